@@ -27,6 +27,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -50,21 +51,18 @@
 
 //#include "compositor.h"
 #include "encoder.h"
+#include "encoder_backend.h"
+#include "h264_nal.h"
+#include "import_cache.h"
+#include "latency_probe.h"
+#include "rate_control.h"
+#include "tile_codec.h"
 #include "ias-shell-client-protocol.h"
+#include "../../shared/h264-bitstream.h"
+#include "../../shared/helpers.h"
 #include "../../shared/timespec-util.h"
 #include "../../shared/zalloc.h"
 
-#define NAL_REF_IDC_NONE        0
-#define NAL_REF_IDC_LOW         1
-#define NAL_REF_IDC_MEDIUM      2
-#define NAL_REF_IDC_HIGH        3
-
-#define NAL_NON_IDR             1
-#define NAL_IDR                 5
-#define NAL_SPS                 7
-#define NAL_PPS                 8
-#define NAL_SEI                 6
-
 #define SLICE_TYPE_P            0
 #define SLICE_TYPE_B            1
 #define SLICE_TYPE_I            2
@@ -72,11 +70,9 @@
 #define ENTROPY_MODE_CAVLC      0
 #define ENTROPY_MODE_CABAC      1
 
-#define PROFILE_IDC_BASELINE    66
-#define PROFILE_IDC_MAIN        77
-#define PROFILE_IDC_HIGH        100
-
-#define MAX_FRAMES              5
+/* Enough output buffers for a full transport queue, the frame being sent
+ * and the frame being encoded. */
+#define MAX_FRAMES              (FRAME_QUEUE_MAX_DEPTH + 2)
 #define BUFFER_STATUS_FREE      0
 #define BUFFER_STATUS_IN_USE    1
 
@@ -86,9 +82,9 @@
 typedef enum {
 	EncoderBufferSequence,
 	EncoderBufferPicture,
-	EncoderBufferSlice,
 	EncoderBufferHRD,
 	EncoderBufferQualityLevel,
+	EncoderBufferRateControl,
 	EncoderBufferSPSHeader,
 	EncoderBufferSPSData,
 	EncoderBufferPPSHeader,
@@ -101,6 +97,35 @@ typedef enum {
 #define US_IN_SEC              1000000
 #define DEFAULT_FPS            60
 
+/* A captured buffer waiting to be encoded */
+struct rd_encode_frame {
+	int prime_fd;
+	int stride;
+	int frame_number;
+	int32_t va_buffer_handle;
+	enum rd_encoder_format format;
+	uint32_t timestamp;
+	uint64_t capture_us;
+	uint32_t shm_surf_id;
+	uint32_t buf_id;
+	uint32_t image_id;
+};
+
+/* An encoded buffer waiting to be sent */
+struct rd_transport_frame {
+	int frame_number;
+	uint32_t timestamp;
+	uint64_t capture_us;
+	struct rd_encoder_output output;
+};
+
+/* Time spent processing frames in one pipeline stage */
+struct rd_stage_stats {
+	uint64_t frames;
+	uint64_t total_us;
+	uint64_t max_us;
+};
+
 struct rd_encoder {
 	int drm_fd;
 	int width, height;
@@ -127,38 +152,49 @@ struct rd_encoder {
 	int destroying_transport;
 	int destroying_encoder;
 
+	/* Earliest time the next captured frame is accepted when --fps
+	 * limits the frame rate */
+	uint64_t next_frame_us;
+
 	/* Encoder thread */
 	pthread_t encoder_thread;
-	pthread_mutex_t encoder_mutex;
-	pthread_cond_t encoder_cond;
-
-	struct {
-		int valid;
-		int prime_fd;
-		int stride;
-		int frame_number;
-		int32_t va_buffer_handle;
-		enum rd_encoder_format format;
-		uint32_t timestamp;
-		uint32_t shm_surf_id;
-		uint32_t buf_id;
-		uint32_t image_id;
-	} current_encode, next_encode;
+	struct frame_queue encode_queue;
+	int encode_queue_depth;
+	enum frame_queue_policy encode_queue_policy;
+	struct rd_encode_frame current_encode;
+	struct rd_stage_stats encode_stats;
 
 	/* Transportation thread */
 	pthread_t transport_thread;
-	pthread_mutex_t transport_mutex;
-	pthread_cond_t transport_cond;
-
-	struct {
-		int valid;
-		int frame_number;
-		int32_t handle;
-		int32_t stream_size;
-		uint32_t timestamp;
-		VABufferID output_buf;
-	} current_transport, next_transport;
-
+	struct frame_queue transport_queue;
+	int transport_queue_depth;
+	enum frame_queue_policy transport_queue_policy;
+	struct rd_transport_frame current_transport;
+	struct rd_stage_stats transport_stats;
+
+	/* Backend that encodes frames, and its private data */
+	const struct rd_encoder_backend *backend;
+	const struct rd_encoder_backend *requested_backend;
+	void *backend_data;
+
+	/* Settings for the tiles backend */
+	int tile_size;
+	int key_interval;
+
+	/* Slices per frame, and whether to put a latency probe ahead of
+	 * each frame */
+	int num_slices;
+	int latency_probe;
+
+	/* Rate control from transport feedback, if enabled. The controller
+	 * runs in the transport thread and publishes its targets for the
+	 * encoder thread and should_skip(). */
+	int rate_control;
+	struct rate_controller rate;
+	uint32_t target_bps;
+	int target_fps;
+
+	/* The rest of this structure is the VA-API backend's */
 	VADisplay va_dpy;
 
 	/* Video post processing is used for colorspace conversion */
@@ -180,6 +216,9 @@ struct rd_encoder {
 
 		struct {
 			VABufferID buffers[num_encoder_buffers];
+			VABufferID slices[RD_ENCODER_MAX_SLICES];
+			int num_slices;
+			uint32_t bits_per_second;
 			int seq_changed;
 			uint32_t last_timestamp;
 			unsigned int time_scale;
@@ -195,6 +234,20 @@ struct rd_encoder {
 		int bufferStatus;
 	} out_buf[MAX_FRAMES];
 
+	/* VA surfaces imported from the compositor's dmabufs, kept while the
+	 * compositor keeps reusing the buffers. flush_imports is set from
+	 * other threads to have the encoder thread empty the cache. */
+	struct import_cache surface_cache;
+	int flush_imports;
+
+	/* Output bitstream buffers as opened by the transport thread */
+	struct {
+		uint32_t id;
+		int32_t handle;
+		drm_intel_bo *bo;
+	} output_bos[MAX_FRAMES];
+	int next_output_bo;
+
 	/* Transport plugin */
 	void *transport_handle;
 	void *transport_private_data;
@@ -202,6 +255,13 @@ struct rd_encoder {
 			drm_intel_bo *drm_bo,
 			int32_t stream_size,
 			uint32_t timestamp);
+	int (*transport_send_slice_fptr)(void *transport_private_data,
+			uint8_t *data,
+			int32_t size,
+			uint32_t timestamp,
+			int last);
+	int (*transport_feedback_fptr)(void *transport_private_data,
+			struct rate_feedback *feedback);
 
 	drm_intel_bufmgr *drm_bufmgr;
 };
@@ -212,151 +272,11 @@ encoder_thread_function(void * const data);
 static void *
 transport_thread_function(void * const data);
 
-/* bitstream code used for writing the packed headers */
-
-#define BITSTREAM_ALLOCATE_STEPPING	 4096
-
-struct bitstream {
-	unsigned int *buffer;
-	int bit_offset;
-	int max_size_in_dword;
-};
-
-static unsigned int
-va_swap32(unsigned int val)
-{
-	unsigned char *pval = (unsigned char *)&val;
-
-	return ((pval[0] << 24) |
-		(pval[1] << 16) |
-		(pval[2] << 8)  |
-		(pval[3] << 0));
-}
-
-static void
-bitstream_start(struct bitstream * const bs)
-{
-	bs->max_size_in_dword = BITSTREAM_ALLOCATE_STEPPING;
-	bs->buffer = calloc(bs->max_size_in_dword * sizeof(unsigned int), 1);
-	bs->bit_offset = 0;
-}
-
-static void
-bitstream_end(struct bitstream * const bs)
-{
-	int pos = (bs->bit_offset >> 5);
-	int bit_offset = (bs->bit_offset & 0x1f);
-	int bit_left = 32 - bit_offset;
-
-	if (!bs->buffer) {
-		fprintf(stderr, "ERROR - No valid bitstream buffer.\n");
-		return;
-	}
-
-	if (bit_offset) {
-		bs->buffer[pos] = va_swap32((bs->buffer[pos] << bit_left));
-	}
-}
-
-static void
-bitstream_put_ui(struct bitstream * const bs, const unsigned int val,
-			int size_in_bits)
-{
-	int pos = (bs->bit_offset >> 5);
-	int bit_offset = (bs->bit_offset & 0x1f);
-	int bit_left = 32 - bit_offset;
-
-	if (!size_in_bits)
-		return;
-
-	if (!bs->buffer) {
-		fprintf(stderr, "ERROR - No valid bitstream buffer.\n");
-		return;
-	}
-
-	bs->bit_offset += size_in_bits;
-
-	if (bit_left > size_in_bits) {
-		bs->buffer[pos] = (bs->buffer[pos] << size_in_bits | val);
-		return;
-	}
-
-	size_in_bits -= bit_left;
-	bs->buffer[pos] =
-		(bs->buffer[pos] << bit_left) | (val >> size_in_bits);
-	bs->buffer[pos] = va_swap32(bs->buffer[pos]);
-
-	if (pos + 1 == bs->max_size_in_dword) {
-		unsigned int *temp_buffer;
-		bs->max_size_in_dword += BITSTREAM_ALLOCATE_STEPPING;
-		/* Assign realloc pointer to a temp_buffer so that if realloc
-		 * fails then we can use the original bs->buffer to handle the
-		 * error, otherwise it would be lost. */
-		temp_buffer =
-			realloc(bs->buffer,
-				bs->max_size_in_dword * sizeof(unsigned int));
-		if (!temp_buffer) {
-			/* Handle error by discarding the buffer. Another option
-			 * might be to just drop the value that we're trying to add
-			 * to the buffer. */
-			free(bs->buffer);
-			bs->buffer = NULL;
-			bs->max_size_in_dword = 0;
-			bs->bit_offset = 0;
-			return;
-		} else {
-			bs->buffer = temp_buffer;
-		}
-	}
-
-	bs->buffer[pos + 1] = val;
-}
-
-static void
-bitstream_put_ue(struct bitstream * const bs, unsigned int val)
-{
-	int size_in_bits = 0;
-	int tmp_val = ++val;
-
-	while (tmp_val) {
-		tmp_val >>= 1;
-		size_in_bits++;
-	}
-
-	bitstream_put_ui(bs, 0, size_in_bits - 1); /* leading zero */
-	bitstream_put_ui(bs, val, size_in_bits);
-}
-
-static void
-bitstream_put_se(struct bitstream * const bs, const int val)
-{
-	unsigned int new_val;
-
-	if (val <= 0)
-		new_val = -2 * val;
-	else
-		new_val = 2 * val - 1;
-
-	bitstream_put_ue(bs, new_val);
-}
+static int
+start_backend(struct rd_encoder * const encoder);
 
 static void
-bitstream_byte_aligning(struct bitstream * const bs, const int bit)
-{
-	int bit_offset = (bs->bit_offset & 0x7);
-	int bit_left = 8 - bit_offset;
-	int new_val;
-
-	if (!bit_offset)
-		return;
-
-	if (bit)
-		new_val = (1 << bit_left) - 1;
-	else
-		new_val = 0;
-
-	bitstream_put_ui(bs, new_val, bit_left);
-}
+put_output_bos(struct rd_encoder * const encoder);
 
 static VAStatus
 encoder_create_config(struct rd_encoder * const encoder)
@@ -404,8 +324,9 @@ encoder_create_config(struct rd_encoder * const encoder)
 	attrib[0].type = VAConfigAttribRTFormat;
 	attrib[0].value = VA_RT_FORMAT_YUV420;
 
+	/* Constant QP unless the bitrate is being steered */
 	attrib[1].type = VAConfigAttribRateControl;
-	attrib[1].value = VA_RC_CQP;
+	attrib[1].value = encoder->rate_control ? VA_RC_CBR : VA_RC_CQP;
 
 	status = vaCreateConfig(encoder->va_dpy, VAProfileH264ConstrainedBaseline,
 				VAEntrypointEncSliceLP, attrib, 2,
@@ -682,6 +603,10 @@ encoder_update_pic_parameters(struct rd_encoder * const encoder,
 	return buffer;
 }
 
+/*
+ * Each slice is a band of whole macroblock rows, so that the slices finish
+ * top to bottom and the transport can send each as soon as it has it.
+ */
 static void
 encoder_init_slice_parameter(struct rd_encoder * const encoder)
 {
@@ -690,7 +615,9 @@ encoder_init_slice_parameter(struct rd_encoder * const encoder)
 	VAEncSliceParameterBufferH264 *slice;
 	int width_in_mbs;
 	int height_in_mbs;
-	int j;
+	int num_slices;
+	int first_row, last_row;
+	int i, j;
 
 	if (encoder == NULL) {
 		fprintf(stderr, "encoder_init_slice_parameter : No encoder.\n");
@@ -700,87 +627,115 @@ encoder_init_slice_parameter(struct rd_encoder * const encoder)
 	width_in_mbs = (encoder->region.w + 15) / 16;
 	height_in_mbs = (encoder->region.h + 15) / 16;
 
-	status = vaCreateBuffer(encoder->va_dpy, encoder->encoder.ctx,
-				VAEncSliceParameterBufferType,
-				sizeof(VAEncSliceParameterBufferH264), 1,
-				NULL, &slice_param_buf);
-	if (status == VA_STATUS_SUCCESS) {
-		encoder->encoder.param.buffers[EncoderBufferSlice] = slice_param_buf;
-	} else {
-		printf("ERROR - failed to create encoder slice parameter buffer.\n");
-		return;
+	num_slices = encoder->num_slices;
+	if (num_slices < 1) {
+		num_slices = 1;
 	}
-
-	status = vaMapBuffer(encoder->va_dpy, slice_param_buf, (void **) &slice);
-	if (status != VA_STATUS_SUCCESS) {
-		printf("ERROR - failed to map slice parameter buffer %d for init.\n",
-				slice_param_buf);
-		return;
+	if (num_slices > height_in_mbs) {
+		num_slices = height_in_mbs;
 	}
+	encoder->encoder.param.num_slices = 0;
 
-	memset(slice, 0, sizeof(VAEncSliceParameterBufferH264));
-	/* Most values in the slice parameter buffer structure stay
-	 * constant between frames. */
-	slice->macroblock_address = 0;
-	slice->num_macroblocks = height_in_mbs * width_in_mbs;
-	slice->pic_parameter_set_id = 0;
-	slice->direct_spatial_mv_pred_flag = 0;
-	slice->num_ref_idx_l0_active_minus1 = 0;
-	slice->num_ref_idx_l1_active_minus1 = 0;
-	slice->cabac_init_idc = 0;
-	slice->slice_qp_delta = 0;
-	slice->disable_deblocking_filter_idc = 0;
-	slice->slice_alpha_c0_offset_div2 = 2;
-	slice->slice_beta_offset_div2 = 2;
-	slice->idr_pic_id = 0;
+	for (i = 0; i < num_slices; i++) {
+		status = vaCreateBuffer(encoder->va_dpy, encoder->encoder.ctx,
+					VAEncSliceParameterBufferType,
+					sizeof(VAEncSliceParameterBufferH264), 1,
+					NULL, &slice_param_buf);
+		if (status == VA_STATUS_SUCCESS) {
+			encoder->encoder.param.slices[i] = slice_param_buf;
+			encoder->encoder.param.num_slices = i + 1;
+		} else {
+			printf("ERROR - failed to create encoder slice parameter buffer.\n");
+			return;
+		}
 
-	for (j = 1; j < 32; j++) {
-		slice->RefPicList0[j].picture_id = VA_INVALID_ID;
-		slice->RefPicList0[j].flags = VA_PICTURE_H264_INVALID;
-	}
-	for (j = 0; j < 32; j++) {
-		slice->RefPicList1[j].picture_id = VA_INVALID_ID;
-		slice->RefPicList1[j].flags = VA_PICTURE_H264_INVALID;
-	}
+		status = vaMapBuffer(encoder->va_dpy, slice_param_buf, (void **) &slice);
+		if (status != VA_STATUS_SUCCESS) {
+			printf("ERROR - failed to map slice parameter buffer %d for init.\n",
+					slice_param_buf);
+			return;
+		}
+
+		first_row = height_in_mbs * i / num_slices;
+		last_row = height_in_mbs * (i + 1) / num_slices;
+
+		memset(slice, 0, sizeof(VAEncSliceParameterBufferH264));
+		/* Most values in the slice parameter buffer structure stay
+		 * constant between frames. */
+		slice->macroblock_address = first_row * width_in_mbs;
+		slice->num_macroblocks = (last_row - first_row) * width_in_mbs;
+		slice->pic_parameter_set_id = 0;
+		slice->direct_spatial_mv_pred_flag = 0;
+		slice->num_ref_idx_l0_active_minus1 = 0;
+		slice->num_ref_idx_l1_active_minus1 = 0;
+		slice->cabac_init_idc = 0;
+		slice->slice_qp_delta = 0;
+		slice->disable_deblocking_filter_idc = 0;
+		slice->slice_alpha_c0_offset_div2 = 2;
+		slice->slice_beta_offset_div2 = 2;
+		slice->idr_pic_id = 0;
+
+		for (j = 1; j < 32; j++) {
+			slice->RefPicList0[j].picture_id = VA_INVALID_ID;
+			slice->RefPicList0[j].flags = VA_PICTURE_H264_INVALID;
+		}
+		for (j = 0; j < 32; j++) {
+			slice->RefPicList1[j].picture_id = VA_INVALID_ID;
+			slice->RefPicList1[j].flags = VA_PICTURE_H264_INVALID;
+		}
 
-	vaUnmapBuffer(encoder->va_dpy, slice_param_buf);
+		vaUnmapBuffer(encoder->va_dpy, slice_param_buf);
+	}
 }
 
-static VABufferID
-encoder_update_slice_parameter(struct rd_encoder * const encoder,
-		const int slice_type)
+/*
+ * Update every slice for the next frame and add them to 'buffers'. Returns
+ * the number of buffers added, or -1 on failure.
+ */
+static int
+encoder_update_slice_parameters(struct rd_encoder * const encoder,
+		const int slice_type, VABufferID * const buffers)
 {
 	VAStatus status;
 	VAEncSliceParameterBufferH264 *slice;
 	VABufferID slice_param_buf = VA_INVALID_ID;
+	int i;
 
 	if (encoder == NULL) {
-		fprintf(stderr, "encoder_update_slice_parameter : No encoder.\n");
-		return VA_INVALID_ID;
+		fprintf(stderr, "encoder_update_slice_parameters : No encoder.\n");
+		return -1;
 	}
 
-	slice_param_buf = encoder->encoder.param.buffers[EncoderBufferSlice];
-	status = vaMapBuffer(encoder->va_dpy, slice_param_buf, (void **) &slice);
-	if (status != VA_STATUS_SUCCESS) {
-		printf("ERROR - failed to map slice parameter buffer %d for update.\n",
-				slice_param_buf);
-		return VA_INVALID_ID;
+	if (encoder->encoder.param.num_slices == 0) {
+		return -1;
 	}
 
-	slice->slice_type = slice_type;
-	slice->pic_order_cnt_lsb = encoder->frame_count * 2;
+	for (i = 0; i < encoder->encoder.param.num_slices; i++) {
+		slice_param_buf = encoder->encoder.param.slices[i];
+		status = vaMapBuffer(encoder->va_dpy, slice_param_buf, (void **) &slice);
+		if (status != VA_STATUS_SUCCESS) {
+			printf("ERROR - failed to map slice parameter buffer %d for update.\n",
+					slice_param_buf);
+			return -1;
+		}
 
-	if (slice_type == SLICE_TYPE_I) {
-		slice->RefPicList0[0].picture_id = VA_INVALID_ID;
-		slice->RefPicList0[0].flags = VA_PICTURE_H264_INVALID;
-	} else {
-		slice->RefPicList0[0].picture_id =
-				encoder->encoder.reference_picture[(encoder->frame_count + 1) % 2];
-		slice->RefPicList0[0].flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE;
+		slice->slice_type = slice_type;
+		slice->pic_order_cnt_lsb = encoder->frame_count * 2;
+
+		if (slice_type == SLICE_TYPE_I) {
+			slice->RefPicList0[0].picture_id = VA_INVALID_ID;
+			slice->RefPicList0[0].flags = VA_PICTURE_H264_INVALID;
+		} else {
+			slice->RefPicList0[0].picture_id =
+					encoder->encoder.reference_picture[(encoder->frame_count + 1) % 2];
+			slice->RefPicList0[0].flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE;
+		}
+
+		vaUnmapBuffer(encoder->va_dpy, slice_param_buf);
+		buffers[i] = slice_param_buf;
 	}
 
-	vaUnmapBuffer(encoder->va_dpy, slice_param_buf);
-	return slice_param_buf;
+	return encoder->encoder.param.num_slices;
 }
 
 static void
@@ -833,9 +788,67 @@ encoder_init_misc_parameters(struct rd_encoder * const encoder)
 			vaUnmapBuffer(encoder->va_dpy, buffer);
 		}
 	}
+
+	if (!encoder->rate_control) {
+		return;
+	}
+
+	buffer = VA_INVALID_ID;
+	total_size =
+		sizeof(VAEncMiscParameterBuffer) +
+		sizeof(VAEncMiscParameterRateControl);
+	status = vaCreateBuffer(encoder->va_dpy, encoder->encoder.ctx,
+			VAEncMiscParameterBufferType, total_size,
+			1, NULL, &buffer);
+	if (status == VA_STATUS_SUCCESS) {
+		encoder->encoder.param.buffers[EncoderBufferRateControl] = buffer;
+	} else {
+		printf("ERROR - failed to create encoder rate control parameter buffer.\n");
+	}
+	encoder->encoder.param.bits_per_second = 0;
+}
+
+/* Pass on the rate controller's latest target bitrate */
+static VABufferID
+encoder_update_rate_control(struct rd_encoder * const encoder)
+{
+	VAEncMiscParameterBuffer *misc_param;
+	VAEncMiscParameterRateControl *rate;
+	VABufferID buffer;
+	VAStatus status;
+	uint32_t bits_per_second;
+
+	buffer = encoder->encoder.param.buffers[EncoderBufferRateControl];
+	bits_per_second = __atomic_load_n(&encoder->target_bps,
+			__ATOMIC_RELAXED);
+	if (bits_per_second == encoder->encoder.param.bits_per_second) {
+		return buffer;
+	}
+
+	status = vaMapBuffer(encoder->va_dpy, buffer, (void **) &misc_param);
+	if (status != VA_STATUS_SUCCESS) {
+		printf("ERROR - failed to map rate control parameter buffer %d for update.\n",
+				buffer);
+		return VA_INVALID_ID;
+	}
+
+	misc_param->type = VAEncMiscParameterTypeRateControl;
+	rate = (VAEncMiscParameterRateControl *) misc_param->data;
+	memset(rate, 0, sizeof(*rate));
+	rate->bits_per_second = bits_per_second;
+	rate->target_percentage = 100;
+	rate->window_size = 1000;
+	rate->initial_qp = 26;
+	rate->min_qp = 1;
+
+	vaUnmapBuffer(encoder->va_dpy, buffer);
+	encoder->encoder.param.bits_per_second = bits_per_second;
+
+	return buffer;
 }
 
-/* Can probably remove this, since values do not change. */
+/* The HRD buffer only matters with rate control, when it holds a second of
+ * the target bitrate. */
 static VABufferID
 encoder_update_HRD_parameters(const struct rd_encoder * const encoder)
 {
@@ -860,8 +873,14 @@ encoder_update_HRD_parameters(const struct rd_encoder * const encoder)
 	misc_param->type = VAEncMiscParameterTypeHRD;
 	hrd = (VAEncMiscParameterHRD *) misc_param->data;
 
-	hrd->initial_buffer_fullness = 0;
-	hrd->buffer_size = 0;
+	if (encoder->rate_control) {
+		hrd->buffer_size = __atomic_load_n(&encoder->target_bps,
+				__ATOMIC_RELAXED);
+		hrd->initial_buffer_fullness = hrd->buffer_size / 2;
+	} else {
+		hrd->initial_buffer_fullness = 0;
+		hrd->buffer_size = 0;
+	}
 
 	vaUnmapBuffer(encoder->va_dpy, buffer);
 
@@ -902,6 +921,7 @@ setup_encoder(struct rd_encoder * const encoder)
 	for (i = 0; i < num_encoder_buffers; i++) {
 		encoder->encoder.param.buffers[i] = VA_INVALID_ID;
 	}
+	encoder->encoder.param.num_slices = 0;
 
 	encoder_init_seq_parameters(encoder);
 	encoder_init_pic_parameters(encoder);
@@ -926,215 +946,98 @@ encoder_destroy_encode_session(struct rd_encoder * const encoder)
 			encoder->encoder.param.buffers[i] = VA_INVALID_ID;
 		}
 	}
+	for (i = 0; i < encoder->encoder.param.num_slices; i++) {
+		vaDestroyBuffer(encoder->va_dpy, encoder->encoder.param.slices[i]);
+	}
+	encoder->encoder.param.num_slices = 0;
 
 	vaDestroySurfaces(encoder->va_dpy, encoder->encoder.reference_picture, 3);
 	encoder_destroy_config(encoder);
 }
 
-static void
-nal_start_code_prefix(struct bitstream *bs)
-{
-	bitstream_put_ui(bs, 0x00000001, 32);
-}
-
-static void
-nal_header(struct bitstream *bs, const int nal_ref_idc, const int nal_unit_type)
-{
-	/* forbidden_zero_bit: 0 */
-	bitstream_put_ui(bs, 0, 1);
-
-	bitstream_put_ui(bs, nal_ref_idc, 2);
-	bitstream_put_ui(bs, nal_unit_type, 5);
-}
-
-static void
-rbsp_trailing_bits(struct bitstream *bs)
-{
-	bitstream_put_ui(bs, 1, 1);
-	bitstream_byte_aligning(bs, 0);
-}
-
-/* If none of the inputs to this change after init then we can just do
- * this at init. */
-static void sps_rbsp(struct bitstream *bs,
-			const VAEncSequenceParameterBufferH264 * const seq,
-			const int constraint_set_flag)
-{
-	int i;
-
-	bitstream_put_ui(bs, PROFILE_IDC_BASELINE, 8);
-
-	/* constraint_set[0-3] flag */
-	for (i = 0; i < 4; i++) {
-		int set = (constraint_set_flag & (1 << i)) ? 1 : 0;
-		bitstream_put_ui(bs, set, 1);
-	}
-
-	/* reserved_zero_4bits */
-	bitstream_put_ui(bs, 0, 4);
-	bitstream_put_ui(bs, seq->level_idc, 8);
-	bitstream_put_ue(bs, seq->seq_parameter_set_id);
-
-	bitstream_put_ue(bs, seq->seq_fields.bits.log2_max_frame_num_minus4);
-	bitstream_put_ue(bs, seq->seq_fields.bits.pic_order_cnt_type);
-	bitstream_put_ue(bs,
-			 seq->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4);
-
-	bitstream_put_ue(bs, seq->max_num_ref_frames);
-
-	/* gaps_in_frame_num_value_allowed_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* pic_width_in_mbs_minus1, pic_height_in_map_units_minus1 */
-	bitstream_put_ue(bs, seq->picture_width_in_mbs - 1);
-	bitstream_put_ue(bs, seq->picture_height_in_mbs - 1);
-
-	bitstream_put_ui(bs, seq->seq_fields.bits.frame_mbs_only_flag, 1);
-	bitstream_put_ui(bs, seq->seq_fields.bits.direct_8x8_inference_flag, 1);
-
-	bitstream_put_ui(bs, seq->frame_cropping_flag, 1);
-
-	if (seq->frame_cropping_flag) {
-		bitstream_put_ue(bs, seq->frame_crop_left_offset);
-		bitstream_put_ue(bs, seq->frame_crop_right_offset);
-		bitstream_put_ue(bs, seq->frame_crop_top_offset);
-		bitstream_put_ue(bs, seq->frame_crop_bottom_offset);
-	}
-
-	/* vui_parameters_present_flag */
-	bitstream_put_ui(bs, 1, 1);
-
-	/* aspect_ratio_info_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	/* overscan_info_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* video_signal_type_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	/* chroma_loc_info_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* timing_info_present_flag */
-	bitstream_put_ui(bs, 1, 1);
-	bitstream_put_ui(bs, seq->num_units_in_tick, 32);
-	bitstream_put_ui(bs, seq->time_scale, 32);
-
-	/* fixed_frame_rate_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* nal_hrd_parameters_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* vcl_hrd_parameters_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* low_delay_hrd_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* pic_struct_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	/* bitstream_restriction_flag */
-	bitstream_put_ui(bs, 0, 1);
-
-	rbsp_trailing_bits(bs);
-}
-
-static void pps_rbsp(struct bitstream *bs,
-			const struct rd_encoder * const encoder)
+static int
+build_packed_pic_buffer(const struct rd_encoder * const encoder,
+			uint8_t * const header_buffer)
 {
 	VABufferID buffer = encoder->encoder.param.buffers[EncoderBufferPicture];
 	VAEncPictureParameterBufferH264 *pic;
+	struct h264_pps pps;
 	VAStatus status;
+	int bit_length;
 
 	status = vaMapBuffer(encoder->va_dpy, buffer, (void **) &pic);
 	if (status != VA_STATUS_SUCCESS) {
-		printf("ERROR - pps_rbsp failed to map picture parameter buffer %d.\n",
+		printf("ERROR - build_packed_pic_buffer failed to map picture parameter buffer %d.\n",
 				buffer);
-	} else {
-		/* pic_parameter_set_id, seq_parameter_set_id */
-		bitstream_put_ue(bs, pic->pic_parameter_set_id);
-		bitstream_put_ue(bs, pic->seq_parameter_set_id);
-
-		bitstream_put_ui(bs, pic->pic_fields.bits.entropy_coding_mode_flag, 1);
-
-		/* pic_order_present_flag: 0 */
-		bitstream_put_ui(bs, 0, 1);
-
-		/* num_slice_groups_minus1 */
-		bitstream_put_ue(bs, 0);
-
-		bitstream_put_ue(bs, pic->num_ref_idx_l0_active_minus1);
-		bitstream_put_ue(bs, pic->num_ref_idx_l1_active_minus1);
-
-		bitstream_put_ui(bs, pic->pic_fields.bits.weighted_pred_flag, 1);
-		bitstream_put_ui(bs, pic->pic_fields.bits.weighted_bipred_idc, 2);
-
-		/* pic_init_qp_minus26, pic_init_qs_minus26, chroma_qp_index_offset */
-		bitstream_put_se(bs, pic->pic_init_qp - 26);
-		bitstream_put_se(bs, 0);
-		bitstream_put_se(bs, 0);
-
-		bitstream_put_ui(bs, pic->pic_fields.bits.deblocking_filter_control_present_flag, 1);
-
-		/* constrained_intra_pred_flag, redundant_pic_cnt_present_flag */
-		bitstream_put_ui(bs, 0, 1);
-		bitstream_put_ui(bs, 0, 1);
-
-		bitstream_put_ui(bs, pic->pic_fields.bits.transform_8x8_mode_flag, 1);
-
-		/* pic_scaling_matrix_present_flag */
-		bitstream_put_ui(bs, 0, 1);
-		bitstream_put_se(bs, pic->second_chroma_qp_index_offset);
-
-		vaUnmapBuffer(encoder->va_dpy, buffer);
+		return 0;
 	}
 
-	rbsp_trailing_bits(bs);
-}
-
-static int
-build_packed_pic_buffer(const struct rd_encoder * const encoder,
-			void ** const header_buffer)
-{
-	struct bitstream bs;
+	memset(&pps, 0, sizeof(pps));
+	pps.pic_parameter_set_id = pic->pic_parameter_set_id;
+	pps.seq_parameter_set_id = pic->seq_parameter_set_id;
+	pps.entropy_coding_mode_flag = pic->pic_fields.bits.entropy_coding_mode_flag;
+	pps.num_ref_idx_l0_active_minus1 = pic->num_ref_idx_l0_active_minus1;
+	pps.num_ref_idx_l1_active_minus1 = pic->num_ref_idx_l1_active_minus1;
+	pps.weighted_pred_flag = pic->pic_fields.bits.weighted_pred_flag;
+	pps.weighted_bipred_idc = pic->pic_fields.bits.weighted_bipred_idc;
+	pps.pic_init_qp = pic->pic_init_qp;
+	pps.deblocking_filter_control_present_flag =
+		pic->pic_fields.bits.deblocking_filter_control_present_flag;
+	pps.transform_8x8_mode_flag = pic->pic_fields.bits.transform_8x8_mode_flag;
+	pps.second_chroma_qp_index_offset = pic->second_chroma_qp_index_offset;
 
-	bitstream_start(&bs);
-	nal_start_code_prefix(&bs);
-	nal_header(&bs, NAL_REF_IDC_HIGH, NAL_PPS);
-	pps_rbsp(&bs, encoder);
-	bitstream_end(&bs);
+	vaUnmapBuffer(encoder->va_dpy, buffer);
 
-	*header_buffer = bs.buffer;
-	return bs.bit_offset;
+	bit_length = h264_write_pps(&pps, header_buffer, H264_MAX_HEADER_BYTES);
+	return bit_length < 0 ? 0 : bit_length;
 }
 
 static int
 build_packed_seq_buffer(const struct rd_encoder * const encoder,
-			void ** const header_buffer)
+			uint8_t * const header_buffer)
 {
-	struct bitstream bs;
+	VABufferID seq_buf = encoder->encoder.param.buffers[EncoderBufferSequence];
 	VAEncSequenceParameterBufferH264 *seq;
+	struct h264_sps sps;
 	VAStatus status;
-	VABufferID seq_buf;
-
-	bitstream_start(&bs);
-	nal_start_code_prefix(&bs);
-	nal_header(&bs, NAL_REF_IDC_HIGH, NAL_SPS);
+	int bit_length;
 
-	seq_buf = encoder->encoder.param.buffers[EncoderBufferSequence];
 	status = vaMapBuffer(encoder->va_dpy, seq_buf, (void **) &seq);
 	if (status != VA_STATUS_SUCCESS) {
 		printf("ERROR - build_packed_seq_buffer failed to map sequence parameter buffer %d.\n",
 				seq_buf);
-	} else {
-		sps_rbsp(&bs, seq, encoder->encoder.constraint_set_flag);
-		vaUnmapBuffer(encoder->va_dpy, seq_buf);
+		return 0;
 	}
 
-	bitstream_end(&bs);
+	memset(&sps, 0, sizeof(sps));
+	sps.profile_idc = H264_PROFILE_IDC_BASELINE;
+	sps.constraint_set_flags = encoder->encoder.constraint_set_flag;
+	sps.level_idc = seq->level_idc;
+	sps.seq_parameter_set_id = seq->seq_parameter_set_id;
+	sps.log2_max_frame_num_minus4 = seq->seq_fields.bits.log2_max_frame_num_minus4;
+	sps.pic_order_cnt_type = seq->seq_fields.bits.pic_order_cnt_type;
+	sps.log2_max_pic_order_cnt_lsb_minus4 =
+		seq->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4;
+	sps.max_num_ref_frames = seq->max_num_ref_frames;
+	sps.width_in_mbs = seq->picture_width_in_mbs;
+	sps.height_in_mbs = seq->picture_height_in_mbs;
+	sps.frame_mbs_only_flag = seq->seq_fields.bits.frame_mbs_only_flag;
+	sps.direct_8x8_inference_flag =
+		seq->seq_fields.bits.direct_8x8_inference_flag;
+	sps.frame_cropping_flag = seq->frame_cropping_flag;
+	sps.frame_crop_left_offset = seq->frame_crop_left_offset;
+	sps.frame_crop_right_offset = seq->frame_crop_right_offset;
+	sps.frame_crop_top_offset = seq->frame_crop_top_offset;
+	sps.frame_crop_bottom_offset = seq->frame_crop_bottom_offset;
+	sps.num_units_in_tick = seq->num_units_in_tick;
+	sps.time_scale = seq->time_scale;
+	/* The frame rate follows the compositor's, so isn't fixed */
+	sps.fixed_frame_rate_flag = 0;
+
+	vaUnmapBuffer(encoder->va_dpy, seq_buf);
 
-	*header_buffer = bs.buffer;
-	return bs.bit_offset;
+	bit_length = h264_write_sps(&sps, header_buffer, H264_MAX_HEADER_BYTES);
+	return bit_length < 0 ? 0 : bit_length;
 }
 
 static int
@@ -1148,7 +1051,7 @@ create_packed_header_buffers(const struct rd_encoder * const encoder,
 
 	packed_header.type = type;
 	packed_header.bit_length = bit_length;
-	packed_header.has_emulation_bytes = 0;
+	packed_header.has_emulation_bytes = 1;
 
 	status = vaCreateBuffer(encoder->va_dpy, encoder->encoder.ctx,
 				VAEncPackedHeaderParameterBufferType,
@@ -1180,7 +1083,7 @@ encoder_prepare_headers(struct rd_encoder * const encoder,
 {
 	VABufferID *p = buffers;
 	int bit_length;
-	void *data = NULL;
+	uint8_t data[H264_MAX_HEADER_BYTES];
 	VAStatus status;
 
 	if (encoder->encoder.param.seq_changed) {
@@ -1200,11 +1103,9 @@ encoder_prepare_headers(struct rd_encoder * const encoder,
 					encoder->encoder.param.buffers[EncoderBufferSPSData]);
 			}
 		}
-		bit_length = build_packed_seq_buffer(encoder, &data);
+		bit_length = build_packed_seq_buffer(encoder, data);
 		p += create_packed_header_buffers(encoder, p, VAEncPackedHeaderSequence,
 					data, bit_length);
-		free(data);
-		data = NULL;
 		encoder->encoder.param.buffers[EncoderBufferSPSHeader] = *(p-2);
 		encoder->encoder.param.buffers[EncoderBufferSPSData] = *(p-1);
 		encoder->encoder.param.seq_changed = 0;
@@ -1230,10 +1131,9 @@ encoder_prepare_headers(struct rd_encoder * const encoder,
 				encoder->encoder.param.buffers[EncoderBufferPPSData]);
 		}
 	}
-	bit_length = build_packed_pic_buffer(encoder, &data);
+	bit_length = build_packed_pic_buffer(encoder, data);
 	p += create_packed_header_buffers(encoder, p, VAEncPackedHeaderPicture,
 					data, bit_length);
-	free(data);
 	encoder->encoder.param.buffers[EncoderBufferPPSHeader] = *(p-2);
 	encoder->encoder.param.buffers[EncoderBufferPPSData] = *(p-1);
 
@@ -1345,12 +1245,14 @@ enum output_write_status {
 
 static enum output_write_status
 encoder_write_output(struct rd_encoder * const encoder,
-		const VABufferID output_buf)
+		const VABufferID output_buf, const int is_idr,
+		struct rd_encoder_output * const output)
 {
-	VACodedBufferSegment *segment;
+	VACodedBufferSegment *segment, *next;
 	VAStatus status;
 	VABufferInfo buf_info;
 	unsigned int stream_size = 0;
+	int num_slices;
 	int frame_number;
 #ifdef PROFILE_REMOTE_DISPLAY
 	struct timespec start_spec, end_spec;
@@ -1406,7 +1308,27 @@ encoder_write_output(struct rd_encoder * const encoder,
 		return OUTPUT_WRITE_OVERFLOW;
 	}
 
+	/* Drivers may return each slice as its own segment. The transport
+	 * sends the buffer from its start, so only take the segments that
+	 * carry on directly from the first. */
 	stream_size = segment->size;
+	for (next = segment->next; next; next = next->next) {
+		if (next->status & VA_CODED_BUF_STATUS_SLICE_OVERFLOW_MASK) {
+			encoder->encoder.output_size *= 2;
+			vaUnmapBuffer(encoder->va_dpy, output_buf);
+			return OUTPUT_WRITE_OVERFLOW;
+		}
+		if ((uint8_t *) next->buf !=
+				(uint8_t *) segment->buf + stream_size) {
+			break;
+		}
+		stream_size += next->size;
+	}
+
+	/* Find where each slice ends, so that the transport can send the
+	 * frame a slice at a time. */
+	num_slices = h264_split_slices(segment->buf, stream_size,
+			output->slice_end, RD_ENCODER_MAX_SLICES);
 
 #ifdef PROFILE_REMOTE_DISPLAY
 	if (encoder->profile_level > 1) {
@@ -1442,20 +1364,13 @@ encoder_write_output(struct rd_encoder * const encoder,
 		return OUTPUT_WRITE_FATAL;
 	}
 
-	pthread_mutex_lock(&encoder->transport_mutex);
-	if (encoder->next_transport.valid == 1) {
-		fprintf(stderr, "WARNING: transport dropping frame %d.\n",
-			encoder->next_transport.frame_number);
-			rd_encoder_release_buffer(encoder, encoder->next_transport.output_buf);
-	}
-	encoder->next_transport.handle = buf_info.handle;
-	encoder->next_transport.stream_size = stream_size;
-	encoder->next_transport.timestamp = encoder->current_encode.timestamp;
-	encoder->next_transport.output_buf = output_buf;
-	encoder->next_transport.frame_number = encoder->current_encode.frame_number;
-	encoder->next_transport.valid = 1;
-	pthread_cond_signal(&encoder->transport_cond);
-	pthread_mutex_unlock(&encoder->transport_mutex);
+	output->id = output_buf;
+	output->handle = buf_info.handle;
+	output->data = NULL;
+	output->size = stream_size;
+	output->is_idr = is_idr;
+	output->dropped = 0;
+	output->num_slices = num_slices;
 
 #ifdef PROFILE_REMOTE_DISPLAY
 	if (encoder->profile_level > 1) {
@@ -1472,13 +1387,18 @@ encoder_write_output(struct rd_encoder * const encoder,
 	return OUTPUT_WRITE_SUCCESS;
 }
 
-static void
-encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input)
+static int
+encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input,
+		struct rd_encoder_output * const output)
 {
 	VABufferID output_buf = VA_INVALID_ID;
-	VABufferID buffers[8];
+	/* Sequence, HRD, quality level and rate control, up to four packed
+	 * headers, the picture and the slices */
+	VABufferID buffers[9 + RD_ENCODER_MAX_SLICES];
 	int bufferCount = 0;
 	int numParamBuffers = 0;
+	int numFrameBuffers;
+	int numSliceBuffers;
 	int i, slice_type;
 	int frame_number;
 	enum output_write_status ret = 0;
@@ -1489,7 +1409,7 @@ encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input)
 
 	if (encoder == NULL) {
 		fprintf(stderr, "encoder_encode : No encoder.\n");
-		return;
+		return -1;
 	}
 
 #ifdef PROFILE_REMOTE_DISPLAY
@@ -1511,12 +1431,15 @@ encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input)
 	buffers[bufferCount++] = encoder_update_seq_parameters(encoder);
 	buffers[bufferCount++] = encoder_update_HRD_parameters(encoder);
 	buffers[bufferCount++] = encoder->encoder.param.buffers[EncoderBufferQualityLevel];
+	if (encoder->rate_control) {
+		buffers[bufferCount++] = encoder_update_rate_control(encoder);
+	}
 	numParamBuffers = bufferCount;
 
 	for (i = 0; i < numParamBuffers; i++)
 		if (buffers[i] == VA_INVALID_ID) {
 			printf("Invalid parameter buffer.\n");
-			return;
+			return -1;
 		}
 
 	/* Send SPS/PPS before every I frame or after a frame rate change. */
@@ -1528,28 +1451,32 @@ encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input)
 				buffers + bufferCount);
 		bufferCount += numHeaderBuffers;
 	}
+	numFrameBuffers = bufferCount;
 
 	do {
+		bufferCount = numFrameBuffers;
+
 		/* Keep retrying with larger buffer sizes until we have success. */
 		output_buf = encoder_get_output_buffer(encoder);
 		if (output_buf == VA_INVALID_ID) {
 			printf("Invalid output buffer.\n");
-			return;
+			return -1;
 		}
 
 		buffers[bufferCount++] =
 			encoder_update_pic_parameters(encoder, output_buf, slice_type);
 		if (buffers[bufferCount - 1] == VA_INVALID_ID) {
 			printf("Invalid pic parameters buffer.\n");
-			return;
+			return -1;
 		}
 
-		buffers[bufferCount++] = encoder_update_slice_parameter(encoder,
-				slice_type);
-		if (buffers[bufferCount - 1] == VA_INVALID_ID) {
+		numSliceBuffers = encoder_update_slice_parameters(encoder,
+				slice_type, buffers + bufferCount);
+		if (numSliceBuffers < 0) {
 			printf("Invalid image data buffer.\n");
-			return;
+			return -1;
 		}
+		bufferCount += numSliceBuffers;
 
 		encoder_render_picture(encoder, input, buffers, bufferCount);
 
@@ -1564,7 +1491,8 @@ encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input)
 	}
 #endif
 
-		ret = encoder_write_output(encoder, output_buf);
+		ret = encoder_write_output(encoder, output_buf,
+				slice_type == SLICE_TYPE_I, output);
 
 		/* The output buffer is to be destroyed on encoder destruction
 		 * in the normal case but we need to destroy it before creating
@@ -1591,7 +1519,7 @@ encoder_encode(struct rd_encoder * const encoder, const VASurfaceID input)
 					frame_number, duration);
 	}
 #endif
-	return;
+	return ret == OUTPUT_WRITE_SUCCESS ? 0 : -1;
 }
 
 
@@ -1668,29 +1596,130 @@ vpp_destroy(struct rd_encoder * const encoder)
 	}
 }
 
-static int
-setup_encoder_thread(struct rd_encoder * const encoder)
+static uint64_t
+monotonic_us(void)
 {
-	int err;
+	struct timespec spec;
 
-	if (encoder == NULL) {
-		fprintf(stderr, "setup_encoder_thread : No encoder.\n");
-		return -1;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return timespec_to_usec(&spec);
+}
 
-	err = pthread_mutex_init(&encoder->encoder_mutex, NULL);
-	if (err != 0) {
-		fprintf(stderr, "Encoder mutex init failure: %d\n", err);
-		return err;
+static void
+stage_stats_add(struct rd_stage_stats * const stats, const uint64_t start_us)
+{
+	uint64_t duration = monotonic_us() - start_us;
+
+	stats->frames++;
+	stats->total_us += duration;
+	if (duration > stats->max_us) {
+		stats->max_us = duration;
+	}
+}
+
+static void
+print_stage_stats(const char *name, struct frame_queue * const queue,
+		const struct rd_stage_stats * const stage)
+{
+	struct frame_queue_stats stats;
+
+	frame_queue_get_stats(queue, &stats);
+
+	printf("RD-ENCODER:\t%s queue (depth %u, %s): %" PRIu64 " queued, "
+		"%" PRIu64 " dropped, occupancy avg %.2f max %u, "
+		"wait avg %" PRIu64 " us max %" PRIu64 " us.\n",
+		name, queue->depth, frame_queue_policy_name(queue->policy),
+		stats.pushed, stats.dropped,
+		stats.pushed ? (double) stats.occupancy_total / stats.pushed : 0.0,
+		stats.occupancy_max,
+		stats.popped ? stats.latency_total_us / stats.popped : 0,
+		stats.latency_max_us);
+	printf("RD-ENCODER:\t%s stage: %" PRIu64 " frames, "
+		"avg %" PRIu64 " us max %" PRIu64 " us.\n",
+		name, stage->frames,
+		stage->frames ? stage->total_us / stage->frames : 0,
+		stage->max_us);
+}
+
+/* Give a captured buffer back to the compositor. */
+static void
+release_capture_buffer(struct rd_encoder * const encoder,
+		struct rd_encode_frame * const frame)
+{
+	if (frame->va_buffer_handle) {
+		/* Shared memory surface. */
+		ias_hmi_release_buffer_handle(encoder->hmi,
+			frame->shm_surf_id,
+			frame->buf_id,
+			frame->image_id,
+			encoder->surfid, 0);
+	} else {
+		close(frame->prime_fd);
+		frame->prime_fd = -1;
+		if (encoder->surfid) {
+			/* Wayland buffer surface. */
+			ias_hmi_release_buffer_handle(encoder->hmi, 0, 0, 0,
+					encoder->surfid, 0);
+		} else {
+			/* Full framebuffer. */
+			ias_hmi_release_buffer_handle(encoder->hmi, 0, 0, 0, 0,
+					encoder->output_number);
+		}
+	}
+}
+
+/* Release a captured buffer that won't be encoded. */
+static void
+drop_encode_frame(void *data, void *elem)
+{
+	struct rd_encoder *encoder = data;
+	struct rd_encode_frame *frame = elem;
+
+	if (encoder->verbose || encoder->profile_level) {
+		printf("RD-ENCODER:\tFrame[%d] dropped before encoding.\n",
+			frame->frame_number);
+	}
+
+	release_capture_buffer(encoder, frame);
+}
+
+/* Hand the output of an encoded frame that won't be sent back to the
+ * backend. */
+static void
+drop_transport_frame(void *data, void *elem)
+{
+	struct rd_encoder *encoder = data;
+	struct rd_transport_frame *frame = elem;
+
+	fprintf(stderr, "WARNING: transport dropping frame %d.\n",
+		frame->frame_number);
+	frame->output.dropped = 1;
+	encoder->backend->release(encoder->backend_data, &frame->output);
+}
+
+static int
+setup_encoder_thread(struct rd_encoder * const encoder)
+{
+	int err;
+
+	if (encoder == NULL) {
+		fprintf(stderr, "setup_encoder_thread : No encoder.\n");
+		return -1;
 	}
-	err = pthread_cond_init(&encoder->encoder_cond, NULL);
+
+	err = frame_queue_init(&encoder->encode_queue,
+			encoder->encode_queue_depth,
+			sizeof(struct rd_encode_frame),
+			encoder->encode_queue_policy,
+			drop_encode_frame, encoder);
 	if (err != 0) {
-		fprintf(stderr, "Encoder condition init failure: %d\n", err);
+		fprintf(stderr, "Encoder queue init failure: %d\n", err);
 		return err;
 	}
 	err = pthread_create(&encoder->encoder_thread, NULL, encoder_thread_function, encoder);
 	if (err != 0) {
 		fprintf(stderr, "Encoder thread creation failure: %d\n", err);
+		frame_queue_fini(&encoder->encode_queue);
 		return err;
 	}
 
@@ -1707,19 +1736,19 @@ setup_transport_thread(struct rd_encoder * const encoder)
 		return -1;
 	}
 
-	err = pthread_mutex_init(&encoder->transport_mutex, NULL);
+	err = frame_queue_init(&encoder->transport_queue,
+			encoder->transport_queue_depth,
+			sizeof(struct rd_transport_frame),
+			encoder->transport_queue_policy,
+			drop_transport_frame, encoder);
 	if (err != 0) {
-		fprintf(stderr, "Transport mutex init failure: %d\n", err);
-		return err;
-	}
-	err = pthread_cond_init(&encoder->transport_cond, NULL);
-	if (err != 0) {
-		fprintf(stderr, "Transport condition init failure: %d\n", err);
+		fprintf(stderr, "Transport queue init failure: %d\n", err);
 		return err;
 	}
 	err = pthread_create(&encoder->transport_thread, NULL, transport_thread_function, encoder);
 	if (err != 0) {
 		fprintf(stderr, "Transport thread creation failure: %d\n", err);
+		frame_queue_fini(&encoder->transport_queue);
 		return err;
 	}
 
@@ -1731,20 +1760,16 @@ destroy_encoder_thread(struct rd_encoder * const encoder)
 {
 	if (encoder->encoder_thread) {
 		/* Make sure the encoder thread finishes... */
-		if (encoder->verbose > 1) {
-			printf("Waiting for encoder thread mutex...\n");
-		}
-		pthread_mutex_lock(&encoder->encoder_mutex);
 		encoder->destroying_encoder = 1;
-		pthread_cond_signal(&encoder->encoder_cond);
-		pthread_mutex_unlock(&encoder->encoder_mutex);
+		frame_queue_wake(&encoder->encode_queue);
 
 		if (encoder->verbose > 1) {
 			printf("Waiting for encoder thread to finish...\n");
 		}
 		pthread_join(encoder->encoder_thread, NULL);
-		pthread_mutex_destroy(&encoder->encoder_mutex);
-		pthread_cond_destroy(&encoder->encoder_cond);
+
+		/* Release any captured buffers still waiting */
+		frame_queue_fini(&encoder->encode_queue);
 	}
 }
 
@@ -1753,20 +1778,17 @@ destroy_transport_thread(struct rd_encoder * const encoder)
 {
 	if (encoder->transport_thread) {
 		/* Make sure the transport thread finishes... */
-		if (encoder->verbose > 1) {
-			printf("Waiting for transport thread mutex...\n");
-		}
-		pthread_mutex_lock(&encoder->transport_mutex);
 		encoder->destroying_transport = 1;
-		pthread_cond_signal(&encoder->transport_cond);
-		pthread_mutex_unlock(&encoder->transport_mutex);
+		frame_queue_wake(&encoder->transport_queue);
 
 		if (encoder->verbose > 1) {
 			printf("Waiting for transport thread to finish...\n");
 		}
 		pthread_join(encoder->transport_thread, NULL);
-		pthread_mutex_destroy(&encoder->transport_mutex);
-		pthread_cond_destroy(&encoder->transport_cond);
+
+		/* Release any encoded buffers still waiting */
+		frame_queue_fini(&encoder->transport_queue);
+		put_output_bos(encoder);
 	}
 }
 
@@ -1821,6 +1843,14 @@ load_transport_plugin(const char *plugin, struct rd_encoder *encoder,
 		return -1;
 	}
 
+	/* Optional: plugins without it get whole frames */
+	encoder->transport_send_slice_fptr = dlsym(encoder->transport_handle,
+			"send_slice");
+
+	/* Optional: plugins without it can't steer the rate controller */
+	encoder->transport_feedback_fptr = dlsym(encoder->transport_handle,
+			"get_feedback");
+
 	return 0;
 }
 
@@ -1853,9 +1883,6 @@ struct rd_encoder *
 rd_encoder_create(const int verbose, char *plugin, int *argc, char **argv)
 {
 	struct rd_encoder *encoder;
-	VAStatus status;
-	int major, minor;
-	int i;
 	int err;
 
 	encoder = zalloc(sizeof(*encoder));
@@ -1866,16 +1893,27 @@ rd_encoder_create(const int verbose, char *plugin, int *argc, char **argv)
 	encoder->drm_fd = -1;
 	encoder->verbose = verbose;
 
+	/* A single slot between each stage, replaced by newer frames,
+	 * unless rd_encoder_configure_queue() says otherwise. */
+	encoder->encode_queue_depth = 1;
+	encoder->encode_queue_policy = FRAME_QUEUE_DROP_OLDEST;
+	encoder->transport_queue_depth = 1;
+	encoder->transport_queue_policy = FRAME_QUEUE_DROP_OLDEST;
+
+	encoder->tile_size = TILE_SIZE_DEFAULT;
+	encoder->num_slices = 1;
+
+	/* Without an Intel GPU only the CPU encoder backend can run, and it
+	 * can still take frames shared as dma-bufs. */
 	encoder->drm_fd = open("/dev/dri/card0", O_RDWR | O_CLOEXEC);
 	if(encoder->drm_fd < 0) {
 		fprintf(stderr, "Failed to open card0.\n");
-		goto err_encoder;
-	}
-
-	encoder->drm_bufmgr = drm_intel_bufmgr_gem_init(encoder->drm_fd, DRM_BUF_MGR_SIZE);
-
-	if (encoder->drm_bufmgr == NULL) {
-		goto err_encoder;
+	} else {
+		encoder->drm_bufmgr = drm_intel_bufmgr_gem_init(encoder->drm_fd,
+				DRM_BUF_MGR_SIZE);
+		if (encoder->drm_bufmgr == NULL) {
+			fprintf(stderr, "Failed to create buffer manager.\n");
+		}
 	}
 
 	err = load_transport_plugin(plugin, encoder, argc, argv);
@@ -1883,26 +1921,6 @@ rd_encoder_create(const int verbose, char *plugin, int *argc, char **argv)
 		goto err_encoder;
 	}
 
-	/* Buffers will be created on request... */
-	for (i = 0; i < MAX_FRAMES; i++) {
-		encoder->out_buf[i].bufferID = VA_INVALID_ID;
-		encoder->out_buf[i].bufferStatus = BUFFER_STATUS_FREE;
-	}
-
-	encoder->vpp.output = VA_INVALID_ID;
-
-	encoder->va_dpy = vaGetDisplayDRM(encoder->drm_fd);
-	if (!encoder->va_dpy) {
-		fprintf(stderr, "encoder: Failed to create VA display.\n");
-		goto err_encoder;
-	}
-
-	status = vaInitialize(encoder->va_dpy, &major, &minor);
-	if (status != VA_STATUS_SUCCESS) {
-		fprintf(stderr, "encoder: Failed to initialize display.\n");
-		goto err_encoder;
-	}
-
 	return encoder;
 
 err_encoder:
@@ -1941,23 +1959,20 @@ rd_encoder_init(struct rd_encoder * const encoder,
 	encoder->display = display;
 	encoder->output_number = output_number;
 	encoder->fps = fps;
-	if (setup_vpp(encoder) < 0) {
-		fprintf(stderr, "encoder: Failed to initialize VPP pipeline.\n");
-		goto err_va_dpy;
-	}
 
-	if (setup_encoder(encoder) < 0) {
-		goto err_vpp;
+	err = start_backend(encoder);
+	if (err != 0) {
+		return -1;
 	}
 
 	err = setup_encoder_thread(encoder);
 	if (err != 0) {
-		goto err_vpp;
+		goto err_backend;
 	}
 
 	err = setup_transport_thread(encoder);
 	if (err != 0) {
-		goto err_vpp;
+		goto err_backend;
 	}
 
 	if (encoder->verbose) {
@@ -1966,11 +1981,9 @@ rd_encoder_init(struct rd_encoder * const encoder,
 
 	return 0;
 
-err_vpp:
-	vpp_destroy(encoder);
-err_va_dpy:
-	vaTerminate(encoder->va_dpy);
-	encoder->va_dpy = 0;
+err_backend:
+	encoder->backend->destroy(encoder->backend_data);
+	encoder->backend_data = NULL;
 
 	return -1;
 }
@@ -1978,40 +1991,39 @@ err_va_dpy:
 void
 rd_encoder_destroy(struct rd_encoder *encoder)
 {
-	int i;
-	int status;
-
 	destroy_encoder_thread(encoder);
+	if (encoder->backend_data) {
+		encoder->backend->flush(encoder->backend_data);
+	}
 	destroy_transport_thread(encoder);
 	if (encoder->verbose) {
 		printf("Worker threads destroyed...\n");
 	}
 
+	if ((encoder->verbose || encoder->profile_level) &&
+	    encoder->encoder_thread && encoder->transport_thread) {
+		print_stage_stats("Encode", &encoder->encode_queue,
+				&encoder->encode_stats);
+		print_stage_stats("Transport", &encoder->transport_queue,
+				&encoder->transport_stats);
+	}
+
 	destroy_transport_plugin(encoder);
 	if (encoder->verbose) {
 		printf("Transport plugin destroyed...\n");
 	}
 
-	encoder_destroy_encode_session(encoder);
-	vpp_destroy(encoder);
-	for (i = 0; i < MAX_FRAMES; i++) {
-		if (encoder->out_buf[i].bufferID != VA_INVALID_ID) {
-			status = vaDestroyBuffer(encoder->va_dpy, encoder->out_buf[i].bufferID);
-			if (status != VA_STATUS_SUCCESS) {
-				fprintf(stderr, "Failed to destroy buffer %d.\n",
-						encoder->out_buf[i].bufferID);
-			} else {
-				encoder->out_buf[i].bufferID = VA_INVALID_ID;
-				encoder->out_buf[i].bufferStatus = BUFFER_STATUS_FREE;
-			}
-		}
-	}
-	vaTerminate(encoder->va_dpy);
-	if (encoder->verbose) {
-		printf("libva context destroyed...\n");
+	if (encoder->backend_data) {
+		encoder->backend->destroy(encoder->backend_data);
+		encoder->backend_data = NULL;
 	}
 
-	close(encoder->drm_fd);
+	if (encoder->drm_bufmgr) {
+		drm_intel_bufmgr_destroy(encoder->drm_bufmgr);
+	}
+	if (encoder->drm_fd >= 0) {
+		close(encoder->drm_fd);
+	}
 
 	free(encoder);
 	if (encoder->verbose) {
@@ -2189,45 +2201,69 @@ convert_rgb_to_yuv(struct rd_encoder * const encoder, const VASurfaceID src_surf
 	return status;
 }
 
-static void
-encoder_frame(struct rd_encoder * const encoder)
+static int
+va_backend_encode(void *data, const struct rd_encoder_input *input,
+		struct rd_encoder_output *output)
 {
+	struct rd_encoder *encoder = data;
 	VASurfaceID src_surface = VA_INVALID_ID;
 	VAStatus status, conv_status;
-	int64_t finish = 0;
-	struct timespec end_spec;
-	int frame_number;
+	struct import_key key;
+	int frame_number = input->frame_number;
+	int cacheable = 0, cached = 0, reused = 0;
+	int ret;
 #ifdef PROFILE_REMOTE_DISPLAY
-	struct timespec start_spec;
-	int64_t duration, start = 0;
+	struct timespec start_spec, end_spec;
+	int64_t duration;
 
-	if (encoder->profile_level) {
+	if (encoder->profile_level > 1) {
 		clock_gettime(CLOCK_MONOTONIC_RAW, &start_spec);
-		start = timespec_to_nsec(&start_spec);
 	}
 #endif
 
-	frame_number = encoder->current_encode.frame_number;
+	if (__atomic_exchange_n(&encoder->flush_imports, 0, __ATOMIC_ACQ_REL)) {
+		import_cache_fini(&encoder->surface_cache);
+	}
 
-	if (encoder->current_encode.va_buffer_handle) {
-		/* We assume that all shm buffers contain RGB data. */
+	/* The VA code below reads the frame from encoder->current_encode,
+	 * which 'input' was filled from. */
+	if (input->va_buffer_handle) {
+		/* We assume that all shm buffers contain RGB data. The
+		 * compositor frees these once they're released, so they
+		 * aren't worth caching. */
 		status = create_surface_from_handle(encoder, &src_surface);
 		if (status != VA_STATUS_SUCCESS) {
 			fprintf(stderr, "[libva encoder] failed to create surface from handle for frame %d.\n",
 				frame_number);
-			return;
+			return -1;
 		}
 	} else {
 		/* Not a shared memory buffer... */
-		status = create_surface_from_fd(encoder, &src_surface);
-		if (status != VA_STATUS_SUCCESS) {
-			fprintf(stderr, "[libva encoder] failed to create surface from fd for frame %d.\n",
-				frame_number);
-			return;
+		cacheable = import_key_from_fd(&key, input->prime_fd,
+				input->stride, input->format,
+				encoder->width, encoder->height) == 0;
+		if (cacheable &&
+		    import_cache_lookup(&encoder->surface_cache, &key,
+				&src_surface)) {
+			cached = 1;
+			reused = 1;
+		} else {
+			status = create_surface_from_fd(encoder, &src_surface);
+			if (status != VA_STATUS_SUCCESS) {
+				fprintf(stderr, "[libva encoder] failed to create surface from fd for frame %d.\n",
+					frame_number);
+				return -1;
+			}
+			if (cacheable) {
+				import_cache_insert(&encoder->surface_cache,
+						&key, src_surface);
+				cached = 1;
+			}
 		}
 	}
 	if (encoder->verbose > 2) {
-		printf("Surface created for frame %d.\n", frame_number);
+		printf("Surface %s for frame %d.\n",
+			reused ? "reused" : "created", frame_number);
 	}
 
 	conv_status = convert_rgb_to_yuv(encoder, src_surface);
@@ -2235,7 +2271,8 @@ encoder_frame(struct rd_encoder * const encoder)
 #ifdef PROFILE_REMOTE_DISPLAY
 	if (encoder->profile_level > 1) {
 		clock_gettime(CLOCK_MONOTONIC_RAW, &end_spec);
-		duration = timespec_to_nsec(&end_spec) - start;
+		duration = timespec_to_nsec(&end_spec) -
+			timespec_to_nsec(&start_spec);
 		printf("RD-ENCODER:\tFrame[%d] New frame converted in %ld us.\n",
 					frame_number, duration / NS_IN_US);
 	}
@@ -2244,185 +2281,565 @@ encoder_frame(struct rd_encoder * const encoder)
 	if (conv_status != VA_STATUS_SUCCESS) {
 		fprintf(stderr, "[libva encoder] color space conversion failed for frame %d.\n",
 			frame_number);
-		return;
+		if (cached) {
+			/* Don't keep a surface that may be the problem. */
+			import_cache_fini(&encoder->surface_cache);
+		} else {
+			vaDestroySurfaces(encoder->va_dpy, &src_surface, 1);
+		}
+		return -1;
 	}
 
-	encoder_encode(encoder, encoder->vpp.output);
-	if (encoder->profile_level > 1) {
-		clock_gettime(CLOCK_MONOTONIC_RAW, &end_spec);
-		finish = timespec_to_nsec(&end_spec);
-		printf("RD-ENCODER:\tFrame[%d] Encoder completed at: %ld ns.\n",
-			frame_number, finish);
+	ret = encoder_encode(encoder, encoder->vpp.output, output);
+
+	if (!cached) {
+		vaDestroySurfaces(encoder->va_dpy, &src_surface, 1);
 	}
 
-	vaDestroySurfaces(encoder->va_dpy, &src_surface, 1);
-	close(encoder->current_encode.prime_fd);
+	return ret;
+}
 
-	if (encoder->verbose > 2) {
-		printf("Releasing buffer for frame %d...\n", frame_number);
-	}
-	if (encoder->current_encode.va_buffer_handle) {
-		/* Shared memory surface. */
-		ias_hmi_release_buffer_handle(encoder->hmi,
-			encoder->current_encode.shm_surf_id,
-			encoder->current_encode.buf_id,
-			encoder->current_encode.image_id,
-			encoder->surfid, 0);
-	} else if (encoder->surfid) {
-		/* Wayland buffer surface. */
-		ias_hmi_release_buffer_handle(encoder->hmi, 0, 0, 0,
-				encoder->surfid, 0);
-	} else {
-		/* Full framebuffer. */
-		ias_hmi_release_buffer_handle(encoder->hmi, 0, 0, 0, 0,
-				encoder->output_number);
-	}
-	wl_display_flush(encoder->display);
+static void
+evict_surface(void *data, uint32_t surface)
+{
+	struct rd_encoder *encoder = data;
+	VASurfaceID id = surface;
 
-#ifdef PROFILE_REMOTE_DISPLAY
-	if (encoder->profile_level) {
-		clock_gettime(CLOCK_MONOTONIC_RAW, &end_spec);
-		finish = timespec_to_nsec(&end_spec);
-		duration = finish - start;
-		printf("RD-ENCODER:\tFrame[%d] processed - start: %ld ns, "
-					"finish: %ld ns, duration: %ld ns.\n",
-					frame_number, start, finish, duration);
-	}
-#endif
+	vaDestroySurfaces(encoder->va_dpy, &id, 1);
 }
 
-static void *
-encoder_thread_function(void * const data)
+static void
+va_backend_invalidate(void *data)
 {
 	struct rd_encoder *encoder = data;
 
-	while (!encoder->destroying_encoder) {
-		pthread_mutex_lock(&encoder->encoder_mutex);
+	__atomic_store_n(&encoder->flush_imports, 1, __ATOMIC_RELEASE);
+}
 
-		if (!encoder->next_encode.valid) {
-			if (encoder->verbose > 1) {
-				printf("Waiting on encoder condition...\n");
-			}
-			pthread_cond_wait(&encoder->encoder_cond, &encoder->encoder_mutex);
-		}
-		if (encoder->verbose > 1) {
-			printf("Encoder thread running...\n");
-		}
+static void
+va_backend_flush(void *data)
+{
+	struct rd_encoder *encoder = data;
 
-		/* If the thread is woken by destroy_encoder_thread()
-		 * then there might not be valid input. */
-		if (!encoder->next_encode.valid) {
-			if (encoder->verbose > 1) {
-				printf("No encode in queue.\n");
-			}
-			pthread_mutex_unlock(&encoder->encoder_mutex);
-			continue;
-		}
+	if (encoder->vpp.output != VA_INVALID_ID) {
+		vaSyncSurface(encoder->va_dpy, encoder->vpp.output);
+	}
+}
 
-		if (!encoder->destroying_encoder) {
-			encoder->current_encode.prime_fd = encoder->next_encode.prime_fd;
-			encoder->current_encode.stride = encoder->next_encode.stride;
-			encoder->current_encode.va_buffer_handle = encoder->next_encode.va_buffer_handle;
-			encoder->current_encode.format = encoder->next_encode.format;
-			encoder->current_encode.timestamp = encoder->next_encode.timestamp;
-			encoder->current_encode.frame_number = encoder->next_encode.frame_number;
-			encoder->current_encode.shm_surf_id = encoder->next_encode.shm_surf_id;
-			encoder->current_encode.buf_id = encoder->next_encode.buf_id;
-			encoder->current_encode.image_id = encoder->next_encode.image_id;
-			encoder->current_encode.valid =  encoder->next_encode.valid;
-			encoder->next_encode.valid = 0;
-			pthread_mutex_unlock(&encoder->encoder_mutex);
+static void
+va_backend_release(void *data, const struct rd_encoder_output *output)
+{
+	rd_encoder_release_buffer(data, output->id);
+}
 
-			if (encoder->verbose > 2) {
-				printf("RD-ENCODER:\tFrame[%d] encode starting.\n",
-					encoder->current_encode.frame_number);
-			}
-			encoder_frame(encoder);
-			if (encoder->verbose > 2) {
-				printf("RD-ENCODER:\tFrame[%d] encode completed.\n",
-					encoder->current_encode.frame_number);
-			}
+static void
+va_backend_destroy(void *data)
+{
+	struct rd_encoder *encoder = data;
+	int status;
+	int i;
 
-		} else {
-			pthread_mutex_unlock(&encoder->encoder_mutex);
-			if (encoder->verbose) {
-				printf("encoder_thread_function skipping frame since encoder is being destroyed...\n");
+	if (encoder->verbose) {
+		printf("Surface imports: %" PRIu64 " reused, %" PRIu64 " created, %"
+			PRIu64 " evicted.\n", encoder->surface_cache.hits,
+			encoder->surface_cache.misses,
+			encoder->surface_cache.evictions);
+	}
+	import_cache_fini(&encoder->surface_cache);
+	encoder_destroy_encode_session(encoder);
+	vpp_destroy(encoder);
+	for (i = 0; i < MAX_FRAMES; i++) {
+		if (encoder->out_buf[i].bufferID != VA_INVALID_ID) {
+			status = vaDestroyBuffer(encoder->va_dpy, encoder->out_buf[i].bufferID);
+			if (status != VA_STATUS_SUCCESS) {
+				fprintf(stderr, "Failed to destroy buffer %d.\n",
+						encoder->out_buf[i].bufferID);
+			} else {
+				encoder->out_buf[i].bufferID = VA_INVALID_ID;
+				encoder->out_buf[i].bufferStatus = BUFFER_STATUS_FREE;
 			}
 		}
 	}
-
-	return NULL;
+	vaTerminate(encoder->va_dpy);
+	encoder->va_dpy = 0;
+	if (encoder->verbose) {
+		printf("libva context destroyed...\n");
+	}
 }
 
 static void *
-transport_thread_function(void * const data)
+va_backend_init(struct rd_encoder *encoder,
+		const struct rd_encoder_backend_config *config)
 {
-	struct rd_encoder *encoder = data;
-
-#ifdef PROFILE_REMOTE_DISPLAY
+	VAStatus status;
+	int major, minor;
+	int i;
+
+	if (config->bufmgr == NULL) {
+		fprintf(stderr, "encoder: VA backend needs an Intel GPU.\n");
+		return NULL;
+	}
+
+	/* Buffers will be created on request... */
+	for (i = 0; i < MAX_FRAMES; i++) {
+		encoder->out_buf[i].bufferID = VA_INVALID_ID;
+		encoder->out_buf[i].bufferStatus = BUFFER_STATUS_FREE;
+	}
+
+	encoder->vpp.output = VA_INVALID_ID;
+
+	import_cache_init(&encoder->surface_cache, evict_surface, encoder);
+	encoder->flush_imports = 0;
+
+	encoder->va_dpy = vaGetDisplayDRM(config->drm_fd);
+	if (!encoder->va_dpy) {
+		fprintf(stderr, "encoder: Failed to create VA display.\n");
+		return NULL;
+	}
+
+	status = vaInitialize(encoder->va_dpy, &major, &minor);
+	if (status != VA_STATUS_SUCCESS) {
+		fprintf(stderr, "encoder: Failed to initialize display.\n");
+		goto err_va_dpy;
+	}
+
+	if (setup_vpp(encoder) < 0) {
+		fprintf(stderr, "encoder: Failed to initialize VPP pipeline.\n");
+		goto err_va_dpy;
+	}
+
+	if (setup_encoder(encoder) < 0) {
+		goto err_vpp;
+	}
+
+	return encoder;
+
+err_vpp:
+	vpp_destroy(encoder);
+err_va_dpy:
+	vaTerminate(encoder->va_dpy);
+	encoder->va_dpy = 0;
+
+	return NULL;
+}
+
+static const struct rd_encoder_backend va_backend = {
+	.name = "va",
+	.init = va_backend_init,
+	.encode = va_backend_encode,
+	.flush = va_backend_flush,
+	.release = va_backend_release,
+	.invalidate = va_backend_invalidate,
+	.destroy = va_backend_destroy,
+};
+
+/* In order of preference when no backend is requested */
+static const struct rd_encoder_backend * const backends[] = {
+	&va_backend,
+	&rd_encoder_backend_cpu,
+	&rd_encoder_backend_tiles,
+};
+
+static const struct rd_encoder_backend *
+find_backend(const char *name)
+{
+	unsigned i;
+
+	for (i = 0; i < ARRAY_LENGTH(backends); i++) {
+		if (strcmp(backends[i]->name, name) == 0) {
+			return backends[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int
+start_backend(struct rd_encoder * const encoder)
+{
+	struct rd_encoder_backend_config config;
+	unsigned i;
+
+	config.width = encoder->width;
+	config.height = encoder->height;
+	config.x = encoder->region.x;
+	config.y = encoder->region.y;
+	config.w = encoder->region.w;
+	config.h = encoder->region.h;
+	config.encoder_tu = encoder->encoder_tu;
+	config.tile_size = encoder->tile_size;
+	config.key_interval = encoder->key_interval;
+	config.num_slices = encoder->num_slices;
+	config.verbose = encoder->verbose;
+	config.drm_fd = encoder->drm_fd;
+	config.bufmgr = encoder->drm_bufmgr;
+
+	if (encoder->requested_backend) {
+		encoder->backend = encoder->requested_backend;
+		encoder->backend_data = encoder->backend->init(encoder, &config);
+		if (encoder->backend_data == NULL) {
+			fprintf(stderr, "encoder: Failed to start %s backend.\n",
+					encoder->backend->name);
+			return -1;
+		}
+		return 0;
+	}
+
+	for (i = 0; i < ARRAY_LENGTH(backends); i++) {
+		encoder->backend = backends[i];
+		encoder->backend_data = encoder->backend->init(encoder, &config);
+		if (encoder->backend_data) {
+			if (i > 0) {
+				fprintf(stderr, "encoder: Falling back to %s backend.\n",
+						encoder->backend->name);
+			}
+			return 0;
+		}
+	}
+
+	fprintf(stderr, "encoder: No encoder backend could be started.\n");
+	return -1;
+}
+
+int
+rd_encoder_select_backend(struct rd_encoder *encoder, const char *name)
+{
+	if (name == NULL) {
+		encoder->requested_backend = NULL;
+		return 0;
+	}
+
+	encoder->requested_backend = find_backend(name);
+	if (encoder->requested_backend == NULL) {
+		fprintf(stderr, "encoder: Unknown backend '%s'.\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+encoder_frame(struct rd_encoder * const encoder)
+{
+	struct rd_encode_frame *current = &encoder->current_encode;
+	struct rd_encoder_input input;
+	struct rd_transport_frame frame;
+	int64_t finish = 0;
 	struct timespec end_spec;
-	int64_t finish;
+	int frame_number;
+#ifdef PROFILE_REMOTE_DISPLAY
+	struct timespec start_spec;
+	int64_t duration, start = 0;
+
+	if (encoder->profile_level) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &start_spec);
+		start = timespec_to_nsec(&start_spec);
+	}
 #endif
 
-	while (!encoder->destroying_transport) {
-		pthread_mutex_lock(&encoder->transport_mutex);
+	frame_number = current->frame_number;
+
+	input.va_buffer_handle = current->va_buffer_handle;
+	input.prime_fd = current->prime_fd;
+	input.stride = current->stride;
+	input.format = current->format;
+	input.timestamp = current->timestamp;
+	input.frame_number = frame_number;
+
+	if (encoder->backend->encode(encoder->backend_data, &input,
+				&frame.output) == 0) {
+		frame.frame_number = frame_number;
+		frame.timestamp = current->timestamp;
+		frame.capture_us = current->capture_us;
+		frame_queue_push(&encoder->transport_queue, &frame,
+				frame.output.is_idr ? FRAME_QUEUE_IDR : 0);
+	}
+	if (encoder->profile_level > 1) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end_spec);
+		finish = timespec_to_nsec(&end_spec);
+		printf("RD-ENCODER:\tFrame[%d] Encoder completed at: %ld ns.\n",
+			frame_number, finish);
+	}
+
+	if (encoder->verbose > 2) {
+		printf("Releasing buffer for frame %d...\n", frame_number);
+	}
+	release_capture_buffer(encoder, current);
+	wl_display_flush(encoder->display);
+
+#ifdef PROFILE_REMOTE_DISPLAY
+	if (encoder->profile_level) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &end_spec);
+		finish = timespec_to_nsec(&end_spec);
+		duration = finish - start;
+		printf("RD-ENCODER:\tFrame[%d] processed - start: %ld ns, "
+					"finish: %ld ns, duration: %ld ns.\n",
+					frame_number, start, finish, duration);
+	}
+#endif
+}
+
+static void *
+encoder_thread_function(void * const data)
+{
+	struct rd_encoder *encoder = data;
+	uint64_t start_us;
 
-		if (!encoder->next_transport.valid) {
-			pthread_cond_wait(&encoder->transport_cond, &encoder->transport_mutex);
+	while (!encoder->destroying_encoder) {
+		if (encoder->verbose > 1 &&
+		    frame_queue_occupancy(&encoder->encode_queue) == 0) {
+			printf("Waiting on encoder queue...\n");
 		}
 
 		/* If the thread is woken by destroy_encoder_thread()
 		 * then there might not be valid input. */
-		if (!encoder->next_transport.valid) {
+		if (frame_queue_wait_pop(&encoder->encode_queue,
+				&encoder->current_encode, NULL) < 0) {
+			if (encoder->verbose > 1) {
+				printf("No encode in queue.\n");
+			}
+			continue;
+		}
+		if (encoder->verbose > 1) {
+			printf("Encoder thread running...\n");
+		}
+
+		if (!encoder->destroying_encoder) {
+			if (encoder->verbose > 2) {
+				printf("RD-ENCODER:\tFrame[%d] encode starting.\n",
+					encoder->current_encode.frame_number);
+			}
+			start_us = monotonic_us();
+			encoder_frame(encoder);
+			stage_stats_add(&encoder->encode_stats, start_us);
+			if (encoder->verbose > 2) {
+				printf("RD-ENCODER:\tFrame[%d] encode completed.\n",
+					encoder->current_encode.frame_number);
+			}
+
+		} else {
+			drop_encode_frame(encoder, &encoder->current_encode);
+			if (encoder->verbose) {
+				printf("encoder_thread_function skipping frame since encoder is being destroyed...\n");
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Open the bitstream buffer the backend named, keeping it open for the next
+ * time: the backend cycles through a fixed set of buffers.
+ */
+static drm_intel_bo *
+get_output_bo(struct rd_encoder * const encoder,
+		const struct rd_encoder_output * const output)
+{
+	int slot = -1;
+	int i;
+
+	for (i = 0; i < MAX_FRAMES; i++) {
+		if (encoder->output_bos[i].bo == NULL) {
+			if (slot < 0) {
+				slot = i;
+			}
+			continue;
+		}
+		if (encoder->output_bos[i].id != output->id) {
+			continue;
+		}
+		if (encoder->output_bos[i].handle == output->handle) {
+			return encoder->output_bos[i].bo;
+		}
+		/* The backend has replaced this buffer */
+		slot = i;
+		break;
+	}
+
+	if (slot < 0) {
+		slot = encoder->next_output_bo;
+		encoder->next_output_bo = (slot + 1) % MAX_FRAMES;
+	}
+	if (encoder->output_bos[slot].bo) {
+		drm_intel_bo_unreference(encoder->output_bos[slot].bo);
+	}
+
+	encoder->output_bos[slot].bo = drm_intel_bo_gem_create_from_name(
+			encoder->drm_bufmgr, "rd_output", output->handle);
+	encoder->output_bos[slot].id = output->id;
+	encoder->output_bos[slot].handle = output->handle;
+
+	return encoder->output_bos[slot].bo;
+}
+
+static void
+put_output_bos(struct rd_encoder * const encoder)
+{
+	int i;
+
+	for (i = 0; i < MAX_FRAMES; i++) {
+		if (encoder->output_bos[i].bo) {
+			drm_intel_bo_unreference(encoder->output_bos[i].bo);
+			encoder->output_bos[i].bo = NULL;
+		}
+	}
+}
+
+static int
+use_send_slice(struct rd_encoder * const encoder,
+		const struct rd_encoder_output * const output)
+{
+	if (encoder->transport_send_slice_fptr == NULL ||
+	    output->num_slices == 0) {
+		return 0;
+	}
+
+	return output->num_slices > 1 || encoder->latency_probe;
+}
+
+/*
+ * Hand the frame to the transport one slice at a time, after a latency
+ * probe if one was asked for, so that the plugin can put the first slice
+ * on the wire before it has the rest.
+ *
+ * VA-API only gives back the coded buffer once the whole picture is done,
+ * so for now the slices all become available together, but the receiver
+ * can still start decoding the first while the rest are in flight.
+ */
+static void
+send_slices(struct rd_encoder * const encoder, uint8_t * const data)
+{
+	struct rd_transport_frame *frame = &encoder->current_transport;
+	struct rd_encoder_output *output = &frame->output;
+	uint8_t sei[LATENCY_PROBE_MAX_SIZE];
+	struct latency_probe probe;
+	int32_t start = 0;
+	size_t size;
+	int i;
+
+	if (encoder->latency_probe) {
+		probe.capture_us = frame->capture_us;
+		probe.frame_number = frame->frame_number;
+		size = latency_probe_write(sei, &probe);
+		(*encoder->transport_send_slice_fptr)(
+			encoder->transport_private_data,
+			sei, size, frame->timestamp, 0);
+	}
+
+	for (i = 0; i < output->num_slices; i++) {
+		(*encoder->transport_send_slice_fptr)(
+			encoder->transport_private_data,
+			data + start,
+			output->slice_end[i] - start,
+			frame->timestamp,
+			i == output->num_slices - 1);
+		start = output->slice_end[i];
+	}
+}
+
+/* After each frame is sent, ask the transport how the link is coping */
+static void
+update_rate_control(struct rd_encoder * const encoder)
+{
+	struct rate_feedback feedback;
+
+	if (!encoder->rate_control || encoder->transport_feedback_fptr == NULL) {
+		return;
+	}
+
+	memset(&feedback, 0, sizeof(feedback));
+	if ((*encoder->transport_feedback_fptr)(
+			encoder->transport_private_data, &feedback) != 0) {
+		return;
+	}
+
+	if (!rate_control_update(&encoder->rate, &feedback, monotonic_us())) {
+		return;
+	}
+
+	__atomic_store_n(&encoder->target_bps, encoder->rate.target_bps,
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&encoder->target_fps, encoder->rate.target_fps,
+			__ATOMIC_RELAXED);
+
+	if (encoder->verbose) {
+		printf("Rate control: %u kbit/s at %d fps.\n",
+			encoder->rate.target_bps / 1000,
+			encoder->rate.target_fps);
+	}
+}
+
+static void *
+transport_thread_function(void * const data)
+{
+	struct rd_encoder *encoder = data;
+	uint64_t start_us;
+
+#ifdef PROFILE_REMOTE_DISPLAY
+	struct timespec end_spec;
+	int64_t finish;
+#endif
+
+	while (!encoder->destroying_transport) {
+		/* If the thread is woken by destroy_transport_thread()
+		 * then there might not be valid input. */
+		if (frame_queue_wait_pop(&encoder->transport_queue,
+				&encoder->current_transport, NULL) < 0) {
 			if (encoder->verbose > 1) {
 				printf("No transport in queue.\n");
 			}
-			pthread_mutex_unlock(&encoder->transport_mutex);
 			continue;
 		}
 
 		if (!encoder->destroying_transport) {
+			struct rd_encoder_output *output =
+				&encoder->current_transport.output;
 			drm_intel_bo *drm_bo = NULL;
-
-			encoder->current_transport.handle = encoder->next_transport.handle;
-			encoder->current_transport.stream_size = encoder->next_transport.stream_size;
-			encoder->current_transport.timestamp = encoder->next_transport.timestamp;
-			encoder->current_transport.valid = encoder->next_transport.valid;
-			encoder->current_transport.output_buf = encoder->next_transport.output_buf;
-			encoder->current_transport.frame_number = encoder->next_transport.frame_number;
-			encoder->next_transport.valid = 0;
-
-			pthread_mutex_unlock(&encoder->transport_mutex);
-
-			drm_bo = drm_intel_bo_gem_create_from_name(
-									encoder->drm_bufmgr,
-									"temp1",
-									encoder->current_transport.handle);
-
-			if (drm_bo == NULL) {
-				fprintf(stderr, "Failed to create drm buffer.\n");
-				rd_encoder_release_buffer(encoder, encoder->current_transport.output_buf);
-				return NULL;
+			drm_intel_bo cpu_bo;
+
+			start_us = monotonic_us();
+			if (output->handle) {
+				drm_bo = get_output_bo(encoder, output);
+				if (drm_bo == NULL) {
+					fprintf(stderr, "Failed to create drm buffer.\n");
+					encoder->backend->release(encoder->backend_data, output);
+					return NULL;
+				}
+
+				drm_intel_bo_map(drm_bo, 1);
+			} else {
+				/* The backend left the bitstream in memory.
+				 * Transport plugins only read 'virtual'. */
+				memset(&cpu_bo, 0, sizeof(cpu_bo));
+				cpu_bo.size = output->size;
+				cpu_bo.virtual = output->data;
+				drm_bo = &cpu_bo;
 			}
 
-			drm_intel_bo_map(drm_bo, 1);
-
-			(*encoder->transport_send_fptr)(
-				encoder->transport_private_data,
-				drm_bo,
-				encoder->current_transport.stream_size,
-				encoder->current_transport.timestamp);
+			if (use_send_slice(encoder, output)) {
+				send_slices(encoder, drm_bo->virtual);
+			} else {
+				(*encoder->transport_send_fptr)(
+					encoder->transport_private_data,
+					drm_bo,
+					output->size,
+					encoder->current_transport.timestamp);
+			}
 
-			drm_intel_bo_unmap(drm_bo);
-			drm_intel_bo_unreference(drm_bo);
+			if (drm_bo != &cpu_bo) {
+				drm_intel_bo_unmap(drm_bo);
+			}
+			update_rate_control(encoder);
+			stage_stats_add(&encoder->transport_stats, start_us);
 		} else {
-			pthread_mutex_unlock(&encoder->transport_mutex);
 			if (encoder->verbose) {
 				printf("transport_thread_function skipping since encoder is being destroyed...\n");
 			}
 		}
 
-		rd_encoder_release_buffer(encoder, encoder->current_transport.output_buf);
+		encoder->backend->release(encoder->backend_data,
+				&encoder->current_transport.output);
 
 #ifdef PROFILE_REMOTE_DISPLAY
 		if (encoder->profile_level) {
@@ -2438,21 +2855,46 @@ transport_thread_function(void * const data)
 	return NULL;
 }
 
+/*
+ * With --fps, or the rate controller, below the display rate, accept
+ * captured frames no more often than the requested interval. A frame
+ * arriving up to a quarter of an interval early is still taken, so that
+ * jitter in the compositor's frame timing doesn't halve the rate. Returns 1
+ * if the frame should be skipped.
+ */
 static int should_skip(struct rd_encoder * const encoder)
 {
-	if(!encoder->fps || encoder->fps == 60) {
-		return 0;
-	} else {
-		float ans = (float)60/(60 - encoder->fps) * 100;
-		int mod = (encoder->frame_count * 100) % (int) ans;
-		if(encoder->fps > 30 && mod > 20) {
-			//It is under a certain threshold so don't skip
-			return 0;
-		} else if(encoder->fps <= 30 && mod < 20) {
-			return 0;
+	uint64_t interval, now;
+	int fps = encoder->fps;
+	int target_fps;
+
+	if (encoder->rate_control) {
+		target_fps = __atomic_load_n(&encoder->target_fps,
+				__ATOMIC_RELAXED);
+		if (fps <= 0 || target_fps < fps) {
+			fps = target_fps;
 		}
 	}
-	return 1;
+
+	if (fps <= 0 || fps >= DEFAULT_FPS) {
+		return 0;
+	}
+
+	interval = US_IN_SEC / fps;
+	now = monotonic_us();
+
+	if (encoder->next_frame_us &&
+	    now + interval / 4 < encoder->next_frame_us) {
+		return 1;
+	}
+
+	/* Don't try to catch up after a stall */
+	if (encoder->next_frame_us + interval < now) {
+		encoder->next_frame_us = now;
+	}
+	encoder->next_frame_us += interval;
+
+	return 0;
 }
 
 int
@@ -2463,6 +2905,8 @@ rd_encoder_frame(struct rd_encoder * const encoder,
 		int32_t frame_number, uint32_t shm_surf_id,
 		uint32_t buf_id, uint32_t image_id)
 {
+	struct rd_encode_frame frame;
+
 	/* TODO: Added additional strides, need to use them */
 	if (encoder->verbose > 1) {
 		printf("Frame %d received...\n", frame_number);
@@ -2490,71 +2934,174 @@ rd_encoder_frame(struct rd_encoder * const encoder,
 		return 0;
 	}
 
-	pthread_mutex_lock(&encoder->encoder_mutex);
+	frame.prime_fd = prime_fd;
+	/* TODO - Once we have a version of mesa that supports
+	 * gbm_bo_get_stride_for_plane(), we should send an array of
+	 * strides and offsets. */
+	frame.stride = stride0;
+	frame.va_buffer_handle = va_buffer_handle;
+	frame.format = format;
+	frame.timestamp = timestamp;
+	frame.capture_us = latency_probe_now_us();
+	frame.frame_number = frame_number;
+	frame.shm_surf_id = shm_surf_id;
+	frame.buf_id = buf_id;
+	frame.image_id = image_id;
+
+	if (should_skip(encoder)) {
+		drop_encode_frame(encoder, &frame);
+		return 0;
+	}
 
-	/* The mutex is never released while encoding, so this point should
-	 * never be reached if next_encode.valid is true. However, if the system
-	 * is under heavy load, it can happen that the encoder does not get
-	 * scheduled between frames being submitted. In this case, we
-	 * drop the older frame. Dropping the current frame as well is too
-	 * aggressive. */
-	if (encoder->next_encode.valid || should_skip(encoder)) {
+	/* Add current frame to queue. If the encoder has fallen behind and
+	 * the queue is full, its drop policy decides which frame goes. Every
+	 * frame is encoded as an IDR frame, so they all count as one. */
+	if (encoder->verbose > 2) {
+		printf("Queueing buffer for frame %d...\n", frame_number);
+	}
+	frame_queue_push(&encoder->encode_queue, &frame, FRAME_QUEUE_IDR);
 
-		if (encoder->next_encode.valid) {
-			/* Drop queued frame... */
-			printf("WARNING: Dropping frame %d, since a newer frame is available to encode.\n",
-					encoder->next_encode.frame_number);
-		}
+	return 0;
+}
 
-		encoder->next_encode.valid = 0;
-		if (encoder->next_encode.va_buffer_handle) {
-			/* Shared memory surface. */
-			ias_hmi_release_buffer_handle(encoder->hmi,
-				encoder->next_encode.shm_surf_id,
-				encoder->next_encode.buf_id,
-				encoder->next_encode.image_id,
-				encoder->surfid, 0);
-		} else {
-			close(encoder->next_encode.prime_fd);
-			encoder->next_encode.prime_fd = -1;
-			if (encoder->surfid) {
-				/* Wayland buffer surface. */
-				ias_hmi_release_buffer_handle(encoder->hmi, 0, 0, 0,
-						encoder->surfid, 0);
-			} else {
-				/* Full framebuffer. */
-				ias_hmi_release_buffer_handle(encoder->hmi, 0, 0, 0, 0,
-						encoder->output_number);
-			}
-		}
+int
+rd_encoder_configure_queue(struct rd_encoder *encoder,
+		enum rd_encoder_stage stage, int depth,
+		enum frame_queue_policy policy)
+{
+	if (encoder == NULL) {
+		fprintf(stderr, "rd_encoder_configure_queue : No encoder.\n");
+		return -1;
+	}
 
-		encoder->frame_count++;
-		pthread_mutex_unlock(&encoder->encoder_mutex);
-		return 0;
+	if (depth < 1 || depth > FRAME_QUEUE_MAX_DEPTH) {
+		fprintf(stderr, "Queue depth must be between 1 and %d.\n",
+			FRAME_QUEUE_MAX_DEPTH);
+		return -1;
 	}
 
-	/* Add current frame to queue... */
-	if (encoder->verbose > 2) {
-		printf("Updating queued buffer...\n");
+	switch (stage) {
+	case RD_ENCODER_STAGE_ENCODE:
+		encoder->encode_queue_depth = depth;
+		encoder->encode_queue_policy = policy;
+		break;
+	case RD_ENCODER_STAGE_TRANSPORT:
+		encoder->transport_queue_depth = depth;
+		encoder->transport_queue_policy = policy;
+		break;
+	default:
+		return -1;
 	}
-	encoder->next_encode.prime_fd = prime_fd;
-	/* TODO - Once we have a version of mesa that supports
-	 * gbm_bo_get_stride_for_plane(), we should send an array of
-	 * strides and offsets. */
-	encoder->next_encode.stride = stride0;
-	encoder->next_encode.va_buffer_handle = va_buffer_handle;
-	encoder->next_encode.format = format;
-	encoder->next_encode.timestamp = timestamp;
-	encoder->next_encode.frame_number = frame_number;
-	encoder->next_encode.shm_surf_id = shm_surf_id;
-	encoder->next_encode.buf_id = buf_id;
-	encoder->next_encode.image_id = image_id;
-	encoder->next_encode.valid = 1;
-	pthread_cond_signal(&encoder->encoder_cond);
-	pthread_mutex_unlock(&encoder->encoder_mutex);
+
+	if (encoder->verbose) {
+		printf("Using %s queue depth of %d, %s.\n",
+			stage == RD_ENCODER_STAGE_ENCODE ? "encode" : "transport",
+			depth, frame_queue_policy_name(policy));
+	}
+
+	return 0;
+}
+
+int
+rd_encoder_configure_tiles(struct rd_encoder *encoder, int tile_size,
+		int key_interval)
+{
+	if (encoder == NULL) {
+		fprintf(stderr, "rd_encoder_configure_tiles : No encoder.\n");
+		return -1;
+	}
+
+	if (tile_size < TILE_SIZE_MIN || tile_size > TILE_SIZE_MAX) {
+		fprintf(stderr, "Tile size must be between %d and %d.\n",
+			TILE_SIZE_MIN, TILE_SIZE_MAX);
+		return -1;
+	}
+	if (key_interval < 0) {
+		fprintf(stderr, "Key frame interval can't be negative.\n");
+		return -1;
+	}
+
+	encoder->tile_size = tile_size;
+	encoder->key_interval = key_interval;
+
 	return 0;
 }
 
+int
+rd_encoder_configure_streaming(struct rd_encoder *encoder, int num_slices,
+		int latency_probe)
+{
+	if (encoder == NULL) {
+		fprintf(stderr, "rd_encoder_configure_streaming : No encoder.\n");
+		return -1;
+	}
+
+	if (num_slices < 1 || num_slices > RD_ENCODER_MAX_SLICES) {
+		fprintf(stderr, "Slices per frame must be between 1 and %d.\n",
+			RD_ENCODER_MAX_SLICES);
+		return -1;
+	}
+
+	encoder->num_slices = num_slices;
+	encoder->latency_probe = latency_probe;
+
+	if (encoder->verbose) {
+		printf("Using %d slice%s per frame%s.\n", num_slices,
+			num_slices > 1 ? "s" : "",
+			latency_probe ? ", with latency probes" : "");
+	}
+
+	if (encoder->transport_send_slice_fptr == NULL &&
+	    (num_slices > 1 || latency_probe)) {
+		fprintf(stderr, "Transport plugin sends whole frames only.\n");
+	}
+
+	return 0;
+}
+
+int
+rd_encoder_configure_rate(struct rd_encoder *encoder, int start_kbps,
+		int min_kbps, int max_kbps, int min_fps)
+{
+	struct rate_control_config config;
+
+	if (encoder == NULL) {
+		fprintf(stderr, "rd_encoder_configure_rate : No encoder.\n");
+		return -1;
+	}
+
+	if (rate_control_config_init(&config, start_kbps, min_kbps, max_kbps,
+				min_fps, DEFAULT_FPS) != 0) {
+		fprintf(stderr, "Bad bitrate range: need min <= start <= max, "
+			"and a minimum frame rate up to %d.\n", DEFAULT_FPS);
+		return -1;
+	}
+
+	rate_control_init(&encoder->rate, &config);
+	encoder->target_bps = encoder->rate.target_bps;
+	encoder->target_fps = encoder->rate.target_fps;
+	encoder->rate_control = 1;
+
+	if (encoder->transport_feedback_fptr == NULL) {
+		fprintf(stderr, "Transport plugin gives no feedback, so the "
+			"bitrate will stay at %u kbit/s.\n",
+			config.start_bps / 1000);
+	} else if (encoder->verbose) {
+		printf("Using rate control from %u to %u kbit/s, "
+			"starting at %u.\n", config.min_bps / 1000,
+			config.max_bps / 1000, config.start_bps / 1000);
+	}
+
+	return 0;
+}
+
+void
+rd_encoder_invalidate_imports(struct rd_encoder *encoder)
+{
+	if (encoder->backend_data && encoder->backend->invalidate) {
+		encoder->backend->invalidate(encoder->backend_data);
+	}
+}
 
 void
 rd_encoder_enable_profiling(struct rd_encoder *encoder, int profile_level)
@@ -24,6 +24,7 @@
  */
 
 #include "ias-shell-client-protocol.h"
+#include "frame_queue.h"
 
 #ifndef _REMOTE_DISPLAY_ENCODER_H_
 #define _REMOTE_DISPLAY_ENCODER_H_
@@ -33,6 +34,9 @@
 #define NS_IN_US    1000
 #define US_IN_SEC   1000000
 
+/* Most slices a frame can be split into */
+#define RD_ENCODER_MAX_SLICES	16
+
 struct rd_encoder;
 struct wl_shm_buffer;
 
@@ -41,6 +45,12 @@ enum rd_encoder_format {
 	RD_FORMAT_NV12,
 };
 
+/* Queues in front of the encoder and transport threads */
+enum rd_encoder_stage {
+	RD_ENCODER_STAGE_ENCODE,
+	RD_ENCODER_STAGE_TRANSPORT,
+};
+
 struct rd_encoder *
 rd_encoder_create(const int verbose, char *plugin, int *argc, char **argv);
 int
@@ -63,6 +73,35 @@ rd_encoder_frame(struct rd_encoder * const encoder, int32_t va_buffer_handle,
 					uint32_t image_id);
 void
 rd_encoder_enable_profiling(struct rd_encoder *encoder, int profile_level);
+/* Must be called before rd_encoder_init(). 'name' is "va", "cpu" or
+ * "tiles", or NULL to use VA-API when it's available and "cpu" otherwise. */
+int
+rd_encoder_select_backend(struct rd_encoder *encoder, const char *name);
+/* Must be called before rd_encoder_init(). */
+int
+rd_encoder_configure_queue(struct rd_encoder *encoder,
+		enum rd_encoder_stage stage, int depth,
+		enum frame_queue_policy policy);
+/* Must be called before rd_encoder_init(). Settings for the "tiles"
+ * backend; a key_interval of 0 sends key frames only when needed. */
+int
+rd_encoder_configure_tiles(struct rd_encoder *encoder, int tile_size,
+		int key_interval);
+/* Must be called before rd_encoder_init(). Split each H.264 frame into
+ * num_slices slices that the transport sends as each is ready, and put a
+ * latency probe SEI ahead of each frame if latency_probe is set. */
+int
+rd_encoder_configure_streaming(struct rd_encoder *encoder, int num_slices,
+		int latency_probe);
+/* Must be called before rd_encoder_init(). Steer the bitrate, in kbit/s,
+ * and frame rate from the transport's feedback about the link; 0 picks a
+ * default for any of the values. */
+int
+rd_encoder_configure_rate(struct rd_encoder *encoder, int start_kbps,
+		int min_kbps, int max_kbps, int min_fps);
+/* The captured surface has gone, so its buffers won't be seen again. */
+void
+rd_encoder_invalidate_imports(struct rd_encoder *encoder);
 int
 vsync_received(struct rd_encoder *encoder);
 void
@@ -0,0 +1,138 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * This file defines the interface between the Remote Display encoder
+ * pipeline and the backend that turns captured frames into a bitstream.
+ */
+
+#ifndef __REMOTE_DISPLAY_ENCODER_BACKEND_H__
+#define __REMOTE_DISPLAY_ENCODER_BACKEND_H__
+
+#include <stdint.h>
+#include <libdrm/intel_bufmgr.h>
+
+#include "encoder.h"
+
+/* What the backend is asked to encode, fixed for the life of the backend. */
+struct rd_encoder_backend_config {
+	/* Size of the captured buffers */
+	int width, height;
+
+	/* Region of the captured buffers to encode */
+	int x, y, w, h;
+
+	/* Target usage, 1 (best quality) to 7 (fastest) */
+	int encoder_tu;
+
+	/* Tile coding: tile size in pixels, and frames between key frames,
+	 * 0 for key frames only when needed */
+	int tile_size;
+	int key_interval;
+
+	/* H.264: slices per frame, each a band of macroblock rows that the
+	 * transport can send without waiting for the rest */
+	int num_slices;
+
+	int verbose;
+
+	/* DRM device and buffer manager; the buffer manager is NULL when
+	 * the device isn't an Intel GPU */
+	int drm_fd;
+	drm_intel_bufmgr *bufmgr;
+};
+
+/* One captured frame. The pipeline releases the buffer once encode()
+ * returns, so the backend must be finished with it by then. */
+struct rd_encoder_input {
+	/* Shared memory buffers are passed as a GEM name, anything else as a
+	 * dmabuf fd */
+	int32_t va_buffer_handle;
+	int prime_fd;
+	int stride;
+	enum rd_encoder_format format;
+	uint32_t timestamp;
+	int frame_number;
+};
+
+/* One encoded frame, held by the backend until release() */
+struct rd_encoder_output {
+	/* Backend's own identifier for the buffer */
+	uint32_t id;
+
+	/* Where the bitstream is: either a GEM name for the transport to
+	 * map, or, if handle is 0, memory the backend has already mapped */
+	int32_t handle;
+	void *data;
+	int32_t size;
+
+	/* The frame can be decoded without any before it */
+	int is_idr;
+
+	/* Set by the pipeline when the frame is released without being sent;
+	 * backends that code against earlier frames must start again */
+	int dropped;
+
+	/* H.264 backends: end offset of each run of bytes in the bitstream
+	 * that finishes with a coded slice. 0 for bitstreams that aren't
+	 * H.264. */
+	int num_slices;
+	int32_t slice_end[RD_ENCODER_MAX_SLICES];
+};
+
+/*
+ * Backend operations. init() returns the backend's private data, which is
+ * passed to all the other operations, or NULL on failure. encode() is only
+ * called from the encoder thread; release() is called from whichever thread
+ * is done with the output, usually the transport thread.
+ */
+struct rd_encoder_backend {
+	const char *name;
+
+	void *(*init)(struct rd_encoder *encoder,
+			const struct rd_encoder_backend_config *config);
+
+	/* Returns 0, or -1 if the frame couldn't be encoded */
+	int (*encode)(void *data, const struct rd_encoder_input *input,
+			struct rd_encoder_output *output);
+
+	/* Wait for any work the backend still has in flight */
+	void (*flush)(void *data);
+
+	void (*release)(void *data, const struct rd_encoder_output *output);
+
+	/* Optional. Forget anything kept from earlier captured buffers,
+	 * because the compositor no longer uses them. May be called from
+	 * any thread. */
+	void (*invalidate)(void *data);
+
+	/* Called after every output has been released */
+	void (*destroy)(void *data);
+};
+
+extern const struct rd_encoder_backend rd_encoder_backend_cpu;
+extern const struct rd_encoder_backend rd_encoder_backend_tiles;
+
+#endif /* __REMOTE_DISPLAY_ENCODER_BACKEND_H__ */
@@ -0,0 +1,466 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * CPU encoder backends. They need no GPU support beyond sharing the
+ * captured buffers, so they're used where VA-API isn't available and for
+ * testing.
+ *
+ * "cpu" converts each captured frame to NV12 and writes it as an
+ * intra-only H.264 picture with sw_encode.
+ *
+ * "tiles" sends only the tiles that changed since the last frame, in the
+ * tile_codec stream format. It takes RGB captures only.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/dma-buf.h>
+
+#include "encoder_backend.h"
+#include "frame_queue.h"
+#include "sw_encode.h"
+#include "tile_codec.h"
+#include "../../shared/zalloc.h"
+
+/* Enough for every frame in the transport queue, the one being sent and
+ * the one being encoded. */
+#define CPU_OUTPUT_BUFFERS (FRAME_QUEUE_MAX_DEPTH + 2)
+
+struct cpu_output {
+	uint8_t *data;
+	int busy;
+};
+
+struct cpu_backend {
+	struct rd_encoder_backend_config config;
+
+	/* Part of the captured buffer to encode, clipped to the buffer and
+	 * rounded down to an even size */
+	int x, y, w, h;
+
+	/* "cpu" */
+	struct sw_h264 h264;
+
+	/* NV12 work image at the coded size */
+	struct sw_nv12 image;
+	uint8_t *image_data;
+
+	/* "tiles". force_key is set from the transport thread when a frame
+	 * is dropped, since the receiver then misses its tiles. */
+	struct tile_encoder tiles;
+	int force_key;
+
+	size_t output_size;
+	struct cpu_output outputs[CPU_OUTPUT_BUFFERS];
+};
+
+/* A captured buffer mapped for reading */
+struct cpu_mapping {
+	drm_intel_bo *bo;
+	void *map;
+	size_t size;
+	int prime_fd;
+	const uint8_t *data;
+};
+
+static void
+dmabuf_sync(const int fd, const uint64_t flags)
+{
+#ifdef DMA_BUF_IOCTL_SYNC
+	struct dma_buf_sync sync = { .flags = flags };
+
+	while (ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync) < 0 &&
+	       (errno == EINTR || errno == EAGAIN));
+#endif
+}
+
+static int
+map_input(struct cpu_backend * const cpu,
+		const struct rd_encoder_input * const input,
+		struct cpu_mapping * const mapping)
+{
+	int aligned_height;
+
+	memset(mapping, 0, sizeof(*mapping));
+	mapping->prime_fd = -1;
+
+	if (input->va_buffer_handle) {
+		if (cpu->config.bufmgr == NULL) {
+			fprintf(stderr, "[cpu encoder] can't map GEM buffers without an Intel GPU.\n");
+			return -1;
+		}
+		mapping->bo = drm_intel_bo_gem_create_from_name(cpu->config.bufmgr,
+				"cpu_encoder_input", input->va_buffer_handle);
+		if (mapping->bo == NULL) {
+			return -1;
+		}
+		if (drm_intel_bo_map(mapping->bo, 0) != 0) {
+			drm_intel_bo_unreference(mapping->bo);
+			return -1;
+		}
+		mapping->data = mapping->bo->virtual;
+		return 0;
+	}
+
+	if (input->format == RD_FORMAT_RGB) {
+		mapping->size = (size_t) input->stride * cpu->config.height;
+	} else {
+		/* NV12 buffers have the UV plane after a luma plane padded
+		 * to a multiple of 128 lines. */
+		aligned_height = (cpu->config.height + 0x7F) & ~0x7F;
+		mapping->size = (size_t) input->stride * aligned_height * 3 / 2;
+	}
+
+	mapping->map = mmap(NULL, mapping->size, PROT_READ, MAP_SHARED,
+			input->prime_fd, 0);
+	if (mapping->map == MAP_FAILED) {
+		return -1;
+	}
+	mapping->prime_fd = input->prime_fd;
+	dmabuf_sync(mapping->prime_fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+	mapping->data = mapping->map;
+
+	return 0;
+}
+
+static void
+unmap_input(struct cpu_mapping * const mapping)
+{
+	if (mapping->bo) {
+		drm_intel_bo_unmap(mapping->bo);
+		drm_intel_bo_unreference(mapping->bo);
+	} else {
+		dmabuf_sync(mapping->prime_fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+		munmap(mapping->map, mapping->size);
+	}
+}
+
+static struct cpu_output *
+get_output(struct cpu_backend * const cpu, uint32_t * const id)
+{
+	struct cpu_output *output;
+	int i;
+
+	for (i = 0; i < CPU_OUTPUT_BUFFERS; i++) {
+		output = &cpu->outputs[i];
+		if (__atomic_load_n(&output->busy, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		if (output->data == NULL) {
+			output->data = malloc(cpu->output_size);
+			if (output->data == NULL) {
+				return NULL;
+			}
+		}
+		__atomic_store_n(&output->busy, 1, __ATOMIC_RELAXED);
+		*id = i;
+		return output;
+	}
+
+	return NULL;
+}
+
+static int
+cpu_backend_encode(void *data, const struct rd_encoder_input *input,
+		struct rd_encoder_output *output)
+{
+	struct cpu_backend *cpu = data;
+	struct cpu_mapping mapping;
+	struct cpu_output *out;
+	struct sw_nv12 src;
+	int aligned_height;
+	uint32_t id;
+
+	out = get_output(cpu, &id);
+	if (out == NULL) {
+		fprintf(stderr, "[cpu encoder] no output buffer for frame %d.\n",
+				input->frame_number);
+		return -1;
+	}
+
+	if (map_input(cpu, input, &mapping) < 0) {
+		fprintf(stderr, "[cpu encoder] failed to map frame %d.\n",
+				input->frame_number);
+		__atomic_store_n(&out->busy, 0, __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	if (input->format == RD_FORMAT_RGB) {
+		sw_encode_bgrx_to_nv12(mapping.data +
+				(size_t) cpu->y * input->stride + cpu->x * 4,
+				input->stride, cpu->w, cpu->h, &cpu->image);
+	} else {
+		aligned_height = (cpu->config.height + 0x7F) & ~0x7F;
+		src.y = (uint8_t *) mapping.data +
+				(size_t) cpu->y * input->stride + cpu->x;
+		src.uv = (uint8_t *) mapping.data +
+				(size_t) aligned_height * input->stride +
+				(size_t) (cpu->y / 2) * input->stride + cpu->x;
+		src.y_stride = input->stride;
+		src.uv_stride = input->stride;
+		src.width = cpu->w;
+		src.height = cpu->h;
+		sw_encode_nv12_copy(&src, &cpu->image, cpu->w, cpu->h);
+	}
+
+	unmap_input(&mapping);
+
+	sw_encode_nv12_pad(&cpu->image, cpu->w, cpu->h);
+
+	output->id = id;
+	output->handle = 0;
+	output->data = out->data;
+	output->size = sw_encode_h264_frame(&cpu->h264, &cpu->image, out->data);
+	output->is_idr = 1;
+	output->dropped = 0;
+	output->num_slices = 1;
+	output->slice_end[0] = output->size;
+
+	if (cpu->config.verbose > 2) {
+		printf("[cpu encoder] frame %d: %d bytes.\n",
+				input->frame_number, output->size);
+	}
+
+	return 0;
+}
+
+static int
+tiles_backend_encode(void *data, const struct rd_encoder_input *input,
+		struct rd_encoder_output *output)
+{
+	struct cpu_backend *cpu = data;
+	struct cpu_mapping mapping;
+	struct cpu_output *out;
+	uint32_t id;
+	int is_key;
+
+	if (input->format != RD_FORMAT_RGB) {
+		fprintf(stderr, "[tiles encoder] frame %d isn't RGB.\n",
+				input->frame_number);
+		return -1;
+	}
+
+	out = get_output(cpu, &id);
+	if (out == NULL) {
+		fprintf(stderr, "[tiles encoder] no output buffer for frame %d.\n",
+				input->frame_number);
+		return -1;
+	}
+
+	if (map_input(cpu, input, &mapping) < 0) {
+		fprintf(stderr, "[tiles encoder] failed to map frame %d.\n",
+				input->frame_number);
+		__atomic_store_n(&out->busy, 0, __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	if (__atomic_exchange_n(&cpu->force_key, 0, __ATOMIC_ACQ_REL)) {
+		tile_encoder_force_key(&cpu->tiles);
+	}
+
+	output->id = id;
+	output->handle = 0;
+	output->data = out->data;
+	output->size = tile_encoder_frame(&cpu->tiles, mapping.data +
+			(size_t) cpu->y * input->stride + cpu->x * 4,
+			input->stride, input->frame_number, out->data, &is_key);
+	output->is_idr = is_key;
+	output->dropped = 0;
+	output->num_slices = 0;
+
+	unmap_input(&mapping);
+
+	if (cpu->config.verbose > 2) {
+		printf("[tiles encoder] frame %d: %d bytes%s.\n",
+				input->frame_number, output->size,
+				is_key ? ", key frame" : "");
+	}
+
+	return 0;
+}
+
+static void
+cpu_backend_flush(void *data)
+{
+	/* Frames are encoded synchronously; nothing is left in flight. */
+}
+
+static void
+cpu_backend_release(void *data, const struct rd_encoder_output *output)
+{
+	struct cpu_backend *cpu = data;
+
+	if (output->dropped) {
+		__atomic_store_n(&cpu->force_key, 1, __ATOMIC_RELEASE);
+	}
+	if (output->id < CPU_OUTPUT_BUFFERS) {
+		__atomic_store_n(&cpu->outputs[output->id].busy, 0,
+				__ATOMIC_RELEASE);
+	}
+}
+
+static void
+cpu_backend_destroy(void *data)
+{
+	struct cpu_backend *cpu = data;
+	int i;
+
+	for (i = 0; i < CPU_OUTPUT_BUFFERS; i++) {
+		free(cpu->outputs[i].data);
+	}
+	free(cpu->image_data);
+	tile_encoder_fini(&cpu->tiles);
+	free(cpu);
+}
+
+/* Set up what both backends share: the region and the output buffers */
+static struct cpu_backend *
+cpu_backend_create(const struct rd_encoder_backend_config *config)
+{
+	struct cpu_backend *cpu;
+
+	cpu = zalloc(sizeof(*cpu));
+	if (cpu == NULL) {
+		return NULL;
+	}
+
+	cpu->config = *config;
+
+	cpu->x = config->x < 0 ? 0 : config->x & ~1;
+	cpu->y = config->y < 0 ? 0 : config->y & ~1;
+	cpu->w = config->w;
+	cpu->h = config->h;
+	if (cpu->x + cpu->w > config->width) {
+		cpu->w = config->width - cpu->x;
+	}
+	if (cpu->y + cpu->h > config->height) {
+		cpu->h = config->height - cpu->y;
+	}
+	cpu->w &= ~1;
+	cpu->h &= ~1;
+	if (cpu->w <= 0 || cpu->h <= 0) {
+		fprintf(stderr, "[cpu encoder] empty region %dx%d+%d+%d.\n",
+				config->w, config->h, config->x, config->y);
+		free(cpu);
+		return NULL;
+	}
+
+	return cpu;
+}
+
+static void *
+cpu_backend_init(struct rd_encoder *encoder,
+		const struct rd_encoder_backend_config *config)
+{
+	struct cpu_backend *cpu;
+	int coded_width, coded_height;
+
+	cpu = cpu_backend_create(config);
+	if (cpu == NULL) {
+		return NULL;
+	}
+
+	sw_encode_h264_init(&cpu->h264, cpu->w, cpu->h);
+	coded_width = sw_encode_h264_coded_width(&cpu->h264);
+	coded_height = sw_encode_h264_coded_height(&cpu->h264);
+
+	cpu->image_data = malloc((size_t) coded_width * coded_height * 3 / 2);
+	if (cpu->image_data == NULL) {
+		free(cpu);
+		return NULL;
+	}
+	cpu->image.y = cpu->image_data;
+	cpu->image.uv = cpu->image_data + (size_t) coded_width * coded_height;
+	cpu->image.y_stride = coded_width;
+	cpu->image.uv_stride = coded_width;
+	cpu->image.width = coded_width;
+	cpu->image.height = coded_height;
+
+	cpu->output_size = sw_encode_h264_max_size(&cpu->h264);
+
+	if (config->verbose) {
+		printf("[cpu encoder] encoding %dx%d intra-only, up to %zu bytes a frame.\n",
+				cpu->w, cpu->h, cpu->output_size);
+	}
+
+	return cpu;
+}
+
+static void *
+tiles_backend_init(struct rd_encoder *encoder,
+		const struct rd_encoder_backend_config *config)
+{
+	struct cpu_backend *cpu;
+
+	cpu = cpu_backend_create(config);
+	if (cpu == NULL) {
+		return NULL;
+	}
+
+	if (tile_encoder_init(&cpu->tiles, cpu->w, cpu->h, config->tile_size,
+				config->key_interval) < 0) {
+		fprintf(stderr, "[tiles encoder] can't encode %dx%d in %d pixel tiles.\n",
+				cpu->w, cpu->h, config->tile_size);
+		free(cpu);
+		return NULL;
+	}
+
+	cpu->output_size = tile_encoder_max_size(&cpu->tiles);
+
+	if (config->verbose) {
+		printf("[tiles encoder] encoding %dx%d in %dx%d tiles.\n",
+				cpu->w, cpu->h, cpu->tiles.tiles_x,
+				cpu->tiles.tiles_y);
+	}
+
+	return cpu;
+}
+
+const struct rd_encoder_backend rd_encoder_backend_cpu = {
+	.name = "cpu",
+	.init = cpu_backend_init,
+	.encode = cpu_backend_encode,
+	.flush = cpu_backend_flush,
+	.release = cpu_backend_release,
+	.destroy = cpu_backend_destroy,
+};
+
+const struct rd_encoder_backend rd_encoder_backend_tiles = {
+	.name = "tiles",
+	.init = tiles_backend_init,
+	.encode = tiles_backend_encode,
+	.flush = cpu_backend_flush,
+	.release = cpu_backend_release,
+	.destroy = cpu_backend_destroy,
+};
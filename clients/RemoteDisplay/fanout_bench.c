@@ -0,0 +1,339 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Measures what it costs the UDP transport to send to several receivers
+ * on the loopback interface, by each of:
+ *
+ *   sendto     a socket per receiver and a sendto() each, as the plugin
+ *              used to
+ *   sendmmsg   one sendmmsg() per packet for all receivers (udp_fanout)
+ *   multicast  one send to a group the receivers have joined
+ *
+ *   Usage: remote-display-fanout-bench [-n receivers] [-p packets]
+ *                                      [-s size] [mode...]
+ *
+ * Only the sending thread's CPU time is counted. Loopback drops packets
+ * once the receivers fall behind, so what each got is shown too.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "udp_fanout.h"
+
+#define MAX_RECEIVERS	UDP_FANOUT_MAX_DESTS
+#define MAX_PACKET	1400
+#define GROUP		"239.255.77.1"
+
+struct receiver {
+	int fd;
+	int port;
+	uint64_t packets;
+	pthread_t thread;
+};
+
+static volatile int stop;
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double
+thread_cpu_sec(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_THREAD, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void *
+receive_thread(void *data)
+{
+	struct receiver *receiver = data;
+	struct pollfd pfd = { receiver->fd, POLLIN, 0 };
+	uint8_t packet[MAX_PACKET];
+
+	while (!stop) {
+		if (poll(&pfd, 1, 50) != 1) {
+			continue;
+		}
+		while (recv(receiver->fd, packet, sizeof(packet),
+					MSG_DONTWAIT) > 0) {
+			receiver->packets++;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+open_receiver(struct receiver *receiver, int multicast, int port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	struct ip_mreq mreq;
+	int rcvbuf = 4 * 1024 * 1024;
+	int one = 1;
+
+	memset(receiver, 0, sizeof(*receiver));
+	receiver->fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (receiver->fd < 0) {
+		return -1;
+	}
+	setsockopt(receiver->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+			sizeof(rcvbuf));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	if (multicast) {
+		/* Every member of the group listens on the same port */
+		setsockopt(receiver->fd, SOL_SOCKET, SO_REUSEADDR, &one,
+				sizeof(one));
+		addr.sin_addr.s_addr = inet_addr(GROUP);
+	} else {
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+	if (bind(receiver->fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    getsockname(receiver->fd, (struct sockaddr *) &addr, &len) < 0) {
+		close(receiver->fd);
+		return -1;
+	}
+	receiver->port = ntohs(addr.sin_port);
+
+	if (multicast) {
+		mreq.imr_multiaddr.s_addr = inet_addr(GROUP);
+		mreq.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+		if (setsockopt(receiver->fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+					&mreq, sizeof(mreq)) < 0) {
+			fprintf(stderr, "Failed to join %s: %m\n", GROUP);
+			close(receiver->fd);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* What the plugin did before udp_fanout: a socket and a sendto() for each
+ * receiver */
+static int
+send_each(struct receiver *receivers, int num_receivers, const uint8_t *packet,
+		size_t size, int packets)
+{
+	struct sockaddr_in addr[MAX_RECEIVERS];
+	int fd[MAX_RECEIVERS];
+	int i, p;
+
+	for (i = 0; i < num_receivers; i++) {
+		fd[i] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (fd[i] < 0) {
+			return -1;
+		}
+		memset(&addr[i], 0, sizeof(addr[i]));
+		addr[i].sin_family = AF_INET;
+		addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr[i].sin_port = htons(receivers[i].port);
+	}
+
+	for (p = 0; p < packets; p++) {
+		for (i = 0; i < num_receivers; i++) {
+			sendto(fd[i], packet, size, 0,
+					(struct sockaddr *) &addr[i],
+					sizeof(addr[i]));
+		}
+	}
+
+	for (i = 0; i < num_receivers; i++) {
+		close(fd[i]);
+	}
+	return 0;
+}
+
+static int
+send_fanout(const char *clients, const char *multicast_if,
+		const uint8_t *packet, size_t size, int packets)
+{
+	struct udp_fanout fanout;
+	int p;
+
+	if (udp_fanout_init(&fanout, clients, 1, multicast_if, 0) < 0) {
+		return -1;
+	}
+
+	for (p = 0; p < packets; p++) {
+		udp_fanout_send(&fanout, packet, size, 0);
+	}
+
+	udp_fanout_fini(&fanout);
+	return 0;
+}
+
+static int
+run(const char *mode, int num_receivers, int packets, size_t size)
+{
+	struct receiver receivers[MAX_RECEIVERS];
+	uint8_t packet[MAX_PACKET];
+	char clients[MAX_RECEIVERS * 24] = "";
+	int multicast = !strcmp(mode, "multicast");
+	uint64_t least = UINT64_MAX;
+	double start, cpu, elapsed;
+	int i, ret;
+
+	if (strcmp(mode, "sendto") && strcmp(mode, "sendmmsg") && !multicast) {
+		fprintf(stderr, "Unknown mode %s\n", mode);
+		return -1;
+	}
+
+	stop = 0;
+	for (i = 0; i < num_receivers; i++) {
+		if (open_receiver(&receivers[i], multicast,
+					multicast && i ? receivers[0].port : 0) < 0) {
+			fprintf(stderr, "Failed to open receiver\n");
+			while (i--) {
+				close(receivers[i].fd);
+			}
+			return -1;
+		}
+		snprintf(clients + strlen(clients), sizeof(clients) - strlen(clients),
+				"%s127.0.0.1:%d", i ? "," : "", receivers[i].port);
+		pthread_create(&receivers[i].thread, NULL, receive_thread,
+				&receivers[i]);
+	}
+	if (multicast) {
+		snprintf(clients, sizeof(clients), "%s:%d", GROUP,
+				receivers[0].port);
+	}
+
+	memset(packet, 0x5a, sizeof(packet));
+	start = now_sec();
+	cpu = thread_cpu_sec();
+	if (!strcmp(mode, "sendto")) {
+		ret = send_each(receivers, num_receivers, packet, size, packets);
+	} else {
+		ret = send_fanout(clients, multicast ? "127.0.0.1" : NULL,
+				packet, size, packets);
+	}
+	cpu = thread_cpu_sec() - cpu;
+	elapsed = now_sec() - start;
+
+	/* Let the receivers catch up with what's in their sockets */
+	usleep(200000);
+	stop = 1;
+	for (i = 0; i < num_receivers; i++) {
+		pthread_join(receivers[i].thread, NULL);
+		close(receivers[i].fd);
+		if (receivers[i].packets < least) {
+			least = receivers[i].packets;
+		}
+	}
+
+	if (ret < 0) {
+		fprintf(stderr, "%s: sending failed\n", mode);
+		return -1;
+	}
+
+	printf("%-10s %9d %8.3f %14.0f %12.1f%%\n", mode, packets, elapsed,
+			cpu * 1e9 / packets, least * 100.0 / packets);
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: remote-display-fanout-bench [-n receivers] "
+			"[-p packets] [-s size]\n"
+			"\t[sendto] [sendmmsg] [multicast]\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	static char *all[] = { "sendto", "sendmmsg", "multicast" };
+	char **modes = all;
+	int num_modes = 3;
+	int num_receivers = 3;
+	int packets = 200000;
+	int size = MAX_PACKET;
+	int opt, i, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:p:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			num_receivers = atoi(optarg);
+			break;
+		case 'p':
+			packets = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (num_receivers < 1 || num_receivers > MAX_RECEIVERS ||
+	    packets < 1 || size < 1 || size > MAX_PACKET) {
+		usage();
+		return 1;
+	}
+	if (optind < argc) {
+		modes = &argv[optind];
+		num_modes = argc - optind;
+	}
+
+	printf("%d receivers, %d byte packets\n", num_receivers, size);
+	printf("%-10s %9s %8s %14s %13s\n", "mode", "packets", "sec",
+			"send ns/packet", "least got");
+	for (i = 0; i < num_modes; i++) {
+		if (run(modes[i], num_receivers, packets, size) < 0) {
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
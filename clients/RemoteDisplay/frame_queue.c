@@ -0,0 +1,344 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include "frame_queue.h"
+#include "../../shared/timespec-util.h"
+
+/* How often a producer dropping the oldest frame retries for a free slot */
+#define DROP_OLDEST_ATTEMPTS 4
+
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_to_usec(&ts);
+}
+
+/*
+ * A cell is free for the push at position p when its sequence is 2p, and
+ * holds the element for the pop at position p when its sequence is 2p + 1.
+ * Popping sets it to 2(p + depth), freeing it for the push one lap later.
+ * Doubling keeps "full" and "free" distinct even when depth is 1.
+ */
+static int
+try_push(struct frame_queue *queue, const void *elem, uint32_t flags,
+		uint64_t push_us)
+{
+	uint64_t pos = atomic_load_explicit(&queue->push_pos,
+			memory_order_relaxed);
+	struct frame_queue_cell *cell = &queue->cells[pos % queue->depth];
+	uint64_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+	/* Full, or the oldest frame is still being copied out */
+	if (seq != 2 * pos) {
+		return -1;
+	}
+
+	memcpy(cell->data, elem, queue->elem_size);
+	cell->flags = flags;
+	cell->push_us = push_us;
+
+	/* Only one thread ever pushes, so no need to claim the position */
+	atomic_store_explicit(&queue->push_pos, pos + 1, memory_order_relaxed);
+	atomic_store_explicit(&cell->seq, 2 * pos + 1, memory_order_release);
+
+	return 0;
+}
+
+/*
+ * The consumer and a producer dropping the oldest frame can race for the
+ * same element, so it is claimed by advancing pop_pos before being copied.
+ */
+static int
+try_pop(struct frame_queue *queue, void *elem, uint32_t *flags,
+		uint64_t *push_us)
+{
+	struct frame_queue_cell *cell;
+	uint64_t pos, seq;
+
+	pos = atomic_load_explicit(&queue->pop_pos, memory_order_relaxed);
+	for (;;) {
+		cell = &queue->cells[pos % queue->depth];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+
+		if ((int64_t) (seq - (2 * pos + 1)) < 0) {
+			return -1;
+		}
+
+		if (seq == 2 * pos + 1) {
+			if (atomic_compare_exchange_weak_explicit(&queue->pop_pos,
+					&pos, pos + 1, memory_order_relaxed,
+					memory_order_relaxed)) {
+				break;
+			}
+		} else {
+			pos = atomic_load_explicit(&queue->pop_pos,
+					memory_order_relaxed);
+		}
+	}
+
+	memcpy(elem, cell->data, queue->elem_size);
+	if (flags) {
+		*flags = cell->flags;
+	}
+	if (push_us) {
+		*push_us = cell->push_us;
+	}
+
+	atomic_store_explicit(&cell->seq, 2 * (pos + queue->depth),
+			memory_order_release);
+
+	return 0;
+}
+
+static void
+drop_elem(struct frame_queue *queue, void *elem)
+{
+	atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+	if (queue->drop) {
+		queue->drop(queue->drop_data, elem);
+	}
+}
+
+static void
+record_push(struct frame_queue *queue)
+{
+	uint32_t occupancy = frame_queue_occupancy(queue);
+
+	atomic_fetch_add_explicit(&queue->occupancy_total, occupancy,
+			memory_order_relaxed);
+	if (occupancy > atomic_load_explicit(&queue->occupancy_max,
+			memory_order_relaxed)) {
+		atomic_store_explicit(&queue->occupancy_max, occupancy,
+				memory_order_relaxed);
+	}
+
+	sem_post(&queue->ready);
+}
+
+
+int
+frame_queue_init(struct frame_queue *queue, int depth, size_t elem_size,
+		enum frame_queue_policy policy,
+		frame_queue_drop_t drop, void *drop_data)
+{
+	uint32_t i;
+
+	if (elem_size > FRAME_QUEUE_MAX_ELEM) {
+		return -1;
+	}
+
+	memset(queue, 0, sizeof(*queue));
+
+	if (depth < 1) {
+		depth = 1;
+	} else if (depth > FRAME_QUEUE_MAX_DEPTH) {
+		depth = FRAME_QUEUE_MAX_DEPTH;
+	}
+
+	queue->depth = depth;
+	queue->elem_size = elem_size;
+	queue->policy = policy;
+	queue->drop = drop;
+	queue->drop_data = drop_data;
+
+	for (i = 0; i < queue->depth; i++) {
+		atomic_init(&queue->cells[i].seq, 2 * i);
+	}
+	atomic_init(&queue->push_pos, 0);
+	atomic_init(&queue->pop_pos, 0);
+
+	if (sem_init(&queue->ready, 0, 0) < 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+frame_queue_fini(struct frame_queue *queue)
+{
+	uint8_t elem[FRAME_QUEUE_MAX_ELEM];
+
+	while (try_pop(queue, elem, NULL, NULL) == 0) {
+		drop_elem(queue, elem);
+	}
+
+	sem_destroy(&queue->ready);
+}
+
+int
+frame_queue_push(struct frame_queue *queue, const void *elem, uint32_t flags)
+{
+	uint8_t old[FRAME_QUEUE_MAX_ELEM];
+	uint64_t push_us = now_us();
+	int i;
+
+	atomic_fetch_add_explicit(&queue->pushed, 1, memory_order_relaxed);
+
+	if (try_push(queue, elem, flags, push_us) == 0) {
+		record_push(queue);
+		return 0;
+	}
+
+	if (queue->policy == FRAME_QUEUE_DROP_OLDEST ||
+			(queue->policy == FRAME_QUEUE_KEEP_IDR &&
+			 (flags & FRAME_QUEUE_IDR))) {
+		for (i = 0; i < DROP_OLDEST_ATTEMPTS; i++) {
+			if (try_pop(queue, old, NULL, NULL) == 0) {
+				drop_elem(queue, old);
+			}
+
+			if (try_push(queue, elem, flags, push_us) == 0) {
+				record_push(queue);
+				return 1;
+			}
+
+			/* The consumer is part way through copying the
+			 * oldest frame out; let it finish */
+			sched_yield();
+		}
+	}
+
+	/* Drop the new frame */
+	memcpy(old, elem, queue->elem_size);
+	drop_elem(queue, old);
+
+	return 1;
+}
+
+int
+frame_queue_pop(struct frame_queue *queue, void *elem, uint32_t *flags)
+{
+	uint64_t push_us, latency;
+
+	if (try_pop(queue, elem, flags, &push_us) < 0) {
+		return -1;
+	}
+
+	latency = now_us() - push_us;
+	atomic_fetch_add_explicit(&queue->popped, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&queue->latency_total_us, latency,
+			memory_order_relaxed);
+	if (latency > atomic_load_explicit(&queue->latency_max_us,
+			memory_order_relaxed)) {
+		atomic_store_explicit(&queue->latency_max_us, latency,
+				memory_order_relaxed);
+	}
+
+	return 0;
+}
+
+int
+frame_queue_wait_pop(struct frame_queue *queue, void *elem, uint32_t *flags)
+{
+	/* One post per push or wake; a post whose frame was dropped to make
+	 * room for a newer one just finds the queue empty */
+	while (sem_wait(&queue->ready) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+
+	return frame_queue_pop(queue, elem, flags);
+}
+
+void
+frame_queue_wake(struct frame_queue *queue)
+{
+	sem_post(&queue->ready);
+}
+
+uint32_t
+frame_queue_occupancy(struct frame_queue *queue)
+{
+	uint64_t push_pos = atomic_load_explicit(&queue->push_pos,
+			memory_order_relaxed);
+	uint64_t pop_pos = atomic_load_explicit(&queue->pop_pos,
+			memory_order_relaxed);
+
+	return push_pos > pop_pos ? push_pos - pop_pos : 0;
+}
+
+void
+frame_queue_get_stats(struct frame_queue *queue,
+		struct frame_queue_stats *stats)
+{
+	stats->pushed = atomic_load(&queue->pushed);
+	stats->popped = atomic_load(&queue->popped);
+	stats->dropped = atomic_load(&queue->dropped);
+	stats->occupancy_total = atomic_load(&queue->occupancy_total);
+	stats->occupancy_max = atomic_load(&queue->occupancy_max);
+	stats->latency_total_us = atomic_load(&queue->latency_total_us);
+	stats->latency_max_us = atomic_load(&queue->latency_max_us);
+}
+
+static const struct {
+	enum frame_queue_policy policy;
+	const char *name;
+} policy_names[] = {
+	{ FRAME_QUEUE_DROP_OLDEST, "drop-oldest" },
+	{ FRAME_QUEUE_DROP_NEWEST, "drop-newest" },
+	{ FRAME_QUEUE_KEEP_IDR, "keep-idr" },
+};
+
+int
+frame_queue_policy_from_string(const char *name,
+		enum frame_queue_policy *policy)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+		if (strcmp(name, policy_names[i].name) == 0) {
+			*policy = policy_names[i].policy;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+const char *
+frame_queue_policy_name(enum frame_queue_policy policy)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+		if (policy_names[i].policy == policy) {
+			return policy_names[i].name;
+		}
+	}
+
+	return "unknown";
+}
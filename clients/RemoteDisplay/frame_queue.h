@@ -0,0 +1,174 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __REMOTE_DISPLAY_FRAME_QUEUE_H__
+#define __REMOTE_DISPLAY_FRAME_QUEUE_H__
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <semaphore.h>
+
+/* Deepest queue that can be configured between two pipeline stages. */
+#define FRAME_QUEUE_MAX_DEPTH 8
+
+/* Largest element a queue can carry; elements are copied in and out. */
+#define FRAME_QUEUE_MAX_ELEM 64
+
+/* Element flag: the frame can be decoded on its own. */
+#define FRAME_QUEUE_IDR (1 << 0)
+
+/*
+ * What a full queue does with a new frame.
+ *
+ * DROP_OLDEST keeps latency down: the frame that has waited longest goes.
+ * DROP_NEWEST keeps what is already queued flowing smoothly and discards
+ * the new frame.
+ * KEEP_IDR never loses an IDR frame to a non-IDR one: a new IDR frame
+ * replaces the oldest, while any other new frame is discarded.
+ */
+enum frame_queue_policy {
+	FRAME_QUEUE_DROP_OLDEST,
+	FRAME_QUEUE_DROP_NEWEST,
+	FRAME_QUEUE_KEEP_IDR,
+};
+
+/* Called for every element the queue discards, on the discarding thread. */
+typedef void (*frame_queue_drop_t)(void *data, void *elem);
+
+struct frame_queue_stats {
+	uint64_t pushed;
+	uint64_t popped;
+	uint64_t dropped;
+
+	/* Frames waiting, sampled after every push */
+	uint64_t occupancy_total;
+	uint32_t occupancy_max;
+
+	/* Time from push to pop */
+	uint64_t latency_total_us;
+	uint64_t latency_max_us;
+};
+
+struct frame_queue_cell {
+	atomic_uint_least64_t seq;
+	uint32_t flags;
+	uint64_t push_us;
+	uint8_t data[FRAME_QUEUE_MAX_ELEM];
+};
+
+/*
+ * Bounded queue handing frames from one producer thread to one consumer
+ * thread without locks.  The producer also dequeues when it has to drop
+ * the oldest frame, so slots are claimed with per-cell sequence numbers
+ * (as in Vyukov's bounded MPMC queue) rather than plain head and tail
+ * indices: a slot being copied out by one side can never be overwritten
+ * by the other.  The semaphore only exists so that the consumer can sleep
+ * while the queue is empty.
+ */
+struct frame_queue {
+	struct frame_queue_cell cells[FRAME_QUEUE_MAX_DEPTH];
+	uint32_t depth;
+	size_t elem_size;
+	enum frame_queue_policy policy;
+	frame_queue_drop_t drop;
+	void *drop_data;
+
+	atomic_uint_least64_t push_pos;
+	atomic_uint_least64_t pop_pos;
+	sem_t ready;
+
+	/* Written by the producer */
+	atomic_uint_least64_t pushed;
+	atomic_uint_least64_t dropped;
+	atomic_uint_least64_t occupancy_total;
+	atomic_uint occupancy_max;
+
+	/* Written by the consumer */
+	atomic_uint_least64_t popped;
+	atomic_uint_least64_t latency_total_us;
+	atomic_uint_least64_t latency_max_us;
+};
+
+/*
+ * Set up an empty queue holding up to 'depth' elements of 'elem_size'
+ * bytes; depth is clamped to 1..FRAME_QUEUE_MAX_DEPTH.  Returns 0, or -1
+ * if the element is too large or the semaphore can't be created.
+ */
+int
+frame_queue_init(struct frame_queue *queue, int depth, size_t elem_size,
+		enum frame_queue_policy policy,
+		frame_queue_drop_t drop, void *drop_data);
+
+/* Drop anything still queued and free the semaphore. */
+void
+frame_queue_fini(struct frame_queue *queue);
+
+/*
+ * Producer: queue a copy of 'elem', applying the drop policy if the queue
+ * is full.  Returns 0 if nothing was dropped, 1 if a frame (either this
+ * one or an older one) was.
+ */
+int
+frame_queue_push(struct frame_queue *queue, const void *elem, uint32_t flags);
+
+/*
+ * Consumer: copy the oldest element into 'elem' without blocking.  Returns
+ * 0, or -1 if the queue is empty.
+ */
+int
+frame_queue_pop(struct frame_queue *queue, void *elem, uint32_t *flags);
+
+/*
+ * Consumer: as frame_queue_pop(), but sleeps until an element arrives or
+ * frame_queue_wake() is called, in which case it may return -1.
+ */
+int
+frame_queue_wait_pop(struct frame_queue *queue, void *elem, uint32_t *flags);
+
+/* Wake a consumer sleeping in frame_queue_wait_pop(), e.g. to shut down. */
+void
+frame_queue_wake(struct frame_queue *queue);
+
+/* Frames currently queued; approximate while the other side is running. */
+uint32_t
+frame_queue_occupancy(struct frame_queue *queue);
+
+void
+frame_queue_get_stats(struct frame_queue *queue,
+		struct frame_queue_stats *stats);
+
+/*
+ * Parse "drop-oldest", "drop-newest" or "keep-idr".  Returns 0, or -1 if
+ * 'name' is none of those.
+ */
+int
+frame_queue_policy_from_string(const char *name,
+		enum frame_queue_policy *policy);
+
+const char *
+frame_queue_policy_name(enum frame_queue_policy policy);
+
+#endif /* __REMOTE_DISPLAY_FRAME_QUEUE_H__ */
@@ -0,0 +1,161 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "h264_nal.h"
+
+#define NRI_MASK	0x60
+
+/* FU indicator and FU header */
+#define FU_HEADER_SIZE	2
+
+/* Offset of the next 00 00 01 at or after 'pos', or 'size' if none */
+static size_t
+find_start_code(const uint8_t *data, const size_t size, size_t pos)
+{
+	while (pos + 3 <= size) {
+		if (data[pos + 2] > 1) {
+			pos += 3;
+		} else if (data[pos] == 0 && data[pos + 1] == 0 &&
+			   data[pos + 2] == 1) {
+			return pos;
+		} else {
+			pos++;
+		}
+	}
+
+	return size;
+}
+
+int
+h264_nal_next(const uint8_t *data, size_t size, size_t *pos,
+		struct h264_nal *nal)
+{
+	size_t sc, next;
+
+	sc = find_start_code(data, size, *pos);
+	if (sc + 3 >= size) {
+		*pos = size;
+		return 0;
+	}
+
+	nal->start = sc > *pos && data[sc - 1] == 0 ? sc - 1 : sc;
+	nal->offset = sc + 3;
+	nal->type = data[nal->offset] & H264_NAL_TYPE_MASK;
+
+	/* Trailing zeros belong to the next start code */
+	next = find_start_code(data, size, nal->offset);
+	while (next > nal->offset && data[next - 1] == 0) {
+		next--;
+	}
+	nal->size = next - nal->offset;
+	*pos = next;
+
+	return 1;
+}
+
+int
+h264_split_slices(const uint8_t *data, size_t size, int32_t *slice_end,
+		int max_slices)
+{
+	struct h264_nal nal;
+	size_t pos = 0;
+	int count = 0;
+
+	while (h264_nal_next(data, size, &pos, &nal)) {
+		if (nal.type != H264_NAL_SLICE && nal.type != H264_NAL_IDR) {
+			continue;
+		}
+
+		/* A new slice ends the run before it */
+		if (count > 0 && count < max_slices) {
+			slice_end[count - 1] = nal.start;
+		}
+		if (count < max_slices) {
+			count++;
+		}
+	}
+
+	if (count > 0) {
+		slice_end[count - 1] = size;
+	}
+
+	return count;
+}
+
+int
+h264_packetize(const uint8_t *data, size_t size, uint8_t *payload,
+		size_t max_payload, int last, h264_packet_func_t send,
+		void *send_data)
+{
+	const size_t step = max_payload - FU_HEADER_SIZE;
+	struct h264_nal nal, next;
+	size_t pos = 0, offset, chunk;
+	uint8_t nal_header;
+	int have_next;
+	int num_packets = 0;
+	int start, end, marker;
+
+	have_next = h264_nal_next(data, size, &pos, &next);
+	while (have_next) {
+		nal = next;
+		have_next = h264_nal_next(data, size, &pos, &next);
+		marker = last && !have_next;
+
+		if (nal.size <= max_payload) {
+			memcpy(payload, data + nal.offset, nal.size);
+			send(payload, nal.size, marker, send_data);
+			num_packets++;
+			continue;
+		}
+
+		/* The NAL header goes into the FU indicator and header */
+		nal_header = data[nal.offset];
+		offset = 1;
+		start = 1;
+		while (offset < nal.size) {
+			chunk = nal.size - offset < step ? nal.size - offset : step;
+			end = offset + chunk == nal.size;
+
+			/* FU indicator and header - as per section 5.8 of rfc6184. */
+			payload[0] = (nal_header & NRI_MASK) | H264_NAL_FU_A;
+			payload[1] = (start << 7) | (end << 6) |
+				(nal_header & H264_NAL_TYPE_MASK);
+			memcpy(payload + FU_HEADER_SIZE,
+				data + nal.offset + offset, chunk);
+			send(payload, chunk + FU_HEADER_SIZE, marker && end,
+				send_data);
+			num_packets++;
+
+			offset += chunk;
+			start = 0;
+		}
+	}
+
+	return num_packets;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Helpers for walking an H.264 Annex B byte stream: finding NAL units and
+ * splitting an access unit at its slices so that each can be sent as soon
+ * as the transport gets it.
+ */
+
+#ifndef __REMOTE_DISPLAY_H264_NAL_H__
+#define __REMOTE_DISPLAY_H264_NAL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define H264_NAL_TYPE_MASK	0x1f
+
+#define H264_NAL_SLICE		1
+#define H264_NAL_IDR		5
+#define H264_NAL_SEI		6
+#define H264_NAL_FU_A		28
+
+/* One NAL unit found in a byte stream */
+struct h264_nal {
+	/* Offset of the start code, which may be 3 or 4 bytes */
+	size_t start;
+
+	/* Offset and size of the NAL unit itself, from the NAL header up to
+	 * the next start code */
+	size_t offset;
+	size_t size;
+
+	int type;
+};
+
+/*
+ * Find the first NAL unit whose start code begins at or after *pos, and
+ * move *pos past it. Returns 1, or 0 when there are no more.
+ */
+int
+h264_nal_next(const uint8_t *data, size_t size, size_t *pos,
+		struct h264_nal *nal);
+
+/*
+ * Split an access unit into runs of bytes that each end with one coded
+ * slice, writing the end offset of each run to slice_end. The first run
+ * also carries the parameter sets and SEI that come before the first slice.
+ * Slices past max_slices are merged into the last run. Returns the number
+ * of runs, 0 if there are no slices.
+ */
+int
+h264_split_slices(const uint8_t *data, size_t size, int32_t *slice_end,
+		int max_slices);
+
+/* Called with each payload h264_packetize() builds. The payload sits in
+ * the caller's buffer, so it may write a header in front of it. */
+typedef void (*h264_packet_func_t)(uint8_t *payload, size_t size,
+		int marker, void *data);
+
+/*
+ * Packetize every NAL unit in a byte stream as RFC 6184 non-interleaved
+ * mode does: a single NAL unit packet where it fits in max_payload bytes,
+ * FU-A fragments where it doesn't. Start codes of either length are
+ * stripped. Each payload is built in 'payload', which must hold max_payload
+ * bytes. The marker bit goes on the final packet when 'last' is set.
+ * Returns the number of packets sent.
+ */
+int
+h264_packetize(const uint8_t *data, size_t size, uint8_t *payload,
+		size_t max_payload, int last, h264_packet_func_t send,
+		void *send_data);
+
+#endif /* __REMOTE_DISPLAY_H264_NAL_H__ */
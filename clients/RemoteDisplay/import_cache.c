@@ -0,0 +1,139 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "import_cache.h"
+
+void
+import_cache_init(struct import_cache *cache, import_cache_evict_fn evict,
+		void *data)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->evict = evict;
+	cache->data = data;
+}
+
+static void
+evict_entry(struct import_cache *cache, struct import_cache_entry *entry)
+{
+	cache->evict(cache->data, entry->value);
+	entry->valid = 0;
+	cache->evictions++;
+}
+
+void
+import_cache_fini(struct import_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < IMPORT_CACHE_SIZE; i++) {
+		if (cache->entries[i].valid) {
+			evict_entry(cache, &cache->entries[i]);
+		}
+	}
+}
+
+int
+import_key_from_fd(struct import_key *key, int fd, uint32_t stride,
+		uint32_t format, uint32_t width, uint32_t height)
+{
+	struct stat st;
+
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		return -1;
+	}
+
+	memset(key, 0, sizeof(*key));
+	key->dev = st.st_dev;
+	key->ino = st.st_ino;
+	key->stride = stride;
+	key->format = format;
+	key->width = width;
+	key->height = height;
+
+	return 0;
+}
+
+static int
+key_equal(const struct import_key *a, const struct import_key *b)
+{
+	return a->ino == b->ino && a->dev == b->dev &&
+		a->stride == b->stride && a->format == b->format &&
+		a->width == b->width && a->height == b->height;
+}
+
+int
+import_cache_lookup(struct import_cache *cache, const struct import_key *key,
+		uint32_t *value)
+{
+	struct import_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < IMPORT_CACHE_SIZE; i++) {
+		entry = &cache->entries[i];
+		if (entry->valid && key_equal(&entry->key, key)) {
+			entry->last_used = ++cache->clock;
+			*value = entry->value;
+			cache->hits++;
+			return 1;
+		}
+	}
+
+	cache->misses++;
+	return 0;
+}
+
+void
+import_cache_insert(struct import_cache *cache, const struct import_key *key,
+		uint32_t value)
+{
+	struct import_cache_entry *entry = NULL;
+	int i;
+
+	for (i = 0; i < IMPORT_CACHE_SIZE; i++) {
+		if (!cache->entries[i].valid) {
+			entry = &cache->entries[i];
+			break;
+		}
+		if (entry == NULL ||
+		    cache->entries[i].last_used < entry->last_used) {
+			entry = &cache->entries[i];
+		}
+	}
+
+	if (entry->valid) {
+		evict_entry(cache, entry);
+	}
+
+	entry->key = *key;
+	entry->value = value;
+	entry->last_used = ++cache->clock;
+	entry->valid = 1;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Cache of imported capture buffers. The compositor cycles through a small
+ * set of buffers, so rather than importing each captured frame afresh the
+ * encoder keeps what it made from a buffer the last time (a VA surface, for
+ * instance) and looks it up by the identity of the dmabuf.
+ */
+
+#ifndef __REMOTE_DISPLAY_IMPORT_CACHE_H__
+#define __REMOTE_DISPLAY_IMPORT_CACHE_H__
+
+#include <stdint.h>
+
+#define IMPORT_CACHE_SIZE	8
+
+/* Identity of a captured buffer: the dmabuf's inode, which is the same for
+ * every fd exported from one buffer, and how the buffer is laid out. */
+struct import_key {
+	uint64_t dev;
+	uint64_t ino;
+	uint32_t stride;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct import_cache_entry {
+	struct import_key key;
+	uint32_t value;
+	uint64_t last_used;
+	int valid;
+};
+
+/* Called with each value that leaves the cache, to free it */
+typedef void (*import_cache_evict_fn)(void *data, uint32_t value);
+
+struct import_cache {
+	struct import_cache_entry entries[IMPORT_CACHE_SIZE];
+	uint64_t clock;
+
+	import_cache_evict_fn evict;
+	void *data;
+
+	uint64_t hits, misses, evictions;
+};
+
+void
+import_cache_init(struct import_cache *cache, import_cache_evict_fn evict,
+		void *data);
+
+/* Evicts every entry. */
+void
+import_cache_fini(struct import_cache *cache);
+
+/* Fill in 'key' for the dmabuf 'fd'. Returns 0, or -1 if fd can't be
+ * identified, in which case the buffer shouldn't be cached. */
+int
+import_key_from_fd(struct import_key *key, int fd, uint32_t stride,
+		uint32_t format, uint32_t width, uint32_t height);
+
+/* Returns 1 and sets *value if 'key' is cached, otherwise 0. */
+int
+import_cache_lookup(struct import_cache *cache, const struct import_key *key,
+		uint32_t *value);
+
+/* Add 'value' for 'key', evicting the least recently used entry if the
+ * cache is full. 'key' must not already be cached. */
+void
+import_cache_insert(struct import_cache *cache, const struct import_key *key,
+		uint32_t value);
+
+#endif /* __REMOTE_DISPLAY_IMPORT_CACHE_H__ */
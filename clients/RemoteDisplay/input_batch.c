@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <config.h>
+
+#include <string.h>
+
+#include "shared/relay-input-event.h"
+
+#include "input_batch.h"
+#include "ias-shell-client-protocol.h"
+
+
+int
+input_batch_add_touch(struct wl_array *batch,
+		const struct remote_display_touch_event *event)
+{
+	struct ias_relay_input_event *ev;
+	uint32_t type;
+
+	switch(event->type) {
+	case REMOTE_DISPLAY_TOUCH_DOWN:
+		type = IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_DOWN;
+		break;
+	case REMOTE_DISPLAY_TOUCH_UP:
+		type = IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_UP;
+		break;
+	case REMOTE_DISPLAY_TOUCH_MOTION:
+		type = IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_MOTION;
+		break;
+	case REMOTE_DISPLAY_TOUCH_FRAME:
+		type = IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_FRAME;
+		break;
+	case REMOTE_DISPLAY_TOUCH_CANCEL:
+		type = IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_CANCEL;
+		break;
+	default:
+		return 0;
+	}
+
+	ev = wl_array_add(batch, sizeof(*ev));
+	if (!ev) {
+		return -1;
+	}
+
+	memset(ev, 0, sizeof(*ev));
+	ev->kind = IAS_RELAY_INPUT_EVENT_KIND_TOUCH;
+	ev->type = type;
+	ev->time = event->time;
+	ev->touch.id = event->id;
+	ev->touch.x = event->x;
+	ev->touch.y = event->y;
+
+	return 0;
+}
+
+
+int
+input_batch_add_key(struct wl_array *batch,
+		const struct remote_display_key_event *event)
+{
+	struct ias_relay_input_event *ev;
+
+	/* The server only relays key presses and releases. */
+	if (event->type != REMOTE_DISPLAY_KEY_KEY) {
+		return 0;
+	}
+
+	ev = wl_array_add(batch, sizeof(*ev));
+	if (!ev) {
+		return -1;
+	}
+
+	ev->kind = IAS_RELAY_INPUT_EVENT_KIND_KEY;
+	ev->type = IAS_RELAY_INPUT_KEY_EVENT_TYPE_KEY;
+	ev->time = event->time;
+	ev->key.key = event->key;
+	ev->key.state = event->state;
+	ev->key.mods_depressed = event->mods_depressed;
+	ev->key.mods_latched = event->mods_latched;
+	ev->key.mods_locked = event->mods_locked;
+	ev->key.group = event->group;
+
+	return 0;
+}
+
+
+void
+input_batch_send(struct ias_relay_input *ias_in, uint32_t surfid,
+		struct wl_array *batch)
+{
+	const size_t max_size =
+		INPUT_BATCH_MAX_RECORDS * sizeof(struct ias_relay_input_event);
+	struct wl_array chunk;
+	size_t offset;
+
+	/* A larger request would fail to marshal and take the whole
+	 * display connection down with it */
+	for (offset = 0; offset < batch->size; offset += chunk.size) {
+		chunk.data = (char *) batch->data + offset;
+		chunk.size = batch->size - offset;
+		if (chunk.size > max_size) {
+			chunk.size = max_size;
+		}
+		chunk.alloc = chunk.size;
+
+		ias_relay_input_send_events(ias_in, surfid, &chunk);
+	}
+
+	batch->size = 0;
+}
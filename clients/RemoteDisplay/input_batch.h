@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __REMOTE_DISPLAY_INPUT_BATCH_H__
+#define __REMOTE_DISPLAY_INPUT_BATCH_H__
+
+#include <stdint.h>
+
+#include <wayland-util.h>
+
+#include "input_sender.h"
+#include "shared/relay-input-event.h"
+
+struct ias_relay_input;
+
+/*
+ * Most records one send_events request can carry.  A Wayland message is at
+ * most 4096 bytes, and the message header, surfid and array length take
+ * 16 of them.
+ */
+#define INPUT_BATCH_MAX_RECORDS \
+	((4096 - 16) / sizeof(struct ias_relay_input_event))
+
+/*
+ * Append an event to a batch of ias_relay_input_event records for
+ * ias_relay_input.send_events.  Return 0 on success, -1 if out of memory.
+ */
+int
+input_batch_add_touch(struct wl_array *batch,
+		const struct remote_display_touch_event *event);
+
+int
+input_batch_add_key(struct wl_array *batch,
+		const struct remote_display_key_event *event);
+
+/*
+ * Send the batch as ias_relay_input.send_events requests of at most
+ * INPUT_BATCH_MAX_RECORDS records each, in order, and empty it.
+ */
+void
+input_batch_send(struct ias_relay_input *ias_in, uint32_t surfid,
+		struct wl_array *batch);
+
+#endif /* __REMOTE_DISPLAY_INPUT_BATCH_H__ */
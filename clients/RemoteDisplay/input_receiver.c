@@ -33,8 +33,12 @@
 #include <sys/mman.h>
 
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <errno.h>
+#include <time.h>
 
 #include <signal.h>
 
@@ -47,21 +51,16 @@
 
 #include "shared/helpers.h"
 #include "shared/config-parser.h"
+#include "shared/relay-input-event.h"
 
 #include "input_sender.h"
 #include "input_receiver.h"
+#include "input_batch.h"
+#include "input_ring.h"
 #include "ias-shell-client-protocol.h"
 #include "main.h" /* Need access to app_state */
 
 
-struct tcpTransport {
-	int sockDesc;
-	struct sockaddr_in sockAddr;
-	char *ipaddr;
-	unsigned short port;
-	int connected;
-};
-
 struct remoteDisplayInput {
 	int uinput_touch_fd;
 	int uinput_keyboard_fd;
@@ -75,15 +74,53 @@ struct remoteDisplayButtonState{
 		unsigned int state_changed : 1;
 	};
 
+/* Reconnect delays double from the minimum up to the maximum. */
+#define RECONNECT_MIN_MS 100
+#define RECONNECT_MAX_MS 5000
+
+/*
+ * Touch ids from each sender are offset by this much when relayed to a
+ * surface, so that fingers on two tablets don't collide.
+ */
+#define SENDER_TOUCH_ID_STRIDE 16
+
+#define MAX_EPOLL_EVENTS 8
+
+struct input_receiver_private_data;
+
+/* Connection to one input sender. */
+struct tcpTransport {
+	struct input_receiver_private_data *data;
+	int index;
+	int sockDesc;
+	struct sockaddr_in sockAddr;
+	char *ipaddr;
+	unsigned short port;
+	int connecting;
+	int connected;
+	/* When to try connecting again, and how long to wait after that */
+	uint64_t retry_at;
+	uint32_t backoff_ms;
+	struct input_ring ring;
+	struct remoteDisplayButtonState button_state;
+};
+
 struct input_receiver_private_data {
-	struct tcpTransport transport;
+	/* Storage for the transports' ipaddr strings */
+	char *ipaddrs;
+	struct tcpTransport *transports;
+	int num_transports;
+	int epoll_fd;
+	/* Written by stop_event_listener() to wake the receiver thread */
+	int wake_fd;
 	struct remoteDisplayInput input;
 	volatile int running;
 	int verbose;
 	struct app_state *appstate;
-	struct remoteDisplayButtonState button_state;
 	/* input receiver thread */
 	pthread_t input_thread;
+	/* Events for one ias_relay_input.send_events request */
+	struct wl_array batch;
 };
 
 
@@ -260,10 +297,28 @@ init_surface_touch(void)
 }
 
 
+static int
+use_batch(struct ias_relay_input *ias_in)
+{
+	return ias_relay_input_get_version(ias_in) >=
+		IAS_RELAY_INPUT_SEND_EVENTS_SINCE_VERSION;
+}
+
+
 static void
-handle_surface_touch_event(struct ias_relay_input *ias_in, uint32_t surfid,
+handle_surface_touch_event(struct input_receiver_private_data *data,
 		const struct remote_display_touch_event *event)
 {
+	struct ias_relay_input *ias_in = data->appstate->ias_in;
+	uint32_t surfid = data->appstate->surfid;
+
+	if (use_batch(ias_in)) {
+		if (input_batch_add_touch(&data->batch, event) < 0) {
+			fprintf(stderr, "Failed to batch touch event.\n");
+		}
+		return;
+	}
+
 	printf("Touch event for surface.\n");
 	switch(event->type) {
 	case REMOTE_DISPLAY_TOUCH_DOWN:
@@ -359,9 +414,19 @@ init_output_keyboard(int *uinput_keyboard_fd_out)
 }
 
 static void
-handle_surface_key_event(struct ias_relay_input *ias_in, uint32_t surfid,
+handle_surface_key_event(struct input_receiver_private_data *data,
 		const struct remote_display_key_event *event)
 {
+	struct ias_relay_input *ias_in = data->appstate->ias_in;
+	uint32_t surfid = data->appstate->surfid;
+
+	if (use_batch(ias_in)) {
+		if (input_batch_add_key(&data->batch, event) < 0) {
+			fprintf(stderr, "Failed to batch key event.\n");
+		}
+		return;
+	}
+
 	printf("Keyboard event for surface.\n");
 	switch(event->type) {
 	case REMOTE_DISPLAY_KEY_KEY:
@@ -507,7 +572,7 @@ handle_output_pointer_event(const struct remote_display_pointer_event *event,
 }
 
 static void
-handle_surface_pointer_event(struct ias_relay_input *ias_in, uint32_t surfid,
+handle_surface_pointer_event(struct input_receiver_private_data *data,
 		struct remoteDisplayButtonState *button_state,
 		const struct remote_display_pointer_event *event)
 {
@@ -515,26 +580,14 @@ handle_surface_pointer_event(struct ias_relay_input *ias_in, uint32_t surfid,
 	uint32_t send_event = 0;
 
 	printf("Pointer event for surface.\n");
-	convert_pointer_to_touch(button_state, event, &touch_event, &send_event);
+	convert_pointer_to_touch(button_state, event, &touch_event,
+			&send_event);
 	if (send_event) {
-		handle_surface_touch_event(ias_in, surfid, &touch_event);
+		handle_surface_touch_event(data, &touch_event);
 	}
 }
 
 
-static void
-close_transport(struct tcpTransport *transport)
-{
-	printf("Closing transport...\n");
-	if (transport->sockDesc >= 0) {
-		close(transport->sockDesc);
-		transport->sockDesc = -1;
-	}
-	transport->connected = 0;
-	/* May need to consider tracking the state, so that any multi-touch slots
-	 * that are currently "down" are sent an up event. */
-}
-
 static void
 cleanup_input(struct remoteDisplayInput *input)
 {
@@ -558,203 +611,455 @@ cleanup_input(struct remoteDisplayInput *input)
 }
 
 
+static uint64_t
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static void
+close_transport(struct tcpTransport *transport)
+{
+	if (transport->sockDesc >= 0) {
+		epoll_ctl(transport->data->epoll_fd, EPOLL_CTL_DEL,
+				transport->sockDesc, NULL);
+		close(transport->sockDesc);
+		transport->sockDesc = -1;
+	}
+	transport->connecting = 0;
+	transport->connected = 0;
+	input_ring_reset(&transport->ring);
+	/* May need to consider tracking the state, so that any multi-touch slots
+	 * that are currently "down" are sent an up event. */
+}
+
+
+static void
+schedule_reconnect(struct tcpTransport *transport)
+{
+	close_transport(transport);
+	transport->retry_at = now_ms() + transport->backoff_ms;
+	transport->backoff_ms = MIN(transport->backoff_ms * 2, RECONNECT_MAX_MS);
+}
+
+
+/*
+ * Start a nonblocking connect.  Completion is reported by epoll as the
+ * socket becoming writable, and handled in finish_connect().
+ */
 static void
 init_transport(struct tcpTransport *transport)
 {
+	struct epoll_event ev;
 	int ret = 0;
 
-	printf("Initialising transport on input receiver...\n");
-	transport->sockDesc = socket(AF_INET , SOCK_STREAM , IPPROTO_IP);
+	transport->sockDesc = socket(AF_INET,
+			SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_IP);
 	if (transport->sockDesc == -1) {
 		fprintf(stderr, "Socket creation failed.\n");
+		schedule_reconnect(transport);
 		return;
 	}
 
-	transport->sockAddr.sin_family = AF_INET;
-	transport->sockAddr.sin_addr.s_addr = inet_addr(transport->ipaddr);
-	transport->sockAddr.sin_port = htons(transport->port);
-
 	ret = connect(transport->sockDesc,
 			(struct sockaddr *) &transport->sockAddr,
 			sizeof(transport->sockAddr));
-	if (ret < 0) {
-		fprintf(stderr, "Error connecting to input sender.\n");
-		close(transport->sockDesc);
-		transport->sockDesc = -1;
+	if (ret < 0 && errno != EINPROGRESS) {
+		schedule_reconnect(transport);
 		return;
 	}
 
-	printf("Connected to input sender.\n");
+	memset(&ev, 0, sizeof(ev));
+	ev.events = ret == 0 ? EPOLLIN : EPOLLOUT;
+	ev.data.ptr = transport;
+	if (epoll_ctl(transport->data->epoll_fd, EPOLL_CTL_ADD,
+				transport->sockDesc, &ev) < 0) {
+		fprintf(stderr, "Failed to watch input sender socket.\n");
+		schedule_reconnect(transport);
+		return;
+	}
+
+	if (ret == 0) {
+		printf("Connected to input sender %s:%d.\n",
+			transport->ipaddr, transport->port);
+		transport->connected = 1;
+		transport->backoff_ms = RECONNECT_MIN_MS;
+	} else {
+		transport->connecting = 1;
+	}
+}
+
+
+static void
+finish_connect(struct tcpTransport *transport)
+{
+	struct epoll_event ev;
+	socklen_t len = sizeof(int);
+	int err = 0;
+
+	transport->connecting = 0;
+	if (getsockopt(transport->sockDesc, SOL_SOCKET, SO_ERROR, &err, &len) < 0 ||
+			err) {
+		if (transport->data->verbose) {
+			printf("Error connecting to input sender %s:%d, retrying in %u ms.\n",
+				transport->ipaddr, transport->port, transport->backoff_ms);
+		}
+		schedule_reconnect(transport);
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = transport;
+	epoll_ctl(transport->data->epoll_fd, EPOLL_CTL_MOD,
+			transport->sockDesc, &ev);
+
+	printf("Connected to input sender %s:%d.\n",
+		transport->ipaddr, transport->port);
 	transport->connected = 1;
+	transport->backoff_ms = RECONNECT_MIN_MS;
 }
 
 
-#define MESG_SIZE 100
-static void *
-receive_events(void * const priv_data)
+/*
+ * Called by input_ring_parse() for each whole event from a sender.
+ * Short payloads from older senders are zero-extended.
+ */
+static void
+dispatch_event(void *priv_data, uint32_t type, const void *payload,
+		uint32_t size)
 {
-	int ret = 0;
-	struct remote_display_input_event_header header;
-	struct remote_display_touch_event touch_event;
-	struct remote_display_key_event key_event;
-	struct remote_display_pointer_event pointer_event;
-	struct input_receiver_private_data *data = priv_data;
+	struct tcpTransport *transport = priv_data;
+	struct input_receiver_private_data *data = transport->data;
+	struct app_state *appstate = data->appstate;
+	union {
+		struct remote_display_touch_event touch;
+		struct remote_display_key_event key;
+		struct remote_display_pointer_event pointer;
+	} event;
+
+	memset(&event, 0, sizeof(event));
+	memcpy(&event, payload, MIN(size, sizeof(event)));
 
-	init_transport(&data->transport);
-	data->running = 1;
+	if (appstate->surfid) {
+		switch(type) {
+		case REMOTE_DISPLAY_TOUCH_EVENT:
+			event.touch.id += transport->index * SENDER_TOUCH_ID_STRIDE;
+			handle_surface_touch_event(data, &event.touch);
+			break;
+		case REMOTE_DISPLAY_KEY_EVENT:
+			handle_surface_key_event(data, &event.key);
+			break;
+		case REMOTE_DISPLAY_POINTER_EVENT:
+			handle_surface_pointer_event(data, &transport->button_state,
+					&event.pointer);
+			break;
+		default:
+			if (data->verbose > 1) {
+				printf("Unknown event type for surface %d.\n",
+						appstate->surfid);
+			}
+			break;
+		}
+	} else {
+		switch(type) {
+		case REMOTE_DISPLAY_TOUCH_EVENT:
+			if (data->verbose > 1) {
+				printf("Touch event received for output %d...\n",
+					appstate->output_number);
+			}
+			handle_output_touch_event(&event.touch, appstate);
+			break;
+		case REMOTE_DISPLAY_KEY_EVENT:
+			if (data->verbose > 1) {
+				printf("Key event received for output %d...\n",
+					appstate->output_number);
+			}
+			handle_output_key_event(&event.key, appstate);
+			break;
+		case REMOTE_DISPLAY_POINTER_EVENT:
+			if (data->verbose > 1) {
+				printf("Pointer event received for output %d...\n",
+					appstate->output_number);
+			}
+			handle_output_pointer_event(&event.pointer,
+					&transport->button_state, appstate);
+			break;
+		default:
+			if (data->verbose > 1) {
+				printf("Unknown event type for output %d.\n",
+					appstate->output_number);
+			}
+			break;
+		}
+	}
+}
 
-	while (data->running) {
-		if (data->transport.connected) {
-			ret = recv(data->transport.sockDesc, &header, sizeof(header), 0);
+
+/*
+ * Read what the sender has ready and handle every whole event in it.  Events
+ * that arrive fragmented simply wait in the ring for the rest of their bytes.
+ * Everything handled in one go is passed to the server in as few requests
+ * as the message size limit allows (a full ring makes three), so that a
+ * burst of remote input costs a few rounds of marshalling and one flush
+ * rather than one per event.
+ */
+static void
+read_transport(struct tcpTransport *transport)
+{
+	struct input_receiver_private_data *data = transport->data;
+	ssize_t ret;
+
+	ret = input_ring_recv(&transport->ring, transport->sockDesc);
+	if (ret < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return;
+	}
+	if (ret <= 0) {
+		printf("Input sender %s:%d has closed socket. Attempting to reconnect...\n",
+			transport->ipaddr, transport->port);
+		schedule_reconnect(transport);
+		return;
+	}
+
+	if (input_ring_parse(&transport->ring, dispatch_event, transport) < 0) {
+		fprintf(stderr, "Corrupt input event stream from %s:%d.\n",
+			transport->ipaddr, transport->port);
+		schedule_reconnect(transport);
+	}
+
+	if (data->appstate->surfid) {
+		if (data->batch.size) {
+			if (data->verbose > 1) {
+				printf("Relaying %zu input events to surface %d...\n",
+					data->batch.size / sizeof(struct ias_relay_input_event),
+					data->appstate->surfid);
+			}
+			input_batch_send(data->appstate->ias_in,
+					data->appstate->surfid, &data->batch);
 		}
-		if (data->running == 0) {
-			printf("Receive interrupted by shutdown.\n");
+		wl_display_flush(data->appstate->display);
+	}
+}
+
+
+/*
+ * Start connecting to any sender whose backoff has expired and return how
+ * long epoll may sleep before the next one is due, or -1 if none are.
+ */
+static int
+reconnect_transports(struct input_receiver_private_data *data)
+{
+	uint64_t now = now_ms();
+	int timeout = -1;
+	int i;
+
+	for (i = 0; i < data->num_transports; i++) {
+		struct tcpTransport *transport = &data->transports[i];
+		int wait;
+
+		if (transport->sockDesc >= 0) {
 			continue;
 		}
-		if (data->transport.connected == 0) {
-			/* Do nothing. */
-		} else if (ret <= 0) {
-			printf("Header receive failed.\n");
-		} else if (data->appstate->surfid) {
-			switch(header.type) {
-			case REMOTE_DISPLAY_TOUCH_EVENT:
-				if (data->verbose > 1) {
-					printf("Touch event received for surface %d...\n",
-						data->appstate->surfid);
-				}
-				ret = recv(data->transport.sockDesc, &touch_event, header.size, 0);
-				if (ret > 0) {
-					handle_surface_touch_event(data->appstate->ias_in,
-							data->appstate->surfid,
-							&touch_event);
-				}
-				break;
-			case REMOTE_DISPLAY_KEY_EVENT:
-				if (data->verbose > 1) {
-					printf("Key event received for surface %d...\n",
-						data->appstate->surfid);
-				}
-				ret = recv(data->transport.sockDesc, &key_event, header.size, 0);
-				if (ret > 0) {
-					handle_surface_key_event(data->appstate->ias_in,
-							data->appstate->surfid,
-							&key_event);
-				}
-				break;
-			case REMOTE_DISPLAY_POINTER_EVENT:
-				if (data->verbose > 1) {
-					printf("Pointer event received for surface %d...\n",
-						data->appstate->surfid);
-				}
-				ret = recv(data->transport.sockDesc, &pointer_event, header.size, 0);
-				if (ret > 0) {
-					handle_surface_pointer_event(data->appstate->ias_in,
-							data->appstate->surfid, &data->button_state,
-							&pointer_event);
-				}
-				break;
-			default:
-				if (data->verbose > 1) {
-					printf("Unknown event type for surface %d.\n",
-							data->appstate->surfid);
-				}
-				break;
-			}
-			wl_display_flush(data->appstate->display);
-		} else {
-			switch(header.type) {
-			case REMOTE_DISPLAY_TOUCH_EVENT:
-				if (data->verbose > 1) {
-					printf("Touch event received for output %d...\n",
-						data->appstate->output_number);
-				}
-				ret = recv(data->transport.sockDesc, &touch_event,
-						header.size, 0);
-				if (ret > 0) {
-					handle_output_touch_event(&touch_event, data->appstate);
-				}
-				break;
-			case REMOTE_DISPLAY_KEY_EVENT:
-				if (data->verbose > 1) {
-					printf("Key event received for output %d...\n",
-						data->appstate->output_number);
-				}
-				ret = recv(data->transport.sockDesc, &key_event, header.size, 0);
-				if (ret > 0) {
-					handle_output_key_event(&key_event, data->appstate);
-				}
-				break;
-			case REMOTE_DISPLAY_POINTER_EVENT:
-				if (data->verbose > 1) {
-					printf("Pointer event received for output %d...\n",
-						data->appstate->output_number);
-				}
-				ret = recv(data->transport.sockDesc, &pointer_event, header.size, 0);
-				if (ret > 0) {
-					handle_output_pointer_event(&pointer_event,
-							&data->button_state, data->appstate);
-				}
-				break;
-			default:
-				if (data->verbose > 1) {
-					printf("Unknown event type for output %d.\n",
-						data->appstate->output_number);
-				}
-				break;
+
+		if (transport->retry_at <= now) {
+			init_transport(transport);
+			if (transport->sockDesc >= 0) {
+				continue;
 			}
 		}
-		if (ret <= 0) {
-			if (data->transport.connected) {
-				printf("Sender has closed socket. Attempting to reconnect...\n");
-				close_transport(&data->transport);
+
+		wait = transport->retry_at > now ? transport->retry_at - now : 0;
+		if (timeout < 0 || wait < timeout) {
+			timeout = wait;
+		}
+	}
+
+	return timeout;
+}
+
+
+static void *
+receive_events(void * const priv_data)
+{
+	struct input_receiver_private_data *data = priv_data;
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	int timeout;
+	int count;
+	int i;
+
+	while (data->running) {
+		timeout = reconnect_transports(data);
+
+		count = epoll_wait(data->epoll_fd, events, ARRAY_LENGTH(events),
+				timeout);
+		if (count < 0 && errno != EINTR) {
+			fprintf(stderr, "Input receiver epoll_wait failed: %s\n",
+				strerror(errno));
+			break;
+		}
+
+		for (i = 0; i < count && data->running; i++) {
+			struct tcpTransport *transport = events[i].data.ptr;
+
+			/* The wake eventfd; 'running' tells us why. */
+			if (!transport) {
+				continue;
 			}
-			init_transport(&data->transport);
-			if (!data->transport.connected) {
-				sleep(1);
+
+			if (transport->connecting) {
+				finish_connect(transport);
+			} else if (transport->connected) {
+				read_transport(transport);
 			}
 		}
 	}
 
-	close_transport(&data->transport);
-	cleanup_input(&data->input);
-	free(priv_data);
-
 	printf("Receive thread finished.\n");
 	return 0;
 }
 
 
+static void
+destroy_event_listener(struct input_receiver_private_data *data)
+{
+	int i;
+
+	for (i = 0; i < data->num_transports; i++) {
+		close_transport(&data->transports[i]);
+	}
+	cleanup_input(&data->input);
+
+	if (data->wake_fd >= 0) {
+		close(data->wake_fd);
+	}
+	if (data->epoll_fd >= 0) {
+		close(data->epoll_fd);
+	}
+
+	wl_array_release(&data->batch);
+	free(data->transports);
+	free(data->ipaddrs);
+	free(data);
+}
+
+
+/*
+ * relay_input_ipaddr is a comma separated list of senders, each optionally
+ * with its own ":port"; relay_input_port is the default port.
+ */
+static int
+init_transports(struct input_receiver_private_data *data, char *ipaddrs,
+		int default_port)
+{
+	char *saveptr = NULL;
+	char *addr;
+	int count = 1;
+	char *p;
+
+	for (p = ipaddrs; *p; p++) {
+		if (*p == ',') {
+			count++;
+		}
+	}
+
+	data->transports = calloc(count, sizeof(*data->transports));
+	if (!data->transports) {
+		return -1;
+	}
+
+	for (addr = strtok_r(ipaddrs, ",", &saveptr); addr;
+			addr = strtok_r(NULL, ",", &saveptr)) {
+		struct tcpTransport *transport =
+			&data->transports[data->num_transports];
+		char *port = strchr(addr, ':');
+
+		if (port) {
+			*port++ = '\0';
+		}
+
+		transport->data = data;
+		transport->index = data->num_transports;
+		transport->sockDesc = -1;
+		transport->ipaddr = addr;
+		transport->port = port ? atoi(port) : default_port;
+		transport->backoff_ms = RECONNECT_MIN_MS;
+		transport->sockAddr.sin_family = AF_INET;
+		transport->sockAddr.sin_addr.s_addr = inet_addr(addr);
+		transport->sockAddr.sin_port = htons(transport->port);
+		input_ring_reset(&transport->ring);
+
+		printf("Receiving input events from %s:%d.\n", transport->ipaddr,
+			transport->port);
+		data->num_transports++;
+	}
+
+	return data->num_transports ? 0 : -1;
+}
+
+
 void
 start_event_listener(struct app_state *appstate, int *argc, char **argv)
 {
 	struct input_receiver_private_data *data = NULL;
+	struct epoll_event ev;
+	char *ipaddrs = NULL;
+	int port = 0;
 	int ret = 0;
 	int touch_ret = 0;
 	int keyb_ret = 0;
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_STRING,  "relay_input_ipaddr", 0, &ipaddrs},
+		{ WESTON_OPTION_INTEGER, "relay_input_port", 0, &port},
+	};
+
+	parse_options(options, ARRAY_LENGTH(options), argc, argv);
 
+	if ((ipaddrs == NULL) || (ipaddrs[0] == 0)) {
+		printf("Not listening for input events; network configuration not set.\n");
+		free(ipaddrs);
+		return;
+	}
 
 	data = calloc(1, sizeof(*data));
 	if (!data) {
 		fprintf(stderr, "Failed to allocate memory for input receiver private data.\n");
+		free(ipaddrs);
 		return;
-	} else {
-		int port = 0;
-		const struct weston_option options[] = {
-			{ WESTON_OPTION_STRING,  "relay_input_ipaddr", 0, &data->transport.ipaddr},
-			{ WESTON_OPTION_INTEGER, "relay_input_port", 0, &port},
-		};
+	}
+	data->ipaddrs = ipaddrs;
+	data->appstate = appstate;
+	data->verbose = appstate->verbose;
+	data->input.uinput_touch_fd = -1;
+	data->input.uinput_keyboard_fd = -1;
+	data->input.uinput_pointer_fd = -1;
+	data->wake_fd = -1;
+	wl_array_init(&data->batch);
+
+	data->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (data->epoll_fd < 0) {
+		fprintf(stderr, "Failed to create input receiver epoll fd.\n");
+		destroy_event_listener(data);
+		return;
+	}
 
-		parse_options(options, ARRAY_LENGTH(options), argc, argv);
-		data->transport.port = port;
+	data->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (data->wake_fd < 0 ||
+			epoll_ctl(data->epoll_fd, EPOLL_CTL_ADD, data->wake_fd, &ev) < 0) {
+		fprintf(stderr, "Failed to create input receiver wake fd.\n");
+		destroy_event_listener(data);
+		return;
 	}
 
-	if ((data->transport.ipaddr != NULL) && (data->transport.ipaddr[0] != 0)) {
-		printf("Receiving input events from %s:%d.\n", data->transport.ipaddr,
-			data->transport.port);
-	} else {
-		printf("Not listening for input events; network configuration not set.\n");
-		free(data);
-		data = NULL;
+	if (init_transports(data, ipaddrs, port) < 0) {
+		fprintf(stderr, "No usable input sender addresses.\n");
+		destroy_event_listener(data);
 		return;
 	}
 
@@ -784,24 +1089,23 @@ start_event_listener(struct app_state *appstate, int *argc, char **argv)
 
 	if (touch_ret) {
 		fprintf(stderr, "Error initialising touch input - %d.\n", touch_ret);
-		free(data);
+		destroy_event_listener(data);
 		return;
 	}
 	if (keyb_ret) {
 		fprintf(stderr, "Error initialising keyboard input - %d.\n", keyb_ret);
-		free(data);
+		destroy_event_listener(data);
 		return;
 	}
 
+	data->running = 1;
 	ret = pthread_create(&data->input_thread, NULL, receive_events, data);
 	if (ret) {
 		fprintf(stderr, "Transport thread creation failure: %d\n", ret);
-		free(data);
+		destroy_event_listener(data);
 		return;
 	}
 
-	data->appstate = appstate;
-	data->verbose = appstate->verbose;
 	appstate->ir_priv = data;
 	printf("Input receiver started.\n");
 }
@@ -816,7 +1120,10 @@ stop_event_listener(struct input_receiver_private_data *priv_data)
 	if (priv_data->verbose) {
 		printf("Waiting for input receiver thread to finish...\n");
 	}
-	shutdown(priv_data->transport.sockDesc, SHUT_RDWR);
+	if (eventfd_write(priv_data->wake_fd, 1) < 0) {
+		fprintf(stderr, "Failed to wake input receiver thread.\n");
+	}
 	pthread_join(priv_data->input_thread, NULL);
+	destroy_event_listener(priv_data);
 	printf("Input receiver thread stopped.\n");
 }
@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <config.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "input_ring.h"
+
+
+/* Copy 'len' bytes starting 'offset' bytes past the tail out of the ring. */
+static void
+ring_peek(const struct input_ring *ring, uint32_t offset, void *dst,
+		uint32_t len)
+{
+	uint32_t start = (ring->tail + offset) & (INPUT_RING_SIZE - 1);
+	uint32_t first = INPUT_RING_SIZE - start;
+
+	if (first >= len) {
+		memcpy(dst, ring->data + start, len);
+	} else {
+		memcpy(dst, ring->data + start, first);
+		memcpy((uint8_t *) dst + first, ring->data, len - first);
+	}
+}
+
+
+ssize_t
+input_ring_recv(struct input_ring *ring, int fd)
+{
+	uint32_t space = INPUT_RING_SIZE - input_ring_used(ring);
+	uint32_t start = ring->head & (INPUT_RING_SIZE - 1);
+	uint32_t first = INPUT_RING_SIZE - start;
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t ret;
+
+	if (space == 0) {
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov[0].iov_base = ring->data + start;
+	iov[0].iov_len = first < space ? first : space;
+	iov[1].iov_base = ring->data;
+	iov[1].iov_len = space - iov[0].iov_len;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+
+	ret = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (ret > 0) {
+		ring->head += ret;
+	}
+
+	return ret;
+}
+
+
+int
+input_ring_parse(struct input_ring *ring,
+		input_stream_handler_t handler, void *data)
+{
+	struct remote_display_input_event_header header;
+	uint8_t payload[INPUT_STREAM_MAX_PAYLOAD];
+	int count = 0;
+
+	while (input_ring_used(ring) >= sizeof(header)) {
+		ring_peek(ring, 0, &header, sizeof(header));
+		if (header.size > INPUT_STREAM_MAX_PAYLOAD) {
+			return -1;
+		}
+		if (input_ring_used(ring) - sizeof(header) < header.size) {
+			break;
+		}
+
+		ring_peek(ring, sizeof(header), payload, header.size);
+		ring->tail += sizeof(header) + header.size;
+		handler(data, header.type, payload, header.size);
+		count++;
+	}
+
+	return count;
+}
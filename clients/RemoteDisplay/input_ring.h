@@ -0,0 +1,84 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __REMOTE_DISPLAY_INPUT_RING_H__
+#define __REMOTE_DISPLAY_INPUT_RING_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "input_sender.h"
+
+/* Must be a power of two. */
+#define INPUT_RING_SIZE 8192
+
+/* Largest payload we accept after a remote_display_input_event_header. */
+#define INPUT_STREAM_MAX_PAYLOAD 256
+
+/*
+ * Receive buffer for one sender's event stream.  'head' and 'tail' are free
+ * running byte counts; only their difference and their value modulo the
+ * size matter, so a message may wrap around the end of 'data'.
+ */
+struct input_ring {
+	uint8_t data[INPUT_RING_SIZE];
+	uint32_t head;
+	uint32_t tail;
+};
+
+typedef void (*input_stream_handler_t)(void *data, uint32_t type,
+		const void *payload, uint32_t size);
+
+static inline void
+input_ring_reset(struct input_ring *ring)
+{
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+static inline uint32_t
+input_ring_used(const struct input_ring *ring)
+{
+	return ring->head - ring->tail;
+}
+
+/*
+ * Read whatever 'fd' has ready into the free space of the ring without
+ * blocking.  Returns the byte count, 0 at end of stream, or -1 with errno
+ * set (EAGAIN if there was nothing to read).
+ */
+ssize_t
+input_ring_recv(struct input_ring *ring, int fd);
+
+/*
+ * Call 'handler' for every complete header + payload message in the ring and
+ * consume them, leaving any trailing partial message for the next read.
+ * Returns the number of messages handled, or -1 if the stream is corrupt.
+ */
+int
+input_ring_parse(struct input_ring *ring,
+		input_stream_handler_t handler, void *data);
+
+#endif /* __REMOTE_DISPLAY_INPUT_RING_H__ */
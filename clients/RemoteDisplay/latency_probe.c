@@ -0,0 +1,194 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <time.h>
+
+#include "h264_nal.h"
+#include "latency_probe.h"
+
+#define SEI_USER_DATA_UNREGISTERED	5
+
+/* UUID, capture time and frame number */
+#define PROBE_PAYLOAD_SIZE	(16 + 8 + 4)
+
+/* Identifies our user data among any others */
+static const uint8_t probe_uuid[16] = {
+	0x52, 0x44, 0x4c, 0x50, 0x2d, 0x9b, 0x4e, 0x61,
+	0xa7, 0x3c, 0x5e, 0x11, 0xc2, 0x80, 0x4d, 0x17,
+};
+
+uint64_t
+latency_probe_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+size_t
+latency_probe_write(uint8_t *out, const struct latency_probe *probe)
+{
+	uint8_t rbsp[2 + PROBE_PAYLOAD_SIZE + 1];
+	size_t len = 0, i;
+	int zeros = 0;
+	int shift;
+
+	rbsp[len++] = SEI_USER_DATA_UNREGISTERED;
+	rbsp[len++] = PROBE_PAYLOAD_SIZE;
+	memcpy(rbsp + len, probe_uuid, sizeof(probe_uuid));
+	len += sizeof(probe_uuid);
+	for (shift = 56; shift >= 0; shift -= 8) {
+		rbsp[len++] = probe->capture_us >> shift;
+	}
+	for (shift = 24; shift >= 0; shift -= 8) {
+		rbsp[len++] = probe->frame_number >> shift;
+	}
+	/* rbsp_trailing_bits */
+	rbsp[len++] = 0x80;
+
+	out[0] = 0;
+	out[1] = 0;
+	out[2] = 0;
+	out[3] = 1;
+	out[4] = H264_NAL_SEI;
+	len = 5;
+
+	/* Emulation prevention */
+	for (i = 0; i < sizeof(rbsp); i++) {
+		if (zeros == 2 && rbsp[i] <= 3) {
+			out[len++] = 3;
+			zeros = 0;
+		}
+		out[len++] = rbsp[i];
+		zeros = rbsp[i] == 0 ? zeros + 1 : 0;
+	}
+
+	return len;
+}
+
+/* Undo emulation prevention, returning the RBSP size */
+static size_t
+unescape(const uint8_t *nal, size_t size, uint8_t *rbsp, size_t max)
+{
+	size_t len = 0, i;
+	int zeros = 0;
+
+	for (i = 0; i < size && len < max; i++) {
+		if (zeros == 2 && nal[i] == 3) {
+			zeros = 0;
+			continue;
+		}
+		rbsp[len++] = nal[i];
+		zeros = nal[i] == 0 ? zeros + 1 : 0;
+	}
+
+	return len;
+}
+
+static int
+parse_sei(const uint8_t *rbsp, size_t size, struct latency_probe *probe)
+{
+	size_t pos = 0;
+	uint32_t type, payload_size;
+	const uint8_t *p;
+	int i;
+
+	/* Stop at the trailing bits */
+	while (pos + 1 < size) {
+		type = 0;
+		while (pos < size && rbsp[pos] == 0xff) {
+			type += 255;
+			pos++;
+		}
+		if (pos >= size) {
+			return 0;
+		}
+		type += rbsp[pos++];
+
+		payload_size = 0;
+		while (pos < size && rbsp[pos] == 0xff) {
+			payload_size += 255;
+			pos++;
+		}
+		if (pos >= size) {
+			return 0;
+		}
+		payload_size += rbsp[pos++];
+
+		if (payload_size > size - pos) {
+			return 0;
+		}
+
+		p = rbsp + pos;
+		if (type == SEI_USER_DATA_UNREGISTERED &&
+		    payload_size >= PROBE_PAYLOAD_SIZE &&
+		    memcmp(p, probe_uuid, sizeof(probe_uuid)) == 0) {
+			p += sizeof(probe_uuid);
+			probe->capture_us = 0;
+			for (i = 0; i < 8; i++) {
+				probe->capture_us = probe->capture_us << 8 | *p++;
+			}
+			probe->frame_number = 0;
+			for (i = 0; i < 4; i++) {
+				probe->frame_number = probe->frame_number << 8 | *p++;
+			}
+			return 1;
+		}
+
+		pos += payload_size;
+	}
+
+	return 0;
+}
+
+int
+latency_probe_find(const uint8_t *data, size_t size,
+		struct latency_probe *probe)
+{
+	uint8_t rbsp[256];
+	struct h264_nal nal;
+	size_t pos = 0;
+	size_t len;
+
+	while (h264_nal_next(data, size, &pos, &nal)) {
+		if (nal.type != H264_NAL_SEI) {
+			continue;
+		}
+
+		/* Skip the NAL header. Only the start of a long SEI is
+		 * looked at; the probe is written on its own. */
+		len = unescape(data + nal.offset + 1, nal.size - 1,
+				rbsp, sizeof(rbsp));
+		if (parse_sei(rbsp, len, probe)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
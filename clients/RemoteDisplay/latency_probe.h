@@ -0,0 +1,69 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Glass-to-glass latency probe. The sender puts the time a frame was
+ * captured into the stream ahead of the frame, as an H.264 SEI
+ * user_data_unregistered message, and a receiver that finds it can
+ * subtract it from the time the frame was shown. Decoders that don't know
+ * the message skip it.
+ *
+ * Times are CLOCK_REALTIME in microseconds, so sender and receiver on
+ * different machines need synchronised clocks.
+ */
+
+#ifndef __REMOTE_DISPLAY_LATENCY_PROBE_H__
+#define __REMOTE_DISPLAY_LATENCY_PROBE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest SEI NAL unit latency_probe_write() produces, with start code */
+#define LATENCY_PROBE_MAX_SIZE	64
+
+struct latency_probe {
+	uint64_t capture_us;
+	uint32_t frame_number;
+};
+
+uint64_t
+latency_probe_now_us(void);
+
+/*
+ * Write the probe as an SEI NAL unit with a 4-byte start code to 'out',
+ * which must hold LATENCY_PROBE_MAX_SIZE bytes. Returns the size written.
+ */
+size_t
+latency_probe_write(uint8_t *out, const struct latency_probe *probe);
+
+/*
+ * Look through 'size' bytes of Annex B stream for a probe. Returns 1 and
+ * fills in 'probe' if one is found, otherwise 0.
+ */
+int
+latency_probe_find(const uint8_t *data, size_t size,
+		struct latency_probe *probe);
+
+#endif /* __REMOTE_DISPLAY_LATENCY_PROBE_H__ */
@@ -45,6 +45,7 @@
 #include "encoder.h"
 #include "main.h"
 #include "input_receiver.h"
+#include "tile_codec.h"
 
 enum {
 	STOP_DISPLAY = 0,
@@ -147,6 +148,12 @@ handle_surface_destroyed(void *data,
 	struct app_state *app_state = data;
 	struct surf_list *s, *tmp;
 
+	/* Buffers imported from the captured surface won't come again */
+	if (app_state->rd_encoder && app_state->surfid &&
+	    id == app_state->surfid) {
+		rd_encoder_invalidate_imports(app_state->rd_encoder);
+	}
+
 	/* Find the surface and remove it from our surface list */
 	wl_list_for_each_safe(s, tmp, &app_state->surface_list, link) {
 		if (s->surf_id == id) {
@@ -400,7 +407,8 @@ registry_handle_global(void *data, struct wl_registry *registry, uint32_t id,
 		ias_hmi_add_listener(app_state->hmi, &hmi_listener, app_state);
 	} else if (strcmp(interface, "ias_relay_input") == 0) {
 		printf("Bind ias_relay_input.\n");
-		app_state->ias_in = wl_registry_bind(registry, id, &ias_relay_input_interface, 1);
+		app_state->ias_in = wl_registry_bind(registry, id,
+				&ias_relay_input_interface, MIN(version, 2));
 	} else if (strcmp(interface, "wl_output") == 0) {
 		new_output = calloc(1, sizeof *new_output);
 		if (!new_output) {
@@ -586,6 +594,40 @@ usage(int error_code)
 	printf("\t--output=<output_number>\tweston output to capture, starting"
 		" from 0 - ignored if surfid is given\n");
 	printf("\t--fps=<fps>\tapproximate frames to encode and transport\n");
+	printf("\t--encoder=<backend>\t\tva, cpu or tiles; by default va,"
+		" or cpu if VA-API can't be used;\n"
+		"\t\t\t\t\ttiles isn't H.264, so can't be sent with the"
+		" udp or avb plugins\n"
+		"\t--tile_size=<pixels>\t\ttiles backend: tile size, %d to %d"
+		" (default %d)\n"
+		"\t--key_interval=<frames>\t\ttiles backend: frames between"
+		" full frames,\n"
+		"\t\t\t\t\t0 (default) for only when frames are lost\n",
+		TILE_SIZE_MIN, TILE_SIZE_MAX, TILE_SIZE_DEFAULT);
+	printf("\t--slices=<n>\t\t\tslices per frame, 1 (default) to %d;"
+		" each is sent\n"
+		"\t\t\t\t\tas soon as it is ready\n"
+		"\t--latency_probe\t\t\tput the capture time ahead of each"
+		" frame\n"
+		"\t\t\t\t\tfor a receiver to measure latency\n",
+		RD_ENCODER_MAX_SLICES);
+	printf("\t--bitrate=<kbps>\t\tadapt the bitrate to the link,"
+		" starting here\n"
+		"\t--min_bitrate=<kbps>\t\tlowest bitrate rate control"
+		" may use\n"
+		"\t--max_bitrate=<kbps>\t\thighest bitrate rate control"
+		" may use\n"
+		"\t--min_fps=<fps>\t\t\tlowest frame rate rate control"
+		" may drop to\n");
+	printf("\t--encode_queue=<depth>\t\tcaptured frames that may wait for"
+		" the encoder, 1 to %d\n"
+		"\t--transport_queue=<depth>\tencoded frames that may wait for"
+		" the transport, 1 to %d\n"
+		"\t--encode_drop=<policy>\n"
+		"\t--transport_drop=<policy>\twhich frame a full queue drops:"
+		" drop-oldest (default),\n"
+		"\t\t\t\t\tdrop-newest or keep-idr\n",
+		FRAME_QUEUE_MAX_DEPTH, FRAME_QUEUE_MAX_DEPTH);
 	printf("\t--x=<x_coordinate>\t\tx coordinate of region of surface"
 		" to be captured\n"
 		"\t--y=<x_coordinate>\t\ty coordinate of region of surface "
@@ -593,8 +635,12 @@ usage(int error_code)
 		"\t--w=<width>\t\t\twidth of region of surface to be captured\n"
 		"\t--h=<height>\t\t\theight of region of surface "
 		"to be captured\n");
+	printf("\t--relay_input_ipaddr=<addr>[:<port>][,...]\n"
+		"\t\t\t\t\tinput senders to receive events from\n"
+		"\t--relay_input_port=<port>\tdefault input sender port\n");
 	printf("\t--help\t\t\t\tshow this help text and exit\n\n");
-	printf("Note that all options other than state default to zero.\n"
+	printf("Note that all options other than state and the queue options"
+		" default to zero.\n"
 		"A width or height of zero is taken to mean that the entire "
 		"width or height of the surface should be captured.\n"
 		"A surface ID of zero means that the whole framebuffer for the "
@@ -655,6 +701,39 @@ init(struct app_state *app_state, int *argc, char **argv)
 		rd_encoder_enable_profiling(app_state->rd_encoder, app_state->profile);
 	}
 
+	if (rd_encoder_configure_queue(app_state->rd_encoder,
+				RD_ENCODER_STAGE_ENCODE,
+				app_state->encode_queue,
+				app_state->encode_policy) != 0 ||
+	    rd_encoder_configure_queue(app_state->rd_encoder,
+				RD_ENCODER_STAGE_TRANSPORT,
+				app_state->transport_queue,
+				app_state->transport_policy) != 0) {
+		fprintf(stderr, "Bad frame queue configuration\n");
+		return -1;
+	}
+
+	if (rd_encoder_select_backend(app_state->rd_encoder,
+				app_state->encoder_backend) != 0 ||
+	    rd_encoder_configure_tiles(app_state->rd_encoder,
+				app_state->tile_size,
+				app_state->key_interval) != 0 ||
+	    rd_encoder_configure_streaming(app_state->rd_encoder,
+				app_state->slices,
+				app_state->latency_probe) != 0) {
+		return -1;
+	}
+
+	if ((app_state->bitrate || app_state->min_bitrate ||
+	     app_state->max_bitrate || app_state->min_fps) &&
+	    rd_encoder_configure_rate(app_state->rd_encoder,
+				app_state->bitrate,
+				app_state->min_bitrate,
+				app_state->max_bitrate,
+				app_state->min_fps) != 0) {
+		return -1;
+	}
+
 	app_state->encoder_state = ENC_STATE_NONE;
 
 	if (init_encoder(app_state) != 0) {
@@ -748,6 +827,19 @@ main(int argc, char **argv)
 		{ WESTON_OPTION_INTEGER, "h", 0, &app_state.h},
 		{ WESTON_OPTION_INTEGER, "tu", 0, &app_state.encoder_tu},
 		{ WESTON_OPTION_INTEGER, "fps", 0, &app_state.fps},
+		{ WESTON_OPTION_STRING,  "encoder", 0, &app_state.encoder_backend},
+		{ WESTON_OPTION_INTEGER, "tile_size", 0, &app_state.tile_size},
+		{ WESTON_OPTION_INTEGER, "key_interval", 0, &app_state.key_interval},
+		{ WESTON_OPTION_INTEGER, "slices", 0, &app_state.slices},
+		{ WESTON_OPTION_BOOLEAN, "latency_probe", 0, &app_state.latency_probe},
+		{ WESTON_OPTION_INTEGER, "bitrate", 0, &app_state.bitrate},
+		{ WESTON_OPTION_INTEGER, "min_bitrate", 0, &app_state.min_bitrate},
+		{ WESTON_OPTION_INTEGER, "max_bitrate", 0, &app_state.max_bitrate},
+		{ WESTON_OPTION_INTEGER, "min_fps", 0, &app_state.min_fps},
+		{ WESTON_OPTION_INTEGER, "encode_queue", 0, &app_state.encode_queue},
+		{ WESTON_OPTION_STRING,  "encode_drop", 0, &app_state.encode_drop},
+		{ WESTON_OPTION_INTEGER, "transport_queue", 0, &app_state.transport_queue},
+		{ WESTON_OPTION_STRING,  "transport_drop", 0, &app_state.transport_drop},
 		{ WESTON_OPTION_BOOLEAN, "help", 0, &help },
 	};
 
@@ -777,11 +869,53 @@ main(int argc, char **argv)
 		plugin_fullname_helper();
 	}
 
+	/* The udp and avb plugins packetize whatever they're given as
+	 * H.264, which the tiles stream isn't. */
+	if (app_state.encoder_backend && app_state.transport_plugin &&
+	    !strcmp(app_state.encoder_backend, "tiles") &&
+	    (!strcmp(app_state.transport_plugin, "udp") ||
+	     !strcmp(app_state.transport_plugin, "avb"))) {
+		fprintf(stderr, "The tiles encoder can't be used with the %s"
+				" plugin, which only carries H.264.\n",
+				app_state.transport_plugin);
+		usage(-EINVAL);
+	}
+
 	if (app_state.encoder_tu == 0) {
 		/* Default to fastest encode mode. */
 		app_state.encoder_tu = 7;
 	}
 
+	/* Default to a single frame between threads, replaced by newer ones. */
+	if (app_state.tile_size == 0) {
+		app_state.tile_size = TILE_SIZE_DEFAULT;
+	}
+	if (app_state.slices == 0) {
+		app_state.slices = 1;
+	}
+	if (app_state.encode_queue == 0) {
+		app_state.encode_queue = 1;
+	}
+	if (app_state.transport_queue == 0) {
+		app_state.transport_queue = 1;
+	}
+	app_state.encode_policy = FRAME_QUEUE_DROP_OLDEST;
+	app_state.transport_policy = FRAME_QUEUE_DROP_OLDEST;
+	if (app_state.encode_drop &&
+	    frame_queue_policy_from_string(app_state.encode_drop,
+				&app_state.encode_policy) != 0) {
+		fprintf(stderr, "Unknown drop policy '%s'.\n",
+			app_state.encode_drop);
+		usage(-EINVAL);
+	}
+	if (app_state.transport_drop &&
+	    frame_queue_policy_from_string(app_state.transport_drop,
+				&app_state.transport_policy) != 0) {
+		fprintf(stderr, "Unknown drop policy '%s'.\n",
+			app_state.transport_drop);
+		usage(-EINVAL);
+	}
+
 	err = init(&app_state, &argc, argv);
 	if ((err == 0) && state) {
 		/* Catch SIGINT / Ctrl+C to stop recording. */
@@ -52,6 +52,31 @@ struct app_state {
 	int h;
 	int encoder_tu;
 	int fps;
+
+	/* Frame queues in front of the encoder and transport threads */
+	int encode_queue;
+	char *encode_drop;
+	enum frame_queue_policy encode_policy;
+	int transport_queue;
+	char *transport_drop;
+	enum frame_queue_policy transport_policy;
+
+	/* Encoder backend, or NULL to pick one */
+	char *encoder_backend;
+	int tile_size;
+	int key_interval;
+
+	/* H.264 slices per frame, and whether to send latency probes */
+	int slices;
+	int latency_probe;
+
+	/* Rate control: bitrate range in kbit/s and the lowest frame rate;
+	 * all 0 leaves the bitrate fixed */
+	int bitrate;
+	int min_bitrate;
+	int max_bitrate;
+	int min_fps;
+
 	int output_number;
 	int output_origin_x;
 	int output_origin_y;
@@ -0,0 +1,240 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "rate_control.h"
+
+#define US_PER_SEC		1000000
+
+#define DEFAULT_START_KBPS	8000
+#define DEFAULT_MIN_KBPS	500
+#define DEFAULT_MAX_KBPS	20000
+#define DEFAULT_MIN_FPS		10
+
+/* Loss, out of 256, above which the bitrate is cut in proportion, and
+ * below which it may grow. In between it's left alone. */
+#define LOSS_HIGH		26
+#define LOSS_LOW		5
+
+/* More than this much of a second's data waiting to be sent, or this much
+ * jitter, means the link is only just keeping up */
+#define QUEUE_LIMIT_MS		100
+#define JITTER_LIMIT_US		30000
+
+/* Cut to 85% when the link is backing up, at most once a second, and wait
+ * a second before trying to go any higher */
+#define BACKOFF_PERCENT		85
+#define HOLD_US			US_PER_SEC
+
+/* Grow by 8% for each second the link is clear */
+#define INCREASE_PERCENT	8
+
+int
+rate_control_config_init(struct rate_control_config *config,
+		int start_kbps, int min_kbps, int max_kbps,
+		int min_fps, int max_fps)
+{
+	if (start_kbps < 0 || min_kbps < 0 || max_kbps < 0 ||
+	    min_fps < 0 || max_fps < 1) {
+		return -1;
+	}
+
+	if (min_kbps == 0) {
+		min_kbps = DEFAULT_MIN_KBPS;
+	}
+	if (max_kbps == 0) {
+		max_kbps = start_kbps > DEFAULT_MAX_KBPS ?
+				start_kbps : DEFAULT_MAX_KBPS;
+	}
+	if (start_kbps == 0) {
+		start_kbps = DEFAULT_START_KBPS;
+		if (start_kbps > max_kbps) {
+			start_kbps = max_kbps;
+		}
+		if (start_kbps < min_kbps) {
+			start_kbps = min_kbps;
+		}
+	}
+	if (min_fps == 0) {
+		min_fps = DEFAULT_MIN_FPS < max_fps ? DEFAULT_MIN_FPS : max_fps;
+	}
+
+	if (min_kbps > start_kbps || start_kbps > max_kbps ||
+	    min_fps > max_fps) {
+		return -1;
+	}
+
+	config->min_bps = min_kbps * 1000u;
+	config->max_bps = max_kbps * 1000u;
+	config->start_bps = start_kbps * 1000u;
+	config->min_fps = min_fps;
+	config->max_fps = max_fps;
+
+	return 0;
+}
+
+void
+rate_control_init(struct rate_controller *rc,
+		const struct rate_control_config *config)
+{
+	memset(rc, 0, sizeof(*rc));
+	rc->config = *config;
+	rc->target_bps = config->start_bps;
+	rc->target_fps = config->max_fps;
+}
+
+/* Worst loss the report shows, out of 256: what the receiver saw, or the
+ * share of the sends since the last report that failed */
+static uint32_t
+report_loss(struct rate_controller *rc, const struct rate_feedback *feedback)
+{
+	uint32_t loss = 0;
+	uint32_t sent, errors;
+
+	if (feedback->flags & RATE_FEEDBACK_RECEIVER) {
+		loss = feedback->fraction_lost;
+	}
+
+	if (feedback->flags & RATE_FEEDBACK_ERRORS) {
+		sent = feedback->packets_sent - rc->last_packets_sent;
+		errors = feedback->send_errors - rc->last_send_errors;
+		rc->last_packets_sent = feedback->packets_sent;
+		rc->last_send_errors = feedback->send_errors;
+
+		if (errors && sent <= errors) {
+			loss = 256;
+		} else if (errors && errors * 256 / sent > loss) {
+			loss = errors * 256 / sent;
+		}
+	}
+
+	return loss;
+}
+
+static int
+backing_up(const struct rate_controller *rc,
+		const struct rate_feedback *feedback)
+{
+	uint64_t queue_limit;
+
+	if (feedback->flags & RATE_FEEDBACK_QUEUE) {
+		queue_limit = (uint64_t) rc->target_bps / 8 *
+				QUEUE_LIMIT_MS / 1000;
+		if (feedback->queue_bytes > queue_limit) {
+			return 1;
+		}
+	}
+
+	return (feedback->flags & RATE_FEEDBACK_RECEIVER) &&
+			feedback->jitter_us > JITTER_LIMIT_US;
+}
+
+/* Whether congestion may cut the rates now. A cut takes a while to show
+ * in the send queue and in receiver reports, so until the hold runs out
+ * only a fresh report of worse loss than the last cut's can cut again. */
+static int
+may_cut(const struct rate_controller *rc,
+		const struct rate_feedback *feedback, uint64_t now_us)
+{
+	if (now_us >= rc->cut_hold_until_us) {
+		return 1;
+	}
+
+	return (feedback->flags & RATE_FEEDBACK_RECEIVER) &&
+			feedback->fraction_lost > LOSS_HIGH &&
+			feedback->fraction_lost > rc->cut_loss;
+}
+
+int
+rate_control_update(struct rate_controller *rc,
+		const struct rate_feedback *feedback, uint64_t now_us)
+{
+	const struct rate_control_config *config = &rc->config;
+	uint32_t old_bps = rc->target_bps;
+	int old_fps = rc->target_fps;
+	uint64_t elapsed, bps;
+	uint32_t loss;
+	int congested;
+
+	elapsed = rc->last_update_us ? now_us - rc->last_update_us : 0;
+	if (elapsed > US_PER_SEC) {
+		elapsed = US_PER_SEC;
+	}
+	rc->last_update_us = now_us;
+
+	loss = report_loss(rc, feedback);
+	congested = loss > LOSS_HIGH || backing_up(rc, feedback);
+	bps = rc->target_bps;
+
+	if (congested) {
+		if (may_cut(rc, feedback, now_us)) {
+			/* Once the bitrate can't go any lower, send fewer
+			 * frames */
+			if (bps <= config->min_bps) {
+				rc->target_fps = rc->target_fps * 3 / 4;
+			}
+
+			if (loss > LOSS_HIGH) {
+				bps = bps * (512 - loss) / 512;
+			} else {
+				bps = bps * BACKOFF_PERCENT / 100;
+			}
+			rc->cut_hold_until_us = now_us + HOLD_US;
+			rc->cut_loss = feedback->flags & RATE_FEEDBACK_RECEIVER ?
+					feedback->fraction_lost : 0;
+		}
+		rc->hold_until_us = now_us + HOLD_US;
+	} else if (loss < LOSS_LOW && now_us >= rc->hold_until_us) {
+		/* Get the frame rate back before raising the bitrate */
+		if (rc->target_fps < config->max_fps) {
+			rc->target_fps += config->max_fps / 10 > 1 ?
+					config->max_fps / 10 : 1;
+			rc->hold_until_us = now_us + HOLD_US / 4;
+		} else {
+			bps += bps * INCREASE_PERCENT * elapsed /
+					(100 * (uint64_t) US_PER_SEC);
+		}
+	}
+
+	if (bps < config->min_bps) {
+		bps = config->min_bps;
+	}
+	if (bps > config->max_bps) {
+		bps = config->max_bps;
+	}
+	rc->target_bps = bps;
+
+	if (rc->target_fps < config->min_fps) {
+		rc->target_fps = config->min_fps;
+	}
+	if (rc->target_fps > config->max_fps) {
+		rc->target_fps = config->max_fps;
+	}
+
+	return rc->target_bps != old_bps || rc->target_fps != old_fps;
+}
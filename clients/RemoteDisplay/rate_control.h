@@ -0,0 +1,118 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Rate controller for the Remote Display encoder. The transport reports
+ * how the link is coping - data backing up in the send queue, failed sends
+ * and, when the receiver sends them, RTCP receiver reports of loss and
+ * jitter - and the controller picks the bitrate and frame rate to encode
+ * at: backing off quickly when the link is congested and probing upwards
+ * slowly while it isn't. Once the bitrate is at its floor, frames are
+ * skipped instead.
+ */
+
+#ifndef __REMOTE_DISPLAY_RATE_CONTROL_H__
+#define __REMOTE_DISPLAY_RATE_CONTROL_H__
+
+#include <stdint.h>
+
+/* Which fields of a struct rate_feedback the transport filled in */
+#define RATE_FEEDBACK_QUEUE	(1 << 0)
+#define RATE_FEEDBACK_ERRORS	(1 << 1)
+#define RATE_FEEDBACK_RECEIVER	(1 << 2)
+
+/* What a transport knows about the link after sending a frame */
+struct rate_feedback {
+	uint32_t flags;
+
+	/* RATE_FEEDBACK_QUEUE: bytes sent but not yet on the wire */
+	uint32_t queue_bytes;
+
+	/* RATE_FEEDBACK_ERRORS: running totals of packets the transport
+	 * tried to send, and of those that failed */
+	uint32_t packets_sent;
+	uint32_t send_errors;
+
+	/* RATE_FEEDBACK_RECEIVER: from the latest receiver report, the
+	 * fraction of packets lost since the one before, out of 256, and
+	 * the interarrival jitter */
+	uint8_t fraction_lost;
+	uint32_t jitter_us;
+};
+
+struct rate_control_config {
+	/* Bitrate range in bits per second, and where to start */
+	uint32_t min_bps;
+	uint32_t max_bps;
+	uint32_t start_bps;
+
+	/* Frame rate range */
+	int min_fps;
+	int max_fps;
+};
+
+struct rate_controller {
+	struct rate_control_config config;
+
+	/* Current targets */
+	uint32_t target_bps;
+	int target_fps;
+
+	/* No increases before this time, after backing off */
+	uint64_t hold_until_us;
+	uint64_t last_update_us;
+
+	/* No further cut before this time, unless a receiver report shows
+	 * more loss than the one behind the last cut */
+	uint64_t cut_hold_until_us;
+	uint32_t cut_loss;
+
+	/* Totals from the previous error report */
+	uint32_t last_packets_sent;
+	uint32_t last_send_errors;
+};
+
+/*
+ * Fill in a config from bitrates in kbit/s. 0 picks a default for any of
+ * them. Returns 0, or -1 if the values don't make sense.
+ */
+int
+rate_control_config_init(struct rate_control_config *config,
+		int start_kbps, int min_kbps, int max_kbps,
+		int min_fps, int max_fps);
+
+void
+rate_control_init(struct rate_controller *rc,
+		const struct rate_control_config *config);
+
+/*
+ * Take a report from the transport, made at now_us on any monotonic clock.
+ * Returns 1 if the target bitrate or frame rate changed.
+ */
+int
+rate_control_update(struct rate_controller *rc,
+		const struct rate_feedback *feedback, uint64_t now_us);
+
+#endif /* __REMOTE_DISPLAY_RATE_CONTROL_H__ */
@@ -0,0 +1,223 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "rtcp_report.h"
+
+#define RTP_SEQ_MOD		(1 << 16)
+
+/* A jump in sequence numbers this big is taken as the sender restarting */
+#define MAX_DROPOUT		3000
+
+#define RTCP_VERSION		2
+#define RTCP_HEADER_SIZE	4
+#define SR_SENDER_INFO_SIZE	20
+#define REPORT_BLOCK_SIZE	24
+
+static void
+put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t
+get_be32(const uint8_t *p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+			(uint32_t) p[2] << 8 | p[3];
+}
+
+void
+rtcp_receiver_init(struct rtcp_receiver_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+static void
+restart_sequence(struct rtcp_receiver_stats *stats, uint16_t seq)
+{
+	stats->base_seq = seq;
+	stats->max_seq = seq;
+	stats->cycles = 0;
+	stats->received = 0;
+	stats->expected_prior = 0;
+	stats->received_prior = 0;
+}
+
+void
+rtcp_receiver_packet(struct rtcp_receiver_stats *stats, uint16_t seq,
+		uint32_t rtp_ts, uint32_t arrival)
+{
+	uint16_t delta;
+	int32_t transit, d;
+
+	if (!stats->started) {
+		restart_sequence(stats, seq);
+		stats->started = 1;
+		stats->transit = arrival - rtp_ts;
+	}
+
+	delta = seq - stats->max_seq;
+	if (delta < MAX_DROPOUT) {
+		/* In order, perhaps with a gap */
+		if (seq < stats->max_seq) {
+			stats->cycles += RTP_SEQ_MOD;
+		}
+		stats->max_seq = seq;
+	} else if (delta > RTP_SEQ_MOD - MAX_DROPOUT) {
+		/* Duplicate or reordered; counted but changes nothing */
+	} else {
+		restart_sequence(stats, seq);
+	}
+	stats->received++;
+
+	/* Jitter estimate, RFC 3550 A.8 */
+	transit = arrival - rtp_ts;
+	d = transit - stats->transit;
+	stats->transit = transit;
+	if (d < 0) {
+		d = -d;
+	}
+	stats->jitter += d - ((stats->jitter + 8) >> 4);
+}
+
+void
+rtcp_receiver_report(struct rtcp_receiver_stats *stats, uint32_t ssrc,
+		struct rtcp_report_block *block)
+{
+	uint32_t extended_max, expected, expected_interval, received_interval;
+	int32_t lost, lost_interval;
+
+	extended_max = stats->cycles + stats->max_seq;
+	expected = stats->started ? extended_max - stats->base_seq + 1 : 0;
+	lost = expected - stats->received;
+
+	/* 24 bits signed */
+	if (lost > 0x7fffff) {
+		lost = 0x7fffff;
+	} else if (lost < -0x800000) {
+		lost = -0x800000;
+	}
+
+	expected_interval = expected - stats->expected_prior;
+	stats->expected_prior = expected;
+	received_interval = stats->received - stats->received_prior;
+	stats->received_prior = stats->received;
+	lost_interval = expected_interval - received_interval;
+
+	block->ssrc = ssrc;
+	if (expected_interval == 0 || lost_interval <= 0) {
+		block->fraction_lost = 0;
+	} else {
+		block->fraction_lost = (lost_interval << 8) / expected_interval;
+	}
+	block->cumulative_lost = lost;
+	block->highest_seq = extended_max;
+	block->jitter = stats->jitter >> 4;
+}
+
+size_t
+rtcp_build_rr(uint8_t *out, uint32_t sender_ssrc,
+		const struct rtcp_report_block *block)
+{
+	/* Version, one report block, type, and length in words less one */
+	out[0] = RTCP_VERSION << 6 | 1;
+	out[1] = RTCP_PT_RR;
+	out[2] = 0;
+	out[3] = RTCP_RR_SIZE / 4 - 1;
+	put_be32(out + 4, sender_ssrc);
+
+	put_be32(out + 8, block->ssrc);
+	put_be32(out + 12, (uint32_t) block->fraction_lost << 24 |
+			(block->cumulative_lost & 0xffffff));
+	put_be32(out + 16, block->highest_seq);
+	put_be32(out + 20, block->jitter);
+
+	/* No sender report to refer to */
+	put_be32(out + 24, 0);
+	put_be32(out + 28, 0);
+
+	return RTCP_RR_SIZE;
+}
+
+int
+rtcp_parse_report(const uint8_t *data, size_t size, uint32_t ssrc,
+		struct rtcp_report_block *block)
+{
+	const uint8_t *p, *blocks;
+	size_t length, offset;
+	int count, i;
+	uint32_t lost;
+
+	while (size >= RTCP_HEADER_SIZE) {
+		if (data[0] >> 6 != RTCP_VERSION) {
+			return 0;
+		}
+
+		count = data[0] & 0x1f;
+		length = ((size_t) data[2] << 8 | data[3]) * 4 + 4;
+		if (length > size) {
+			return 0;
+		}
+
+		offset = 0;
+		if (data[1] == RTCP_PT_SR) {
+			offset = RTCP_HEADER_SIZE + 4 + SR_SENDER_INFO_SIZE;
+		} else if (data[1] == RTCP_PT_RR) {
+			offset = RTCP_HEADER_SIZE + 4;
+		}
+
+		blocks = data + offset;
+		for (i = 0; offset && i < count; i++) {
+			p = blocks + i * REPORT_BLOCK_SIZE;
+			if (p + REPORT_BLOCK_SIZE > data + length) {
+				break;
+			}
+			if (get_be32(p) != ssrc) {
+				continue;
+			}
+
+			block->ssrc = ssrc;
+			block->fraction_lost = p[4];
+			lost = get_be32(p + 4) & 0xffffff;
+			/* Sign extend from 24 bits */
+			block->cumulative_lost = (int32_t) (lost << 8) >> 8;
+			block->highest_seq = get_be32(p + 8);
+			block->jitter = get_be32(p + 12);
+			return 1;
+		}
+
+		data += length;
+		size -= length;
+	}
+
+	return 0;
+}
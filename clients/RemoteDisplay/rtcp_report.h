@@ -0,0 +1,114 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * RTCP receiver reports (RFC 3550), as far as the Remote Display rate
+ * controller needs them: a receiver keeps loss and jitter statistics for
+ * the RTP stream and sends them back in a receiver report, and the sender
+ * picks the report block out of whatever RTCP it gets.
+ */
+
+#ifndef __REMOTE_DISPLAY_RTCP_REPORT_H__
+#define __REMOTE_DISPLAY_RTCP_REPORT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size of a receiver report with one report block */
+#define RTCP_RR_SIZE		32
+
+#define RTCP_PT_SR		200
+#define RTCP_PT_RR		201
+
+/* RTP timestamps for video count at 90kHz */
+#define RTCP_CLOCK_RATE		90000
+
+struct rtcp_report_block {
+	/* Source the block reports on */
+	uint32_t ssrc;
+
+	/* Packets lost since the previous report, out of 256 */
+	uint8_t fraction_lost;
+
+	/* Packets lost since the start, 24 bits signed */
+	int32_t cumulative_lost;
+
+	/* Cycle count in the top 16 bits, highest sequence number seen in
+	 * the bottom 16 */
+	uint32_t highest_seq;
+
+	/* Interarrival jitter in RTP timestamp units */
+	uint32_t jitter;
+};
+
+/* Receiver side statistics, per RFC 3550 appendix A.1, A.3 and A.8 */
+struct rtcp_receiver_stats {
+	int started;
+	uint16_t max_seq;
+	uint32_t cycles;
+	uint32_t base_seq;
+	uint32_t received;
+	uint32_t expected_prior;
+	uint32_t received_prior;
+
+	/* Relative transit time of the last packet, and jitter scaled by 16 */
+	int32_t transit;
+	uint32_t jitter;
+};
+
+void
+rtcp_receiver_init(struct rtcp_receiver_stats *stats);
+
+/*
+ * Count a packet with RTP sequence number 'seq' and timestamp 'rtp_ts' that
+ * arrived at 'arrival', measured in RTP timestamp units on any clock.
+ */
+void
+rtcp_receiver_packet(struct rtcp_receiver_stats *stats, uint16_t seq,
+		uint32_t rtp_ts, uint32_t arrival);
+
+/* Fill in a report block for 'ssrc', and start a new reporting interval */
+void
+rtcp_receiver_report(struct rtcp_receiver_stats *stats, uint32_t ssrc,
+		struct rtcp_report_block *block);
+
+/*
+ * Write a receiver report from 'sender_ssrc' with one block to 'out', which
+ * must hold RTCP_RR_SIZE bytes. Returns the size written.
+ */
+size_t
+rtcp_build_rr(uint8_t *out, uint32_t sender_ssrc,
+		const struct rtcp_report_block *block);
+
+/*
+ * Find the report block about 'ssrc' in a compound RTCP packet, in either a
+ * sender or receiver report. Returns 1 and fills in 'block' if there is
+ * one, otherwise 0.
+ */
+int
+rtcp_parse_report(const uint8_t *data, size_t size, uint32_t ssrc,
+		struct rtcp_report_block *block);
+
+#endif /* __REMOTE_DISPLAY_RTCP_REPORT_H__ */
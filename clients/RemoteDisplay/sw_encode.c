@@ -0,0 +1,544 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "sw_encode.h"
+
+#define NAL_REF_IDC_HIGH	3
+
+#define NAL_IDR			5
+#define NAL_SPS			7
+#define NAL_PPS			8
+
+#define PROFILE_IDC_BASELINE	66
+
+/* Slice type 7: I, and every other slice in the picture is I too */
+#define SLICE_TYPE_I_ALL	7
+
+/* I_PCM as mb_type in an I slice */
+#define MB_TYPE_I_PCM		25
+
+/* Bytes in one I_PCM macroblock: 16x16 luma and two 8x8 chroma */
+#define PCM_MB_BYTES		(256 + 64 + 64)
+
+
+/*
+ * Limited range BT.601, in 8-bit fixed point:
+ *	Y =  (66 R + 129 G +  25 B + 128) >> 8) + 16
+ *	U = (-38 R -  74 G + 112 B + 128) >> 8) + 128
+ *	V = (112 R -  94 G -  18 B + 128) >> 8) + 128
+ * Memory order of a pixel is B, G, R, X.
+ */
+static inline uint8_t
+rgb_to_y(const uint8_t *p)
+{
+	return ((66 * p[2] + 129 * p[1] + 25 * p[0] + 128) >> 8) + 16;
+}
+
+static inline uint8_t
+rgb_to_u(const uint8_t *p)
+{
+	return ((-38 * p[2] - 74 * p[1] + 112 * p[0] + 128) >> 8) + 128;
+}
+
+static inline uint8_t
+rgb_to_v(const uint8_t *p)
+{
+	return ((112 * p[2] - 94 * p[1] - 18 * p[0] + 128) >> 8) + 128;
+}
+
+/* Rounding average, as _mm_avg_epu8() does it */
+static inline uint8_t
+avg(uint8_t a, uint8_t b)
+{
+	return (a + b + 1) >> 1;
+}
+
+/*
+ * Convert pixels x0 onwards of one pair of source rows. 'row1' is the same
+ * as 'row0' when the image has an odd number of rows, in which case 'y1'
+ * is NULL.
+ */
+static void
+convert_pair_c(const uint8_t *row0, const uint8_t *row1,
+		uint8_t *y0, uint8_t *y1, uint8_t *uv, int x0, int width)
+{
+	int x, x1, c;
+	uint8_t a[4], b[4], m[4];
+
+	for (x = x0; x < width; x += 2) {
+		x1 = x + 1 < width ? x + 1 : x;
+
+		y0[x] = rgb_to_y(row0 + x * 4);
+		if (x1 != x) {
+			y0[x1] = rgb_to_y(row0 + x1 * 4);
+		}
+		if (y1) {
+			y1[x] = rgb_to_y(row1 + x * 4);
+			if (x1 != x) {
+				y1[x1] = rgb_to_y(row1 + x1 * 4);
+			}
+		}
+
+		/* Average down the columns, then across, as the SSE2 code
+		 * does, so that both give the same result */
+		for (c = 0; c < 4; c++) {
+			a[c] = avg(row0[x * 4 + c], row1[x * 4 + c]);
+			b[c] = avg(row0[x1 * 4 + c], row1[x1 * 4 + c]);
+			m[c] = avg(a[c], b[c]);
+		}
+		uv[x] = rgb_to_u(m);
+		uv[x + 1] = rgb_to_v(m);
+	}
+}
+
+#ifdef __SSE2__
+/* Apply 'coef' (B, G, R, X order) to four pixels; returns four int32. */
+static inline __m128i
+weigh4(__m128i px, __m128i coef, __m128i offset)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo, hi;
+
+	/* madd leaves B*cb + G*cg and R*cr in adjacent lanes per pixel;
+	 * add each odd lane into the even one below it */
+	lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coef);
+	hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coef);
+	lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+	hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+	lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+	hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(
+				_mm_unpacklo_epi64(lo, hi),
+				_mm_set1_epi32(128)), 8), offset);
+}
+
+/* Luma for 16 pixels */
+static inline void
+luma16(const uint8_t *src, uint8_t *dst)
+{
+	const __m128i coef = _mm_set_epi16(0, 66, 129, 25, 0, 66, 129, 25);
+	const __m128i offset = _mm_set1_epi32(16);
+	__m128i y[4];
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		y[i] = weigh4(_mm_loadu_si128((const __m128i *) src + i),
+				coef, offset);
+	}
+
+	_mm_storeu_si128((__m128i *) dst,
+			_mm_packus_epi16(_mm_packs_epi32(y[0], y[1]),
+					 _mm_packs_epi32(y[2], y[3])));
+}
+
+/* Average each pair of adjacent pixels in two lots of four, giving four */
+static inline __m128i
+halve8(__m128i a, __m128i b)
+{
+	a = _mm_avg_epu8(a, _mm_srli_epi64(a, 32));
+	b = _mm_avg_epu8(b, _mm_srli_epi64(b, 32));
+	a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+
+	return _mm_unpacklo_epi64(a, b);
+}
+
+/* Interleaved chroma for 16x2 pixels */
+static inline void
+chroma16(const uint8_t *row0, const uint8_t *row1, uint8_t *dst)
+{
+	const __m128i ucoef = _mm_set_epi16(0, -38, -74, 112, 0, -38, -74, 112);
+	const __m128i vcoef = _mm_set_epi16(0, 112, -94, -18, 0, 112, -94, -18);
+	const __m128i offset = _mm_set1_epi32(128);
+	__m128i m[4], c0, c1, u, v;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		m[i] = _mm_avg_epu8(
+			_mm_loadu_si128((const __m128i *) row0 + i),
+			_mm_loadu_si128((const __m128i *) row1 + i));
+	}
+	c0 = halve8(m[0], m[1]);
+	c1 = halve8(m[2], m[3]);
+
+	u = _mm_packs_epi32(weigh4(c0, ucoef, offset),
+			    weigh4(c1, ucoef, offset));
+	v = _mm_packs_epi32(weigh4(c0, vcoef, offset),
+			    weigh4(c1, vcoef, offset));
+
+	_mm_storeu_si128((__m128i *) dst,
+			_mm_packus_epi16(_mm_unpacklo_epi16(u, v),
+					 _mm_unpackhi_epi16(u, v)));
+}
+#endif
+
+static void
+convert(const uint8_t *src, int src_stride, int width, int height,
+		const struct sw_nv12 *dst, int simd)
+{
+	const uint8_t *row0, *row1;
+	uint8_t *y0, *y1, *uv;
+	int y, x;
+
+	for (y = 0; y < height; y += 2) {
+		row0 = src + y * src_stride;
+		row1 = y + 1 < height ? row0 + src_stride : row0;
+		y0 = dst->y + y * dst->y_stride;
+		y1 = y + 1 < height ? y0 + dst->y_stride : NULL;
+		uv = dst->uv + (y / 2) * dst->uv_stride;
+		x = 0;
+
+#ifdef __SSE2__
+		if (simd) {
+			for (; x + 16 <= width; x += 16) {
+				luma16(row0 + x * 4, y0 + x);
+				if (y1) {
+					luma16(row1 + x * 4, y1 + x);
+				}
+				chroma16(row0 + x * 4, row1 + x * 4, uv + x);
+			}
+		}
+#endif
+
+		convert_pair_c(row0, row1, y0, y1, uv, x, width);
+	}
+}
+
+void
+sw_encode_bgrx_to_nv12(const uint8_t *src, int src_stride,
+		int width, int height, const struct sw_nv12 *dst)
+{
+	convert(src, src_stride, width, height, dst, 1);
+}
+
+void
+sw_encode_bgrx_to_nv12_c(const uint8_t *src, int src_stride,
+		int width, int height, const struct sw_nv12 *dst)
+{
+	convert(src, src_stride, width, height, dst, 0);
+}
+
+void
+sw_encode_nv12_copy(const struct sw_nv12 *src, const struct sw_nv12 *dst,
+		int width, int height)
+{
+	int y;
+
+	for (y = 0; y < height; y++) {
+		memcpy(dst->y + y * dst->y_stride, src->y + y * src->y_stride,
+			width);
+	}
+	for (y = 0; y < (height + 1) / 2; y++) {
+		memcpy(dst->uv + y * dst->uv_stride,
+			src->uv + y * src->uv_stride, (width + 1) & ~1);
+	}
+}
+
+void
+sw_encode_nv12_pad(const struct sw_nv12 *img, int width, int height)
+{
+	int cw = (width + 1) / 2, ch = (height + 1) / 2;
+	uint8_t *row;
+	int x, y;
+
+	for (y = 0; y < height; y++) {
+		row = img->y + y * img->y_stride;
+		memset(row + width, row[width - 1], img->width - width);
+	}
+	for (; y < img->height; y++) {
+		memcpy(img->y + y * img->y_stride,
+			img->y + (height - 1) * img->y_stride, img->width);
+	}
+
+	for (y = 0; y < ch; y++) {
+		row = img->uv + y * img->uv_stride;
+		for (x = cw; x < img->width / 2; x++) {
+			row[x * 2] = row[(cw - 1) * 2];
+			row[x * 2 + 1] = row[(cw - 1) * 2 + 1];
+		}
+	}
+	for (; y < img->height / 2; y++) {
+		memcpy(img->uv + y * img->uv_stride,
+			img->uv + (ch - 1) * img->uv_stride, img->width);
+	}
+}
+
+
+/*
+ * NAL unit writer. Bits collect in 'bits' and leave a byte at a time
+ * through put_byte(), which inserts emulation prevention bytes as it goes,
+ * so the payload never needs a second pass.
+ */
+struct nal_writer {
+	uint8_t *out;
+	size_t pos;
+	uint64_t bits;
+	int nbits;
+	int zeros;
+};
+
+static inline void
+put_byte(struct nal_writer *w, uint8_t byte)
+{
+	if (w->zeros >= 2 && byte <= 3) {
+		w->out[w->pos++] = 3;
+		w->zeros = 0;
+	}
+	w->out[w->pos++] = byte;
+	w->zeros = byte ? 0 : w->zeros + 1;
+}
+
+/* Write the low 'n' bits of 'val', n <= 32 */
+static inline void
+put_bits(struct nal_writer *w, uint32_t val, int n)
+{
+	w->bits = (w->bits << n) | (val & (uint32_t) ((1ULL << n) - 1));
+	w->nbits += n;
+	while (w->nbits >= 8) {
+		w->nbits -= 8;
+		put_byte(w, w->bits >> w->nbits);
+	}
+	w->bits &= (1U << w->nbits) - 1;
+}
+
+static void
+put_ue(struct nal_writer *w, uint32_t val)
+{
+	uint32_t code = val + 1;
+	int len = 32 - __builtin_clz(code);
+
+	/* len - 1 zeros, then the len bits of val + 1 */
+	if (len * 2 - 1 <= 32) {
+		put_bits(w, code, len * 2 - 1);
+	} else {
+		put_bits(w, 0, len - 1);
+		put_bits(w, code, len);
+	}
+}
+
+static void
+put_se(struct nal_writer *w, int32_t val)
+{
+	put_ue(w, val > 0 ? 2 * (uint32_t) val - 1 : -2 * (uint32_t) val);
+}
+
+static void
+align_zero(struct nal_writer *w)
+{
+	if (w->nbits) {
+		put_bits(w, 0, 8 - w->nbits);
+	}
+}
+
+static void
+nal_begin(struct nal_writer *w, int nal_ref_idc, int nal_unit_type)
+{
+	/* Start code and header aren't subject to emulation prevention */
+	w->out[w->pos++] = 0;
+	w->out[w->pos++] = 0;
+	w->out[w->pos++] = 0;
+	w->out[w->pos++] = 1;
+	w->out[w->pos++] = (nal_ref_idc << 5) | nal_unit_type;
+	w->bits = 0;
+	w->nbits = 0;
+	w->zeros = 0;
+}
+
+static void
+nal_end(struct nal_writer *w)
+{
+	/* rbsp_trailing_bits() */
+	put_bits(w, 1, 1);
+	align_zero(w);
+}
+
+static void
+write_sps(const struct sw_h264 *h264, struct nal_writer *w)
+{
+	int mbs = h264->mb_width * h264->mb_height;
+	int crop_right = (h264->mb_width * 16 - h264->width) / 2;
+	int crop_bottom = (h264->mb_height * 16 - h264->height) / 2;
+	int level_idc;
+
+	/* Smallest level whose frame size limit fits */
+	if (mbs <= 1620) {
+		level_idc = 31;
+	} else if (mbs <= 8192) {
+		level_idc = 41;
+	} else {
+		level_idc = 51;
+	}
+
+	nal_begin(w, NAL_REF_IDC_HIGH, NAL_SPS);
+	put_bits(w, PROFILE_IDC_BASELINE, 8);
+	/* constraint_set0 and 1: constrained baseline */
+	put_bits(w, 0xc0, 8);
+	put_bits(w, level_idc, 8);
+	put_ue(w, 0);			/* seq_parameter_set_id */
+	put_ue(w, 0);			/* log2_max_frame_num_minus4 */
+	put_ue(w, 2);			/* pic_order_cnt_type */
+	put_ue(w, 0);			/* max_num_ref_frames */
+	put_bits(w, 0, 1);		/* gaps_in_frame_num_value_allowed_flag */
+	put_ue(w, h264->mb_width - 1);
+	put_ue(w, h264->mb_height - 1);
+	put_bits(w, 1, 1);		/* frame_mbs_only_flag */
+	put_bits(w, 1, 1);		/* direct_8x8_inference_flag */
+	if (crop_right || crop_bottom) {
+		put_bits(w, 1, 1);	/* frame_cropping_flag */
+		put_ue(w, 0);
+		put_ue(w, crop_right);
+		put_ue(w, 0);
+		put_ue(w, crop_bottom);
+	} else {
+		put_bits(w, 0, 1);
+	}
+	put_bits(w, 0, 1);		/* vui_parameters_present_flag */
+	nal_end(w);
+}
+
+static void
+write_pps(struct nal_writer *w)
+{
+	nal_begin(w, NAL_REF_IDC_HIGH, NAL_PPS);
+	put_ue(w, 0);			/* pic_parameter_set_id */
+	put_ue(w, 0);			/* seq_parameter_set_id */
+	put_bits(w, 0, 1);		/* entropy_coding_mode_flag: CAVLC */
+	put_bits(w, 0, 1);		/* bottom_field_pic_order_in_frame_present_flag */
+	put_ue(w, 0);			/* num_slice_groups_minus1 */
+	put_ue(w, 0);			/* num_ref_idx_l0_default_active_minus1 */
+	put_ue(w, 0);			/* num_ref_idx_l1_default_active_minus1 */
+	put_bits(w, 0, 1);		/* weighted_pred_flag */
+	put_bits(w, 0, 2);		/* weighted_bipred_idc */
+	put_se(w, 0);			/* pic_init_qp_minus26 */
+	put_se(w, 0);			/* pic_init_qs_minus26 */
+	put_se(w, 0);			/* chroma_qp_index_offset */
+	put_bits(w, 1, 1);		/* deblocking_filter_control_present_flag */
+	put_bits(w, 0, 1);		/* constrained_intra_pred_flag */
+	put_bits(w, 0, 1);		/* redundant_pic_cnt_present_flag */
+	nal_end(w);
+}
+
+static void
+write_pcm_mb(struct nal_writer *w, const struct sw_nv12 *img, int mbx, int mby)
+{
+	const uint8_t *row;
+	int x, y;
+
+	put_ue(w, MB_TYPE_I_PCM);
+	align_zero(w);
+
+	for (y = 0; y < 16; y++) {
+		row = img->y + (mby * 16 + y) * img->y_stride + mbx * 16;
+		for (x = 0; x < 16; x++) {
+			put_byte(w, row[x]);
+		}
+	}
+
+	/* All of Cb, then all of Cr */
+	for (y = 0; y < 8; y++) {
+		row = img->uv + (mby * 8 + y) * img->uv_stride + mbx * 16;
+		for (x = 0; x < 16; x += 2) {
+			put_byte(w, row[x]);
+		}
+	}
+	for (y = 0; y < 8; y++) {
+		row = img->uv + (mby * 8 + y) * img->uv_stride + mbx * 16;
+		for (x = 1; x < 16; x += 2) {
+			put_byte(w, row[x]);
+		}
+	}
+}
+
+static void
+write_idr_slice(struct sw_h264 *h264, const struct sw_nv12 *img,
+		struct nal_writer *w)
+{
+	int mbx, mby;
+
+	nal_begin(w, NAL_REF_IDC_HIGH, NAL_IDR);
+	put_ue(w, 0);			/* first_mb_in_slice */
+	put_ue(w, SLICE_TYPE_I_ALL);
+	put_ue(w, 0);			/* pic_parameter_set_id */
+	put_bits(w, 0, 4);		/* frame_num */
+	put_ue(w, h264->idr_pic_id);
+	/* dec_ref_pic_marking() */
+	put_bits(w, 0, 1);		/* no_output_of_prior_pics_flag */
+	put_bits(w, 0, 1);		/* long_term_reference_flag */
+	put_se(w, 0);			/* slice_qp_delta */
+	put_ue(w, 1);			/* disable_deblocking_filter_idc */
+
+	for (mby = 0; mby < h264->mb_height; mby++) {
+		for (mbx = 0; mbx < h264->mb_width; mbx++) {
+			write_pcm_mb(w, img, mbx, mby);
+		}
+	}
+	nal_end(w);
+
+	/* Consecutive IDR pictures must have different idr_pic_ids */
+	h264->idr_pic_id ^= 1;
+}
+
+void
+sw_encode_h264_init(struct sw_h264 *h264, int width, int height)
+{
+	memset(h264, 0, sizeof(*h264));
+	h264->width = width;
+	h264->height = height;
+	h264->mb_width = (width + 15) / 16;
+	h264->mb_height = (height + 15) / 16;
+}
+
+size_t
+sw_encode_h264_max_size(const struct sw_h264 *h264)
+{
+	size_t mbs = h264->mb_width * h264->mb_height;
+
+	/* Every two bytes of payload can gain an emulation prevention
+	 * byte, in the worst case; 64 bytes more covers the parameter sets
+	 * and slice header. */
+	return mbs * (PCM_MB_BYTES + 2) * 3 / 2 + 64;
+}
+
+size_t
+sw_encode_h264_frame(struct sw_h264 *h264, const struct sw_nv12 *img,
+		uint8_t *out)
+{
+	struct nal_writer w = { .out = out };
+
+	write_sps(h264, &w);
+	write_pps(&w);
+	write_idr_slice(h264, img, &w);
+
+	return w.pos;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Software building blocks for the CPU encoder backend: colour conversion
+ * to NV12 and an intra-only H.264 writer.
+ */
+
+#ifndef __REMOTE_DISPLAY_SW_ENCODE_H__
+#define __REMOTE_DISPLAY_SW_ENCODE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* An NV12 image: full resolution luma, then interleaved Cb/Cr at half
+ * resolution in both directions. */
+struct sw_nv12 {
+	uint8_t *y;
+	uint8_t *uv;
+	int y_stride;
+	int uv_stride;
+	int width;
+	int height;
+};
+
+/*
+ * Convert 32-bit BGRX pixels (XRGB8888 in memory order) to limited range
+ * BT.601 NV12. 'dst' must have room for width x height, rounded up to even.
+ * Chroma is taken from the average of each 2x2 block. Uses SSE2 where the
+ * build has it; the result is identical to sw_encode_bgrx_to_nv12_c().
+ */
+void
+sw_encode_bgrx_to_nv12(const uint8_t *src, int src_stride,
+		int width, int height, const struct sw_nv12 *dst);
+
+/* Plain C version of the above, as the reference for testing. */
+void
+sw_encode_bgrx_to_nv12_c(const uint8_t *src, int src_stride,
+		int width, int height, const struct sw_nv12 *dst);
+
+/* Copy a width x height area of an NV12 image. */
+void
+sw_encode_nv12_copy(const struct sw_nv12 *src, const struct sw_nv12 *dst,
+		int width, int height);
+
+/*
+ * Fill 'img' out from width x height to its own size by repeating the
+ * last column and row, so that partial macroblocks don't drag in junk.
+ */
+void
+sw_encode_nv12_pad(const struct sw_nv12 *img, int width, int height);
+
+/*
+ * Intra-only H.264 writer. Every picture is an IDR picture made entirely of
+ * I_PCM macroblocks, preceded by its SPS and PPS. This is lossless in NV12
+ * and cheap to produce, at the cost of bandwidth: about 1.5 bytes a pixel.
+ */
+struct sw_h264 {
+	int width, height;
+	int mb_width, mb_height;
+	uint32_t idr_pic_id;
+};
+
+/* 'width' and 'height' are the visible size and must be even. */
+void
+sw_encode_h264_init(struct sw_h264 *h264, int width, int height);
+
+/* Size of the NV12 image sw_encode_h264_frame() expects, in macroblocks
+ * rounded up from the visible size. */
+static inline int
+sw_encode_h264_coded_width(const struct sw_h264 *h264)
+{
+	return h264->mb_width * 16;
+}
+
+static inline int
+sw_encode_h264_coded_height(const struct sw_h264 *h264)
+{
+	return h264->mb_height * 16;
+}
+
+/* Largest number of bytes sw_encode_h264_frame() can write. */
+size_t
+sw_encode_h264_max_size(const struct sw_h264 *h264);
+
+/*
+ * Write one access unit in Annex B byte stream format to 'out', which must
+ * hold sw_encode_h264_max_size() bytes. 'img' is the coded size. Returns
+ * the number of bytes written.
+ */
+size_t
+sw_encode_h264_frame(struct sw_h264 *h264, const struct sw_nv12 *img,
+		uint8_t *out);
+
+#endif /* __REMOTE_DISPLAY_SW_ENCODE_H__ */
@@ -0,0 +1,560 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HAVE_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+#include "tile_codec.h"
+
+#define BYTES_PER_PIXEL		4
+
+/* Longest run or literal one RLE control byte can describe */
+#define RLE_MAX_COUNT		128
+#define RLE_RUN			0x80
+
+static const uint8_t frame_magic[4] = { 'R', 'D', 'T', '1' };
+
+/* Reflected CRC32C polynomial 0x82f63b78, a byte at a time */
+static const uint32_t crc32c_table[256] = {
+	0x00000000, 0xf26b8303, 0xe13b70f7, 0x1350f3f4,
+	0xc79a971f, 0x35f1141c, 0x26a1e7e8, 0xd4ca64eb,
+	0x8ad958cf, 0x78b2dbcc, 0x6be22838, 0x9989ab3b,
+	0x4d43cfd0, 0xbf284cd3, 0xac78bf27, 0x5e133c24,
+	0x105ec76f, 0xe235446c, 0xf165b798, 0x030e349b,
+	0xd7c45070, 0x25afd373, 0x36ff2087, 0xc494a384,
+	0x9a879fa0, 0x68ec1ca3, 0x7bbcef57, 0x89d76c54,
+	0x5d1d08bf, 0xaf768bbc, 0xbc267848, 0x4e4dfb4b,
+	0x20bd8ede, 0xd2d60ddd, 0xc186fe29, 0x33ed7d2a,
+	0xe72719c1, 0x154c9ac2, 0x061c6936, 0xf477ea35,
+	0xaa64d611, 0x580f5512, 0x4b5fa6e6, 0xb93425e5,
+	0x6dfe410e, 0x9f95c20d, 0x8cc531f9, 0x7eaeb2fa,
+	0x30e349b1, 0xc288cab2, 0xd1d83946, 0x23b3ba45,
+	0xf779deae, 0x05125dad, 0x1642ae59, 0xe4292d5a,
+	0xba3a117e, 0x4851927d, 0x5b016189, 0xa96ae28a,
+	0x7da08661, 0x8fcb0562, 0x9c9bf696, 0x6ef07595,
+	0x417b1dbc, 0xb3109ebf, 0xa0406d4b, 0x522bee48,
+	0x86e18aa3, 0x748a09a0, 0x67dafa54, 0x95b17957,
+	0xcba24573, 0x39c9c670, 0x2a993584, 0xd8f2b687,
+	0x0c38d26c, 0xfe53516f, 0xed03a29b, 0x1f682198,
+	0x5125dad3, 0xa34e59d0, 0xb01eaa24, 0x42752927,
+	0x96bf4dcc, 0x64d4cecf, 0x77843d3b, 0x85efbe38,
+	0xdbfc821c, 0x2997011f, 0x3ac7f2eb, 0xc8ac71e8,
+	0x1c661503, 0xee0d9600, 0xfd5d65f4, 0x0f36e6f7,
+	0x61c69362, 0x93ad1061, 0x80fde395, 0x72966096,
+	0xa65c047d, 0x5437877e, 0x4767748a, 0xb50cf789,
+	0xeb1fcbad, 0x197448ae, 0x0a24bb5a, 0xf84f3859,
+	0x2c855cb2, 0xdeeedfb1, 0xcdbe2c45, 0x3fd5af46,
+	0x7198540d, 0x83f3d70e, 0x90a324fa, 0x62c8a7f9,
+	0xb602c312, 0x44694011, 0x5739b3e5, 0xa55230e6,
+	0xfb410cc2, 0x092a8fc1, 0x1a7a7c35, 0xe811ff36,
+	0x3cdb9bdd, 0xceb018de, 0xdde0eb2a, 0x2f8b6829,
+	0x82f63b78, 0x709db87b, 0x63cd4b8f, 0x91a6c88c,
+	0x456cac67, 0xb7072f64, 0xa457dc90, 0x563c5f93,
+	0x082f63b7, 0xfa44e0b4, 0xe9141340, 0x1b7f9043,
+	0xcfb5f4a8, 0x3dde77ab, 0x2e8e845f, 0xdce5075c,
+	0x92a8fc17, 0x60c37f14, 0x73938ce0, 0x81f80fe3,
+	0x55326b08, 0xa759e80b, 0xb4091bff, 0x466298fc,
+	0x1871a4d8, 0xea1a27db, 0xf94ad42f, 0x0b21572c,
+	0xdfeb33c7, 0x2d80b0c4, 0x3ed04330, 0xccbbc033,
+	0xa24bb5a6, 0x502036a5, 0x4370c551, 0xb11b4652,
+	0x65d122b9, 0x97baa1ba, 0x84ea524e, 0x7681d14d,
+	0x2892ed69, 0xdaf96e6a, 0xc9a99d9e, 0x3bc21e9d,
+	0xef087a76, 0x1d63f975, 0x0e330a81, 0xfc588982,
+	0xb21572c9, 0x407ef1ca, 0x532e023e, 0xa145813d,
+	0x758fe5d6, 0x87e466d5, 0x94b49521, 0x66df1622,
+	0x38cc2a06, 0xcaa7a905, 0xd9f75af1, 0x2b9cd9f2,
+	0xff56bd19, 0x0d3d3e1a, 0x1e6dcdee, 0xec064eed,
+	0xc38d26c4, 0x31e6a5c7, 0x22b65633, 0xd0ddd530,
+	0x0417b1db, 0xf67c32d8, 0xe52cc12c, 0x1747422f,
+	0x49547e0b, 0xbb3ffd08, 0xa86f0efc, 0x5a048dff,
+	0x8ecee914, 0x7ca56a17, 0x6ff599e3, 0x9d9e1ae0,
+	0xd3d3e1ab, 0x21b862a8, 0x32e8915c, 0xc083125f,
+	0x144976b4, 0xe622f5b7, 0xf5720643, 0x07198540,
+	0x590ab964, 0xab613a67, 0xb831c993, 0x4a5a4a90,
+	0x9e902e7b, 0x6cfbad78, 0x7fab5e8c, 0x8dc0dd8f,
+	0xe330a81a, 0x115b2b19, 0x020bd8ed, 0xf0605bee,
+	0x24aa3f05, 0xd6c1bc06, 0xc5914ff2, 0x37faccf1,
+	0x69e9f0d5, 0x9b8273d6, 0x88d28022, 0x7ab90321,
+	0xae7367ca, 0x5c18e4c9, 0x4f48173d, 0xbd23943e,
+	0xf36e6f75, 0x0105ec76, 0x12551f82, 0xe03e9c81,
+	0x34f4f86a, 0xc69f7b69, 0xd5cf889d, 0x27a40b9e,
+	0x79b737ba, 0x8bdcb4b9, 0x988c474d, 0x6ae7c44e,
+	0xbe2da0a5, 0x4c4623a6, 0x5f16d052, 0xad7d5351,
+};
+
+uint32_t
+tile_crc32c_c(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+
+	crc = ~crc;
+	while (len--) {
+		crc = crc32c_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	}
+
+	return ~crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t
+crc32c_sse42(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t crc64 = ~crc;
+	uint64_t v;
+
+	while (len >= 8) {
+		memcpy(&v, p, sizeof(v));
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		len -= 8;
+	}
+	crc = crc64;
+	while (len--) {
+		crc = _mm_crc32_u8(crc, *p++);
+	}
+
+	return ~crc;
+}
+#endif
+
+uint32_t
+tile_crc32c(uint32_t crc, const void *data, size_t len)
+{
+#ifdef HAVE_CRC32C_SSE42
+	if (__builtin_cpu_supports("sse4.2")) {
+		return crc32c_sse42(crc, data, len);
+	}
+#endif
+	return tile_crc32c_c(crc, data, len);
+}
+
+static inline void
+put_u16(uint8_t *p, const uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static inline void
+put_u32(uint8_t *p, const uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static inline uint32_t
+get_u16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static inline uint32_t
+get_u32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline uint32_t
+get_pixel(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/* Size of the tile at 'column', 'row', cut to the frame */
+static void
+tile_rect(const int width, const int height, const int tile_size,
+		const int column, const int row, int *x, int *y, int *w, int *h)
+{
+	*x = column * tile_size;
+	*y = row * tile_size;
+	*w = width - *x < tile_size ? width - *x : tile_size;
+	*h = height - *y < tile_size ? height - *y : tile_size;
+}
+
+/*
+ * Run-length code 'count' pixels into 'out'. Returns the number of bytes
+ * written, or 0 if that would be more than 'limit'.
+ */
+static size_t
+rle_encode(const uint8_t *pixels, const int count, uint8_t *out,
+		const size_t limit)
+{
+	size_t len = 0;
+	int literal = 0;
+	int i = 0;
+	int run;
+	uint32_t pixel;
+
+	while (i < count) {
+		pixel = get_pixel(pixels + i * BYTES_PER_PIXEL);
+		run = 1;
+		while (i + run < count && run < RLE_MAX_COUNT &&
+		       get_pixel(pixels + (i + run) * BYTES_PER_PIXEL) == pixel) {
+			run++;
+		}
+
+		if (run == 1) {
+			/* Extend the current literal, or start a new one */
+			if (literal == 0 || literal == RLE_MAX_COUNT) {
+				if (len + 1 + BYTES_PER_PIXEL > limit) {
+					return 0;
+				}
+				literal = 0;
+				len++;
+			} else if (len + BYTES_PER_PIXEL > limit) {
+				return 0;
+			}
+			memcpy(out + len, pixels + i * BYTES_PER_PIXEL,
+					BYTES_PER_PIXEL);
+			len += BYTES_PER_PIXEL;
+			out[len - BYTES_PER_PIXEL * (literal + 1) - 1] = literal;
+			literal++;
+			i++;
+			continue;
+		}
+
+		if (len + 1 + BYTES_PER_PIXEL > limit) {
+			return 0;
+		}
+		out[len++] = RLE_RUN | (run - 1);
+		memcpy(out + len, &pixel, BYTES_PER_PIXEL);
+		len += BYTES_PER_PIXEL;
+		literal = 0;
+		i += run;
+	}
+
+	return len;
+}
+
+static int
+rle_decode(const uint8_t *data, const size_t len, uint8_t *pixels,
+		const int count)
+{
+	size_t pos = 0;
+	int done = 0;
+	int n, i;
+
+	while (pos < len) {
+		n = (data[pos] & ~RLE_RUN) + 1;
+		if (done + n > count) {
+			return -1;
+		}
+		if (data[pos++] & RLE_RUN) {
+			if (pos + BYTES_PER_PIXEL > len) {
+				return -1;
+			}
+			for (i = 0; i < n; i++) {
+				memcpy(pixels + (done + i) * BYTES_PER_PIXEL,
+						data + pos, BYTES_PER_PIXEL);
+			}
+			pos += BYTES_PER_PIXEL;
+		} else {
+			if (pos + (size_t) n * BYTES_PER_PIXEL > len) {
+				return -1;
+			}
+			memcpy(pixels + done * BYTES_PER_PIXEL, data + pos,
+					n * BYTES_PER_PIXEL);
+			pos += n * BYTES_PER_PIXEL;
+		}
+		done += n;
+	}
+
+	return done == count ? 0 : -1;
+}
+
+int
+tile_encoder_init(struct tile_encoder *enc, int width, int height,
+		int tile_size, int key_interval)
+{
+	memset(enc, 0, sizeof(*enc));
+
+	if (width <= 0 || height <= 0 || width > 0xffff || height > 0xffff ||
+	    tile_size < TILE_SIZE_MIN || tile_size > TILE_SIZE_MAX) {
+		return -1;
+	}
+
+	enc->width = width;
+	enc->height = height;
+	enc->tile_size = tile_size;
+	enc->tiles_x = (width + tile_size - 1) / tile_size;
+	enc->tiles_y = (height + tile_size - 1) / tile_size;
+	enc->key_interval = key_interval;
+	enc->need_key = 1;
+
+	enc->crcs = calloc(enc->tiles_x * enc->tiles_y, sizeof(*enc->crcs));
+	enc->scratch = malloc(tile_size * tile_size * BYTES_PER_PIXEL);
+	if (enc->crcs == NULL || enc->scratch == NULL) {
+		tile_encoder_fini(enc);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+tile_encoder_fini(struct tile_encoder *enc)
+{
+	free(enc->crcs);
+	free(enc->scratch);
+	enc->crcs = NULL;
+	enc->scratch = NULL;
+}
+
+void
+tile_encoder_force_key(struct tile_encoder *enc)
+{
+	enc->need_key = 1;
+}
+
+size_t
+tile_encoder_max_size(const struct tile_encoder *enc)
+{
+	return TILE_FRAME_HEADER_SIZE + (size_t) enc->tiles_x * enc->tiles_y *
+		(TILE_HEADER_SIZE +
+		 enc->tile_size * enc->tile_size * BYTES_PER_PIXEL);
+}
+
+size_t
+tile_encoder_frame(struct tile_encoder *enc, const uint8_t *src,
+		int src_stride, uint32_t frame_number, uint8_t *out, int *is_key)
+{
+	size_t len = TILE_FRAME_HEADER_SIZE;
+	size_t raw_size, data_size;
+	uint32_t tiles = 0;
+	uint32_t crc;
+	uint8_t *tile;
+	int key;
+	int row, column, line;
+	int x, y, w, h;
+
+	key = enc->need_key ||
+		(enc->key_interval > 0 && enc->since_key >= enc->key_interval);
+
+	for (row = 0; row < enc->tiles_y; row++) {
+		for (column = 0; column < enc->tiles_x; column++) {
+			tile_rect(enc->width, enc->height, enc->tile_size,
+					column, row, &x, &y, &w, &h);
+
+			/* Gather the tile's rows so that the CRC and the
+			 * coder see one run of pixels. */
+			raw_size = (size_t) w * h * BYTES_PER_PIXEL;
+			for (line = 0; line < h; line++) {
+				memcpy(enc->scratch + line * w * BYTES_PER_PIXEL,
+						src + (size_t) (y + line) * src_stride +
+						x * BYTES_PER_PIXEL,
+						w * BYTES_PER_PIXEL);
+			}
+
+			crc = tile_crc32c(0, enc->scratch, raw_size);
+			if (!key && crc == enc->crcs[row * enc->tiles_x + column]) {
+				continue;
+			}
+			enc->crcs[row * enc->tiles_x + column] = crc;
+
+			tile = out + len;
+			put_u32(tile, row * enc->tiles_x + column);
+			data_size = rle_encode(enc->scratch, w * h,
+					tile + TILE_HEADER_SIZE, raw_size - 1);
+			if (data_size) {
+				tile[4] = TILE_ENCODING_RLE;
+			} else {
+				tile[4] = TILE_ENCODING_RAW;
+				memcpy(tile + TILE_HEADER_SIZE, enc->scratch,
+						raw_size);
+				data_size = raw_size;
+			}
+			put_u32(tile + 5, data_size);
+
+			len += TILE_HEADER_SIZE + data_size;
+			tiles++;
+		}
+	}
+
+	memcpy(out, frame_magic, sizeof(frame_magic));
+	out[4] = key ? TILE_FRAME_KEY : 0;
+	out[5] = 0;
+	put_u16(out + 6, enc->tile_size);
+	put_u16(out + 8, enc->width);
+	put_u16(out + 10, enc->height);
+	put_u32(out + 12, frame_number);
+	put_u32(out + 16, tiles);
+
+	if (key) {
+		enc->need_key = 0;
+		enc->since_key = 0;
+	}
+	enc->since_key++;
+	*is_key = key;
+
+	return len;
+}
+
+void
+tile_decoder_init(struct tile_decoder *dec)
+{
+	memset(dec, 0, sizeof(*dec));
+}
+
+void
+tile_decoder_fini(struct tile_decoder *dec)
+{
+	free(dec->frame);
+	dec->frame = NULL;
+}
+
+static int
+apply_tiles(struct tile_decoder *dec, const uint8_t *data, size_t size,
+		const int tile_size, const uint32_t tiles)
+{
+	const int tiles_x = (dec->width + tile_size - 1) / tile_size;
+	const int tiles_y = (dec->height + tile_size - 1) / tile_size;
+	uint8_t *pixels;
+	uint32_t index, length;
+	uint32_t n;
+	int x, y, w, h;
+	int line;
+
+	pixels = malloc(tile_size * tile_size * BYTES_PER_PIXEL);
+	if (pixels == NULL) {
+		return -1;
+	}
+
+	for (n = 0; n < tiles; n++) {
+		if (size < TILE_HEADER_SIZE) {
+			goto err;
+		}
+		index = get_u32(data);
+		length = get_u32(data + 5);
+		if (index >= (uint32_t) (tiles_x * tiles_y) ||
+		    length > size - TILE_HEADER_SIZE) {
+			goto err;
+		}
+
+		tile_rect(dec->width, dec->height, tile_size,
+				index % tiles_x, index / tiles_x, &x, &y, &w, &h);
+
+		switch (data[4]) {
+		case TILE_ENCODING_RAW:
+			if (length != (uint32_t) (w * h * BYTES_PER_PIXEL)) {
+				goto err;
+			}
+			memcpy(pixels, data + TILE_HEADER_SIZE, length);
+			break;
+		case TILE_ENCODING_RLE:
+			if (rle_decode(data + TILE_HEADER_SIZE, length,
+						pixels, w * h) < 0) {
+				goto err;
+			}
+			break;
+		default:
+			goto err;
+		}
+
+		for (line = 0; line < h; line++) {
+			memcpy(dec->frame + (size_t) (y + line) * dec->stride +
+					x * BYTES_PER_PIXEL,
+					pixels + line * w * BYTES_PER_PIXEL,
+					w * BYTES_PER_PIXEL);
+		}
+
+		data += TILE_HEADER_SIZE + length;
+		size -= TILE_HEADER_SIZE + length;
+	}
+
+	free(pixels);
+	return size == 0 ? (int) tiles : -1;
+
+err:
+	free(pixels);
+	return -1;
+}
+
+int
+tile_decoder_apply(struct tile_decoder *dec, const uint8_t *data,
+		size_t size)
+{
+	int key, tile_size, width, height;
+	uint8_t *frame;
+	int ret;
+
+	if (size < TILE_FRAME_HEADER_SIZE ||
+	    memcmp(data, frame_magic, sizeof(frame_magic)) != 0) {
+		return -1;
+	}
+
+	key = data[4] & TILE_FRAME_KEY;
+	tile_size = get_u16(data + 6);
+	width = get_u16(data + 8);
+	height = get_u16(data + 10);
+	if (tile_size < TILE_SIZE_MIN || tile_size > TILE_SIZE_MAX ||
+	    width == 0 || height == 0) {
+		return -1;
+	}
+
+	if (key) {
+		if (width != dec->width || height != dec->height) {
+			frame = realloc(dec->frame,
+					(size_t) width * height * BYTES_PER_PIXEL);
+			if (frame == NULL) {
+				return -1;
+			}
+			dec->frame = frame;
+			dec->width = width;
+			dec->height = height;
+			dec->stride = width * BYTES_PER_PIXEL;
+		}
+		dec->have_key = 1;
+	} else if (!dec->have_key ||
+		   width != dec->width || height != dec->height) {
+		return -1;
+	}
+
+	ret = apply_tiles(dec, data + TILE_FRAME_HEADER_SIZE,
+			size - TILE_FRAME_HEADER_SIZE, tile_size,
+			get_u32(data + 16));
+	if (ret < 0) {
+		/* The frame may be half updated; wait for the next key. */
+		dec->have_key = 0;
+		return -1;
+	}
+
+	dec->frame_number = get_u32(data + 12);
+
+	return ret;
+}
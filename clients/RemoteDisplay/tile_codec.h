@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Tile-based dirty-region coding for Remote Display. A frame is divided into
+ * square tiles; a CRC32C of every tile is kept, and only tiles whose CRC has
+ * changed since the last frame are sent, run-length coded where that helps.
+ * This suits HMI content, where most of the screen is static and flat.
+ *
+ * Stream format, all integers little-endian. Each frame is:
+ *
+ *	magic		4 bytes	"RDT1"
+ *	flags		u8	TILE_FRAME_KEY if every tile follows
+ *	reserved	u8	0
+ *	tile_size	u16
+ *	width		u16
+ *	height		u16
+ *	frame_number	u32
+ *	tile_count	u32
+ *
+ * followed by tile_count tiles, each:
+ *
+ *	index		u32	row-major, tiles_x * row + column
+ *	encoding	u8	TILE_ENCODING_RAW or TILE_ENCODING_RLE
+ *	length		u32	bytes of data
+ *	data
+ *
+ * Tile pixels are 32-bit BGRX in raster order within the tile; tiles on the
+ * right and bottom edges are cut to the frame. RLE data is a sequence of
+ * control bytes c: if c & 0x80, the next pixel repeated (c & 0x7f) + 1
+ * times, otherwise c + 1 literal pixels.
+ */
+
+#ifndef __REMOTE_DISPLAY_TILE_CODEC_H__
+#define __REMOTE_DISPLAY_TILE_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TILE_FRAME_HEADER_SIZE	20
+#define TILE_HEADER_SIZE	9
+
+#define TILE_FRAME_KEY		(1 << 0)
+
+#define TILE_ENCODING_RAW	0
+#define TILE_ENCODING_RLE	1
+
+#define TILE_SIZE_DEFAULT	64
+#define TILE_SIZE_MIN		16
+#define TILE_SIZE_MAX		256
+
+/* CRC32C (Castagnoli) of 'len' bytes, continuing from 'crc'. Uses the SSE4.2
+ * crc32 instruction when the CPU has it. */
+uint32_t
+tile_crc32c(uint32_t crc, const void *data, size_t len);
+
+/* Table-driven version of the above, as the reference for testing. */
+uint32_t
+tile_crc32c_c(uint32_t crc, const void *data, size_t len);
+
+struct tile_encoder {
+	int width, height;
+	int tile_size;
+	int tiles_x, tiles_y;
+
+	/* CRC of every tile as last sent */
+	uint32_t *crcs;
+
+	/* One tile's pixels, gathered into rows */
+	uint8_t *scratch;
+
+	/* Frames between key frames, 0 for only the first */
+	int key_interval;
+	int since_key;
+	int need_key;
+};
+
+/*
+ * 'tile_size' must be between TILE_SIZE_MIN and TILE_SIZE_MAX. Returns 0,
+ * or -1 on failure.
+ */
+int
+tile_encoder_init(struct tile_encoder *enc, int width, int height,
+		int tile_size, int key_interval);
+
+void
+tile_encoder_fini(struct tile_encoder *enc);
+
+/* Make the next frame a key frame, e.g. because a frame was lost. */
+void
+tile_encoder_force_key(struct tile_encoder *enc);
+
+/* Largest number of bytes tile_encoder_frame() can write. */
+size_t
+tile_encoder_max_size(const struct tile_encoder *enc);
+
+/*
+ * Write the tiles of the BGRX image 'src' that changed since the last call
+ * to 'out', which must hold tile_encoder_max_size() bytes. Returns the
+ * number of bytes written; *is_key says whether it was a key frame.
+ */
+size_t
+tile_encoder_frame(struct tile_encoder *enc, const uint8_t *src,
+		int src_stride, uint32_t frame_number, uint8_t *out, int *is_key);
+
+/*
+ * Reference receiver: keeps a BGRX copy of the frame and applies each
+ * frame of the stream to it. Deltas are refused until a key frame has been
+ * seen.
+ */
+struct tile_decoder {
+	uint8_t *frame;
+	int width, height;
+	int stride;
+	int have_key;
+	uint32_t frame_number;
+};
+
+void
+tile_decoder_init(struct tile_decoder *dec);
+
+void
+tile_decoder_fini(struct tile_decoder *dec);
+
+/*
+ * Apply one frame of 'size' bytes. Returns the number of tiles updated, or
+ * -1 if the data is malformed or is a delta with no key frame before it.
+ */
+int
+tile_decoder_apply(struct tile_decoder *dec, const uint8_t *data,
+		size_t size);
+
+#endif /* __REMOTE_DISPLAY_TILE_CODEC_H__ */
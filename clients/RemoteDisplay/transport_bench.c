@@ -0,0 +1,350 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Compares the CPU time the Remote Display transport plugins spend per GiB
+ * of stream, by loading each plugin and handing it synthetic frames as
+ * fast as it will take them.
+ *
+ *   Usage: remote-display-transport-bench [-s size_mb] [-f frame_kb]
+ *                                         [-d dir] plugin [plugin...]
+ *
+ * Plugins are named as for remote-display's --plugin, and found the same
+ * way. Those named tcp* send to a receiver on the loopback interface,
+ * whose own CPU time isn't counted; the others are given --file=1 and a
+ * --file_path in dir (default /tmp), removed afterwards. Anything after
+ * "--" is passed to every plugin, e.g. "-- --direct=1".
+ *
+ * The time counted is the whole process less the receiver, so includes
+ * the kernel workers io_uring starts on the process's behalf.
+ */
+
+#include <config.h>
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <linux/limits.h>
+#include <libdrm/intel_bufmgr.h>
+
+#define MAX_PLUGIN_ARGS	16
+
+struct plugin {
+	void *handle;
+	int (*init)(int *argc, char **argv, void **plugin_private_data,
+			int verbose);
+	int (*send_frame)(void *plugin_private_data, drm_intel_bo *drm_bo,
+			int32_t stream_size, uint32_t timestamp);
+	void (*destroy)(void **plugin_private_data);
+};
+
+struct receiver {
+	int listen_fd;
+	int port;
+	pthread_t thread;
+	uint64_t bytes;
+	struct rusage usage;
+};
+
+static double
+timeval_sec(const struct timeval *tv)
+{
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static double
+now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+receive_thread(void *data)
+{
+	struct receiver *receiver = data;
+	static uint8_t buf[256 * 1024];
+	ssize_t n;
+	int fd;
+
+	fd = accept(receiver->listen_fd, NULL, NULL);
+	if (fd >= 0) {
+		while ((n = read(fd, buf, sizeof(buf))) > 0) {
+			receiver->bytes += n;
+		}
+		close(fd);
+	}
+
+	getrusage(RUSAGE_THREAD, &receiver->usage);
+	return NULL;
+}
+
+static int
+start_receiver(struct receiver *receiver)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	memset(receiver, 0, sizeof(*receiver));
+	receiver->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (receiver->listen_fd < 0) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(receiver->listen_fd, (struct sockaddr *) &addr,
+				sizeof(addr)) < 0 ||
+	    getsockname(receiver->listen_fd, (struct sockaddr *) &addr,
+				&len) < 0 ||
+	    listen(receiver->listen_fd, 1) < 0 ||
+	    pthread_create(&receiver->thread, NULL, receive_thread,
+				receiver) != 0) {
+		close(receiver->listen_fd);
+		return -1;
+	}
+
+	receiver->port = ntohs(addr.sin_port);
+	return 0;
+}
+
+static int
+load_plugin(struct plugin *plugin, const char *dir, const char *name)
+{
+	char path[PATH_MAX];
+
+	if (dir) {
+		snprintf(path, sizeof(path), "%s/transport_plugin_%s.so",
+				dir, name);
+	} else {
+		snprintf(path, sizeof(path), "transport_plugin_%s.so", name);
+	}
+
+	plugin->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!plugin->handle) {
+		fprintf(stderr, "Failed to load %s: %s\n", path, dlerror());
+		return -1;
+	}
+
+	plugin->init = dlsym(plugin->handle, "init");
+	plugin->send_frame = dlsym(plugin->handle, "send_frame");
+	plugin->destroy = dlsym(plugin->handle, "destroy");
+	if (!plugin->init || !plugin->send_frame || !plugin->destroy) {
+		fprintf(stderr, "%s is not a transport plugin\n", path);
+		dlclose(plugin->handle);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+run(const char *dir, const char *name, char **extra, int num_extra,
+		const char *file_dir, uint8_t *frame, size_t frame_size,
+		uint64_t total)
+{
+	char *argv[MAX_PLUGIN_ARGS + 4];
+	char arg[2][PATH_MAX + 32];
+	char file_path[PATH_MAX];
+	struct plugin plugin;
+	struct receiver receiver;
+	struct rusage before, after;
+	drm_intel_bo bo;
+	void *data = NULL;
+	uint64_t sent;
+	uint32_t timestamp = 0;
+	double start, elapsed, user, sys, mib;
+	int argc = 0, tcp, i;
+
+	if (load_plugin(&plugin, dir, name) != 0) {
+		return -1;
+	}
+
+	tcp = strncmp(name, "tcp", 3) == 0;
+	argv[argc++] = "remote-display-transport-bench";
+	if (tcp) {
+		if (start_receiver(&receiver) != 0) {
+			fprintf(stderr, "Failed to start receiver\n");
+			dlclose(plugin.handle);
+			return -1;
+		}
+		snprintf(arg[0], sizeof(arg[0]), "--ipaddr=127.0.0.1");
+		snprintf(arg[1], sizeof(arg[1]), "--port=%d", receiver.port);
+	} else {
+		snprintf(file_path, sizeof(file_path),
+				"%s/remote-display-bench-%d.h264", file_dir,
+				getpid());
+		unlink(file_path);
+		snprintf(arg[0], sizeof(arg[0]), "--file_path=%s", file_path);
+		snprintf(arg[1], sizeof(arg[1]), "--file=1");
+	}
+	argv[argc++] = arg[0];
+	argv[argc++] = arg[1];
+	for (i = 0; i < num_extra; i++) {
+		argv[argc++] = extra[i];
+	}
+	argv[argc] = NULL;
+
+	memset(&bo, 0, sizeof(bo));
+	bo.virtual = frame;
+	bo.size = frame_size;
+
+	getrusage(RUSAGE_SELF, &before);
+	start = now_sec();
+
+	if (plugin.init(&argc, argv, &data, 0) != 0) {
+		fprintf(stderr, "%s failed to start\n", name);
+		dlclose(plugin.handle);
+		return -1;
+	}
+
+	for (sent = 0; sent < total; sent += frame_size) {
+		if (plugin.send_frame(data, &bo, frame_size,
+					timestamp += 1500) != 0) {
+			break;
+		}
+	}
+	plugin.destroy(&data);
+
+	if (tcp) {
+		pthread_join(receiver.thread, NULL);
+		close(receiver.listen_fd);
+	}
+	elapsed = now_sec() - start;
+	getrusage(RUSAGE_SELF, &after);
+
+	user = timeval_sec(&after.ru_utime) - timeval_sec(&before.ru_utime);
+	sys = timeval_sec(&after.ru_stime) - timeval_sec(&before.ru_stime);
+	if (tcp) {
+		user -= timeval_sec(&receiver.usage.ru_utime);
+		sys -= timeval_sec(&receiver.usage.ru_stime);
+		if (receiver.bytes != sent) {
+			fprintf(stderr, "%s: sent %" PRIu64 " bytes, "
+					"%" PRIu64 " received\n", name, sent,
+					receiver.bytes);
+		}
+	} else {
+		unlink(file_path);
+	}
+
+	mib = sent / (1024.0 * 1024.0);
+	printf("%-16s %8.0f %8.2f %9.1f %11.1f %11.1f\n", name, mib,
+			elapsed, mib / elapsed, user * 1000 * 1024 / mib,
+			sys * 1000 * 1024 / mib);
+
+	dlclose(plugin.handle);
+	return sent < total ? -1 : 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "Usage: remote-display-transport-bench [-s size_mb] "
+			"[-f frame_kb] [-d plugin_dir]\n"
+			"\t[-o file_dir] plugin [plugin...] [-- plugin options]\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *dir = NULL;
+	const char *file_dir = "/tmp";
+	char **extra = NULL;
+	int num_extra = 0;
+	int size_mb = 1024;
+	int frame_kb = 64;
+	uint8_t *frame;
+	size_t i;
+	int opt, first, last, ret = 0;
+
+	while ((opt = getopt(argc, argv, "+s:f:d:o:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = atoi(optarg);
+			break;
+		case 'f':
+			frame_kb = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		case 'o':
+			file_dir = optarg;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	first = optind;
+	for (last = first; last < argc && strcmp(argv[last], "--"); last++)
+		;
+	if (last < argc) {
+		extra = &argv[last + 1];
+		num_extra = argc - last - 1;
+	}
+	if (first == last || size_mb <= 0 || frame_kb <= 0 ||
+	    num_extra > MAX_PLUGIN_ARGS) {
+		usage();
+		return 1;
+	}
+
+	/* Incompressible-looking data, the size of a busy frame */
+	frame = malloc((size_t) frame_kb * 1024);
+	if (!frame) {
+		return 1;
+	}
+	srand(1);
+	for (i = 0; i < (size_t) frame_kb * 1024; i++) {
+		frame[i] = rand();
+	}
+
+	printf("%-16s %8s %8s %9s %11s %11s\n", "plugin", "MiB", "sec",
+			"MiB/s", "user ms/GiB", "sys ms/GiB");
+	for (; first < last; first++) {
+		if (run(dir, argv[first], extra, num_extra, file_dir, frame,
+					(size_t) frame_kb * 1024,
+					(uint64_t) size_mb * 1024 * 1024) != 0) {
+			ret = 1;
+		}
+	}
+
+	free(frame);
+	return ret;
+}
@@ -30,6 +30,8 @@
 #ifndef __REMOTE_DISPLAY_TRANSPORT_PLUGIN_H__
 #define __REMOTE_DISPLAY_TRANSPORT_PLUGIN_H__
 
+#include "rate_control.h"
+
 /**
  * Initialisation of the plugin.
  * This must clean up after itself and set *plugin_private_data to
@@ -61,6 +63,34 @@ void help(void);
 int send_frame(void *plugin_private_data, drm_intel_bo *drm_bo,
 		int32_t stream_size, uint32_t timestamp);
 
+/**
+ * Optional. Send part of a frame: one or more whole NAL units, ending
+ * with a coded slice or, ahead of a frame, an SEI message. Called in
+ * order for each part as soon as it is ready, with the same timestamp for
+ * every part of a frame. Plugins without it are given whole frames.
+ *
+ * @param plugin_private_data Pointer to plugin private data.
+ * @param data Annex B byte stream to be sent.
+ * @param size Size of data to be sent.
+ * @param timestamp RTP-style timestamp for frame.
+ * @param last Non-zero for the final part of the frame.
+ * @return Error code. 0 on success.
+ */
+int send_slice(void *plugin_private_data, uint8_t *data, int32_t size,
+		uint32_t timestamp, int last);
+
+/**
+ * Optional. Report how the link is coping, for rate control. Called after
+ * each frame is sent. Fill in the fields of feedback the transport knows
+ * and set the matching flags; receiver reports should only be passed on
+ * once, when they arrive.
+ *
+ * @param plugin_private_data Pointer to plugin private data.
+ * @param feedback Output for the state of the link.
+ * @return Error code. 0 on success.
+ */
+int get_feedback(void *plugin_private_data, struct rate_feedback *feedback);
+
 /**
  * Destruction of the plugin.
  * This must clean up any resources that are tracked using
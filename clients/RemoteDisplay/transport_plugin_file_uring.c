@@ -0,0 +1,244 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * This file contains a transport plugin for the remote display wayland
+ * client that captures the stream of H264 frames to a file through
+ * io_uring. Frames are gathered into large buffers registered with the
+ * kernel and written asynchronously, optionally with O_DIRECT to keep the
+ * stream out of the page cache.
+ */
+#include <config.h>
+
+#include <stdio.h>
+#include <wayland-util.h>
+#include <libdrm/intel_bufmgr.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+
+#include "../shared/config-parser.h"
+#include "../shared/helpers.h"
+
+#include "transport_plugin.h"
+#include "uring_writer.h"
+
+#define DEFAULT_SLOTS	4
+#define DEFAULT_SLOT_KB	1024
+
+/* O_DIRECT offsets and sizes must be multiples of the logical block size;
+ * a page covers any disk */
+#define DIRECT_ALIGN	4096
+
+
+struct private_data {
+	int verbose;
+	int fd;
+	struct rd_uring_writer writer;
+};
+
+
+static int
+open_output(const char *file_path, int direct, uint64_t *offset)
+{
+	char filepath[PATH_MAX] = {0};
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+	off_t end;
+	int fd;
+
+	strncpy(filepath, file_path, PATH_MAX - 1);
+	if (filepath[strlen(filepath) - 1] == '/') {
+		/* Append default filename */
+		const unsigned int max_write = PATH_MAX - strlen(filepath) - 1;
+
+		strncat(filepath, "capture.mp4", max_write);
+	}
+
+	fd = open(filepath, flags | (direct ? O_DIRECT : 0), 0644);
+	if (fd < 0 && direct && errno == EINVAL) {
+		printf("%s can't be written with O_DIRECT.\n", filepath);
+		direct = 0;
+		fd = open(filepath, flags, 0644);
+	}
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open video output file: %s.\n", filepath);
+		return -1;
+	}
+
+	/* Like the file plugin, add to what's there. Writes go to explicit
+	 * offsets, so the file isn't opened for appending. */
+	end = lseek(fd, 0, SEEK_END);
+	if (end < 0) {
+		fprintf(stderr, "Failed to seek in video output file: %s.\n",
+				filepath);
+		close(fd);
+		return -1;
+	}
+	if (direct && end % DIRECT_ALIGN) {
+		printf("%s doesn't end on a block, so O_DIRECT can't be used.\n",
+				filepath);
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+	}
+
+	*offset = end;
+	return fd;
+}
+
+WL_EXPORT int init(int *argc, char **argv, void **plugin_private_data, int verbose)
+{
+	printf("Using io_uring file remote display transport plugin...\n");
+	struct private_data *private_data = calloc(1, sizeof(*private_data));
+	char *file_path = NULL;
+	uint64_t offset;
+	int direct = 0;
+	int slots = DEFAULT_SLOTS;
+	int slot_kb = DEFAULT_SLOT_KB;
+	int ret;
+
+	*plugin_private_data = (void *)private_data;
+	if (private_data) {
+		private_data->verbose = verbose;
+	} else {
+		return(-ENOMEM);
+	}
+
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_STRING,  "file_path", 0, &file_path},
+		{ WESTON_OPTION_INTEGER, "direct", 0, &direct},
+		{ WESTON_OPTION_INTEGER, "slots", 0, &slots},
+		{ WESTON_OPTION_INTEGER, "slot_kb", 0, &slot_kb},
+	};
+
+	parse_options(options, ARRAY_LENGTH(options), argc, argv);
+
+	if ((file_path == 0) || (file_path[0] == 0)) {
+		fprintf(stderr, "No file path provided.\n");
+		goto err;
+	}
+
+	if (slots < 1 || slots > RD_URING_MAX_SLOTS || slot_kb < 4) {
+		fprintf(stderr, "Invalid buffer configuration: 1 to %d slots of "
+				"at least 4 KiB.\n", RD_URING_MAX_SLOTS);
+		goto err;
+	}
+
+	private_data->fd = open_output(file_path, direct, &offset);
+	if (private_data->fd < 0) {
+		goto err;
+	}
+	direct = (fcntl(private_data->fd, F_GETFL) & O_DIRECT) != 0;
+
+	ret = rd_uring_writer_init(&private_data->writer, private_data->fd,
+			RD_URING_WRITE, slots, (size_t) slot_kb * 1024,
+			direct ? DIRECT_ALIGN : 0, offset);
+	if (ret < 0) {
+		fprintf(stderr, "Failed to set up io_uring: %s.\n", strerror(-ret));
+		close(private_data->fd);
+		goto err;
+	}
+
+	if (verbose) {
+		printf("Writing from %d %s buffers of %d KiB%s.\n", slots,
+				private_data->writer.fixed ? "registered" : "unregistered",
+				slot_kb, direct ? " with O_DIRECT" : "");
+	}
+
+	free(file_path);
+	return 0;
+
+err:
+	free(file_path);
+	free(private_data);
+	*plugin_private_data = NULL;
+	return -1;
+}
+
+
+WL_EXPORT void help(void)
+{
+	printf("\tThe file_uring plugin uses the following parameters:\n");
+	printf("\t--file_path=<file_path>\t\tset path for saving the captured image stream to a file\n");
+	printf("\t--direct=1\t\t\twrite with O_DIRECT, bypassing the page cache\n");
+	printf("\t--slots=<n>\t\t\twrite buffers, 1 to %d (default %d)\n",
+			RD_URING_MAX_SLOTS, DEFAULT_SLOTS);
+	printf("\t--slot_kb=<KiB>\t\t\tsize of each write buffer (default %d)\n",
+			DEFAULT_SLOT_KB);
+	printf("\n\tNote that if file_path does not include a filename then it will default to 'capture.mp4'.\n");
+	printf("\tFrames are written a buffer at a time, and the rest when the plugin is destroyed.\n");
+	printf("\n\tFile can be played back using (for example):\n");
+	printf("\t\"gst-launch-1.0 filesrc location=/var/cap.h264 ! h264parse ! mfxdecode ! mfxsink\"\n");
+}
+
+
+WL_EXPORT int send_frame(void *plugin_private_data, drm_intel_bo *drm_bo, int32_t stream_size, uint32_t timestamp)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+	int ret;
+
+	if (private_data == NULL) {
+		fprintf(stderr, "Invalid pointer to file plugin private data.\n");
+		return (-EFAULT);
+	}
+
+	if (private_data->verbose) {
+		printf("Processing frame in file plugin...\n");
+	}
+
+	ret = rd_uring_writer_queue(&private_data->writer, drm_bo->virtual,
+			stream_size);
+	if (ret == 0) {
+		ret = rd_uring_writer_submit(&private_data->writer);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "Error dumping frame to file: %s.\n",
+				strerror(-ret));
+		return -ret;
+	}
+
+	return 0;
+}
+
+WL_EXPORT void destroy(void **plugin_private_data)
+{
+	struct private_data *private_data = (struct private_data *)*plugin_private_data;
+
+	if (private_data == NULL) {
+		return;
+	}
+
+	if (private_data->verbose) {
+		printf("Freeing file plugin private data...\n");
+	}
+	if (rd_uring_writer_flush(&private_data->writer) < 0) {
+		fprintf(stderr, "Error writing the end of the stream to file.\n");
+	}
+	rd_uring_writer_fini(&private_data->writer);
+	close(private_data->fd);
+	free(private_data);
+	*plugin_private_data = NULL;
+}
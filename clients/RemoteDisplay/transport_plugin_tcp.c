@@ -30,7 +30,9 @@
 #include <string.h>
 
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <linux/sockios.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -38,6 +40,7 @@
 #include "../shared/helpers.h"
 
 #include "transport_plugin.h"
+#include "rate_control.h"
 
 
 struct tcpSocket {
@@ -51,6 +54,9 @@ struct private_data {
 	struct tcpSocket socket;
 	char *ipaddr;
 	unsigned short port;
+
+	/* Rate control feedback: writes tried and failed */
+	uint32_t writes, write_errors;
 };
 
 
@@ -133,8 +139,68 @@ WL_EXPORT int send_frame(void *plugin_private_data, drm_intel_bo *drm_bo,
 
 	int rval = write(private_data->socket.sockDesc, bufdata, stream_size);
 
+	private_data->writes++;
 	if (rval <= 0) {
 		fprintf(stderr, "Send failed.\n");
+		private_data->write_errors++;
+	}
+
+	return 0;
+}
+
+WL_EXPORT int send_slice(void *plugin_private_data, uint8_t *data,
+		int32_t size, uint32_t timestamp, int last)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+	ssize_t rval;
+
+	if (private_data == NULL) {
+		fprintf(stderr, "Private data is null!\n");
+		return -1;
+	}
+
+	if (private_data->verbose > 1) {
+		printf("Sending %d byte slice over TCP...\n", size);
+	}
+
+	/* The stream is a byte stream, so the receiver sees the slice
+	 * as soon as it arrives whether or not the frame is done. */
+	while (size > 0) {
+		rval = write(private_data->socket.sockDesc, data, size);
+		if (rval < 0 && errno == EINTR) {
+			continue;
+		}
+		private_data->writes++;
+		if (rval <= 0) {
+			fprintf(stderr, "Send failed.\n");
+			private_data->write_errors++;
+			return -1;
+		}
+		data += rval;
+		size -= rval;
+	}
+
+	return 0;
+}
+
+WL_EXPORT int get_feedback(void *plugin_private_data,
+		struct rate_feedback *feedback)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+	int queued;
+
+	if (private_data == NULL) {
+		return -1;
+	}
+
+	/* TCP hides loss behind retransmission, so a growing send queue is
+	 * the sign that the link can't keep up */
+	feedback->flags = RATE_FEEDBACK_ERRORS;
+	feedback->packets_sent = private_data->writes;
+	feedback->send_errors = private_data->write_errors;
+	if (ioctl(private_data->socket.sockDesc, SIOCOUTQ, &queued) == 0) {
+		feedback->flags |= RATE_FEEDBACK_QUEUE;
+		feedback->queue_bytes = queued;
 	}
 
 	return 0;
@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * This file contains a TCP transport plugin for the remote display wayland
+ * client that sends through io_uring. Each frame is copied into buffers
+ * registered with the kernel and sent with one system call, zero-copy
+ * where the kernel supports it, so the transport thread doesn't wait for
+ * the network unless the previous frame is still going out.
+ */
+#include <stdio.h>
+#include <wayland-util.h>
+#include <libdrm/intel_bufmgr.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../shared/config-parser.h"
+#include "../shared/helpers.h"
+
+#include "transport_plugin.h"
+#include "rate_control.h"
+#include "uring_writer.h"
+
+#define DEFAULT_SLOTS	8
+#define DEFAULT_SLOT_KB	256
+
+
+struct private_data {
+	int verbose;
+	int sockDesc;
+	char *ipaddr;
+	unsigned short port;
+	struct rd_uring_writer writer;
+};
+
+
+static void
+free_private_data(void **plugin_private_data)
+{
+	struct private_data *private_data = (struct private_data *)*plugin_private_data;
+
+	if (private_data->sockDesc >= 0) {
+		close(private_data->sockDesc);
+	}
+	free(private_data->ipaddr);
+	free(private_data);
+	*plugin_private_data = NULL;
+}
+
+WL_EXPORT int init(int *argc, char **argv, void **plugin_private_data, int verbose)
+{
+	printf("Using io_uring TCP remote display transport plugin...\n");
+	struct private_data *private_data = calloc(1, sizeof(*private_data));
+	struct sockaddr_in sockAddr;
+	int ret;
+
+	*plugin_private_data = (void *)private_data;
+	if (private_data) {
+		private_data->verbose = verbose;
+		private_data->sockDesc = -1;
+	} else {
+		return(-ENOMEM);
+	}
+
+	int port = 0;
+	int slots = DEFAULT_SLOTS;
+	int slot_kb = DEFAULT_SLOT_KB;
+	int zerocopy = 1;
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_STRING,  "ipaddr", 0, &private_data->ipaddr},
+		{ WESTON_OPTION_INTEGER, "port", 0, &port},
+		{ WESTON_OPTION_INTEGER, "slots", 0, &slots},
+		{ WESTON_OPTION_INTEGER, "slot_kb", 0, &slot_kb},
+		{ WESTON_OPTION_INTEGER, "zerocopy", 0, &zerocopy},
+	};
+	parse_options(options, ARRAY_LENGTH(options), argc, argv);
+	private_data->port = port;
+
+	if ((private_data->ipaddr != NULL) && (private_data->ipaddr[0] != 0)) {
+		printf("Sending to %s:%d.\n", private_data->ipaddr, port);
+	} else {
+		fprintf(stderr, "Invalid network configuration.\n");
+		free_private_data(plugin_private_data);
+		return -1;
+	}
+
+	if (slots < 1 || slots > RD_URING_MAX_SLOTS || slot_kb < 1) {
+		fprintf(stderr, "Invalid buffer configuration: 1 to %d slots of "
+				"at least 1 KiB.\n", RD_URING_MAX_SLOTS);
+		free_private_data(plugin_private_data);
+		return -1;
+	}
+
+	private_data->sockDesc = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (private_data->sockDesc < 0) {
+		fprintf(stderr, "Socket creation failed.\n");
+		free_private_data(plugin_private_data);
+		return -1;
+	}
+
+	memset(&sockAddr, 0, sizeof(sockAddr));
+	sockAddr.sin_addr.s_addr = inet_addr(private_data->ipaddr);
+	sockAddr.sin_family = AF_INET;
+	sockAddr.sin_port = htons(private_data->port);
+	if (connect(private_data->sockDesc, (struct sockaddr *) &sockAddr,
+			sizeof(sockAddr)) < 0) {
+		fprintf(stderr, "Error connecting to receiver.\n");
+		free_private_data(plugin_private_data);
+		return -1;
+	}
+
+	ret = -EOPNOTSUPP;
+	if (zerocopy) {
+		ret = rd_uring_writer_init(&private_data->writer,
+				private_data->sockDesc, RD_URING_SEND_ZC, slots,
+				slot_kb * 1024, 0, 0);
+		if (ret == -EOPNOTSUPP) {
+			printf("Kernel can't send zero-copy through io_uring.\n");
+		}
+	}
+	if (ret == -EOPNOTSUPP) {
+		ret = rd_uring_writer_init(&private_data->writer,
+				private_data->sockDesc, RD_URING_SEND, slots,
+				slot_kb * 1024, 0, 0);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "Failed to set up io_uring: %s.\n", strerror(-ret));
+		free_private_data(plugin_private_data);
+		return -1;
+	}
+
+	if (verbose) {
+		printf("Sending from %d %s buffers of %d KiB%s.\n", slots,
+				private_data->writer.fixed ? "registered" : "unregistered",
+				slot_kb,
+				private_data->writer.op == RD_URING_SEND_ZC ?
+					", zero-copy" : "");
+	}
+
+	return 0;
+}
+
+
+WL_EXPORT void help(void)
+{
+	printf("\tThe tcp_uring plugin uses the following parameters:\n");
+	printf("\t--ipaddr=<ip_address>\t\tIP address of receiver.\n");
+	printf("\t--port=<port_number>\t\tPort to use on receiver.\n");
+	printf("\t--slots=<n>\t\t\tSend buffers, 1 to %d (default %d).\n",
+			RD_URING_MAX_SLOTS, DEFAULT_SLOTS);
+	printf("\t--slot_kb=<KiB>\t\t\tSize of each send buffer (default %d).\n",
+			DEFAULT_SLOT_KB);
+	printf("\t--zerocopy=0\t\t\tCopy into the socket even where the kernel"
+			" can send zero-copy.\n");
+	printf("\n\tThe receiver should be started using:\n");
+	printf("\t\"gst-launch-1.0 tcpserversrc  host=<ip_address> port=<port_number> ! h264parse ! mfxdecode live-mode=true ! mfxsinkelement\"\n");
+}
+
+
+static int
+send_data(struct private_data *private_data, const void *data, int32_t size)
+{
+	int ret;
+
+	ret = rd_uring_writer_queue(&private_data->writer, data, size);
+	if (ret == 0) {
+		ret = rd_uring_writer_submit(&private_data->writer);
+	}
+	if (ret < 0) {
+		fprintf(stderr, "Send failed: %s.\n", strerror(-ret));
+		return -1;
+	}
+
+	return 0;
+}
+
+WL_EXPORT int send_frame(void *plugin_private_data, drm_intel_bo *drm_bo,
+		int32_t stream_size, uint32_t timestamp)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+
+	if (private_data == NULL) {
+		fprintf(stderr, "Private data is null!\n");
+		return -1;
+	}
+
+	if (private_data->verbose) {
+		printf("Sending frame over TCP...\n");
+	}
+
+	return send_data(private_data, drm_bo->virtual, stream_size);
+}
+
+WL_EXPORT int send_slice(void *plugin_private_data, uint8_t *data,
+		int32_t size, uint32_t timestamp, int last)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+
+	if (private_data == NULL) {
+		fprintf(stderr, "Private data is null!\n");
+		return -1;
+	}
+
+	if (private_data->verbose > 1) {
+		printf("Sending %d byte slice over TCP...\n", size);
+	}
+
+	return send_data(private_data, data, size);
+}
+
+WL_EXPORT int get_feedback(void *plugin_private_data,
+		struct rate_feedback *feedback)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+	int queued;
+
+	if (private_data == NULL) {
+		return -1;
+	}
+
+	/* Data still in our buffers is as far behind as the socket's */
+	feedback->flags = RATE_FEEDBACK_ERRORS;
+	feedback->packets_sent = private_data->writer.ops;
+	feedback->send_errors = private_data->writer.op_errors;
+	if (ioctl(private_data->sockDesc, SIOCOUTQ, &queued) == 0) {
+		feedback->flags |= RATE_FEEDBACK_QUEUE;
+		feedback->queue_bytes = queued + private_data->writer.bytes_pending;
+	}
+
+	return 0;
+}
+
+WL_EXPORT void destroy(void **plugin_private_data)
+{
+	struct private_data *private_data = (struct private_data *)*plugin_private_data;
+
+	if (private_data == NULL) {
+		return;
+	}
+
+	if (private_data->verbose) {
+		fprintf(stdout, "Closing network connection...\n");
+	}
+	rd_uring_writer_fini(&private_data->writer);
+
+	if (private_data->verbose) {
+		fprintf(stdout, "Freeing plugin private data...\n");
+	}
+	free_private_data(plugin_private_data);
+}
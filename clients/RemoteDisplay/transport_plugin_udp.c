@@ -28,6 +28,7 @@
 #include <netdb.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <time.h>
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
 #include <stdbool.h>
@@ -35,6 +36,10 @@
 #include "../shared/config-parser.h"
 #include "../shared/helpers.h"
 #include "transport_plugin.h"
+#include "h264_nal.h"
+#include "rate_control.h"
+#include "rtcp_report.h"
+#include "udp_fanout.h"
 
 
 #define TO_Mb(bytes) ((bytes)/1024/1024*8)
@@ -42,35 +47,66 @@
 #define RTP_BUFFER_SIZE 1400
 #define RTP_HEADER_SIZE (3*4)
 #define RTP_PAYLOAD_SIZE (RTP_BUFFER_SIZE - RTP_HEADER_SIZE)
-#define NAL_HEADER_SIZE 1
-#define FU_HEADER_SIZE 1
-#define FU_INDICATOR_SIZE 1
-#define NAL_MARKER_SIZE 3
-#define SPS_PPS_MARKER_SIZE 4
-#define NRI_MASK 0x60
-#define NAL_TYPE_MASK 0x1F
-#define FU_A_TYPE 28
-#define MAX_ADDRS 10
-
-struct udpSocket {
-	int sockDesc;
-	struct sockaddr_in sockAddr;
-	bool available;
-};
+#define RTP_SSRC 0x4120db95 /* hard-coded */
 
 
 struct private_data {
 	int verbose;
 	int debug_packetisation;
-	struct udpSocket socket[MAX_ADDRS];
-	int num_addr;
+	struct udp_fanout fanout;
+	/* When the frame being sent started, for retrying failed clients */
+	uint64_t frame_us;
 	char *ipaddr;
 	char *tp;
 	GstElement *pipeline;
 	GstElement *appsrc;
 	uint32_t benchmark_time, frames, total_stream_size;
+
+	/* Rate control feedback: sends tried and failed with gstreamer, and
+	 * the socket RTCP receiver reports arrive on, or -1 */
+	uint32_t packets_sent, send_errors;
+	int rtcp_fd;
 };
 
+/* Receiver reports are only read when asked for feedback, so the socket
+ * doesn't block */
+static int
+open_rtcp_socket(int port)
+{
+	struct sockaddr_in addr;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			IPPROTO_UDP);
+	if (fd < 0) {
+		fprintf(stderr, "RTCP socket creation failed.\n");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "Failed to listen for RTCP on port %d: %m\n",
+				port);
+		close(fd);
+		return -1;
+	}
+
+	printf("Listening for RTCP receiver reports on port %d.\n", port);
+	return fd;
+}
+
+static uint64_t
+monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 WL_EXPORT int init(int *argc, char **argv, void **plugin_private_data, int verbose)
 {
 	printf("Using UDP remote display transport plugin...\n");
@@ -82,9 +118,14 @@ WL_EXPORT int init(int *argc, char **argv, void **plugin_private_data, int verbo
 	GstElement *rtph264pay = NULL;
 	GstElement *multiudpsink = NULL;
 
+	int rtcp_port = 0;
+	int ttl = 0;
+	char *multicast_if = NULL;
+
 	*plugin_private_data = (void *)private_data;
 	if (private_data) {
 		private_data->verbose = verbose;
+		private_data->rtcp_fd = -1;
 	} else {
 		return(-ENOMEM);
 	}
@@ -92,6 +133,9 @@ WL_EXPORT int init(int *argc, char **argv, void **plugin_private_data, int verbo
 	const struct weston_option options[] = {
 		{ WESTON_OPTION_STRING,  "clients", 0, &private_data->ipaddr},
 		{ WESTON_OPTION_STRING,  "tp", 0, &private_data->tp},
+		{ WESTON_OPTION_INTEGER, "rtcp_port", 0, &rtcp_port},
+		{ WESTON_OPTION_INTEGER, "ttl", 0, &ttl},
+		{ WESTON_OPTION_STRING,  "multicast_if", 0, &multicast_if},
 	};
 	parse_options(options, ARRAY_LENGTH(options), argc, argv);
 
@@ -139,48 +183,26 @@ WL_EXPORT int init(int *argc, char **argv, void **plugin_private_data, int verbo
 
 	} else if(!strcmp(private_data->tp, "native")) {
 
-		char copy[256], *ptr, *ptr2;
-		strcpy(copy, private_data->ipaddr);
-		ptr = strtok(copy, ",");
-		ptr2 = strtok(NULL, "\n");
-
-		while(ptr) {
-			char *str_ipaddr = strtok(ptr, ":");
-			char *str_port = strtok(NULL, "\n");
-			int sockfd;
-			struct timeval optTime = {0, 10}; /* {sec, msec} */
-
-			sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-			if (!str_ipaddr || !str_port || private_data->socket[private_data->num_addr].sockDesc < 0) {
-				fprintf(stderr, "Socket creation failed.\n");
-				if(private_data->ipaddr) {
-					free(private_data->ipaddr);
-				}
-				if(private_data->tp) {
-					free(private_data->tp);
-				}
-				free(private_data);
-				*plugin_private_data = NULL;
-				return -1;
+		if (udp_fanout_init(&private_data->fanout, private_data->ipaddr,
+					ttl, multicast_if, verbose) < 0) {
+			free(multicast_if);
+			if(private_data->ipaddr) {
+				free(private_data->ipaddr);
 			}
-
-			if (setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &optTime, sizeof(optTime)) < 0) {
-				fprintf(stderr, "sendto timeout configuration failed\n");
+			if(private_data->tp) {
+				free(private_data->tp);
 			}
-
-			private_data->socket[private_data->num_addr].sockDesc = sockfd;
-			private_data->socket[private_data->num_addr].sockAddr.sin_addr.s_addr =
-					inet_addr(str_ipaddr);
-			private_data->socket[private_data->num_addr].sockAddr.sin_family = AF_INET;
-			private_data->socket[private_data->num_addr].sockAddr.sin_port = htons(atoi(str_port));
-			private_data->socket[private_data->num_addr].available = true;
-
-			ptr = strtok(ptr2, ",");
-			ptr2 = strtok(NULL, "\n");
-			private_data->num_addr++;
+			free(private_data);
+			*plugin_private_data = NULL;
+			return -1;
 		}
+		free(multicast_if);
 
 		printf("Using native transport\n");
+
+		if (rtcp_port > 0) {
+			private_data->rtcp_fd = open_rtcp_socket(rtcp_port);
+		}
 	}
 
 	return 0;
@@ -212,8 +234,15 @@ WL_EXPORT void help(void)
 	printf("\tThe udp plugin uses the following parameters:\n");
 	printf("\t--clients=<ip_address:port,<ip_address:port>>\t\tIP address and port of receiver.\n");
 	printf("\t\tNote that this is a comma separated list of addresses and ports\n");
+	printf("\t\tand that an address may be a multicast group\n");
+	printf("\t--ttl=<hops> (Optional)\t\t\tTime to live of multicast packets"
+			" (default 1).\n");
+	printf("\t--multicast_if=<ip_address> (Optional)\tAddress of the"
+			" interface to send multicast from.\n");
 	printf("\t--tp=<gst/native> (Optional)\t\tTransport mechanism to use."
 			" Either native (default) or gstreamer based\n");
+	printf("\t--rtcp_port=<port> (Optional)\t\tPort to take RTCP receiver"
+			" reports on,\n\t\tfor rate control. Native transport only.\n");
 	printf("\n\tThe receiver should be started using:\n");
 	printf("\t\"gst-launch-1.0 udpsrc port=<port_number>"
 			"! h264parse ! mfxdecode live-mode=true ! mfxsinkelement\"\n");
@@ -229,7 +258,6 @@ send_packet(uint8_t *payload, size_t size, uint32_t timestamp,
 	uint16_t *rtpBase16 = (uint16_t *)(payload - RTP_HEADER_SIZE);
 	uint32_t *rtpBase32 = (uint32_t *)(payload - RTP_HEADER_SIZE);
 	static uint16_t sequence_number = 1;
-	int i = 0;
 
 	if (size > RTP_PAYLOAD_SIZE) {
 		fprintf(stderr, "Payload size %d too large (>1388).\n", (int)size);
@@ -245,7 +273,7 @@ send_packet(uint8_t *payload, size_t size, uint32_t timestamp,
 	}
 
 	rtpBase32[1] = htonl(timestamp);
-	rtpBase32[2] = htonl(0x4120db95); /* SSRC hard-coded */
+	rtpBase32[2] = htonl(RTP_SSRC);
 	rtpBase16[1] = htons(sequence_number++);
 
 	if (!private_data) {
@@ -253,52 +281,13 @@ send_packet(uint8_t *payload, size_t size, uint32_t timestamp,
 		return -1;
 	}
 
-	for(i = 0; i < private_data->num_addr; i++) {
-		if (private_data->socket[i].available) {
-			int rval = sendto(private_data->socket[i].sockDesc,
-					rtpBase8,
-					size + RTP_HEADER_SIZE,
-					0,
-					(struct sockaddr *) &private_data->socket[i].sockAddr,
-					sizeof(private_data->socket[i].sockAddr));
-
-			if (rval <= 0) {
-				/*TODO - add more detailed error handles */
-				private_data->socket[i].available = false;
-				if (private_data->verbose >= 2) {
-					fprintf(stderr, "Socket(%d) - Send failed with %m \n", i);
-				}
-			}
-		}
-	}
+	/* Clients that fail are skipped for a while, so there's nothing
+	 * more to do about them here */
+	udp_fanout_send(&private_data->fanout, rtpBase8,
+			size + RTP_HEADER_SIZE, private_data->frame_us);
 	return 0;
 }
 
-static int
-get_ps_write_size(uint8_t *readptr)
-{
-	int i = 0;
-	int found_end = 0;
-
-	while (!found_end) {
-		if (readptr[i] == 0x00) {
-			if (readptr[i+1] == 0x00) {
-				if (readptr[i+2] == 0x00) {
-					if (readptr[i+3] == 0x01) {
-						found_end = 1;
-						continue;
-					}
-				} else if (readptr[i+2] == 0x01) {
-					found_end = 1;
-					continue;
-				}
-			}
-		}
-		i++;
-	}
-	return i;
-}
-
 static int send_frame_gst(void *plugin_private_data, drm_intel_bo *drm_bo,
 		int32_t stream_size, uint32_t timestamp)
 {
@@ -324,6 +313,7 @@ static int send_frame_gst(void *plugin_private_data, drm_intel_bo *drm_bo,
 	(void) memcpy (gstmap.data, readptr, stream_size);
 	(void) gst_buffer_unmap(gstbuf, &gstmap);
 
+	private_data->packets_sent++;
 	if (gst_app_src_push_buffer (GST_APP_SRC (private_data->appsrc), gstbuf) != GST_FLOW_OK)
 		goto error;
 
@@ -331,6 +321,9 @@ static int send_frame_gst(void *plugin_private_data, drm_intel_bo *drm_bo,
 
 error:
 	fprintf(stderr, "Send failed.\n");
+	if (private_data) {
+		private_data->send_errors++;
+	}
 
 	if (gstbuf)
 		gst_buffer_unref (gstbuf);
@@ -338,27 +331,53 @@ error:
 	return -1;
 }
 
-static int send_frame_native(void *plugin_private_data, drm_intel_bo *drm_bo,
-		int32_t stream_size, uint32_t timestamp)
+/* Per-call state for send_nal_packet() */
+struct packet_context {
+	struct private_data *private_data;
+	uint32_t timestamp;
+};
+
+static void
+send_nal_packet(uint8_t *payload, size_t size, int marker, void *data)
+{
+	struct packet_context *ctx = data;
+	int err;
+
+	err = send_packet(payload, size, ctx->timestamp, marker,
+			ctx->private_data);
+	if (err) {
+		fprintf(stderr, "Warning: Sending packet returned %d.\n", err);
+	}
+}
+
+/* Send each NAL unit in 'data' as a single packet, or as FU-A fragments
+ * if it doesn't fit. The payload is copied, because the bytes ahead of a
+ * slice belong to the previous one. The marker bit goes on the final
+ * packet when 'last' is set. */
+static int send_slice_native(struct private_data *private_data,
+		uint8_t *data, int32_t size, uint32_t timestamp, int last)
 {
-	int num_packets = 0;
-	int bytes_written = 0;
-	uint16_t count = 0;
 	uint8_t rtp_buffer[RTP_BUFFER_SIZE];
-	uint8_t *rtp_payload = &rtp_buffer[RTP_HEADER_SIZE];
-	uint8_t *fu_start;
-	uint8_t *readptr = drm_bo->virtual;
-	int32_t write_size = stream_size;
-	uint8_t nal_header = 0;
-	int start = 1, end = 0;
-	/* Allow for FU indicator size and FU header size */
-	const int step = RTP_PAYLOAD_SIZE - FU_HEADER_SIZE - FU_INDICATOR_SIZE;
-	int spspps = 0;
-	uint8_t *bufdata;
-	volatile sig_atomic_t send_packages;
-	int err = 0;
-	int i;
+	struct packet_context ctx = { private_data, timestamp };
+	int num_packets;
 
+	private_data->frame_us = monotonic_us();
+	num_packets = h264_packetize(data, size, &rtp_buffer[RTP_HEADER_SIZE],
+			RTP_PAYLOAD_SIZE, last, send_nal_packet, &ctx);
+
+	if (private_data->debug_packetisation) {
+		printf("Packets for slice = %d packets.\n", num_packets);
+	}
+	return 0;
+}
+
+/* Encoders differ in which start codes they use (the VA driver puts four
+ * bytes before parameter sets and three before slices, the software
+ * encoder four everywhere), so frames go through the same NAL parser as
+ * slices do. */
+static int send_frame_native(void *plugin_private_data, drm_intel_bo *drm_bo,
+		int32_t stream_size, uint32_t timestamp)
+{
 	struct private_data *private_data = (struct private_data *)plugin_private_data;
 
 	if (!private_data) {
@@ -370,253 +389,48 @@ static int send_frame_native(void *plugin_private_data, drm_intel_bo *drm_bo,
 		printf("Sending frame over UDP...\n");
 	}
 
-	/* SPS and PPS are preceded by the bytes 00 00 00 01 (in our case).
-	 * 00 00 01 means we have an ordinary NAL unit containing an h264
-	 * encoded frame. This may well be different and more nuanced with
-	 * other implementations. */
-	bufdata = ((uint8_t *)(drm_bo->virtual));
-	if (bufdata[0] == 0x00) {
-		if (bufdata[1] == 0x00) {
-			if (bufdata[2] == 0x00) {
-				if (bufdata[3] == 0x01) {
-					/* SPS or PPS */
-					if (private_data->debug_packetisation) {
-						printf("SPS or PPS frame\n");
-					}
-					spspps = 1;
-				} else {
-					fprintf(stderr, "Invalid start of stream.\n");
-					return 1;
-				}
-			} else if (bufdata[2] == 0x01) {
-				/* Ordinary NAL unit containing an h264 encoded frame */
-				if (private_data->debug_packetisation) {
-					printf("00 00 01 - start of frame?\n");
-				}
-			} else {
-				fprintf(stderr, "Invalid frame.\n");
-				return 1;
-			}
-		}
-	}
-
-	send_packages = 1;
-	while (send_packages){
-		num_packets++;
-		if (spspps == 1) {
-			int32_t sps_size, pps_size;
-			/* Skip 00 00 00 01 */
-			readptr += SPS_PPS_MARKER_SIZE;
-			sps_size = get_ps_write_size(readptr);
-
-			/* Send SPS... */
-			memcpy(rtp_payload, readptr, sps_size);
-			err = send_packet(rtp_payload, sps_size, timestamp, 1,
-					private_data);
-			bytes_written += sps_size;
-			if (err) {
-				fprintf(stderr, "Warning: Sending SPS packet returned %d.\n",
-						err);
-				err = 0;
-			}
-
-			/* Advance readptr by SPS + second 00 00 00 01 marker... */
-			readptr += sps_size + SPS_PPS_MARKER_SIZE;
-			pps_size = get_ps_write_size(readptr);
-
-			if (private_data->debug_packetisation) {
-				printf("Skipping second 00 00 00 01 marker and writing"
-				   " %d bytes + 12 byte header\n", pps_size);
-				nal_header = readptr[0];
-				printf("PPS - nal_type = 0x%x\n",
-					nal_header & NAL_TYPE_MASK);
-			}
-
-			/* Send PPS... */
-			/* We avoid doing a memcpy where possible, writing
-			 * the headers to the mapped buffer instead. (This
-			 * trashes the previous 12 bytes in the buffer, but we
-			 * don't need to worry about that.) */
-			if (bytes_written >= RTP_HEADER_SIZE) {
-				err = send_packet(readptr, pps_size, timestamp,
-					1, private_data);
-			} else {
-				memcpy(rtp_payload, readptr, pps_size);
-				err = send_packet(rtp_payload, pps_size, timestamp, 1,
-						private_data);
-			}
-			bytes_written += pps_size;
-			if (err) {
-				fprintf(stderr, "Warning: Sending PPS packet returned %d.\n",
-						err);
-				err = 0;
-			}
-
-			/* There will be a NAL unit in buffer after SPS and PPS. */
-			readptr += pps_size;
-			write_size = stream_size -
-				(sps_size + pps_size + 2 * SPS_PPS_MARKER_SIZE);
-			spspps = 0;
-		}
-
-		if (start == 1) {
-			/* Skip 00 00 01 marker before NAL unit starts... */
-			readptr += NAL_MARKER_SIZE;
-			write_size -= NAL_MARKER_SIZE;
-			nal_header = readptr[0];
-			if (private_data->debug_packetisation) {
-				printf("Skipped 00 00 01 marker.\n");
-				printf("nal_type = 0x%x\n",
-					nal_header & NAL_TYPE_MASK);
-			}
-		}
-
-		/* NAL packetisation into Fragmentation Units (FUs)...*/
-		if (RTP_PAYLOAD_SIZE >= write_size) {
-			/* Stream is smaller than a packet, no FUs. */
-			if (private_data->debug_packetisation) {
-				printf("Small packet, only writing %d bytes.\n", write_size);
-			}
-			if (bytes_written >= RTP_HEADER_SIZE) {
-				err = send_packet(readptr, write_size, timestamp,
-					1, private_data);
-			} else {
-				memcpy(rtp_payload, readptr, write_size);
-				err = send_packet(rtp_payload, write_size, timestamp, 1,
-						private_data);
-			}
-			bytes_written += write_size;
-			if (err) {
-				fprintf(stderr, "Warning: Sending small packet returned %d.\n",
-						err);
-				err = 0;
-			}
-			send_packages = 0;
-		} else if (step * count < write_size) {
-			count++;
-
-			/* FU indicator - as per section 5.8 of rfc6184. */
-			*rtp_payload = (nal_header & NRI_MASK) | FU_A_TYPE;
-
-			/* FU header - as per section 5.8 of rfc6184. */
-			*(rtp_payload + 1) = (start << 7) | (end << 6) |
-				(nal_header & NAL_TYPE_MASK);
-
-			if (private_data->debug_packetisation) {
-				printf("%s FU. Indicator 0x%x Header 0x%x\n",
-					start ? "First" : "Middle",
-					/* Sometimes fprintf tries to interpret
-					 * these as 64-bit ints. The 0xFF & fixes that. */
-					0xFF & *rtp_payload, 0xFF & *(rtp_payload + 1));
-			}
-
-			if (start) {
-				/* Skip the NAL header because the info is
-				 * already in the FU indicator and header. */
-				readptr += NAL_HEADER_SIZE;
-				start = 0;
-			}
-
-			if (bytes_written >= RTP_HEADER_SIZE) {
-				/* We have the marker bits free as well as the header size. */
-				fu_start = readptr - FU_HEADER_SIZE - FU_INDICATOR_SIZE;
-				fu_start[0] = *rtp_payload;
-				fu_start[1] = *(rtp_payload + 1);
-				err = send_packet(fu_start, RTP_PAYLOAD_SIZE,
-					timestamp, 0, private_data);
-			} else {
-				memcpy(rtp_payload + FU_HEADER_SIZE + FU_INDICATOR_SIZE,
-					readptr, step);
-				err = send_packet(rtp_payload, RTP_PAYLOAD_SIZE,
-					timestamp, 0, private_data);
-			}
-			bytes_written += step;
-			if (err) {
-				fprintf(stderr, "Warning: Sending FU packet returned %d.\n",
-						err);
-				err = 0;
-			}
-
-			readptr += step;
-		} else {
-			/* Last FU... */
-			int bytes_left = write_size - (step*(count-1)) - NAL_HEADER_SIZE;
-
-			end = 1;
-			*rtp_payload = (nal_header & NRI_MASK) | FU_A_TYPE;
-			*(rtp_payload + 1) = (start << 7) | (end << 6) |
-						(nal_header & NAL_TYPE_MASK);
-
-			if (private_data->debug_packetisation) {
-				printf("Last FU. Indicator: 0x%x, Header: 0x%x, size: %d\n",
-					*rtp_payload, *(rtp_payload + 1), bytes_left);
-			}
-
-			if (bytes_written >= RTP_HEADER_SIZE) {
-				/* We have the marker bits free as well as the header size. */
-				fu_start = readptr - FU_HEADER_SIZE - FU_INDICATOR_SIZE;
-				fu_start[0] = *rtp_payload;
-				fu_start[1] = *(rtp_payload + 1);
-				err = send_packet(fu_start, bytes_left
-					+ FU_HEADER_SIZE + FU_INDICATOR_SIZE,
-					timestamp, 1, private_data);
-			} else {
-				memcpy(rtp_payload + FU_HEADER_SIZE
-					+ FU_INDICATOR_SIZE,
-					readptr, bytes_left);
-				err = send_packet(rtp_payload, bytes_left
-					+ FU_HEADER_SIZE + FU_INDICATOR_SIZE,
-					timestamp, 1, private_data);
-			}
-			bytes_written += bytes_left;
-			if (err) {
-				fprintf(stderr, "Warning: Sending final packet returned %d.\n",
-						err);
-				err = 0;
-			}
+	return send_slice_native(private_data, drm_bo->virtual, stream_size,
+			timestamp, 1);
+}
 
-			send_packages = 0;
-		}
-	}
+static void
+update_benchmark(struct private_data *private_data, int32_t stream_size,
+		int end_of_frame)
+{
+	struct timeval tv;
+	uint32_t time;
 
-	for(i = 0; i < private_data->num_addr; i++) {
-		private_data->socket[i].available = true;
+	gettimeofday(&tv, NULL);
+	time = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	if (private_data->frames == 0)
+		private_data->benchmark_time = time;
+	if (time - private_data->benchmark_time >= (BENCHMARK_INTERVAL * 1000)) {
+		printf("%d frames in %d seconds: %f fps, %f Mb sent\n",
+				private_data->frames,
+				BENCHMARK_INTERVAL,
+				(float) private_data->frames / BENCHMARK_INTERVAL,
+				TO_Mb((float)(private_data->total_stream_size / BENCHMARK_INTERVAL)));
+		private_data->benchmark_time = time;
+		private_data->frames = 0;
+		private_data->total_stream_size = 0;
 	}
-
-	if (private_data->verbose >= 2 || private_data->debug_packetisation) {
-		printf("Packets for frame = %d packets.\n", num_packets);
+	if (end_of_frame) {
+		private_data->frames++;
 	}
-	return 0;
+	private_data->total_stream_size += stream_size;
 }
 
 WL_EXPORT int send_frame(void *plugin_private_data, drm_intel_bo *drm_bo,
 		int32_t stream_size, uint32_t timestamp)
 {
 	struct private_data *private_data = (struct private_data *)plugin_private_data;
-	struct timeval tv;
-	uint32_t time;
 
 	if(!private_data) {
 		return -1;
 	} else {
 
 		if (private_data->verbose) {
-			gettimeofday(&tv, NULL);
-			time = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-			if (private_data->frames == 0)
-				private_data->benchmark_time = time;
-			if (time - private_data->benchmark_time >= (BENCHMARK_INTERVAL * 1000)) {
-				printf("%d frames in %d seconds: %f fps, %f Mb sent\n",
-						private_data->frames,
-						BENCHMARK_INTERVAL,
-						(float) private_data->frames / BENCHMARK_INTERVAL,
-						TO_Mb((float)(private_data->total_stream_size / BENCHMARK_INTERVAL)));
-				private_data->benchmark_time = time;
-				private_data->frames = 0;
-				private_data->total_stream_size = 0;
-			}
-			private_data->frames++;
-			private_data->total_stream_size += stream_size;
+			update_benchmark(private_data, stream_size, 1);
 		}
 
 		return !strcmp(private_data->tp, "gst")
@@ -627,12 +441,83 @@ WL_EXPORT int send_frame(void *plugin_private_data, drm_intel_bo *drm_bo,
 	}
 }
 
+WL_EXPORT int send_slice(void *plugin_private_data, uint8_t *data,
+		int32_t size, uint32_t timestamp, int last)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+	drm_intel_bo bo;
+
+	if (!private_data) {
+		return -1;
+	}
+
+	if (private_data->verbose) {
+		update_benchmark(private_data, size, last);
+	}
+
+	if (!strcmp(private_data->tp, "gst")) {
+		/* appsrc takes any run of whole NAL units */
+		memset(&bo, 0, sizeof(bo));
+		bo.size = size;
+		bo.virtual = data;
+		return send_frame_gst(plugin_private_data, &bo, size, timestamp);
+	}
+
+	return send_slice_native(private_data, data, size, timestamp, last);
+}
+
+
+WL_EXPORT int get_feedback(void *plugin_private_data,
+		struct rate_feedback *feedback)
+{
+	struct private_data *private_data = (struct private_data *)plugin_private_data;
+	struct rtcp_report_block block;
+	uint8_t report[1500];
+	ssize_t n;
+	int i;
+
+	if (!private_data) {
+		return -1;
+	}
+
+	feedback->flags = RATE_FEEDBACK_ERRORS;
+	feedback->packets_sent = private_data->packets_sent;
+	feedback->send_errors = private_data->send_errors;
+
+	if (strcmp(private_data->tp, "native")) {
+		return 0;
+	}
 
+	/* Every client is sent to through the one socket */
+	feedback->flags |= RATE_FEEDBACK_QUEUE;
+	feedback->queue_bytes = udp_fanout_queued(&private_data->fanout);
+	feedback->packets_sent = 0;
+	feedback->send_errors = 0;
+	for (i = 0; i < private_data->fanout.num_dests; i++) {
+		feedback->packets_sent +=
+			private_data->fanout.dests[i].packets_sent;
+		feedback->send_errors +=
+			private_data->fanout.dests[i].send_errors;
+	}
+
+	/* Only the newest report that has come in since last time */
+	while (private_data->rtcp_fd >= 0 &&
+	       (n = recv(private_data->rtcp_fd, report, sizeof(report), 0)) > 0) {
+		if (!rtcp_parse_report(report, n, RTP_SSRC, &block)) {
+			continue;
+		}
+		feedback->flags |= RATE_FEEDBACK_RECEIVER;
+		feedback->fraction_lost = block.fraction_lost;
+		feedback->jitter_us = (uint64_t) block.jitter * 1000000 /
+				RTCP_CLOCK_RATE;
+	}
+
+	return 0;
+}
 
 WL_EXPORT void destroy(void **plugin_private_data)
 {
 	struct private_data *private_data = (struct private_data *)*plugin_private_data;
-	int i;
 
 	if (private_data == NULL) {
 		return;
@@ -646,11 +531,10 @@ WL_EXPORT void destroy(void **plugin_private_data)
 		(void) gst_element_set_state (private_data->pipeline, GST_STATE_NULL);
 		(void) gst_object_unref (GST_OBJECT (private_data->pipeline));
 	} else if(!strcmp(private_data->tp, "native")) {
-		for(i = 0; i < private_data->num_addr; i++) {
-			close(private_data->socket[i].sockDesc);
-			private_data->socket[i].sockDesc = -1;
-			memset(&private_data->socket[i].sockAddr, 0,
-					sizeof(private_data->socket[i].sockAddr));
+		udp_fanout_fini(&private_data->fanout);
+		if (private_data->rtcp_fd >= 0) {
+			close(private_data->rtcp_fd);
+			private_data->rtcp_fd = -1;
 		}
 	}
 
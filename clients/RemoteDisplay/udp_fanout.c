@@ -0,0 +1,309 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/sockios.h>
+
+#include "udp_fanout.h"
+
+static int
+parse_clients(struct udp_fanout *fanout, const char *clients)
+{
+	char *copy, *entry, *save = NULL, *colon;
+	struct udp_fanout_dest *dest;
+	int port;
+
+	copy = strdup(clients);
+	if (!copy) {
+		return -1;
+	}
+
+	for (entry = strtok_r(copy, ",", &save); entry;
+	     entry = strtok_r(NULL, ",", &save)) {
+		if (fanout->num_dests == UDP_FANOUT_MAX_DESTS) {
+			fprintf(stderr, "Too many clients, at most %d.\n",
+					UDP_FANOUT_MAX_DESTS);
+			goto err;
+		}
+
+		colon = strchr(entry, ':');
+		port = colon ? atoi(colon + 1) : 0;
+		if (colon) {
+			*colon = '\0';
+		}
+		dest = &fanout->dests[fanout->num_dests];
+		if (port <= 0 || port > 65535 ||
+		    inet_pton(AF_INET, entry, &dest->addr.sin_addr) != 1) {
+			if (colon) {
+				*colon = ':';
+			}
+			fprintf(stderr, "Invalid client address: %s.\n", entry);
+			goto err;
+		}
+		dest->addr.sin_family = AF_INET;
+		dest->addr.sin_port = htons(port);
+		fanout->num_dests++;
+	}
+
+	free(copy);
+	if (fanout->num_dests == 0) {
+		fprintf(stderr, "No clients given.\n");
+		return -1;
+	}
+	return 0;
+
+err:
+	free(copy);
+	return -1;
+}
+
+static int
+setup_multicast(struct udp_fanout *fanout, int ttl, const char *multicast_if)
+{
+	struct in_addr addr;
+
+	if (ttl <= 0) {
+		ttl = 1;
+	}
+	if (setsockopt(fanout->fd, IPPROTO_IP, IP_MULTICAST_TTL,
+				&ttl, sizeof(ttl)) < 0) {
+		fprintf(stderr, "Failed to set multicast TTL: %m.\n");
+		return -1;
+	}
+
+	if (multicast_if) {
+		if (inet_pton(AF_INET, multicast_if, &addr) != 1 ||
+		    setsockopt(fanout->fd, IPPROTO_IP, IP_MULTICAST_IF,
+				&addr, sizeof(addr)) < 0) {
+			fprintf(stderr, "Failed to send multicast from %s.\n",
+					multicast_if);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+udp_fanout_init(struct udp_fanout *fanout, const char *clients, int ttl,
+		const char *multicast_if, int verbose)
+{
+	/* Don't hold up the frame for a full socket; the packet is lost
+	 * like any other */
+	struct timeval timeout = { 0, 10 };
+	int multicast = 0;
+	int i;
+
+	memset(fanout, 0, sizeof(*fanout));
+	fanout->fd = -1;
+	fanout->verbose = verbose;
+
+	if (parse_clients(fanout, clients) < 0) {
+		return -1;
+	}
+
+	fanout->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+	if (fanout->fd < 0) {
+		fprintf(stderr, "Socket creation failed.\n");
+		return -1;
+	}
+
+	if (setsockopt(fanout->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+				sizeof(timeout)) < 0) {
+		fprintf(stderr, "sendto timeout configuration failed\n");
+	}
+
+	for (i = 0; i < fanout->num_dests; i++) {
+		if (IN_MULTICAST(ntohl(fanout->dests[i].addr.sin_addr.s_addr))) {
+			multicast = 1;
+		}
+	}
+	if (multicast && setup_multicast(fanout, ttl, multicast_if) < 0) {
+		udp_fanout_fini(fanout);
+		return -1;
+	}
+
+	return 0;
+}
+
+void
+udp_fanout_fini(struct udp_fanout *fanout)
+{
+	if (fanout->fd >= 0) {
+		close(fanout->fd);
+	}
+	fanout->fd = -1;
+	fanout->num_dests = 0;
+}
+
+static void
+dest_failed(struct udp_fanout *fanout, int index, int error, uint64_t now_us)
+{
+	struct udp_fanout_dest *dest = &fanout->dests[index];
+	uint64_t delay = UDP_FANOUT_RETRY_MIN_US;
+	uint32_t i;
+
+	dest->send_errors++;
+	dest->failures++;
+	for (i = 1; i < dest->failures && delay < UDP_FANOUT_RETRY_MAX_US; i++) {
+		delay *= 2;
+	}
+	if (delay > UDP_FANOUT_RETRY_MAX_US) {
+		delay = UDP_FANOUT_RETRY_MAX_US;
+	}
+	dest->retry_us = now_us + delay;
+
+	if (fanout->verbose >= 2 || (fanout->verbose && dest->failures == 1)) {
+		fprintf(stderr, "Client %d - Send failed with %s, retrying in "
+				"%d ms\n", index, strerror(error),
+				(int) (delay / 1000));
+	}
+}
+
+static void
+dest_sent(struct udp_fanout *fanout, int index)
+{
+	struct udp_fanout_dest *dest = &fanout->dests[index];
+
+	dest->packets_sent++;
+	if (dest->failures) {
+		if (fanout->verbose) {
+			printf("Client %d - Sending again after %u failures\n",
+					index, dest->failures);
+		}
+		dest->failures = 0;
+	}
+}
+
+/* Errors that say something about the receiver rather than the socket */
+static int
+dest_unreachable(int error)
+{
+	switch (error) {
+	case ENETUNREACH:
+	case EHOSTUNREACH:
+	case EACCES:
+	case EPERM:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+int
+udp_fanout_send(struct udp_fanout *fanout, const void *packet, size_t size,
+		uint64_t now_us)
+{
+	struct mmsghdr msgs[UDP_FANOUT_MAX_DESTS];
+	int index[UDP_FANOUT_MAX_DESTS];
+	struct iovec iov;
+	int count = 0, start = 0, failed = 0;
+	int i, ret, error;
+
+	iov.iov_base = (void *) packet;
+	iov.iov_len = size;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (i = 0; i < fanout->num_dests; i++) {
+		if (fanout->dests[i].failures &&
+		    now_us < fanout->dests[i].retry_us) {
+			continue;
+		}
+		msgs[count].msg_hdr.msg_name = &fanout->dests[i].addr;
+		msgs[count].msg_hdr.msg_namelen = sizeof(fanout->dests[i].addr);
+		msgs[count].msg_hdr.msg_iov = &iov;
+		msgs[count].msg_hdr.msg_iovlen = 1;
+		index[count++] = i;
+	}
+
+	/* sendmmsg() stops at the first message it can't send, and only
+	 * says why if it is the first, so go round again from there */
+	while (start < count) {
+		ret = sendmmsg(fanout->fd, &msgs[start], count - start, 0);
+		if (ret > 0) {
+			for (i = start; i < start + ret; i++) {
+				dest_sent(fanout, index[i]);
+			}
+			start += ret;
+			continue;
+		}
+
+		error = ret < 0 ? errno : EIO;
+		if (error == EAGAIN || error == EWOULDBLOCK ||
+		    error == ENOBUFS || error == EINTR) {
+			/* Every receiver shares the socket, so the packet is
+			 * lost for all those still to go, but none of them is
+			 * to blame */
+			if (fanout->verbose >= 2) {
+				fprintf(stderr, "Send failed with %s, packet lost "
+						"for %d clients\n", strerror(error),
+						count - start);
+			}
+			for (i = start; i < count; i++) {
+				fanout->dests[index[i]].send_errors++;
+			}
+			failed += count - start;
+			break;
+		}
+
+		if (dest_unreachable(error)) {
+			dest_failed(fanout, index[start], error, now_us);
+		} else {
+			fanout->dests[index[start]].send_errors++;
+		}
+		failed++;
+		start++;
+	}
+
+	return failed;
+}
+
+int
+udp_fanout_dest_up(const struct udp_fanout *fanout, int index)
+{
+	return fanout->dests[index].failures == 0;
+}
+
+int
+udp_fanout_queued(const struct udp_fanout *fanout)
+{
+	int queued;
+
+	if (ioctl(fanout->fd, SIOCOUTQ, &queued) < 0) {
+		return 0;
+	}
+
+	return queued;
+}
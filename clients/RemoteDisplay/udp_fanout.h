@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Sends each RTP packet of the UDP transport to every receiver with one
+ * sendmmsg() call on a single socket, so the packet is built once however
+ * many receivers there are. A receiver address may also be a multicast
+ * group, leaving the copies to the network.
+ *
+ * A receiver the network can't reach is left alone for a while rather
+ * than being retried on every packet, backing off further each time it
+ * fails again, and is taken back as soon as a send to it succeeds. A full
+ * socket only loses the packet it was sending.
+ */
+
+#ifndef __REMOTE_DISPLAY_UDP_FANOUT_H__
+#define __REMOTE_DISPLAY_UDP_FANOUT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define UDP_FANOUT_MAX_DESTS	10
+
+/* How long a failed receiver is left before the next try, doubling with
+ * each failure in a row */
+#define UDP_FANOUT_RETRY_MIN_US	10000
+#define UDP_FANOUT_RETRY_MAX_US	1000000
+
+struct udp_fanout_dest {
+	struct sockaddr_in addr;
+
+	/* Failures in a row, and while there are any, when to try again */
+	uint32_t failures;
+	uint64_t retry_us;
+
+	uint32_t packets_sent;
+	uint32_t send_errors;
+};
+
+struct udp_fanout {
+	int fd;
+	int verbose;
+	int num_dests;
+	struct udp_fanout_dest dests[UDP_FANOUT_MAX_DESTS];
+};
+
+/*
+ * Set up sending to "ip:port[,ip:port...]". For multicast groups among
+ * them, ttl (1 if 0) limits how far the packets go and multicast_if, if
+ * not NULL, is the address of the interface to send from. Returns 0, or -1
+ * with a message printed.
+ */
+int
+udp_fanout_init(struct udp_fanout *fanout, const char *clients, int ttl,
+		const char *multicast_if, int verbose);
+
+void
+udp_fanout_fini(struct udp_fanout *fanout);
+
+/* Send one packet to every receiver not waiting out a failure at now_us.
+ * Returns the number of receivers it couldn't be sent to. */
+int
+udp_fanout_send(struct udp_fanout *fanout, const void *packet, size_t size,
+		uint64_t now_us);
+
+/* Returns 1 if the receiver is being sent to */
+int
+udp_fanout_dest_up(const struct udp_fanout *fanout, int index);
+
+/* Bytes waiting in the socket to be sent */
+int
+udp_fanout_queued(const struct udp_fanout *fanout);
+
+#endif /* __REMOTE_DISPLAY_UDP_FANOUT_H__ */
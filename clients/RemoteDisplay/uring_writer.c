@@ -0,0 +1,569 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "uring_writer.h"
+
+enum slot_state {
+	SLOT_FREE,
+	SLOT_FILLING,
+	SLOT_BUSY,	/* write or send in flight */
+	SLOT_NOTIF,	/* zero-copy send done, kernel may still read it */
+};
+
+int
+rd_uring_init(struct rd_uring *ring, unsigned entries)
+{
+	struct io_uring_params params;
+	unsigned *array;
+	unsigned i;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		ring->fd = -1;
+		return -errno;
+	}
+
+	ring->sq_map_size = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned);
+	ring->cq_map_size = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_map_size > ring->sq_map_size) {
+			ring->sq_map_size = ring->cq_map_size;
+		}
+		ring->cq_map_size = ring->sq_map_size;
+	}
+
+	ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_map == MAP_FAILED) {
+		ring->sq_map = NULL;
+		goto err;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_map = ring->sq_map;
+	} else {
+		ring->cq_map = mmap(NULL, ring->cq_map_size,
+				PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_map == MAP_FAILED) {
+			ring->cq_map = NULL;
+			goto err;
+		}
+	}
+
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto err;
+	}
+
+	ring->entries = params.sq_entries;
+	ring->sq_head = (unsigned *)((uint8_t *) ring->sq_map +
+			params.sq_off.head);
+	ring->sq_tail = (unsigned *)((uint8_t *) ring->sq_map +
+			params.sq_off.tail);
+	ring->sq_mask = (unsigned *)((uint8_t *) ring->sq_map +
+			params.sq_off.ring_mask);
+	ring->cq_head = (unsigned *)((uint8_t *) ring->cq_map +
+			params.cq_off.head);
+	ring->cq_tail = (unsigned *)((uint8_t *) ring->cq_map +
+			params.cq_off.tail);
+	ring->cq_mask = (unsigned *)((uint8_t *) ring->cq_map +
+			params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((uint8_t *) ring->cq_map +
+			params.cq_off.cqes);
+	ring->sqe_tail = *ring->sq_tail;
+
+	/* Entries are always used in ring order */
+	array = (unsigned *)((uint8_t *) ring->sq_map + params.sq_off.array);
+	for (i = 0; i < params.sq_entries; i++) {
+		array[i] = i;
+	}
+
+	return 0;
+
+err:
+	i = errno;
+	rd_uring_fini(ring);
+	return -(int) i;
+}
+
+void
+rd_uring_fini(struct rd_uring *ring)
+{
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_map && ring->cq_map != ring->sq_map) {
+		munmap(ring->cq_map, ring->cq_map_size);
+	}
+	if (ring->sq_map) {
+		munmap(ring->sq_map, ring->sq_map_size);
+	}
+	if (ring->fd >= 0) {
+		close(ring->fd);
+	}
+	memset(ring, 0, sizeof(*ring));
+	ring->fd = -1;
+}
+
+int
+rd_uring_op_supported(struct rd_uring *ring, int op)
+{
+	struct io_uring_probe *probe;
+	int supported = 0;
+	const unsigned num_ops = 256;
+
+	probe = calloc(1, sizeof(*probe) +
+			num_ops * sizeof(struct io_uring_probe_op));
+	if (!probe) {
+		return 0;
+	}
+
+	if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE,
+				probe, num_ops) == 0 &&
+	    op <= probe->last_op) {
+		supported = !!(probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+	}
+
+	free(probe);
+	return supported;
+}
+
+struct io_uring_sqe *
+rd_uring_get_sqe(struct rd_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (ring->sqe_tail - head >= ring->entries) {
+		return NULL;
+	}
+
+	sqe = &ring->sqes[ring->sqe_tail & *ring->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sqe_tail++;
+	ring->pending++;
+
+	return sqe;
+}
+
+static int
+uring_enter(struct rd_uring *ring, unsigned to_submit, unsigned wait_nr)
+{
+	int ret;
+
+	do {
+		ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+				wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+
+	return ret < 0 ? -errno : ret;
+}
+
+int
+rd_uring_submit(struct rd_uring *ring, unsigned wait_nr)
+{
+	int ret;
+
+	__atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+	ret = uring_enter(ring, ring->pending, wait_nr);
+	if (ret > 0) {
+		ring->pending -= ret;
+	}
+
+	return ret;
+}
+
+int
+rd_uring_peek_cqe(struct rd_uring *ring, struct io_uring_cqe *cqe)
+{
+	unsigned head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+
+	*cqe = ring->cqes[head & *ring->cq_mask];
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+static void
+writer_complete(struct rd_uring_writer *writer, const struct io_uring_cqe *cqe)
+{
+	struct rd_uring_slot *slot = &writer->slots[cqe->user_data];
+
+	if (cqe->flags & IORING_CQE_F_NOTIF) {
+		slot->state = SLOT_FREE;
+		return;
+	}
+
+	if (writer->op != RD_URING_WRITE) {
+		writer->sends_in_flight--;
+	}
+
+	/* Sends wait for all of the data, and a short write to a file
+	 * means it is full, so anything less is a failure. The rest of a
+	 * chain after a failed send is cancelled. */
+	writer->ops++;
+	if (cqe->res != (int) slot->used) {
+		writer->op_errors++;
+		if (writer->error == 0) {
+			writer->error = cqe->res < 0 ? cqe->res : -EIO;
+		}
+	}
+	writer->bytes_pending -= slot->used;
+
+	/* A zero-copy send that went ahead says so, and the buffer stays
+	 * in use until the notification */
+	slot->state = (cqe->flags & IORING_CQE_F_MORE) ? SLOT_NOTIF : SLOT_FREE;
+}
+
+static void
+writer_reap(struct rd_uring_writer *writer)
+{
+	struct io_uring_cqe cqe;
+
+	while (rd_uring_peek_cqe(&writer->ring, &cqe)) {
+		writer_complete(writer, &cqe);
+	}
+}
+
+static int
+writer_in_flight(const struct rd_uring_writer *writer)
+{
+	int i, count = 0;
+
+	for (i = 0; i < writer->num_slots; i++) {
+		if (writer->slots[i].state == SLOT_BUSY ||
+		    writer->slots[i].state == SLOT_NOTIF) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Submit whatever may be submitted and then, if wait is set and anything
+ * is in flight, wait for a completion. A chain of sends can't start until
+ * the one before has been sent, or a send that had to wait for space in
+ * the socket could be overtaken.
+ */
+static int
+writer_enter(struct rd_uring_writer *writer, int wait)
+{
+	struct rd_uring *ring = &writer->ring;
+	int ordered = writer->op != RD_URING_WRITE;
+	int ret;
+
+	if (ring->pending && !(ordered && writer->sends_in_flight > 0)) {
+		ret = rd_uring_submit(ring, 0);
+		if (ret < 0) {
+			return ret;
+		}
+		if (ordered) {
+			writer->sends_in_flight += ret;
+		}
+	}
+
+	if (wait && (unsigned) writer_in_flight(writer) > ring->pending) {
+		ret = uring_enter(ring, 0, 1);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	writer_reap(writer);
+	return 0;
+}
+
+static int
+writer_get_slot(struct rd_uring_writer *writer)
+{
+	int i, index, ret;
+
+	for (;;) {
+		for (i = 0; i < writer->num_slots; i++) {
+			index = (writer->next_slot + i) % writer->num_slots;
+			if (writer->slots[index].state == SLOT_FREE) {
+				writer->next_slot = (index + 1) % writer->num_slots;
+				writer->slots[index].state = SLOT_FILLING;
+				writer->slots[index].used = 0;
+				return index;
+			}
+		}
+
+		ret = writer_enter(writer, 1);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+}
+
+static int
+writer_prep(struct rd_uring_writer *writer, int index)
+{
+	struct rd_uring_slot *slot = &writer->slots[index];
+	struct io_uring_sqe *sqe;
+
+	sqe = rd_uring_get_sqe(&writer->ring);
+	if (!sqe) {
+		return -EBUSY;
+	}
+
+	sqe->fd = writer->fd;
+	sqe->addr = (uintptr_t) slot->data;
+	sqe->len = slot->used;
+	sqe->user_data = index;
+
+	switch (writer->op) {
+	case RD_URING_WRITE:
+		sqe->opcode = writer->fixed ?
+			IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->off = writer->offset;
+		writer->offset += slot->used;
+		break;
+	case RD_URING_SEND_ZC:
+		sqe->opcode = IORING_OP_SEND_ZC;
+		if (writer->fixed) {
+			sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+		}
+		/* fall through */
+	case RD_URING_SEND:
+		if (writer->op == RD_URING_SEND) {
+			sqe->opcode = IORING_OP_SEND;
+		}
+		sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+		sqe->flags = IOSQE_IO_LINK;
+		break;
+	}
+	if (writer->fixed) {
+		sqe->buf_index = index;
+	}
+
+	slot->state = SLOT_BUSY;
+	return 0;
+}
+
+int
+rd_uring_writer_init(struct rd_uring_writer *writer, int fd,
+		enum rd_uring_op op, int num_slots, size_t slot_size,
+		size_t align, uint64_t offset)
+{
+	struct iovec iov[RD_URING_MAX_SLOTS];
+	size_t pool_align = align > 4096 ? align : 4096;
+	void *pool;
+	int i, ret;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->ring.fd = -1;
+
+	if (num_slots < 1 || num_slots > RD_URING_MAX_SLOTS ||
+	    slot_size == 0 || slot_size > UINT32_MAX ||
+	    (align && (slot_size % align || offset % align))) {
+		return -EINVAL;
+	}
+
+	/* The completion queue is twice the size, enough for the two
+	 * completions of every zero-copy send */
+	ret = rd_uring_init(&writer->ring, num_slots);
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (op == RD_URING_SEND_ZC &&
+	    !rd_uring_op_supported(&writer->ring, IORING_OP_SEND_ZC)) {
+		rd_uring_fini(&writer->ring);
+		return -EOPNOTSUPP;
+	}
+
+	if (posix_memalign(&pool, pool_align, num_slots * slot_size) != 0) {
+		rd_uring_fini(&writer->ring);
+		return -ENOMEM;
+	}
+
+	writer->fd = fd;
+	writer->op = op;
+	writer->pool = pool;
+	writer->num_slots = num_slots;
+	writer->slot_size = slot_size;
+	writer->align = align;
+	writer->offset = offset;
+	writer->filling = -1;
+	for (i = 0; i < num_slots; i++) {
+		writer->slots[i].data = writer->pool + i * slot_size;
+		iov[i].iov_base = writer->slots[i].data;
+		iov[i].iov_len = slot_size;
+	}
+
+	/* Registering pins the pages once rather than on every operation.
+	 * It counts against the locked memory limit on older kernels, so
+	 * carry on without if it fails. */
+	writer->fixed = syscall(__NR_io_uring_register, writer->ring.fd,
+			IORING_REGISTER_BUFFERS, iov, num_slots) == 0;
+
+	return 0;
+}
+
+int
+rd_uring_writer_queue(struct rd_uring_writer *writer, const void *data,
+		size_t size)
+{
+	const uint8_t *bytes = data;
+	struct rd_uring_slot *slot;
+	size_t count;
+	int ret;
+
+	writer_reap(writer);
+	if (writer->error) {
+		return writer->error;
+	}
+
+	while (size > 0) {
+		if (writer->filling < 0) {
+			ret = writer_get_slot(writer);
+			if (ret < 0) {
+				return ret;
+			}
+			writer->filling = ret;
+		}
+
+		slot = &writer->slots[writer->filling];
+		count = writer->slot_size - slot->used;
+		if (count > size) {
+			count = size;
+		}
+		memcpy(slot->data + slot->used, bytes, count);
+		slot->used += count;
+		writer->bytes_pending += count;
+		bytes += count;
+		size -= count;
+
+		if (slot->used == writer->slot_size) {
+			ret = writer_prep(writer, writer->filling);
+			if (ret < 0) {
+				return ret;
+			}
+			writer->filling = -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+rd_uring_writer_submit(struct rd_uring_writer *writer)
+{
+	int ret;
+
+	if (writer->op != RD_URING_WRITE && writer->filling >= 0) {
+		ret = writer_prep(writer, writer->filling);
+		if (ret < 0) {
+			return ret;
+		}
+		writer->filling = -1;
+	}
+
+	/* Sends may have to wait for the previous chain, rather than leave
+	 * this one sitting until the next call */
+	ret = writer_enter(writer, 0);
+	while (ret == 0 && writer->ring.pending > 0) {
+		ret = writer_enter(writer, 1);
+	}
+	if (ret < 0) {
+		return ret;
+	}
+
+	return writer->error;
+}
+
+int
+rd_uring_writer_flush(struct rd_uring_writer *writer)
+{
+	struct rd_uring_slot *slot;
+	uint64_t end = 0;
+	size_t pad;
+	int ret;
+
+	if (writer->filling >= 0) {
+		slot = &writer->slots[writer->filling];
+		if (writer->align && slot->used % writer->align) {
+			pad = writer->align - slot->used % writer->align;
+			end = writer->offset + slot->used;
+			memset(slot->data + slot->used, 0, pad);
+			slot->used += pad;
+			writer->bytes_pending += pad;
+		}
+		ret = writer_prep(writer, writer->filling);
+		if (ret < 0) {
+			return ret;
+		}
+		writer->filling = -1;
+	}
+
+	while (writer->ring.pending > 0 || writer_in_flight(writer) > 0) {
+		ret = writer_enter(writer, 1);
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (end && ftruncate(writer->fd, end) < 0 && writer->error == 0) {
+		writer->error = -errno;
+	}
+
+	return writer->error;
+}
+
+void
+rd_uring_writer_fini(struct rd_uring_writer *writer)
+{
+	if (writer->ring.fd >= 0) {
+		rd_uring_writer_flush(writer);
+		rd_uring_fini(&writer->ring);
+	}
+	free(writer->pool);
+	writer->pool = NULL;
+}
@@ -0,0 +1,171 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * io_uring for the Remote Display transport plugins, on the raw system
+ * calls so that no library is needed.
+ *
+ * A writer owns a pool of buffers registered with the kernel. Data handed
+ * to it is copied into the buffers, which are queued as writes or sends
+ * and submitted together with one system call, so the caller's buffer is
+ * free as soon as the call returns. Each buffer is reused only once the
+ * kernel has finished with it: for a zero-copy send that is when the
+ * notification arrives, not when the send completes.
+ *
+ * Sends on a stream socket keep their order: a batch is submitted as one
+ * linked chain, and only once the previous batch has been sent. Writes to
+ * a file go to explicit offsets, so may complete in any order; with
+ * O_DIRECT only whole aligned blocks are written until the writer is
+ * flushed.
+ */
+
+#ifndef __REMOTE_DISPLAY_URING_WRITER_H__
+#define __REMOTE_DISPLAY_URING_WRITER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+struct rd_uring {
+	int fd;
+	unsigned entries;
+
+	/* Submission queue, with prepared entries not yet submitted */
+	unsigned *sq_head, *sq_tail, *sq_mask;
+	struct io_uring_sqe *sqes;
+	unsigned sqe_tail;
+	unsigned pending;
+
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void *sq_map, *cq_map;
+	size_t sq_map_size, cq_map_size, sqes_size;
+};
+
+/* Returns 0 or a negative errno, -ENOSYS where io_uring isn't available */
+int
+rd_uring_init(struct rd_uring *ring, unsigned entries);
+
+void
+rd_uring_fini(struct rd_uring *ring);
+
+/* Returns 1 if the kernel knows the IORING_OP_* opcode */
+int
+rd_uring_op_supported(struct rd_uring *ring, int op);
+
+/* A cleared submission entry, or NULL if the queue is full */
+struct io_uring_sqe *
+rd_uring_get_sqe(struct rd_uring *ring);
+
+/* Submit the prepared entries and wait for at least wait_nr completions.
+ * Returns the number submitted or a negative errno. */
+int
+rd_uring_submit(struct rd_uring *ring, unsigned wait_nr);
+
+/* Take the next completion, if there is one. Returns 1 if cqe is set. */
+int
+rd_uring_peek_cqe(struct rd_uring *ring, struct io_uring_cqe *cqe);
+
+enum rd_uring_op {
+	RD_URING_WRITE,		/* write to a file at increasing offsets */
+	RD_URING_SEND,		/* send on a stream socket */
+	RD_URING_SEND_ZC,	/* send without copying into the socket */
+};
+
+#define RD_URING_MAX_SLOTS	64
+
+struct rd_uring_slot {
+	int state;
+	uint8_t *data;
+	size_t used;
+};
+
+struct rd_uring_writer {
+	struct rd_uring ring;
+	int fd;
+	enum rd_uring_op op;
+
+	/* Registered buffers, or not if the kernel wouldn't take them */
+	uint8_t *pool;
+	struct rd_uring_slot slots[RD_URING_MAX_SLOTS];
+	int num_slots;
+	size_t slot_size;
+	int fixed;
+
+	/* Slot being filled, or -1, and where to look for a free one next */
+	int filling;
+	int next_slot;
+
+	/* O_DIRECT block size; 0 to write whatever has been queued */
+	size_t align;
+
+	/* Where the next write goes, for RD_URING_WRITE */
+	uint64_t offset;
+
+	/* Sends submitted and not yet complete, and whether the prepared
+	 * entries must wait for them to keep the stream in order */
+	int sends_in_flight;
+
+	/* Bytes queued and not yet completed, the first error seen and the
+	 * totals for feedback */
+	uint64_t bytes_pending;
+	int error;
+	uint32_t ops, op_errors;
+};
+
+/*
+ * Set up a writer for fd with num_slots buffers of slot_size bytes. For
+ * RD_URING_WRITE, writing starts at offset; a non-zero align means fd was
+ * opened with O_DIRECT, and slot_size and offset must be multiples of it.
+ * Returns 0 or a negative errno.
+ */
+int
+rd_uring_writer_init(struct rd_uring_writer *writer, int fd,
+		enum rd_uring_op op, int num_slots, size_t slot_size,
+		size_t align, uint64_t offset);
+
+/* Copy data into the buffers, queueing each as it fills. Blocks only while
+ * every buffer is still in use. Returns 0 or a negative errno, including
+ * any error from earlier writes or sends. */
+int
+rd_uring_writer_queue(struct rd_uring_writer *writer, const void *data,
+		size_t size);
+
+/* Submit what has been queued. Sends also take the partly filled buffer,
+ * so the receiver gets everything queued so far. */
+int
+rd_uring_writer_submit(struct rd_uring_writer *writer);
+
+/* Write or send everything and wait for the kernel to finish with it. An
+ * O_DIRECT file is padded to a whole block and then truncated back. */
+int
+rd_uring_writer_flush(struct rd_uring_writer *writer);
+
+/* Flush, and free everything but fd */
+void
+rd_uring_writer_fini(struct rd_uring_writer *writer);
+
+#endif /* __REMOTE_DISPLAY_URING_WRITER_H__ */
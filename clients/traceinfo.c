@@ -47,6 +47,8 @@ struct wayland {
 	struct wl_display *display;
 	struct wl_registry *registry;
 	struct trace_reporter *reporter;
+	uint32_t reporter_version;
+	int latency;
 };
 
 struct trace_event {
@@ -226,10 +228,16 @@ static void
 trace_reporter_trace_end(void *data,
 		struct trace_reporter *reporter)
 {
+	struct wayland *w = data;
 	struct trace_event *ev = first_event;
 	struct trace_event *child;
 	struct timeval *prevtime;
 
+	/* Latency histograms were already printed as they arrived */
+	if (w->latency) {
+		return;
+	}
+
 	if (!ev) {
 		printf("No timing information logged.\n");
 		return;
@@ -257,9 +265,48 @@ trace_reporter_trace_end(void *data,
 	}
 }
 
+/*
+ * trace_reporter_latency_histogram()
+ *
+ * Print the histogram of one input latency stage.  Buckets are on a log2
+ * scale in microseconds; only non-empty buckets are shown.
+ */
+static void
+trace_reporter_latency_histogram(void *data,
+		struct trace_reporter *reporter,
+		uint32_t stage,
+		const char *name,
+		uint32_t count,
+		uint32_t mean_usec,
+		uint32_t max_usec,
+		struct wl_array *buckets)
+{
+	uint32_t *bucket;
+	unsigned int i = 0;
+	unsigned int nbuckets = buckets->size / sizeof *bucket;
+
+	printf("%s: %u samples, mean %uus, max %uus\n",
+			name, count, mean_usec, max_usec);
+
+	wl_array_for_each(bucket, buckets) {
+		if (*bucket) {
+			if (i == 0) {
+				printf("  %10s <1us  %u\n", "", *bucket);
+			} else if (i == nbuckets - 1) {
+				printf("  %10u+us   %u\n", 1u << (i - 1), *bucket);
+			} else {
+				printf("  %10u-%uus  %u\n",
+						1u << (i - 1), 1u << i, *bucket);
+			}
+		}
+		i++;
+	}
+}
+
 static const struct trace_reporter_listener listener = {
 	trace_reporter_tracepoint,
 	trace_reporter_trace_end,
+	trace_reporter_latency_histogram,
 };
 
 /*
@@ -275,10 +322,11 @@ display_handle_global(void *data, struct wl_registry *registry, uint32_t id,
 	struct wayland *w = data;
 
 	if (!strcmp(interface, "trace_reporter")) {
+		w->reporter_version = version < 2 ? version : 2;
 		w->reporter = wl_registry_bind(registry,
 				id,
 				&trace_reporter_interface,
-				1);
+				w->reporter_version);
 		trace_reporter_add_listener(w->reporter, &listener, w);
 	}
 }
@@ -297,17 +345,20 @@ main(int argc, char **argv)
 	/* cmdline options */
 	int32_t dump_stdout = 0;
 	int32_t clear = 0;
+	int32_t latency = 0;
 
 	const struct weston_option options[] = {
 		{ WESTON_OPTION_BOOLEAN, "stdout", 0, &dump_stdout },
 		{ WESTON_OPTION_BOOLEAN, "clear", 'c', &clear },
+		{ WESTON_OPTION_BOOLEAN, "latency", 'l', &latency },
 	};
 
 	remaining_argc = parse_options(options, ARRAY_LENGTH(options), &argc, argv);
 
-	if (remaining_argc > 1 || argc > 3) {
+	if (remaining_argc > 1 || argc > 4) {
 		printf("Usage:\n");
-		printf("  traceinfo [--dump-stdout] [--clear | -c]\n");
+		printf("  traceinfo [--dump-stdout] [--clear | -c] "
+				"[--latency | -l]\n");
 
 		return -1;
 	}
@@ -337,7 +388,16 @@ main(int argc, char **argv)
 		clearmode = TRACE_REPORTER_LOG_REPORT_PRESERVE;
 	}
 
-	if (dump_stdout) {
+	if (latency) {
+		if (wayland.reporter_version < 2) {
+			fprintf(stderr, "Compositor does not report input latency\n");
+			wl_display_disconnect(wayland.display);
+			return -1;
+		}
+
+		wayland.latency = 1;
+		trace_reporter_latency_report(wayland.reporter, clearmode);
+	} else if (dump_stdout) {
 		trace_reporter_stdout_report(wayland.reporter, clearmode);
 	} else {
 		trace_reporter_event_report(wayland.reporter, clearmode);
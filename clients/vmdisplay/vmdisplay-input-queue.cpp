@@ -0,0 +1,153 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: vmdisplay-input-queue.cpp
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Single producer/single consumer queue handing input events from the
+ *   vmdisplay-input socket reader to the thread injecting them into uinput
+ *-----------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "vmdisplay-input-queue.h"
+
+#define VMDISPLAY_INPUT_QUEUE_MASK (VMDISPLAY_INPUT_QUEUE_SIZE - 1)
+
+/*
+ * data_fd is created here and woken by the producer. space_fd belongs to the
+ * producer (it usually also uses it to be told to stop) and is only written.
+ */
+int InputEventQueue::init(int producer_fd)
+{
+	data_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (data_fd < 0) {
+		printf("Cannot create input queue eventfd\n");
+		return -1;
+	}
+
+	space_fd = producer_fd;
+
+	return 0;
+}
+
+void InputEventQueue::cleanup()
+{
+	if (data_fd >= 0) {
+		close(data_fd);
+		data_fd = -1;
+	}
+
+	space_fd = -1;
+}
+
+bool InputEventQueue::push(const struct vmdisplay_input_event &event)
+{
+	uint32_t h = head.load(std::memory_order_relaxed);
+	uint32_t t = tail.load(std::memory_order_acquire);
+	unsigned int depth;
+
+	if (h - t == VMDISPLAY_INPUT_QUEUE_SIZE)
+		return false;
+
+	events[h & VMDISPLAY_INPUT_QUEUE_MASK] = event;
+	head.store(h + 1, std::memory_order_seq_cst);
+
+	/* Pairs with the store in want_data(): either the consumer sees
+	 * the new head there, or we see that it is about to sleep. */
+	if (data_wanted.load(std::memory_order_seq_cst) &&
+	    data_wanted.exchange(false))
+		eventfd_write(data_fd, 1);
+
+	depth = h + 1 - t;
+	if (depth > max_depth.load(std::memory_order_relaxed))
+		max_depth.store(depth, std::memory_order_relaxed);
+	queued.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+bool InputEventQueue::want_space()
+{
+	space_wanted.store(true, std::memory_order_seq_cst);
+
+	if (head.load(std::memory_order_relaxed) -
+	    tail.load(std::memory_order_seq_cst) < VMDISPLAY_INPUT_QUEUE_SIZE) {
+		space_wanted.store(false, std::memory_order_relaxed);
+		return false;
+	}
+
+	stalls.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+unsigned int InputEventQueue::pop(struct vmdisplay_input_event *out,
+				  unsigned int max_events)
+{
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t h = head.load(std::memory_order_acquire);
+	unsigned int count = 0;
+
+	while (t != h && count < max_events)
+		out[count++] = events[t++ & VMDISPLAY_INPUT_QUEUE_MASK];
+
+	if (count == 0)
+		return 0;
+
+	tail.store(t, std::memory_order_seq_cst);
+
+	if (space_wanted.load(std::memory_order_seq_cst) &&
+	    space_wanted.exchange(false))
+		eventfd_write(space_fd, 1);
+
+	return count;
+}
+
+bool InputEventQueue::want_data()
+{
+	data_wanted.store(true, std::memory_order_seq_cst);
+
+	if (head.load(std::memory_order_seq_cst) !=
+	    tail.load(std::memory_order_relaxed)) {
+		data_wanted.store(false, std::memory_order_relaxed);
+		return false;
+	}
+
+	return true;
+}
+
+void InputEventQueue::get_stats(struct vmdisplay_input_queue_stats *stats) const
+{
+	uint32_t t = tail.load(std::memory_order_relaxed);
+	uint32_t h = head.load(std::memory_order_relaxed);
+
+	stats->depth = h - t;
+	stats->max_depth = max_depth.load(std::memory_order_relaxed);
+	stats->queued = queued.load(std::memory_order_relaxed);
+	stats->stalls = stalls.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,108 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: vmdisplay-input-queue.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Single producer/single consumer queue handing input events from the
+ *   vmdisplay-input socket reader to the thread injecting them into uinput
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _VMDISPLAY_INPUT_QUEUE_H_
+#define _VMDISPLAY_INPUT_QUEUE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "vmdisplay-shared.h"
+
+/* Must be a power of two */
+#define VMDISPLAY_INPUT_QUEUE_SIZE 256
+
+struct vmdisplay_input_event {
+	struct vmdisplay_input_event_header header;
+	union {
+		struct vmdisplay_touch_event touch;
+		struct vmdisplay_key_event key;
+		struct vmdisplay_pointer_event pointer;
+	};
+};
+
+struct vmdisplay_input_queue_stats {
+	unsigned int depth;
+	unsigned int max_depth;
+	uint64_t queued;
+	uint64_t stalls;
+};
+
+/*
+ * The reader thread is the only producer and the dispatch thread the only
+ * consumer, so head and tail each have a single writer and no lock is
+ * needed. Neither side polls the ring: before sleeping, a side announces it
+ * with want_data() or want_space() and the other side writes to its eventfd
+ * on the next push() or pop(). Both return false if the ring changed in the
+ * meantime, in which case the caller must not sleep.
+ */
+class InputEventQueue {
+public:
+	InputEventQueue():head(0), tail(0), data_wanted(false),
+	    space_wanted(false), data_fd(-1), space_fd(-1),
+	    max_depth(0), queued(0), stalls(0) {
+	};
+	int init(int space_fd);
+	void cleanup();
+
+	/* Producer side */
+	bool push(const struct vmdisplay_input_event &event);
+	bool want_space();
+
+	/* Consumer side */
+	unsigned int pop(struct vmdisplay_input_event *events,
+			 unsigned int max_events);
+	bool want_data();
+	int get_data_fd() const {
+		return data_fd;
+	};
+
+	void get_stats(struct vmdisplay_input_queue_stats *stats) const;
+private:
+	struct vmdisplay_input_event events[VMDISPLAY_INPUT_QUEUE_SIZE];
+
+	/* Written by the producer only */
+	alignas(64) std::atomic<uint32_t> head;
+	/* Written by the consumer only */
+	alignas(64) std::atomic<uint32_t> tail;
+
+	std::atomic<bool> data_wanted;
+	std::atomic<bool> space_wanted;
+	int data_fd;
+	int space_fd;
+
+	std::atomic<unsigned int> max_depth;
+	std::atomic<uint64_t> queued;
+	std::atomic<uint64_t> stalls;
+};
+
+#endif // _VMDISPLAY_INPUT_QUEUE_H_
@@ -35,6 +35,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <strings.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -44,7 +47,9 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/eventfd.h>
 #include <vector>
+#include <atomic>
 #include <pthread.h>
 #include <linux/input.h>
 #include <linux/uinput.h>
@@ -52,6 +57,14 @@
 #include "vmdisplay-shared.h"
 #include "vmdisplay-server.h"
 #include "vmdisplay-server-network.h"
+#include "vmdisplay-input-queue.h"
+
+/* Touch ids below this have their motion coalesced, matching ABS_MT_SLOT */
+#define VMDISPLAY_INPUT_TOUCH_SLOTS 8
+#define VMDISPLAY_INPUT_DISPATCH_MAX 64
+#define UINPUT_FRAME_MAX 32
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
 typedef int32_t wl_fixed_t;
 
@@ -67,10 +80,63 @@ static inline double wl_fixed_to_double(wl_fixed_t f)
 	return u.d - (3LL << 43);
 }
 
+struct uinput_frame {
+	struct input_event events[UINPUT_FRAME_MAX];
+	unsigned int count;
+};
+
+static void frame_add(struct uinput_frame *frame,
+		      uint16_t type, uint16_t code, int32_t value)
+{
+	struct input_event *ev = &frame->events[frame->count++];
+
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+/* Terminate the frame with SYN_REPORT and hand it to uinput in one write */
+static ssize_t frame_send(int fd, struct uinput_frame *frame)
+{
+	frame_add(frame, EV_SYN, SYN_REPORT, 0);
+
+	return write(fd, frame->events,
+		     frame->count * sizeof(frame->events[0]));
+}
+
+static bool is_coalescable_motion(const struct vmdisplay_input_event &event)
+{
+	switch (event.header.type) {
+	case VMDISPLAY_POINTER_EVENT:
+		return event.pointer.type == VMDISPLAY_POINTER_MOTION;
+	case VMDISPLAY_TOUCH_EVENT:
+		return event.touch.type == VMDISPLAY_TOUCH_MOTION &&
+		    event.touch.id < VMDISPLAY_INPUT_TOUCH_SLOTS;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Events are received on a reader thread and injected into uinput from
+ * run(), with an InputEventQueue in between, so a slow injection never
+ * leaves the socket undrained and a burst of input never stalls the reader.
+ *
+ * Pointer motion and touch motion are only positions, so both sides may
+ * replace one with a newer one: the reader when the queue is full (counted
+ * as dropped), the dispatcher while draining a backlog (counted as
+ * coalesced). Held motion is always sent before the next event of any
+ * other kind, so keys, buttons, axis and touch down/up keep their order
+ * and position; the reader blocks rather than drop them.
+ */
 class VMDisplayInput {
 public:
 	VMDisplayInput():hyper_comm_input(NULL),
-	    running(false),
+	    running(false), reader_started(false), reader_wake_fd(-1),
+	    reader_pointer_pending(false), reader_touch_pending(0),
+	    dropped(0), pointer_motion_pending(false),
+	    touch_motion_pending(0), coalesced(0), stats_requested(false),
 	    uinput_touch_fd(-1), uinput_keyboard_fd(-1), uinput_pointer_fd(-1) {
 	};
 	int init(int domid, CommunicationChannelType comm_type,
@@ -78,16 +144,51 @@ public:
 	int cleanup();
 	int run();
 	void stop();
+	void read_events();
+	void request_stats();
 private:
+	int recv_event(struct vmdisplay_input_event &event);
+	void queue_event(const struct vmdisplay_input_event &event);
+	void hold_motion(const struct vmdisplay_input_event &event);
+	bool flush_held_motion();
+	void retry_held_motion();
+	void wait_for_space();
+
+	void dispatch_event(const struct vmdisplay_input_event &event);
+	void flush_motion();
+	void print_stats();
+
 	void handle_touch_event(const vmdisplay_touch_event & event);
 	void handle_key_event(const vmdisplay_key_event & event);
 	void handle_pointer_event(const vmdisplay_pointer_event & event);
 	int init_touch();
 	int init_keyboard();
-	int inti_pointer();
+	int init_pointer();
 
 	HyperCommunicatorInterface *hyper_comm_input;
-	bool running;
+	std::atomic<bool> running;
+
+	InputEventQueue queue;
+	pthread_t reader_thread;
+	bool reader_started;
+	int reader_wake_fd;
+
+	/* Reader thread only: motion waiting for room in the queue */
+	struct vmdisplay_input_event reader_pointer;
+	bool reader_pointer_pending;
+	struct vmdisplay_input_event reader_touch[VMDISPLAY_INPUT_TOUCH_SLOTS];
+	uint32_t reader_touch_pending;
+	std::atomic<uint64_t> dropped;
+
+	/* Dispatch thread only: motion not yet written to uinput */
+	struct vmdisplay_pointer_event pointer_motion;
+	bool pointer_motion_pending;
+	struct vmdisplay_touch_event touch_motion[VMDISPLAY_INPUT_TOUCH_SLOTS];
+	uint32_t touch_motion_pending;
+	uint64_t coalesced;
+
+	std::atomic<bool> stats_requested;
+
 	int uinput_touch_fd;
 	int uinput_keyboard_fd;
 	int uinput_pointer_fd;
@@ -144,7 +245,6 @@ int VMDisplayInput::init_touch()
 
 int VMDisplayInput::init_keyboard()
 {
-	int uinput_keyboard_fd;
 	struct uinput_user_dev uidev;
 
 	uinput_keyboard_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
@@ -174,9 +274,8 @@ int VMDisplayInput::init_keyboard()
 	return 0;
 }
 
-static int init_pointer()
+int VMDisplayInput::init_pointer()
 {
-	int uinput_pointer_fd;
 	struct uinput_user_dev uidev;
 
 	uinput_pointer_fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
@@ -220,9 +319,20 @@ static int init_pointer()
 	return 0;
 }
 
+static void *reader_thread_func(void *arg)
+{
+	VMDisplayInput *input = (VMDisplayInput *) arg;
+
+	input->read_events();
+
+	return NULL;
+}
+
 int VMDisplayInput::init(int domid, CommunicationChannelType comm_type,
 			 const char *comm_args)
 {
+	sigset_t signals, saved_signals;
+
 	switch (comm_type) {
 	case CommunicationChannelNetwork:
 		hyper_comm_input = new NetworkCommunicator();
@@ -238,6 +348,12 @@ int VMDisplayInput::init(int domid, CommunicationChannelType comm_type,
 		return -1;
 	}
 
+	if (hyper_comm_input->get_fd() < 0) {
+		printf("Input channel cannot be polled\n");
+		cleanup();
+		return -1;
+	}
+
 	if (init_touch()) {
 		printf("Cannot initialize touch device\n");
 		cleanup();
@@ -256,19 +372,59 @@ int VMDisplayInput::init(int domid, CommunicationChannelType comm_type,
 		return -1;
 	}
 
+	reader_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (reader_wake_fd < 0 || queue.init(reader_wake_fd)) {
+		printf("Cannot initialize input queue\n");
+		cleanup();
+		return -1;
+	}
+
 	running = true;
 
+	/* Leave signals to the dispatch thread, so the reader's recv() is
+	 * never interrupted halfway through an event */
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, &saved_signals);
+	if (pthread_create(&reader_thread, NULL, reader_thread_func, this)) {
+		pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+		printf("Cannot start input reader thread\n");
+		running = false;
+		cleanup();
+		return -1;
+	}
+	pthread_sigmask(SIG_SETMASK, &saved_signals, NULL);
+	reader_started = true;
+
 	return 0;
 }
 
 int VMDisplayInput::cleanup()
 {
+	stop();
+
+	if (reader_started) {
+		/* The wake fd only reaches the reader in poll(); it may be
+		 * blocked in recv() partway through an event instead */
+		if (hyper_comm_input && hyper_comm_input->get_fd() >= 0)
+			shutdown(hyper_comm_input->get_fd(), SHUT_RDWR);
+
+		pthread_join(reader_thread, NULL);
+		reader_started = false;
+	}
+
 	if (hyper_comm_input) {
 		hyper_comm_input->cleanup();
 		delete hyper_comm_input;
 		hyper_comm_input = NULL;
 	}
 
+	queue.cleanup();
+
+	if (reader_wake_fd >= 0) {
+		close(reader_wake_fd);
+		reader_wake_fd = -1;
+	}
+
 	if (uinput_pointer_fd >= 0) {
 		ioctl(uinput_pointer_fd, UI_DEV_DESTROY);
 		close(uinput_pointer_fd);
@@ -290,245 +446,384 @@ int VMDisplayInput::cleanup()
 	return 0;
 }
 
+static void add_touch_motion(struct uinput_frame *frame,
+			     const vmdisplay_touch_event & event)
+{
+	frame_add(frame, EV_ABS, ABS_MT_SLOT, event.id);
+	frame_add(frame, EV_ABS, ABS_MT_POSITION_X,
+		  wl_fixed_to_double(event.x));
+	frame_add(frame, EV_ABS, ABS_MT_POSITION_Y,
+		  wl_fixed_to_double(event.y));
+}
+
 void VMDisplayInput::handle_touch_event(const vmdisplay_touch_event & event)
 {
-	struct input_event ev;
-	float x, y;
-        ssize_t ret;
+	struct uinput_frame frame;
+
+	frame.count = 0;
 
 	switch (event.type) {
 	case VMDISPLAY_TOUCH_DOWN:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_SLOT;
-		ev.value = event.id;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_TRACKING_ID;
-		ev.value = event.id;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		x = wl_fixed_to_double(event.x);
-		y = wl_fixed_to_double(event.y);
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_POSITION_X;
-		ev.value = wl_fixed_to_double(event.x);
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_POSITION_Y;
-		ev.value = wl_fixed_to_double(event.y);
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
+		frame_add(&frame, EV_ABS, ABS_MT_SLOT, event.id);
+		frame_add(&frame, EV_ABS, ABS_MT_TRACKING_ID, event.id);
+		frame_add(&frame, EV_ABS, ABS_MT_POSITION_X,
+			  wl_fixed_to_double(event.x));
+		frame_add(&frame, EV_ABS, ABS_MT_POSITION_Y,
+			  wl_fixed_to_double(event.y));
 		break;
 
 	case VMDISPLAY_TOUCH_UP:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_SLOT;
-		ev.value = event.id;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_TRACKING_ID;
-		ev.value = -1;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
+		frame_add(&frame, EV_ABS, ABS_MT_SLOT, event.id);
+		frame_add(&frame, EV_ABS, ABS_MT_TRACKING_ID, -1);
 		break;
 
 	case VMDISPLAY_TOUCH_MOTION:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_SLOT;
-		ev.value = event.id;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_POSITION_X;
-		ev.value = wl_fixed_to_double(event.x);
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_MT_POSITION_Y;
-		ev.value = wl_fixed_to_double(event.y);
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_touch_fd, &ev, sizeof(ev));
-
+		add_touch_motion(&frame, event);
 		break;
+
+	default:
+		return;
 	}
-    if (ret < 0)
-        printf("failed to handle input touch event\n");
+
+	if (frame_send(uinput_touch_fd, &frame) < 0)
+		printf("failed to handle input touch event\n");
 }
 
 void VMDisplayInput::handle_key_event(const vmdisplay_key_event & event)
 {
-	struct input_event ev;
-        ssize_t ret;
+	struct uinput_frame frame;
+
+	frame.count = 0;
 
 	switch (event.type) {
 	case VMDISPLAY_KEY_KEY:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_KEY;
-		ev.code = event.key;
-		ev.value = event.state;
-		ret = write(uinput_keyboard_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_keyboard_fd, &ev, sizeof(ev));
-
+		frame_add(&frame, EV_KEY, event.key, event.state);
 		break;
+
+	default:
+		return;
 	}
-        if (ret < 0)
-            printf("failed to handle input key event\n");
 
+	if (frame_send(uinput_keyboard_fd, &frame) < 0)
+		printf("failed to handle input key event\n");
 }
 
 void VMDisplayInput::handle_pointer_event(const vmdisplay_pointer_event & event)
 {
-	struct input_event ev;
-        ssize_t ret = 0;
+	struct uinput_frame frame;
+
+	frame.count = 0;
 
 	switch (event.type) {
 	case VMDISPLAY_POINTER_BUTTON:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_MSC;
-		ev.code = MSC_SCAN;
-		ev.value = 90001;
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_KEY;
-		ev.code = event.button;
-		ev.value = event.state;
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
+		frame_add(&frame, EV_MSC, MSC_SCAN, 90001);
+		frame_add(&frame, EV_KEY, event.button, event.state);
 		break;
 
 	case VMDISPLAY_POINTER_MOTION:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_X;
-		ev.value = wl_fixed_to_double(event.x);
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_ABS;
-		ev.code = ABS_Y;
-		ev.value = wl_fixed_to_double(event.y);
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
+		frame_add(&frame, EV_ABS, ABS_X, wl_fixed_to_double(event.x));
+		frame_add(&frame, EV_ABS, ABS_Y, wl_fixed_to_double(event.y));
 		break;
 
 	case VMDISPLAY_POINTER_AXIS:
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_REL;
-		ev.code = REL_WHEEL;
-		ev.value = event.value;
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
-		memset(&ev, 0, sizeof(ev));
-		ev.type = EV_SYN;
-		ev.code = 0;
-		ev.value = 0;
-		ret = write(uinput_pointer_fd, &ev, sizeof(ev));
-
+		frame_add(&frame, EV_REL, REL_WHEEL, event.value);
 		break;
+
+	default:
+		return;
 	}
-    if (ret < 0)
-        printf("failed to handle input pointer event\n");
+
+	if (frame_send(uinput_pointer_fd, &frame) < 0)
+		printf("failed to handle input pointer event\n");
 }
 
-int VMDisplayInput::run()
+static int recv_full(HyperCommunicatorInterface *comm, void *data, int len)
+{
+	char *p = (char *)data;
+	int ret;
+
+	while (len > 0) {
+		ret = comm->recv_data(p, len);
+		if (ret < 0)
+			return -1;
+
+		p += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+int VMDisplayInput::recv_event(struct vmdisplay_input_event &event)
 {
-	struct vmdisplay_input_event_header header;
-	struct vmdisplay_touch_event touch_event;
-	struct vmdisplay_key_event key_event;
-	struct vmdisplay_pointer_event pointer_event;
-	int ret = -1;
+	const uint32_t max_size = sizeof(event) - sizeof(event.header);
+
+	if (recv_full(hyper_comm_input, &event.header, sizeof(event.header)))
+		return -1;
+
+	if (event.header.size > max_size) {
+		printf("Invalid input event size %u\n", event.header.size);
+		return -1;
+	}
+
+	memset(&event.touch, 0, max_size);
+
+	return recv_full(hyper_comm_input, &event.touch, event.header.size);
+}
+
+void VMDisplayInput::hold_motion(const struct vmdisplay_input_event &event)
+{
+	uint32_t slot;
+
+	if (event.header.type == VMDISPLAY_POINTER_EVENT) {
+		if (reader_pointer_pending)
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		reader_pointer = event;
+		reader_pointer_pending = true;
+	} else {
+		slot = 1u << event.touch.id;
+		if (reader_touch_pending & slot)
+			dropped.fetch_add(1, std::memory_order_relaxed);
+		reader_touch[event.touch.id] = event;
+		reader_touch_pending |= slot;
+	}
+}
+
+/* Returns true once no motion is held back any more */
+bool VMDisplayInput::flush_held_motion()
+{
+	int id;
+
+	if (reader_pointer_pending) {
+		if (!queue.push(reader_pointer))
+			return false;
+		reader_pointer_pending = false;
+	}
+
+	while (reader_touch_pending) {
+		id = ffs(reader_touch_pending) - 1;
+		if (!queue.push(reader_touch[id]))
+			return false;
+		reader_touch_pending &= ~(1u << id);
+	}
+
+	return true;
+}
+
+/* Queue what fits now and get woken up for the rest */
+void VMDisplayInput::retry_held_motion()
+{
+	while (!flush_held_motion()) {
+		if (queue.want_space())
+			return;
+	}
+}
+
+void VMDisplayInput::wait_for_space()
+{
+	struct pollfd fd = { reader_wake_fd, POLLIN, 0 };
+	eventfd_t count;
+
+	while (poll(&fd, 1, -1) < 0 && errno == EINTR)
+		;
+
+	eventfd_read(reader_wake_fd, &count);
+}
+
+void VMDisplayInput::queue_event(const struct vmdisplay_input_event &event)
+{
+	if (is_coalescable_motion(event)) {
+		if (!reader_pointer_pending && !reader_touch_pending &&
+		    queue.push(event))
+			return;
+
+		hold_motion(event);
+		retry_held_motion();
+		return;
+	}
+
+	while (running) {
+		if (flush_held_motion() && queue.push(event))
+			return;
+
+		if (queue.want_space())
+			wait_for_space();
+	}
+}
+
+void VMDisplayInput::read_events()
+{
+	struct vmdisplay_input_event event;
+	struct pollfd fds[2];
+	eventfd_t count;
+
+	fds[0].fd = hyper_comm_input->get_fd();
+	fds[0].events = POLLIN;
+	fds[1].fd = reader_wake_fd;
+	fds[1].events = POLLIN;
 
 	while (running) {
-		if (hyper_comm_input) {
-			ret =
-			    hyper_comm_input->recv_data(&header,
-							sizeof(header));
-
-			if (ret < 0) {
-				printf("Lost connection with server\n");
-				running = false;
+		if (poll(fds, ARRAY_LENGTH(fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents & POLLIN)
+			eventfd_read(reader_wake_fd, &count);
+
+		if (!running)
+			break;
+
+		if (reader_pointer_pending || reader_touch_pending)
+			retry_held_motion();
+
+		if (fds[0].revents) {
+			if (recv_event(event)) {
+				if (running)
+					printf("Lost connection with server\n");
 				break;
 			}
 
-			switch (header.type) {
-			case VMDISPLAY_TOUCH_EVENT:
-				ret =
-				    hyper_comm_input->recv_data(&touch_event,
-								header.size);
-				handle_touch_event(touch_event);
-				break;
-			case VMDISPLAY_KEY_EVENT:
-				ret =
-				    hyper_comm_input->recv_data(&key_event,
-								header.size);
-				handle_key_event(key_event);
-				break;
-			case VMDISPLAY_POINTER_EVENT:
-				ret =
-				    hyper_comm_input->recv_data(&pointer_event,
-								header.size);
-				handle_pointer_event(pointer_event);
-				break;
-			default:
-				printf("Unknown event type\n");
+			queue_event(event);
+		}
+	}
+
+	running = false;
+	eventfd_write(queue.get_data_fd(), 1);
+}
+
+void VMDisplayInput::flush_motion()
+{
+	struct uinput_frame frame;
+	int id;
+
+	if (pointer_motion_pending) {
+		handle_pointer_event(pointer_motion);
+		pointer_motion_pending = false;
+	}
+
+	if (touch_motion_pending) {
+		frame.count = 0;
+		while (touch_motion_pending) {
+			id = ffs(touch_motion_pending) - 1;
+			add_touch_motion(&frame, touch_motion[id]);
+			touch_motion_pending &= ~(1u << id);
+		}
+
+		if (frame_send(uinput_touch_fd, &frame) < 0)
+			printf("failed to handle input touch event\n");
+	}
+}
+
+void VMDisplayInput::dispatch_event(const struct vmdisplay_input_event &event)
+{
+	uint32_t slot;
+
+	if (is_coalescable_motion(event)) {
+		if (event.header.type == VMDISPLAY_POINTER_EVENT) {
+			if (pointer_motion_pending)
+				coalesced++;
+			pointer_motion = event.pointer;
+			pointer_motion_pending = true;
+		} else {
+			slot = 1u << event.touch.id;
+			if (touch_motion_pending & slot)
+				coalesced++;
+			touch_motion[event.touch.id] = event.touch;
+			touch_motion_pending |= slot;
+		}
+		return;
+	}
+
+	flush_motion();
+
+	switch (event.header.type) {
+	case VMDISPLAY_TOUCH_EVENT:
+		handle_touch_event(event.touch);
+		break;
+	case VMDISPLAY_KEY_EVENT:
+		handle_key_event(event.key);
+		break;
+	case VMDISPLAY_POINTER_EVENT:
+		handle_pointer_event(event.pointer);
+		break;
+	default:
+		printf("Unknown event type\n");
+		break;
+	}
+}
+
+void VMDisplayInput::print_stats()
+{
+	struct vmdisplay_input_queue_stats stats;
+
+	queue.get_stats(&stats);
+
+	printf("Input queue: depth %u, max depth %u/%u, queued %" PRIu64
+	       ", reader stalls %" PRIu64 ", motion dropped %" PRIu64
+	       ", motion coalesced %" PRIu64 "\n",
+	       stats.depth, stats.max_depth, VMDISPLAY_INPUT_QUEUE_SIZE,
+	       stats.queued, stats.stalls,
+	       dropped.load(std::memory_order_relaxed), coalesced);
+}
+
+int VMDisplayInput::run()
+{
+	struct vmdisplay_input_event events[VMDISPLAY_INPUT_DISPATCH_MAX];
+	struct pollfd fd;
+	unsigned int count, i;
+	eventfd_t value;
+
+	fd.fd = queue.get_data_fd();
+	fd.events = POLLIN;
+
+	while (running) {
+		if (stats_requested.exchange(false))
+			print_stats();
+
+		count = queue.pop(events, ARRAY_LENGTH(events));
+		if (count == 0) {
+			if (!queue.want_data())
+				continue;
+
+			if (poll(&fd, 1, -1) < 0 && errno != EINTR)
 				break;
-			}
+
+			if (fd.revents & POLLIN)
+				eventfd_read(fd.fd, &value);
+			continue;
 		}
+
+		for (i = 0; i < count; i++)
+			dispatch_event(events[i]);
+
+		/* Motion is merged within a batch, never held across one */
+		flush_motion();
 	}
 
+	print_stats();
+
 	return 0;
 }
 
 void VMDisplayInput::stop()
 {
 	running = false;
+
+	if (reader_wake_fd >= 0)
+		eventfd_write(reader_wake_fd, 1);
+
+	if (queue.get_data_fd() >= 0)
+		eventfd_write(queue.get_data_fd(), 1);
+}
+
+void VMDisplayInput::request_stats()
+{
+	stats_requested = true;
+
+	if (queue.get_data_fd() >= 0)
+		eventfd_write(queue.get_data_fd(), 1);
 }
 
 static VMDisplayInput *input_server = NULL;
@@ -539,6 +834,12 @@ static void signal_int(int signum)
 		input_server->stop();
 }
 
+static void signal_usr1(int signum)
+{
+	if (input_server)
+		input_server->request_stats();
+}
+
 void signal_callback_handler(int signum)
 {
 	printf("Caught signal SIGPIPE %d\n", signum);
@@ -551,7 +852,8 @@ void print_usage(const char *path)
 	    ("       dom_id if of remote domain that will be sharing input\n");
 	printf
 	    ("       comm_type type of communication channel used by remote domain to share input\n");
-	printf("       comm_arg communication channel specific arguments\n\n");
+	printf("       comm_arg communication channel specific arguments\n");
+	printf("       SIGUSR1 prints input queue statistics\n\n");
 	printf("e.g.:\n");
 	printf("%s 2 --xen \"shared_input\"\n", path);
 	printf("%s 2 --net \"10.103.104.25:5555\"\n", path);
@@ -559,13 +861,17 @@ void print_usage(const char *path)
 
 int main(int argc, char *argv[])
 {
-	struct sigaction sigint;
+	struct sigaction sigint, sigusr1;
 	CommunicationChannelType comm_type;
 
 	sigint.sa_handler = signal_int;
 	sigemptyset(&sigint.sa_mask);
 	sigint.sa_flags = SA_RESETHAND;
 	sigaction(SIGINT, &sigint, NULL);
+	sigusr1.sa_handler = signal_usr1;
+	sigemptyset(&sigusr1.sa_mask);
+	sigusr1.sa_flags = 0;
+	sigaction(SIGUSR1, &sigusr1, NULL);
 	signal(SIGPIPE, signal_callback_handler);
 	VMDisplayInput server;
 
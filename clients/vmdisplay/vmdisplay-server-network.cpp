@@ -202,6 +202,14 @@ int NetworkCommunicator::recv_data(void *buffer, int max_len)
 	return ret;
 }
 
+int NetworkCommunicator::get_fd()
+{
+	if (direction == HyperCommunicatorInterface::Receiver)
+		return sock_fd;
+
+	return -1;
+}
+
 int NetworkCommunicator::recv_metadata(void **surfaces_metadata)
 {
 	int len;
@@ -43,6 +43,7 @@ public:
 	int recv_data(void *data, int len);
 	int send_data(const void *data, int len);
 	int recv_metadata(void **surfaces_metadata);
+	int get_fd();
 
 	void listen_for_connection();
 private:
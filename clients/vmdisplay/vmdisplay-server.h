@@ -46,6 +46,10 @@ public:
 	virtual int recv_data(void *data, int len) = 0;
 	virtual int send_data(const void *data, int len) = 0;
 	virtual int recv_metadata(void **surfaces_metadata) = 0;
+	/* fd to poll before recv_data(), or -1 if the channel has none */
+	virtual int get_fd() {
+		return -1;
+	};
 };
 
 #endif // _VMDISPLAY_SERVER_H_
@@ -0,0 +1,198 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: input-replay.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Module replaying a recorded evdev trace into the compositor, mainly to
+ *   measure input throughput without hardware:
+ *
+ *     [input-replay]
+ *     trace=touchscreen.evemu
+ *     speed=0
+ *     passes=100
+ *     exit-when-done=true
+ *
+ *   and run weston --backend=headless-backend.so --modules=input-replay.so
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compositor.h"
+#include "compositor/weston.h"
+#include "input-replay.h"
+#include "shared/helpers.h"
+#include "shared/zalloc.h"
+
+struct replay_module {
+	struct weston_compositor *compositor;
+	struct weston_input_replay *replay;
+	int exit_when_done;
+	struct wl_listener destroy_listener;
+};
+
+static void
+replay_done(struct weston_input_replay *replay, void *data)
+{
+	struct replay_module *module = data;
+	struct weston_input_replay_stats stats;
+	double seconds;
+
+	weston_input_replay_get_stats(replay, &stats);
+	seconds = stats.wall_usec / 1000000.0;
+
+	weston_log("input-replay: %u events in %u frames over %.3f s, "
+		   "%.0f events/s, %.2f us CPU per event\n",
+		   stats.events, stats.frames, seconds,
+		   seconds > 0 ? stats.events / seconds : 0.0,
+		   stats.events ? (double)stats.cpu_usec / stats.events : 0.0);
+
+	if (module->exit_when_done)
+		weston_compositor_exit(module->compositor);
+}
+
+static void
+replay_module_destroy(struct wl_listener *listener, void *data)
+{
+	struct replay_module *module =
+		container_of(listener, struct replay_module, destroy_listener);
+
+	wl_list_remove(&module->destroy_listener.link);
+	weston_input_replay_destroy(module->replay);
+	free(module);
+}
+
+/* Relative trace paths are taken relative to the directory of weston.ini */
+static FILE *
+open_trace(struct weston_config *config, const char *trace)
+{
+	const char *config_path;
+	char *dir_buf, *path;
+	FILE *fp;
+
+	config_path = config ? weston_config_get_full_path(config) : NULL;
+	if (trace[0] == '/' || !config_path)
+		return fopen(trace, "r");
+
+	dir_buf = strdup(config_path);
+	if (!dir_buf)
+		return NULL;
+	if (asprintf(&path, "%s/%s", dirname(dir_buf), trace) < 0) {
+		free(dir_buf);
+		return NULL;
+	}
+
+	fp = fopen(path, "r");
+	free(path);
+	free(dir_buf);
+
+	return fp;
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct weston_config *config = wet_get_config(compositor);
+	struct weston_config_section *section;
+	struct replay_module *module;
+	char *trace, *seat;
+	double speed;
+	int32_t passes;
+	FILE *fp;
+	int ret;
+
+	section = weston_config_get_section(config, "input-replay", NULL, NULL);
+	weston_config_section_get_string(section, "trace", &trace, NULL);
+	weston_config_section_get_string(section, "seat", &seat, "replay");
+	weston_config_section_get_double(section, "speed", &speed, 1.0);
+	weston_config_section_get_int(section, "passes", &passes, 1);
+
+	if (!trace) {
+		weston_log("input-replay: no trace set in [input-replay]\n");
+		free(seat);
+		return -1;
+	}
+
+	module = zalloc(sizeof *module);
+	if (!module)
+		goto err_free;
+	module->compositor = compositor;
+	weston_config_section_get_bool(section, "exit-when-done",
+				       &module->exit_when_done, 0);
+
+	module->replay = weston_input_replay_create(compositor, seat);
+	if (!module->replay)
+		goto err_module;
+
+	fp = open_trace(config, trace);
+	if (!fp) {
+		weston_log("input-replay: cannot open trace %s: %m\n", trace);
+		goto err_replay;
+	}
+	ret = weston_input_replay_load(module->replay, fp);
+	fclose(fp);
+	if (ret < 0)
+		goto err_replay;
+
+	if (weston_input_replay_start(module->replay, speed, passes,
+				      replay_done, module) < 0) {
+		weston_log("input-replay: invalid speed %f or passes %d\n",
+			   speed, passes);
+		goto err_replay;
+	}
+
+	module->destroy_listener.notify = replay_module_destroy;
+	wl_signal_add(&compositor->destroy_signal, &module->destroy_listener);
+
+	if (speed > 0)
+		weston_log("input-replay: replaying %s %d times at %.2fx\n",
+			   trace, passes, speed);
+	else
+		weston_log("input-replay: replaying %s %d times unthrottled\n",
+			   trace, passes);
+
+	free(trace);
+	free(seat);
+
+	return 0;
+
+err_replay:
+	weston_input_replay_destroy(module->replay);
+err_module:
+	free(module);
+err_free:
+	free(trace);
+	free(seat);
+
+	return -1;
+}
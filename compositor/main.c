@@ -845,6 +845,8 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	struct weston_config_section *s;
 	int repaint_msec;
 	int vt_switching;
+	int touch_resample;
+	int prediction_msec;
 
 	s = weston_config_get_section(config, "keyboard", NULL, NULL);
 	weston_config_section_get_string(s, "keymap_rules",
@@ -882,6 +884,18 @@ weston_compositor_init_config(struct weston_compositor *ec,
 	weston_log("Output repaint window is %d ms maximum.\n",
 		   ec->repaint_msec);
 
+	s = weston_config_get_section(config, "touch", NULL, NULL);
+	weston_config_section_get_bool(s, "resample", &touch_resample, false);
+	weston_config_section_get_int(s, "prediction-horizon",
+				      &prediction_msec, 0);
+	if (prediction_msec < -50 || prediction_msec > 50) {
+		weston_log("Invalid prediction-horizon value in config: %d\n",
+			   prediction_msec);
+		prediction_msec = 0;
+	}
+	ec->touch_resample = touch_resample;
+	ec->touch_prediction_usec = prediction_msec * 1000;
+
 	return 0;
 }
 
@@ -1233,6 +1247,10 @@ load_drm_backend(struct weston_compositor *c,
 					 NULL);
 	weston_config_section_get_uint(section, "pageflip-timeout",
 	                               &config.pageflip_timeout, 0);
+	weston_config_section_get_string(section, "recorder-codec",
+					 &config.recorder_codec, NULL);
+	weston_config_section_get_uint(section, "recorder-queue-depth",
+				       &config.recorder_queue_depth, 4);
 
 	config.base.struct_version = WESTON_DRM_BACKEND_CONFIG_VERSION;
 	config.base.struct_size = sizeof(struct weston_drm_backend_config);
@@ -1244,6 +1262,7 @@ load_drm_backend(struct weston_compositor *c,
 	wet_set_pending_output_handler(c, drm_backend_output_configure);
 
 	free(config.gbm_format);
+	free(config.recorder_codec);
 	free(config.seat_id);
 
 	return ret;
@@ -51,6 +51,9 @@ struct classic_scanout {
 struct ias_classic_priv {
 	struct classic_scanout scanout;
 	struct classic_scanout scanout_bak;
+
+	/* FB_DAMAGE_CLIPS blob attached to the pending primary plane update */
+	uint32_t damage_blob_id;
 };
 
 enum plane_flip_state {
@@ -184,6 +187,7 @@ create_sprites_for_crtc(struct ias_crtc *ias_crtc)
 
 		if (!(plane->possible_crtcs & (1 << ias_crtc->index))) {
 			DRM_FREE_PLANE(backend, plane);
+			ias_plane_formats_release(&sprite->in_formats);
 			free(sprite);
 
 			continue;
@@ -234,6 +238,13 @@ create_sprites_for_crtc(struct ias_crtc *ias_crtc)
 		sprite->count_formats = plane->count_formats;
 		memcpy(sprite->formats, plane->formats,
 				plane->count_formats * sizeof(plane->formats[0]));
+
+		if (ias_sprite_supports_format(sprite, GBM_FORMAT_NV12) ||
+		    ias_sprite_supports_format(sprite, GBM_FORMAT_YUYV)) {
+			weston_log("plane %u can scan out YUV%s\n", plane->plane_id,
+					sprite->prop.color_encoding ?
+					"" : " (fixed color conversion)");
+		}
 		/*
 		drmModeFreePlane(plane);
 		*/
@@ -360,6 +371,8 @@ generate_crtc_scanout_classic(struct ias_crtc *ias_crtc,
 		ias_output_render(ias_crtc->output[0], damage);
 		pixman_region32_subtract(&primary_plane->damage,
 				&primary_plane->damage, damage);
+		pixman_region32_subtract(&output->base.damage,
+				&output->base.damage, damage);
 
 		if(!ias_crtc->output[0]->scanout_surface) {
 			/* Find sprite that will be used for that scanout */
@@ -385,6 +398,8 @@ generate_crtc_scanout_classic(struct ias_crtc *ias_crtc,
 				return 0;
 			}
 
+			ias_output_scanout_locked(ias_crtc->output[0], scanout->next);
+
 #if defined(BUILD_VAAPI_RECORDER) || defined(BUILD_FRAME_CAPTURE)
 			wl_signal_emit(&output->next_scanout_ready_signal, output);
 #endif
@@ -487,6 +502,7 @@ allocate_scanout_classic(struct ias_crtc *ias_crtc, struct ias_mode *m)
 	int32_t old_width = ias_crtc->output[0]->width;
 	int32_t old_height = ias_crtc->output[0]->height;
 	uint32_t surface_flags;
+	struct ias_sprite *primary = NULL, *s;
 	int use_vm = 0;
 
 	/*
@@ -543,8 +559,15 @@ allocate_scanout_classic(struct ias_crtc *ias_crtc, struct ias_mode *m)
 	if (ias_crtc->output[0]->vm)
 		surface_flags |= GBM_BO_USE_LINEAR;
 
-	scanout->surface = gbm_surface_create(ias_crtc->backend->gbm,
-			m->base.width, m->base.height,
+	wl_list_for_each(s, &ias_crtc->sprite_list, link) {
+		if (s->type == DRM_PLANE_TYPE_PRIMARY) {
+			primary = s;
+			break;
+		}
+	}
+
+	scanout->surface = ias_scanout_surface_create(ias_crtc->output[0],
+			primary, m->base.width, m->base.height,
 			GBM_FORMAT_ARGB8888,
 			surface_flags);
 
@@ -575,6 +598,7 @@ allocate_scanout_classic(struct ias_crtc *ias_crtc, struct ias_mode *m)
 	scanout->current = NULL;
 	scanout->next = NULL;
 	scanout->in_use = 1;
+	ias_output_scanout_allocated(ias_crtc->output[0]);
 
 	if (ias_crtc->output[0]) {
 		/*
@@ -614,6 +638,7 @@ try_revert_mode:
 
 			weston_compositor_damage_all(ias_crtc->backend->compositor);
 			scanout->in_use = 1;
+			ias_output_scanout_allocated(ias_crtc->output[0]);
 		}
 		else {
 			weston_log("failed to create gl renderer output state for previous mode\n");
@@ -792,6 +817,13 @@ flip_classic(int drm_fd, struct ias_crtc *ias_crtc, int output_num)
 
 			update_primary_plane(ias_crtc, scanout);
 			ret = drmModeAtomicCommit(drm_fd, ias_crtc->prop_set, flags, ias_crtc);
+
+			/* The kernel holds its own reference once the commit is queued */
+			if (priv->damage_blob_id) {
+				drmModeDestroyPropertyBlob(drm_fd, priv->damage_blob_id);
+				priv->damage_blob_id = 0;
+			}
+
 			if (ret) {
 				IAS_ERROR("Queueing atomic pageflip failed: %m");
 				return;
@@ -989,6 +1021,8 @@ static void
 update_primary_plane(struct ias_crtc *ias_crtc, struct classic_scanout *scanout)
 {
 	struct ias_backend *backend = ias_crtc->backend;
+	struct ias_classic_priv *priv =
+		(struct ias_classic_priv *)ias_crtc->output_model_priv;
 	struct ias_sprite *s;
 
 	wl_list_for_each(s, &ias_crtc->sprite_list, link) {
@@ -1022,6 +1056,20 @@ update_primary_plane(struct ias_crtc *ias_crtc, struct classic_scanout *scanout)
 					s->prop.fb_id,
 					scanout->next->fb_id);
 
+			/*
+			 * Tell the kernel which parts of the composited scanout
+			 * actually changed so PSR and similar can skip the rest.
+			 */
+			if (s->prop.fb_damage_clips) {
+				ias_output_create_damage_blob(ias_crtc->output[0],
+						scanout->next, &priv->damage_blob_id);
+				if (priv->damage_blob_id) {
+					drmModeAtomicAddProperty(ias_crtc->prop_set,
+							s->plane_id,
+							s->prop.fb_damage_clips,
+							priv->damage_blob_id);
+				}
+			}
 
 			if (backend->rbc_supported && backend->rbc_debug) {
 				weston_log("[RBC] commiting scanout, compression enabled = %d\n",
@@ -1085,6 +1133,9 @@ update_sprites_classic(struct ias_crtc *ias_crtc)
 					s->prop.fb_id,
 					s->next->fb_id);
 
+			ias_sprite_set_color_properties(s, s->next,
+					ias_crtc->prop_set);
+
 			if (backend->rbc_supported && backend->rbc_debug) {
 				weston_log("Flipping sprite, compressed = %d\n",
 					   s->next->is_compressed);
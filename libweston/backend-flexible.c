@@ -67,6 +67,9 @@ struct ias_flexible_priv {
 	int in_handler;  /* currently handling a flip event */
 	int pending;     /* Which planes are pending a commit */
 	int commited;    /* Which planes have been commited, awaiting complete */
+
+	/* FB_DAMAGE_CLIPS blobs referenced by the pending property set */
+	uint32_t damage_blob_id[MAX_OUTPUTS_PER_CRTC];
 };
 
 static void
@@ -191,6 +194,7 @@ create_sprites_for_crtc(struct ias_crtc *ias_crtc)
 		if ((sprite->type == DRM_PLANE_TYPE_CURSOR && !backend->use_cursor_as_uplane) ||
 			!((1 << ias_crtc->index) & plane->possible_crtcs)) {
 			DRM_FREE_PLANE(backend, plane);
+			ias_plane_formats_release(&sprite->in_formats);
 			free(sprite);
 
 			continue;
@@ -230,6 +234,13 @@ create_sprites_for_crtc(struct ias_crtc *ias_crtc)
 		sprite->count_formats = plane->count_formats;
 		memcpy(sprite->formats, plane->formats,
 				plane->count_formats * sizeof(plane->formats[0]));
+
+		if (ias_sprite_supports_format(sprite, GBM_FORMAT_NV12) ||
+		    ias_sprite_supports_format(sprite, GBM_FORMAT_YUYV)) {
+			weston_log("plane %u can scan out YUV%s\n", plane->plane_id,
+					sprite->prop.color_encoding ?
+					"" : " (fixed color conversion)");
+		}
 		/*
 		drmModeFreePlane(plane);
 		*/
@@ -387,6 +398,8 @@ generate_crtc_scanout_flexible(struct ias_crtc *ias_crtc,
 	if (!scanout->next) {
 		ias_output_render(output, damage);
 		pixman_region32_subtract(&plane->damage, &plane->damage, damage);
+		pixman_region32_subtract(&output->base.damage,
+				&output->base.damage, damage);
 
 		if(!output->scanout_surface) {
 			/* Find sprite that will be used for that scanout */
@@ -411,6 +424,8 @@ generate_crtc_scanout_flexible(struct ias_crtc *ias_crtc,
 				return 0;
 			}
 
+			ias_output_scanout_locked(output, scanout->next);
+
 #if defined(BUILD_VAAPI_RECORDER) || defined(BUILD_FRAME_CAPTURE)
 			wl_signal_emit(&output->next_scanout_ready_signal, output);
 #endif
@@ -508,13 +523,16 @@ allocate_scanout_flexible(struct ias_crtc *ias_crtc, struct ias_mode *m)
 	struct flexible_scanout *scanout = priv->scanout;
 	struct flexible_scanout *scanout_save = priv->scanout_save;
 	EGLint format = ias_crtc->backend->format;
+	struct ias_sprite *ias_sprite, *plane;
 	int use_vm = 0;
 
 	for (i = 0; i < ias_crtc->num_outputs; i++) {
 		/*
 		 * If the old buffers haven't been released, then a previous mode set
 		 * was never complete and the current buffers can be released. Otherwise
-		 * save the current buffers until the mode set completes.
+		 * save the current buffers until the mode set completes.  Either way
+		 * the renderer state goes now, as the output only has room for the
+		 * one we're about to create.
 		 */
 		if (scanout_save[i].in_use) {
 			if (scanout[i].in_use) {
@@ -522,6 +540,9 @@ allocate_scanout_flexible(struct ias_crtc *ias_crtc, struct ias_mode *m)
 				gbm_surface_destroy(scanout[i].surface);
 			}
 		} else {
+			if (scanout[i].in_use) {
+				gl_renderer->output_destroy(&ias_crtc->output[i]->base);
+			}
 			scanout_save[i].in_use = scanout[i].in_use;
 			scanout_save[i].surface = scanout[i].surface;
 			scanout_save[i].current = scanout[i].current;
@@ -540,12 +561,23 @@ allocate_scanout_flexible(struct ias_crtc *ias_crtc, struct ias_mode *m)
 			ias_crtc->output[i]->height = m->base.height;
 		}*/
 
+		plane = NULL;
+		wl_list_for_each(ias_sprite, &ias_crtc->sprite_list, link) {
+			if ((ias_crtc->backend->use_cursor_as_uplane ||
+			     ias_sprite->type != DRM_PLANE_TYPE_CURSOR) &&
+			    ias_sprite->output_id == i) {
+				plane = ias_sprite;
+				break;
+			}
+		}
+
 		/* The width needs to be 64 byte aligned because an X-tiled surface
 		 * (assuming 32 bpp) needs a 256 byte aligned stride. Usually, the
 		 * DRI driver makes the alignment adjustments but currently UFO is
 		 * not doing it; therefore this temporary workaround is needed.
 		 */
-		scanout[i].surface = gbm_surface_create(ias_crtc->backend->gbm,
+		scanout[i].surface = ias_scanout_surface_create(ias_crtc->output[i],
+				plane,
 #ifdef WORKAROUND_UFO_STRIDE
 				ALIGN(ias_crtc->output[i]->width, 512),
 #else
@@ -578,6 +610,7 @@ allocate_scanout_flexible(struct ias_crtc *ias_crtc, struct ias_mode *m)
 		scanout[i].current = NULL;
 		scanout[i].next = NULL;
 		scanout[i].in_use = 1;
+		ias_output_scanout_allocated(ias_crtc->output[i]);
 	}
 
 	for (i = 0; i < ias_crtc->num_outputs; i++) {
@@ -804,6 +837,7 @@ commit(struct ias_crtc *ias_crtc)
 	struct ias_flexible_priv *priv =
 		(struct ias_flexible_priv *)ias_crtc->output_model_priv;
 	int ret = 0;
+	int i;
 	struct timespec ts;
 	uint32_t flags = DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT;
 
@@ -826,6 +860,14 @@ commit(struct ias_crtc *ias_crtc)
 		IAS_ERROR("This failure will prevent clients from updating.");
 	}
 
+	/* The kernel holds its own reference once the commit is queued */
+	for (i = 0; i < MAX_OUTPUTS_PER_CRTC; i++) {
+		if (priv->damage_blob_id[i]) {
+			drmModeDestroyPropertyBlob(priv->drm_fd, priv->damage_blob_id[i]);
+			priv->damage_blob_id[i] = 0;
+		}
+	}
+
 	mode_id = 0;
 
 	/* Free and re-allocate the property set so it's always clean */
@@ -948,6 +990,7 @@ flip_flexible(int drm_fd, struct ias_crtc *ias_crtc, int output_id)
 		(struct ias_flexible_priv *)ias_crtc->output_model_priv;
 	struct flexible_scanout *scanout = priv->scanout;
 	struct ias_backend *backend = ias_crtc->backend;
+	uint32_t old_blob_id;
 	int i;
 
 	if (ias_crtc->prop_set) {
@@ -970,6 +1013,9 @@ flip_flexible(int drm_fd, struct ias_crtc *ias_crtc, int output_id)
 					ias_sprite->prop.fb_id,
 					scanout[s].next->fb_id);
 
+			ias_sprite_set_color_properties(ias_sprite, scanout[s].next,
+					ias_crtc->prop_set);
+
 			drmModeAtomicAddProperty(ias_crtc->prop_set,
 					ias_sprite->plane_id,
 					ias_sprite->prop.crtc_id,
@@ -1005,6 +1051,29 @@ flip_flexible(int drm_fd, struct ias_crtc *ias_crtc, int output_id)
 					ias_sprite->plane_id,
 					ias_sprite->prop.src_h, h);
 
+			/*
+			 * Tell the kernel which parts of the composited scanout
+			 * actually changed so PSR and similar can skip the rest.
+			 */
+			if (ias_sprite->prop.fb_damage_clips) {
+				old_blob_id = priv->damage_blob_id[s];
+
+				ias_output_create_damage_blob(output, scanout[s].next,
+						&priv->damage_blob_id[s]);
+
+				/* A 0 value drops a blob queued by an earlier flip */
+				if (priv->damage_blob_id[s] || old_blob_id) {
+					drmModeAtomicAddProperty(ias_crtc->prop_set,
+							ias_sprite->plane_id,
+							ias_sprite->prop.fb_damage_clips,
+							priv->damage_blob_id[s]);
+				}
+
+				if (old_blob_id) {
+					drmModeDestroyPropertyBlob(drm_fd, old_blob_id);
+				}
+			}
+
 			if (backend->rbc_supported && backend->rbc_debug) {
 				weston_log("[RBC] Commiting scanout %d, compression enabled = %d\n",
 					   s, scanout[s].next->is_compressed);
@@ -1046,6 +1115,40 @@ flip_flexible(int drm_fd, struct ias_crtc *ias_crtc, int output_id)
 	}
 }
 
+/*
+ * is_yuv_flippable_on_plane()
+ *
+ * YUV dmabufs (camera and video frames) are drawn with the renderer's YUV
+ * shaders, but the plane behind this output can often convert them itself.
+ * Returns 1 if the plane advertises the buffer's format.
+ */
+static uint32_t
+is_yuv_flippable_on_plane(struct weston_surface *surface,
+		struct weston_output *output)
+{
+	struct ias_output *ias_output = (struct ias_output *)output;
+	struct ias_crtc *ias_crtc = ias_output->ias_crtc;
+	struct ias_backend *backend = ias_crtc->backend;
+	struct linux_dmabuf_buffer *dmabuf;
+	struct ias_sprite *ias_sprite;
+
+	dmabuf = linux_dmabuf_buffer_get(surface->buffer_ref.buffer->resource);
+	if (!dmabuf || !ias_format_is_yuv(dmabuf->attributes.format)) {
+		return 0;
+	}
+
+	wl_list_for_each(ias_sprite, &ias_crtc->sprite_list, link) {
+		if ((backend->use_cursor_as_uplane ||
+		     ias_sprite->type != DRM_PLANE_TYPE_CURSOR) &&
+		    (uint32_t)ias_sprite->output_id == ias_output->scanout) {
+			return ias_sprite_supports_format(ias_sprite,
+					dmabuf->attributes.format);
+		}
+	}
+
+	return 0;
+}
+
 /*
  * is_surface_flippable_flexible()
  *
@@ -1087,7 +1190,8 @@ static uint32_t is_surface_flippable_flexible(
 			(!surface->compositor->renderer->is_shader_of_type(
 					surface, WL_SHM_FORMAT_XRGB8888) &&
 			 !surface->compositor->renderer->is_shader_of_type(
-					surface, WL_SHM_FORMAT_ARGB8888)) ||
+					surface, WL_SHM_FORMAT_ARGB8888) &&
+			 !is_yuv_flippable_on_plane(surface, output)) ||
 			/*
 			 * If it is ARGB surface, then in order for it to be flipped,
 			 * it should either be the only one on this output OR its opaque
@@ -1172,45 +1276,47 @@ set_mode_flexible(struct ias_crtc *ias_crtc)
 			}
 		}
 
-		/*
-		 * Check for old saved buffers.  If this call is made when the current
-		 * ias_fb pointer is NULL, then there's a good chance a the mode was
-		 * just changed and we have old scanout buffer information still around.
-		 */
-		for (i = 0; i < ias_crtc->num_outputs; i++) {
-			if (!scanout[i].current) {
-				if (scanout_save[i].in_use) {
-					if (scanout_save[i].current) {
-						if (scanout_save[i].current->is_client_buffer) {
-							gbm_bo_destroy(scanout_save[i].current->bo);
-						} else {
-							gbm_surface_release_buffer(
-									scanout_save[i].surface,
-									scanout_save[i].current->bo);
-						}
-					}
+		ias_crtc->request_set_mode = 0;
+	}
 
-					if (scanout_save[i].next) {
-						if (scanout_save[i].next->is_client_buffer) {
-							gbm_bo_destroy(scanout_save[i].next->bo);
-						} else {
-							gbm_surface_release_buffer(
-									scanout_save[i].surface,
-									scanout_save[i].next->bo);
-						}
+	/*
+	 * Check for old saved buffers.  If this call is made when the current
+	 * ias_fb pointer is NULL, then there's a good chance the scanouts were
+	 * just reallocated and we have old scanout buffer information still
+	 * around.  That is also true when the mode itself didn't change and the
+	 * mode set was skipped above.
+	 */
+	for (i = 0; i < ias_crtc->num_outputs; i++) {
+		if (!scanout[i].current) {
+			if (scanout_save[i].in_use) {
+				if (scanout_save[i].current) {
+					if (scanout_save[i].current->is_client_buffer) {
+						gbm_bo_destroy(scanout_save[i].current->bo);
+					} else {
+						gbm_surface_release_buffer(
+								scanout_save[i].surface,
+								scanout_save[i].current->bo);
 					}
+				}
 
-					gl_renderer->output_destroy(&ias_crtc->output[i]->base);
-					gbm_surface_destroy(scanout_save[i].surface);
+				if (scanout_save[i].next) {
+					if (scanout_save[i].next->is_client_buffer) {
+						gbm_bo_destroy(scanout_save[i].next->bo);
+					} else {
+						gbm_surface_release_buffer(
+								scanout_save[i].surface,
+								scanout_save[i].next->bo);
+					}
 				}
-				scanout_save[i].current = NULL;
-				scanout_save[i].next = NULL;
-				scanout_save[i].in_use = 0;
+
+				gbm_surface_destroy(scanout_save[i].surface);
 			}
+			scanout_save[i].current = NULL;
+			scanout_save[i].next = NULL;
+			scanout_save[i].in_use = 0;
 		}
-
-		ias_crtc->request_set_mode = 0;
 	}
+
 	return 0;
 }
 
@@ -268,6 +268,13 @@ struct drm_backend {
 
 	uint32_t pageflip_timeout;
 
+#ifdef BUILD_VAAPI_RECORDER
+	/* VA display shared by all recordings, opened on first use */
+	struct vaapi_recorder_pool *recorder_pool;
+	enum vaapi_recorder_codec recorder_codec;
+	int recorder_queue_depth;
+#endif
+
 	bool shutting_down;
 };
 
@@ -747,6 +754,11 @@ drm_output_update_msc(struct drm_output *output, unsigned int seq);
 static void
 drm_output_destroy(struct weston_output *output_base);
 
+#ifdef BUILD_VAAPI_RECORDER
+static void
+recorder_destroy(struct drm_output *output);
+#endif
+
 /**
  * Returns true if the plane can be used on the given output for its current
  * repaint cycle.
@@ -4823,6 +4835,11 @@ drm_output_destroy(struct weston_output *base)
 		return;
 	}
 
+#ifdef BUILD_VAAPI_RECORDER
+	if (output->recorder)
+		recorder_destroy(output);
+#endif
+
 	if (output->base.enabled)
 		drm_output_deinit(&output->base);
 
@@ -5200,6 +5217,11 @@ drm_destroy(struct weston_compositor *ec)
 
 	weston_compositor_shutdown(ec);
 
+#ifdef BUILD_VAAPI_RECORDER
+	if (b->recorder_pool)
+		vaapi_recorder_pool_destroy(b->recorder_pool);
+#endif
+
 	if (b->gbm)
 		gbm_device_destroy(b->gbm);
 
@@ -5504,14 +5526,22 @@ create_recorder(struct drm_backend *b, int width, int height,
 	int fd;
 	drm_magic_t magic;
 
-	fd = open(b->drm.filename, O_RDWR | O_CLOEXEC);
-	if (fd < 0)
-		return NULL;
+	if (!b->recorder_pool) {
+		fd = open(b->drm.filename, O_RDWR | O_CLOEXEC);
+		if (fd < 0)
+			return NULL;
 
-	drmGetMagic(fd, &magic);
-	drmAuthMagic(b->drm.fd, magic);
+		drmGetMagic(fd, &magic);
+		drmAuthMagic(b->drm.fd, magic);
 
-	return vaapi_recorder_create(fd, width, height, filename);
+		b->recorder_pool = vaapi_recorder_pool_create(fd);
+		if (!b->recorder_pool)
+			return NULL;
+	}
+
+	return vaapi_recorder_create(b->recorder_pool, width, height,
+				     b->recorder_codec,
+				     b->recorder_queue_depth, filename);
 }
 
 static void
@@ -5520,6 +5550,7 @@ recorder_binding(struct weston_keyboard *keyboard, const struct timespec *time,
 {
 	struct drm_backend *b = data;
 	struct drm_output *output;
+	const char *filename;
 	int width, height;
 
 	output = container_of(b->compositor->output_list.next,
@@ -5535,8 +5566,13 @@ recorder_binding(struct weston_keyboard *keyboard, const struct timespec *time,
 		width = output->base.current_mode->width;
 		height = output->base.current_mode->height;
 
+		if (b->recorder_codec == VAAPI_RECORDER_H265_MAIN)
+			filename = "capture.h265";
+		else
+			filename = "capture.h264";
+
 		output->recorder =
-			create_recorder(b, width, height, "capture.h264");
+			create_recorder(b, width, height, filename);
 		if (!output->recorder) {
 			weston_log("failed to create vaapi recorder\n");
 			return;
@@ -5665,6 +5701,16 @@ drm_backend_create(struct weston_compositor *compositor,
 	if (parse_gbm_format(config->gbm_format, GBM_FORMAT_XRGB8888, &b->gbm_format) < 0)
 		goto err_compositor;
 
+#ifdef BUILD_VAAPI_RECORDER
+	b->recorder_codec = VAAPI_RECORDER_H264_MAIN;
+	if (config->recorder_codec &&
+	    vaapi_recorder_codec_from_name(config->recorder_codec,
+					   &b->recorder_codec) < 0)
+		weston_log("[libva recorder] unrecognized codec '%s', "
+			   "using h264-main\n", config->recorder_codec);
+	b->recorder_queue_depth = config->recorder_queue_depth;
+#endif
+
 	if (config->seat_id)
 		seat_id = config->seat_id;
 
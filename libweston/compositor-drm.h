@@ -35,7 +35,7 @@
 extern "C" {
 #endif
 
-#define WESTON_DRM_BACKEND_CONFIG_VERSION 3
+#define WESTON_DRM_BACKEND_CONFIG_VERSION 4
 
 struct libinput_device;
 
@@ -146,6 +146,21 @@ struct weston_drm_backend_config {
 	 * based on seat names and boot_vga to find the right device.
 	 */
 	char *specific_device;
+
+	/** Codec used by the VA-API screen recorder
+	 *
+	 * One of "h264-baseline", "h264-main", "h264-high" or "h265-main";
+	 * "h264" and "h265" select the main profiles. If NULL, use
+	 * "h264-main". The backend does not take ownership of the string.
+	 */
+	char *recorder_codec;
+
+	/** Frames the VA-API recorder queues for its encoder thread
+	 *
+	 * When the queue is full the oldest frame is dropped. Clamped to
+	 * 1..8.
+	 */
+	uint32_t recorder_queue_depth;
 };
 
 #ifdef  __cplusplus
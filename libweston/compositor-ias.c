@@ -59,6 +59,8 @@
 #include "ias-backend.h"
 #include "launcher-util.h"
 #include "trace-reporter.h"
+#include "timeline.h"
+#include "ias-damage.h"
 #include <EGL/egl.h>
 #include <dlfcn.h>
 #include <time.h>
@@ -149,6 +151,8 @@ static int use_rbc = 0;
 static int rbc_debug = 0;
 static int damage_outputs_on_init = 1;
 static int use_cursor_as_uplane = 0;
+static int use_plane_cache = 1;
+static int plane_cache_debug = 0;
 
 TRACING_DECLARATIONS;
 
@@ -347,6 +351,44 @@ static int emgd_has_multiplane_drm(struct ias_backend *backend)
 		return overlay;
 }
 
+/*
+ * Read the IN_FORMATS blob so we know which modifiers the plane can scan
+ * out for each format, not just the formats themselves.
+ */
+static void
+get_plane_formats(int fd, uint64_t blob_id, struct ias_plane_formats *pf)
+{
+	drmModePropertyBlobPtr blob;
+
+	blob = drmModeGetPropertyBlob(fd, blob_id);
+	if (!blob) {
+		return;
+	}
+
+	if (ias_plane_formats_parse(pf, blob->data, blob->length)) {
+		weston_log("ignoring malformed IN_FORMATS blob %u\n",
+				(uint32_t)blob_id);
+	}
+
+	drmModeFreePropertyBlob(blob);
+}
+
+static int
+get_property_enum_value(drmModePropertyPtr prop, const char *name,
+		uint64_t *value)
+{
+	int i;
+
+	for (i = 0; i < prop->count_enums; i++) {
+		if (!strcmp(prop->enums[i].name, name)) {
+			*value = prop->enums[i].value;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
 void
 ias_get_object_properties(int fd,
 		struct ias_properties *drm_props,
@@ -380,6 +422,13 @@ ias_get_object_properties(int fd,
 
 		{ "alpha", F(alpha) },
 		{ "pixel blend mode", F(pixel_blend_mode) },
+
+		{ "FB_DAMAGE_CLIPS", F(fb_damage_clips) },
+
+		{ "COLOR_ENCODING", F(color_encoding) },
+		{ "COLOR_RANGE", F(color_range) },
+
+		{ "IN_FORMATS", F(in_formats) },
 	};
 #undef F
 
@@ -414,6 +463,28 @@ ias_get_object_properties(int fd,
 				sprite->rotation = props->prop_values[i];
 			}
 
+			/*
+			 * Only treat the YCbCr controls as usable if they offer
+			 * the conversion our GL shaders do, so a view looks the
+			 * same whether it's on a plane or composited.
+			 */
+			if (!strcmp(prop->name, "COLOR_ENCODING") &&
+			    get_property_enum_value(prop, "ITU-R BT.601 YCbCr",
+					&sprite->color_encoding_bt601)) {
+				*p = 0;
+			}
+
+			if (!strcmp(prop->name, "COLOR_RANGE") &&
+			    get_property_enum_value(prop, "YCbCr limited range",
+					&sprite->color_range_limited)) {
+				*p = 0;
+			}
+
+			if (!strcmp(prop->name, "IN_FORMATS")) {
+				get_plane_formats(fd, props->prop_values[i],
+						&sprite->in_formats);
+			}
+
 			weston_log_continue("%s (%u), ", prop->name, prop->prop_id);
 			break;
 		}
@@ -475,7 +546,8 @@ ias_get_crtc_object_properties(int fd,
 }
 
 static uint32_t
-is_rbc_resolve_possible_on_sprite(uint32_t rotation, uint32_t format);
+is_rbc_resolve_possible_on_sprite(struct ias_sprite *sprite,
+		uint32_t rotation, uint32_t format, uint64_t modifier);
 
 /* Update output's coordinates
  *
@@ -614,6 +686,26 @@ ias_crtc_set_mode(struct wl_client *client,
 	return;
 }
 
+/*
+ * ias_crtc_reallocate_scanout()
+ *
+ * Recreate the composited scanouts of a CRTC in its current mode, so they
+ * pick up a change in the layouts its outputs may use.
+ */
+static void
+ias_crtc_reallocate_scanout(struct ias_crtc *ias_crtc)
+{
+	if (ias_crtc->output_model->allocate_scanout(ias_crtc,
+				ias_crtc->current_mode) == -1) {
+		IAS_ERROR("Failed to reallocate scanout for CRTC %d",
+				ias_crtc->crtc_id);
+		return;
+	}
+
+	ias_crtc->request_set_mode = 1;
+	weston_compositor_damage_all(ias_crtc->backend->compositor);
+}
+
 static int32_t
 ias_get_object_prop(int fd, uint32_t id, uint32_t object_type,
 		const char *name, uint32_t *prop_id, uint64_t *prop_value)
@@ -1230,6 +1322,7 @@ ias_output_set_xy(struct wl_client *client,
 	ias_output->base.dirty = 1;
 	weston_output_damage(&ias_output->base);
 	weston_output_move(&ias_output->base, x, y);
+	ias_output_reset_damage_history(ias_output);
 	ias_move_pointer(compositor, ias_output, x, y,
 			ias_output->base.current_mode->width,
 			ias_output->base.current_mode->height);
@@ -1326,12 +1419,11 @@ ias_output_scale(struct ias_output *ias_output,
 	weston_output_damage(&ias_output->base);
 
 	/*
-	 * The previous frame's damage is also completely invalid now that we've
-	 * resized.  Re-initialize it to the entire (new) output size.
+	 * Damage recorded for earlier frames is in the old output geometry, so
+	 * none of our scanout buffers can be partially redrawn anymore.
 	 */
-	pixman_region32_fini(&ias_output->prev_damage);
-	pixman_region32_init(&ias_output->prev_damage);
-	pixman_region32_copy(&ias_output->prev_damage, &output->region);
+	ias_output_reset_damage_history(ias_output);
+	ias_output->scanout_damage_valid = 0;
 
 	ias_move_pointer(compositor, ias_output, output->x, output->y,
 			ias_output->base.current_mode->width,
@@ -1422,6 +1514,181 @@ ias_fb_destroy_callback(struct gbm_bo *bo, void *data)
 #define EGL_OFFSET 0x3061
 #endif
 
+/*
+ * ias_import_dmabuf()
+ *
+ * Imports a linux_dmabuf buffer as a GBM bo that we can build a scanout fb
+ * from.  Multi-planar buffers (NV12 from cameras and video decoders) are
+ * imported with all their planes when GBM can take modifiers; otherwise
+ * only the first plane is imported and the remaining planes are assumed to
+ * live in the same buffer object at the offsets the client gave us.
+ */
+struct gbm_bo *
+ias_import_dmabuf(struct ias_backend *backend,
+		struct linux_dmabuf_buffer *dmabuf)
+{
+	struct gbm_import_fd_data gbm_dmabuf = {
+		.fd = dmabuf->attributes.fd[0],
+		.width = dmabuf->attributes.width,
+		.height = dmabuf->attributes.height,
+		.stride = dmabuf->attributes.stride[0],
+		.format = dmabuf->attributes.format
+	};
+#ifdef HAVE_GBM_MODIFIERS
+	struct gbm_import_fd_modifier_data gbm_planes = {
+		.width = dmabuf->attributes.width,
+		.height = dmabuf->attributes.height,
+		.format = dmabuf->attributes.format,
+		.num_fds = dmabuf->attributes.n_planes,
+		.modifier = dmabuf->attributes.modifier[0],
+	};
+	int i;
+
+	if (dmabuf->attributes.n_planes > 1) {
+		for (i = 0; i < dmabuf->attributes.n_planes; i++) {
+			gbm_planes.fds[i] = dmabuf->attributes.fd[i];
+			gbm_planes.strides[i] = dmabuf->attributes.stride[i];
+			gbm_planes.offsets[i] = dmabuf->attributes.offset[i];
+		}
+
+		return gbm_bo_import(backend->gbm, GBM_BO_IMPORT_FD_MODIFIER,
+				     &gbm_planes, GBM_BO_USE_SCANOUT);
+	}
+#endif
+
+	return gbm_bo_import(backend->gbm, GBM_BO_IMPORT_FD,
+			     &gbm_dmabuf, GBM_BO_USE_SCANOUT);
+}
+
+/*
+ * scanout_modifiers_allowed()
+ *
+ * The IAS_MODIFIERS_* layouts an output's scanouts may use right now.
+ * Compression needs RBC to be enabled on the backend.  Frame capture hands
+ * the front buffer to the encoder as a single plane without a modifier,
+ * which it can only import X/Y tiled or linear.
+ */
+static uint32_t
+scanout_modifiers_allowed(struct ias_output *output)
+{
+	uint32_t allow = IAS_MODIFIERS_YF;
+
+	if (output->ias_crtc->backend->rbc_enabled) {
+		allow |= IAS_MODIFIERS_CCS;
+	}
+
+#ifdef BUILD_FRAME_CAPTURE
+	if (output->cp) {
+		allow = 0;
+	}
+#endif
+
+	return allow;
+}
+
+/*
+ * ias_scanout_surface_create()
+ *
+ * Allocate the GBM surface an output composites into on a plane.  If the
+ * plane lists modifiers we hand GBM every layout it can scan out that the
+ * output may currently use, best first, so the driver can pick a tiled (and,
+ * with RBC, compressed) layout instead of whatever it would default to.
+ * Falls back to a plain surface if that isn't possible.
+ */
+struct gbm_surface *
+ias_scanout_surface_create(struct ias_output *output,
+		struct ias_sprite *sprite, uint32_t width, uint32_t height,
+		uint32_t format, uint32_t flags)
+{
+	struct ias_backend *backend = output->ias_crtc->backend;
+#ifdef HAVE_GBM_MODIFIERS
+	struct gbm_surface *surface;
+	uint64_t modifiers[16];
+	int num_modifiers;
+#endif
+
+	output->scanout_modifiers = scanout_modifiers_allowed(output);
+
+#ifdef HAVE_GBM_MODIFIERS
+	if (sprite && !(flags & GBM_BO_USE_LINEAR)) {
+		num_modifiers = ias_plane_formats_get_modifiers(&sprite->in_formats,
+				format, output->scanout_modifiers,
+				modifiers, ARRAY_LENGTH(modifiers));
+
+		if (num_modifiers) {
+			surface = gbm_surface_create_with_modifiers(backend->gbm,
+					width, height, format,
+					modifiers, num_modifiers);
+			if (surface) {
+				return surface;
+			}
+
+			weston_log("plane %d: no surface with its modifiers, "
+					"using the default layout\n", sprite->plane_id);
+		}
+	}
+#endif
+
+	return gbm_surface_create(backend->gbm, width, height, format, flags);
+}
+
+int
+ias_format_is_yuv(uint32_t format)
+{
+	switch (format) {
+	case GBM_FORMAT_NV12:
+	case GBM_FORMAT_YUYV:
+	case GBM_FORMAT_YVYU:
+	case GBM_FORMAT_UYVY:
+	case GBM_FORMAT_VYUY:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+int
+ias_sprite_supports_format(struct ias_sprite *sprite, uint32_t format)
+{
+	uint32_t i;
+
+	for (i = 0; i < sprite->count_formats; i++) {
+		if (sprite->formats[i] == format) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * ias_sprite_set_color_properties()
+ *
+ * Ask the plane to convert a YUV framebuffer the same way the GL renderer's
+ * YUV shaders would.  Planes without the properties use their fixed
+ * conversion, which on our hardware is the same BT.601 limited range.
+ */
+void
+ias_sprite_set_color_properties(struct ias_sprite *sprite, struct ias_fb *fb,
+		drmModeAtomicReq *req)
+{
+	if (!ias_format_is_yuv(fb->format)) {
+		return;
+	}
+
+	if (sprite->prop.color_encoding) {
+		drmModeAtomicAddProperty(req, sprite->plane_id,
+				sprite->prop.color_encoding,
+				sprite->color_encoding_bt601);
+	}
+
+	if (sprite->prop.color_range) {
+		drmModeAtomicAddProperty(req, sprite->plane_id,
+				sprite->prop.color_range,
+				sprite->color_range_limited);
+	}
+}
+
 struct ias_fb *
 ias_fb_get_from_bo(struct gbm_bo *bo, struct weston_buffer *buffer,
 		   struct ias_output *output, enum ias_fb_type fb_type)
@@ -1457,6 +1724,7 @@ ias_fb_get_from_bo(struct gbm_bo *bo, struct weston_buffer *buffer,
 	fb->is_client_buffer = 0;
 	fb->buffer_ref.buffer = NULL;
 	fb->is_compressed = 0;
+	fb->frame = 0;
 
 	width = gbm_bo_get_width(bo);
 	height = gbm_bo_get_height(bo);
@@ -1482,7 +1750,11 @@ ias_fb_get_from_bo(struct gbm_bo *bo, struct weston_buffer *buffer,
 
 		if (dmabuf) {
 			for (i = 0; i < dmabuf->attributes.n_planes; i++) {
+#ifdef HAVE_GBM_MODIFIERS
+				handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+#else
 				handles[i] = gbm_bo_get_handle(bo).u32;
+#endif
 				strides[i] = dmabuf->attributes.stride[i];
 				offsets[i] = dmabuf->attributes.offset[i];
 				modifiers[i] = dmabuf->attributes.modifier[i];
@@ -1503,10 +1775,34 @@ ias_fb_get_from_bo(struct gbm_bo *bo, struct weston_buffer *buffer,
 				}
 				handles[0] = gbm_bo_get_handle(bo).u32;
 				handles[1] = gbm_bo_get_handle(bo).u32;
-			} else if (format == GBM_FORMAT_XRGB8888 || format == GBM_FORMAT_ARGB8888) {
+			} else if (format == GBM_FORMAT_XRGB8888 || format == GBM_FORMAT_ARGB8888 ||
+				   format == GBM_FORMAT_YUYV) {
 				strides[0] = gbm_bo_get_stride(bo);
 				handles[0] = gbm_bo_get_handle(bo).u32;
 				offsets[0] = 0;
+#ifdef HAVE_GBM_MODIFIERS
+				/*
+				 * Our own scanouts may have been allocated
+				 * tiled or compressed (CCS has a second, aux
+				 * plane), so describe every plane of the bo.
+				 */
+				modifiers[0] = gbm_bo_get_modifier(bo);
+				if (modifiers[0] != DRM_FORMAT_MOD_INVALID &&
+				    modifiers[0] != DRM_FORMAT_MOD_LINEAR) {
+					for (i = 0; i < gbm_bo_get_plane_count(bo); i++) {
+						handles[i] = gbm_bo_get_handle_for_plane(bo, i).u32;
+						strides[i] = gbm_bo_get_stride_for_plane(bo, i);
+						offsets[i] = gbm_bo_get_offset(bo, i);
+						modifiers[i] = modifiers[0];
+					}
+					flags |= DRM_MODE_FB_MODIFIERS;
+					if (modifiers[0] == I915_FORMAT_MOD_Y_TILED_CCS ||
+					    modifiers[0] == I915_FORMAT_MOD_Yf_TILED_CCS)
+						fb->is_compressed = 1;
+				} else {
+					modifiers[0] = 0;
+				}
+#endif
 			}
 		}
 
@@ -1573,10 +1869,13 @@ ias_fb_get_from_bo(struct gbm_bo *bo, struct weston_buffer *buffer,
  * This function returns the weston_plane for the scanout if the
  * surface is suitable.  Otherwise it returns NULL.
  *
+ * known_flippable skips the output model's is_surface_flippable() test; it
+ * is only set when replaying a cached plane assignment for an unchanged
+ * scene, in which case the test already passed on a previous frame.
  */
 static struct weston_plane *
-ias_attempt_scanout_for_view(struct weston_output *_output,
-		struct weston_view *ev, uint32_t check_xy)
+attempt_scanout_for_view(struct weston_output *_output,
+		struct weston_view *ev, uint32_t check_xy, int known_flippable)
 {
 	struct ias_output *output = (struct ias_output *) _output;
 	struct ias_backend *c =
@@ -1588,6 +1887,7 @@ ias_attempt_scanout_for_view(struct weston_output *_output,
 	struct ias_fb *ias_fb;
 	uint32_t format;
 	uint32_t resolve_needed = 0;
+	uint64_t modifier = DRM_FORMAT_MOD_INVALID;
 	struct ias_sprite *ias_sprite;
 	int i;
 
@@ -1612,24 +1912,16 @@ ias_attempt_scanout_for_view(struct weston_output *_output,
 
 	if (buffer) {
 		if ((dmabuf = linux_dmabuf_buffer_get(buffer->resource))) {
-			struct gbm_import_fd_data gbm_dmabuf = {
-				.fd = dmabuf->attributes.fd[0],
-				.width = dmabuf->attributes.width,
-				.height = dmabuf->attributes.height,
-				.stride = dmabuf->attributes.stride[0],
-				.format = dmabuf->attributes.format
-			};
-
 			for (i = 0; i < dmabuf->attributes.n_planes; i++) {
 				if (dmabuf->attributes.modifier[i] == I915_FORMAT_MOD_Y_TILED_CCS ||
 				    dmabuf->attributes.modifier[i] == I915_FORMAT_MOD_Yf_TILED_CCS) {
 					resolve_needed = 1;
+					modifier = dmabuf->attributes.modifier[i];
 					break;
 				}
 			}
 
-			bo = gbm_bo_import(c->gbm, GBM_BO_IMPORT_FD,
-					   &gbm_dmabuf, GBM_BO_USE_SCANOUT);
+			bo = ias_import_dmabuf(c, dmabuf);
 		} else {
 			bo = gbm_bo_import(c->gbm, GBM_BO_IMPORT_WL_BUFFER,
 					   buffer->resource, GBM_BO_USE_SCANOUT);
@@ -1653,12 +1945,14 @@ ias_attempt_scanout_for_view(struct weston_output *_output,
 	 * Make output specific call to check if this surface is flippable.
 	 * Additionaly check if sprite used for given output is able to resolve given buffer if there is such need.
 	 */
-	if(!ias_crtc->output_model->is_surface_flippable ||
-			!ias_crtc->output_model->is_surface_flippable(ev, _output, check_xy) ||
+	if((!known_flippable &&
+			(!ias_crtc->output_model->is_surface_flippable ||
+			 !ias_crtc->output_model->is_surface_flippable(ev, _output, check_xy))) ||
 			(resolve_needed &&
 				 !(c->rbc_enabled &&
 				   ias_sprite->supports_rbc &&
-				   is_rbc_resolve_possible_on_sprite(0, format)))) {
+				   is_rbc_resolve_possible_on_sprite(ias_sprite, 0,
+						format, modifier)))) {
 		if (resolve_needed && c->rbc_debug) {
 			weston_log("[RBC] Cannot handle compressed buffer on scanout %d, requesing resolve in DRI\n",
 				   output->scanout);
@@ -1681,6 +1975,147 @@ ias_attempt_scanout_for_view(struct weston_output *_output,
 	return &output->fb_plane;
 }
 
+static struct weston_plane *
+ias_attempt_scanout_for_view(struct weston_output *_output,
+		struct weston_view *ev, uint32_t check_xy)
+{
+	return attempt_scanout_for_view(_output, ev, check_xy, 0);
+}
+
+
+/*
+ * ias_output_reset_damage_history()
+ *
+ * Forget which buffers we've seen and what they contain; the next frames
+ * are fully redrawn until every buffer of the scanout has been drawn once.
+ */
+void
+ias_output_reset_damage_history(struct ias_output *output)
+{
+	struct ias_damage_history *history = &output->damage_history;
+
+	history->num_bos = 0;
+	history->locked_bo = NULL;
+}
+
+/*
+ * ias_output_scanout_allocated()
+ *
+ * Called by the output models once an output's scanout surface and its
+ * renderer state have been (re)created.
+ */
+void
+ias_output_scanout_allocated(struct ias_output *output)
+{
+	output->damage_history.enabled =
+		gl_renderer->output_set_external_damage(&output->base, 1);
+
+	ias_output_reset_damage_history(output);
+}
+
+/*
+ * ias_output_scanout_locked()
+ *
+ * Called by the output models once the frame just composited by
+ * ias_output_render() has been locked from the gbm surface, so we know
+ * which buffer now holds that frame.
+ */
+void
+ias_output_scanout_locked(struct ias_output *output, struct ias_fb *fb)
+{
+	struct ias_damage_history *history = &output->damage_history;
+	int i;
+
+	fb->frame = history->frame;
+	history->locked_bo = fb->bo;
+
+	for (i = 0; i < history->num_bos; i++) {
+		if (history->bos[i] == fb->bo) {
+			return;
+		}
+	}
+
+	/*
+	 * More buffers than we expected; we can no longer tell which one EGL
+	 * will hand us next, so stop tracking until the scanout is reset.
+	 */
+	if (history->num_bos == IAS_DAMAGE_HISTORY_LEN) {
+		IAS_DEBUG("Output %s has more than %d scanout buffers",
+				output->name, IAS_DAMAGE_HISTORY_LEN);
+		history->num_bos = -1;
+		return;
+	}
+
+	if (history->num_bos >= 0) {
+		history->bos[history->num_bos++] = fb->bo;
+	}
+}
+
+/*
+ * damage_history_get()
+ *
+ * Work out what has to be drawn into the buffer the gbm surface will hand
+ * us for this frame.  It picks the oldest buffer that isn't locked and only
+ * allocates a new one when all of them are, which is what lets us predict
+ * the buffer's age here instead of assuming there are exactly two.
+ *
+ * Returns 1 for a partial redraw, 0 if 'damage' is the whole output.
+ */
+static int
+damage_history_get(struct ias_output *output,
+		pixman_region32_t *new_damage,
+		pixman_region32_t *damage)
+{
+	struct ias_damage_history *history = &output->damage_history;
+	struct ias_fb *fb;
+	uint32_t oldest = 0;
+	uint32_t f;
+	int i, found = 0;
+
+	for (i = 0; i < history->num_bos; i++) {
+		if (history->bos[i] == history->locked_bo) {
+			continue;
+		}
+
+		fb = gbm_bo_get_user_data(history->bos[i]);
+		f = fb ? fb->frame : 0;
+
+		if (!found || f < oldest) {
+			oldest = f;
+			found = 1;
+		}
+	}
+
+	if (!history->enabled || !found || oldest == 0 ||
+			history->frame - oldest >= IAS_DAMAGE_HISTORY_LEN) {
+		pixman_region32_copy(damage, &output->base.region);
+		return 0;
+	}
+
+	pixman_region32_copy(damage, new_damage);
+	for (f = oldest + 1; f <= history->frame; f++) {
+		pixman_region32_union(damage, damage,
+				&history->damage[f % IAS_DAMAGE_HISTORY_LEN]);
+	}
+
+	return 1;
+}
+
+static void
+damage_history_push(struct ias_output *output, pixman_region32_t *damage)
+{
+	struct ias_damage_history *history = &output->damage_history;
+
+	/* Sequence numbers of 0 mean "unknown", so start over on wrap */
+	if (++history->frame == 0) {
+		history->frame = 1;
+		ias_output_reset_damage_history(output);
+	}
+
+	pixman_region32_copy(
+			&history->damage[history->frame % IAS_DAMAGE_HISTORY_LEN],
+			damage);
+}
 
 /*
  * ias_output_render()
@@ -1705,19 +2140,20 @@ ias_output_render(struct ias_output *output, pixman_region32_t *new_damage)
 	output->scanout_surface = NULL;
 
 	/*
-	 * Combine this frame's damage with previous frame's damage to figure out
-	 * which areas of the scanout need to be drawn (since we swap between
-	 * scanout buffers, we need to accumulate two frames of damage).
+	 * Combine this frame's damage with everything that changed since the
+	 * buffer we're about to draw into was last used.
 	 */
 	pixman_region32_init(&damage);
-	pixman_region32_union(&damage, new_damage, &output->prev_damage);
-
-	/* Save away our new damage so that it can be re-used next frame */
-	pixman_region32_copy(&output->prev_damage, new_damage);
+	if (damage_history_get(output, new_damage, &damage)) {
+		output->damage_history.partial_redraws++;
+	} else {
+		output->damage_history.full_redraws++;
+	}
 
 	/* Bind buffers/contexts in preparation for rendering */
 	ret = ias_crtc->output_model->pre_render(output);
 	if (ret) {
+		pixman_region32_fini(&damage);
 		return;
 	}
 
@@ -1748,6 +2184,28 @@ ias_output_render(struct ias_output *output, pixman_region32_t *new_damage)
 
 	pixman_region32_fini(&damage);
 
+	/*
+	 * Remember what actually changed in this scanout so the flip can pass
+	 * it on as damage clips.  Plugins draw the whole output themselves, so
+	 * we can't say anything about what they touched.
+	 */
+	if (output->plugin || output->disabled) {
+		damage_history_push(output, &output->base.region);
+		output->scanout_damage_valid = 0;
+	} else {
+		damage_history_push(output, new_damage);
+
+		pixman_region32_init(&damage);
+		pixman_region32_copy(&damage, new_damage);
+		pixman_region32_translate(&damage,
+				-output->base.x, -output->base.y);
+		weston_transformed_region(output->base.width, output->base.height,
+				output->base.transform, output->base.current_scale,
+				&damage, &output->scanout_damage);
+		pixman_region32_fini(&damage);
+		output->scanout_damage_valid = 1;
+	}
+
 	wl_signal_emit(&output->base.frame_signal, output);
 
 	/* Complete rendering process */
@@ -1755,6 +2213,42 @@ ias_output_render(struct ias_output *output, pixman_region32_t *new_damage)
 	TRACEPOINT_ONCE("Backend post render complete");
 }
 
+/*
+ * ias_output_create_damage_blob()
+ *
+ * Build an FB_DAMAGE_CLIPS blob describing what changed in 'fb' since the
+ * last scanout of this output.  *blob_id is left at 0 (full update) for
+ * client buffers or when the damage isn't known.  The caller owns the blob
+ * and should destroy it once the commit referencing it has been queued.
+ */
+int
+ias_output_create_damage_blob(struct ias_output *output,
+		struct ias_fb *fb,
+		uint32_t *blob_id)
+{
+	struct ias_backend *b = (struct ias_backend *)
+		output->base.compositor->backend;
+	int32_t w, h;
+
+	*blob_id = 0;
+
+	if (!fb || fb->is_client_buffer || !output->scanout_damage_valid) {
+		return 0;
+	}
+
+	w = output->base.width * output->base.current_scale;
+	h = output->base.height * output->base.current_scale;
+	if (output->base.transform & WL_OUTPUT_TRANSFORM_90) {
+		int32_t t = w;
+		w = h;
+		h = t;
+	}
+
+	return ias_damage_create_blob(b->drm.fd, &output->scanout_damage, w, h,
+			gbm_bo_get_width(fb->bo), gbm_bo_get_height(fb->bo),
+			blob_id);
+}
+
 static void
 vblank_handler(int fd,
 		unsigned int frame,
@@ -2136,12 +2630,244 @@ ias_attempt_cursor_for_view(struct ias_crtc *ias_crtc,
 }
 
 
+/*
+ * Number of frames between plane cache statistics reports when
+ * plane_cache_debug is enabled.
+ */
+#define PLANE_CACHE_REPORT_INTERVAL 600
+
+static inline uint32_t
+plane_cache_hash(uint32_t hash, uint32_t value)
+{
+	int i;
+
+	/* FNV-1a, one byte at a time */
+	for (i = 0; i < 4; i++) {
+		hash ^= (value >> (i * 8)) & 0xff;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline uint32_t
+plane_cache_hash_ptr(uint32_t hash, const void *ptr)
+{
+	uint64_t value = (uint64_t)(uintptr_t)ptr;
+
+	hash = plane_cache_hash(hash, (uint32_t)value);
+	return plane_cache_hash(hash, (uint32_t)(value >> 32));
+}
+
+static inline uint32_t
+plane_cache_hash_box(uint32_t hash, const pixman_box32_t *box)
+{
+	hash = plane_cache_hash(hash, box->x1);
+	hash = plane_cache_hash(hash, box->y1);
+	hash = plane_cache_hash(hash, box->x2);
+	return plane_cache_hash(hash, box->y2);
+}
+
+/*
+ * plane_cache_signature()
+ *
+ * Computes a signature for everything the plane assignment tests in
+ * ias_assign_planes() depend on: the output geometry and the stacking order,
+ * geometry, buffer type/format and opacity of every view on the output,
+ * and whether the CRTC's cursor plane still works.
+ * Buffer contents and identity are deliberately left out so that a client
+ * flipping a new buffer every frame still hits the cache.
+ */
+static uint32_t
+plane_cache_signature(struct ias_output *ias_output, int *num_views)
+{
+	struct weston_output *output = &ias_output->base;
+	struct weston_compositor *compositor = output->compositor;
+	struct weston_view *ev;
+	struct weston_surface *surface;
+	struct weston_buffer *buffer;
+	struct linux_dmabuf_buffer *dmabuf;
+	uint32_t hash = 2166136261u;
+	EGLint format;
+	int count = 0;
+
+	hash = plane_cache_hash(hash, output->x);
+	hash = plane_cache_hash(hash, output->y);
+	hash = plane_cache_hash(hash, output->current_mode->width);
+	hash = plane_cache_hash(hash, output->current_mode->height);
+	hash = plane_cache_hash(hash, ias_output->width);
+	hash = plane_cache_hash(hash, ias_output->height);
+	hash = plane_cache_hash(hash,
+			ias_output->ias_crtc->current_mode->base.width);
+	hash = plane_cache_hash(hash,
+			ias_output->ias_crtc->current_mode->base.height);
+	hash = plane_cache_hash(hash, ias_output->ias_crtc->cursors_are_broken);
+
+	wl_list_for_each(ev, &compositor->view_list, link) {
+		if (!(ev->output_mask & (1 << output->id)))
+			continue;
+
+		surface = ev->surface;
+		buffer = surface->buffer_ref.buffer;
+
+		hash = plane_cache_hash_ptr(hash, ev);
+		hash = plane_cache_hash_ptr(hash, surface);
+		hash = plane_cache_hash(hash, ev->output_mask);
+		hash = plane_cache_hash(hash, ev->transform.enabled);
+		hash = plane_cache_hash(hash, (int32_t)ev->geometry.x);
+		hash = plane_cache_hash(hash, (int32_t)ev->geometry.y);
+		hash = plane_cache_hash_box(hash,
+				&ev->transform.boundingbox.extents);
+		hash = plane_cache_hash_box(hash, &surface->opaque.extents);
+		hash = plane_cache_hash(hash, surface->width);
+		hash = plane_cache_hash(hash, surface->height);
+
+		if (buffer) {
+			hash = plane_cache_hash(hash, buffer->width);
+			hash = plane_cache_hash(hash, buffer->height);
+			hash = plane_cache_hash(hash,
+					wl_shm_buffer_get(buffer->resource) != NULL);
+
+			dmabuf = linux_dmabuf_buffer_get(buffer->resource);
+			if (dmabuf) {
+				hash = plane_cache_hash(hash,
+						dmabuf->attributes.format);
+				hash = plane_cache_hash(hash,
+						(uint32_t)dmabuf->attributes.modifier[0]);
+				hash = plane_cache_hash(hash,
+						(uint32_t)(dmabuf->attributes.modifier[0] >> 32));
+			} else if (buffer->legacy_buffer &&
+				   gl_renderer->query_buffer(compositor,
+						buffer->legacy_buffer,
+						EGL_TEXTURE_FORMAT, &format)) {
+				/* wl_drm buffers: RGB vs RGBA decides whether
+				 * a view can go on an opaque plane */
+				hash = plane_cache_hash(hash, format);
+			}
+		} else {
+			hash = plane_cache_hash(hash, 0xffffffff);
+		}
+
+		count++;
+	}
+
+	*num_views = count;
+	return plane_cache_hash(hash, count);
+}
+
+/*
+ * plane_cache_record()
+ *
+ * Appends a view's plane decision to the output's cache while the cache is
+ * being rebuilt.
+ */
+static void
+plane_cache_record(struct ias_plane_cache *cache, struct weston_view *ev,
+		enum ias_plane_choice choice, int keep_buffer)
+{
+	struct ias_plane_decision *decisions;
+	int max;
+
+	if (cache->num_decisions == cache->max_decisions) {
+		max = cache->max_decisions ? cache->max_decisions * 2 : 16;
+		decisions = realloc(cache->decisions, max * sizeof *decisions);
+		if (!decisions) {
+			cache->valid = 0;
+			return;
+		}
+		cache->decisions = decisions;
+		cache->max_decisions = max;
+	}
+
+	cache->decisions[cache->num_decisions].view = ev;
+	cache->decisions[cache->num_decisions].choice = choice;
+	cache->decisions[cache->num_decisions].keep_buffer = keep_buffer;
+	cache->num_decisions++;
+}
+
+/*
+ * plane_cache_replay()
+ *
+ * Applies the cached plane decisions for an unchanged scene.  The view list
+ * is walked in the same order it was when the cache was built; the signature
+ * covers the view pointers and their order, so decisions line up one to one.
+ *
+ * Returns 0 on success.  If a cached scanout can't actually be flipped this
+ * frame (e.g., the buffer import failed), the view falls back to the primary
+ * plane and -1 is returned so the cache gets rebuilt on the next frame.
+ */
+static int
+plane_cache_replay(struct ias_output *ias_output)
+{
+	struct weston_output *output = &ias_output->base;
+	struct ias_crtc *ias_crtc = ias_output->ias_crtc;
+	struct ias_plane_cache *cache = &ias_output->plane_cache;
+	struct weston_plane *primary_plane = &output->compositor->primary_plane;
+	struct weston_plane *next_plane;
+	struct weston_view *ev, *next;
+	struct ias_plane_decision *decision = cache->decisions;
+	int ret = 0;
+
+	wl_list_for_each_safe(ev, next, &output->compositor->view_list, link) {
+		if (!(ev->output_mask & (1 << output->id)))
+			continue;
+
+		assert(decision->view == ev);
+
+		if (decision->keep_buffer) {
+			ev->surface->keep_buffer = 1;
+		}
+
+		switch (decision->choice) {
+		case IAS_PLANE_CHOICE_CURSOR:
+			ias_crtc->cursor_view = ev;
+			next_plane = &ias_crtc->cursor_plane;
+			break;
+		case IAS_PLANE_CHOICE_SCANOUT:
+			next_plane = attempt_scanout_for_view(output, ev, 1, 1);
+			if (!next_plane) {
+				next_plane = primary_plane;
+				ret = -1;
+			}
+			break;
+		case IAS_PLANE_CHOICE_PRIMARY:
+		default:
+			next_plane = primary_plane;
+			break;
+		}
+
+		weston_view_move_to_plane(ev, next_plane);
+		decision++;
+	}
+
+	return ret;
+}
+
+static void
+plane_cache_report(struct ias_output *ias_output)
+{
+	struct ias_plane_cache *cache = &ias_output->plane_cache;
+	uint32_t total = cache->hits + cache->misses;
+
+	if (total && (total % PLANE_CACHE_REPORT_INTERVAL) == 0) {
+		weston_log("[plane cache] %s: %u hits, %u misses (%u%% hit rate)\n",
+				ias_output->name, cache->hits, cache->misses,
+				cache->hits * 100 / total);
+	}
+}
+
 /*
  * ias_assign_planes()
  *
  * Try to assign surfaces to hardware planes.  We may assign surfaces to a
  * cursor or sprite plane, or we may decide to flip to a client buffer directly
  * onto the display plane.
+ *
+ * In steady state the scene doesn't change from one frame to the next, so
+ * the decisions made here are cached per output along with a signature of
+ * the scene (see plane_cache_signature()).  If the signature matches on the
+ * next frame, the previous decisions are replayed without running the
+ * cursor/scanout eligibility tests again.
  */
 static void
 ias_assign_planes(struct weston_output *output, void *repaint_data)
@@ -2153,6 +2879,10 @@ ias_assign_planes(struct weston_output *output, void *repaint_data)
 	struct ias_crtc *ias_crtc = ias_output->ias_crtc;
 	struct ias_output_model *output_model = ias_crtc->output_model;
 	struct ias_backend *backend = ias_crtc->backend;
+	struct ias_plane_cache *cache = &ias_output->plane_cache;
+	enum ias_plane_choice choice;
+	uint32_t signature = 0;
+	int use_cache, num_views, flippable, scanout_assigned = 0;
 
 	/*
 	 * If this output model can neither flip client surfaces or use a hardware
@@ -2169,6 +2899,43 @@ ias_assign_planes(struct weston_output *output, void *repaint_data)
 	ias_crtc->last_cursor_view = ias_crtc->cursor_view;
 	ias_crtc->cursor_view = NULL;
 
+	/*
+	 * Layout plugins take over plane assignment themselves, so only cache
+	 * decisions for the regular compositing path.
+	 */
+	use_cache = backend->use_plane_cache && !ias_output->plugin;
+
+	if (use_cache) {
+		signature = plane_cache_signature(ias_output, &num_views);
+
+		if (cache->valid && cache->signature == signature &&
+				cache->num_decisions == num_views) {
+			cache->hits++;
+			TL_POINT("ias_plane_cache_hit", TLP_OUTPUT(output), TLP_END);
+			if (backend->plane_cache_debug) {
+				plane_cache_report(ias_output);
+			}
+
+			if (plane_cache_replay(ias_output)) {
+				cache->valid = 0;
+			}
+			return;
+		}
+
+		cache->misses++;
+		TL_POINT("ias_plane_cache_miss", TLP_OUTPUT(output), TLP_END);
+		if (backend->plane_cache_debug) {
+			plane_cache_report(ias_output);
+		}
+
+		/* Rebuild the decision list while walking the views below */
+		cache->valid = 1;
+		cache->signature = signature;
+		cache->num_decisions = 0;
+	} else {
+		cache->valid = 0;
+	}
+
 	/*
 	 * Track the area of all surfaces above that will overlap with future
 	 * surfaces.
@@ -2184,9 +2951,9 @@ ias_assign_planes(struct weston_output *output, void *repaint_data)
 		 * Surfaces that can be flipped onto the display plane or the cursor plane
 		 * need to have their buffer kept around.
 		 */
-		if((ias_crtc->output_model->is_surface_flippable &&
-			ias_crtc->output_model->is_surface_flippable(ev, output, 1)) ||
-			is_surface_flippable_on_cursor(ias_crtc, ev)) {
+		flippable = ias_crtc->output_model->is_surface_flippable &&
+			ias_crtc->output_model->is_surface_flippable(ev, output, 1);
+		if(flippable || is_surface_flippable_on_cursor(ias_crtc, ev)) {
 			ev->surface->keep_buffer = 1;
 		}
 
@@ -2230,6 +2997,38 @@ ias_assign_planes(struct weston_output *output, void *repaint_data)
 				next_plane = primary_plane;
 			}
 
+			if (use_cache) {
+				if (next_plane == &ias_crtc->cursor_plane) {
+					choice = IAS_PLANE_CHOICE_CURSOR;
+				} else if (next_plane == &ias_output->fb_plane) {
+					choice = IAS_PLANE_CHOICE_SCANOUT;
+					scanout_assigned = 1;
+				} else {
+					choice = IAS_PLANE_CHOICE_PRIMARY;
+
+					/*
+					 * A flippable, unobscured view that still ended up on
+					 * the primary plane was rejected for a reason the
+					 * signature doesn't capture (scanout still pending,
+					 * failed import, RBC).  Don't cache that; try again next frame.
+					 */
+					if (flippable && output_model->can_client_flip &&
+							!scanout_assigned &&
+							!pixman_region32_not_empty(&surface_overlap)) {
+						cache->valid = 0;
+					}
+				}
+
+				/*
+				 * keep_buffer only ever gets set here; record whatever
+				 * the tests above and below decided for this view.
+				 */
+				plane_cache_record(cache, ev, choice,
+						ev->surface->keep_buffer ||
+						(ev->surface->role_name &&
+						 !strcmp(ev->surface->role_name, "ivi_surface")));
+			}
+
 			/*
 			 * Let weston figure out what needs to be damaged when using this
 			 * plane to present this surface.
@@ -2350,6 +3149,7 @@ ias_output_destroy(struct weston_output *output_base)
 	struct ias_backend *c =
 		(struct ias_backend *) output->base.compositor->backend;
 	struct ias_mode *ias_mode, *next;
+	int i;
 
 	/*
 	 * If this was a non-dualview / non-stereo setup, we might have been
@@ -2360,6 +3160,12 @@ ias_output_destroy(struct weston_output *output_base)
 	weston_plane_release(&output->fb_plane);
 	weston_output_release(&output->base);
 
+	free(output->plane_cache.decisions);
+	pixman_region32_fini(&output->scanout_damage);
+	for (i = 0; i < IAS_DAMAGE_HISTORY_LEN; i++) {
+		pixman_region32_fini(&output->damage_history.damage[i]);
+	}
+
 	wl_list_for_each_safe(ias_mode, next, &output->ias_crtc->mode_list, link) {
 		wl_list_remove(&ias_mode->link);
 		free(ias_mode);
@@ -2606,6 +3412,7 @@ destroy_sprites_atomic(struct ias_backend *backend)
 				drmModeRmFB(backend->drm.fd, sprite->current->fb_id);
 			}
 
+			ias_plane_formats_release(&sprite->in_formats);
 			free(sprite);
 		}
 
@@ -2643,6 +3450,7 @@ destroy_sprites(struct ias_backend *backend)
 				drmModeRmFB(backend->drm.fd, sprite->current->fb_id);
 			}
 
+			ias_plane_formats_release(&sprite->in_formats);
 			free(sprite);
 		}
 	}
@@ -3342,6 +4150,36 @@ atomic_ioctl_supported(int fd)
 	}
 }
 
+/*
+ * Can any plane scan out 'format' with 'modifier'?  Kernels without
+ * IN_FORMATS don't tell us, so we assume they can as we always did.
+ */
+static int
+scanout_modifier_supported(struct weston_compositor *compositor,
+		int format, uint64_t modifier)
+{
+	struct ias_backend *backend = (struct ias_backend *)compositor->backend;
+	struct ias_crtc *ias_crtc;
+	struct ias_sprite *sprite;
+	int have_in_formats = 0;
+
+	wl_list_for_each(ias_crtc, &backend->crtc_list, link) {
+		wl_list_for_each(sprite, &ias_crtc->sprite_list, link) {
+			if (!sprite->in_formats.count) {
+				continue;
+			}
+
+			have_in_formats = 1;
+			if (ias_plane_formats_has_modifier(&sprite->in_formats,
+					format, modifier)) {
+				return 1;
+			}
+		}
+	}
+
+	return !have_in_formats;
+}
+
 static int
 render_buffer_compression_supported(struct ias_backend *backend)
 {
@@ -3649,6 +4487,21 @@ capture_frame_notify(struct wl_listener *listener, void *data)
 		return;
 	}
 
+	/* get_next_fb() cannot fail in this case, since we have just been
+	 * notified that a frame is available. */
+	fb = output->ias_crtc->output_model->get_next_fb(output);
+
+	/*
+	 * Nothing on screen changed since the last frame we handed over, so
+	 * the remote end already has this content; don't re-encode it.  Only
+	 * ias_output_render() keeps scanout_damage up to date, so a flipped
+	 * client buffer is always captured.
+	 */
+	if (!fb->is_client_buffer && output->scanout_damage_valid &&
+			!pixman_region32_not_empty(&output->scanout_damage)) {
+		return;
+	}
+
 	if (capture_proxy_profiling_is_enabled(output->cp)) {
 		struct timespec start_spec;
 
@@ -3658,9 +4511,6 @@ capture_frame_notify(struct wl_listener *listener, void *data)
 					capture_get_frame_count(output->cp), start);
 	}
 
-	/* get_next_fb() cannot fail in this case, since we have just been
-	 * notified that a frame is available. */
-	fb = output->ias_crtc->output_model->get_next_fb(output);
 	handle = gbm_bo_get_handle(fb->bo).u32;
 
 	ret = drmPrimeHandleToFD(c->drm.fd, handle,
@@ -4021,7 +4871,9 @@ start_capture(struct wl_client *client,
 		output->capture_proxy_frame_listener.notify = capture_frame_notify;
 		wl_signal_add(&output->next_scanout_ready_signal,
 			&output->capture_proxy_frame_listener);
-		weston_output_schedule_repaint(&output->base);
+
+		/* Frames without damage aren't sent, so force a full first frame */
+		weston_output_damage(&output->base);
 
 		if (profile) {
 			capture_proxy_enable_profiling(output->cp, 1);
@@ -4030,6 +4882,11 @@ start_capture(struct wl_client *client,
 		capture_proxy_set_verbose(output->cp, verbose);
 		capture_proxy_set_resource(output->cp, resource);
 		output->base.disable_planes++;
+
+		/* Move off any layout the encoder can't import */
+		if (output->scanout_modifiers != scanout_modifiers_allowed(output)) {
+			ias_crtc_reallocate_scanout(output->ias_crtc);
+		}
 	}
 
 	weston_log("start_capture done.\n");
@@ -4086,6 +4943,10 @@ stop_capture(struct wl_client *client,
 
 		weston_log("Stopping capture for output %d.\n", output_number);
 		capture_proxy_destroy_from_output(output);
+
+		if (output->scanout_modifiers != scanout_modifiers_allowed(output)) {
+			ias_crtc_reallocate_scanout(output->ias_crtc);
+		}
 	}
 
 	weston_log("stop_capture done.\n");
@@ -4346,6 +5207,7 @@ ias_compositor_create(struct weston_compositor *compositor,
 		      struct weston_ias_backend_config *config)
 {
 	struct ias_backend *backend;
+	struct ias_crtc *ias_crtc;
 	struct udev_enumerate *e;
 	struct udev_device *drm_device;
 	const char *path;
@@ -4375,6 +5237,8 @@ ias_compositor_create(struct weston_compositor *compositor,
 
 	backend->print_fps = print_fps;
 	backend->no_flip_event = no_flip_event;
+	backend->use_plane_cache = use_plane_cache;
+	backend->plane_cache_debug = plane_cache_debug;
 
 	if (config->gbm_format) {
 		if (strcmp(config->gbm_format, "xrgb8888") == 0)
@@ -4572,12 +5436,23 @@ ias_compositor_create(struct weston_compositor *compositor,
 		 * flag to it.
 		 */
 		gl_renderer->rbc = use_rbc;
+		gl_renderer->scanout_modifier_supported = scanout_modifier_supported;
 		backend->rbc_supported = render_buffer_compression_supported(backend);
 		backend->rbc_enabled = backend->rbc_supported && use_rbc && !has_overlapping_outputs(backend);
 		if (backend->rbc_debug) {
 			weston_log("[RBC] RBC support in DRM = %d\n", backend->rbc_supported);
 			weston_log("[RBC] RBC enabled in compositor = %d\n", backend->rbc_enabled);
 		}
+
+		/*
+		 * The scanouts were allocated by create_crtcs() before we knew,
+		 * so give them the chance to use compressed layouts now.
+		 */
+		if (backend->rbc_enabled) {
+			wl_list_for_each(ias_crtc, &backend->crtc_list, link) {
+				ias_crtc_reallocate_scanout(ias_crtc);
+			}
+		}
 	}
 
 	if (compositor->renderer->import_dmabuf) {
@@ -4762,14 +5637,22 @@ assign_zorder_to_sprite(struct weston_output *output,
 
 /*
  * Checks if compressed buffer meets all requrements to be resolved in display controller.
- * Assumes that buffer is Y or Yf tiled with CSS enabled.
+ * Assumes that buffer is Y or Yf tiled with CSS enabled.  Planes that list
+ * their modifiers are asked directly; for the others we only know that
+ * 32bpp RGB works.
  */
 static uint32_t
-is_rbc_resolve_possible_on_sprite(uint32_t rotation, uint32_t format) {
+is_rbc_resolve_possible_on_sprite(struct ias_sprite *sprite,
+		uint32_t rotation, uint32_t format, uint64_t modifier) {
 	if (rotation != 0 && rotation != 180) {
 		return 0;
 	}
 
+	if (sprite->in_formats.count) {
+		return ias_plane_formats_has_modifier(&sprite->in_formats,
+				format, modifier);
+	}
+
 	if (format != GBM_FORMAT_ARGB8888 && format != GBM_FORMAT_XRGB8888) {
 		return 0;
 	}
@@ -4884,6 +5767,8 @@ assign_view_to_sprite(struct weston_view *view,
 	struct gbm_bo *bo;
 	uint32_t format;
 	uint32_t resolve_needed = 0;
+	uint64_t modifier = DRM_FORMAT_MOD_INVALID;
+	uint32_t format_unsupported = 0;
 	uint32_t downscaling = 0;
 	struct linux_dmabuf_buffer *dmabuf;
 	int i;
@@ -4909,24 +5794,16 @@ assign_view_to_sprite(struct weston_view *view,
 
 	/* Import the surface buffer as a GBM bo that we can flip */
 	if ((dmabuf = linux_dmabuf_buffer_get(surface->buffer_ref.buffer->resource))) {
-		struct gbm_import_fd_data gbm_dmabuf = {
-			.fd = dmabuf->attributes.fd[0],
-			.width = dmabuf->attributes.width,
-			.height = dmabuf->attributes.height,
-			.stride = dmabuf->attributes.stride[0],
-			.format = dmabuf->attributes.format
-		};
-
 		for (i = 0; i < dmabuf->attributes.n_planes; i++) {
 			if (dmabuf->attributes.modifier[i] == I915_FORMAT_MOD_Y_TILED_CCS ||
 			    dmabuf->attributes.modifier[i] == I915_FORMAT_MOD_Yf_TILED_CCS) {
 				resolve_needed = 1;
+				modifier = dmabuf->attributes.modifier[i];
 				break;
 			}
 		}
 
-		bo = gbm_bo_import(backend->gbm, GBM_BO_IMPORT_FD,
-				   &gbm_dmabuf, GBM_BO_USE_SCANOUT);
+		bo = ias_import_dmabuf(backend, dmabuf);
 	} else {
 		bo = gbm_bo_import(backend->gbm, GBM_BO_IMPORT_WL_BUFFER,
 				   surface->buffer_ref.buffer->resource, GBM_BO_USE_SCANOUT);
@@ -4949,11 +5826,23 @@ assign_view_to_sprite(struct weston_view *view,
 	wl_list_for_each(ias_sprite, &ias_crtc->sprite_list, link) {
 		if (ias_sprite->type == DRM_PLANE_TYPE_OVERLAY ||
 			(backend->use_cursor_as_uplane && ias_sprite->type == DRM_PLANE_TYPE_CURSOR)) {
+			/*
+			 * Not every plane can scan out every format (YUV in
+			 * particular is often limited to a few planes), so
+			 * skip the ones that don't list it.  If none do, the
+			 * caller composites the view with GL instead.
+			 */
+			if (!ias_sprite_supports_format(ias_sprite, format)) {
+				format_unsupported = 1;
+				continue;
+			}
+
 			if (*sprite_id == 0) {
 				if (ias_sprite->locked) continue;
 				if (resolve_needed && !(backend->rbc_enabled &&
 							ias_sprite->supports_rbc &&
-							is_rbc_resolve_possible_on_sprite(0, format))) {
+							is_rbc_resolve_possible_on_sprite(ias_sprite, 0,
+								format, modifier))) {
 					continue;
 				}
 				sprite = ias_sprite;
@@ -4962,7 +5851,8 @@ assign_view_to_sprite(struct weston_view *view,
 			} else if (ias_sprite->plane_id == *sprite_id) {
 				if (resolve_needed && !(backend->rbc_enabled &&
 							ias_sprite->supports_rbc &&
-							is_rbc_resolve_possible_on_sprite(0, format))) {
+							is_rbc_resolve_possible_on_sprite(ias_sprite, 0,
+								format, modifier))) {
 					continue;
 				}
 				//if (ias_sprite->locked) continue;
@@ -4985,6 +5875,10 @@ assign_view_to_sprite(struct weston_view *view,
 			weston_log("No RBC capable sprite available");
 		}
 
+		if (format_unsupported) {
+			IAS_DEBUG("No free sprite can scan out format 0x%08x", format);
+		}
+
 		gbm_bo_destroy(bo);
 		return NULL;
 	}
@@ -5294,6 +6188,10 @@ void backend_begin(void *userdata, const char **attrs) {
 			use_cursor_as_uplane = atoi(attrs[1]);
 		} else if (strcmp(attrs[0], "vm_share_only") == 0) {
 			vm_share_only = atoi(attrs[1]);
+		} else if (strcmp(attrs[0], "plane_cache") == 0) {
+			use_plane_cache = atoi(attrs[1]);
+		} else if (strcmp(attrs[0], "plane_cache_debug") == 0) {
+			plane_cache_debug = atoi(attrs[1]);
 		}
 
 		attrs += 2;
@@ -887,7 +887,6 @@ xf_peer_activate(freerdp_peer* client)
 	rdpSettings *settings;
 	rdpPointerUpdate *pointer;
 	struct rdp_peers_item *peersItem;
-	struct xkb_context *xkbContext;
 	struct xkb_rule_names xkbRuleNames;
 	struct xkb_keymap *keymap;
 	struct weston_output *weston_output;
@@ -965,15 +964,9 @@ xf_peer_activate(freerdp_peer* client)
 	}
 
 	keymap = NULL;
-	if (xkbRuleNames.layout) {
-		xkbContext = xkb_context_new(0);
-		if (!xkbContext) {
-			weston_log("unable to create a xkb_context\n");
-			return FALSE;
-		}
-
-		keymap = xkb_keymap_new_from_names(xkbContext, &xkbRuleNames, 0);
-	}
+	if (xkbRuleNames.layout)
+		keymap = weston_compositor_get_keymap(b->compositor,
+						      &xkbRuleNames);
 
 	if (settings->ClientHostname)
 		snprintf(seat_name, sizeof(seat_name), "RDP %s", settings->ClientHostname);
@@ -989,6 +982,7 @@ xf_peer_activate(freerdp_peer* client)
 
 	weston_seat_init(peersItem->seat, b->compositor, seat_name);
 	weston_seat_init_keyboard(peersItem->seat, keymap);
+	xkb_keymap_unref(keymap);
 	weston_seat_init_pointer(peersItem->seat);
 
 	peersItem->flags |= RDP_PEER_ACTIVATED;
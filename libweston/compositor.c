@@ -54,6 +54,7 @@
 #include "timeline.h"
 
 #include "compositor.h"
+#include "input-latency.h"
 #include "viewporter-server-protocol.h"
 #include "presentation-time-server-protocol.h"
 #include "shared/helpers.h"
@@ -3234,6 +3235,8 @@ surface_commit(struct wl_client *client, struct wl_resource *resource)
 		return;
 	}
 
+	weston_input_latency_commit(surface->compositor, surface);
+
 	if (sub) {
 		weston_subsurface_commit(sub);
 		return;
@@ -5458,6 +5461,8 @@ weston_compositor_create(struct wl_display *display, void *user_data)
 	wl_list_init(&ec->touch_binding_list);
 	wl_list_init(&ec->axis_binding_list);
 	wl_list_init(&ec->debug_binding_list);
+	wl_list_init(&ec->xkb_info_list);
+	wl_list_init(&ec->xkb_keymap_cache);
 
 	wl_list_init(&ec->plugin_api_list);
 
@@ -5729,6 +5734,7 @@ weston_compositor_destroy(struct weston_compositor *compositor)
 
 	weston_plugin_api_destroy_list(compositor);
 
+	free(compositor->input_latency);
 	free(compositor);
 }
 
@@ -93,6 +93,7 @@ struct weston_pointer;
 struct linux_dmabuf_buffer;
 struct weston_recorder;
 struct weston_pointer_constraint;
+struct weston_input_latency;
 
 enum weston_keyboard_modifier {
 	MODIFIER_CTRL = (1 << 0),
@@ -470,6 +471,26 @@ struct weston_pointer {
 };
 
 
+#define WESTON_TOUCH_RESAMPLE_MAX_POINTS 16
+
+struct weston_touch_resample_point {
+	/* Last two raw samples; index 1 is the newest */
+	struct timespec time[2];
+	wl_fixed_t x[2], y[2];
+	int samples;
+	bool pending;
+};
+
+struct weston_touch_resample {
+	bool enabled;
+	int32_t prediction_usec;
+	struct wl_event_source *timer;
+	bool timer_armed;
+	/* Something reached the grab since the last frame was sent */
+	bool needs_frame;
+	struct weston_touch_resample_point points[WESTON_TOUCH_RESAMPLE_MAX_POINTS];
+};
+
 struct weston_touch {
 	struct weston_seat *seat;
 
@@ -491,6 +512,9 @@ struct weston_touch {
 	struct timespec grab_time;
 
 	struct wl_list timestamps_list;
+
+	/* Per-frame motion resampling, see weston_touch_set_resampling() */
+	struct weston_touch_resample resample;
 };
 
 void
@@ -590,6 +614,9 @@ weston_touch_start_grab(struct weston_touch *device,
 			struct weston_touch_grab *grab);
 void
 weston_touch_end_grab(struct weston_touch *touch);
+void
+weston_touch_set_resampling(struct weston_touch *touch, bool enabled,
+			    int32_t prediction_usec);
 
 bool
 weston_touch_has_focus_resource(struct weston_touch *touch);
@@ -630,12 +657,16 @@ weston_touch_start_drag(struct weston_touch *touch,
 			struct weston_surface *icon,
 			struct wl_client *client);
 
+/*
+ * Keyboards using the same xkb_keymap share one weston_xkb_info, and with it
+ * one sealed keymap file that is sent to every wl_keyboard resource.
+ */
 struct weston_xkb_info {
 	struct xkb_keymap *keymap;
 	int keymap_fd;
 	size_t keymap_size;
-	char *keymap_area;
 	int32_t ref_count;
+	struct wl_list link; /* weston_compositor::xkb_info_list */
 	xkb_mod_index_t shift_mod;
 	xkb_mod_index_t caps_mod;
 	xkb_mod_index_t ctrl_mod;
@@ -1060,6 +1091,8 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info *xkb_info;
+	struct wl_list xkb_info_list; /* weston_xkb_info::link */
+	struct wl_list xkb_keymap_cache; /* compiled keymaps by RMLVO names */
 
 	/* Raw keyboard processing (no libxkbcommon initialization or handling) */
 	int use_xkbcommon;
@@ -1096,6 +1129,13 @@ struct weston_compositor {
 	 * it
 	 */
 	void *input_view;
+
+	/* Input latency histograms, NULL unless a module enabled them */
+	struct weston_input_latency *input_latency;
+
+	/* Touch resampling defaults for newly created seats */
+	bool touch_resample;
+	int32_t touch_prediction_usec;
 };
 
 struct weston_buffer {
@@ -1419,6 +1459,10 @@ struct weston_surface {
 
 	/* An list of per seat pointer constraints. */
 	struct wl_list pointer_constraints;
+
+	/* When the oldest input event not yet answered by a commit was sent
+	 * to this surface, in CLOCK_MONOTONIC usec; 0 if none. */
+	uint64_t input_latency_usec;
 };
 
 struct weston_subsurface {
@@ -1916,6 +1960,9 @@ weston_seat_release(struct weston_seat *seat);
 int
 weston_compositor_set_xkb_rule_names(struct weston_compositor *ec,
 				     struct xkb_rule_names *names);
+struct xkb_keymap *
+weston_compositor_get_keymap(struct weston_compositor *ec,
+			     const struct xkb_rule_names *names);
 void
 weston_compositor_xkb_destroy(struct weston_compositor *ec);
 
@@ -1132,10 +1132,14 @@ gl_renderer_repaint_output_base(struct weston_output *output,
 	pixman_region32_init(&total_damage);
 	pixman_region32_init(&buffer_damage);
 
-	output_get_damage(output, &buffer_damage, &border_damage);
-	output_rotate_damage(output, output_damage, go->border_status);
+	if (go->external_damage) {
+		pixman_region32_copy(&total_damage, output_damage);
+	} else {
+		output_get_damage(output, &buffer_damage, &border_damage);
+		output_rotate_damage(output, output_damage, go->border_status);
 
-	pixman_region32_union(&total_damage, &buffer_damage, output_damage);
+		pixman_region32_union(&total_damage, &buffer_damage, output_damage);
+	}
 	border_damage |= go->border_status;
 
 	repaint_views(output, &total_damage);
@@ -2056,11 +2060,16 @@ gl_renderer_query_dmabuf_modifiers(struct weston_compositor *wc, int format,
 		/*
 		 * Either the rbc flag is turned on, in which case we shouldn't filter
 		 * out RBC modifiers. OR if it is turned off, then we should filter
-		 * them out.
+		 * them out.  RBC modifiers also go if the backend can't scan
+		 * them out for this format.
 		 */
-		if(gl_renderer_interface.rbc ||
-			(temp_modifiers[i] != I915_FORMAT_MOD_Y_TILED_CCS &&
-			temp_modifiers[i] != I915_FORMAT_MOD_Yf_TILED_CCS)) {
+		if (temp_modifiers[i] != I915_FORMAT_MOD_Y_TILED_CCS &&
+			temp_modifiers[i] != I915_FORMAT_MOD_Yf_TILED_CCS) {
+			(*modifiers)[j++] = temp_modifiers[i];
+		} else if (gl_renderer_interface.rbc &&
+			(!gl_renderer_interface.scanout_modifier_supported ||
+			 gl_renderer_interface.scanout_modifier_supported(wc,
+					format, temp_modifiers[i]))) {
 			(*modifiers)[j++] = temp_modifiers[i];
 		}
 	}
@@ -3256,6 +3265,22 @@ gl_renderer_swap_output_buffers(struct weston_output *output)
 	}
 }
 
+static int
+gl_renderer_output_set_external_damage(struct weston_output *output,
+				       int enable)
+{
+	struct gl_renderer *gr = get_renderer(output->compositor);
+	struct gl_output_state *go = get_output_state(output);
+
+	/* Without buffer age EGL promises nothing about old buffer contents */
+	if (!gr->has_egl_buffer_age)
+		enable = 0;
+
+	go->external_damage = enable;
+
+	return enable;
+}
+
 static int
 gl_renderer_get_num_textures(struct weston_surface *surface)
 {
@@ -4088,4 +4113,5 @@ WL_EXPORT struct gl_renderer_interface gl_renderer_interface = {
 	.get_num_egl_images = gl_renderer_get_num_egl_images,
 	.set_viewport = gl_renderer_set_viewport,
 	.query_buffer = gl_renderer_query_buffer,
+	.output_set_external_damage = gl_renderer_output_set_external_damage,
 };
@@ -141,8 +141,25 @@ struct gl_renderer_interface {
 			           struct wl_resource *buffer,
 				   EGLint attribute, EGLint *value);
 
+	/*
+	 * The caller tracks what each buffer of the output's surface contains
+	 * and passes the complete damage for the buffer being drawn, so the
+	 * renderer shouldn't add its own buffer age damage.  Returns whether
+	 * this was enabled (it needs EGL_EXT_buffer_age).
+	 */
+	int (*output_set_external_damage)(struct weston_output *output,
+					  int enable);
+
 	int rbc;
 
+	/*
+	 * Optional; set by the backend so compressed modifiers that none of
+	 * its planes can scan out aren't advertised to clients.  A client
+	 * picking one would only ever be composited.
+	 */
+	int (*scanout_modifier_supported)(struct weston_compositor *ec,
+					  int format, uint64_t modifier);
+
 #ifdef USE_VM
 	int vm_exec;
 	int vm_dbg;
@@ -331,6 +348,9 @@ struct gl_output_state {
 
 	struct weston_matrix output_matrix;
 
+	/* Caller supplies the full damage of the buffer being drawn */
+	int external_damage;
+
 	/* struct timeline_render_point::link */
 	struct wl_list timeline_render_point_list;
 
@@ -58,6 +58,8 @@
 #include "ias-common.h"
 #include "ias-backend-server-protocol.h"
 #include "presentation-time-server-protocol.h"
+#include "linux-dmabuf.h"
+#include "ias-formats.h"
 #include "launcher-util.h"
 #include "config-parser.h"
 
@@ -186,6 +188,16 @@ struct ias_properties {
 	uint32_t pixel_blend_mode;
 
 	uint32_t rotation;
+
+	/* Optional; 0 if the kernel can't take damage hints for this plane */
+	uint32_t fb_damage_clips;
+
+	/* Optional; 0 if the plane has no programmable YCbCr conversion */
+	uint32_t color_encoding;
+	uint32_t color_range;
+
+	/* Optional; 0 if the kernel doesn't list modifiers per format */
+	uint32_t in_formats;
 };
 
 #if 0
@@ -360,6 +372,12 @@ struct ias_fb {
 	int is_client_buffer;
 	struct weston_buffer_reference buffer_ref;
 	uint32_t format;
+
+	/*
+	 * Composited frame (ias_damage_history sequence number) last rendered
+	 * into this bo; 0 if never rendered by us or unknown.
+	 */
+	uint32_t frame;
 };
 
 /*
@@ -407,6 +425,13 @@ struct ias_sprite {
 
 	uint32_t supports_rbc;
 
+	/* Enum values for the YCbCr conversion the GL path also uses */
+	uint64_t color_encoding_bt601;
+	uint64_t color_range_limited;
+
+	/* Format/modifier pairs from IN_FORMATS, empty if not exposed */
+	struct ias_plane_formats in_formats;
+
 	uint32_t count_formats;
 	uint32_t formats[];
 };
@@ -415,9 +440,41 @@ struct ias_fb *
 ias_fb_get_from_bo(struct gbm_bo *bo, struct weston_buffer *buffer,
 		   struct ias_output *output, enum ias_fb_type type);
 
+struct gbm_bo *
+ias_import_dmabuf(struct ias_backend *backend,
+		struct linux_dmabuf_buffer *dmabuf);
+
+int
+ias_format_is_yuv(uint32_t format);
+
+struct gbm_surface *
+ias_scanout_surface_create(struct ias_output *output,
+		struct ias_sprite *sprite, uint32_t width, uint32_t height,
+		uint32_t format, uint32_t flags);
+
+int
+ias_sprite_supports_format(struct ias_sprite *sprite, uint32_t format);
+
+void
+ias_sprite_set_color_properties(struct ias_sprite *sprite, struct ias_fb *fb,
+		drmModeAtomicReq *req);
+
 void
 ias_output_render(struct ias_output *output, pixman_region32_t *new_damage);
 
+int
+ias_output_create_damage_blob(struct ias_output *output, struct ias_fb *fb,
+		uint32_t *blob_id);
+
+void
+ias_output_scanout_locked(struct ias_output *output, struct ias_fb *fb);
+
+void
+ias_output_reset_damage_history(struct ias_output *output);
+
+void
+ias_output_scanout_allocated(struct ias_output *output);
+
 void
 ias_set_dpms(struct ias_crtc *ias_crtc, enum dpms_enum level);
 
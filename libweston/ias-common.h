@@ -118,6 +118,68 @@ enum crtc_plane {
 	CRTC_PLANE_SPRITE_B,
 };
 
+/*
+ * Plane chosen for a view by ias_assign_planes().  Recorded in the output's
+ * plane assignment cache so that an unchanged scene can skip re-evaluating
+ * cursor and scanout eligibility on the next frame.
+ */
+enum ias_plane_choice {
+	IAS_PLANE_CHOICE_PRIMARY = 0,
+	IAS_PLANE_CHOICE_CURSOR,
+	IAS_PLANE_CHOICE_SCANOUT,
+};
+
+struct ias_plane_decision {
+	struct weston_view *view;
+	enum ias_plane_choice choice;
+	int keep_buffer;
+};
+
+struct ias_plane_cache {
+	/* Is the decision list below valid for 'signature'? */
+	int valid;
+	uint32_t signature;
+
+	int num_decisions;
+	int max_decisions;
+	struct ias_plane_decision *decisions;
+
+	/* Statistics, reported via the timeline and plane_cache_debug */
+	uint32_t hits;
+	uint32_t misses;
+};
+
+/*
+ * Number of composited frames of damage we remember per scanout.  Mesa's gbm
+ * surfaces never hand out more than four color buffers, so a buffer that is
+ * older than this will also be older than anything EGL can give us back.
+ */
+#define IAS_DAMAGE_HISTORY_LEN 4
+
+struct ias_damage_history {
+	/* Does the renderer draw exactly the damage we hand it? */
+	int enabled;
+
+	/* Sequence number of the last composited frame; 0 before the first */
+	uint32_t frame;
+
+	/* damage[f % IAS_DAMAGE_HISTORY_LEN] is what changed in frame f */
+	pixman_region32_t damage[IAS_DAMAGE_HISTORY_LEN];
+
+	/*
+	 * Buffers this scanout's gbm surface has handed us so far, and the one
+	 * we locked most recently (still being scanned out, so EGL won't pick
+	 * it to render the next frame).
+	 */
+	int num_bos;
+	struct gbm_bo *bos[IAS_DAMAGE_HISTORY_LEN];
+	struct gbm_bo *locked_bo;
+
+	/* Statistics, reported via print_fps */
+	uint32_t full_redraws;
+	uint32_t partial_redraws;
+};
+
 struct ias_output {
 	struct weston_output base;
 	char *name;
@@ -157,11 +219,25 @@ struct ias_output {
 	GLuint fbo;
 
 	/*
-	 * Previous frame's damage.  Since we swap between scanout buffers, we
-	 * need to redraw both the current frame's damage and the previous frame's
-	 * damage to ensure no artifacts when updating the scanout.
+	 * Damage of recent frames and which frame each scanout buffer last
+	 * held.  A buffer handed back by the gbm surface only needs the damage
+	 * since it was last drawn to, rather than assuming two buffers.
+	 */
+	struct ias_damage_history damage_history;
+
+	/*
+	 * Damage of the most recently composited scanout in buffer coordinates,
+	 * passed to the kernel as FB_DAMAGE_CLIPS.  Invalid when the whole
+	 * buffer must be considered damaged (layout plugins, resizes).
 	 */
-	pixman_region32_t prev_damage;
+	pixman_region32_t scanout_damage;
+	int scanout_damage_valid;
+
+	/* IAS_MODIFIERS_* layouts the composited scanouts were allocated with */
+	uint32_t scanout_modifiers;
+
+	/* Plane assignments from the previous frame, keyed by scene signature */
+	struct ias_plane_cache plane_cache;
 
 	/* Loadable layout plugin */
 	struct ias_plugin *plugin;
@@ -303,6 +379,8 @@ struct ias_backend {
 	int rbc_enabled;
 	int rbc_debug;
 	int use_cursor_as_uplane;
+	int use_plane_cache;
+	int plane_cache_debug;
 };
 
 /*
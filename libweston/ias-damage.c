@@ -0,0 +1,131 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-damage.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Conversion of per-frame output damage into FB_DAMAGE_CLIPS blobs.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include "ias-damage.h"
+
+/*
+ * Scale a single coordinate from src to fb space.  Start edges round down
+ * and end edges round up so that the scaled clip always covers the damage.
+ */
+static int32_t
+scale_coord(int32_t v, int32_t src, int32_t fb, int round_up)
+{
+	int64_t n;
+
+	if (src == fb || src <= 0) {
+		return v;
+	}
+
+	n = (int64_t)v * fb;
+	if (round_up) {
+		n += src - 1;
+	}
+
+	return (int32_t)(n / src);
+}
+
+static int
+add_clip(struct ias_damage_clip *clips, int n, pixman_box32_t *box,
+		int32_t src_w, int32_t src_h, int32_t fb_w, int32_t fb_h)
+{
+	struct ias_damage_clip *c = &clips[n];
+
+	c->x1 = scale_coord(box->x1, src_w, fb_w, 0);
+	c->y1 = scale_coord(box->y1, src_h, fb_h, 0);
+	c->x2 = scale_coord(box->x2, src_w, fb_w, 1);
+	c->y2 = scale_coord(box->y2, src_h, fb_h, 1);
+
+	if (c->x1 < 0) c->x1 = 0;
+	if (c->y1 < 0) c->y1 = 0;
+	if (c->x2 > fb_w) c->x2 = fb_w;
+	if (c->y2 > fb_h) c->y2 = fb_h;
+
+	/* Entirely outside the framebuffer */
+	if (c->x1 >= c->x2 || c->y1 >= c->y2) {
+		return n;
+	}
+
+	return n + 1;
+}
+
+int
+ias_damage_get_clips(pixman_region32_t *damage,
+		int32_t src_w, int32_t src_h,
+		int32_t fb_w, int32_t fb_h,
+		struct ias_damage_clip *clips, int max_clips)
+{
+	pixman_box32_t *rects;
+	int nrects, i, n = 0;
+
+	if (max_clips <= 0 || !pixman_region32_not_empty(damage)) {
+		return 0;
+	}
+
+	rects = pixman_region32_rectangles(damage, &nrects);
+
+	if (nrects > max_clips) {
+		return add_clip(clips, 0, pixman_region32_extents(damage),
+				src_w, src_h, fb_w, fb_h);
+	}
+
+	for (i = 0; i < nrects; i++) {
+		n = add_clip(clips, n, &rects[i], src_w, src_h, fb_w, fb_h);
+	}
+
+	return n;
+}
+
+int
+ias_damage_create_blob(int drm_fd, pixman_region32_t *damage,
+		int32_t src_w, int32_t src_h,
+		int32_t fb_w, int32_t fb_h,
+		uint32_t *blob_id)
+{
+	struct ias_damage_clip clips[IAS_MAX_DAMAGE_CLIPS];
+	int n;
+
+	*blob_id = 0;
+
+	n = ias_damage_get_clips(damage, src_w, src_h, fb_w, fb_h,
+			clips, IAS_MAX_DAMAGE_CLIPS);
+	if (n == 0) {
+		return 0;
+	}
+
+	return drmModeCreatePropertyBlob(drm_fd, clips, n * sizeof clips[0],
+			blob_id);
+}
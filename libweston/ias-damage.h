@@ -0,0 +1,83 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-damage.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Conversion of per-frame output damage into FB_DAMAGE_CLIPS blobs.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __IAS_DAMAGE_H__
+#define __IAS_DAMAGE_H__
+
+#include <stdint.h>
+#include <pixman.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * More rectangles than this and we just send the bounding box; the kernel
+ * doesn't gain anything from a long list of tiny clips.
+ */
+#define IAS_MAX_DAMAGE_CLIPS 64
+
+/* Same layout as the kernel's struct drm_mode_rect */
+struct ias_damage_clip {
+	int32_t x1;
+	int32_t y1;
+	int32_t x2;
+	int32_t y2;
+};
+
+/*
+ * Convert 'damage' (in a src_w x src_h space with origin at the top-left of
+ * the framebuffer) into framebuffer-relative clip rectangles, scaling to
+ * fb_w x fb_h if the two differ.  Returns the number of clips written.
+ */
+int
+ias_damage_get_clips(pixman_region32_t *damage,
+		int32_t src_w, int32_t src_h,
+		int32_t fb_w, int32_t fb_h,
+		struct ias_damage_clip *clips, int max_clips);
+
+/*
+ * Create an FB_DAMAGE_CLIPS property blob for 'damage'.  On success returns
+ * 0 and sets *blob_id, which is left at 0 if there's nothing to send (in
+ * which case the kernel treats the plane as fully damaged).
+ */
+int
+ias_damage_create_blob(int drm_fd, pixman_region32_t *damage,
+		int32_t src_w, int32_t src_h,
+		int32_t fb_w, int32_t fb_h,
+		uint32_t *blob_id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
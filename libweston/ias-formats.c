@@ -0,0 +1,235 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-formats.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Parsing of the per-plane IN_FORMATS property (format/modifier pairs).
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <drm_fourcc.h>
+
+#include "ias-formats.h"
+
+int
+ias_plane_formats_parse(struct ias_plane_formats *pf,
+		const void *data, size_t size)
+{
+	const struct ias_format_modifier_blob *blob = data;
+	const uint32_t *formats;
+	const struct ias_format_modifier *mods;
+	uint32_t i, j, n;
+
+	pf->count = 0;
+	pf->formats = NULL;
+
+	if (size < sizeof(*blob) || blob->version < IAS_FORMAT_BLOB_VERSION) {
+		return -1;
+	}
+
+	if (blob->formats_offset > size ||
+	    blob->count_formats > (size - blob->formats_offset) / sizeof(*formats) ||
+	    blob->modifiers_offset > size ||
+	    blob->count_modifiers > (size - blob->modifiers_offset) / sizeof(*mods)) {
+		return -1;
+	}
+
+	formats = (const uint32_t *)((const char *)data + blob->formats_offset);
+	mods = (const struct ias_format_modifier *)
+		((const char *)data + blob->modifiers_offset);
+
+	if (!blob->count_formats) {
+		return 0;
+	}
+
+	pf->formats = calloc(blob->count_formats, sizeof(*pf->formats));
+	if (!pf->formats) {
+		return -1;
+	}
+	pf->count = blob->count_formats;
+
+	for (i = 0; i < blob->count_formats; i++) {
+		struct ias_format_modifiers *f = &pf->formats[i];
+
+		f->format = formats[i];
+
+		/* Each modifier covers a 64-format window starting at offset */
+		for (n = 0, j = 0; j < blob->count_modifiers; j++) {
+			if (i >= mods[j].offset && i < mods[j].offset + 64 &&
+			    (mods[j].formats & (1ULL << (i - mods[j].offset)))) {
+				n++;
+			}
+		}
+
+		if (!n) {
+			continue;
+		}
+
+		f->modifiers = calloc(n, sizeof(*f->modifiers));
+		if (!f->modifiers) {
+			ias_plane_formats_release(pf);
+			return -1;
+		}
+
+		for (j = 0; j < blob->count_modifiers; j++) {
+			if (i >= mods[j].offset && i < mods[j].offset + 64 &&
+			    (mods[j].formats & (1ULL << (i - mods[j].offset)))) {
+				f->modifiers[f->num_modifiers++] = mods[j].modifier;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void
+ias_plane_formats_release(struct ias_plane_formats *pf)
+{
+	uint32_t i;
+
+	for (i = 0; i < pf->count; i++) {
+		free(pf->formats[i].modifiers);
+	}
+
+	free(pf->formats);
+	pf->formats = NULL;
+	pf->count = 0;
+}
+
+static const struct ias_format_modifiers *
+find_format(const struct ias_plane_formats *pf, uint32_t format)
+{
+	uint32_t i;
+
+	for (i = 0; i < pf->count; i++) {
+		if (pf->formats[i].format == format) {
+			return &pf->formats[i];
+		}
+	}
+
+	return NULL;
+}
+
+int
+ias_plane_formats_has_modifier(const struct ias_plane_formats *pf,
+		uint32_t format, uint64_t modifier)
+{
+	const struct ias_format_modifiers *f = find_format(pf, format);
+	uint32_t i;
+
+	if (!f) {
+		return 0;
+	}
+
+	for (i = 0; i < f->num_modifiers; i++) {
+		if (f->modifiers[i] == modifier) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+is_ccs(uint64_t modifier)
+{
+	return modifier == I915_FORMAT_MOD_Y_TILED_CCS ||
+		modifier == I915_FORMAT_MOD_Yf_TILED_CCS;
+}
+
+static int
+is_yf(uint64_t modifier)
+{
+	return modifier == I915_FORMAT_MOD_Yf_TILED ||
+		modifier == I915_FORMAT_MOD_Yf_TILED_CCS;
+}
+
+/* Lower is better; anything we don't know about goes last */
+static int
+modifier_rank(uint64_t modifier)
+{
+	switch (modifier) {
+	case I915_FORMAT_MOD_Yf_TILED_CCS:
+		return 0;
+	case I915_FORMAT_MOD_Y_TILED_CCS:
+		return 1;
+	case I915_FORMAT_MOD_Yf_TILED:
+		return 2;
+	case I915_FORMAT_MOD_Y_TILED:
+		return 3;
+	case I915_FORMAT_MOD_X_TILED:
+		return 4;
+	case DRM_FORMAT_MOD_LINEAR:
+		return 5;
+	default:
+		return 6;
+	}
+}
+
+int
+ias_plane_formats_get_modifiers(const struct ias_plane_formats *pf,
+		uint32_t format, uint32_t allow,
+		uint64_t *modifiers, int max)
+{
+	const struct ias_format_modifiers *f = find_format(pf, format);
+	uint64_t m;
+	uint32_t i;
+	int n = 0, k;
+
+	if (!f) {
+		return 0;
+	}
+
+	for (i = 0; i < f->num_modifiers; i++) {
+		m = f->modifiers[i];
+
+		if (m == DRM_FORMAT_MOD_INVALID ||
+				(!(allow & IAS_MODIFIERS_CCS) && is_ccs(m)) ||
+				(!(allow & IAS_MODIFIERS_YF) && is_yf(m))) {
+			continue;
+		}
+
+		/*
+		 * Insertion sort, keeping the best 'max'; the lists are only
+		 * a handful of entries.
+		 */
+		k = n < max ? n++ : max;
+		for (; k > 0 && modifier_rank(modifiers[k - 1]) > modifier_rank(m); k--) {
+			if (k < max) {
+				modifiers[k] = modifiers[k - 1];
+			}
+		}
+		if (k < max) {
+			modifiers[k] = m;
+		}
+	}
+
+	return n;
+}
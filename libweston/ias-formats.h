@@ -0,0 +1,110 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-formats.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Parsing of the per-plane IN_FORMATS property (format/modifier pairs).
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __IAS_FORMATS_H__
+#define __IAS_FORMATS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Same layout as the kernel's struct drm_format_modifier_blob */
+struct ias_format_modifier_blob {
+	uint32_t version;
+	uint32_t flags;
+	uint32_t count_formats;
+	uint32_t formats_offset;
+	uint32_t count_modifiers;
+	uint32_t modifiers_offset;
+};
+
+/* Same layout as the kernel's struct drm_format_modifier */
+struct ias_format_modifier {
+	uint64_t formats;
+	uint32_t offset;
+	uint32_t pad;
+	uint64_t modifier;
+};
+
+#define IAS_FORMAT_BLOB_VERSION 1
+
+struct ias_format_modifiers {
+	uint32_t format;
+	uint32_t num_modifiers;
+	uint64_t *modifiers;
+};
+
+/* Everything a plane can scan out; count is 0 if IN_FORMATS is missing */
+struct ias_plane_formats {
+	uint32_t count;
+	struct ias_format_modifiers *formats;
+};
+
+/*
+ * Fill 'pf' from the contents of an IN_FORMATS blob.  Returns 0 on success
+ * or -1 if the blob is malformed or we run out of memory, in which case
+ * 'pf' is left empty.
+ */
+int
+ias_plane_formats_parse(struct ias_plane_formats *pf,
+		const void *data, size_t size);
+
+void
+ias_plane_formats_release(struct ias_plane_formats *pf);
+
+int
+ias_plane_formats_has_modifier(const struct ias_plane_formats *pf,
+		uint32_t format, uint64_t modifier);
+
+/* Layouts ias_plane_formats_get_modifiers() may return besides X/Y/linear */
+#define IAS_MODIFIERS_CCS	(1 << 0)
+#define IAS_MODIFIERS_YF	(1 << 1)
+
+/*
+ * Write up to 'max' of the modifiers the plane takes for 'format', best
+ * layout first (compressed, then Yf/Y/X tiled, then linear).  Compressed
+ * and Yf tiled layouts are left out unless the matching IAS_MODIFIERS_*
+ * bit is set in 'allow'.  Returns the number written.
+ */
+int
+ias_plane_formats_get_modifiers(const struct ias_plane_formats *pf,
+		uint32_t format, uint32_t allow,
+		uint64_t *modifiers, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,613 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-gesture.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Multi-touch gesture recognition shared by the layout plugins.
+ *
+ *   A touch sequence runs from the first finger down to the last finger up.
+ *   It starts out undecided and settles on at most one continuous gesture
+ *   (long-press, pinch or drag); tap and swipe are decided when the last
+ *   finger lifts.  Once a continuous gesture has ended the rest of the
+ *   sequence is ignored.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "ias-gesture.h"
+#include "shared/timespec-util.h"
+
+enum gesture_state {
+	GESTURE_IDLE = 0,
+	GESTURE_POSSIBLE,
+	GESTURE_LONG_PRESS,
+	GESTURE_PINCH,
+	GESTURE_DRAG,
+	GESTURE_FAILED,
+};
+
+void
+ias_gesture_config_init(struct ias_gesture_config *config)
+{
+	config->tap_slop = 15.0;
+	config->tap_max_msec = 300;
+	config->long_press_msec = 800;
+	config->swipe_min_distance = 100.0;
+	config->swipe_max_msec = 500;
+	config->pinch_min_scale = 0.15;
+	config->drag_min_distance = 30.0;
+}
+
+static struct ias_gesture_touch *
+find_touch(struct ias_gesture_recognizer *rec, int touch_id)
+{
+	int i;
+
+	for (i = 0; i < IAS_GESTURE_MAX_TOUCHES; i++) {
+		if (rec->touches[i].active && rec->touches[i].id == touch_id) {
+			return &rec->touches[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void
+get_centroid(const struct ias_gesture_recognizer *rec, double *cx, double *cy)
+{
+	double x = 0.0, y = 0.0;
+	int i;
+
+	for (i = 0; i < IAS_GESTURE_MAX_TOUCHES; i++) {
+		if (rec->touches[i].active) {
+			x += rec->touches[i].x;
+			y += rec->touches[i].y;
+		}
+	}
+
+	*cx = rec->num_touches ? x / rec->num_touches : 0.0;
+	*cy = rec->num_touches ? y / rec->num_touches : 0.0;
+}
+
+/* Mean distance of the fingers from their centroid */
+static double
+get_spread(const struct ias_gesture_recognizer *rec, double cx, double cy)
+{
+	double d = 0.0;
+	int i;
+
+	for (i = 0; i < IAS_GESTURE_MAX_TOUCHES; i++) {
+		if (rec->touches[i].active) {
+			d += hypot(rec->touches[i].x - cx, rec->touches[i].y - cy);
+		}
+	}
+
+	return rec->num_touches ? d / rec->num_touches : 0.0;
+}
+
+static double
+get_scale(const struct ias_gesture_recognizer *rec, double cx, double cy)
+{
+	/* Fingers on top of each other give no usable spread */
+	if (rec->start_spread < 1.0) {
+		return rec->base_scale;
+	}
+
+	return rec->base_scale * get_spread(rec, cx, cy) / rec->start_spread;
+}
+
+/*
+ * Take the current positions as the starting point for the set of fingers
+ * now down.  Called whenever a finger is added or removed, so that the
+ * change in centroid and spread isn't mistaken for movement.
+ */
+static void
+set_baseline(struct ias_gesture_recognizer *rec)
+{
+	int i;
+
+	for (i = 0; i < IAS_GESTURE_MAX_TOUCHES; i++) {
+		rec->touches[i].start_x = rec->touches[i].x;
+		rec->touches[i].start_y = rec->touches[i].y;
+	}
+
+	get_centroid(rec, &rec->start_cx, &rec->start_cy);
+	rec->start_spread = get_spread(rec, rec->start_cx, rec->start_cy);
+}
+
+/*
+ * Fold the progress of the current set of fingers into the running totals
+ * before the set changes, so a pinch or drag carries on smoothly when a
+ * finger is added or lifted.
+ */
+static void
+accumulate(struct ias_gesture_recognizer *rec)
+{
+	double cx, cy;
+
+	get_centroid(rec, &cx, &cy);
+	rec->base_scale = get_scale(rec, cx, cy);
+	rec->base_dx += cx - rec->start_cx;
+	rec->base_dy += cy - rec->start_cy;
+}
+
+static void
+init_event(struct ias_gesture_recognizer *rec,
+		struct ias_gesture_event *event,
+		enum ias_gesture_type type,
+		enum ias_gesture_phase phase)
+{
+	double cx, cy;
+
+	get_centroid(rec, &cx, &cy);
+
+	memset(event, 0, sizeof *event);
+	event->type = type;
+	event->phase = phase;
+	event->time = rec->last_time;
+	event->fingers = rec->num_touches;
+	event->x = cx;
+	event->y = cy;
+	event->start_x = rec->origin_x;
+	event->start_y = rec->origin_y;
+	event->dx = rec->base_dx + cx - rec->start_cx;
+	event->dy = rec->base_dy + cy - rec->start_cy;
+	event->scale = type == IAS_GESTURE_PINCH ? get_scale(rec, cx, cy) : 1.0;
+	event->direction = IAS_GESTURE_DIRECTION_NONE;
+}
+
+static void
+send_event(struct ias_gesture_recognizer *rec, struct ias_gesture_event *event)
+{
+	if (!(rec->mask & event->type) || !rec->notify) {
+		return;
+	}
+
+	rec->last_scale = event->scale;
+	rec->last_dx = event->dx;
+	rec->last_dy = event->dy;
+
+	rec->notify(event, rec->data);
+}
+
+static void
+send_phase(struct ias_gesture_recognizer *rec,
+		enum ias_gesture_type type,
+		enum ias_gesture_phase phase)
+{
+	struct ias_gesture_event event;
+	int64_t msec;
+
+	init_event(rec, &event, type, phase);
+
+	if (phase == IAS_GESTURE_PHASE_END) {
+		msec = timespec_sub_to_msec(&rec->last_time, &rec->begin_time);
+		if (msec > 0) {
+			event.velocity_x = event.dx / msec;
+			event.velocity_y = event.dy / msec;
+		}
+	}
+
+	send_event(rec, &event);
+}
+
+static enum ias_gesture_type
+current_type(const struct ias_gesture_recognizer *rec)
+{
+	switch (rec->state) {
+	case GESTURE_LONG_PRESS:
+		return IAS_GESTURE_LONG_PRESS;
+	case GESTURE_PINCH:
+		return IAS_GESTURE_PINCH;
+	case GESTURE_DRAG:
+		return IAS_GESTURE_DRAG;
+	default:
+		return 0;
+	}
+}
+
+/* Start a continuous gesture from the current baseline */
+static void
+begin(struct ias_gesture_recognizer *rec, enum gesture_state state)
+{
+	rec->state = state;
+	rec->begin_time = rec->last_time;
+	rec->origin_x = rec->start_cx;
+	rec->origin_y = rec->start_cy;
+	rec->base_scale = 1.0;
+	rec->base_dx = 0.0;
+	rec->base_dy = 0.0;
+
+	send_phase(rec, current_type(rec), IAS_GESTURE_PHASE_BEGIN);
+}
+
+/* End the continuous gesture in progress and ignore the rest of the sequence */
+static void
+end(struct ias_gesture_recognizer *rec, enum ias_gesture_phase phase)
+{
+	enum ias_gesture_type type = current_type(rec);
+
+	if (type) {
+		send_phase(rec, type, phase);
+	}
+
+	rec->state = GESTURE_FAILED;
+}
+
+static int
+long_press_possible(const struct ias_gesture_recognizer *rec)
+{
+	return rec->state == GESTURE_POSSIBLE &&
+		!rec->moved &&
+		rec->max_touches == 1 &&
+		(rec->mask & IAS_GESTURE_LONG_PRESS);
+}
+
+static void
+check_long_press(struct ias_gesture_recognizer *rec, const struct timespec *now)
+{
+	if (!long_press_possible(rec)) {
+		return;
+	}
+
+	if (timespec_sub_to_msec(now, &rec->down_time) <
+			rec->config.long_press_msec) {
+		return;
+	}
+
+	begin(rec, GESTURE_LONG_PRESS);
+}
+
+/* Evaluate the positions recorded since the last call */
+static void
+update(struct ias_gesture_recognizer *rec)
+{
+	struct ias_gesture_event event;
+	double cx, cy;
+	int i;
+
+	if (!rec->moved) {
+		for (i = 0; i < IAS_GESTURE_MAX_TOUCHES; i++) {
+			struct ias_gesture_touch *t = &rec->touches[i];
+
+			if (t->active && hypot(t->x - t->start_x, t->y - t->start_y) >
+					rec->config.tap_slop) {
+				rec->moved = 1;
+			}
+		}
+	}
+
+	get_centroid(rec, &cx, &cy);
+
+	switch (rec->state) {
+	case GESTURE_POSSIBLE:
+		if (rec->num_touches < 2) {
+			break;
+		}
+
+		if ((rec->mask & IAS_GESTURE_PINCH) && rec->start_spread >= 1.0 &&
+				fabs(get_scale(rec, cx, cy) - 1.0) >=
+				rec->config.pinch_min_scale) {
+			begin(rec, GESTURE_PINCH);
+		} else if ((rec->mask & IAS_GESTURE_DRAG) &&
+				hypot(cx - rec->start_cx, cy - rec->start_cy) >=
+				rec->config.drag_min_distance) {
+			begin(rec, GESTURE_DRAG);
+		}
+		break;
+
+	case GESTURE_LONG_PRESS:
+	case GESTURE_PINCH:
+	case GESTURE_DRAG:
+		init_event(rec, &event, current_type(rec), IAS_GESTURE_PHASE_UPDATE);
+		if (event.dx != rec->last_dx || event.dy != rec->last_dy ||
+				event.scale != rec->last_scale) {
+			send_event(rec, &event);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* The last finger of the sequence has lifted; decide on tap or swipe */
+static void
+finish(struct ias_gesture_recognizer *rec, const struct ias_gesture_touch *t)
+{
+	struct ias_gesture_event event;
+	int64_t msec;
+	double dx, dy, dist;
+
+	msec = timespec_sub_to_msec(&rec->last_time, &rec->down_time);
+
+	if (rec->state == GESTURE_LONG_PRESS) {
+		end(rec, IAS_GESTURE_PHASE_END);
+		return;
+	}
+
+	if (rec->state != GESTURE_POSSIBLE) {
+		return;
+	}
+
+	if (!rec->moved) {
+		if (msec > rec->config.tap_max_msec) {
+			return;
+		}
+
+		memset(&event, 0, sizeof event);
+		event.type = IAS_GESTURE_TAP;
+		event.phase = IAS_GESTURE_PHASE_END;
+		event.time = rec->last_time;
+		event.fingers = rec->max_touches;
+		event.x = event.start_x = rec->origin_x;
+		event.y = event.start_y = rec->origin_y;
+		event.scale = 1.0;
+		send_event(rec, &event);
+		return;
+	}
+
+	if (rec->max_touches != 1 || msec > rec->config.swipe_max_msec) {
+		return;
+	}
+
+	dx = t->x - t->start_x;
+	dy = t->y - t->start_y;
+	dist = hypot(dx, dy);
+	if (dist < rec->config.swipe_min_distance) {
+		return;
+	}
+
+	memset(&event, 0, sizeof event);
+	event.type = IAS_GESTURE_SWIPE;
+	event.phase = IAS_GESTURE_PHASE_END;
+	event.time = rec->last_time;
+	event.fingers = 1;
+	event.start_x = t->start_x;
+	event.start_y = t->start_y;
+	event.x = t->x;
+	event.y = t->y;
+	event.dx = dx;
+	event.dy = dy;
+	event.scale = 1.0;
+	if (msec > 0) {
+		event.velocity_x = dx / msec;
+		event.velocity_y = dy / msec;
+	}
+	if (fabs(dx) >= fabs(dy)) {
+		event.direction = dx < 0 ? IAS_GESTURE_DIRECTION_LEFT :
+			IAS_GESTURE_DIRECTION_RIGHT;
+	} else {
+		event.direction = dy < 0 ? IAS_GESTURE_DIRECTION_UP :
+			IAS_GESTURE_DIRECTION_DOWN;
+	}
+	send_event(rec, &event);
+}
+
+static void
+clear(struct ias_gesture_recognizer *rec)
+{
+	memset(rec->touches, 0, sizeof rec->touches);
+	rec->num_touches = 0;
+	rec->max_touches = 0;
+	rec->state = GESTURE_IDLE;
+	rec->moved = 0;
+}
+
+void
+ias_gesture_recognizer_init(struct ias_gesture_recognizer *rec,
+		const struct ias_gesture_config *config,
+		uint32_t mask,
+		ias_gesture_notify_fn notify,
+		void *data)
+{
+	memset(rec, 0, sizeof *rec);
+
+	if (config) {
+		rec->config = *config;
+	} else {
+		ias_gesture_config_init(&rec->config);
+	}
+
+	rec->mask = mask;
+	rec->notify = notify;
+	rec->data = data;
+	rec->base_scale = 1.0;
+}
+
+void
+ias_gesture_recognizer_reset(struct ias_gesture_recognizer *rec,
+		uint32_t mask,
+		ias_gesture_notify_fn notify,
+		void *data)
+{
+	ias_gesture_touch_cancel(rec);
+
+	rec->mask = mask;
+	rec->notify = notify;
+	rec->data = data;
+}
+
+void
+ias_gesture_touch_down(struct ias_gesture_recognizer *rec,
+		const struct timespec *time,
+		int touch_id, double x, double y)
+{
+	struct ias_gesture_touch *t = NULL;
+	int i;
+
+	if (rec->num_touches == IAS_GESTURE_MAX_TOUCHES ||
+			find_touch(rec, touch_id)) {
+		return;
+	}
+
+	rec->last_time = *time;
+
+	if (rec->num_touches == 0) {
+		clear(rec);
+		rec->state = GESTURE_POSSIBLE;
+		rec->down_time = *time;
+		rec->base_scale = 1.0;
+		rec->base_dx = 0.0;
+		rec->base_dy = 0.0;
+	} else {
+		check_long_press(rec, time);
+		update(rec);
+
+		switch (rec->state) {
+		case GESTURE_LONG_PRESS:
+			/* A second finger turns a long-press into nothing */
+			end(rec, IAS_GESTURE_PHASE_CANCEL);
+			break;
+		case GESTURE_PINCH:
+		case GESTURE_DRAG:
+			accumulate(rec);
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (i = 0; i < IAS_GESTURE_MAX_TOUCHES; i++) {
+		if (!rec->touches[i].active) {
+			t = &rec->touches[i];
+			break;
+		}
+	}
+
+	t->id = touch_id;
+	t->active = 1;
+	t->x = x;
+	t->y = y;
+
+	rec->num_touches++;
+	if (rec->num_touches > rec->max_touches) {
+		rec->max_touches = rec->num_touches;
+	}
+
+	set_baseline(rec);
+
+	/* A tap is reported at the centroid of all the fingers that took part */
+	if (rec->state == GESTURE_POSSIBLE) {
+		rec->origin_x = rec->start_cx;
+		rec->origin_y = rec->start_cy;
+	}
+}
+
+void
+ias_gesture_touch_up(struct ias_gesture_recognizer *rec,
+		const struct timespec *time,
+		int touch_id)
+{
+	struct ias_gesture_touch *t = find_touch(rec, touch_id);
+
+	if (!t) {
+		return;
+	}
+
+	rec->last_time = *time;
+	check_long_press(rec, time);
+	update(rec);
+
+	if (rec->num_touches == 1) {
+		finish(rec, t);
+		clear(rec);
+		return;
+	}
+
+	if (rec->state == GESTURE_PINCH || rec->state == GESTURE_DRAG) {
+		if (rec->num_touches == 2) {
+			/* Report the end while both fingers still count */
+			end(rec, IAS_GESTURE_PHASE_END);
+		} else {
+			accumulate(rec);
+		}
+	}
+
+	t->active = 0;
+	rec->num_touches--;
+
+	set_baseline(rec);
+}
+
+void
+ias_gesture_touch_motion(struct ias_gesture_recognizer *rec,
+		const struct timespec *time,
+		int touch_id, double x, double y)
+{
+	struct ias_gesture_touch *t = find_touch(rec, touch_id);
+
+	if (!t) {
+		return;
+	}
+
+	rec->last_time = *time;
+	t->x = x;
+	t->y = y;
+}
+
+void
+ias_gesture_touch_frame(struct ias_gesture_recognizer *rec)
+{
+	if (rec->state == GESTURE_IDLE) {
+		return;
+	}
+
+	check_long_press(rec, &rec->last_time);
+	update(rec);
+}
+
+void
+ias_gesture_touch_cancel(struct ias_gesture_recognizer *rec)
+{
+	if (rec->state != GESTURE_IDLE) {
+		end(rec, IAS_GESTURE_PHASE_CANCEL);
+	}
+
+	clear(rec);
+}
+
+int
+ias_gesture_long_press_pending(const struct ias_gesture_recognizer *rec)
+{
+	return long_press_possible(rec);
+}
+
+void
+ias_gesture_check_timeout(struct ias_gesture_recognizer *rec,
+		const struct timespec *now)
+{
+	if (!long_press_possible(rec)) {
+		return;
+	}
+
+	rec->last_time = *now;
+	check_long_press(rec, now);
+}
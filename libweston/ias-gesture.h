@@ -0,0 +1,248 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-gesture.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Multi-touch gesture recognition shared by the layout plugins.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __IAS_GESTURE_H__
+#define __IAS_GESTURE_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Touch points beyond this many are ignored until one is released */
+#define IAS_GESTURE_MAX_TOUCHES 10
+
+/* Gesture types, also used as bits in a plugin's gesture mask */
+enum ias_gesture_type {
+	IAS_GESTURE_TAP        = (1 << 0),
+	IAS_GESTURE_LONG_PRESS = (1 << 1),
+	IAS_GESTURE_SWIPE      = (1 << 2),
+	IAS_GESTURE_PINCH      = (1 << 3),
+	IAS_GESTURE_DRAG       = (1 << 4),
+};
+
+#define IAS_GESTURE_ALL (IAS_GESTURE_TAP | IAS_GESTURE_LONG_PRESS | \
+		IAS_GESTURE_SWIPE | IAS_GESTURE_PINCH | IAS_GESTURE_DRAG)
+
+/*
+ * Tap and swipe are reported once, with IAS_GESTURE_PHASE_END.  Long-press,
+ * pinch and drag are reported as BEGIN, any number of UPDATEs and then END,
+ * or CANCEL if the touch sequence was cancelled part way through.
+ */
+enum ias_gesture_phase {
+	IAS_GESTURE_PHASE_BEGIN,
+	IAS_GESTURE_PHASE_UPDATE,
+	IAS_GESTURE_PHASE_END,
+	IAS_GESTURE_PHASE_CANCEL,
+};
+
+enum ias_gesture_direction {
+	IAS_GESTURE_DIRECTION_NONE,
+	IAS_GESTURE_DIRECTION_LEFT,
+	IAS_GESTURE_DIRECTION_RIGHT,
+	IAS_GESTURE_DIRECTION_UP,
+	IAS_GESTURE_DIRECTION_DOWN,
+};
+
+struct ias_gesture_event {
+	enum ias_gesture_type type;
+	enum ias_gesture_phase phase;
+
+	/* Timestamp of the touch event that completed this step */
+	struct timespec time;
+
+	/* Number of fingers taking part */
+	int fingers;
+
+	/* Centroid of the fingers now and when the gesture started */
+	double x, y;
+	double start_x, start_y;
+
+	/* Translation of the centroid since the gesture started */
+	double dx, dy;
+
+	/* Pinch: finger spread relative to the start; 1.0 for anything else */
+	double scale;
+
+	/* Swipe and the end of a drag: average speed in pixels per msec */
+	double velocity_x, velocity_y;
+
+	/* Swipe: dominant direction of travel */
+	enum ias_gesture_direction direction;
+};
+
+typedef void
+(*ias_gesture_notify_fn)(const struct ias_gesture_event *event, void *data);
+
+/*
+ * Thresholds.  Distances are in the coordinate space of the touch events
+ * (global compositor coordinates in the framework), times in msec.
+ */
+struct ias_gesture_config {
+	/* Movement allowed before a touch no longer counts as stationary */
+	double tap_slop;
+
+	/* Longest a tap may be held */
+	uint32_t tap_max_msec;
+
+	/* How long a stationary finger must be held for a long-press */
+	uint32_t long_press_msec;
+
+	/* A single finger moving this far within swipe_max_msec is a swipe */
+	double swipe_min_distance;
+	uint32_t swipe_max_msec;
+
+	/* Two or more fingers: change in spread that starts a pinch */
+	double pinch_min_scale;
+
+	/* Two or more fingers: centroid travel that starts a drag */
+	double drag_min_distance;
+};
+
+struct ias_gesture_touch {
+	int id;
+	int active;
+	double x, y;
+
+	/* Position when the current set of fingers was established */
+	double start_x, start_y;
+};
+
+/*
+ * All state lives in this structure; feeding events never allocates.  The
+ * fields are private to ias-gesture.c.
+ */
+struct ias_gesture_recognizer {
+	struct ias_gesture_config config;
+	uint32_t mask;
+	ias_gesture_notify_fn notify;
+	void *data;
+
+	struct ias_gesture_touch touches[IAS_GESTURE_MAX_TOUCHES];
+	int num_touches;
+	int max_touches;
+
+	int state;
+	int moved;
+
+	/* First finger down, start of the current gesture, latest event */
+	struct timespec down_time;
+	struct timespec begin_time;
+	struct timespec last_time;
+
+	/* Centroid and spread when the current set of fingers was established */
+	double start_cx, start_cy;
+	double start_spread;
+
+	/* Centroid when the gesture began, and the scale and translation
+	 * accumulated over earlier sets of fingers */
+	double origin_x, origin_y;
+	double base_scale;
+	double base_dx, base_dy;
+
+	/* Last reported values, to skip updates that change nothing */
+	double last_scale;
+	double last_dx, last_dy;
+};
+
+void
+ias_gesture_config_init(struct ias_gesture_config *config);
+
+/*
+ * Initialise the recognizer.  'config' may be NULL for the defaults.  Only
+ * gestures whose type is set in 'mask' are recognized and passed to notify.
+ */
+void
+ias_gesture_recognizer_init(struct ias_gesture_recognizer *rec,
+		const struct ias_gesture_config *config,
+		uint32_t mask,
+		ias_gesture_notify_fn notify,
+		void *data);
+
+/*
+ * Forget any touches in progress, cancelling a gesture that had begun, and
+ * start recognizing the gestures in 'mask' for 'notify'.
+ */
+void
+ias_gesture_recognizer_reset(struct ias_gesture_recognizer *rec,
+		uint32_t mask,
+		ias_gesture_notify_fn notify,
+		void *data);
+
+void
+ias_gesture_touch_down(struct ias_gesture_recognizer *rec,
+		const struct timespec *time,
+		int touch_id, double x, double y);
+
+void
+ias_gesture_touch_up(struct ias_gesture_recognizer *rec,
+		const struct timespec *time,
+		int touch_id);
+
+/*
+ * Motion only records the new position; it is evaluated on the following
+ * frame so that fingers moving together are seen together.
+ */
+void
+ias_gesture_touch_motion(struct ias_gesture_recognizer *rec,
+		const struct timespec *time,
+		int touch_id, double x, double y);
+
+void
+ias_gesture_touch_frame(struct ias_gesture_recognizer *rec);
+
+void
+ias_gesture_touch_cancel(struct ias_gesture_recognizer *rec);
+
+/*
+ * Returns 1 while a long-press could still be recognized, in which case the
+ * caller should call ias_gesture_check_timeout() once long_press_msec have
+ * passed since the touch went down.
+ */
+int
+ias_gesture_long_press_pending(const struct ias_gesture_recognizer *rec);
+
+/*
+ * Recognize a long-press that has timed out by 'now' without any further
+ * touch events.  'now' must be on the same clock as the touch events.
+ */
+void
+ias_gesture_check_timeout(struct ias_gesture_recognizer *rec,
+		const struct timespec *now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
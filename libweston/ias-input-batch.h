@@ -0,0 +1,110 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-input-batch.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Helpers to fill the preallocated ipug_event_batch handed to input
+ *   plugins through on_input_batch.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef IAS_INPUT_BATCH_H
+#define IAS_INPUT_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "ias-spug.h"
+
+static inline void
+ipug_event_batch_reset(struct ipug_event_batch *batch)
+{
+	batch->count = 0;
+	batch->mask = 0;
+	memset(batch->type_count, 0, sizeof batch->type_count);
+}
+
+/* Returns the time field of an event, or NULL for types without one */
+static inline const struct timespec **
+ipug_event_time(union ipug_event *event)
+{
+	switch (event->base.event_type) {
+	case IPUG_POINTER_MOTION:
+		return &event->pointer_motion.time;
+	case IPUG_POINTER_BUTTON:
+		return &event->pointer_button.time;
+	case IPUG_TOUCH_DOWN:
+		return &event->touch_down.time;
+	case IPUG_TOUCH_MOTION:
+		return &event->touch_motion.time;
+	case IPUG_TOUCH_UP:
+		return &event->touch_up.time;
+	case IPUG_KEYBOARD_KEY:
+		return &event->key_key.time;
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * Copies size bytes of info into the next free slot of the batch. The time
+ * the event points at is copied into the batch as well, since the caller's
+ * timespec is usually on the stack of the seat code. Returns -1 if the
+ * batch is full.
+ */
+static inline int
+ipug_event_batch_append(struct ipug_event_batch *batch,
+			const struct ipug_event_info *info, size_t size)
+{
+	union ipug_event *event;
+	const struct timespec **time;
+	uint32_t i;
+
+	if (batch->count == IPUG_EVENT_BATCH_MAX ||
+	    size > sizeof *event ||
+	    info->event_type >= IPUG_NUM_EVENT_TYPES)
+		return -1;
+
+	i = batch->count++;
+	event = &batch->events[i];
+	memcpy(event, info, size);
+
+	time = ipug_event_time(event);
+	if (time && *time) {
+		batch->times[i] = **time;
+		*time = &batch->times[i];
+	}
+
+	batch->mask |= 1u << info->event_type;
+	batch->type_count[info->event_type]++;
+
+	return 0;
+}
+
+#endif
@@ -38,18 +38,20 @@
 #define IAS_PLUGIN_DEFINITINS_H
 
 #include "ias-spug.h"
+#include "ias-gesture.h"
 /*
  * Function signatures for entry points by which the IAS shell will
  * call into a plugin.
  */
 
 /* Currently supported plugin API version */
-#define PLUGIN_API_VERSION 2
+#define PLUGIN_API_VERSION 4
 
 typedef uint32_t ias_identifier;
 struct ias_sprite;
 struct ias_plugin_info;
 struct ipug_event_info;
+struct ipug_event_batch;
 
 typedef void
 (*ias_draw_fn)(spug_view_list);
@@ -66,6 +68,9 @@ typedef void
 typedef void
 (*ias_layout_switchfrom_fn)(const spug_output_id, struct ias_plugin_info *);
 
+typedef void
+(*ias_gesture_fn)(const struct ias_gesture_event *);
+
 
 /*
  * IAS plugin information structure.  The IAS shell will
@@ -95,6 +100,17 @@ struct ias_plugin_info {
 	unsigned int id;
 
 	ias_draw_fn          draw;
+
+	/*
+	 * Gestures (inforec version 2, plugin API version 4).  While the plugin
+	 * is the active layout and no input plugin is taking events, the
+	 * framework recognizes the IAS_GESTURE_* types set in gesture_mask from
+	 * touch input and passes them to on_gesture.  Raw touch events still go
+	 * to touch_grab if it is set; if it isn't, they are consumed rather than
+	 * passed on to clients.
+	 */
+	uint32_t             gesture_mask;
+	ias_gesture_fn       on_gesture;
 };
 
 
@@ -110,6 +126,15 @@ struct ias_input_plugin_info {
 
 	/* API plugin entry point callback */
 	void(*on_input)(struct ipug_event_info *info);
+
+	/*
+	 * Optional batched entry point (plugin API version 3). When set, it is
+	 * used instead of on_input: touch motion and frame events are collected
+	 * until the compositor has drained its input sources, and any other
+	 * event is delivered immediately together with the events queued before
+	 * it.
+	 */
+	void(*on_input_batch)(struct ipug_event_batch *batch);
 };
 
 /* Plugin initialization function pointer type */
@@ -83,6 +83,19 @@ struct {
 	 * but continue to receive pointer motion events itself. */
 	struct spug_view* input_focus[IPUG_NUM_EVENT_TYPES];
 
+	/* events queued for the input plugin's on_input_batch. There are two so
+	 * that events raised while the plugin handles one batch are collected in
+	 * the other rather than overwriting it */
+	struct ipug_event_batch *input_batch[2];
+	int input_batch_current;
+	int input_batch_flushing;
+	struct wl_event_source *input_batch_idle;
+
+	/* touch gestures for the active layout plugin, and the timer that
+	 * recognizes a long-press while the finger is held still */
+	struct ias_gesture_recognizer gestures;
+	struct wl_event_source *long_press_timer;
+
 	spug_view_list spug_view_ids;
 	spug_surface_list spug_surface_ids;
 	spug_seat_list spug_seat_ids;
@@ -46,6 +46,8 @@
 #include <wayland-server.h>
 
 #include "ias-plugin-framework-private.h"
+#include "ias-input-batch.h"
+#include "shared/timespec-util.h"
 /*
  * At the moment IAS can only handle four outputs (via dualview or stereo
  * mode)
@@ -608,6 +610,126 @@ void on_touch_call(struct weston_touch_grab *base)
 
 }
 
+/*************batched input delivery*******************/
+
+/*
+ * Input plugins that provide on_input_batch get their events in arrays
+ * rather than one call per event.  Touch motion and frame events are
+ * queued in a preallocated batch and handed over from an idle callback,
+ * which the event loop runs once every ready input source has been
+ * dispatched.  Any other event changes seat state (focus, touch points,
+ * buttons, keys) that the default grabs rely on when the plugin forwards
+ * the event, so it is appended and the batch is delivered right away.
+ * That includes pointer motion: notify_button() runs the compositor's
+ * button bindings before the grab sees the button, and those go by the
+ * pointer position and focus the forwarded motion leaves behind.
+ *
+ * A layout plugin can also be the active input plugin, and its ias_plugin
+ * union holds ias_plugin_info rather than ias_input_plugin_info, so only the
+ * configured input plugin is ever asked for on_input_batch.
+ */
+static int
+input_plugin_uses_batches(void)
+{
+	return framework->input_plugin &&
+		framework->active_input_plugin == framework->input_plugin &&
+		framework->input_plugin->input_info.on_input_batch &&
+		framework->input_batch[0];
+}
+
+static int
+input_plugin_wants_events(void)
+{
+	return framework->active_input_plugin &&
+		(framework->active_input_plugin->input_info.on_input ||
+		 input_plugin_uses_batches());
+}
+
+static void
+flush_input_batch(void)
+{
+	struct ipug_event_batch *batch;
+
+	/* events raised from inside on_input_batch wait for the idle handler */
+	if (framework->input_batch_flushing) {
+		return;
+	}
+
+	if (framework->input_batch_idle) {
+		wl_event_source_remove(framework->input_batch_idle);
+		framework->input_batch_idle = NULL;
+	}
+
+	batch = framework->input_batch[framework->input_batch_current];
+	if (!batch || batch->count == 0) {
+		return;
+	}
+
+	/* anything raised while the plugin runs goes to the other batch */
+	framework->input_batch_current ^= 1;
+	framework->input_batch_flushing = 1;
+	framework->input_plugin->input_info.on_input_batch(batch);
+	framework->input_batch_flushing = 0;
+	ipug_event_batch_reset(batch);
+}
+
+static void
+input_batch_idle_handler(void *data)
+{
+	/* idle sources are destroyed by the event loop once dispatched */
+	framework->input_batch_idle = NULL;
+	flush_input_batch();
+}
+
+static void
+queue_input_event(const struct ipug_event_info *info, size_t size)
+{
+	struct ipug_event_batch *batch;
+	struct wl_event_loop *loop;
+
+	batch = framework->input_batch[framework->input_batch_current];
+	if (ipug_event_batch_append(batch, info, size) < 0) {
+		flush_input_batch();
+		batch = framework->input_batch[framework->input_batch_current];
+		if (ipug_event_batch_append(batch, info, size) < 0) {
+			IAS_ERROR("Input batch full, dropping event type %d",
+					info->event_type);
+			return;
+		}
+	}
+
+	switch (info->event_type) {
+	case IPUG_TOUCH_MOTION:
+	case IPUG_TOUCH_FRAME:
+		break;
+	default:
+		if (!framework->input_batch_flushing) {
+			flush_input_batch();
+			return;
+		}
+		break;
+	}
+
+	if (!framework->input_batch_idle) {
+		loop = wl_display_get_event_loop(framework->compositor->wl_display);
+		framework->input_batch_idle =
+			wl_event_loop_add_idle(loop, input_batch_idle_handler, NULL);
+		if (!framework->input_batch_idle) {
+			flush_input_batch();
+		}
+	}
+}
+
+static void
+dispatch_input_event(struct ipug_event_info *info, size_t size)
+{
+	if (input_plugin_uses_batches()) {
+		queue_input_event(info, size);
+	} else {
+		framework->active_input_plugin->input_info.on_input(info);
+	}
+}
+
 /*************pointer functions*******************/
 
 /*TODO, do the same for all input functions!*/
@@ -626,8 +748,7 @@ plugin_pointer_grab_focus(struct weston_pointer_grab *grab)
 #endif
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_pointer_focus event_pointer_info;
 		event_pointer_info.base.event_type = IPUG_POINTER_FOCUS;
 		event_pointer_info.grab = grab;
@@ -636,8 +757,7 @@ plugin_pointer_grab_focus(struct weston_pointer_grab *grab)
 		event_pointer_info.y = grab->pointer->grab_y;
 		/* TODO: get wl_surface from westong_surface, or find a work around,
 		 * this could break end customers layout plugins */
-		framework->active_input_plugin->input_info.on_input(
-								(struct ipug_event_info*)&event_pointer_info);
+		dispatch_input_event(&event_pointer_info.base, sizeof event_pointer_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface->focus) {
@@ -654,16 +774,14 @@ plugin_pointer_grab_button(struct weston_pointer_grab *grab,
 {
 	on_mouse_call(grab);
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_pointer_button event_pointer_info;
 		event_pointer_info.base.event_type = IPUG_POINTER_BUTTON;
 		event_pointer_info.grab = grab;
 		event_pointer_info.time = time;
 		event_pointer_info.button = button;
 		event_pointer_info.state = state;
-		framework->active_input_plugin->input_info.on_input(
-								(struct ipug_event_info*)&event_pointer_info);
+		dispatch_input_event(&event_pointer_info.base, sizeof event_pointer_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface->button) {
@@ -685,8 +803,7 @@ plugin_pointer_grab_motion(struct weston_pointer_grab *grab,
 {
 	on_mouse_call(grab);
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_pointer_motion event_pointer_info;
 		event_pointer_info.base.event_type = IPUG_POINTER_MOTION;
 		event_pointer_info.grab = grab;
@@ -699,8 +816,7 @@ plugin_pointer_grab_motion(struct weston_pointer_grab *grab,
 			event_pointer_info.x =  wl_fixed_from_double(event->dx);
 			event_pointer_info.y =  wl_fixed_from_double(event->dy);
 		}
-		framework->active_input_plugin->input_info.on_input(
-								(struct ipug_event_info*)&event_pointer_info);
+		dispatch_input_event(&event_pointer_info.base, sizeof event_pointer_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface->motion) {
@@ -719,13 +835,11 @@ plugin_pointer_grab_cancel(struct weston_pointer_grab *grab)
 	on_mouse_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_pointer_cancel event_pointer_info;
 		event_pointer_info.base.event_type = IPUG_POINTER_CANCEL;
 		event_pointer_info.grab = grab;
-		framework->active_input_plugin->input_info.on_input(
-								(struct ipug_event_info*)&event_pointer_info);
+		dispatch_input_event(&event_pointer_info.base, sizeof event_pointer_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface &&
 			framework->last_actived_layout_plugin->info.mouse_grab.interface->cancel) {
@@ -774,16 +888,14 @@ plugin_keyboard_grab_key(struct weston_keyboard_grab *grab, const struct timespe
 	on_keyboard_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_key_key event_key_info;
 		event_key_info.base.event_type = IPUG_KEYBOARD_KEY;
 		event_key_info.grab = grab;
 		event_key_info.time = time;
 		event_key_info.key = key;
 		event_key_info.state = state;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_key_info);
+		dispatch_input_event(&event_key_info.base, sizeof event_key_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.key_grab.interface &&
 			framework->last_actived_layout_plugin->info.key_grab.interface->key) {
@@ -806,8 +918,7 @@ plugin_keyboard_grab_modifiers(struct weston_keyboard_grab *grab, uint32_t seria
 	on_keyboard_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_key_mod event_key_info;
 		event_key_info.base.event_type = IPUG_KEYBOARD_MOD;
 		event_key_info.grab = grab;
@@ -816,8 +927,7 @@ plugin_keyboard_grab_modifiers(struct weston_keyboard_grab *grab, uint32_t seria
 		event_key_info.mods_latched = mods_latched;
 		event_key_info.mods_locked = mods_locked;
 		event_key_info.group = group;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_key_info);
+		dispatch_input_event(&event_key_info.base, sizeof event_key_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.key_grab.interface &&
 			framework->last_actived_layout_plugin->info.key_grab.interface->modifiers) {
@@ -844,13 +954,11 @@ plugin_keyboard_grab_cancel(struct weston_keyboard_grab *grab)
 	on_keyboard_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_key_cancel event_key_info;
 		event_key_info.base.event_type = IPUG_KEYBOARD_CANCEL;
 		event_key_info.grab = grab;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_key_info);
+		dispatch_input_event(&event_key_info.base, sizeof event_key_info);
 	} else if(framework->last_actived_layout_plugin &&
 			framework->last_actived_layout_plugin->info.key_grab.interface &&
 			framework->last_actived_layout_plugin->info.key_grab.interface->cancel) {
@@ -869,6 +977,92 @@ static const struct weston_keyboard_grab_interface plugin_keyboard_functions = {
 		plugin_keyboard_grab_cancel,
 };
 
+/**********************Gesture functions *********************/
+
+/*
+ * Gestures are recognized for the last activated layout plugin when it has
+ * asked for them, but only on the path where that plugin would otherwise get
+ * the raw touch events; an input plugin taking events decides for itself.
+ */
+static int
+layout_plugin_wants_gestures(void)
+{
+	struct ias_plugin *plugin = framework->last_actived_layout_plugin;
+
+	return !input_plugin_wants_events() &&
+		plugin &&
+		plugin->info.inforec_version >= 2 &&
+		plugin->info.gesture_mask &&
+		plugin->info.on_gesture;
+}
+
+static const struct weston_touch_grab_interface *
+layout_plugin_touch_grab(void)
+{
+	struct ias_plugin *plugin = framework->last_actived_layout_plugin;
+
+	return plugin ? plugin->info.touch_grab.interface : NULL;
+}
+
+static void
+send_gesture(const struct ias_gesture_event *event, void *data)
+{
+	struct ias_plugin *plugin = data;
+
+	plugin->info.on_gesture(event);
+}
+
+/*
+ * Point the recognizer at the last activated layout plugin, cancelling
+ * anything that was in progress for the previous one.
+ */
+static void
+update_gesture_subscription(void)
+{
+	struct ias_plugin *plugin = framework->last_actived_layout_plugin;
+
+	wl_event_source_timer_update(framework->long_press_timer, 0);
+
+	if (layout_plugin_wants_gestures()) {
+		ias_gesture_recognizer_reset(&framework->gestures,
+				plugin->info.gesture_mask, send_gesture, plugin);
+	} else {
+		ias_gesture_recognizer_reset(&framework->gestures, 0, NULL, NULL);
+	}
+}
+
+/*
+ * Arm the long-press timer when a touch sequence starts and disarm it as
+ * soon as a long-press can no longer happen.
+ */
+static void
+update_long_press_timer(int touch_down)
+{
+	struct ias_gesture_recognizer *rec = &framework->gestures;
+
+	if (!ias_gesture_long_press_pending(rec)) {
+		wl_event_source_timer_update(framework->long_press_timer, 0);
+	} else if (touch_down) {
+		wl_event_source_timer_update(framework->long_press_timer,
+				rec->config.long_press_msec);
+	}
+}
+
+static int
+long_press_timeout(void *data)
+{
+	struct ias_gesture_recognizer *rec = &framework->gestures;
+	struct timespec deadline;
+
+	/* The timer never fires early, so the deadline is as good as the
+	 * current time and is certain to be on the touch events' clock */
+	timespec_add_msec(&deadline, &rec->down_time,
+			rec->config.long_press_msec);
+	ias_gesture_check_timeout(rec, &deadline);
+
+	return 0;
+}
+
 /**********************Touch functions *********************/
 static void plugin_touch_grab_down(struct weston_touch_grab *grab,
 		const struct timespec *time,
@@ -876,10 +1070,13 @@ static void plugin_touch_grab_down(struct weston_touch_grab *grab,
 		wl_fixed_t sx,
 		wl_fixed_t sy)
 {
+	const struct weston_touch_grab_interface *layout_grab =
+		layout_plugin_touch_grab();
+	int gestures = layout_plugin_wants_gestures();
+
 	on_touch_call(grab);
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_touch_down event_touch_info;
 		event_touch_info.base.event_type = IPUG_TOUCH_DOWN;
 		event_touch_info.grab = grab;
@@ -887,49 +1084,54 @@ static void plugin_touch_grab_down(struct weston_touch_grab *grab,
 		event_touch_info.touch_id = touch_id;
 		event_touch_info.sx = sx;
 		event_touch_info.sy = sy;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_touch_info);
-	} else if(framework->last_actived_layout_plugin &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface->down) {
+		dispatch_input_event(&event_touch_info.base, sizeof event_touch_info);
+		return;
+	}
 
-		framework->last_actived_layout_plugin->info.touch_grab.interface->down(
-				grab,
-				time,
-				touch_id,
-				sx,	sy);
-	} else {
+	if(layout_grab && layout_grab->down) {
+		layout_grab->down(grab, time, touch_id, sx, sy);
+	} else if(!gestures) {
 		grab->touch->default_grab.interface->down(grab, time, touch_id, sx, sy);
 	}
+
+	if(gestures) {
+		ias_gesture_touch_down(&framework->gestures, time, touch_id,
+				wl_fixed_to_double(sx), wl_fixed_to_double(sy));
+		update_long_press_timer(1);
+	}
 }
 
 static void plugin_touch_grab_up(struct weston_touch_grab *grab,
 		const struct timespec *time,
 		int touch_id)
 {
+	const struct weston_touch_grab_interface *layout_grab =
+		layout_plugin_touch_grab();
+	int gestures = layout_plugin_wants_gestures();
+
 	on_touch_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_touch_up event_touch_info;
 		event_touch_info.base.event_type = IPUG_TOUCH_UP;
 		event_touch_info.grab = grab;
 		event_touch_info.time = time;
 		event_touch_info.touch_id = touch_id;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_touch_info);
-	} else if(framework->last_actived_layout_plugin &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface->up) {
+		dispatch_input_event(&event_touch_info.base, sizeof event_touch_info);
+		return;
+	}
 
-		framework->last_actived_layout_plugin->info.touch_grab.interface->up(
-				grab,
-				time,
-				touch_id);
-	} else {
+	if(layout_grab && layout_grab->up) {
+		layout_grab->up(grab, time, touch_id);
+	} else if(!gestures) {
 		grab->touch->default_grab.interface->up(grab, time, touch_id);
 	}
+
+	if(gestures) {
+		ias_gesture_touch_up(&framework->gestures, time, touch_id);
+		update_long_press_timer(0);
+	}
 }
 
 static void plugin_touch_grab_motion(struct weston_touch_grab *grab,
@@ -938,11 +1140,14 @@ static void plugin_touch_grab_motion(struct weston_touch_grab *grab,
 		wl_fixed_t sx,
 		wl_fixed_t sy)
 {
+	const struct weston_touch_grab_interface *layout_grab =
+		layout_plugin_touch_grab();
+	int gestures = layout_plugin_wants_gestures();
+
 	on_touch_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_touch_motion event_touch_info;
 		event_touch_info.base.event_type = IPUG_TOUCH_MOTION;
 		event_touch_info.grab = grab;
@@ -950,57 +1155,78 @@ static void plugin_touch_grab_motion(struct weston_touch_grab *grab,
 		event_touch_info.touch_id = touch_id;
 		event_touch_info.sx = sx;
 		event_touch_info.sy = sy;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_touch_info);
-	} else if(framework->last_actived_layout_plugin &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface->motion) {
+		dispatch_input_event(&event_touch_info.base, sizeof event_touch_info);
+		return;
+	}
 
-		framework->last_actived_layout_plugin->info.touch_grab.interface->motion(
-				grab,
-				time,
-				touch_id,
-				sx, sy);
-	} else {
+	if(layout_grab && layout_grab->motion) {
+		layout_grab->motion(grab, time, touch_id, sx, sy);
+	} else if(!gestures) {
 		grab->touch->default_grab.interface->motion(grab, time, touch_id, sx, sy);
 	}
+
+	/* evaluated on the frame that follows */
+	if(gestures) {
+		ias_gesture_touch_motion(&framework->gestures, time, touch_id,
+				wl_fixed_to_double(sx), wl_fixed_to_double(sy));
+	}
 }
 
 static void plugin_touch_grab_frame(struct weston_touch_grab *grab)
 {
+	const struct weston_touch_grab_interface *layout_grab =
+		layout_plugin_touch_grab();
+	int gestures = layout_plugin_wants_gestures();
+
 	on_touch_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_touch_frame event_touch_info;
 		event_touch_info.base.event_type = IPUG_TOUCH_FRAME;
 		event_touch_info.grab = grab;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_touch_info);
-	} else if(framework->last_actived_layout_plugin &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface &&
-			framework->last_actived_layout_plugin->info.touch_grab.interface->cancel) {
+		dispatch_input_event(&event_touch_info.base, sizeof event_touch_info);
+		return;
+	}
 
-		framework->last_actived_layout_plugin->info.touch_grab.interface->cancel(
-				grab);
-	} else {
-		grab->touch->default_grab.interface->cancel(grab);
+	if(layout_grab && layout_grab->frame) {
+		layout_grab->frame(grab);
+	} else if(!gestures) {
+		grab->touch->default_grab.interface->frame(grab);
+	}
+
+	if(gestures) {
+		ias_gesture_touch_frame(&framework->gestures);
+		update_long_press_timer(0);
 	}
 }
 
 static void plugin_touch_grab_cancel(struct weston_touch_grab *grab)
 {
+	const struct weston_touch_grab_interface *layout_grab =
+		layout_plugin_touch_grab();
+	int gestures = layout_plugin_wants_gestures();
+
 	on_touch_call(grab);
 
 
-	if(framework->active_input_plugin &&
-			framework->active_input_plugin->input_info.on_input) {
+	if(input_plugin_wants_events()) {
 		struct ipug_event_info_touch_cancel event_touch_info;
 		event_touch_info.base.event_type = IPUG_TOUCH_CANCEL;
 		event_touch_info.grab = grab;
-		framework->active_input_plugin->input_info.on_input(
-									(struct ipug_event_info*)&event_touch_info);
+		dispatch_input_event(&event_touch_info.base, sizeof event_touch_info);
+		return;
+	}
+
+	if(layout_grab && layout_grab->cancel) {
+		layout_grab->cancel(grab);
+	} else if(!gestures) {
+		grab->touch->default_grab.interface->cancel(grab);
+	}
+
+	if(gestures) {
+		ias_gesture_touch_cancel(&framework->gestures);
+		update_long_press_timer(0);
 	}
 }
 
@@ -1076,18 +1302,9 @@ static void set_up_seat_with_plugin_framework(struct weston_seat *seat)
 	if(touch)	{
 		static struct weston_touch_grab plugin_touch_grab = {NULL, NULL};
 
-		/* if we have a layout plugin but no input plugin loaded
-		 * then set the default grabs to the layout plugin's ones */
-		if(!framework->input_plugin &&
-				framework->last_actived_layout_plugin &&
-				framework->last_actived_layout_plugin->info.touch_grab.interface) {
-
-			plugin_touch_grab.interface =
-				framework->last_actived_layout_plugin->info.touch_grab.interface;
-
-		} else {
-			plugin_touch_grab.interface = &plugin_touch_functions;
-		}
+		/* touch always goes through the framework's grab, which passes
+		 * events on to the layout plugin and feeds its gestures */
+		plugin_touch_grab.interface = &plugin_touch_functions;
 
 		weston_touch_start_grab(touch, &plugin_touch_grab);
 	}
@@ -1159,6 +1376,16 @@ static void initialize_input_plugin(void)
 		exit(1);
 	}
 
+	/* Preallocate the event storage for plugins taking batched input */
+	if (plugin->input_info.on_input_batch) {
+		framework->input_batch[0] = calloc(2, sizeof *framework->input_batch[0]);
+		if (!framework->input_batch[0]) {
+			IAS_ERROR("Failed to allocate input batch for plugin '%s', "
+					"falling back to per-event delivery", plugin->name);
+		} else {
+			framework->input_batch[1] = framework->input_batch[0] + 1;
+		}
+	}
 
 	framework->input_plugin = plugin;
 	framework->active_input_plugin = framework->input_plugin;
@@ -1414,6 +1641,8 @@ ias_activate_plugin(struct weston_output *output, ias_identifier id)
 			}
 		}
 
+		update_gesture_subscription();
+
 		/* Call "switch_to" plugin hook */
 		if (plugin->info.switch_to) {
 			struct spug_output* soutput = get_output_wrapper(output);
@@ -1526,6 +1755,12 @@ ias_deactivate_plugin(struct weston_output *output)
 	if(ias_output->plugin == framework->active_input_plugin) {
 		framework->active_input_plugin = NULL;
 	}
+
+	/* don't leave a gesture half recognized for a plugin that's gone */
+	if(framework->gestures.data == ias_output->plugin) {
+		wl_event_source_timer_update(framework->long_press_timer, 0);
+		ias_gesture_recognizer_reset(&framework->gestures, 0, NULL, NULL);
+	}
 	ias_output->plugin = NULL;
 
 	/* Restore saved GL state */
@@ -1912,6 +2147,18 @@ WL_EXPORT int wet_module_init(struct weston_compositor *compositor,int *argc, ch
 	/* Initialize layout change callback list */
 	wl_list_init(&framework->layout_change_callbacks);
 
+	/* Gestures are off until a layout plugin that wants them is activated */
+	ias_gesture_recognizer_init(&framework->gestures, NULL, 0, NULL, NULL);
+	framework->long_press_timer =
+		wl_event_loop_add_timer(wl_display_get_event_loop(compositor->wl_display),
+				long_press_timeout, NULL);
+	if (!framework->long_press_timer) {
+		IAS_ERROR("Failed to create long-press timer");
+		dlclose(self);
+		free(framework);
+		return -1;
+	}
+
 	/* set up the renderer interface */
 	spug_init_renderer();
 
@@ -0,0 +1,130 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-relay-input-batch.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Coalescing of batched relay input events.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "ias-relay-input-batch.h"
+#include "ias-shell-server-protocol.h"
+
+struct touch_set {
+	uint32_t ids[IAS_RELAY_INPUT_MAX_TOUCH_POINTS];
+	uint32_t count;
+};
+
+static bool
+touch_set_contains(struct touch_set *set, uint32_t id)
+{
+	uint32_t i;
+
+	for (i = 0; i < set->count; i++) {
+		if (set->ids[i] == id) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void
+touch_set_add(struct touch_set *set, uint32_t id)
+{
+	if (set->count < IAS_RELAY_INPUT_MAX_TOUCH_POINTS) {
+		set->ids[set->count++] = id;
+	}
+}
+
+static void
+touch_set_remove(struct touch_set *set, uint32_t id)
+{
+	uint32_t i;
+
+	for (i = 0; i < set->count; i++) {
+		if (set->ids[i] == id) {
+			set->ids[i] = set->ids[--set->count];
+			return;
+		}
+	}
+}
+
+/*
+ * Walk the batch backwards, remembering which touch points we've already
+ * seen a later motion for in the current frame.  Anything earlier for the
+ * same point is stale by the time the client would get to handle it.
+ */
+uint32_t
+ias_relay_input_coalesce(struct ias_relay_input_event *events, uint32_t count)
+{
+	struct touch_set seen = { .count = 0 };
+	uint32_t out = count;
+	uint32_t i;
+
+	for (i = count; i-- > 0; ) {
+		struct ias_relay_input_event *ev = &events[i];
+		bool keep = true;
+
+		if (ev->kind != IAS_RELAY_INPUT_EVENT_KIND_TOUCH) {
+			seen.count = 0;
+		} else {
+			switch (ev->type) {
+			case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_MOTION:
+				if (touch_set_contains(&seen, ev->touch.id)) {
+					keep = false;
+				} else {
+					touch_set_add(&seen, ev->touch.id);
+				}
+				break;
+			case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_DOWN:
+			case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_UP:
+				touch_set_remove(&seen, ev->touch.id);
+				break;
+			default:
+				/* Frame, cancel and anything we don't know about */
+				seen.count = 0;
+				break;
+			}
+		}
+
+		if (keep && --out != i) {
+			events[out] = *ev;
+		}
+	}
+
+	if (out > 0) {
+		memmove(events, &events[out], (count - out) * sizeof(*events));
+	}
+
+	return count - out;
+}
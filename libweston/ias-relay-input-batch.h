@@ -0,0 +1,64 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ias-relay-input-batch.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Coalescing of batched relay input events.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef __IAS_RELAY_INPUT_BATCH_H__
+#define __IAS_RELAY_INPUT_BATCH_H__
+
+#include <stdint.h>
+
+#include "shared/relay-input-event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Touch points we track per frame while coalescing.  Motion for points
+ * beyond this is passed through untouched.
+ */
+#define IAS_RELAY_INPUT_MAX_TOUCH_POINTS 16
+
+/*
+ * Drop touch motion records that are followed, within the same frame, by
+ * another motion of the same touch point with no down, up, cancel or key
+ * record in between.  The surviving records keep their relative order and
+ * are packed at the start of 'events'.  Returns the new record count.
+ */
+uint32_t
+ias_relay_input_coalesce(struct ias_relay_input_event *events, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -38,105 +38,251 @@
 #include <linux/input.h>
 
 #include "ias-relay-input.h"
+#include "ias-relay-input-batch.h"
 #include "ias-shell.h"
 
 
+/*
+ * Input resources of a client we've relayed events to.  Remote touch
+ * streams arrive at display rate, so rather than walk every seat's resource
+ * lists per event we remember what we found until the resource (or the
+ * client) goes away.
+ */
+struct relay_client {
+	struct wl_listener client_destroy;
+
+	struct wl_resource *touch;
+	struct wl_listener touch_destroy;
+
+	struct wl_resource *keyboard;
+	struct wl_listener keyboard_destroy;
+};
+
 static void
-ias_relay_input_send_touch(struct wl_client *client,
-			struct wl_resource *resource,
-			uint32_t touch_event_type,
-			uint32_t surfid,
-			uint32_t touch_id,
-			uint32_t x,
-			uint32_t y,
-			uint32_t time)
+relay_client_touch_destroyed(struct wl_listener *listener, void *data)
 {
-	struct ias_shell *shell = wl_resource_get_user_data(resource);
-	struct ias_surface *shsurf;
-	struct wl_resource *surf_resource = NULL;
-	struct wl_resource *ws_resource = NULL;
-	struct wl_resource *target_resource = NULL;
-	struct wl_resource *t_resource = NULL;
-	struct weston_seat *seat = NULL;
-
-	printf("Touch event received in server.\n");
-
-	/* Walk the surface list looking for the requested surface.  */
-	wl_list_for_each(shsurf, &shell->client_surfaces, surface_link) {
-		printf("Surface ID: %u\n", SURFPTR2ID(shsurf));
-		if (SURFPTR2ID(shsurf) == surfid) {
-			surf_resource = shsurf->resource;
-			ws_resource = shsurf->surface->resource;
+	struct relay_client *rc =
+		container_of(listener, struct relay_client, touch_destroy);
+
+	wl_list_remove(&rc->touch_destroy.link);
+	rc->touch = NULL;
+}
+
+static void
+relay_client_keyboard_destroyed(struct wl_listener *listener, void *data)
+{
+	struct relay_client *rc =
+		container_of(listener, struct relay_client, keyboard_destroy);
+
+	wl_list_remove(&rc->keyboard_destroy.link);
+	rc->keyboard = NULL;
+}
+
+static void
+relay_client_destroyed(struct wl_listener *listener, void *data)
+{
+	struct relay_client *rc =
+		container_of(listener, struct relay_client, client_destroy);
+
+	if (rc->touch) {
+		wl_list_remove(&rc->touch_destroy.link);
+	}
+
+	if (rc->keyboard) {
+		wl_list_remove(&rc->keyboard_destroy.link);
+	}
+
+	wl_list_remove(&rc->client_destroy.link);
+	free(rc);
+}
+
+static struct relay_client *
+get_relay_client(struct wl_client *client)
+{
+	struct wl_listener *listener;
+	struct relay_client *rc;
+
+	listener = wl_client_get_destroy_listener(client, relay_client_destroyed);
+	if (listener) {
+		return container_of(listener, struct relay_client, client_destroy);
+	}
+
+	rc = calloc(1, sizeof *rc);
+	if (!rc) {
+		return NULL;
+	}
+
+	rc->touch_destroy.notify = relay_client_touch_destroyed;
+	rc->keyboard_destroy.notify = relay_client_keyboard_destroyed;
+	rc->client_destroy.notify = relay_client_destroyed;
+	wl_client_add_destroy_listener(client, &rc->client_destroy);
+
+	return rc;
+}
+
+/*
+ * Find the first resource in 'list' that belongs to 'client'.
+ */
+static struct wl_resource *
+find_client_resource(struct wl_list *list, struct wl_client *client)
+{
+	struct wl_resource *resource;
+
+	wl_resource_for_each(resource, list) {
+		if (wl_resource_get_client(resource) == client) {
+			return resource;
+		}
+	}
+
+	return NULL;
+}
+
+static struct wl_resource *
+get_client_touch(struct ias_shell *shell, struct wl_client *client)
+{
+	struct relay_client *rc = get_relay_client(client);
+	struct weston_seat *seat;
+	struct wl_resource *touch = NULL;
+
+	if (rc && rc->touch) {
+		return rc->touch;
+	}
+
+	wl_list_for_each(seat, &shell->compositor->seat_list, link) {
+		if (!seat->touch_state) {
+			continue;
+		}
+
+		touch = find_client_resource(&seat->touch_state->resource_list,
+				client);
+		if (!touch) {
+			touch = find_client_resource(
+					&seat->touch_state->focus_resource_list, client);
+		}
+		if (touch) {
 			break;
 		}
 	}
 
-	if (surf_resource == NULL) {
-		printf("No surface to match surfid.\n");
-		return;
+	if (rc && touch) {
+		rc->touch = touch;
+		wl_resource_add_destroy_listener(touch, &rc->touch_destroy);
 	}
 
+	return touch;
+}
+
+static struct wl_resource *
+get_client_keyboard(struct ias_shell *shell, struct wl_client *client)
+{
+	struct relay_client *rc = get_relay_client(client);
+	struct weston_seat *seat;
+	struct wl_resource *keyboard = NULL;
 
+	if (rc && rc->keyboard) {
+		return rc->keyboard;
+	}
 
 	wl_list_for_each(seat, &shell->compositor->seat_list, link) {
-		wl_list_for_each(t_resource, &seat->touch_state->resource_list, link) {
-			if (wl_resource_get_client(t_resource) == wl_resource_get_client(surf_resource)) {
-				target_resource = t_resource;
-				break;
-			}
+		if (!seat->keyboard_state) {
+			continue;
+		}
+
+		keyboard = find_client_resource(&seat->keyboard_state->resource_list,
+				client);
+		if (!keyboard) {
+			keyboard = find_client_resource(
+					&seat->keyboard_state->focus_resource_list, client);
 		}
-		if (target_resource) {
-			printf("Target resource found for seat %p.\n", seat);
+		if (keyboard) {
 			break;
-		} else {
-			printf("Target resource not found for seat %p.\n", seat);
 		}
 	}
 
-	if (target_resource == NULL) {
-		printf("No target resource found.\n");
-		return;
+	if (rc && keyboard) {
+		rc->keyboard = keyboard;
+		wl_resource_add_destroy_listener(keyboard, &rc->keyboard_destroy);
 	}
 
+	return keyboard;
+}
+
+static void
+relay_touch(struct wl_client *client, struct ias_surface *shsurf,
+		struct wl_resource *target_resource, uint32_t touch_event_type,
+		uint32_t touch_id, uint32_t x, uint32_t y, uint32_t time)
+{
+	uint32_t serial;
+
 	switch(touch_event_type) {
 		case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_DOWN:
-		{
-			uint32_t serial = wl_display_next_serial(wl_client_get_display(client));
-			printf("Touch down at (%f,%f). ID=%d - server.\n",
-				wl_fixed_to_double(x),
-				wl_fixed_to_double(y),
-				touch_id);
+			serial = wl_display_next_serial(wl_client_get_display(client));
 			wl_touch_send_down(target_resource,
 					serial, time,
-					ws_resource,
+					shsurf->surface->resource,
 					touch_id, x, y);
 			break;
-		}
 		case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_UP:
-		{
-			uint32_t serial = wl_display_next_serial(wl_client_get_display(client));
-			printf("Touch up - server.\n");
+			serial = wl_display_next_serial(wl_client_get_display(client));
 			wl_touch_send_up(target_resource, serial, time, touch_id);
 			break;
-		}
 		case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_MOTION:
-			printf("Touch motion at (%f,%f). ID=%d - server.\n",
-				wl_fixed_to_double(x),
-				wl_fixed_to_double(y),
-				touch_id);
 			wl_touch_send_motion(target_resource, time, touch_id, x, y);
 			break;
 		case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_FRAME:
-			printf("Touch frame - server.\n");
-			 wl_touch_send_frame(target_resource);
+			wl_touch_send_frame(target_resource);
 			break;
 		case IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_CANCEL:
-			printf("Touch cancel - server.\n");
 			wl_touch_send_cancel(target_resource);
 			break;
 	}
 }
 
+static void
+relay_key(struct wl_client *client, struct wl_resource *target_resource,
+		uint32_t key_event_type, uint32_t time, uint32_t key, uint32_t state)
+{
+	uint32_t serial;
+
+	serial = wl_display_next_serial(wl_client_get_display(client));
+	switch(key_event_type) {
+	case IAS_RELAY_INPUT_KEY_EVENT_TYPE_KEY:
+		wl_keyboard_send_key(target_resource, serial, time, key, state);
+		break;
+	}
+}
+
+static void
+ias_relay_input_send_touch(struct wl_client *client,
+			struct wl_resource *resource,
+			uint32_t touch_event_type,
+			uint32_t surfid,
+			uint32_t touch_id,
+			uint32_t x,
+			uint32_t y,
+			uint32_t time)
+{
+	struct ias_shell *shell = wl_resource_get_user_data(resource);
+	struct ias_surface *shsurf;
+	struct wl_resource *target_resource;
+
+	shsurf = ias_shell_get_surface(shell, surfid);
+	if (!shsurf) {
+		IAS_DEBUG("No surface to match surfid %u", surfid);
+		return;
+	}
+
+	target_resource = get_client_touch(shell,
+			wl_resource_get_client(shsurf->resource));
+	if (!target_resource) {
+		IAS_DEBUG("No touch resource for surface %u", surfid);
+		return;
+	}
+
+	relay_touch(client, shsurf, target_resource,
+			touch_event_type, touch_id, x, y, time);
+}
+
 static void
 ias_relay_input_send_key(struct wl_client *client,
 			struct wl_resource *resource,
@@ -152,59 +298,93 @@ ias_relay_input_send_key(struct wl_client *client,
 {
 	struct ias_shell *shell = wl_resource_get_user_data(resource);
 	struct ias_surface *shsurf;
-	struct wl_resource *surf_resource = NULL;
-	struct wl_resource *t_resource = NULL;
-	struct wl_resource *target_resource = NULL;
-    struct weston_seat *seat = NULL;
-
-	printf("Key event received in server.\n");
-
-	/* Walk the surface list looking for the requested surface.  */
-	wl_list_for_each(shsurf, &shell->client_surfaces, surface_link) {
-		printf("Surface ID: %u\n", SURFPTR2ID(shsurf));
-		if (SURFPTR2ID(shsurf) == surfid) {
-			surf_resource = shsurf->resource;
-			break;
-		}
+	struct wl_resource *target_resource;
+
+	shsurf = ias_shell_get_surface(shell, surfid);
+	if (!shsurf) {
+		IAS_DEBUG("No surface to match surfid %u", surfid);
+		return;
 	}
 
-	if (surf_resource == NULL) {
-		printf("No surface to match surfid.\n");
+	target_resource = get_client_keyboard(shell,
+			wl_resource_get_client(shsurf->resource));
+	if (!target_resource) {
+		IAS_DEBUG("No keyboard resource for surface %u", surfid);
 		return;
 	}
 
-	wl_list_for_each(seat, &shell->compositor->seat_list, link) {
-		wl_list_for_each(t_resource, &seat->keyboard_state->resource_list, link) {
-			if (wl_resource_get_client(t_resource) == wl_resource_get_client(surf_resource)) {
-				target_resource = t_resource;
-				break;
-			}
-		}
-		if (target_resource) {
-			printf("Target resource found for seat %p.\n", seat);
-			break;
-		} else {
-			printf("Target resource not found for seat %p.\n", seat);
-		}
+	relay_key(client, target_resource, key_event_type, time, key, state);
+}
+
+static void
+ias_relay_input_send_events(struct wl_client *client,
+			struct wl_resource *resource,
+			uint32_t surfid,
+			struct wl_array *events)
+{
+	struct ias_shell *shell = wl_resource_get_user_data(resource);
+	struct ias_relay_input_event *ev;
+	struct ias_surface *shsurf;
+	struct wl_client *target_client;
+	struct wl_resource *touch = NULL;
+	struct wl_resource *keyboard = NULL;
+	uint32_t count;
+	uint32_t i;
+
+	if (events->size % sizeof(*ev)) {
+		wl_resource_post_error(resource,
+				IAS_RELAY_INPUT_ERROR_INVALID_EVENTS,
+				"event array size %zu is not a multiple of %zu",
+				events->size, sizeof(*ev));
+		return;
 	}
 
-	if (target_resource == NULL) {
-		printf("No target resource found.\n");
+	shsurf = ias_shell_get_surface(shell, surfid);
+	if (!shsurf) {
+		IAS_DEBUG("No surface to match surfid %u", surfid);
 		return;
 	}
+	target_client = wl_resource_get_client(shsurf->resource);
 
-	uint32_t serial = wl_display_next_serial(wl_client_get_display(client));
-	switch(key_event_type) {
-	case IAS_RELAY_INPUT_KEY_EVENT_TYPE_KEY:
-		printf("Send key %u - server.\n", key);
-		wl_keyboard_send_key(target_resource, serial, time, key, state);
-		break;
+	/*
+	 * Everything in the batch arrived at once, so intermediate positions of
+	 * a touch point within a frame would only be stale work for the client.
+	 */
+	ev = events->data;
+	count = ias_relay_input_coalesce(ev, events->size / sizeof(*ev));
+
+	for (i = 0; i < count; i++, ev++) {
+		switch (ev->kind) {
+		case IAS_RELAY_INPUT_EVENT_KIND_TOUCH:
+			if (!touch) {
+				touch = get_client_touch(shell, target_client);
+			}
+			if (!touch) {
+				IAS_DEBUG("No touch resource for surface %u", surfid);
+				continue;
+			}
+			relay_touch(client, shsurf, touch, ev->type,
+					ev->touch.id, ev->touch.x, ev->touch.y, ev->time);
+			break;
+		case IAS_RELAY_INPUT_EVENT_KIND_KEY:
+			if (!keyboard) {
+				keyboard = get_client_keyboard(shell, target_client);
+			}
+			if (!keyboard) {
+				IAS_DEBUG("No keyboard resource for surface %u", surfid);
+				continue;
+			}
+			relay_key(client, keyboard, ev->type, ev->time,
+					ev->key.key, ev->key.state);
+			break;
+		}
 	}
 }
 
 static const struct ias_relay_input_interface ias_relay_input_implementation = {
 	ias_relay_input_send_touch,
 	ias_relay_input_send_key,
+	ias_relay_input_send_events,
 };
 
 
@@ -220,7 +400,8 @@ bind_ias_relay_input(struct wl_client *client,
 	struct wl_resource *resource;
 
 	printf("bind_ias_relay_input...\n");
-	resource = wl_resource_create(client, &ias_relay_input_interface, 1, id);
+	resource = wl_resource_create(client, &ias_relay_input_interface,
+			version, id);
 	if (resource == NULL) {
 		wl_client_post_no_memory(client);
 		return;
@@ -73,6 +73,16 @@ struct bound_client {
 #define wl_list_first(head, type, member)             \
 	wl_list_empty(head) ? NULL : container_of((head)->next, type, member)
 
+/*
+ * Surface ids are truncated heap addresses, so the low bits are mostly
+ * alignment; spread them with a multiplicative hash.
+ */
+static inline uint32_t
+surface_index_bucket(uint32_t id)
+{
+	return (id * 2654435761u) >> (32 - IAS_SURFACE_INDEX_BITS);
+}
+
 
 /***
  *** Function Prototypes
@@ -895,6 +905,8 @@ ias_shell_get_ias_surface_internal(struct wl_client *client,
 	 * identifier.
 	 */
 	wl_list_insert(&shell->client_surfaces, &shsurf->surface_link);
+	wl_list_insert(&shell->surface_index[surface_index_bucket(SURFPTR2ID(shsurf))],
+			&shsurf->index_link);
 
 	wl_list_for_each(cb, &shell->sfc_change_callbacks, link) {
 		ias_hmi_send_surface_info(cb->resource, SURFPTR2ID(shsurf),
@@ -1164,6 +1176,27 @@ bind_wl_shell(struct wl_client *client,
 	wl_list_insert(&self->wl_shell_clients, &bound->link);
 }
 
+/*
+ * ias_shell_get_surface()
+ *
+ * Look up a client surface by the id we hand out to the HMI (SURFPTR2ID).
+ * Returns NULL if there's no such surface.
+ */
+struct ias_surface *
+ias_shell_get_surface(struct ias_shell *shell, uint32_t id)
+{
+	struct ias_surface *shsurf;
+
+	wl_list_for_each(shsurf, &shell->surface_index[surface_index_bucket(id)],
+			index_link) {
+		if (SURFPTR2ID(shsurf) == id) {
+			return shsurf;
+		}
+	}
+
+	return NULL;
+}
+
 /*
  *  surface_exists()
  *
@@ -1304,6 +1337,7 @@ ias_surface_destructor(struct ias_surface *shsurf)
 
 	/* Remove surface from surface lists */
 	wl_list_remove(&shsurf->surface_link);
+	wl_list_remove(&shsurf->index_link);
 
 	/* Remove surface from popup/background special surface lists */
 	wl_list_remove(&shsurf->special_link);
@@ -1436,6 +1470,7 @@ ias_surface_constructor(void *shellptr,
 	wl_list_init(&shsurf->special_link);
 
 	wl_list_init(&shsurf->surface_link);
+	wl_list_init(&shsurf->index_link);
 
 	/*
 	 * Initialize process id and name for the client app associated with this
@@ -1794,6 +1829,8 @@ print_fps(struct wl_listener *listener, void *data)
 	float time_diff_secs;
 	uint32_t curr_time_ms;
 	struct ias_surface *shsurf;
+	struct weston_output *output;
+	struct ias_output *ias_output;
 
 	gettimeofday(&curr_time, NULL);
 	curr_time_ms = (curr_time.tv_sec * 1000 + curr_time.tv_usec / 1000);
@@ -1817,6 +1854,18 @@ print_fps(struct wl_listener *listener, void *data)
 			shsurf->flip_count = 0;
 		}
 
+		wl_list_for_each(output, &shell->compositor->output_list, link) {
+			ias_output = (struct ias_output *)output;
+			fprintf(stdout, "%s: %u full, %u partial redraws\n",
+					ias_output->name,
+					ias_output->damage_history.full_redraws,
+					ias_output->damage_history.partial_redraws);
+			fflush(stdout);
+
+			ias_output->damage_history.full_redraws = 0;
+			ias_output->damage_history.partial_redraws = 0;
+		}
+
 		fprintf(stdout, "--------------------------------------------------------\n");
 
 		prev_time_ms = curr_time_ms;
@@ -2340,6 +2389,7 @@ WL_EXPORT int wet_shell_init(struct weston_compositor *compositor,
 	struct ias_backend *ias_compositor;
 	struct weston_output *output;
 	struct ias_output *ias_output;
+	int i;
 
 	/* Allocate shell object */
 	shell = calloc(1, sizeof *shell);
@@ -2392,6 +2442,9 @@ WL_EXPORT int wet_shell_init(struct weston_compositor *compositor,
 	wl_list_init(&shell->background_surfaces);
 	wl_list_init(&shell->popup_surfaces);
 	wl_list_init(&shell->client_surfaces);
+	for (i = 0; i < IAS_SURFACE_INDEX_SIZE; i++) {
+		wl_list_init(&shell->surface_index[i]);
+	}
 
 	/* Initialize hmi callback list */
 	wl_list_init(&shell->sfc_change_callbacks);
@@ -2487,7 +2540,7 @@ WL_EXPORT int wet_shell_init(struct weston_compositor *compositor,
 		return -1;
 	}
 	if (!wl_global_create(compositor->wl_display,
-				&ias_relay_input_interface, 1, shell, bind_ias_relay_input))
+				&ias_relay_input_interface, 2, shell, bind_ias_relay_input))
 	{
 		return -1;
 	}
@@ -42,6 +42,10 @@
 
 #define CFG_FILENAME "ias.conf"
 
+/* Number of buckets in the surface id index */
+#define IAS_SURFACE_INDEX_BITS 8
+#define IAS_SURFACE_INDEX_SIZE (1 << IAS_SURFACE_INDEX_BITS)
+
 struct ias_shell;
 
 WL_EXPORT struct ias_surface*
@@ -89,6 +93,12 @@ struct ias_shell {
 	struct wl_list popup_surfaces;
 	struct wl_list client_surfaces;
 
+	/*
+	 * client_surfaces hashed by SURFPTR2ID(), for the HMI and relay input
+	 * requests that name a surface by id.
+	 */
+	struct wl_list surface_index[IAS_SURFACE_INDEX_SIZE];
+
 #ifdef IASDEBUG
 	/*
 	 * Special 'default' background surface.  An HMI should really set the
@@ -219,6 +229,9 @@ struct ias_surface {
 	 * special surface list like popup list */
 	struct wl_list surface_link;
 
+	/* Node in the shell's surface id index bucket */
+	struct wl_list index_link;
+
 	/* Node in special surface list (popup list, background list, etc.) */
 	struct wl_list special_link;
 
@@ -245,4 +258,7 @@ struct ias_surface {
 // whether surface is directly flipped or composited
 int ias_surface_is_flipped(struct ias_surface *shsurf);
 
+struct ias_surface *
+ias_shell_get_surface(struct ias_shell *shell, uint32_t id);
+
 #endif
@@ -470,6 +470,44 @@ struct ipug_event_info_layout_switch_from {
 	struct ias_plugin_info *plugin;
 };
 
+/* storage large enough to hold any of the ipug_event_info_* structures */
+union ipug_event {
+	struct ipug_event_info base;
+	struct ipug_event_info_pointer_focus pointer_focus;
+	struct ipug_event_info_pointer_motion pointer_motion;
+	struct ipug_event_info_pointer_button pointer_button;
+	struct ipug_event_info_pointer_cancel pointer_cancel;
+	struct ipug_event_info_touch_down touch_down;
+	struct ipug_event_info_touch_motion touch_motion;
+	struct ipug_event_info_touch_up touch_up;
+	struct ipug_event_info_touch_frame touch_frame;
+	struct ipug_event_info_touch_cancel touch_cancel;
+	struct ipug_event_info_key_key key_key;
+	struct ipug_event_info_key_mod key_mod;
+	struct ipug_event_info_key_cancel key_cancel;
+};
+
+/* Maximum number of events handed to on_input_batch in one call */
+#define IPUG_EVENT_BATCH_MAX 128
+
+/* A run of input events delivered to an input plugin in one call. The
+ * events are stored contiguously in the order they were received. Any time
+ * pointer in an event points into the times array of the same batch, so
+ * both stay valid only for the duration of the callback. */
+struct ipug_event_batch {
+	/* number of valid entries in events */
+	uint32_t count;
+
+	/* IPUG_*_BIT of every event type present in this batch */
+	ipug_event_mask mask;
+
+	/* number of events of each ipug_event_type in this batch */
+	uint32_t type_count[IPUG_NUM_EVENT_TYPES];
+
+	union ipug_event events[IPUG_EVENT_BATCH_MAX];
+	struct timespec times[IPUG_EVENT_BATCH_MAX];
+};
+
 /* wrappers around ias_* functions */
 WL_EXPORT uint32_t spug_assign_surface_to_scanout(	const spug_view_id view,
 													int x, int y);
@@ -0,0 +1,269 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: input-latency.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Per-stage latency histograms for input events.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "compositor.h"
+#include "input-latency.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+static const char *stage_names[] = {
+	[WESTON_INPUT_LATENCY_DEVICE_READ] = "device read",
+	[WESTON_INPUT_LATENCY_SEAT_DISPATCH] = "seat dispatch",
+	[WESTON_INPUT_LATENCY_PLUGIN_GRAB] = "plugin grab",
+	[WESTON_INPUT_LATENCY_CLIENT_SEND] = "client send",
+	[WESTON_INPUT_LATENCY_CLIENT_COMMIT] = "client commit",
+};
+
+/*
+ * Everything is measured against CLOCK_MONOTONIC, which is also the clock
+ * libinput (and evdev, once EVIOCSCLOCKID is set) stamps events with.
+ */
+static uint64_t
+now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) timespec_to_usec(&ts);
+}
+
+static void
+record(struct weston_input_latency *latency,
+       enum weston_input_latency_stage stage,
+       uint64_t start, uint64_t end)
+{
+	struct weston_latency_histogram *h = &latency->stages[stage];
+	uint64_t usec = end > start ? end - start : 0;
+	unsigned int bucket = 0;
+
+	if (usec > UINT32_MAX)
+		usec = UINT32_MAX;
+
+	if (usec)
+		bucket = 64 - __builtin_clzll(usec);
+	if (bucket >= WESTON_INPUT_LATENCY_BUCKETS)
+		bucket = WESTON_INPUT_LATENCY_BUCKETS - 1;
+
+	h->buckets[bucket]++;
+	h->count++;
+	h->sum_usec += usec;
+	if (usec > h->max_usec)
+		h->max_usec = usec;
+}
+
+/** Turn on input latency tracking for a compositor.
+ *
+ * \param compositor The compositor to instrument.
+ * \return 0 on success, -1 on allocation failure.
+ *
+ * Tracking stays enabled until the compositor is destroyed.  Calling this
+ * again is harmless.
+ */
+WL_EXPORT int
+weston_input_latency_enable(struct weston_compositor *compositor)
+{
+	if (compositor->input_latency)
+		return 0;
+
+	compositor->input_latency = zalloc(sizeof *compositor->input_latency);
+	if (!compositor->input_latency)
+		return -1;
+
+	return 0;
+}
+
+/** Clear all collected histograms. */
+WL_EXPORT void
+weston_input_latency_reset(struct weston_input_latency *latency)
+{
+	memset(latency->stages, 0, sizeof latency->stages);
+}
+
+WL_EXPORT const char *
+weston_input_latency_stage_name(enum weston_input_latency_stage stage)
+{
+	if (stage >= ARRAY_LENGTH(stage_names))
+		return "unknown";
+
+	return stage_names[stage];
+}
+
+/** Upper bound, in microseconds, of the bucket holding the given percentile.
+ *
+ * Returns 0 for an empty histogram and UINT32_MAX if the percentile lands in
+ * the open-ended last bucket.
+ */
+WL_EXPORT uint32_t
+weston_latency_histogram_percentile(const struct weston_latency_histogram *h,
+				    uint32_t percent)
+{
+	uint64_t target, seen = 0;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	target = ((uint64_t) h->count * percent + 99) / 100;
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < WESTON_INPUT_LATENCY_BUCKETS - 1; i++) {
+		seen += h->buckets[i];
+		if (seen >= target)
+			return 1u << i;
+	}
+
+	return UINT32_MAX;
+}
+
+/** Write a summary of every stage to the compositor log. */
+WL_EXPORT void
+weston_input_latency_log(struct weston_input_latency *latency)
+{
+	const struct weston_latency_histogram *h;
+	unsigned int i;
+
+	weston_log("input latency (usec, percentiles are bucket bounds):\n");
+
+	for (i = 0; i < WESTON_INPUT_LATENCY_STAGE_COUNT; i++) {
+		h = &latency->stages[i];
+
+		if (!h->count) {
+			weston_log_continue(STAMP_SPACE "%-14s no samples\n",
+					    stage_names[i]);
+			continue;
+		}
+
+		weston_log_continue(STAMP_SPACE "%-14s n=%u mean=%llu "
+				    "p50<%u p99<%u max=%u\n",
+				    stage_names[i], h->count,
+				    (unsigned long long) (h->sum_usec / h->count),
+				    weston_latency_histogram_percentile(h, 50),
+				    weston_latency_histogram_percentile(h, 99),
+				    h->max_usec);
+	}
+}
+
+WL_EXPORT void
+weston_input_latency_event_begin_(struct weston_input_latency *latency,
+				  const struct timespec *kernel_time)
+{
+	latency->read_usec = now_usec();
+	latency->grab_usec = 0;
+	latency->sent = false;
+	latency->from_device = true;
+
+	if (kernel_time)
+		record(latency, WESTON_INPUT_LATENCY_DEVICE_READ,
+		       timespec_to_usec(kernel_time), latency->read_usec);
+}
+
+WL_EXPORT void
+weston_input_latency_event_end_(struct weston_input_latency *latency)
+{
+	latency->read_usec = 0;
+	latency->grab_usec = 0;
+	latency->sent = false;
+	latency->from_device = false;
+}
+
+WL_EXPORT void
+weston_input_latency_grab_begin_(struct weston_input_latency *latency)
+{
+	uint64_t now = now_usec();
+
+	/* Injected events have no backend read; dispatch starts here */
+	if (!latency->read_usec)
+		latency->read_usec = now;
+
+	record(latency, WESTON_INPUT_LATENCY_SEAT_DISPATCH,
+	       latency->read_usec, now);
+
+	latency->grab_usec = now;
+	latency->sent = false;
+}
+
+WL_EXPORT void
+weston_input_latency_grab_end_(struct weston_input_latency *latency)
+{
+	/* A grab that swallowed the event still cost its own run time */
+	if (latency->grab_usec && !latency->sent)
+		record(latency, WESTON_INPUT_LATENCY_PLUGIN_GRAB,
+		       latency->grab_usec, now_usec());
+
+	latency->grab_usec = 0;
+	latency->sent = false;
+
+	/* One device event may feed several grabs (e.g. both scroll axes) */
+	if (!latency->from_device)
+		latency->read_usec = 0;
+}
+
+WL_EXPORT void
+weston_input_latency_sent_(struct weston_input_latency *latency,
+			   struct weston_surface *surface)
+{
+	uint64_t now;
+
+	/* Only the first client event sent for a seat event is measured */
+	if (!latency->grab_usec || latency->sent)
+		return;
+
+	now = now_usec();
+	record(latency, WESTON_INPUT_LATENCY_PLUGIN_GRAB,
+	       latency->grab_usec, now);
+	record(latency, WESTON_INPUT_LATENCY_CLIENT_SEND,
+	       latency->read_usec, now);
+	latency->sent = true;
+
+	/* The oldest unanswered event is what the next commit answers */
+	if (surface && !surface->input_latency_usec)
+		surface->input_latency_usec = now;
+}
+
+WL_EXPORT void
+weston_input_latency_commit_(struct weston_input_latency *latency,
+			     struct weston_surface *surface)
+{
+	if (!surface->input_latency_usec)
+		return;
+
+	record(latency, WESTON_INPUT_LATENCY_CLIENT_COMMIT,
+	       surface->input_latency_usec, now_usec());
+	surface->input_latency_usec = 0;
+}
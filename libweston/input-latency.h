@@ -0,0 +1,178 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: input-latency.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Per-stage latency histograms for input events, from the kernel
+ *   timestamp to the client's next surface commit.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef WESTON_INPUT_LATENCY_H
+#define WESTON_INPUT_LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "compositor.h"
+
+/*
+ * Stages an input event passes through.  Each stage is measured separately:
+ *
+ *   DEVICE_READ    kernel timestamp -> compositor reads the event
+ *   SEAT_DISPATCH  event read -> seat hands it to the active grab
+ *   PLUGIN_GRAB    grab entered -> first wl_* event sent (or grab returns)
+ *   CLIENT_SEND    event read -> first wl_* event sent to a client
+ *   CLIENT_COMMIT  first wl_* event sent -> receiving surface commits
+ *
+ * Events injected without a kernel timestamp (weston-test, remote input)
+ * start at SEAT_DISPATCH.
+ */
+enum weston_input_latency_stage {
+	WESTON_INPUT_LATENCY_DEVICE_READ = 0,
+	WESTON_INPUT_LATENCY_SEAT_DISPATCH,
+	WESTON_INPUT_LATENCY_PLUGIN_GRAB,
+	WESTON_INPUT_LATENCY_CLIENT_SEND,
+	WESTON_INPUT_LATENCY_CLIENT_COMMIT,
+	WESTON_INPUT_LATENCY_STAGE_COUNT,
+};
+
+/*
+ * Log2 buckets in microseconds: bucket 0 counts samples below 1us, bucket n
+ * counts [2^(n-1), 2^n) us and the last bucket everything above that.
+ */
+#define WESTON_INPUT_LATENCY_BUCKETS 24
+
+struct weston_latency_histogram {
+	uint32_t buckets[WESTON_INPUT_LATENCY_BUCKETS];
+	uint32_t count;
+	uint32_t max_usec;
+	uint64_t sum_usec;
+};
+
+struct weston_input_latency {
+	struct weston_latency_histogram stages[WESTON_INPUT_LATENCY_STAGE_COUNT];
+
+	/* State of the event currently travelling through notify_*() */
+	uint64_t read_usec;
+	uint64_t grab_usec;
+	bool sent;
+	/* read_usec came from a backend and lasts until event_end */
+	bool from_device;
+};
+
+int
+weston_input_latency_enable(struct weston_compositor *compositor);
+
+void
+weston_input_latency_reset(struct weston_input_latency *latency);
+
+const char *
+weston_input_latency_stage_name(enum weston_input_latency_stage stage);
+
+uint32_t
+weston_latency_histogram_percentile(const struct weston_latency_histogram *h,
+				    uint32_t percent);
+
+void
+weston_input_latency_log(struct weston_input_latency *latency);
+
+void
+weston_input_latency_event_begin_(struct weston_input_latency *latency,
+				  const struct timespec *kernel_time);
+void
+weston_input_latency_event_end_(struct weston_input_latency *latency);
+void
+weston_input_latency_grab_begin_(struct weston_input_latency *latency);
+void
+weston_input_latency_grab_end_(struct weston_input_latency *latency);
+void
+weston_input_latency_sent_(struct weston_input_latency *latency,
+			   struct weston_surface *surface);
+void
+weston_input_latency_commit_(struct weston_input_latency *latency,
+			     struct weston_surface *surface);
+
+/*
+ * The hooks below sit on the input hot path; they cost a single pointer
+ * test unless a module has enabled latency tracking.
+ */
+
+/* A backend has read an event carrying the kernel timestamp kernel_time. */
+static inline void
+weston_input_latency_event_begin(struct weston_compositor *compositor,
+				 const struct timespec *kernel_time)
+{
+	if (compositor->input_latency)
+		weston_input_latency_event_begin_(compositor->input_latency,
+						  kernel_time);
+}
+
+/* The backend is done with the event, whether or not it reached a grab. */
+static inline void
+weston_input_latency_event_end(struct weston_compositor *compositor)
+{
+	if (compositor->input_latency)
+		weston_input_latency_event_end_(compositor->input_latency);
+}
+
+/* The seat is about to hand the event to its active grab. */
+static inline void
+weston_input_latency_grab_begin(struct weston_compositor *compositor)
+{
+	if (compositor->input_latency)
+		weston_input_latency_grab_begin_(compositor->input_latency);
+}
+
+/* The active grab has returned. */
+static inline void
+weston_input_latency_grab_end(struct weston_compositor *compositor)
+{
+	if (compositor->input_latency)
+		weston_input_latency_grab_end_(compositor->input_latency);
+}
+
+/* A wl_pointer/wl_keyboard/wl_touch event is being sent for surface. */
+static inline void
+weston_input_latency_sent(struct weston_compositor *compositor,
+			  struct weston_surface *surface)
+{
+	if (compositor->input_latency)
+		weston_input_latency_sent_(compositor->input_latency, surface);
+}
+
+/* A client committed surface. */
+static inline void
+weston_input_latency_commit(struct weston_compositor *compositor,
+			    struct weston_surface *surface)
+{
+	if (compositor->input_latency)
+		weston_input_latency_commit_(compositor->input_latency, surface);
+}
+
+#endif /* WESTON_INPUT_LATENCY_H */
@@ -0,0 +1,881 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: input-replay.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Replay of recorded evdev traces through the seat input path.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <linux/input.h>
+
+#include "compositor.h"
+#include "input-latency.h"
+#include "input-replay.h"
+#include "shared/helpers.h"
+#include "shared/timespec-util.h"
+
+/* Same scroll distance per wheel click as libinput-device.c reports */
+#define REPLAY_AXIS_STEP_DISTANCE 10
+
+#define REPLAY_MAX_SLOTS 16
+
+/*
+ * Frames delivered per main loop iteration when replaying faster than
+ * recorded, so clients are flushed and can keep up in between.
+ */
+#define REPLAY_FRAMES_PER_DISPATCH 32
+
+struct replay_event {
+	uint64_t usec;
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+};
+
+struct replay_axis {
+	int32_t min;
+	int32_t max;
+	bool known;
+};
+
+struct replay_slot {
+	int32_t x;
+	int32_t y;
+	bool active;
+	bool down;
+	bool up;
+	bool moved;
+	/* the previous contact lifted in the frame this one started in */
+	bool up_first;
+};
+
+struct weston_input_replay {
+	struct weston_compositor *compositor;
+	struct weston_seat seat;
+	char *seat_name;
+	bool seat_initialized;
+
+	/* recorded trace */
+	struct replay_event *events;
+	size_t count;
+	size_t alloc;
+	struct replay_axis abs_x, abs_y;
+	bool has_pointer;
+	bool has_keyboard;
+	bool has_touch;
+	bool has_mt;
+	bool abs_pointer;
+
+	/* playback */
+	struct wl_event_source *timer;
+	struct wl_event_source *wake_source;
+	int wake_fd;
+	bool running;
+	double speed;
+	int passes_left;
+	size_t next;
+	uint64_t start_usec;
+	uint64_t pass_offset_usec;
+	uint64_t start_cpu_usec;
+	weston_input_replay_done_func_t done;
+	void *done_data;
+	struct weston_input_replay_stats stats;
+
+	/* evdev state of the frame being assembled */
+	int slot;
+	struct replay_slot slots[REPLAY_MAX_SLOTS];
+	int32_t dx, dy;
+	int32_t wheel, hwheel;
+	int32_t x, y;
+	bool abs_moved;
+	bool touch_frame;
+	uint32_t buttons_down;
+	struct wl_array keys_down;
+};
+
+static uint64_t
+clock_usec(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return timespec_to_usec(&ts);
+}
+
+/*
+ * Trace parsing
+ */
+
+static int
+replay_add_event(struct weston_input_replay *replay, uint64_t usec,
+		 unsigned int type, unsigned int code, int32_t value)
+{
+	struct replay_event *ev;
+	size_t alloc;
+
+	if (replay->count == replay->alloc) {
+		alloc = replay->alloc ? replay->alloc * 2 : 4096;
+		ev = realloc(replay->events, alloc * sizeof *ev);
+		if (!ev)
+			return -1;
+		replay->events = ev;
+		replay->alloc = alloc;
+	}
+
+	ev = &replay->events[replay->count++];
+	ev->usec = usec;
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+
+	switch (type) {
+	case EV_REL:
+		replay->has_pointer = true;
+		break;
+	case EV_KEY:
+		if (code == BTN_TOUCH)
+			replay->has_touch = true;
+		else if (code >= BTN_MOUSE && code < BTN_JOYSTICK)
+			replay->has_pointer = true;
+		else if (code < BTN_MISC || code >= KEY_OK)
+			replay->has_keyboard = true;
+		break;
+	case EV_ABS:
+		if (code == ABS_MT_POSITION_X || code == ABS_MT_POSITION_Y)
+			replay->has_mt = true;
+		break;
+	}
+
+	return 0;
+}
+
+static void
+replay_set_axis(struct replay_axis *axis, int32_t min, int32_t max)
+{
+	axis->min = min;
+	axis->max = max;
+	axis->known = true;
+}
+
+/* Fall back to the range actually seen when the trace has no A: lines */
+static void
+replay_guess_axis(struct weston_input_replay *replay,
+		  struct replay_axis *axis, unsigned int code)
+{
+	size_t i;
+	bool seen = false;
+
+	if (axis->known)
+		return;
+
+	for (i = 0; i < replay->count; i++) {
+		if (replay->events[i].type != EV_ABS ||
+		    replay->events[i].code != code)
+			continue;
+
+		if (!seen || replay->events[i].value < axis->min)
+			axis->min = replay->events[i].value;
+		if (!seen || replay->events[i].value > axis->max)
+			axis->max = replay->events[i].value;
+		seen = true;
+	}
+
+	axis->known = seen;
+}
+
+static int
+replay_init_seat(struct weston_input_replay *replay)
+{
+	struct weston_seat *seat = &replay->seat;
+
+	if (replay->seat_initialized)
+		return 0;
+
+	weston_seat_init(seat, replay->compositor, replay->seat_name);
+	replay->seat_initialized = true;
+
+	if (replay->has_pointer || replay->abs_pointer)
+		weston_seat_init_pointer(seat);
+	if (replay->has_keyboard &&
+	    weston_seat_init_keyboard(seat, NULL) < 0)
+		return -1;
+	if (replay->has_touch)
+		weston_seat_init_touch(seat);
+
+	return 0;
+}
+
+/**
+ * Read an evemu-record trace of a single device.
+ *
+ * Only E: (event) and A: (absolute axis) lines are used; the device is
+ * described by the events it sends.  Multitouch traces must use slots
+ * (protocol B).  The replay seat is created with the capabilities the
+ * trace needs, so a replay can only be loaded once.
+ */
+WL_EXPORT int
+weston_input_replay_load(struct weston_input_replay *replay, FILE *fp)
+{
+	char line[512];
+	unsigned long sec, usec;
+	unsigned int type, code;
+	int min, max, value;
+	uint64_t usec_total, first = 0, last = 0;
+	bool have_first = false;
+	int lineno = 0;
+
+	if (replay->seat_initialized)
+		return -1;
+
+	while (fgets(line, sizeof line, fp)) {
+		lineno++;
+
+		if (strncmp(line, "A:", 2) == 0) {
+			if (sscanf(line, "A: %x %d %d", &code, &min, &max) != 3)
+				goto malformed;
+			if (code == ABS_MT_POSITION_X ||
+			    (code == ABS_X && !replay->abs_x.known))
+				replay_set_axis(&replay->abs_x, min, max);
+			else if (code == ABS_MT_POSITION_Y ||
+				 (code == ABS_Y && !replay->abs_y.known))
+				replay_set_axis(&replay->abs_y, min, max);
+			continue;
+		}
+
+		if (strncmp(line, "E:", 2) != 0)
+			continue;
+
+		if (sscanf(line, "E: %lu.%lu %x %x %d",
+			   &sec, &usec, &type, &code, &value) != 5 ||
+		    usec >= 1000000 || type > EV_MAX || code > KEY_MAX)
+			goto malformed;
+
+		usec_total = sec * 1000000ULL + usec;
+		if (!have_first) {
+			first = usec_total;
+			have_first = true;
+		} else if (usec_total < last) {
+			weston_log("input-replay: trace goes back in time at "
+				   "line %d\n", lineno);
+			return -1;
+		}
+		last = usec_total;
+
+		if (replay_add_event(replay, usec_total - first,
+				     type, code, value) < 0) {
+			weston_log("input-replay: out of memory\n");
+			return -1;
+		}
+	}
+
+	if (replay->count == 0) {
+		weston_log("input-replay: trace has no events\n");
+		return -1;
+	}
+
+	if (replay->has_mt) {
+		replay->has_touch = true;
+		replay_guess_axis(replay, &replay->abs_x, ABS_MT_POSITION_X);
+		replay_guess_axis(replay, &replay->abs_y, ABS_MT_POSITION_Y);
+	} else {
+		replay->abs_pointer = !replay->has_touch;
+		replay_guess_axis(replay, &replay->abs_x, ABS_X);
+		replay_guess_axis(replay, &replay->abs_y, ABS_Y);
+		if (!replay->abs_x.known)
+			replay->abs_pointer = false;
+	}
+
+	return replay_init_seat(replay);
+
+malformed:
+	weston_log("input-replay: malformed trace line %d: %s", lineno, line);
+	return -1;
+}
+
+/*
+ * Frame assembly, following what libinput reports for the same evdev
+ * sequence closely enough to load the seat the same way.
+ */
+
+static struct weston_output *
+replay_output(struct weston_input_replay *replay)
+{
+	if (wl_list_empty(&replay->compositor->output_list))
+		return NULL;
+
+	return container_of(replay->compositor->output_list.next,
+			    struct weston_output, link);
+}
+
+static bool
+replay_abs_to_global(struct weston_input_replay *replay,
+		     int32_t vx, int32_t vy, double *x, double *y)
+{
+	struct weston_output *output = replay_output(replay);
+	struct replay_axis *ax = &replay->abs_x, *ay = &replay->abs_y;
+	double fx, fy;
+
+	if (!output || !ax->known || !ay->known)
+		return false;
+
+	fx = (double)(vx - ax->min) * output->current_mode->width /
+		(ax->max - ax->min + 1);
+	fy = (double)(vy - ay->min) * output->current_mode->height /
+		(ay->max - ay->min + 1);
+	weston_output_transform_coordinate(output, fx, fy, x, y);
+
+	return true;
+}
+
+static void
+replay_key(struct weston_input_replay *replay, const struct timespec *time,
+	   uint32_t code, int32_t value)
+{
+	struct weston_seat *seat = &replay->seat;
+	uint32_t *k, *end;
+
+	/* autorepeat is the compositor's business */
+	if (value == 2 || !replay->has_keyboard)
+		return;
+
+	notify_key(seat, time, code,
+		   value ? WL_KEYBOARD_KEY_STATE_PRESSED :
+			   WL_KEYBOARD_KEY_STATE_RELEASED,
+		   STATE_UPDATE_AUTOMATIC);
+	replay->stats.events++;
+
+	end = (uint32_t *)((char *)replay->keys_down.data +
+			   replay->keys_down.size);
+	for (k = replay->keys_down.data; k < end; k++) {
+		if (*k == code) {
+			*k = end[-1];
+			replay->keys_down.size -= sizeof *k;
+			break;
+		}
+	}
+	if (value) {
+		k = wl_array_add(&replay->keys_down, sizeof *k);
+		if (k)
+			*k = code;
+	}
+}
+
+static void
+replay_button(struct weston_input_replay *replay, const struct timespec *time,
+	      uint32_t code, int32_t value)
+{
+	uint32_t bit = 1u << (code - BTN_MOUSE);
+
+	if (value == 2 || !!(replay->buttons_down & bit) == !!value)
+		return;
+
+	notify_button(&replay->seat, time, code,
+		      value ? WL_POINTER_BUTTON_STATE_PRESSED :
+			      WL_POINTER_BUTTON_STATE_RELEASED);
+	notify_pointer_frame(&replay->seat);
+	replay->stats.events++;
+
+	replay->buttons_down ^= bit;
+}
+
+static void
+replay_axis(struct weston_input_replay *replay, const struct timespec *time,
+	    uint32_t axis, int32_t discrete)
+{
+	struct weston_pointer_axis_event event = {
+		.axis = axis,
+		.value = discrete * REPLAY_AXIS_STEP_DISTANCE,
+		.has_discrete = true,
+		.discrete = discrete,
+	};
+
+	notify_axis(&replay->seat, time, &event);
+	replay->stats.events++;
+}
+
+static void
+replay_slot_event(struct weston_input_replay *replay, uint16_t code,
+		  int32_t value)
+{
+	struct replay_slot *slot;
+
+	if (code == ABS_MT_SLOT) {
+		replay->slot = value;
+		return;
+	}
+
+	if (replay->slot < 0 || replay->slot >= REPLAY_MAX_SLOTS)
+		return;
+	slot = &replay->slots[replay->slot];
+
+	switch (code) {
+	case ABS_MT_TRACKING_ID:
+		if (value >= 0 && !slot->active) {
+			/* a contact that came and went within this frame
+			 * is dropped; one from an earlier frame is lifted
+			 * before the new one goes down */
+			slot->up_first = slot->up && !slot->down;
+			slot->active = true;
+			slot->down = true;
+			slot->up = false;
+		} else if (value < 0 && slot->active) {
+			slot->active = false;
+			slot->up = true;
+		}
+		break;
+	case ABS_MT_POSITION_X:
+		slot->x = value;
+		slot->moved = true;
+		break;
+	case ABS_MT_POSITION_Y:
+		slot->y = value;
+		slot->moved = true;
+		break;
+	}
+}
+
+static void
+replay_abs(struct weston_input_replay *replay, uint16_t code, int32_t value)
+{
+	if (replay->has_mt) {
+		replay_slot_event(replay, code, value);
+		return;
+	}
+
+	switch (code) {
+	case ABS_X:
+		replay->x = value;
+		replay->slots[0].x = value;
+		break;
+	case ABS_Y:
+		replay->y = value;
+		replay->slots[0].y = value;
+		break;
+	default:
+		return;
+	}
+
+	replay->abs_moved = true;
+	replay->slots[0].moved = true;
+}
+
+static void
+replay_flush_touch(struct weston_input_replay *replay,
+		   const struct timespec *time)
+{
+	struct replay_slot *slot;
+	double x, y;
+	int i;
+
+	for (i = 0; i < REPLAY_MAX_SLOTS; i++) {
+		slot = &replay->slots[i];
+
+		if (slot->up_first) {
+			notify_touch(&replay->seat, time, i, 0, 0, WL_TOUCH_UP);
+			replay->stats.events++;
+			replay->touch_frame = true;
+			slot->up_first = false;
+		}
+
+		if (slot->up && !slot->down) {
+			notify_touch(&replay->seat, time, i, 0, 0, WL_TOUCH_UP);
+			replay->stats.events++;
+			replay->touch_frame = true;
+		} else if ((slot->down || (slot->moved && slot->active)) &&
+			   replay_abs_to_global(replay, slot->x, slot->y,
+						&x, &y)) {
+			notify_touch(&replay->seat, time, i, x, y,
+				     slot->down ? WL_TOUCH_DOWN :
+						  WL_TOUCH_MOTION);
+			replay->stats.events++;
+			replay->touch_frame = true;
+		}
+
+		/* a touch that came and went within one frame: up follows */
+		if (slot->up && slot->down) {
+			slot->down = false;
+			i--;
+			continue;
+		}
+
+		slot->down = false;
+		slot->up = false;
+		slot->moved = false;
+	}
+
+	if (replay->touch_frame) {
+		notify_touch_frame(&replay->seat);
+		replay->touch_frame = false;
+	}
+}
+
+static void
+replay_flush_frame(struct weston_input_replay *replay,
+		   const struct timespec *time)
+{
+	struct weston_pointer_motion_event motion = { 0 };
+	double x, y;
+
+	if (replay->dx || replay->dy) {
+		motion.mask = WESTON_POINTER_MOTION_REL |
+			      WESTON_POINTER_MOTION_REL_UNACCEL;
+		motion.time = *time;
+		motion.dx = motion.dx_unaccel = replay->dx;
+		motion.dy = motion.dy_unaccel = replay->dy;
+		notify_motion(&replay->seat, time, &motion);
+		notify_pointer_frame(&replay->seat);
+		replay->stats.events++;
+		replay->dx = replay->dy = 0;
+	}
+
+	if (replay->wheel || replay->hwheel) {
+		notify_axis_source(&replay->seat, WL_POINTER_AXIS_SOURCE_WHEEL);
+		/* evdev wheel up is positive, wl_pointer scroll up negative */
+		if (replay->wheel)
+			replay_axis(replay, time,
+				    WL_POINTER_AXIS_VERTICAL_SCROLL,
+				    -replay->wheel);
+		if (replay->hwheel)
+			replay_axis(replay, time,
+				    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
+				    replay->hwheel);
+		notify_pointer_frame(&replay->seat);
+		replay->wheel = replay->hwheel = 0;
+	}
+
+	if (replay->has_touch) {
+		replay_flush_touch(replay, time);
+	} else if (replay->abs_pointer && replay->abs_moved &&
+		   replay_abs_to_global(replay, replay->x, replay->y, &x, &y)) {
+		notify_motion_absolute(&replay->seat, time, x, y);
+		notify_pointer_frame(&replay->seat);
+		replay->stats.events++;
+	}
+	replay->abs_moved = false;
+
+	replay->stats.frames++;
+}
+
+static void
+replay_process_event(struct weston_input_replay *replay,
+		     const struct replay_event *ev,
+		     const struct timespec *time)
+{
+	switch (ev->type) {
+	case EV_SYN:
+		if (ev->code == SYN_REPORT) {
+			replay_flush_frame(replay, time);
+			weston_input_latency_event_end(replay->compositor);
+		}
+		break;
+	case EV_REL:
+		if (ev->code == REL_X)
+			replay->dx += ev->value;
+		else if (ev->code == REL_Y)
+			replay->dy += ev->value;
+		else if (ev->code == REL_WHEEL)
+			replay->wheel += ev->value;
+		else if (ev->code == REL_HWHEEL)
+			replay->hwheel += ev->value;
+		break;
+	case EV_ABS:
+		replay_abs(replay, ev->code, ev->value);
+		break;
+	case EV_KEY:
+		if (ev->code == BTN_TOUCH) {
+			if (!replay->has_mt && ev->value != 2) {
+				replay->slots[0].active = ev->value;
+				if (ev->value)
+					replay->slots[0].down = true;
+				else
+					replay->slots[0].up = true;
+			}
+		} else if (ev->code >= BTN_MOUSE && ev->code < BTN_JOYSTICK) {
+			if (replay->has_pointer)
+				replay_button(replay, time, ev->code, ev->value);
+		} else if (ev->code < BTN_MISC || ev->code >= KEY_OK) {
+			replay_key(replay, time, ev->code, ev->value);
+		}
+		break;
+	}
+}
+
+/* Let go of anything the trace left pressed so the next pass starts clean */
+static void
+replay_release_all(struct weston_input_replay *replay,
+		   const struct timespec *time)
+{
+	uint32_t *k;
+	int i;
+
+	wl_array_for_each(k, &replay->keys_down) {
+		notify_key(&replay->seat, time, *k,
+			   WL_KEYBOARD_KEY_STATE_RELEASED,
+			   STATE_UPDATE_AUTOMATIC);
+		replay->stats.events++;
+	}
+	replay->keys_down.size = 0;
+
+	for (i = 0; replay->buttons_down; i++) {
+		if (replay->buttons_down & (1u << i))
+			replay_button(replay, time, BTN_MOUSE + i, 0);
+	}
+
+	for (i = 0; i < REPLAY_MAX_SLOTS; i++) {
+		if (replay->slots[i].active) {
+			replay->slots[i].active = false;
+			replay->slots[i].up = true;
+		}
+	}
+	if (replay->has_touch)
+		replay_flush_touch(replay, time);
+
+	replay->dx = replay->dy = 0;
+	replay->wheel = replay->hwheel = 0;
+	replay->abs_moved = false;
+}
+
+/*
+ * Playback
+ */
+
+static void
+replay_finish(struct weston_input_replay *replay)
+{
+	replay->running = false;
+	wl_event_source_timer_update(replay->timer, 0);
+
+	replay->stats.wall_usec = clock_usec(CLOCK_MONOTONIC) -
+		replay->start_usec;
+	replay->stats.cpu_usec = clock_usec(CLOCK_PROCESS_CPUTIME_ID) -
+		replay->start_cpu_usec;
+
+	if (replay->done)
+		replay->done(replay, replay->done_data);
+}
+
+static void
+replay_wake(struct weston_input_replay *replay)
+{
+	uint64_t one = 1;
+
+	if (write(replay->wake_fd, &one, sizeof one) != sizeof one)
+		weston_log("input-replay: failed to schedule replay: %m\n");
+}
+
+static void
+replay_run(struct weston_input_replay *replay)
+{
+	const struct replay_event *ev;
+	struct timespec time;
+	uint64_t now, due, duration;
+	int frames = 0;
+
+	while (replay->running) {
+		if (replay->next == replay->count) {
+			now = clock_usec(CLOCK_MONOTONIC);
+			timespec_from_usec(&time, now);
+			replay_release_all(replay, &time);
+
+			if (--replay->passes_left == 0) {
+				replay_finish(replay);
+				return;
+			}
+
+			duration = replay->events[replay->count - 1].usec;
+			replay->pass_offset_usec += duration;
+			replay->next = 0;
+		}
+
+		ev = &replay->events[replay->next];
+		now = clock_usec(CLOCK_MONOTONIC);
+
+		if (replay->speed > 0) {
+			due = replay->start_usec +
+				(replay->pass_offset_usec + ev->usec) /
+				replay->speed;
+			if (due > now) {
+				/* timers have millisecond resolution; round up */
+				wl_event_source_timer_update(replay->timer,
+					(due - now + 999) / 1000);
+				return;
+			}
+		} else {
+			due = now;
+		}
+
+		timespec_from_usec(&time, due);
+		if (replay->next == 0 || ev[-1].type == EV_SYN)
+			weston_input_latency_event_begin(replay->compositor,
+							 &time);
+		replay_process_event(replay, ev, &time);
+		replay->next++;
+
+		if (ev->type == EV_SYN && ev->code == SYN_REPORT &&
+		    ++frames == REPLAY_FRAMES_PER_DISPATCH) {
+			replay_wake(replay);
+			return;
+		}
+	}
+}
+
+static int
+replay_timer_handler(void *data)
+{
+	replay_run(data);
+
+	return 1;
+}
+
+static int
+replay_wake_handler(int fd, uint32_t mask, void *data)
+{
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) != sizeof count && errno != EAGAIN)
+		weston_log("input-replay: wake read failed: %m\n");
+
+	replay_run(data);
+
+	return 1;
+}
+
+/**
+ * Start replaying the loaded trace.
+ *
+ * speed scales the recorded timing (2.0 plays twice as fast); 0 replays as
+ * fast as the compositor takes the events, yielding to the main loop every
+ * few frames.  The trace is played passes times back to back, and done is
+ * called once the last pass has been delivered.
+ */
+WL_EXPORT int
+weston_input_replay_start(struct weston_input_replay *replay,
+			  double speed, int passes,
+			  weston_input_replay_done_func_t done, void *data)
+{
+	if (!replay->seat_initialized || replay->running ||
+	    speed < 0 || passes < 1)
+		return -1;
+
+	replay->speed = speed;
+	replay->passes_left = passes;
+	replay->done = done;
+	replay->done_data = data;
+	replay->next = 0;
+	replay->pass_offset_usec = 0;
+	memset(&replay->stats, 0, sizeof replay->stats);
+
+	replay->running = true;
+	replay->start_usec = clock_usec(CLOCK_MONOTONIC);
+	replay->start_cpu_usec = clock_usec(CLOCK_PROCESS_CPUTIME_ID);
+	replay_wake(replay);
+
+	return 0;
+}
+
+WL_EXPORT struct weston_seat *
+weston_input_replay_get_seat(struct weston_input_replay *replay)
+{
+	return replay->seat_initialized ? &replay->seat : NULL;
+}
+
+WL_EXPORT void
+weston_input_replay_get_stats(struct weston_input_replay *replay,
+			      struct weston_input_replay_stats *stats)
+{
+	*stats = replay->stats;
+}
+
+WL_EXPORT struct weston_input_replay *
+weston_input_replay_create(struct weston_compositor *compositor,
+			   const char *seat_name)
+{
+	struct weston_input_replay *replay;
+	struct wl_event_loop *loop;
+
+	replay = zalloc(sizeof *replay);
+	if (!replay)
+		return NULL;
+
+	replay->compositor = compositor;
+	replay->wake_fd = -1;
+	wl_array_init(&replay->keys_down);
+
+	replay->seat_name = strdup(seat_name);
+	if (!replay->seat_name)
+		goto err;
+
+	replay->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (replay->wake_fd < 0)
+		goto err;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	replay->wake_source = wl_event_loop_add_fd(loop, replay->wake_fd,
+						   WL_EVENT_READABLE,
+						   replay_wake_handler,
+						   replay);
+	replay->timer = wl_event_loop_add_timer(loop, replay_timer_handler,
+						replay);
+	if (!replay->wake_source || !replay->timer)
+		goto err;
+
+	return replay;
+
+err:
+	weston_input_replay_destroy(replay);
+	return NULL;
+}
+
+WL_EXPORT void
+weston_input_replay_destroy(struct weston_input_replay *replay)
+{
+	if (replay->timer)
+		wl_event_source_remove(replay->timer);
+	if (replay->wake_source)
+		wl_event_source_remove(replay->wake_source);
+	if (replay->wake_fd >= 0)
+		close(replay->wake_fd);
+
+	if (replay->seat_initialized)
+		weston_seat_release(&replay->seat);
+
+	wl_array_release(&replay->keys_down);
+	free(replay->events);
+	free(replay->seat_name);
+	free(replay);
+}
@@ -0,0 +1,82 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: input-replay.h
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Replays recorded evdev traces (evemu-record format) into a seat of its
+ *   own, standing in for a libinput device so the compositor input stack
+ *   can be exercised without hardware.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef WESTON_INPUT_REPLAY_H
+#define WESTON_INPUT_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "compositor.h"
+
+struct weston_input_replay;
+
+struct weston_input_replay_stats {
+	/* SYN_REPORT frames replayed */
+	uint32_t frames;
+	/* notify_*() calls made into the seat */
+	uint32_t events;
+	/* from weston_input_replay_start() to the end of the last pass */
+	uint64_t wall_usec;
+	/* CPU time of the whole compositor process over the same interval */
+	uint64_t cpu_usec;
+};
+
+typedef void (*weston_input_replay_done_func_t)(struct weston_input_replay *replay,
+						void *data);
+
+struct weston_input_replay *
+weston_input_replay_create(struct weston_compositor *compositor,
+			   const char *seat_name);
+
+void
+weston_input_replay_destroy(struct weston_input_replay *replay);
+
+int
+weston_input_replay_load(struct weston_input_replay *replay, FILE *fp);
+
+struct weston_seat *
+weston_input_replay_get_seat(struct weston_input_replay *replay);
+
+int
+weston_input_replay_start(struct weston_input_replay *replay,
+			  double speed, int passes,
+			  weston_input_replay_done_func_t done, void *data);
+
+void
+weston_input_replay_get_stats(struct weston_input_replay *replay,
+			      struct weston_input_replay_stats *stats);
+
+#endif /* WESTON_INPUT_REPLAY_H */
@@ -40,6 +40,7 @@
 #include "shared/os-compatibility.h"
 #include "shared/timespec-util.h"
 #include "compositor.h"
+#include "input-latency.h"
 #include "relative-pointer-unstable-v1-server-protocol.h"
 #include "pointer-constraints-unstable-v1-server-protocol.h"
 #include "input-timestamps-unstable-v1-server-protocol.h"
@@ -447,6 +448,11 @@ pointer_send_motion(struct weston_pointer *pointer,
 		return;
 
 	resource_list = &pointer->focus_client->pointer_resources;
+	if (!wl_list_empty(resource_list))
+		weston_input_latency_sent(pointer->seat->compositor,
+					  pointer->focus ?
+					  pointer->focus->surface : NULL);
+
 	msecs = timespec_to_msec(time);
 	wl_resource_for_each(resource, resource_list) {
 		send_timestamps_for_input_resource(resource,
@@ -535,6 +541,9 @@ weston_pointer_send_button(struct weston_pointer *pointer,
 	if (!weston_pointer_has_focus_resource(pointer))
 		return;
 
+	weston_input_latency_sent(pointer->seat->compositor,
+				  pointer->focus ? pointer->focus->surface : NULL);
+
 	resource_list = &pointer->focus_client->pointer_resources;
 	serial = wl_display_next_serial(display);
 	msecs = timespec_to_msec(time);
@@ -591,6 +600,9 @@ weston_pointer_send_axis(struct weston_pointer *pointer,
 	if (!weston_pointer_has_focus_resource(pointer))
 		return;
 
+	weston_input_latency_sent(pointer->seat->compositor,
+				  pointer->focus ? pointer->focus->surface : NULL);
+
 	resource_list = &pointer->focus_client->pointer_resources;
 	msecs = timespec_to_msec(time);
 	wl_resource_for_each(resource, resource_list) {
@@ -762,6 +774,9 @@ weston_touch_send_down(struct weston_touch *touch, const struct timespec *time,
 	resource_list = &touch->focus_resource_list;
 
 	if (!wl_list_empty(resource_list)) {
+		weston_input_latency_sent(touch->seat->compositor,
+					  touch->focus->surface);
+
 		serial = wl_display_next_serial(display);
 		msecs = timespec_to_msec(time);
 		wl_resource_for_each(resource, resource_list)
@@ -808,6 +823,9 @@ weston_touch_send_up(struct weston_touch *touch, const struct timespec *time,
 	if (!weston_touch_has_focus_resource(touch))
 		return;
 
+	weston_input_latency_sent(touch->seat->compositor,
+				  touch->focus->surface);
+
 	resource_list = &touch->focus_resource_list;
 	serial = wl_display_next_serial(display);
 	msecs = timespec_to_msec(time);
@@ -853,6 +871,9 @@ weston_touch_send_motion(struct weston_touch *touch,
 
 	weston_view_from_global_fixed(touch->focus, x, y, &sx, &sy);
 
+	weston_input_latency_sent(touch->seat->compositor,
+				  touch->focus->surface);
+
 	resource_list = &touch->focus_resource_list;
 	msecs = timespec_to_msec(time);
 	wl_resource_for_each(resource, resource_list) {
@@ -954,6 +975,9 @@ weston_keyboard_send_key(struct weston_keyboard *keyboard,
 	if (!weston_keyboard_has_focus_resource(keyboard))
 		return;
 
+	weston_input_latency_sent(keyboard->seat->compositor,
+				  keyboard->focus);
+
 	resource_list = &keyboard->focus_resource_list;
 	serial = wl_display_next_serial(display);
 	msecs = timespec_to_msec(time);
@@ -1249,10 +1273,9 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 	if (--xkb_info->ref_count > 0)
 		return;
 
+	wl_list_remove(&xkb_info->link);
 	xkb_keymap_unref(xkb_info->keymap);
 
-	if (xkb_info->keymap_area)
-		munmap(xkb_info->keymap_area, xkb_info->keymap_size);
 	if (xkb_info->keymap_fd >= 0)
 		close(xkb_info->keymap_fd);
 	free(xkb_info);
@@ -1291,10 +1314,14 @@ weston_keyboard_destroy(struct weston_keyboard *keyboard)
 	free(keyboard);
 }
 
+static void
+touch_resample_clear(struct weston_touch *touch);
+
 static void
 weston_touch_reset_state(struct weston_touch *touch)
 {
 	touch->num_tp = 0;
+	touch_resample_clear(touch);
 }
 
 WL_EXPORT struct weston_touch *
@@ -1339,6 +1366,8 @@ weston_touch_destroy(struct weston_touch *touch)
 	wl_list_remove(&touch->focus_view_listener.link);
 	wl_list_remove(&touch->focus_resource_listener.link);
 	wl_list_remove(&touch->timestamps_list);
+	if (touch->resample.timer)
+		wl_event_source_remove(touch->resample.timer);
 	free(touch);
 }
 
@@ -1768,7 +1797,9 @@ notify_motion(struct weston_seat *seat,
 	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
 
 	weston_compositor_wake(ec);
+	weston_input_latency_grab_begin(ec);
 	pointer->grab->interface->motion(pointer->grab, time, event);
+	weston_input_latency_grab_end(ec);
 }
 
 #ifdef ENABLE_XKBCOMMON
@@ -1825,7 +1856,9 @@ notify_motion_absolute(struct weston_seat *seat, const struct timespec *time,
 		.y = y,
 	};
 
+	weston_input_latency_grab_begin(ec);
 	pointer->grab->interface->motion(pointer->grab, time, &event);
+	weston_input_latency_grab_end(ec);
 }
 
 static unsigned int
@@ -1881,7 +1914,9 @@ notify_button(struct weston_seat *seat, const struct timespec *time,
 	weston_compositor_run_button_binding(compositor, pointer, time, button,
 					     state);
 
+	weston_input_latency_grab_begin(compositor);
 	pointer->grab->interface->button(pointer->grab, time, button, state);
+	weston_input_latency_grab_end(compositor);
 
 	if (pointer->button_count == 1)
 		pointer->grab_serial =
@@ -1901,7 +1936,9 @@ notify_axis(struct weston_seat *seat, const struct timespec *time,
 					       time, event))
 		return;
 
+	weston_input_latency_grab_begin(compositor);
 	pointer->grab->interface->axis(pointer->grab, time, event);
+	weston_input_latency_grab_end(compositor);
 }
 
 WL_EXPORT void
@@ -2093,7 +2130,8 @@ send_modifiers(struct wl_resource *resource, uint32_t serial, struct weston_keyb
 }
 
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap);
+weston_xkb_info_get(struct weston_compositor *ec, struct xkb_keymap *keymap,
+		    bool *shared);
 
 static void
 update_keymap(struct weston_seat *seat)
@@ -2105,7 +2143,8 @@ update_keymap(struct weston_seat *seat)
 	xkb_mod_mask_t latched_mods;
 	xkb_mod_mask_t locked_mods;
 
-	xkb_info = weston_xkb_info_create(keyboard->pending_keymap);
+	xkb_info = weston_xkb_info_get(seat->compositor,
+				       keyboard->pending_keymap, NULL);
 
 	xkb_keymap_unref(keyboard->pending_keymap);
 	keyboard->pending_keymap = NULL;
@@ -2209,7 +2248,9 @@ notify_key(struct weston_seat *seat, const struct timespec *time, uint32_t key,
 		grab = keyboard->grab;
 	}
 
+	weston_input_latency_grab_begin(compositor);
 	grab->interface->key(grab, time, key, state);
+	weston_input_latency_grab_end(compositor);
 
 	if (keyboard->pending_keymap &&
 	    keyboard->keys.size == 0)
@@ -2354,6 +2395,286 @@ weston_touch_set_focus(struct weston_touch *touch, struct weston_view *view)
 	touch->focus = view;
 }
 
+/*
+ * Touch motion resampling
+ *
+ * With resampling enabled, motion events are not forwarded as they arrive.
+ * The last two raw samples of every touch point are kept and, at the next
+ * repaint deadline of the output under the touch focus, one sample per
+ * point is delivered: interpolated when the target time lies between the
+ * raw samples, extrapolated (by at most the prediction horizon) when it lies
+ * past the newest one.  Downs, ups and cancels are never delayed; pending
+ * motion is flushed unmodified ahead of them so clients see events in order.
+ */
+
+static int
+touch_resample_msec_to_deadline(struct weston_touch *touch)
+{
+	struct weston_compositor *ec = touch->seat->compositor;
+	struct weston_output *output = NULL;
+	struct timespec now, deadline;
+	int64_t refresh_nsec, behind;
+	int64_t msec;
+
+	if (touch->focus)
+		output = touch->focus->output;
+	if (!output && !wl_list_empty(&ec->output_list))
+		output = container_of(ec->output_list.next,
+				      struct weston_output, link);
+	if (!output || !output->current_mode ||
+	    !output->current_mode->refresh)
+		return 1;
+
+	weston_compositor_read_presentation_clock(ec, &now);
+
+	if (output->repaint_status == REPAINT_SCHEDULED) {
+		deadline = output->next_repaint;
+	} else {
+		/* Idle output: project the last vblank onto the next frame */
+		refresh_nsec = millihz_to_nsec(output->current_mode->refresh);
+		timespec_add_msec(&deadline, &output->frame_time,
+				  -ec->repaint_msec);
+		behind = timespec_sub_to_nsec(&now, &deadline);
+		if (behind >= 0)
+			timespec_add_nsec(&deadline, &deadline,
+					  (behind / refresh_nsec + 1) *
+					  refresh_nsec);
+	}
+
+	msec = timespec_sub_to_msec(&deadline, &now);
+
+	/* A zero timeout would disarm the timer */
+	return msec < 1 ? 1 : msec;
+}
+
+static void
+touch_resample_arm(struct weston_touch *touch)
+{
+	struct weston_touch_resample *resample = &touch->resample;
+
+	if (resample->timer_armed)
+		return;
+
+	wl_event_source_timer_update(resample->timer,
+				     touch_resample_msec_to_deadline(touch));
+	resample->timer_armed = true;
+}
+
+static void
+touch_resample_clear(struct weston_touch *touch)
+{
+	struct weston_touch_resample *resample = &touch->resample;
+
+	memset(resample->points, 0, sizeof resample->points);
+	resample->needs_frame = false;
+
+	if (resample->timer_armed) {
+		wl_event_source_timer_update(resample->timer, 0);
+		resample->timer_armed = false;
+	}
+}
+
+static void
+touch_resample_store(struct weston_touch_resample_point *point,
+		     const struct timespec *time, wl_fixed_t x, wl_fixed_t y)
+{
+	if (point->samples > 0) {
+		point->time[0] = point->time[1];
+		point->x[0] = point->x[1];
+		point->y[0] = point->y[1];
+	}
+
+	point->time[1] = *time;
+	point->x[1] = x;
+	point->y[1] = y;
+
+	if (point->samples < 2)
+		point->samples++;
+}
+
+/* Computes the position of point at target.  Returns false when target is
+ * older than the newest raw sample, i.e. that sample still has to be
+ * delivered on a later frame. */
+static bool
+touch_resample_point(struct weston_touch_resample_point *point,
+		     const struct timespec *target, int32_t prediction_usec,
+		     struct timespec *time, wl_fixed_t *x, wl_fixed_t *y)
+{
+	int64_t span, offset;
+	double f;
+
+	*time = point->time[1];
+	*x = point->x[1];
+	*y = point->y[1];
+
+	if (point->samples < 2)
+		return true;
+
+	span = timespec_sub_to_nsec(&point->time[1], &point->time[0]);
+	if (span <= 0)
+		return true;
+
+	offset = timespec_sub_to_nsec(target, &point->time[1]);
+	if (offset > 0)
+		offset = MIN(offset, (int64_t) MAX(prediction_usec, 0) * 1000);
+	else if (offset < -span)
+		offset = -span;
+
+	if (offset == 0)
+		return true;
+
+	f = (double) offset / span;
+	*x = point->x[1] + (wl_fixed_t) ((point->x[1] - point->x[0]) * f);
+	*y = point->y[1] + (wl_fixed_t) ((point->y[1] - point->y[0]) * f);
+	timespec_add_nsec(time, &point->time[1], offset);
+
+	return offset > 0;
+}
+
+/* Delivers every pending touch point to the grab, either resampled for the
+ * current frame or as the newest raw sample. */
+static void
+touch_resample_flush(struct weston_touch *touch, bool resample_now)
+{
+	struct weston_touch_resample *resample = &touch->resample;
+	struct weston_compositor *ec = touch->seat->compositor;
+	struct weston_touch_grab *grab = touch->grab;
+	struct weston_touch_resample_point *point;
+	struct timespec target, time;
+	wl_fixed_t x, y;
+	bool rearm = false;
+	int i;
+
+	weston_compositor_read_presentation_clock(ec, &target);
+	timespec_add_nsec(&target, &target,
+			  (int64_t) resample->prediction_usec * 1000);
+
+	for (i = 0; i < WESTON_TOUCH_RESAMPLE_MAX_POINTS; i++) {
+		point = &resample->points[i];
+		if (!point->pending)
+			continue;
+
+		if (resample_now) {
+			point->pending =
+				!touch_resample_point(point, &target,
+						      resample->prediction_usec,
+						      &time, &x, &y);
+			rearm |= point->pending;
+		} else {
+			time = point->time[1];
+			x = point->x[1];
+			y = point->y[1];
+			point->pending = false;
+		}
+
+		weston_input_latency_grab_begin(ec);
+		grab->interface->motion(grab, &time, i, x, y);
+		weston_input_latency_grab_end(ec);
+		resample->needs_frame = true;
+	}
+
+	if (rearm)
+		touch_resample_arm(touch);
+}
+
+static int
+touch_resample_timer_handler(void *data)
+{
+	struct weston_touch *touch = data;
+	struct weston_touch_grab *grab = touch->grab;
+
+	touch->resample.timer_armed = false;
+	touch_resample_flush(touch, true);
+
+	if (touch->resample.needs_frame) {
+		touch->resample.needs_frame = false;
+		grab->interface->frame(grab);
+	}
+
+	return 0;
+}
+
+/* Buffers a motion event; returns false if it must be delivered now. */
+static bool
+touch_resample_motion(struct weston_touch *touch, const struct timespec *time,
+		      int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+	struct weston_touch_resample_point *point;
+
+	if (!touch->resample.enabled ||
+	    touch_id < 0 || touch_id >= WESTON_TOUCH_RESAMPLE_MAX_POINTS)
+		return false;
+
+	point = &touch->resample.points[touch_id];
+	touch_resample_store(point, time, x, y);
+	point->pending = true;
+	touch_resample_arm(touch);
+
+	return true;
+}
+
+/* Flushes pending motion ahead of a down or up and restarts the history of
+ * touch_id. */
+static void
+touch_resample_barrier(struct weston_touch *touch, const struct timespec *time,
+		       int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+	struct weston_touch_resample_point *point;
+
+	if (!touch->resample.enabled)
+		return;
+
+	touch_resample_flush(touch, false);
+
+	if (touch_id < 0 || touch_id >= WESTON_TOUCH_RESAMPLE_MAX_POINTS)
+		return;
+
+	point = &touch->resample.points[touch_id];
+	memset(point, 0, sizeof *point);
+	if (time)
+		touch_resample_store(point, time, x, y);
+}
+
+/** Enable or disable per-frame motion resampling on a touch device.
+ *
+ * \param touch The touch device.
+ * \param enabled Whether motion should be resampled.
+ * \param prediction_usec Prediction horizon in microseconds.  Samples are
+ * taken at the repaint deadline plus this horizon; a negative value
+ * resamples in the past and only ever interpolates, 0 delivers the newest
+ * position once per frame.
+ *
+ * Disabling delivers any pending motion immediately.
+ */
+WL_EXPORT void
+weston_touch_set_resampling(struct weston_touch *touch, bool enabled,
+			    int32_t prediction_usec)
+{
+	struct weston_touch_resample *resample = &touch->resample;
+	struct wl_event_loop *loop;
+
+	if (enabled && !resample->timer) {
+		loop = wl_display_get_event_loop(
+				touch->seat->compositor->wl_display);
+		resample->timer = wl_event_loop_add_timer(loop,
+					touch_resample_timer_handler, touch);
+		if (!resample->timer) {
+			weston_log("failed to create touch resampling timer\n");
+			return;
+		}
+	}
+
+	if (!enabled && resample->enabled) {
+		touch_resample_flush(touch, false);
+		if (resample->needs_frame)
+			touch->grab->interface->frame(touch->grab);
+		touch_resample_clear(touch);
+	}
+
+	resample->enabled = enabled;
+	resample->prediction_usec = prediction_usec;
+}
+
 /**
  * notify_touch - emulates button touches and notifies surfaces accordingly.
  *
@@ -2408,7 +2729,12 @@ notify_touch(struct weston_seat *seat, const struct timespec *time,
 						    time, touch_type);
 		}
 
+		touch_resample_barrier(touch, time, touch_id, x, y);
+
+		weston_input_latency_grab_begin(ec);
 		grab->interface->down(grab, time, touch_id, x, y);
+		weston_input_latency_grab_end(ec);
+		touch->resample.needs_frame = true;
 		if (touch->num_tp == 1) {
 			touch->grab_serial =
 				wl_display_get_serial(ec->wl_display);
@@ -2424,7 +2750,13 @@ notify_touch(struct weston_seat *seat, const struct timespec *time,
 		if (!ev)
 			break;
 
+		if (touch_resample_motion(touch, time, touch_id, x, y))
+			break;
+
+		weston_input_latency_grab_begin(ec);
 		grab->interface->motion(grab, time, touch_id, x, y);
+		weston_input_latency_grab_end(ec);
+		touch->resample.needs_frame = true;
 		break;
 	case WL_TOUCH_UP:
 		if (touch->num_tp == 0) {
@@ -2438,7 +2770,12 @@ notify_touch(struct weston_seat *seat, const struct timespec *time,
 		weston_compositor_idle_release(ec);
 		touch->num_tp--;
 
+		touch_resample_barrier(touch, NULL, touch_id, 0, 0);
+
+		weston_input_latency_grab_begin(ec);
 		grab->interface->up(grab, time, touch_id);
+		weston_input_latency_grab_end(ec);
+		touch->resample.needs_frame = true;
 		if (touch->num_tp == 0 && !ec->input_view)
 			weston_touch_set_focus(touch, NULL);
 		break;
@@ -2451,6 +2788,13 @@ notify_touch_frame(struct weston_seat *seat)
 	struct weston_touch *touch = weston_seat_get_touch(seat);
 	struct weston_touch_grab *grab = touch->grab;
 
+	/* Frames that only closed buffered motion are sent on resampling */
+	if (touch->resample.enabled) {
+		if (!touch->resample.needs_frame)
+			return;
+		touch->resample.needs_frame = false;
+	}
+
 	grab->interface->frame(grab);
 }
 
@@ -2460,6 +2804,7 @@ notify_touch_cancel(struct weston_seat *seat)
 	struct weston_touch *touch = weston_seat_get_touch(seat);
 	struct weston_touch_grab *grab = touch->grab;
 
+	touch_resample_clear(touch);
 	grab->interface->cancel(grab);
 }
 
@@ -2947,6 +3292,48 @@ bind_relative_pointer_manager(struct wl_client *client, void *data,
 }
 
 #ifdef ENABLE_XKBCOMMON
+/*
+ * Compiled keymaps, kept for the lifetime of the compositor. Compiling is by
+ * far the most expensive part of setting up a keyboard, and every seat,
+ * backend or RDP peer asking for the same layout gets the same result.
+ */
+struct keymap_cache_entry {
+	struct wl_list link; /* weston_compositor::xkb_keymap_cache */
+	struct xkb_rule_names names;
+	struct xkb_keymap *keymap;
+};
+
+/* xkbcommon treats NULL and empty names alike, so the cache does too */
+static const char *
+rule_name(const char *name)
+{
+	return name ? name : "";
+}
+
+static bool
+rule_names_equal(const struct xkb_rule_names *a,
+		 const struct xkb_rule_names *b)
+{
+	return strcmp(rule_name(a->rules), rule_name(b->rules)) == 0 &&
+	       strcmp(rule_name(a->model), rule_name(b->model)) == 0 &&
+	       strcmp(rule_name(a->layout), rule_name(b->layout)) == 0 &&
+	       strcmp(rule_name(a->variant), rule_name(b->variant)) == 0 &&
+	       strcmp(rule_name(a->options), rule_name(b->options)) == 0;
+}
+
+static void
+keymap_cache_entry_destroy(struct keymap_cache_entry *entry)
+{
+	wl_list_remove(&entry->link);
+	xkb_keymap_unref(entry->keymap);
+	free((char *) entry->names.rules);
+	free((char *) entry->names.model);
+	free((char *) entry->names.layout);
+	free((char *) entry->names.variant);
+	free((char *) entry->names.options);
+	free(entry);
+}
+
 WL_EXPORT int
 weston_compositor_set_xkb_rule_names(struct weston_compositor *ec,
 				     struct xkb_rule_names *names)
@@ -2977,6 +3364,8 @@ weston_compositor_set_xkb_rule_names(struct weston_compositor *ec,
 void
 weston_compositor_xkb_destroy(struct weston_compositor *ec)
 {
+	struct keymap_cache_entry *entry, *tmp;
+
 	/*
 	 * If we're operating in raw keyboard mode, we never initialized
 	 * libxkbcommon so there's no cleanup to do either.
@@ -2992,6 +3381,10 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 
 	if (ec->xkb_info)
 		weston_xkb_info_destroy(ec->xkb_info);
+
+	wl_list_for_each_safe(entry, tmp, &ec->xkb_keymap_cache, link)
+		keymap_cache_entry_destroy(entry);
+
 	xkb_context_unref(ec->xkb_context);
 }
 
@@ -3004,6 +3397,7 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 
 	xkb_info->keymap = xkb_keymap_ref(keymap);
 	xkb_info->ref_count = 1;
+	wl_list_init(&xkb_info->link);
 
 	char *keymap_str;
 
@@ -3039,28 +3433,17 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 	}
 	xkb_info->keymap_size = strlen(keymap_str) + 1;
 
-	xkb_info->keymap_fd = os_create_anonymous_file(xkb_info->keymap_size);
+	xkb_info->keymap_fd = os_create_sealed_file(keymap_str,
+						    xkb_info->keymap_size);
 	if (xkb_info->keymap_fd < 0) {
 		weston_log("creating a keymap file for %lu bytes failed: %m\n",
 			(unsigned long) xkb_info->keymap_size);
 		goto err_keymap_str;
 	}
-
-	xkb_info->keymap_area = mmap(NULL, xkb_info->keymap_size,
-				     PROT_READ | PROT_WRITE,
-				     MAP_SHARED, xkb_info->keymap_fd, 0);
-	if (xkb_info->keymap_area == MAP_FAILED) {
-		weston_log("failed to mmap() %lu bytes\n",
-			(unsigned long) xkb_info->keymap_size);
-		goto err_dev_zero;
-	}
-	strcpy(xkb_info->keymap_area, keymap_str);
 	free(keymap_str);
 
 	return xkb_info;
 
-err_dev_zero:
-	close(xkb_info->keymap_fd);
 err_keymap_str:
 	free(keymap_str);
 err_keymap:
@@ -3069,6 +3452,92 @@ err_keymap:
 	return NULL;
 }
 
+/* Returns a new reference to the xkb_info for keymap, creating it (and its
+ * keymap file) only if no keyboard is using that keymap yet. */
+static struct weston_xkb_info *
+weston_xkb_info_get(struct weston_compositor *ec, struct xkb_keymap *keymap,
+		    bool *shared)
+{
+	struct weston_xkb_info *xkb_info;
+
+	wl_list_for_each(xkb_info, &ec->xkb_info_list, link) {
+		if (xkb_info->keymap == keymap) {
+			xkb_info->ref_count++;
+			if (shared)
+				*shared = true;
+			return xkb_info;
+		}
+	}
+
+	xkb_info = weston_xkb_info_create(keymap);
+	if (xkb_info == NULL)
+		return NULL;
+
+	wl_list_insert(&ec->xkb_info_list, &xkb_info->link);
+	if (shared)
+		*shared = false;
+
+	return xkb_info;
+}
+
+/*
+ * Returns a new reference to the keymap compiled from names, or NULL if it
+ * does not compile. Keymaps are cached by name, so asking again for the same
+ * layout, from any seat, returns the same xkb_keymap and lets keyboards
+ * share their weston_xkb_info and keymap file.
+ */
+WL_EXPORT struct xkb_keymap *
+weston_compositor_get_keymap(struct weston_compositor *ec,
+			     const struct xkb_rule_names *names)
+{
+	struct keymap_cache_entry *entry;
+	struct xkb_keymap *keymap;
+	struct timespec start, end;
+
+	if (!ec->use_xkbcommon || ec->xkb_context == NULL)
+		return NULL;
+
+	wl_list_for_each(entry, &ec->xkb_keymap_cache, link) {
+		if (rule_names_equal(&entry->names, names))
+			return xkb_keymap_ref(entry->keymap);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	keymap = xkb_keymap_new_from_names(ec->xkb_context, names, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (keymap == NULL)
+		return NULL;
+
+	weston_log("compiled XKB keymap (rules %s, model %s, layout %s, "
+		   "variant %s, options %s) in %.3f ms\n",
+		   rule_name(names->rules), rule_name(names->model),
+		   rule_name(names->layout), rule_name(names->variant),
+		   rule_name(names->options),
+		   timespec_sub_to_nsec(&end, &start) / 1e6);
+
+	entry = zalloc(sizeof *entry);
+	if (entry == NULL)
+		return keymap;
+
+	entry->keymap = keymap;
+	entry->names.rules = strdup(rule_name(names->rules));
+	entry->names.model = strdup(rule_name(names->model));
+	entry->names.layout = strdup(rule_name(names->layout));
+	entry->names.variant = strdup(rule_name(names->variant));
+	entry->names.options = strdup(rule_name(names->options));
+	wl_list_insert(&ec->xkb_keymap_cache, &entry->link);
+
+	if (!entry->names.rules || !entry->names.model ||
+	    !entry->names.layout || !entry->names.variant ||
+	    !entry->names.options) {
+		xkb_keymap_ref(keymap);
+		keymap_cache_entry_destroy(entry);
+		return keymap;
+	}
+
+	return xkb_keymap_ref(keymap);
+}
+
 static int
 weston_compositor_build_global_keymap(struct weston_compositor *ec)
 {
@@ -3077,9 +3546,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 	if (ec->xkb_info != NULL)
 		return 0;
 
-	keymap = xkb_keymap_new_from_names(ec->xkb_context,
-					   &ec->xkb_names,
-					   0);
+	keymap = weston_compositor_get_keymap(ec, &ec->xkb_names);
 	if (keymap == NULL) {
 		weston_log("failed to compile global XKB keymap\n");
 		weston_log("  tried rules %s, model %s, layout %s, variant %s, "
@@ -3090,7 +3557,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 		return -1;
 	}
 
-	ec->xkb_info = weston_xkb_info_create(keymap);
+	ec->xkb_info = weston_xkb_info_get(ec, keymap, NULL);
 	xkb_keymap_unref(keymap);
 	if (ec->xkb_info == NULL)
 		return -1;
@@ -3109,6 +3576,13 @@ void
 weston_compositor_xkb_destroy(struct weston_compositor *ec)
 {
 }
+
+WL_EXPORT struct xkb_keymap *
+weston_compositor_get_keymap(struct weston_compositor *ec,
+			     const struct xkb_rule_names *names)
+{
+	return NULL;
+}
 #endif
 
 WL_EXPORT void
@@ -3135,6 +3609,11 @@ WL_EXPORT int
 weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 {
 	struct weston_keyboard *keyboard;
+#ifdef ENABLE_XKBCOMMON
+	struct weston_compositor *ec = seat->compositor;
+	struct timespec start, end;
+	bool shared;
+#endif
 
 	if (seat->keyboard_state) {
 		seat->keyboard_device_count += 1;
@@ -3150,15 +3629,19 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 	}
 
 #ifdef ENABLE_XKBCOMMON
-	if (seat->compositor->use_xkbcommon) {
+	if (ec->use_xkbcommon) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
 		if (keymap != NULL) {
-			keyboard->xkb_info = weston_xkb_info_create(keymap);
+			keyboard->xkb_info = weston_xkb_info_get(ec, keymap,
+								 &shared);
 			if (keyboard->xkb_info == NULL)
 				goto err;
 		} else {
-			if (weston_compositor_build_global_keymap(seat->compositor) < 0)
+			shared = ec->xkb_info != NULL;
+			if (weston_compositor_build_global_keymap(ec) < 0)
 				goto err;
-			keyboard->xkb_info = seat->compositor->xkb_info;
+			keyboard->xkb_info = ec->xkb_info;
 			keyboard->xkb_info->ref_count++;
 		}
 
@@ -3169,6 +3652,12 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 		}
 
 		keyboard->xkb_state.leds = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		weston_log("seat %s: keyboard set up in %.3f ms (%s keymap)\n",
+			   seat->seat_name,
+			   timespec_sub_to_nsec(&end, &start) / 1e6,
+			   shared ? "shared" : "new");
 	}
 #endif
 
@@ -3293,6 +3782,10 @@ weston_seat_init_touch(struct weston_seat *seat)
 	seat->touch_device_count = 1;
 	touch->seat = seat;
 
+	if (seat->compositor->touch_resample)
+		weston_touch_set_resampling(touch, true,
+				seat->compositor->touch_prediction_usec);
+
 	seat_send_updated_caps(seat);
 }
 
@@ -0,0 +1,439 @@
+/*
+ *-----------------------------------------------------------------------------
+ * Filename: ipug-batch-bench.c
+ *-----------------------------------------------------------------------------
+ * Copyright 2018 Intel Corporation
+ *
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *-----------------------------------------------------------------------------
+ * Description:
+ *   Compares the cost of per-event and batched delivery of input plugin
+ *   events by replaying a recorded event stream both ways.  The plugin
+ *   framework itself isn't involved: the batched replay only follows the
+ *   same flush policy as queue_input_event() in ias-plugin-framework.c, so
+ *   this measures the call overhead saved, not the framework's behaviour.
+ *
+ *   Usage: ipug-batch-bench [-n iterations] [stream-file]
+ *
+ *   Each line of the stream file is one event, grouped into the runs the
+ *   compositor reads in one pass by "sync" lines:
+ *
+ *     motion <usec> <dx> <dy>
+ *     button <usec> <button> <state>
+ *     key <usec> <key> <state>
+ *     down <usec> <id> <x> <y>
+ *     touch <usec> <id> <x> <y>
+ *     up <usec> <id>
+ *     frame
+ *     sync
+ *
+ *   Without a file, a ten finger touch stream with a key press every
+ *   hundred frames is generated.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+
+#include "ias-plugin-framework.h"
+#include "ias-input-batch.h"
+#include "shared/timespec-util.h"
+
+/* IPUG_NUM_EVENT_TYPES marks the end of a compositor dispatch */
+#define STREAM_SYNC IPUG_NUM_EVENT_TYPES
+
+struct stream_event {
+	int type;
+	union ipug_event event;
+	size_t size;
+	struct timespec time;
+};
+
+struct stream {
+	struct stream_event *events;
+	size_t count;
+	size_t alloc;
+	size_t syncs;
+};
+
+/* what the plugin under test does with each event; the checksum only keeps
+ * the work from being optimized away */
+struct consumer {
+	uint64_t calls;
+	uint64_t events;
+	int64_t checksum;
+};
+
+static struct consumer consumer;
+
+static void
+consume_event(struct ipug_event_info *info)
+{
+	union ipug_event *event = (union ipug_event *)info;
+
+	consumer.events++;
+	switch (info->event_type) {
+	case IPUG_POINTER_MOTION:
+		consumer.checksum += event->pointer_motion.x +
+				     event->pointer_motion.y +
+				     event->pointer_motion.time->tv_nsec;
+		break;
+	case IPUG_TOUCH_MOTION:
+		consumer.checksum += event->touch_motion.sx +
+				     event->touch_motion.sy +
+				     event->touch_motion.time->tv_nsec;
+		break;
+	case IPUG_TOUCH_DOWN:
+		consumer.checksum += event->touch_down.touch_id;
+		break;
+	case IPUG_KEYBOARD_KEY:
+		consumer.checksum += event->key_key.key;
+		break;
+	default:
+		consumer.checksum++;
+		break;
+	}
+}
+
+static void
+on_input(struct ipug_event_info *info)
+{
+	consumer.calls++;
+	consume_event(info);
+}
+
+static void
+on_input_batch(struct ipug_event_batch *batch)
+{
+	uint32_t i;
+
+	consumer.calls++;
+	for (i = 0; i < batch->count; i++)
+		consume_event(&batch->events[i].base);
+}
+
+/* called through pointers, as the framework calls into a dlopen()ed plugin */
+static void (*volatile plugin_on_input)(struct ipug_event_info *) = on_input;
+static void (*volatile plugin_on_input_batch)(struct ipug_event_batch *) =
+	on_input_batch;
+
+static struct stream_event *
+stream_add(struct stream *stream, int type, size_t size)
+{
+	struct stream_event *ev;
+	size_t alloc;
+
+	if (stream->count == stream->alloc) {
+		alloc = stream->alloc ? stream->alloc * 2 : 1024;
+		ev = realloc(stream->events, alloc * sizeof *ev);
+		if (!ev) {
+			fprintf(stderr, "out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		stream->events = ev;
+		stream->alloc = alloc;
+	}
+
+	ev = &stream->events[stream->count++];
+	memset(ev, 0, sizeof *ev);
+	ev->type = type;
+	ev->size = size;
+	if (type == STREAM_SYNC)
+		stream->syncs++;
+	else
+		ev->event.base.event_type = type;
+
+	return ev;
+}
+
+static int
+stream_parse_line(struct stream *stream, const char *line)
+{
+	struct stream_event *ev;
+	char name[16];
+	long long usec;
+	int a, b, c;
+
+	if (sscanf(line, "%15s", name) != 1 || name[0] == '#')
+		return 0;
+
+	if (strcmp(name, "sync") == 0) {
+		stream_add(stream, STREAM_SYNC, 0);
+		return 0;
+	}
+	if (strcmp(name, "frame") == 0) {
+		stream_add(stream, IPUG_TOUCH_FRAME,
+			   sizeof(struct ipug_event_info_touch_frame));
+		return 0;
+	}
+
+	if (sscanf(line, "%15s %lld %d %d %d", name, &usec, &a, &b, &c) < 3)
+		return -1;
+
+	if (strcmp(name, "motion") == 0) {
+		ev = stream_add(stream, IPUG_POINTER_MOTION,
+				sizeof(struct ipug_event_info_pointer_motion));
+		ev->event.pointer_motion.x = wl_fixed_from_int(a);
+		ev->event.pointer_motion.y = wl_fixed_from_int(b);
+		ev->event.pointer_motion.mask = WESTON_POINTER_MOTION_REL;
+	} else if (strcmp(name, "button") == 0) {
+		ev = stream_add(stream, IPUG_POINTER_BUTTON,
+				sizeof(struct ipug_event_info_pointer_button));
+		ev->event.pointer_button.button = a;
+		ev->event.pointer_button.state = b;
+	} else if (strcmp(name, "key") == 0) {
+		ev = stream_add(stream, IPUG_KEYBOARD_KEY,
+				sizeof(struct ipug_event_info_key_key));
+		ev->event.key_key.key = a;
+		ev->event.key_key.state = b;
+	} else if (strcmp(name, "down") == 0) {
+		ev = stream_add(stream, IPUG_TOUCH_DOWN,
+				sizeof(struct ipug_event_info_touch_down));
+		ev->event.touch_down.touch_id = a;
+		ev->event.touch_down.sx = wl_fixed_from_int(b);
+		ev->event.touch_down.sy = wl_fixed_from_int(c);
+	} else if (strcmp(name, "touch") == 0) {
+		ev = stream_add(stream, IPUG_TOUCH_MOTION,
+				sizeof(struct ipug_event_info_touch_motion));
+		ev->event.touch_motion.touch_id = a;
+		ev->event.touch_motion.sx = b;
+		ev->event.touch_motion.sy = c;
+	} else if (strcmp(name, "up") == 0) {
+		ev = stream_add(stream, IPUG_TOUCH_UP,
+				sizeof(struct ipug_event_info_touch_up));
+		ev->event.touch_up.touch_id = a;
+	} else {
+		return -1;
+	}
+
+	timespec_from_usec(&ev->time, usec);
+
+	return 0;
+}
+
+static int
+stream_load(struct stream *stream, const char *path)
+{
+	char line[256];
+	FILE *fp;
+	int lineno = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "cannot open %s: %m\n", path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof line, fp)) {
+		lineno++;
+		if (stream_parse_line(stream, line) < 0) {
+			fprintf(stderr, "%s:%d: cannot parse '%s'\n",
+				path, lineno, line);
+			fclose(fp);
+			return -1;
+		}
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+static void
+stream_generate(struct stream *stream)
+{
+	char line[64];
+	long long usec = 0;
+	int frame, id;
+
+	for (id = 0; id < 10; id++) {
+		snprintf(line, sizeof line, "down %lld %d %d %d",
+			 usec, id, 100 * id, 100);
+		stream_parse_line(stream, line);
+	}
+	stream_parse_line(stream, "frame");
+	stream_parse_line(stream, "sync");
+
+	for (frame = 1; frame <= 10000; frame++) {
+		usec = frame * 8000LL;
+		for (id = 0; id < 10; id++) {
+			snprintf(line, sizeof line, "touch %lld %d %d %d",
+				 usec, id, 100 * id + frame % 50, 100 + frame % 70);
+			stream_parse_line(stream, line);
+		}
+		stream_parse_line(stream, "frame");
+		if (frame % 100 == 0) {
+			snprintf(line, sizeof line, "key %lld %d 1", usec, KEY_A);
+			stream_parse_line(stream, line);
+			snprintf(line, sizeof line, "key %lld %d 0", usec, KEY_A);
+			stream_parse_line(stream, line);
+		}
+		/* a 125Hz touch screen read every other frame by a 60Hz loop */
+		if (frame % 2 == 0)
+			stream_parse_line(stream, "sync");
+	}
+
+	for (id = 0; id < 10; id++) {
+		snprintf(line, sizeof line, "up %lld %d", usec, id);
+		stream_parse_line(stream, line);
+	}
+	stream_parse_line(stream, "frame");
+	stream_parse_line(stream, "sync");
+}
+
+/*
+ * Each event is rebuilt on the stack with a time pointer into that stack
+ * frame, like the plugin framework's grab handlers do.  Keep the flush
+ * policy below in line with queue_input_event().
+ */
+static void
+replay_event(const struct stream_event *ev, struct ipug_event_batch *batch)
+{
+	union ipug_event event = ev->event;
+	struct timespec time = ev->time;
+	const struct timespec **time_field;
+
+	time_field = ipug_event_time(&event);
+	if (time_field)
+		*time_field = &time;
+
+	if (!batch) {
+		plugin_on_input(&event.base);
+		return;
+	}
+
+	if (ipug_event_batch_append(batch, &event.base, ev->size) < 0) {
+		plugin_on_input_batch(batch);
+		ipug_event_batch_reset(batch);
+		ipug_event_batch_append(batch, &event.base, ev->size);
+	}
+
+	switch (ev->type) {
+	case IPUG_TOUCH_MOTION:
+	case IPUG_TOUCH_FRAME:
+		break;
+	default:
+		plugin_on_input_batch(batch);
+		ipug_event_batch_reset(batch);
+		break;
+	}
+}
+
+static double
+replay(const struct stream *stream, int iterations,
+       struct ipug_event_batch *batch)
+{
+	struct timespec start, end;
+	const struct stream_event *ev;
+	int i;
+
+	memset(&consumer, 0, sizeof consumer);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < iterations; i++) {
+		for (ev = stream->events; ev < stream->events + stream->count; ev++) {
+			if (ev->type != STREAM_SYNC) {
+				replay_event(ev, batch);
+			} else if (batch && batch->count) {
+				plugin_on_input_batch(batch);
+				ipug_event_batch_reset(batch);
+			}
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return timespec_sub_to_nsec(&end, &start) /
+		((double)consumer.events ? (double)consumer.events : 1.0);
+}
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n iterations] [stream-file]\n", name);
+	exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct stream stream = { 0 };
+	struct ipug_event_batch *batch;
+	int iterations = 100;
+	double single_ns, batch_ns;
+	uint64_t single_calls;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			if (iterations <= 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc) {
+		if (stream_load(&stream, argv[optind]) < 0)
+			return EXIT_FAILURE;
+	} else {
+		stream_generate(&stream);
+	}
+
+	batch = calloc(1, sizeof *batch);
+	if (!batch) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	/* warm up caches and the branch predictor on both paths */
+	replay(&stream, 1, NULL);
+	replay(&stream, 1, batch);
+
+	single_ns = replay(&stream, iterations, NULL);
+	single_calls = consumer.calls;
+
+	batch_ns = replay(&stream, iterations, batch);
+
+	printf("%zu events in %zu dispatches, %d iterations\n",
+	       stream.count - stream.syncs, stream.syncs, iterations);
+	printf("per-event: %8.2f ns/event, %" PRIu64 " plugin calls\n",
+	       single_ns, single_calls);
+	printf("batched:   %8.2f ns/event, %" PRIu64 " plugin calls\n",
+	       batch_ns, consumer.calls);
+
+	free(batch);
+	free(stream.events);
+
+	return EXIT_SUCCESS;
+}
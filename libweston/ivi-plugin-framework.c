@@ -58,6 +58,13 @@
  */
 #define MAX_OUTPUTS 4
 
+/*
+ * Plugin API version this framework implements.  It delivers input one
+ * event at a time and doesn't recognize gestures, so plugins must not be
+ * told about on_input_batch (version 3) or on_gesture (version 4).
+ */
+#define IVI_PLUGIN_API_VERSION 2
+
 #define find_resource_for_client wl_resource_find_for_client
 
 static void (*ias_config_fptr)(struct weston_surface *es, int32_t sx, int32_t sy);
@@ -1198,7 +1205,8 @@ static void initialize_input_plugin(void)
 	}
 
 	/* Call the initialization function */
-	ret = input_plugin_init(&plugin->input_info, PLUGIN_API_VERSION);
+	ret = input_plugin_init(&plugin->input_info,
+			IVI_PLUGIN_API_VERSION);
 	if (ret) {
 		IAS_ERROR("Failed to initialize plugin '%s'", plugin->name);
 		free(plugin);
@@ -1322,7 +1330,8 @@ initialize_layout_plugin(struct ias_plugin *plugin)
 	}
 
 	/* Call the initialization function */
-	ret = plugin_init(&plugin->info, plugin->info.id, PLUGIN_API_VERSION);
+	ret = plugin_init(&plugin->info, plugin->info.id,
+			IVI_PLUGIN_API_VERSION);
 	if (ret) {
 		IAS_ERROR("Failed to initialize plugin '%s'", plugin->name);
 		wl_list_remove(&plugin->link);
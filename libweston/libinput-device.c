@@ -37,6 +37,7 @@
 #include <libinput.h>
 
 #include "compositor.h"
+#include "input-latency.h"
 #include "libinput-device.h"
 #include "shared/helpers.h"
 #include "shared/timespec-util.h"
@@ -77,6 +78,7 @@ handle_keyboard_key(struct libinput_device *libinput_device,
 
 	timespec_from_usec(&time,
 			   libinput_event_keyboard_get_time_usec(keyboard_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 
 	notify_key(device->seat, &time,
 		   libinput_event_keyboard_get_key(keyboard_event),
@@ -95,6 +97,7 @@ handle_pointer_motion(struct libinput_device *libinput_device,
 
 	timespec_from_usec(&time,
 			   libinput_event_pointer_get_time_usec(pointer_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 	dx_unaccel = libinput_event_pointer_get_dx_unaccelerated(pointer_event);
 	dy_unaccel = libinput_event_pointer_get_dy_unaccelerated(pointer_event);
 
@@ -130,6 +133,7 @@ handle_pointer_motion_absolute(
 
 	timespec_from_usec(&time,
 			   libinput_event_pointer_get_time_usec(pointer_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 	width = device->output->current_mode->width;
 	height = device->output->current_mode->height;
 
@@ -165,6 +169,7 @@ handle_pointer_button(struct libinput_device *libinput_device,
 
 	timespec_from_usec(&time,
 			   libinput_event_pointer_get_time_usec(pointer_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 
 	notify_button(device->seat, &time,
 		      libinput_event_pointer_get_button(pointer_event),
@@ -266,6 +271,7 @@ handle_pointer_axis(struct libinput_device *libinput_device,
 
 	timespec_from_usec(&time,
 			   libinput_event_pointer_get_time_usec(pointer_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 
 	if (has_vert) {
 		axis = LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL;
@@ -314,6 +320,7 @@ handle_touch_with_coords(struct libinput_device *libinput_device,
 
 	timespec_from_usec(&time,
 			   libinput_event_touch_get_time_usec(touch_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 	slot = libinput_event_touch_get_seat_slot(touch_event);
 
 	width = device->output->current_mode->width;
@@ -352,6 +359,7 @@ handle_touch_up(struct libinput_device *libinput_device,
 
 	timespec_from_usec(&time,
 			   libinput_event_touch_get_time_usec(touch_event));
+	weston_input_latency_event_begin(device->seat->compositor, &time);
 
 	notify_touch(device->seat, &time, slot, 0, 0, WL_TOUCH_UP);
 }
@@ -425,6 +433,8 @@ evdev_device_process_event(struct libinput_event *event)
 	if (need_frame)
 		notify_pointer_frame(device->seat);
 
+	weston_input_latency_event_end(device->seat->compositor);
+
 	return handled;
 }
 
@@ -26,16 +26,27 @@
  * SOFTWARE.
  *-----------------------------------------------------------------------------
  * Description:
- *   Weston module for reporting timing/tracing information.
+ *   Weston module for reporting timing/tracing information and input
+ *   latency histograms.
  *-----------------------------------------------------------------------------
  */
 
+#include <signal.h>
+#include <string.h>
+
 #include "compositor.h"
+#include "input-latency.h"
 #include "trace-reporter.h"
 #include "trace-reporter-server-protocol.h"
 
 TRACING_DECLARATIONS;
 
+struct trace_reporter_state {
+	struct weston_compositor *compositor;
+	struct wl_event_source *dump_signal;
+	struct wl_listener destroy_listener;
+};
+
 /*
  * clear_log()
  *
@@ -157,10 +168,59 @@ log_tracepoint(struct wl_client *client,
 }
 
 
+/*
+ * latency_report()
+ *
+ * Send the input latency histograms of every stage to the client, followed
+ * by a trace_end event.
+ */
+static void
+latency_report(struct wl_client *client,
+		struct wl_resource *r,
+		uint32_t clear)
+{
+	struct trace_reporter_state *reporter = wl_resource_get_user_data(r);
+	struct weston_input_latency *latency =
+		reporter->compositor->input_latency;
+	const struct weston_latency_histogram *h;
+	struct wl_array buckets;
+	uint32_t *data;
+	unsigned int i;
+
+	wl_array_init(&buckets);
+	data = wl_array_add(&buckets, sizeof h->buckets);
+	if (!data) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	for (i = 0; i < WESTON_INPUT_LATENCY_STAGE_COUNT; i++) {
+		h = &latency->stages[i];
+		memcpy(data, h->buckets, sizeof h->buckets);
+
+		trace_reporter_send_latency_histogram(r, i,
+				weston_input_latency_stage_name(i),
+				h->count,
+				h->count ? h->sum_usec / h->count : 0,
+				h->max_usec,
+				&buckets);
+	}
+
+	wl_array_release(&buckets);
+
+	trace_reporter_send_trace_end(r);
+
+	if (clear) {
+		weston_input_latency_reset(latency);
+	}
+}
+
+
 static const struct trace_reporter_interface trace_reporter_implementation = {
 	event_report,
 	stdout_report,
 	log_tracepoint,
+	latency_report,
 };
 
 
@@ -176,7 +236,8 @@ bind_trace_reporter(struct wl_client *client,
 		uint32_t id)
 {
 	struct wl_resource *resource;
-	resource = wl_resource_create(client, &trace_reporter_interface, 1, id);
+	resource = wl_resource_create(client, &trace_reporter_interface,
+			version, id);
 	if (resource) {
 		wl_resource_set_implementation(resource,
 				&trace_reporter_implementation, data, NULL);
@@ -184,6 +245,37 @@ bind_trace_reporter(struct wl_client *client,
 }
 
 
+/*
+ * handle_dump_signal()
+ *
+ * SIGUSR2 writes the input latency histograms to the compositor log, for
+ * targets where no client can be started to query them.
+ */
+static int
+handle_dump_signal(int signal_number, void *data)
+{
+	struct trace_reporter_state *reporter = data;
+
+	weston_input_latency_log(reporter->compositor->input_latency);
+
+	return 1;
+}
+
+
+static void
+handle_compositor_destroy(struct wl_listener *listener, void *data)
+{
+	struct trace_reporter_state *reporter =
+		container_of(listener, struct trace_reporter_state,
+				destroy_listener);
+
+	if (reporter->dump_signal) {
+		wl_event_source_remove(reporter->dump_signal);
+	}
+	free(reporter);
+}
+
+
 /*
  * module_init()
  *
@@ -194,17 +286,43 @@ int wet_module_init(struct weston_compositor *compositor,
 WL_EXPORT int wet_module_init(struct weston_compositor *compositor,
 			int *argc, char *argv[])
 {
+	struct trace_reporter_state *reporter;
+	struct wl_event_loop *loop;
+
 	TRACING_MODULE_INIT();
 
+	reporter = zalloc(sizeof *reporter);
+	if (!reporter) {
+		return -1;
+	}
+	reporter->compositor = compositor;
+
+	if (weston_input_latency_enable(compositor) < 0) {
+		weston_log("Failed to enable input latency tracking!\n");
+		free(reporter);
+		return -1;
+	}
+
 	/* Expose the tracing_manager interface to clients */
 	if (!wl_global_create(compositor->wl_display,
 				&trace_reporter_interface,
-				1,
-				compositor,
+				2,
+				reporter,
 				bind_trace_reporter)) {
 		weston_log("Failed to add global trace reporter object!\n");
+		free(reporter);
 		return -1;
 	}
 
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	reporter->dump_signal = wl_event_loop_add_signal(loop, SIGUSR2,
+			handle_dump_signal, reporter);
+	if (!reporter->dump_signal) {
+		weston_log("Failed to watch SIGUSR2, latency dumps disabled\n");
+	}
+
+	reporter->destroy_listener.notify = handle_compositor_destroy;
+	wl_signal_add(&compositor->destroy_signal, &reporter->destroy_listener);
+
 	return 0;
 }
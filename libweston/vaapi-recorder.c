@@ -43,251 +43,435 @@
 #include <va/va_drm.h>
 #include <va/va_drmcommon.h>
 #include <va/va_enc_h264.h>
+#include <va/va_enc_hevc.h>
 #include <va/va_vpp.h>
 
 #include "compositor.h"
 #include "vaapi-recorder.h"
-
-#define NAL_REF_IDC_NONE        0
-#define NAL_REF_IDC_LOW         1
-#define NAL_REF_IDC_MEDIUM      2
-#define NAL_REF_IDC_HIGH        3
-
-#define NAL_NON_IDR             1
-#define NAL_IDR                 5
-#define NAL_SPS                 7
-#define NAL_PPS                 8
-#define NAL_SEI                 6
+#include "shared/h264-bitstream.h"
+#include "shared/helpers.h"
 
 #define SLICE_TYPE_P            0
 #define SLICE_TYPE_B            1
 #define SLICE_TYPE_I            2
 
-#define ENTROPY_MODE_CAVLC      0
-#define ENTROPY_MODE_CABAC      1
+#define HEVC_SLICE_TYPE_B       0
+#define HEVC_SLICE_TYPE_P       1
+#define HEVC_SLICE_TYPE_I       2
 
-#define PROFILE_IDC_BASELINE    66
-#define PROFILE_IDC_MAIN        77
-#define PROFILE_IDC_HIGH        100
+#define HEVC_NAL_TRAIL_R        1
+#define HEVC_NAL_IDR_W_RADL     19
 
-struct vaapi_recorder {
-	int drm_fd, output_fd;
-	int width, height;
-	int frame_count;
+#define HEVC_CODING_TYPE_I      1
+#define HEVC_CODING_TYPE_P      2
 
-	int error;
-	int destroying;
-	pthread_t worker_thread;
-	pthread_mutex_t mutex;
-	pthread_cond_t input_cond;
+/* 32x32 coding tree blocks, split down to 8x8 coding blocks */
+#define HEVC_CTB_SIZE           32
+#define HEVC_MIN_CB_SIZE        8
 
-	struct {
-		int valid;
-		int prime_fd, stride;
-	} input;
+/* HEVC leaves the number of reference frames to the array sizes */
+#define HEVC_MAX_REFS           15
 
-	VADisplay va_dpy;
+/* Finished recordings' sessions kept for reuse; more are destroyed */
+#define MAX_IDLE_SESSIONS       2
+
+struct codec_info {
+	const char *name;
+	VAProfile va_profile;
+	int hevc;
+
+	/* H.264 only */
+	int profile_idc;
+	int constraint_set_flags;
+};
+
+static const struct codec_info codecs[] = {
+	[VAAPI_RECORDER_H264_BASELINE] = {
+		"h264-baseline", VAProfileH264ConstrainedBaseline, 0,
+		H264_PROFILE_IDC_BASELINE,
+		(1 << 0) | (1 << 1), /* Annex A.2.1 and A.2.2 */
+	},
+	[VAAPI_RECORDER_H264_MAIN] = {
+		"h264-main", VAProfileH264Main, 0,
+		H264_PROFILE_IDC_MAIN,
+		(1 << 1), /* Annex A.2.2 */
+	},
+	[VAAPI_RECORDER_H264_HIGH] = {
+		"h264-high", VAProfileH264High, 0,
+		H264_PROFILE_IDC_HIGH, 0,
+	},
+	[VAAPI_RECORDER_H265_MAIN] = {
+		"h265-main", VAProfileHEVCMain, 1, 0, 0,
+	},
+};
+
+/*
+ * Everything about encoding that depends only on the codec and the frame
+ * size, and so can be handed from one recording to the next.
+ */
+struct vaapi_session {
+	struct wl_list link;
+	enum vaapi_recorder_codec codec;
+	int width, height;
 
 	/* video post processing is used for colorspace conversion */
 	struct {
 		VAConfigID cfg;
 		VAContextID ctx;
 		VABufferID pipeline_buf;
-		VASurfaceID output;
 	} vpp;
 
 	struct {
 		VAConfigID cfg;
 		VAContextID ctx;
 		VASurfaceID reference_picture[3];
-
-		int intra_period;
 		int output_size;
-		int constraint_set_flag;
+	} encoder;
+};
+
+struct vaapi_recorder_pool {
+	int drm_fd;
+	VADisplay va_dpy;
+
+	/* vaapi_session::link, most recently used first */
+	struct wl_list idle_sessions;
+	int num_idle;
+};
 
+struct vaapi_recorder {
+	struct vaapi_recorder_pool *pool;
+	struct vaapi_session *session;
+	const struct codec_info *codec;
+	VADisplay va_dpy;
+
+	int output_fd;
+	int width, height;
+	int frame_count;
+	int intra_period;
+
+	int error;
+	int destroying;
+	pthread_t worker_thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t input_cond;
+
+	/* Frames waiting for the worker thread, as a ring of indices into
+	 * surfaces starting at head.  Each frame is converted into a surface
+	 * of its own when it is queued, since the compositor reuses the
+	 * scanout buffer as soon as it has flipped away from it.  There is
+	 * one more surface than the queue can hold, for the frame being
+	 * encoded.  When the queue is full the oldest frame is dropped, so
+	 * that the compositor never waits for the encoder. */
+	struct {
+		VASurfaceID surfaces[VAAPI_RECORDER_MAX_QUEUE_DEPTH + 1];
+		int frames[VAAPI_RECORDER_MAX_QUEUE_DEPTH];
+		int depth;
+		int head, count;
+		/* Surface the worker thread is encoding, or -1 */
+		int encoding;
+		uint32_t dropped;
+	} queue;
+
+	union {
 		struct {
 			VAEncSequenceParameterBufferH264 seq;
 			VAEncPictureParameterBufferH264 pic;
 			VAEncSliceParameterBufferH264 slice;
-		} param;
-	} encoder;
+		} h264;
+		struct {
+			VAEncSequenceParameterBufferHEVC seq;
+			VAEncPictureParameterBufferHEVC pic;
+			VAEncSliceParameterBufferHEVC slice;
+		} hevc;
+	} param;
 };
 
 static void *
 worker_thread_function(void *);
 
-/* bistream code used for writing the packed headers */
+static VAStatus
+session_create_config(struct vaapi_recorder_pool *pool,
+		      struct vaapi_session *s)
+{
+	const struct codec_info *codec = &codecs[s->codec];
+	VAEntrypoint *entrypoints;
+	VAEntrypoint entrypoint = 0;
+	VAConfigAttrib attrib[2];
+	VAStatus status;
+	int i, num_entrypoints = 0;
+
+	/* Prefer the full encoder; some parts only have the low power one */
+	entrypoints = calloc(vaMaxNumEntrypoints(pool->va_dpy),
+			     sizeof *entrypoints);
+	if (!entrypoints)
+		return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+	status = vaQueryConfigEntrypoints(pool->va_dpy, codec->va_profile,
+					  entrypoints, &num_entrypoints);
+	for (i = 0; status == VA_STATUS_SUCCESS && i < num_entrypoints; i++) {
+		if (entrypoints[i] == VAEntrypointEncSlice)
+			entrypoint = VAEntrypointEncSlice;
+		else if (entrypoints[i] == VAEntrypointEncSliceLP && !entrypoint)
+			entrypoint = VAEntrypointEncSliceLP;
+	}
+	free(entrypoints);
 
-#define BITSTREAM_ALLOCATE_STEPPING	 4096
+	if (!entrypoint) {
+		weston_log("vaapi: %s encoding is not supported\n",
+			   codec->name);
+		return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+	}
 
-struct bitstream {
-	unsigned int *buffer;
-	int bit_offset;
-	int max_size_in_dword;
-};
+	/* FIXME: should check if specified attributes are supported */
 
-static unsigned int
-va_swap32(unsigned int val)
-{
-	unsigned char *pval = (unsigned char *)&val;
+	attrib[0].type = VAConfigAttribRTFormat;
+	attrib[0].value = VA_RT_FORMAT_YUV420;
 
-	return ((pval[0] << 24) |
-		(pval[1] << 16) |
-		(pval[2] << 8)  |
-		(pval[3] << 0));
+	attrib[1].type = VAConfigAttribRateControl;
+	attrib[1].value = VA_RC_CQP;
+
+	status = vaCreateConfig(pool->va_dpy, codec->va_profile,
+				entrypoint, attrib, 2,
+				&s->encoder.cfg);
+	if (status != VA_STATUS_SUCCESS)
+		return status;
+
+	status = vaCreateContext(pool->va_dpy, s->encoder.cfg,
+				 s->width, s->height, VA_PROGRESSIVE, 0, 0,
+				 &s->encoder.ctx);
+	if (status != VA_STATUS_SUCCESS) {
+		vaDestroyConfig(pool->va_dpy, s->encoder.cfg);
+		return status;
+	}
+
+	return VA_STATUS_SUCCESS;
 }
 
 static void
-bitstream_start(struct bitstream *bs)
+session_destroy_config(struct vaapi_recorder_pool *pool,
+		       struct vaapi_session *s)
 {
-	bs->max_size_in_dword = BITSTREAM_ALLOCATE_STEPPING;
-	bs->buffer = calloc(bs->max_size_in_dword * sizeof(unsigned int), 1);
-	bs->bit_offset = 0;
+	vaDestroyContext(pool->va_dpy, s->encoder.ctx);
+	vaDestroyConfig(pool->va_dpy, s->encoder.cfg);
 }
 
-static void
-bitstream_end(struct bitstream *bs)
+static int
+session_setup_vpp(struct vaapi_recorder_pool *pool, struct vaapi_session *s)
 {
-	int pos = (bs->bit_offset >> 5);
-	int bit_offset = (bs->bit_offset & 0x1f);
-	int bit_left = 32 - bit_offset;
+	VAStatus status;
 
-	if (bit_offset) {
-		bs->buffer[pos] = va_swap32((bs->buffer[pos] << bit_left));
+	status = vaCreateConfig(pool->va_dpy, VAProfileNone,
+				VAEntrypointVideoProc, NULL, 0,
+				&s->vpp.cfg);
+	if (status != VA_STATUS_SUCCESS) {
+		weston_log("vaapi: failed to create VPP config\n");
+		return -1;
+	}
+
+	status = vaCreateContext(pool->va_dpy, s->vpp.cfg,
+				 s->width, s->height, 0, NULL, 0, &s->vpp.ctx);
+	if (status != VA_STATUS_SUCCESS) {
+		weston_log("vaapi: failed to create VPP context\n");
+		goto err_cfg;
+	}
+
+	status = vaCreateBuffer(pool->va_dpy, s->vpp.ctx,
+				VAProcPipelineParameterBufferType,
+				sizeof(VAProcPipelineParameterBuffer),
+				1, NULL, &s->vpp.pipeline_buf);
+	if (status != VA_STATUS_SUCCESS) {
+		weston_log("vaapi: failed to create VPP pipeline buffer\n");
+		goto err_ctx;
 	}
+
+	return 0;
+
+err_ctx:
+	vaDestroyContext(pool->va_dpy, s->vpp.ctx);
+err_cfg:
+	vaDestroyConfig(pool->va_dpy, s->vpp.cfg);
+
+	return -1;
 }
 
 static void
-bitstream_put_ui(struct bitstream *bs, unsigned int val, int size_in_bits)
+session_destroy_vpp(struct vaapi_recorder_pool *pool, struct vaapi_session *s)
 {
-	int pos = (bs->bit_offset >> 5);
-	int bit_offset = (bs->bit_offset & 0x1f);
-	int bit_left = 32 - bit_offset;
-	unsigned int *temp_buffer;
+	vaDestroyBuffer(pool->va_dpy, s->vpp.pipeline_buf);
+	vaDestroyContext(pool->va_dpy, s->vpp.ctx);
+	vaDestroyConfig(pool->va_dpy, s->vpp.cfg);
+}
 
-	if (!size_in_bits)
-		return;
+static struct vaapi_session *
+session_create(struct vaapi_recorder_pool *pool,
+	       enum vaapi_recorder_codec codec, int width, int height)
+{
+	struct vaapi_session *s;
+	VAStatus status;
 
-	bs->bit_offset += size_in_bits;
+	s = zalloc(sizeof *s);
+	if (s == NULL)
+		return NULL;
 
-	if (bit_left > size_in_bits) {
-		bs->buffer[pos] = (bs->buffer[pos] << size_in_bits | val);
-		return;
-	}
+	s->codec = codec;
+	s->width = width;
+	s->height = height;
 
-	size_in_bits -= bit_left;
-	bs->buffer[pos] =
-		(bs->buffer[pos] << bit_left) | (val >> size_in_bits);
-	bs->buffer[pos] = va_swap32(bs->buffer[pos]);
-
-	if (pos + 1 == bs->max_size_in_dword) {
-		bs->max_size_in_dword += BITSTREAM_ALLOCATE_STEPPING;
-		/* Assign realloc pointer to a temp_buffer as if realloc fails, then
-		 * we should free the original bs->buffer, or else it will be
-		 * lost */
-		temp_buffer =
-			realloc(bs->buffer,
-				bs->max_size_in_dword * sizeof(unsigned int));
-		if (!temp_buffer) {
-			free(bs->buffer);
-			return;
-		} else {
-			bs->buffer = temp_buffer;
-		}
+	if (session_setup_vpp(pool, s) < 0) {
+		weston_log("vaapi: failed to initialize VPP pipeline\n");
+		goto err_free;
 	}
 
-	bs->buffer[pos + 1] = val;
+	status = session_create_config(pool, s);
+	if (status != VA_STATUS_SUCCESS)
+		goto err_vpp;
+
+	status = vaCreateSurfaces(pool->va_dpy, VA_RT_FORMAT_YUV420,
+				  width, height,
+				  s->encoder.reference_picture, 3,
+				  NULL, 0);
+	if (status != VA_STATUS_SUCCESS)
+		goto err_config;
+
+	s->encoder.output_size = width * height;
+
+	return s;
+
+err_config:
+	session_destroy_config(pool, s);
+err_vpp:
+	session_destroy_vpp(pool, s);
+err_free:
+	free(s);
+
+	return NULL;
 }
 
 static void
-bitstream_put_ue(struct bitstream *bs, unsigned int val)
+session_destroy(struct vaapi_recorder_pool *pool, struct vaapi_session *s)
 {
-	int size_in_bits = 0;
-	int tmp_val = ++val;
+	vaDestroySurfaces(pool->va_dpy, s->encoder.reference_picture, 3);
+	session_destroy_config(pool, s);
+	session_destroy_vpp(pool, s);
 
-	while (tmp_val) {
-		tmp_val >>= 1;
-		size_in_bits++;
+	free(s);
+}
+
+static struct vaapi_session *
+pool_get_session(struct vaapi_recorder_pool *pool,
+		 enum vaapi_recorder_codec codec, int width, int height)
+{
+	struct vaapi_session *s;
+
+	wl_list_for_each(s, &pool->idle_sessions, link) {
+		if (s->codec == codec &&
+		    s->width == width && s->height == height) {
+			wl_list_remove(&s->link);
+			pool->num_idle--;
+			return s;
+		}
 	}
 
-	bitstream_put_ui(bs, 0, size_in_bits - 1); /* leading zero */
-	bitstream_put_ui(bs, val, size_in_bits);
+	return session_create(pool, codec, width, height);
 }
 
 static void
-bitstream_put_se(struct bitstream *bs, int val)
+pool_put_session(struct vaapi_recorder_pool *pool, struct vaapi_session *s)
 {
-	unsigned int new_val;
-
-	if (val <= 0)
-		new_val = -2 * val;
-	else
-		new_val = 2 * val - 1;
+	struct vaapi_session *oldest;
+
+	if (pool->num_idle == MAX_IDLE_SESSIONS) {
+		oldest = container_of(pool->idle_sessions.prev,
+				      struct vaapi_session, link);
+		wl_list_remove(&oldest->link);
+		session_destroy(pool, oldest);
+		pool->num_idle--;
+	}
 
-	bitstream_put_ue(bs, new_val);
+	wl_list_insert(&pool->idle_sessions, &s->link);
+	pool->num_idle++;
 }
 
-static void
-bitstream_byte_aligning(struct bitstream *bs, int bit)
+struct vaapi_recorder_pool *
+vaapi_recorder_pool_create(int drm_fd)
 {
-	int bit_offset = (bs->bit_offset & 0x7);
-	int bit_left = 8 - bit_offset;
-	int new_val;
+	struct vaapi_recorder_pool *pool;
+	VAStatus status;
+	int major, minor;
 
-	if (!bit_offset)
-		return;
+	pool = zalloc(sizeof *pool);
+	if (pool == NULL)
+		goto err_fd;
 
-	if (bit)
-		new_val = (1 << bit_left) - 1;
-	else
-		new_val = 0;
+	pool->drm_fd = drm_fd;
+	wl_list_init(&pool->idle_sessions);
 
-	bitstream_put_ui(bs, new_val, bit_left);
+	pool->va_dpy = vaGetDisplayDRM(drm_fd);
+	if (!pool->va_dpy) {
+		weston_log("failed to create VA display\n");
+		goto err_free;
+	}
+
+	status = vaInitialize(pool->va_dpy, &major, &minor);
+	if (status != VA_STATUS_SUCCESS) {
+		weston_log("vaapi: failed to initialize display\n");
+		goto err_free;
+	}
+
+	return pool;
+
+err_free:
+	free(pool);
+err_fd:
+	close(drm_fd);
+
+	return NULL;
 }
 
-static VAStatus
-encoder_create_config(struct vaapi_recorder *r)
+void
+vaapi_recorder_pool_destroy(struct vaapi_recorder_pool *pool)
 {
-	VAConfigAttrib attrib[2];
-	VAStatus status;
+	struct vaapi_session *s, *tmp;
 
-	/* FIXME: should check if VAEntrypointEncSlice is supported */
+	wl_list_for_each_safe(s, tmp, &pool->idle_sessions, link)
+		session_destroy(pool, s);
 
-	/* FIXME: should check if specified attributes are supported */
+	vaTerminate(pool->va_dpy);
+	close(pool->drm_fd);
 
-	attrib[0].type = VAConfigAttribRTFormat;
-	attrib[0].value = VA_RT_FORMAT_YUV420;
+	free(pool);
+}
 
-	attrib[1].type = VAConfigAttribRateControl;
-	attrib[1].value = VA_RC_CQP;
+int
+vaapi_recorder_codec_from_name(const char *name,
+			       enum vaapi_recorder_codec *codec)
+{
+	unsigned int i;
 
-	status = vaCreateConfig(r->va_dpy, VAProfileH264Main,
-				VAEntrypointEncSlice, attrib, 2,
-				&r->encoder.cfg);
-	if (status != VA_STATUS_SUCCESS)
-		return status;
+	if (strcmp(name, "h264") == 0) {
+		*codec = VAAPI_RECORDER_H264_MAIN;
+		return 0;
+	}
 
-	status = vaCreateContext(r->va_dpy, r->encoder.cfg,
-				 r->width, r->height, VA_PROGRESSIVE, 0, 0,
-				 &r->encoder.ctx);
-	if (status != VA_STATUS_SUCCESS) {
-		vaDestroyConfig(r->va_dpy, r->encoder.cfg);
-		return status;
+	if (strcmp(name, "h265") == 0) {
+		*codec = VAAPI_RECORDER_H265_MAIN;
+		return 0;
 	}
 
-	return VA_STATUS_SUCCESS;
-}
+	for (i = 0; i < ARRAY_LENGTH(codecs); i++) {
+		if (strcmp(name, codecs[i].name) == 0) {
+			*codec = i;
+			return 0;
+		}
+	}
 
-static void
-encoder_destroy_config(struct vaapi_recorder *r)
-{
-	vaDestroyContext(r->va_dpy, r->encoder.ctx);
-	vaDestroyConfig(r->va_dpy, r->encoder.cfg);
+	return -1;
 }
 
 static void
 encoder_init_seq_parameters(struct vaapi_recorder *r)
 {
+	VAEncSequenceParameterBufferH264 *seq = &r->param.h264.seq;
 	int width_in_mbs, height_in_mbs;
 	int frame_cropping_flag = 0;
 	int frame_crop_bottom_offset = 0;
@@ -295,26 +479,44 @@ encoder_init_seq_parameters(struct vaapi_recorder *r)
 	width_in_mbs = (r->width + 15) / 16;
 	height_in_mbs = (r->height + 15) / 16;
 
-	r->encoder.param.seq.level_idc = 41;
-	r->encoder.param.seq.intra_period = r->encoder.intra_period;
-	r->encoder.param.seq.max_num_ref_frames = 4;
-	r->encoder.param.seq.picture_width_in_mbs = width_in_mbs;
-	r->encoder.param.seq.picture_height_in_mbs = height_in_mbs;
-	r->encoder.param.seq.seq_fields.bits.frame_mbs_only_flag = 1;
+	seq->level_idc = 41;
+	seq->intra_period = r->intra_period;
+	seq->max_num_ref_frames = 4;
+	seq->picture_width_in_mbs = width_in_mbs;
+	seq->picture_height_in_mbs = height_in_mbs;
+	seq->seq_fields.bits.chroma_format_idc = 1;
+	seq->seq_fields.bits.frame_mbs_only_flag = 1;
 
 	/* Tc = num_units_in_tick / time_scale */
-	r->encoder.param.seq.time_scale = 1800;
-	r->encoder.param.seq.num_units_in_tick = 15;
+	seq->time_scale = 1800;
+	seq->num_units_in_tick = 15;
 
 	if (height_in_mbs * 16 - r->height > 0) {
 		frame_cropping_flag = 1;
 		frame_crop_bottom_offset = (height_in_mbs * 16 - r->height) / 2;
 	}
 
-	r->encoder.param.seq.frame_cropping_flag = frame_cropping_flag;
-	r->encoder.param.seq.frame_crop_bottom_offset = frame_crop_bottom_offset;
+	seq->frame_cropping_flag = frame_cropping_flag;
+	seq->frame_crop_bottom_offset = frame_crop_bottom_offset;
+
+	seq->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 = 2;
+}
+
+static void
+encoder_init_pic_parameters(struct vaapi_recorder *r)
+{
+	VAEncPictureParameterBufferH264 *pic = &r->param.h264.pic;
+
+	pic->pic_init_qp = 0;
+
+	/* CABAC, except for baseline which only has CAVLC */
+	pic->pic_fields.bits.entropy_coding_mode_flag =
+		r->codec->profile_idc != H264_PROFILE_IDC_BASELINE;
 
-	r->encoder.param.seq.seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 = 2;
+	pic->pic_fields.bits.deblocking_filter_control_present_flag = 1;
+
+	pic->pic_fields.bits.transform_8x8_mode_flag =
+		r->codec->profile_idc == H264_PROFILE_IDC_HIGH;
 }
 
 static VABufferID
@@ -323,10 +525,10 @@ encoder_update_seq_parameters(struct vaapi_recorder *r)
 	VABufferID seq_buf;
 	VAStatus status;
 
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
 				VAEncSequenceParameterBufferType,
-				sizeof(r->encoder.param.seq),
-				1, &r->encoder.param.seq,
+				sizeof(r->param.h264.seq),
+				1, &r->param.h264.seq,
 				&seq_buf);
 
 	if (status == VA_STATUS_SUCCESS)
@@ -335,35 +537,23 @@ encoder_update_seq_parameters(struct vaapi_recorder *r)
 		return VA_INVALID_ID;
 }
 
-static void
-encoder_init_pic_parameters(struct vaapi_recorder *r)
-{
-	VAEncPictureParameterBufferH264 *pic = &r->encoder.param.pic;
-
-	pic->pic_init_qp = 0;
-
-	/* ENTROPY_MODE_CABAC */
-	pic->pic_fields.bits.entropy_coding_mode_flag = 1;
-
-	pic->pic_fields.bits.deblocking_filter_control_present_flag = 1;
-}
-
 static VABufferID
 encoder_update_pic_parameters(struct vaapi_recorder *r,
 			      VABufferID output_buf)
 {
-	VAEncPictureParameterBufferH264 *pic = &r->encoder.param.pic;
+	VAEncPictureParameterBufferH264 *pic = &r->param.h264.pic;
+	VASurfaceID *reference_picture = r->session->encoder.reference_picture;
 	VAStatus status;
 	VABufferID pic_param_buf;
 	VASurfaceID curr_pic, pic0;
 
-	curr_pic = r->encoder.reference_picture[r->frame_count % 2];
-	pic0 = r->encoder.reference_picture[(r->frame_count + 1) % 2];
+	curr_pic = reference_picture[r->frame_count % 2];
+	pic0 = reference_picture[(r->frame_count + 1) % 2];
 
 	pic->CurrPic.picture_id = curr_pic;
 	pic->CurrPic.TopFieldOrderCnt = r->frame_count * 2;
 	pic->ReferenceFrames[0].picture_id = pic0;
-	pic->ReferenceFrames[1].picture_id = r->encoder.reference_picture[2];
+	pic->ReferenceFrames[1].picture_id = reference_picture[2];
 	pic->ReferenceFrames[2].picture_id = VA_INVALID_ID;
 
 	pic->coded_buf = output_buf;
@@ -372,7 +562,7 @@ encoder_update_pic_parameters(struct vaapi_recorder *r,
 	pic->pic_fields.bits.idr_pic_flag = (r->frame_count == 0);
 	pic->pic_fields.bits.reference_pic_flag = 1;
 
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
 				VAEncPictureParameterBufferType,
 				sizeof(VAEncPictureParameterBufferH264), 1,
 				pic, &pic_param_buf);
@@ -384,26 +574,26 @@ encoder_update_pic_parameters(struct vaapi_recorder *r,
 }
 
 static VABufferID
-encoder_update_slice_parameter(struct vaapi_recorder *r, int slice_type)
+encoder_update_slice_parameter(struct vaapi_recorder *r, int intra)
 {
+	VAEncSliceParameterBufferH264 *slice = &r->param.h264.slice;
 	VABufferID slice_param_buf;
 	VAStatus status;
 
 	int width_in_mbs = (r->width + 15) / 16;
 	int height_in_mbs = (r->height + 15) / 16;
 
-	memset(&r->encoder.param.slice, 0, sizeof r->encoder.param.slice);
+	memset(slice, 0, sizeof *slice);
 
-	r->encoder.param.slice.num_macroblocks = width_in_mbs * height_in_mbs;
-	r->encoder.param.slice.slice_type = slice_type;
+	slice->num_macroblocks = width_in_mbs * height_in_mbs;
+	slice->slice_type = intra ? SLICE_TYPE_I : SLICE_TYPE_P;
 
-	r->encoder.param.slice.slice_alpha_c0_offset_div2 = 2;
-	r->encoder.param.slice.slice_beta_offset_div2 = 2;
+	slice->slice_alpha_c0_offset_div2 = 2;
+	slice->slice_beta_offset_div2 = 2;
 
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
 				VAEncSliceParameterBufferType,
-				sizeof(r->encoder.param.slice), 1,
-				&r->encoder.param.slice,
+				sizeof(*slice), 1, slice,
 				&slice_param_buf);
 
 	if (status == VA_STATUS_SUCCESS)
@@ -412,257 +602,258 @@ encoder_update_slice_parameter(struct vaapi_recorder *r, int slice_type)
 		return VA_INVALID_ID;
 }
 
-static VABufferID
-encoder_update_misc_hdr_parameter(struct vaapi_recorder *r)
-{
-	VAEncMiscParameterBuffer *misc_param;
-	VAEncMiscParameterHRD *hrd;
-	VABufferID buffer;
-	VAStatus status;
-
-	int total_size =
-		sizeof(VAEncMiscParameterBuffer) +
-		sizeof(VAEncMiscParameterRateControl);
-
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
-				VAEncMiscParameterBufferType, total_size,
-				1, NULL, &buffer);
-	if (status != VA_STATUS_SUCCESS)
-		return VA_INVALID_ID;
-
-	status = vaMapBuffer(r->va_dpy, buffer, (void **) &misc_param);
-	if (status != VA_STATUS_SUCCESS) {
-		vaDestroyBuffer(r->va_dpy, buffer);
-		return VA_INVALID_ID;
-	}
-
-	misc_param->type = VAEncMiscParameterTypeHRD;
-	hrd = (VAEncMiscParameterHRD *) misc_param->data;
-
-	hrd->initial_buffer_fullness = 0;
-	hrd->buffer_size = 0;
-
-	vaUnmapBuffer(r->va_dpy, buffer);
-
-	return buffer;
-}
-
-static int
-setup_encoder(struct vaapi_recorder *r)
-{
-	VAStatus status;
-
-	status = encoder_create_config(r);
-	if (status != VA_STATUS_SUCCESS) {
-		return -1;
-	}
-
-	status = vaCreateSurfaces(r->va_dpy, VA_RT_FORMAT_YUV420,
-				  r->width, r->height,
-				  r->encoder.reference_picture, 3,
-				  NULL, 0);
-	if (status != VA_STATUS_SUCCESS) {
-		encoder_destroy_config(r);
-		return -1;
-	}
-
-	/* VAProfileH264Main */
-	r->encoder.constraint_set_flag |= (1 << 1); /* Annex A.2.2 */
-
-	r->encoder.output_size = r->width * r->height;
-
-	r->encoder.intra_period = 30;
-
-	encoder_init_seq_parameters(r);
-	encoder_init_pic_parameters(r);
-
-	return 0;
-}
-
 static void
-encoder_destroy(struct vaapi_recorder *r)
+hevc_init_seq_parameters(struct vaapi_recorder *r)
 {
-	vaDestroySurfaces(r->va_dpy, r->encoder.reference_picture, 3);
-
-	encoder_destroy_config(r);
+	VAEncSequenceParameterBufferHEVC *seq = &r->param.hevc.seq;
+
+	/* Main profile, level 4.1 (times 30), main tier */
+	seq->general_profile_idc = 1;
+	seq->general_level_idc = 123;
+	seq->general_tier_flag = 0;
+
+	seq->intra_period = r->intra_period;
+	seq->intra_idr_period = 0;
+	seq->ip_period = 1;
+
+	/* The picture has to be a whole number of minimum coding blocks */
+	seq->pic_width_in_luma_samples =
+		(r->width + HEVC_MIN_CB_SIZE - 1) & ~(HEVC_MIN_CB_SIZE - 1);
+	seq->pic_height_in_luma_samples =
+		(r->height + HEVC_MIN_CB_SIZE - 1) & ~(HEVC_MIN_CB_SIZE - 1);
+
+	seq->seq_fields.bits.chroma_format_idc = 1;
+	seq->seq_fields.bits.amp_enabled_flag = 1;
+
+	seq->log2_min_luma_coding_block_size_minus3 = 0;
+	seq->log2_diff_max_min_luma_coding_block_size = 2;
+	seq->log2_min_transform_block_size_minus2 = 0;
+	seq->log2_diff_max_min_transform_block_size = 3;
+	seq->max_transform_hierarchy_depth_inter = 2;
+	seq->max_transform_hierarchy_depth_intra = 2;
+
+	/* One tick per frame, unlike H.264's two */
+	seq->vui_parameters_present_flag = 1;
+	seq->vui_fields.bits.vui_timing_info_present_flag = 1;
+	seq->vui_time_scale = 900;
+	seq->vui_num_units_in_tick = 15;
 }
 
 static void
-nal_start_code_prefix(struct bitstream *bs)
+hevc_init_pic_parameters(struct vaapi_recorder *r)
 {
-	bitstream_put_ui(bs, 0x00000001, 32);
+	VAEncPictureParameterBufferHEVC *pic = &r->param.hevc.pic;
+
+	pic->pic_init_qp = 0;
+	pic->pic_fields.bits.pps_loop_filter_across_slices_enabled_flag = 1;
 }
 
-static void
-nal_header(struct bitstream *bs, int nal_ref_idc, int nal_unit_type)
+static VABufferID
+hevc_update_seq_parameters(struct vaapi_recorder *r)
 {
-	/* forbidden_zero_bit: 0 */
-	bitstream_put_ui(bs, 0, 1);
+	VABufferID seq_buf;
+	VAStatus status;
 
-	bitstream_put_ui(bs, nal_ref_idc, 2);
-	bitstream_put_ui(bs, nal_unit_type, 5);
-}
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
+				VAEncSequenceParameterBufferType,
+				sizeof(r->param.hevc.seq),
+				1, &r->param.hevc.seq,
+				&seq_buf);
 
-static void
-rbsp_trailing_bits(struct bitstream *bs)
-{
-	bitstream_put_ui(bs, 1, 1);
-	bitstream_byte_aligning(bs, 0);
+	if (status == VA_STATUS_SUCCESS)
+		return seq_buf;
+	else
+		return VA_INVALID_ID;
 }
 
-static void sps_rbsp(struct bitstream *bs,
-		     VAEncSequenceParameterBufferH264 *seq,
-		     int constraint_set_flag)
+static VABufferID
+hevc_update_pic_parameters(struct vaapi_recorder *r, VABufferID output_buf,
+			   int intra)
 {
+	VAEncPictureParameterBufferHEVC *pic = &r->param.hevc.pic;
+	VASurfaceID *reference_picture = r->session->encoder.reference_picture;
+	VABufferID pic_param_buf;
+	VAStatus status;
 	int i;
 
-	bitstream_put_ui(bs, PROFILE_IDC_MAIN, 8);
+	pic->decoded_curr_pic.picture_id =
+		reference_picture[r->frame_count % 2];
+	pic->decoded_curr_pic.pic_order_cnt = r->frame_count;
+	pic->decoded_curr_pic.flags = 0;
 
-	/* constraint_set[0-3] flag */
-	for (i = 0; i < 4; i++) {
-		int set = (constraint_set_flag & (1 << i)) ? 1 : 0;
-		bitstream_put_ui(bs, set, 1);
+	for (i = 0; i < HEVC_MAX_REFS; i++) {
+		pic->reference_frames[i].picture_id = VA_INVALID_SURFACE;
+		pic->reference_frames[i].flags = VA_PICTURE_HEVC_INVALID;
 	}
 
-	/* reserved_zero_4bits */
-	bitstream_put_ui(bs, 0, 4);
-	bitstream_put_ui(bs, seq->level_idc, 8);
-	bitstream_put_ue(bs, seq->seq_parameter_set_id);
-
-	bitstream_put_ue(bs, seq->seq_fields.bits.log2_max_frame_num_minus4);
-	bitstream_put_ue(bs, seq->seq_fields.bits.pic_order_cnt_type);
-	bitstream_put_ue(bs,
-			 seq->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4);
-
-	bitstream_put_ue(bs, seq->max_num_ref_frames);
-
-	/* gaps_in_frame_num_value_allowed_flag */
-	bitstream_put_ui(bs, 0, 1);
+	if (!intra) {
+		pic->reference_frames[0].picture_id =
+			reference_picture[(r->frame_count + 1) % 2];
+		pic->reference_frames[0].pic_order_cnt = r->frame_count - 1;
+		pic->reference_frames[0].flags = 0;
+	}
 
-	/* pic_width_in_mbs_minus1, pic_height_in_map_units_minus1 */
-	bitstream_put_ue(bs, seq->picture_width_in_mbs - 1);
-	bitstream_put_ue(bs, seq->picture_height_in_mbs - 1);
+	pic->coded_buf = output_buf;
+	pic->collocated_ref_pic_index = intra ? 0xff : 0;
 
-	bitstream_put_ui(bs, seq->seq_fields.bits.frame_mbs_only_flag, 1);
-	bitstream_put_ui(bs, seq->seq_fields.bits.direct_8x8_inference_flag, 1);
+	pic->nal_unit_type =
+		r->frame_count == 0 ? HEVC_NAL_IDR_W_RADL : HEVC_NAL_TRAIL_R;
+	pic->pic_fields.bits.idr_pic_flag = (r->frame_count == 0);
+	pic->pic_fields.bits.coding_type =
+		intra ? HEVC_CODING_TYPE_I : HEVC_CODING_TYPE_P;
+	pic->pic_fields.bits.reference_pic_flag = 1;
 
-	bitstream_put_ui(bs, seq->frame_cropping_flag, 1);
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
+				VAEncPictureParameterBufferType,
+				sizeof(*pic), 1, pic, &pic_param_buf);
 
-	if (seq->frame_cropping_flag) {
-		bitstream_put_ue(bs, seq->frame_crop_left_offset);
-		bitstream_put_ue(bs, seq->frame_crop_right_offset);
-		bitstream_put_ue(bs, seq->frame_crop_top_offset);
-		bitstream_put_ue(bs, seq->frame_crop_bottom_offset);
-	}
+	if (status == VA_STATUS_SUCCESS)
+		return pic_param_buf;
+	else
+		return VA_INVALID_ID;
+}
 
-	/* vui_parameters_present_flag */
-	bitstream_put_ui(bs, 1, 1);
+static VABufferID
+hevc_update_slice_parameter(struct vaapi_recorder *r, int intra)
+{
+	VAEncSliceParameterBufferHEVC *slice = &r->param.hevc.slice;
+	VABufferID slice_param_buf;
+	VAStatus status;
+	int i;
 
-	/* aspect_ratio_info_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	/* overscan_info_present_flag */
-	bitstream_put_ui(bs, 0, 1);
+	int width_in_ctbs = (r->width + HEVC_CTB_SIZE - 1) / HEVC_CTB_SIZE;
+	int height_in_ctbs = (r->height + HEVC_CTB_SIZE - 1) / HEVC_CTB_SIZE;
 
-	/* video_signal_type_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	/* chroma_loc_info_present_flag */
-	bitstream_put_ui(bs, 0, 1);
+	memset(slice, 0, sizeof *slice);
 
-	/* timing_info_present_flag */
-	bitstream_put_ui(bs, 1, 1);
-	bitstream_put_ui(bs, seq->num_units_in_tick, 32);
-	bitstream_put_ui(bs, seq->time_scale, 32);
-	/* fixed_frame_rate_flag */
-	bitstream_put_ui(bs, 1, 1);
+	slice->num_ctu_in_slice = width_in_ctbs * height_in_ctbs;
+	slice->slice_type = intra ? HEVC_SLICE_TYPE_I : HEVC_SLICE_TYPE_P;
 
-	/* nal_hrd_parameters_present_flag */
-	bitstream_put_ui(bs, 0, 1);
+	for (i = 0; i < HEVC_MAX_REFS; i++) {
+		slice->ref_pic_list0[i].picture_id = VA_INVALID_SURFACE;
+		slice->ref_pic_list0[i].flags = VA_PICTURE_HEVC_INVALID;
+		slice->ref_pic_list1[i].picture_id = VA_INVALID_SURFACE;
+		slice->ref_pic_list1[i].flags = VA_PICTURE_HEVC_INVALID;
+	}
 
-	/* vcl_hrd_parameters_present_flag */
-	bitstream_put_ui(bs, 0, 1);
+	if (!intra)
+		slice->ref_pic_list0[0] = r->param.hevc.pic.reference_frames[0];
 
-	/* low_delay_hrd_flag */
-	bitstream_put_ui(bs, 0, 1);
+	slice->max_num_merge_cand = 5;
+	slice->slice_fields.bits.last_slice_of_pic_flag = 1;
+	slice->slice_fields.bits.slice_loop_filter_across_slices_enabled_flag = 1;
 
-	/* pic_struct_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	/* bitstream_restriction_flag */
-	bitstream_put_ui(bs, 0, 1);
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
+				VAEncSliceParameterBufferType,
+				sizeof(*slice), 1, slice,
+				&slice_param_buf);
 
-	rbsp_trailing_bits(bs);
+	if (status == VA_STATUS_SUCCESS)
+		return slice_param_buf;
+	else
+		return VA_INVALID_ID;
 }
 
-static void pps_rbsp(struct bitstream *bs,
-		     VAEncPictureParameterBufferH264 *pic)
+static VABufferID
+encoder_update_misc_hdr_parameter(struct vaapi_recorder *r)
 {
-	/* pic_parameter_set_id, seq_parameter_set_id */
-	bitstream_put_ue(bs, pic->pic_parameter_set_id);
-	bitstream_put_ue(bs, pic->seq_parameter_set_id);
-
-	bitstream_put_ui(bs, pic->pic_fields.bits.entropy_coding_mode_flag, 1);
-
-	/* pic_order_present_flag: 0 */
-	bitstream_put_ui(bs, 0, 1);
-
-	/* num_slice_groups_minus1 */
-	bitstream_put_ue(bs, 0);
-
-	bitstream_put_ue(bs, pic->num_ref_idx_l0_active_minus1);
-	bitstream_put_ue(bs, pic->num_ref_idx_l1_active_minus1);
+	VAEncMiscParameterBuffer *misc_param;
+	VAEncMiscParameterHRD *hrd;
+	VABufferID buffer;
+	VAStatus status;
 
-	bitstream_put_ui(bs, pic->pic_fields.bits.weighted_pred_flag, 1);
-	bitstream_put_ui(bs, pic->pic_fields.bits.weighted_bipred_idc, 2);
+	int total_size =
+		sizeof(VAEncMiscParameterBuffer) +
+		sizeof(VAEncMiscParameterRateControl);
 
-	/* pic_init_qp_minus26, pic_init_qs_minus26, chroma_qp_index_offset */
-	bitstream_put_se(bs, pic->pic_init_qp - 26);
-	bitstream_put_se(bs, 0);
-	bitstream_put_se(bs, 0);
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
+				VAEncMiscParameterBufferType, total_size,
+				1, NULL, &buffer);
+	if (status != VA_STATUS_SUCCESS)
+		return VA_INVALID_ID;
 
-	bitstream_put_ui(bs, pic->pic_fields.bits.deblocking_filter_control_present_flag, 1);
+	status = vaMapBuffer(r->va_dpy, buffer, (void **) &misc_param);
+	if (status != VA_STATUS_SUCCESS) {
+		vaDestroyBuffer(r->va_dpy, buffer);
+		return VA_INVALID_ID;
+	}
 
-	/* constrained_intra_pred_flag, redundant_pic_cnt_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	bitstream_put_ui(bs, 0, 1);
+	misc_param->type = VAEncMiscParameterTypeHRD;
+	hrd = (VAEncMiscParameterHRD *) misc_param->data;
 
-	bitstream_put_ui(bs, pic->pic_fields.bits.transform_8x8_mode_flag, 1);
+	hrd->initial_buffer_fullness = 0;
+	hrd->buffer_size = 0;
 
-	/* pic_scaling_matrix_present_flag */
-	bitstream_put_ui(bs, 0, 1);
-	bitstream_put_se(bs, pic->second_chroma_qp_index_offset );
+	vaUnmapBuffer(r->va_dpy, buffer);
 
-	rbsp_trailing_bits(bs);
+	return buffer;
 }
 
-static int
-build_packed_pic_buffer(struct vaapi_recorder *r,
-			void **header_buffer)
+static void
+encoder_init_parameters(struct vaapi_recorder *r)
 {
-	struct bitstream bs;
-
-	bitstream_start(&bs);
-	nal_start_code_prefix(&bs);
-	nal_header(&bs, NAL_REF_IDC_HIGH, NAL_PPS);
-	pps_rbsp(&bs, &r->encoder.param.pic);
-	bitstream_end(&bs);
-
-	*header_buffer = bs.buffer;
-	return bs.bit_offset;
+	memset(&r->param, 0, sizeof r->param);
+
+	if (r->codec->hevc) {
+		hevc_init_seq_parameters(r);
+		hevc_init_pic_parameters(r);
+	} else {
+		encoder_init_seq_parameters(r);
+		encoder_init_pic_parameters(r);
+	}
 }
 
-static int
-build_packed_seq_buffer(struct vaapi_recorder *r,
-			void **header_buffer)
+static void
+fill_h264_sps(struct vaapi_recorder *r, struct h264_sps *sps)
 {
-	struct bitstream bs;
-
-	bitstream_start(&bs);
-	nal_start_code_prefix(&bs);
-	nal_header(&bs, NAL_REF_IDC_HIGH, NAL_SPS);
-	sps_rbsp(&bs, &r->encoder.param.seq, r->encoder.constraint_set_flag);
-	bitstream_end(&bs);
+	VAEncSequenceParameterBufferH264 *seq = &r->param.h264.seq;
+
+	memset(sps, 0, sizeof *sps);
+	sps->profile_idc = r->codec->profile_idc;
+	sps->constraint_set_flags = r->codec->constraint_set_flags;
+	sps->level_idc = seq->level_idc;
+	sps->seq_parameter_set_id = seq->seq_parameter_set_id;
+	sps->log2_max_frame_num_minus4 =
+		seq->seq_fields.bits.log2_max_frame_num_minus4;
+	sps->pic_order_cnt_type = seq->seq_fields.bits.pic_order_cnt_type;
+	sps->log2_max_pic_order_cnt_lsb_minus4 =
+		seq->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4;
+	sps->max_num_ref_frames = seq->max_num_ref_frames;
+	sps->width_in_mbs = seq->picture_width_in_mbs;
+	sps->height_in_mbs = seq->picture_height_in_mbs;
+	sps->frame_mbs_only_flag = seq->seq_fields.bits.frame_mbs_only_flag;
+	sps->direct_8x8_inference_flag =
+		seq->seq_fields.bits.direct_8x8_inference_flag;
+	sps->frame_cropping_flag = seq->frame_cropping_flag;
+	sps->frame_crop_left_offset = seq->frame_crop_left_offset;
+	sps->frame_crop_right_offset = seq->frame_crop_right_offset;
+	sps->frame_crop_top_offset = seq->frame_crop_top_offset;
+	sps->frame_crop_bottom_offset = seq->frame_crop_bottom_offset;
+	sps->num_units_in_tick = seq->num_units_in_tick;
+	sps->time_scale = seq->time_scale;
+	sps->fixed_frame_rate_flag = 1;
+}
 
-	*header_buffer = bs.buffer;
-	return bs.bit_offset;
+static void
+fill_h264_pps(struct vaapi_recorder *r, struct h264_pps *pps)
+{
+	VAEncPictureParameterBufferH264 *pic = &r->param.h264.pic;
+
+	memset(pps, 0, sizeof *pps);
+	pps->pic_parameter_set_id = pic->pic_parameter_set_id;
+	pps->seq_parameter_set_id = pic->seq_parameter_set_id;
+	pps->entropy_coding_mode_flag =
+		pic->pic_fields.bits.entropy_coding_mode_flag;
+	pps->num_ref_idx_l0_active_minus1 = pic->num_ref_idx_l0_active_minus1;
+	pps->num_ref_idx_l1_active_minus1 = pic->num_ref_idx_l1_active_minus1;
+	pps->weighted_pred_flag = pic->pic_fields.bits.weighted_pred_flag;
+	pps->weighted_bipred_idc = pic->pic_fields.bits.weighted_bipred_idc;
+	pps->pic_init_qp = pic->pic_init_qp;
+	pps->deblocking_filter_control_present_flag =
+		pic->pic_fields.bits.deblocking_filter_control_present_flag;
+	pps->transform_8x8_mode_flag =
+		pic->pic_fields.bits.transform_8x8_mode_flag;
+	pps->second_chroma_qp_index_offset = pic->second_chroma_qp_index_offset;
 }
 
 static int
@@ -673,18 +864,21 @@ create_packed_header_buffers(struct vaapi_recorder *r, VABufferID *buffers,
 	VAEncPackedHeaderParameterBuffer packed_header;
 	VAStatus status;
 
+	if (bit_length < 0)
+		return 0;
+
 	packed_header.type = type;
 	packed_header.bit_length = bit_length;
-	packed_header.has_emulation_bytes = 0;
+	packed_header.has_emulation_bytes = 1;
 
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
 				VAEncPackedHeaderParameterBufferType,
 				sizeof packed_header, 1, &packed_header,
 				&buffers[0]);
 	if (status != VA_STATUS_SUCCESS)
 		return 0;
 
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
 				VAEncPackedHeaderDataBufferType,
 				(bit_length + 7) / 8, 1, data, &buffers[1]);
 	if (status != VA_STATUS_SUCCESS) {
@@ -695,25 +889,28 @@ create_packed_header_buffers(struct vaapi_recorder *r, VABufferID *buffers,
 	return 2;
 }
 
+/* H.264 only: the driver writes its own HEVC parameter sets */
 static int
 encoder_prepare_headers(struct vaapi_recorder *r, VABufferID *buffers)
 {
 	VABufferID *p;
+	struct h264_sps sps;
+	struct h264_pps pps;
 
 	int bit_length;
-	void *data;
+	uint8_t data[H264_MAX_HEADER_BYTES];
 
 	p = buffers;
 
-	bit_length = build_packed_seq_buffer(r, &data);
+	fill_h264_sps(r, &sps);
+	bit_length = h264_write_sps(&sps, data, sizeof data);
 	p += create_packed_header_buffers(r, p, VAEncPackedHeaderSequence,
 					  data, bit_length);
-	free(data);
 
-	bit_length = build_packed_pic_buffer(r, &data);
+	fill_h264_pps(r, &pps);
+	bit_length = h264_write_pps(&pps, data, sizeof data);
 	p += create_packed_header_buffers(r, p, VAEncPackedHeaderPicture,
 					  data, bit_length);
-	free(data);
 
 	return p - buffers;
 }
@@ -722,17 +919,18 @@ static VAStatus
 encoder_render_picture(struct vaapi_recorder *r, VASurfaceID input,
 		       VABufferID *buffers, int count)
 {
+	VAContextID ctx = r->session->encoder.ctx;
 	VAStatus status;
 
-	status = vaBeginPicture(r->va_dpy, r->encoder.ctx, input);
+	status = vaBeginPicture(r->va_dpy, ctx, input);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
-	status = vaRenderPicture(r->va_dpy, r->encoder.ctx, buffers, count);
+	status = vaRenderPicture(r->va_dpy, ctx, buffers, count);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
-	status = vaEndPicture(r->va_dpy, r->encoder.ctx);
+	status = vaEndPicture(r->va_dpy, ctx);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
@@ -745,8 +943,9 @@ encoder_create_output_buffer(struct vaapi_recorder *r)
 	VABufferID output_buf;
 	VAStatus status;
 
-	status = vaCreateBuffer(r->va_dpy, r->encoder.ctx,
-				VAEncCodedBufferType, r->encoder.output_size,
+	status = vaCreateBuffer(r->va_dpy, r->session->encoder.ctx,
+				VAEncCodedBufferType,
+				r->session->encoder.output_size,
 				1, NULL, &output_buf);
 	if (status == VA_STATUS_SUCCESS)
 		return output_buf;
@@ -772,7 +971,9 @@ encoder_write_output(struct vaapi_recorder *r, VABufferID output_buf)
 		return OUTPUT_WRITE_FATAL;
 
 	if (segment->status & VA_CODED_BUF_STATUS_SLICE_OVERFLOW_MASK) {
-		r->encoder.output_size *= 2;
+		/* Kept with the session, so later recordings start big
+		 * enough */
+		r->session->encoder.output_size *= 2;
 		vaUnmapBuffer(r->va_dpy, output_buf);
 		return OUTPUT_WRITE_OVERFLOW;
 	}
@@ -787,30 +988,35 @@ encoder_write_output(struct vaapi_recorder *r, VABufferID output_buf)
 	return OUTPUT_WRITE_SUCCESS;
 }
 
-static void
+/* Returns 0, or an errno value if the output couldn't be written. */
+static int
 encoder_encode(struct vaapi_recorder *r, VASurfaceID input)
 {
 	VABufferID output_buf = VA_INVALID_ID;
 
 	VABufferID buffers[8];
 	int count = 0;
-	int i, slice_type;
+	int i, intra;
+	int error = 0;
 	enum output_write_status ret;
 
-	if ((r->frame_count % r->encoder.intra_period) == 0)
-		slice_type = SLICE_TYPE_I;
-	else
-		slice_type = SLICE_TYPE_P;
+	intra = (r->frame_count % r->intra_period) == 0;
 
-	buffers[count++] = encoder_update_seq_parameters(r);
-	buffers[count++] = encoder_update_misc_hdr_parameter(r);
-	buffers[count++] = encoder_update_slice_parameter(r, slice_type);
+	if (r->codec->hevc) {
+		buffers[count++] = hevc_update_seq_parameters(r);
+		buffers[count++] = encoder_update_misc_hdr_parameter(r);
+		buffers[count++] = hevc_update_slice_parameter(r, intra);
+	} else {
+		buffers[count++] = encoder_update_seq_parameters(r);
+		buffers[count++] = encoder_update_misc_hdr_parameter(r);
+		buffers[count++] = encoder_update_slice_parameter(r, intra);
+	}
 
 	for (i = 0; i < count; i++)
 		if (buffers[i] == VA_INVALID_ID)
 			goto bail;
 
-	if (r->frame_count == 0)
+	if (r->frame_count == 0 && !r->codec->hevc)
 		count += encoder_prepare_headers(r, buffers + count);
 
 	do {
@@ -818,8 +1024,13 @@ encoder_encode(struct vaapi_recorder *r, VASurfaceID input)
 		if (output_buf == VA_INVALID_ID)
 			goto bail;
 
-		buffers[count++] =
-			encoder_update_pic_parameters(r, output_buf);
+		if (r->codec->hevc)
+			buffers[count++] =
+				hevc_update_pic_parameters(r, output_buf,
+							   intra);
+		else
+			buffers[count++] =
+				encoder_update_pic_parameters(r, output_buf);
 		if (buffers[count - 1] == VA_INVALID_ID)
 			goto bail;
 
@@ -833,78 +1044,22 @@ encoder_encode(struct vaapi_recorder *r, VASurfaceID input)
 	} while (ret == OUTPUT_WRITE_OVERFLOW);
 
 	if (ret == OUTPUT_WRITE_FATAL)
-		r->error = errno;
+		error = errno;
 
 	for (i = 0; i < count; i++)
 		vaDestroyBuffer(r->va_dpy, buffers[i]);
 
 	r->frame_count++;
-	return;
+	return error;
 
 bail:
 	for (i = 0; i < count; i++)
-		vaDestroyBuffer(r->va_dpy, buffers[i]);
+		if (buffers[i] != VA_INVALID_ID)
+			vaDestroyBuffer(r->va_dpy, buffers[i]);
 	if (output_buf != VA_INVALID_ID)
 		vaDestroyBuffer(r->va_dpy, output_buf);
-}
-
-
-static int
-setup_vpp(struct vaapi_recorder *r)
-{
-	VAStatus status;
-
-	status = vaCreateConfig(r->va_dpy, VAProfileNone,
-				VAEntrypointVideoProc, NULL, 0,
-				&r->vpp.cfg);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("vaapi: failed to create VPP config\n");
-		return -1;
-	}
-
-	status = vaCreateContext(r->va_dpy, r->vpp.cfg, r->width, r->height,
-				 0, NULL, 0, &r->vpp.ctx);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("vaapi: failed to create VPP context\n");
-		goto err_cfg;
-	}
-
-	status = vaCreateBuffer(r->va_dpy, r->vpp.ctx,
-				VAProcPipelineParameterBufferType,
-				sizeof(VAProcPipelineParameterBuffer),
-				1, NULL, &r->vpp.pipeline_buf);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("vaapi: failed to create VPP pipeline buffer\n");
-		goto err_ctx;
-	}
-
-	status = vaCreateSurfaces(r->va_dpy, VA_RT_FORMAT_YUV420,
-				  r->width, r->height, &r->vpp.output, 1,
-				  NULL, 0);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("vaapi: failed to create YUV surface\n");
-		goto err_buf;
-	}
 
 	return 0;
-
-err_buf:
-	vaDestroyBuffer(r->va_dpy, r->vpp.pipeline_buf);
-err_ctx:
-	vaDestroyConfig(r->va_dpy, r->vpp.ctx);
-err_cfg:
-	vaDestroyConfig(r->va_dpy, r->vpp.cfg);
-
-	return -1;
-}
-
-static void
-vpp_destroy(struct vaapi_recorder *r)
-{
-	vaDestroySurfaces(r->va_dpy, &r->vpp.output, 1);
-	vaDestroyBuffer(r->va_dpy, r->vpp.pipeline_buf);
-	vaDestroyConfig(r->va_dpy, r->vpp.ctx);
-	vaDestroyConfig(r->va_dpy, r->vpp.cfg);
 }
 
 static int
@@ -922,7 +1077,8 @@ destroy_worker_thread(struct vaapi_recorder *r)
 {
 	pthread_mutex_lock(&r->mutex);
 
-	/* Make sure the worker thread finishes */
+	/* Make sure the worker thread finishes, once it has encoded what
+	 * is still queued */
 	r->destroying = 1;
 	pthread_cond_signal(&r->input_cond);
 
@@ -935,59 +1091,59 @@ destroy_worker_thread(struct vaapi_recorder *r)
 }
 
 struct vaapi_recorder *
-vaapi_recorder_create(int drm_fd, int width, int height, const char *filename)
+vaapi_recorder_create(struct vaapi_recorder_pool *pool,
+		      int width, int height,
+		      enum vaapi_recorder_codec codec, int queue_depth,
+		      const char *filename)
 {
 	struct vaapi_recorder *r;
-	VAStatus status;
-	int major, minor;
 	int flags;
 
 	r = zalloc(sizeof *r);
 	if (r == NULL)
 		return NULL;
 
+	r->pool = pool;
+	r->va_dpy = pool->va_dpy;
+	r->codec = &codecs[codec];
 	r->width = width;
 	r->height = height;
-	r->drm_fd = drm_fd;
+	r->intra_period = 30;
 
-	setup_worker_thread(r);
+	if (queue_depth < 1)
+		queue_depth = 1;
+	if (queue_depth > VAAPI_RECORDER_MAX_QUEUE_DEPTH)
+		queue_depth = VAAPI_RECORDER_MAX_QUEUE_DEPTH;
+	r->queue.depth = queue_depth;
+	r->queue.encoding = -1;
 
 	flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
 	r->output_fd = open(filename, flags, 0644);
 	if (r->output_fd < 0)
-		goto err_thread;
+		goto err_free;
 
-	r->va_dpy = vaGetDisplayDRM(drm_fd);
-	if (!r->va_dpy) {
-		weston_log("failed to create VA display\n");
+	r->session = pool_get_session(pool, codec, width, height);
+	if (!r->session)
 		goto err_fd;
-	}
 
-	status = vaInitialize(r->va_dpy, &major, &minor);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("vaapi: failed to initialize display\n");
-		goto err_fd;
+	if (vaCreateSurfaces(r->va_dpy, VA_RT_FORMAT_YUV420, width, height,
+			     r->queue.surfaces, queue_depth + 1,
+			     NULL, 0) != VA_STATUS_SUCCESS) {
+		weston_log("vaapi: failed to create YUV surfaces\n");
+		goto err_session;
 	}
 
-	if (setup_vpp(r) < 0) {
-		weston_log("vaapi: failed to initialize VPP pipeline\n");
-		goto err_va_dpy;
-	}
+	encoder_init_parameters(r);
 
-	if (setup_encoder(r) < 0) {
-		goto err_vpp;
-	}
+	setup_worker_thread(r);
 
 	return r;
 
-err_vpp:
-	vpp_destroy(r);
-err_va_dpy:
-	vaTerminate(r->va_dpy);
+err_session:
+	pool_put_session(pool, r->session);
 err_fd:
 	close(r->output_fd);
-err_thread:
-	destroy_worker_thread(r);
+err_free:
 	free(r);
 
 	return NULL;
@@ -998,13 +1154,15 @@ vaapi_recorder_destroy(struct vaapi_recorder *r)
 {
 	destroy_worker_thread(r);
 
-	encoder_destroy(r);
-	vpp_destroy(r);
+	if (r->queue.dropped)
+		weston_log("[libva recorder] %u frames dropped "
+			   "with a queue of %d\n",
+			   r->queue.dropped, r->queue.depth);
 
-	vaTerminate(r->va_dpy);
+	vaDestroySurfaces(r->va_dpy, r->queue.surfaces, r->queue.depth + 1);
+	pool_put_session(r->pool, r->session);
 
 	close(r->output_fd);
-	close(r->drm_fd);
 
 	free(r);
 }
@@ -1049,12 +1207,14 @@ create_surface_from_fd(struct vaapi_recorder *r, int prime_fd,
 }
 
 static VAStatus
-convert_rgb_to_yuv(struct vaapi_recorder *r, VASurfaceID rgb_surface)
+convert_rgb_to_yuv(struct vaapi_recorder *r, VASurfaceID rgb_surface,
+		   VASurfaceID yuv_surface)
 {
+	struct vaapi_session *s = r->session;
 	VAProcPipelineParameterBuffer *pipeline_param;
 	VAStatus status;
 
-	status = vaMapBuffer(r->va_dpy, r->vpp.pipeline_buf,
+	status = vaMapBuffer(r->va_dpy, s->vpp.pipeline_buf,
 			     (void **) &pipeline_param);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
@@ -1067,72 +1227,57 @@ convert_rgb_to_yuv(struct vaapi_recorder *r, VASurfaceID rgb_surface)
 	pipeline_param->output_background_color = 0xff000000;
 	pipeline_param->output_color_standard   = VAProcColorStandardNone;
 
-	status = vaUnmapBuffer(r->va_dpy, r->vpp.pipeline_buf);
+	status = vaUnmapBuffer(r->va_dpy, s->vpp.pipeline_buf);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
-	status = vaBeginPicture(r->va_dpy, r->vpp.ctx, r->vpp.output);
+	status = vaBeginPicture(r->va_dpy, s->vpp.ctx, yuv_surface);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
-	status = vaRenderPicture(r->va_dpy, r->vpp.ctx,
-				 &r->vpp.pipeline_buf, 1);
+	status = vaRenderPicture(r->va_dpy, s->vpp.ctx,
+				 &s->vpp.pipeline_buf, 1);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
-	status = vaEndPicture(r->va_dpy, r->vpp.ctx);
+	status = vaEndPicture(r->va_dpy, s->vpp.ctx);
 	if (status != VA_STATUS_SUCCESS)
 		return status;
 
 	return status;
 }
 
-static void
-recorder_frame(struct vaapi_recorder *r)
-{
-	VASurfaceID rgb_surface;
-	VAStatus status;
-
-	status = create_surface_from_fd(r, r->input.prime_fd,
-					r->input.stride, &rgb_surface);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("[libva recorder] "
-			   "failed to create surface from bo\n");
-		return;
-	}
-
-	close(r->input.prime_fd);
-
-	status = convert_rgb_to_yuv(r, rgb_surface);
-	if (status != VA_STATUS_SUCCESS) {
-		weston_log("[libva recorder] "
-			   "color space conversion failed\n");
-		return;
-	}
-
-	encoder_encode(r, r->vpp.output);
-
-	vaDestroySurfaces(r->va_dpy, &rgb_surface, 1);
-}
-
 static void *
 worker_thread_function(void *data)
 {
 	struct vaapi_recorder *r = data;
+	VASurfaceID surface;
+	int error;
 
 	pthread_mutex_lock(&r->mutex);
 
-	while (!r->destroying) {
-		if (!r->input.valid)
+	for (;;) {
+		while (!r->queue.count && !r->destroying)
 			pthread_cond_wait(&r->input_cond, &r->mutex);
 
-		/* If the thread is awaken by destroy_worker_thread(),
-		 * there might not be valid input */
-		if (!r->input.valid)
-			continue;
+		/* Only stop once everything queued has been encoded */
+		if (!r->queue.count)
+			break;
+
+		r->queue.encoding = r->queue.frames[r->queue.head];
+		r->queue.head = (r->queue.head + 1) % r->queue.depth;
+		r->queue.count--;
+		surface = r->queue.surfaces[r->queue.encoding];
 
-		recorder_frame(r);
-		r->input.valid = 0;
+		/* The compositor can queue more frames while this one is
+		 * encoded */
+		pthread_mutex_unlock(&r->mutex);
+		error = encoder_encode(r, surface);
+		pthread_mutex_lock(&r->mutex);
+
+		r->queue.encoding = -1;
+		if (error && !r->error)
+			r->error = error;
 	}
 
 	pthread_mutex_unlock(&r->mutex);
@@ -1140,30 +1285,86 @@ worker_thread_function(void *data)
 	return NULL;
 }
 
+/* Called with the mutex held. */
+static int
+queue_find_free_surface(struct vaapi_recorder *r)
+{
+	int i, j, used;
+
+	for (i = 0; i <= r->queue.depth; i++) {
+		used = (i == r->queue.encoding);
+		for (j = 0; j < r->queue.count && !used; j++)
+			used = r->queue.frames[(r->queue.head + j) %
+					       r->queue.depth] == i;
+		if (!used)
+			return i;
+	}
+
+	/* Can't happen: there is a surface more than the queue holds */
+	assert(0);
+	return -1;
+}
+
+/*
+ * Converts the frame into a free queue surface right away, so that the
+ * buffer behind prime_fd can be reused as soon as this returns, and
+ * leaves the encoding to the worker thread.  Waiting for the conversion
+ * costs the compositor one VPP blit per frame, but never the encode.
+ */
 int
 vaapi_recorder_frame(struct vaapi_recorder *r, int prime_fd, int stride)
 {
-	int ret = 0;
+	VASurfaceID rgb_surface;
+	VAStatus status;
+	int slot;
 
 	pthread_mutex_lock(&r->mutex);
 
 	if (r->error) {
+		pthread_mutex_unlock(&r->mutex);
+		close(prime_fd);
 		errno = r->error;
-		ret = -1;
-		goto unlock;
+		return -1;
 	}
 
-	/* The mutex is never released while encoding, so this point should
-	 * never be reached if input.valid is true. */
-	assert(!r->input.valid);
+	if (r->queue.count == r->queue.depth) {
+		r->queue.head = (r->queue.head + 1) % r->queue.depth;
+		r->queue.count--;
+		r->queue.dropped++;
+	}
 
-	r->input.prime_fd = prime_fd;
-	r->input.stride = stride;
-	r->input.valid = 1;
-	pthread_cond_signal(&r->input_cond);
+	/* Only this thread queues, so the surface stays free while it is
+	 * written without the lock */
+	slot = queue_find_free_surface(r);
 
-unlock:
 	pthread_mutex_unlock(&r->mutex);
 
-	return ret;
+	status = create_surface_from_fd(r, prime_fd, stride, &rgb_surface);
+	close(prime_fd);
+	if (status != VA_STATUS_SUCCESS) {
+		weston_log("[libva recorder] "
+			   "failed to create surface from bo\n");
+		return 0;
+	}
+
+	status = convert_rgb_to_yuv(r, rgb_surface, r->queue.surfaces[slot]);
+	if (status == VA_STATUS_SUCCESS)
+		status = vaSyncSurface(r->va_dpy, r->queue.surfaces[slot]);
+
+	vaDestroySurfaces(r->va_dpy, &rgb_surface, 1);
+
+	if (status != VA_STATUS_SUCCESS) {
+		weston_log("[libva recorder] "
+			   "color space conversion failed\n");
+		return 0;
+	}
+
+	pthread_mutex_lock(&r->mutex);
+	r->queue.frames[(r->queue.head + r->queue.count) % r->queue.depth] =
+		slot;
+	r->queue.count++;
+	pthread_cond_signal(&r->input_cond);
+	pthread_mutex_unlock(&r->mutex);
+
+	return 0;
 }
@@ -26,12 +26,52 @@
 #ifndef _VAAPI_RECORDER_H_
 #define _VAAPI_RECORDER_H_
 
+/* Deepest queue of frames that can wait for the encoder */
+#define VAAPI_RECORDER_MAX_QUEUE_DEPTH 8
+
+enum vaapi_recorder_codec {
+	VAAPI_RECORDER_H264_BASELINE,
+	VAAPI_RECORDER_H264_MAIN,
+	VAAPI_RECORDER_H264_HIGH,
+	VAAPI_RECORDER_H265_MAIN,
+};
+
 struct vaapi_recorder;
 
+/*
+ * The VA display and the encode sessions of finished recordings, so that
+ * starting another recording of the same size and codec doesn't have to
+ * set them up again.  Takes ownership of drm_fd.
+ */
+struct vaapi_recorder_pool;
+
+struct vaapi_recorder_pool *
+vaapi_recorder_pool_create(int drm_fd);
+void
+vaapi_recorder_pool_destroy(struct vaapi_recorder_pool *pool);
+
+/*
+ * Parse "h264-baseline", "h264-main", "h264-high" or "h265-main"; "h264"
+ * and "h265" are the main profiles.  Returns 0, or -1 if name is none of
+ * those.
+ */
+int
+vaapi_recorder_codec_from_name(const char *name,
+			       enum vaapi_recorder_codec *codec);
+
 struct vaapi_recorder *
-vaapi_recorder_create(int drm_fd, int width, int height, const char *filename);
+vaapi_recorder_create(struct vaapi_recorder_pool *pool,
+		      int width, int height,
+		      enum vaapi_recorder_codec codec, int queue_depth,
+		      const char *filename);
 void
 vaapi_recorder_destroy(struct vaapi_recorder *r);
+/*
+ * Queue the frame in the buffer behind fd for encoding.  The frame is
+ * copied before this returns, so the buffer may be reused straight away;
+ * fd is always closed.  Returns -1 with errno set if the recording has
+ * failed.
+ */
 int
 vaapi_recorder_frame(struct vaapi_recorder *r, int fd, int stride);
 
@@ -726,70 +726,33 @@ static spug_pointer_grab_interface mouse_grab_interface = {
 	grid_grab_pointer_cancel
 };
 
+/*
+ * Touch input arrives as taps recognized by the plugin framework.
+ */
 static void
-grid_grab_touch_down(spug_touch_grab *grab,
-		const struct timespec *time,
-		int touch_id,
-		spug_fixed_t sx,
-		spug_fixed_t sy)
+grid_gesture(const struct ias_gesture_event *gesture)
 {
 	spug_output_id output;
-	int x = spug_fixed_to_int(grab->touch->grab_x);
-	int y = spug_fixed_to_int(grab->touch->grab_y);
+	int x = (int)gesture->x;
+	int y = (int)gesture->y;
+
+	if (gesture->type != IAS_GESTURE_TAP) {
+		return;
+	}
 
 	/*
 	 * Grid might be active on multiple outputs at once.  Figure out which
-	 * output the event button event happened on.
+	 * output the tap happened on.
 	 */
 	output = select_output(x, y);
 
-	/* Figure out which tile we clicked on, if any */
+	/* Figure out which tile we tapped on, if any */
 	selected_tile = select_cell(output, x, y);
 
 	/* lets take the opportunity to demonstrate set_input_focus */
 	update_input_focus = 1;
-
-}
-
-static void
-grid_grab_touch_up(spug_touch_grab *grab,
-		const struct timespec *time,
-		int touch_id)
-{
-	/* noop */
-}
-
-static void
-grid_grab_touch_motion(spug_touch_grab *grab,
-		const struct timespec *time,
-		int touch_id,
-		int sx,
-		int sy)
-{
-	/* noop */
-}
-
-static void
-grid_grab_touch_frame(spug_touch_grab *grab)
-{
-	/* noop */
 }
 
-static void
-grid_grab_touch_cancel(spug_touch_grab *grab)
-{
-	/* noop */
-}
-
-
-static spug_touch_grab_interface touch_grab_interface = {
-	grid_grab_touch_down,
-	grid_grab_touch_up,
-	grid_grab_touch_motion,
-	grid_grab_touch_frame,
-	grid_grab_touch_cancel
-};
-
 static void
 grid_grab_key(spug_keyboard_grab *grab,
 		const struct timespec *time,
@@ -967,14 +930,17 @@ ias_plugin_init(struct ias_plugin_info *info,
 	myid = id;
 
 	/*
-	 * This plugin is written for inforec version 1, so that's all we fill
+	 * This plugin is written for inforec version 2, so that's all we fill
 	 * in, regardless of what gets passed in for the version parameter.
+	 * Touch comes in as gestures only, so there's no touch grab.
 	 */
+	info->inforec_version = 2;
 	info->draw = grid_draw;
 	info->mouse_grab.interface = &mouse_grab_interface;
 	info->key_grab.interface = &key_grab_interface;
-	info->touch_grab.interface = &touch_grab_interface;
 	info->switch_to = grid_switch_to;
+	info->gesture_mask = IAS_GESTURE_TAP;
+	info->on_gesture = grid_gesture;
 
 	/*
 	 * Setup vertex and fragment shaders for grid cells
@@ -75,6 +75,20 @@ static void on_input_event(struct ipug_event_info *info)
 
 }
 
+/* the batched entry point. Touch motion events arrive here together, once the
+ * compositor has read everything its input devices had pending, so a plugin
+ * can look at the whole run (for example only act on the last motion of each
+ * touch point) before forwarding. This sample simply handles them in order.
+ */
+static void on_input_batch(struct ipug_event_batch *batch)
+{
+	uint32_t i;
+
+	for(i = 0; i < batch->count; i++) {
+		on_input_event(&batch->events[i].base);
+	}
+}
+
 /***
  *** Plugin initialization
  ***/
@@ -90,7 +104,12 @@ ias_input_plugin_init(struct ias_input_plugin_info *info,
 	info->key_grab = NULL;
 	info->touch_grab = NULL;
 
+	/* on_input is still filled in for compositors older than plugin API
+	 * version 3, which don't know about on_input_batch */
 	info->on_input = &on_input_event;
+	if(version >= 3) {
+		info->on_input_batch = &on_input_batch;
+	}
 
 	return 0;
 }
@@ -50,14 +50,8 @@ typedef struct thumb_obj {
 	struct weston_compositor *compositor;
 	int show;
 	int thumbs;
-	const struct timespec *pressed;
 	float touch_x;
 	float touch_y;
-	const struct timespec *swiped;
-	float swipe_x;
-	float swipe_y;
-	float swipe_end_x;
-	float swipe_end_y;
 	struct weston_seat *seat;
 	/*
 	 * When the surface list is walked, fill out
@@ -674,42 +668,15 @@ thumb_switch_to(struct weston_output * output)
 }
 
 
-static void
-thumb_grab_touch_down(struct weston_touch_grab *grab,
-		const struct timespec *time,
-		int id,
-		wl_fixed_t sx,
-		wl_fixed_t sy)
-{
-	thumb.touch_x = wl_fixed_to_double(grab->touch->grab_x);
-	thumb.touch_y = wl_fixed_to_double(grab->touch->grab_y);
-	thumb.pressed = time;
-}
-
-static void
-thumb_grab_touch_up(struct weston_touch_grab *grab, const struct timespec *time, int id)
+/*
+ * Tap and long-press both act on whatever is under the finger: a thumb, or
+ * the close area of the lower right panel.  Returns the thumb touched, or -1.
+ */
+static int
+thumb_touched(void)
 {
 	int which_thumb = -1;
 
-	if (thumb.swiped) {
-		if ((abs(thumb.swipe_x - thumb.swipe_end_x) > 100) ||
-				(abs(thumb.swipe_y - thumb.swipe_end_y) > 80)) {
-			/*
-			 * Attempting to make the interface respond to swipe/
-			 * drag type events. The difference between a swipe
-			 * and a drag is how long the finger is on the screen.
-			 * Swipes are much shorter than drags.
-			 */
-			if ((time - thumb.swiped) < 1000) {
-				printf("MOTION swipe event!!!\n");
-			} else {
-				printf("MOTION drag event!!!\n");
-			}
-		}
-		thumb.swiped = 0;
-	}
-
-
 	if (thumb.touch_y > (SCREEN_H / 1.6)) {
 		which_thumb = trunc(thumb.touch_x / 204);
 		printf("Thumb %d touched\n", which_thumb);
@@ -722,47 +689,59 @@ thumb_grab_touch_up(struct weston_touch_grab *grab, const struct timespec *time,
 		}
 	}
 
-	if (which_thumb >= 0 && which_thumb < thumb.thumbs) {
-		if ((time - thumb.pressed) > 900) {  /* almost 1 second */
-			/* Hold and press moves thumb to aux area */
-			thumb.aux2 = thumb.thumb_list[which_thumb];
-			thumb.show |= S_AUX2;
-		} else {
-			/* press moves thumb to main area */
-			thumb.main = thumb.thumb_list[which_thumb];
-			thumb.show |= S_MAIN;
-		}
+	if (which_thumb < 0 || which_thumb >= thumb.thumbs) {
+		return -1;
 	}
+
+	return which_thumb;
 }
 
 /*
- * Keep track of the start and end times that the finger is on
- * the screen. This is used to determine if the user swiped,
- * dragged, or pressed.
+ * Touch input arrives as gestures recognized by the plugin framework.
  */
 static void
-thumb_grab_touch_motion(struct weston_touch_grab *grab,
-		const struct timespec *time, int id,
-		wl_fixed_t sx, wl_fixed_t sy)
+thumb_gesture(const struct ias_gesture_event *gesture)
 {
-	if (thumb.swiped == 0) {
-		thumb.swipe_x = wl_fixed_to_double(sx);
-		thumb.swipe_y = wl_fixed_to_double(sy);
-		thumb.swiped = time;
-	} else {
-		thumb.swipe_end_x = wl_fixed_to_double(sx);
-		thumb.swipe_end_y = wl_fixed_to_double(sy);
+	int which_thumb;
+
+	switch (gesture->type) {
+	case IAS_GESTURE_TAP:
+		/* press moves thumb to main area */
+		thumb.touch_x = gesture->x;
+		thumb.touch_y = gesture->y;
+		which_thumb = thumb_touched();
+		if (which_thumb >= 0) {
+			thumb.main = thumb.thumb_list[which_thumb];
+			thumb.show |= S_MAIN;
+		}
+		break;
+	case IAS_GESTURE_LONG_PRESS:
+		/* Hold and press moves thumb to aux area */
+		if (gesture->phase != IAS_GESTURE_PHASE_BEGIN) {
+			break;
+		}
+		thumb.touch_x = gesture->x;
+		thumb.touch_y = gesture->y;
+		which_thumb = thumb_touched();
+		if (which_thumb >= 0) {
+			thumb.aux2 = thumb.thumb_list[which_thumb];
+			thumb.show |= S_AUX2;
+		}
+		break;
+	case IAS_GESTURE_SWIPE:
+		printf("MOTION swipe event!!!\n");
+		break;
+	case IAS_GESTURE_DRAG:
+		if (gesture->phase == IAS_GESTURE_PHASE_END) {
+			printf("MOTION drag event!!!\n");
+		}
+		break;
+	default:
+		break;
 	}
 }
 
 
-static struct weston_touch_grab_interface touch_grab_interface = {
-	thumb_grab_touch_down,
-	thumb_grab_touch_up,
-	thumb_grab_touch_motion,
-};
-
-
 
 
 WL_EXPORT int
@@ -776,14 +755,18 @@ ias_plugin_init(struct ias_plugin_info *info,
 	GLint status;
 
 	/*
-	 * This plugin is written for inforec version 1, so that's all we fill
+	 * This plugin is written for inforec version 2, so that's all we fill
 	 * in, regardless of what gets passed in for the version parameter.
+	 * Touch comes in as gestures only, so there's no touch grab.
 	 */
+	info->inforec_version = 2;
 	info->draw = (ias_draw_fn)thumb_draw;
 	info->mouse_grab.interface = &mouse_grab_interface;
 	info->key_grab.interface = &key_grab_interface;
-	info->touch_grab.interface = &touch_grab_interface;
 	info->switch_to = (ias_switchto_fn)thumb_switch_to;
+	info->gesture_mask = IAS_GESTURE_TAP | IAS_GESTURE_LONG_PRESS |
+		IAS_GESTURE_SWIPE | IAS_GESTURE_DRAG;
+	info->on_gesture = thumb_gesture;
 
 	frag = create_shader(frag_shader_text, GL_FRAGMENT_SHADER);
 	vert = create_shader(vert_shader_text, GL_VERTEX_SHADER);
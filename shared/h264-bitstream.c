@@ -0,0 +1,436 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "h264-bitstream.h"
+
+/* Plenty for an SPS or PPS, so that they never need to grow */
+#define BITSTREAM_INITIAL_SIZE	256
+
+/* Largest RBSP that still fits H264_MAX_HEADER_BYTES once escaped */
+#define HEADER_RBSP_BYTES	(H264_MAX_HEADER_BYTES * 2 / 3 - 5)
+
+void
+bitstream_start(struct bitstream *bs)
+{
+	memset(bs, 0, sizeof *bs);
+	bs->buffer = malloc(BITSTREAM_INITIAL_SIZE);
+	if (bs->buffer)
+		bs->size = BITSTREAM_INITIAL_SIZE;
+	bs->growable = 1;
+}
+
+void
+bitstream_start_fixed(struct bitstream *bs, void *buffer, size_t size)
+{
+	memset(bs, 0, sizeof *bs);
+	bs->buffer = buffer;
+	bs->size = size;
+}
+
+/* Make room for n more bytes after the ones already stored. */
+static int
+bitstream_reserve(struct bitstream *bs, size_t n)
+{
+	size_t used = (bs->bit_offset - bs->cache_bits) / 8;
+	size_t size;
+	uint8_t *buffer;
+
+	if (used + n <= bs->size)
+		return 0;
+
+	if (!bs->growable) {
+		bs->buffer = NULL;
+		return -1;
+	}
+
+	size = bs->size * 2;
+	if (size < used + n)
+		size = used + n;
+
+	/* Assign realloc pointer to a temp buffer so that if realloc
+	 * fails then the original bs->buffer can still be freed,
+	 * otherwise it would be lost. */
+	buffer = realloc(bs->buffer, size);
+	if (!buffer) {
+		free(bs->buffer);
+		bs->buffer = NULL;
+		return -1;
+	}
+
+	bs->buffer = buffer;
+	bs->size = size;
+
+	return 0;
+}
+
+void
+bitstream_end(struct bitstream *bs)
+{
+	uint8_t *p;
+	int n;
+
+	if (!bs->buffer || !bs->cache_bits)
+		return;
+
+	n = (bs->cache_bits + 7) / 8;
+	if (bitstream_reserve(bs, n) < 0)
+		return;
+
+	p = bs->buffer + (bs->bit_offset - bs->cache_bits) / 8;
+
+	/* Left align the remaining bits in the last bytes */
+	bs->cache <<= n * 8 - bs->cache_bits;
+	while (n--)
+		*p++ = bs->cache >> (n * 8);
+
+	bs->cache = 0;
+	bs->cache_bits = 0;
+}
+
+void
+bitstream_put_ui(struct bitstream *bs, unsigned int val, int size_in_bits)
+{
+	uint32_t word;
+	uint8_t *p;
+
+	if (!size_in_bits || !bs->buffer)
+		return;
+
+	/* At most 31 bits are ever left in the cache, so 32 more fit */
+	bs->cache = (bs->cache << size_in_bits) |
+		(val & (uint32_t) ((1ULL << size_in_bits) - 1));
+	bs->cache_bits += size_in_bits;
+	bs->bit_offset += size_in_bits;
+
+	if (bs->cache_bits < 32)
+		return;
+
+	if (bitstream_reserve(bs, 4) < 0)
+		return;
+
+	bs->cache_bits -= 32;
+	word = bs->cache >> bs->cache_bits;
+	p = bs->buffer + (bs->bit_offset - bs->cache_bits) / 8 - 4;
+	p[0] = word >> 24;
+	p[1] = word >> 16;
+	p[2] = word >> 8;
+	p[3] = word;
+
+	bs->cache &= (1ULL << bs->cache_bits) - 1;
+}
+
+void
+bitstream_put_ue(struct bitstream *bs, unsigned int val)
+{
+	uint32_t code = val + 1;
+	int len = 32 - __builtin_clz(code);
+
+	/* len - 1 zeros, then the len bits of val + 1 */
+	if (len * 2 - 1 <= 32) {
+		bitstream_put_ui(bs, code, len * 2 - 1);
+	} else {
+		bitstream_put_ui(bs, 0, len - 1);
+		bitstream_put_ui(bs, code, len);
+	}
+}
+
+void
+bitstream_put_se(struct bitstream *bs, int val)
+{
+	unsigned int new_val;
+
+	if (val <= 0)
+		new_val = -2 * (unsigned int) val;
+	else
+		new_val = 2 * (unsigned int) val - 1;
+
+	bitstream_put_ue(bs, new_val);
+}
+
+void
+bitstream_byte_aligning(struct bitstream *bs, int bit)
+{
+	int bit_offset = (bs->bit_offset & 0x7);
+	int bit_left = 8 - bit_offset;
+	int new_val;
+
+	if (!bit_offset)
+		return;
+
+	if (bit)
+		new_val = (1 << bit_left) - 1;
+	else
+		new_val = 0;
+
+	bitstream_put_ui(bs, new_val, bit_left);
+}
+
+void
+nal_start_code_prefix(struct bitstream *bs)
+{
+	bitstream_put_ui(bs, 0x00000001, 32);
+}
+
+void
+nal_header(struct bitstream *bs, int nal_ref_idc, int nal_unit_type)
+{
+	/* forbidden_zero_bit: 0 */
+	bitstream_put_ui(bs, 0, 1);
+
+	bitstream_put_ui(bs, nal_ref_idc, 2);
+	bitstream_put_ui(bs, nal_unit_type, 5);
+}
+
+void
+rbsp_trailing_bits(struct bitstream *bs)
+{
+	bitstream_put_ui(bs, 1, 1);
+	bitstream_byte_aligning(bs, 0);
+}
+
+void
+h264_sps_rbsp(struct bitstream *bs, const struct h264_sps *sps)
+{
+	int i;
+
+	bitstream_put_ui(bs, sps->profile_idc, 8);
+
+	/* constraint_set[0-3] flag */
+	for (i = 0; i < 4; i++) {
+		int set = (sps->constraint_set_flags & (1 << i)) ? 1 : 0;
+		bitstream_put_ui(bs, set, 1);
+	}
+
+	/* reserved_zero_4bits */
+	bitstream_put_ui(bs, 0, 4);
+	bitstream_put_ui(bs, sps->level_idc, 8);
+	bitstream_put_ue(bs, sps->seq_parameter_set_id);
+
+	if (sps->profile_idc >= H264_PROFILE_IDC_HIGH) {
+		/* chroma_format_idc: 4:2:0 */
+		bitstream_put_ue(bs, 1);
+		/* bit_depth_luma_minus8, bit_depth_chroma_minus8 */
+		bitstream_put_ue(bs, 0);
+		bitstream_put_ue(bs, 0);
+		/* qpprime_y_zero_transform_bypass_flag */
+		bitstream_put_ui(bs, 0, 1);
+		/* seq_scaling_matrix_present_flag */
+		bitstream_put_ui(bs, 0, 1);
+	}
+
+	bitstream_put_ue(bs, sps->log2_max_frame_num_minus4);
+	bitstream_put_ue(bs, sps->pic_order_cnt_type);
+	if (sps->pic_order_cnt_type == 0)
+		bitstream_put_ue(bs, sps->log2_max_pic_order_cnt_lsb_minus4);
+
+	bitstream_put_ue(bs, sps->max_num_ref_frames);
+
+	/* gaps_in_frame_num_value_allowed_flag */
+	bitstream_put_ui(bs, 0, 1);
+
+	/* pic_width_in_mbs_minus1, pic_height_in_map_units_minus1 */
+	bitstream_put_ue(bs, sps->width_in_mbs - 1);
+	bitstream_put_ue(bs, sps->height_in_mbs - 1);
+
+	bitstream_put_ui(bs, sps->frame_mbs_only_flag, 1);
+	bitstream_put_ui(bs, sps->direct_8x8_inference_flag, 1);
+
+	bitstream_put_ui(bs, sps->frame_cropping_flag, 1);
+
+	if (sps->frame_cropping_flag) {
+		bitstream_put_ue(bs, sps->frame_crop_left_offset);
+		bitstream_put_ue(bs, sps->frame_crop_right_offset);
+		bitstream_put_ue(bs, sps->frame_crop_top_offset);
+		bitstream_put_ue(bs, sps->frame_crop_bottom_offset);
+	}
+
+	/* vui_parameters_present_flag */
+	bitstream_put_ui(bs, 1, 1);
+
+	/* aspect_ratio_info_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+	/* overscan_info_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+
+	/* video_signal_type_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+	/* chroma_loc_info_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+
+	/* timing_info_present_flag */
+	bitstream_put_ui(bs, 1, 1);
+	bitstream_put_ui(bs, sps->num_units_in_tick, 32);
+	bitstream_put_ui(bs, sps->time_scale, 32);
+	bitstream_put_ui(bs, sps->fixed_frame_rate_flag, 1);
+
+	/* nal_hrd_parameters_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+
+	/* vcl_hrd_parameters_present_flag; low_delay_hrd_flag is only
+	 * present with HRD parameters */
+	bitstream_put_ui(bs, 0, 1);
+
+	/* pic_struct_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+	/* bitstream_restriction_flag */
+	bitstream_put_ui(bs, 0, 1);
+
+	rbsp_trailing_bits(bs);
+}
+
+void
+h264_pps_rbsp(struct bitstream *bs, const struct h264_pps *pps)
+{
+	/* pic_parameter_set_id, seq_parameter_set_id */
+	bitstream_put_ue(bs, pps->pic_parameter_set_id);
+	bitstream_put_ue(bs, pps->seq_parameter_set_id);
+
+	bitstream_put_ui(bs, pps->entropy_coding_mode_flag, 1);
+
+	/* pic_order_present_flag: 0 */
+	bitstream_put_ui(bs, 0, 1);
+
+	/* num_slice_groups_minus1 */
+	bitstream_put_ue(bs, 0);
+
+	bitstream_put_ue(bs, pps->num_ref_idx_l0_active_minus1);
+	bitstream_put_ue(bs, pps->num_ref_idx_l1_active_minus1);
+
+	bitstream_put_ui(bs, pps->weighted_pred_flag, 1);
+	bitstream_put_ui(bs, pps->weighted_bipred_idc, 2);
+
+	/* pic_init_qp_minus26, pic_init_qs_minus26, chroma_qp_index_offset */
+	bitstream_put_se(bs, pps->pic_init_qp - 26);
+	bitstream_put_se(bs, 0);
+	bitstream_put_se(bs, 0);
+
+	bitstream_put_ui(bs, pps->deblocking_filter_control_present_flag, 1);
+
+	/* constrained_intra_pred_flag, redundant_pic_cnt_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+	bitstream_put_ui(bs, 0, 1);
+
+	bitstream_put_ui(bs, pps->transform_8x8_mode_flag, 1);
+
+	/* pic_scaling_matrix_present_flag */
+	bitstream_put_ui(bs, 0, 1);
+	bitstream_put_se(bs, pps->second_chroma_qp_index_offset);
+
+	rbsp_trailing_bits(bs);
+}
+
+size_t
+h264_escape_rbsp(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	uint8_t *out = dst;
+	size_t i = 0;
+	int zeros = 0;
+
+	while (i < len) {
+#ifdef __SSE2__
+		/* Most of a header has no zero byte at all: copy those
+		 * stretches 16 bytes at a time */
+		if (!zeros && len - i >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+			__m128i z = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+
+			if (!_mm_movemask_epi8(z)) {
+				_mm_storeu_si128((__m128i *) out, v);
+				out += 16;
+				i += 16;
+				continue;
+			}
+		}
+#endif
+		if (zeros >= 2 && src[i] <= 3) {
+			*out++ = 3;
+			zeros = 0;
+		}
+		zeros = src[i] ? 0 : zeros + 1;
+		*out++ = src[i++];
+	}
+
+	return out - dst;
+}
+
+/*
+ * Escape the RBSP that follows the start code and NAL header in bs into
+ * buffer, behind a copy of those first five bytes.
+ */
+static int
+write_nal(struct bitstream *bs, void *buffer, size_t size)
+{
+	size_t len;
+
+	bitstream_end(bs);
+	if (!bs->buffer)
+		return -1;
+
+	len = bs->bit_offset / 8 - 5;
+	if (size < 5 + len + len / 2)
+		return -1;
+
+	memcpy(buffer, bs->buffer, 5);
+	len = h264_escape_rbsp((uint8_t *) buffer + 5, bs->buffer + 5, len);
+
+	return (5 + len) * 8;
+}
+
+int
+h264_write_sps(const struct h264_sps *sps, void *buffer, size_t size)
+{
+	uint8_t rbsp[5 + HEADER_RBSP_BYTES];
+	struct bitstream bs;
+
+	bitstream_start_fixed(&bs, rbsp, sizeof rbsp);
+	nal_start_code_prefix(&bs);
+	nal_header(&bs, H264_NAL_REF_IDC_HIGH, H264_NAL_SPS);
+	h264_sps_rbsp(&bs, sps);
+
+	return write_nal(&bs, buffer, size);
+}
+
+int
+h264_write_pps(const struct h264_pps *pps, void *buffer, size_t size)
+{
+	uint8_t rbsp[5 + HEADER_RBSP_BYTES];
+	struct bitstream bs;
+
+	bitstream_start_fixed(&bs, rbsp, sizeof rbsp);
+	nal_start_code_prefix(&bs);
+	nal_header(&bs, H264_NAL_REF_IDC_HIGH, H264_NAL_PPS);
+	h264_pps_rbsp(&bs, pps);
+
+	return write_nal(&bs, buffer, size);
+}
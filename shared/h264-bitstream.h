@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WESTON_H264_BITSTREAM_H
+#define WESTON_H264_BITSTREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bit writer for the packed H.264 headers that the VA-API encoders are
+ * given, and the SPS and PPS syntax built on it.  Used by both the vaapi
+ * recorder and the remote display client so that the two don't each carry
+ * a copy.
+ */
+
+#define H264_NAL_REF_IDC_NONE		0
+#define H264_NAL_REF_IDC_LOW		1
+#define H264_NAL_REF_IDC_MEDIUM		2
+#define H264_NAL_REF_IDC_HIGH		3
+
+#define H264_NAL_SPS			7
+#define H264_NAL_PPS			8
+
+#define H264_PROFILE_IDC_BASELINE	66
+#define H264_PROFILE_IDC_MAIN		77
+#define H264_PROFILE_IDC_HIGH		100
+
+/* Room for any SPS or PPS written here, emulation prevention included */
+#define H264_MAX_HEADER_BYTES		192
+
+/*
+ * Bits are gathered in a 64 bit cache and stored four bytes at a time,
+ * most significant first, so there is nothing to byte swap at the end.
+ */
+struct bitstream {
+	uint8_t *buffer;
+	size_t size;
+	/* Bits written, including those still in the cache */
+	int bit_offset;
+	uint64_t cache;
+	int cache_bits;
+	/* buffer was allocated by bitstream_start() and can grow */
+	int growable;
+};
+
+/* The SPS fields that can be set; everything else is written as 0. */
+struct h264_sps {
+	/* High profile streams are always 8 bit 4:2:0 */
+	int profile_idc;
+	/* constraint_set0_flag is bit 0, constraint_set1_flag bit 1, ... */
+	int constraint_set_flags;
+	int level_idc;
+	int seq_parameter_set_id;
+	int log2_max_frame_num_minus4;
+	/* Only types 0 and 2 are supported */
+	int pic_order_cnt_type;
+	int log2_max_pic_order_cnt_lsb_minus4;
+	int max_num_ref_frames;
+	int width_in_mbs;
+	int height_in_mbs;
+	int frame_mbs_only_flag;
+	int direct_8x8_inference_flag;
+	int frame_cropping_flag;
+	int frame_crop_left_offset;
+	int frame_crop_right_offset;
+	int frame_crop_top_offset;
+	int frame_crop_bottom_offset;
+	/* VUI timing; a frame is two ticks */
+	uint32_t num_units_in_tick;
+	uint32_t time_scale;
+	int fixed_frame_rate_flag;
+};
+
+/* The PPS fields that can be set; everything else is written as 0. */
+struct h264_pps {
+	int pic_parameter_set_id;
+	int seq_parameter_set_id;
+	int entropy_coding_mode_flag;
+	int num_ref_idx_l0_active_minus1;
+	int num_ref_idx_l1_active_minus1;
+	int weighted_pred_flag;
+	int weighted_bipred_idc;
+	int pic_init_qp;
+	int deblocking_filter_control_present_flag;
+	int transform_8x8_mode_flag;
+	int second_chroma_qp_index_offset;
+};
+
+/*
+ * Start writing into a newly allocated buffer.  If the buffer can't be
+ * allocated, or later grown, bs->buffer is left NULL and further writes
+ * are ignored.
+ */
+void
+bitstream_start(struct bitstream *bs);
+
+/*
+ * Start writing into the caller's buffer of size bytes, which is never
+ * grown: running out of room leaves bs->buffer NULL as above.
+ */
+void
+bitstream_start_fixed(struct bitstream *bs, void *buffer, size_t size);
+
+/* Flush the cached bits, padding the last byte with zeros.  bs->buffer
+ * then holds bs->bit_offset bits of big-endian data; free() it if it came
+ * from bitstream_start(). */
+void
+bitstream_end(struct bitstream *bs);
+
+/* Write the low size_in_bits bits of val, at most 32. */
+void
+bitstream_put_ui(struct bitstream *bs, unsigned int val, int size_in_bits);
+
+/* Unsigned and signed Exp-Golomb codes, ue(v) and se(v). */
+void
+bitstream_put_ue(struct bitstream *bs, unsigned int val);
+
+void
+bitstream_put_se(struct bitstream *bs, int val);
+
+/* Pad to a byte boundary with bits of the given value. */
+void
+bitstream_byte_aligning(struct bitstream *bs, int bit);
+
+void
+nal_start_code_prefix(struct bitstream *bs);
+
+void
+nal_header(struct bitstream *bs, int nal_ref_idc, int nal_unit_type);
+
+void
+rbsp_trailing_bits(struct bitstream *bs);
+
+void
+h264_sps_rbsp(struct bitstream *bs, const struct h264_sps *sps);
+
+void
+h264_pps_rbsp(struct bitstream *bs, const struct h264_pps *pps);
+
+/*
+ * Copy an RBSP into dst as NAL unit payload, inserting an
+ * emulation_prevention_three_byte before any 0x000000 to 0x000003 byte
+ * pattern.  dst must have room for len + len / 2 bytes.  Returns the
+ * number of bytes written.
+ */
+size_t
+h264_escape_rbsp(uint8_t *dst, const uint8_t *src, size_t len);
+
+/*
+ * Write a complete SPS or PPS NAL unit, start code and emulation
+ * prevention bytes included, into the caller's buffer of size bytes,
+ * normally H264_MAX_HEADER_BYTES.  Returns its length in bits, or -1 if it
+ * doesn't fit.
+ */
+int
+h264_write_sps(const struct h264_sps *sps, void *buffer, size_t size);
+
+int
+h264_write_pps(const struct h264_pps *pps, void *buffer, size_t size);
+
+#endif /* WESTON_H264_BITSTREAM_H */
@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -199,6 +200,72 @@ os_create_anonymous_file(off_t size)
 	return fd;
 }
 
+static int
+write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t len;
+
+	while (size > 0) {
+		len = write(fd, p, size);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			return -1;
+
+		p += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+/*
+ * Create an anonymous file holding a copy of the given data, meant to be
+ * handed to any number of clients that only read it.
+ *
+ * Where memfd_create() and file sealing are available, the file is sealed
+ * against writing and resizing, so one client cannot change what the
+ * others see and the same descriptor can be sent to all of them. Otherwise
+ * this falls back to os_create_anonymous_file(), without that guarantee.
+ *
+ * The file descriptor is set CLOEXEC and its offset is unspecified;
+ * readers should mmap() it or use pread().
+ */
+int
+os_create_sealed_file(const void *data, size_t size)
+{
+	int fd;
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+	fd = memfd_create("weston-shared", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0) {
+		if (write_all(fd, data, size) < 0 ||
+		    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+					   F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+			close(fd);
+			return -1;
+		}
+
+		return fd;
+	}
+
+	if (errno != ENOSYS && errno != EINVAL)
+		return -1;
+#endif
+
+	fd = os_create_anonymous_file(size);
+	if (fd < 0)
+		return -1;
+
+	if (write_all(fd, data, size) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c)
@@ -0,0 +1,65 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RELAY_INPUT_EVENT_H
+#define RELAY_INPUT_EVENT_H
+
+#include <stdint.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One record of the ias_relay_input.send_events array.  The layout is part
+ * of the protocol (see ias-shell.xml), so only ever append to it together
+ * with a protocol version bump.
+ */
+struct ias_relay_input_event {
+	uint32_t kind;		/* ias_relay_input.event_kind */
+	uint32_t type;		/* touch_event_type or key_event_type */
+	uint32_t time;
+	union {
+		struct {
+			uint32_t id;
+			uint32_t x;
+			uint32_t y;
+		} touch;
+		struct {
+			uint32_t key;
+			uint32_t state;
+			uint32_t mods_depressed;
+			uint32_t mods_latched;
+			uint32_t mods_locked;
+			uint32_t group;
+		} key;
+	};
+};
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* RELAY_INPUT_EVENT_H */
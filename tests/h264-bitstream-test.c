@@ -0,0 +1,426 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "shared/h264-bitstream.h"
+
+/* Reads back what the writer produced, independently of it. */
+struct bit_reader {
+	const uint8_t *data;
+	int bits;
+	int pos;
+};
+
+static uint32_t
+read_bits(struct bit_reader *br, int n)
+{
+	uint32_t val = 0;
+
+	assert(br->pos + n <= br->bits);
+	while (n--) {
+		val = (val << 1) |
+			((br->data[br->pos / 8] >> (7 - br->pos % 8)) & 1);
+		br->pos++;
+	}
+
+	return val;
+}
+
+static uint32_t
+read_ue(struct bit_reader *br)
+{
+	int zeros = 0;
+
+	while (read_bits(br, 1) == 0)
+		zeros++;
+
+	return (1u << zeros) - 1 + read_bits(br, zeros);
+}
+
+static int32_t
+read_se(struct bit_reader *br)
+{
+	uint32_t code = read_ue(br);
+
+	return code & 1 ? (int32_t) (code + 1) / 2 : -(int32_t) (code / 2);
+}
+
+static void
+finish(struct bitstream *bs, struct bit_reader *br)
+{
+	bitstream_end(bs);
+	assert(bs->buffer);
+
+	br->data = (const uint8_t *) bs->buffer;
+	br->bits = bs->bit_offset;
+	br->pos = 0;
+}
+
+/* An SPS and PPS for 1920x1080 H.264 Main profile, as the vaapi recorder
+ * wrote them before the code was shared, except that the SPS no longer
+ * has a low_delay_hrd_flag without any HRD parameters. */
+static const uint8_t recorder_sps[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x29,
+	0xec, 0xa0, 0x3c, 0x01, 0x12, 0xf2, 0xc2, 0x00,
+	0x00, 0x00, 0x1e, 0x00, 0x00, 0x0e, 0x11, 0x08,
+};
+
+/* The same SPS as a NAL unit: num_units_in_tick needs an emulation
+ * prevention byte. */
+static const uint8_t recorder_sps_nal[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x4d, 0x40, 0x29,
+	0xec, 0xa0, 0x3c, 0x01, 0x12, 0xf2, 0xc2, 0x00,
+	0x00, 0x03, 0x00, 0x1e, 0x00, 0x00, 0x0e, 0x11,
+	0x08,
+};
+
+static const uint8_t recorder_pps[] = {
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xee, 0x01, 0xaf, 0x0c,
+};
+
+static void
+recorder_parameters(struct h264_sps *sps, struct h264_pps *pps)
+{
+	memset(sps, 0, sizeof *sps);
+	sps->profile_idc = H264_PROFILE_IDC_MAIN;
+	sps->constraint_set_flags = 1 << 1;
+	sps->level_idc = 41;
+	sps->log2_max_pic_order_cnt_lsb_minus4 = 2;
+	sps->max_num_ref_frames = 4;
+	sps->width_in_mbs = 120;
+	sps->height_in_mbs = 68;
+	sps->frame_mbs_only_flag = 1;
+	sps->frame_cropping_flag = 1;
+	sps->frame_crop_bottom_offset = 4;
+	sps->num_units_in_tick = 15;
+	sps->time_scale = 1800;
+	sps->fixed_frame_rate_flag = 1;
+
+	memset(pps, 0, sizeof *pps);
+	pps->entropy_coding_mode_flag = 1;
+	pps->deblocking_filter_control_present_flag = 1;
+}
+
+TEST(exp_golomb_codes)
+{
+	static const int32_t se[] = { 0, 1, -1, 2, -2, 1000, -1000 };
+	struct bitstream bs;
+	struct bit_reader br;
+	unsigned int i;
+
+	bitstream_start(&bs);
+	for (i = 0; i < 300; i++)
+		bitstream_put_ue(&bs, i);
+	bitstream_put_ue(&bs, 0xfffffffe);
+	for (i = 0; i < ARRAY_LENGTH(se); i++)
+		bitstream_put_se(&bs, se[i]);
+	finish(&bs, &br);
+
+	for (i = 0; i < 300; i++)
+		assert(read_ue(&br) == i);
+	assert(read_ue(&br) == 0xfffffffe);
+	for (i = 0; i < ARRAY_LENGTH(se); i++)
+		assert(read_se(&br) == se[i]);
+	assert(br.pos == br.bits);
+
+	free(bs.buffer);
+}
+
+TEST(small_codes_have_known_bits)
+{
+	static const uint8_t expected[] = { 0xa6, 0x42, 0x98, 0xe8 };
+	struct bitstream bs;
+
+	/* 1 010 011 00100 00101 00110 00111 0 + trailing bits */
+	bitstream_start(&bs);
+	bitstream_put_ue(&bs, 0);
+	bitstream_put_ue(&bs, 1);
+	bitstream_put_ue(&bs, 2);
+	bitstream_put_ue(&bs, 3);
+	bitstream_put_se(&bs, -2);
+	bitstream_put_ue(&bs, 5);
+	bitstream_put_ue(&bs, 6);
+	bitstream_put_ui(&bs, 0, 1);
+	rbsp_trailing_bits(&bs);
+	bitstream_end(&bs);
+
+	assert(bs.bit_offset == 32);
+	assert(memcmp(bs.buffer, expected, sizeof expected) == 0);
+
+	free(bs.buffer);
+}
+
+TEST(words_straddle_boundaries)
+{
+	struct bitstream bs;
+	struct bit_reader br;
+	int shift;
+
+	/* Every alignment of a 32 bit field, each after a 1 bit marker */
+	bitstream_start(&bs);
+	for (shift = 0; shift < 32; shift++) {
+		bitstream_put_ui(&bs, 1, 1);
+		bitstream_put_ui(&bs, 0xdeadbeef >> shift | 0x80000000, 32);
+		bitstream_put_ui(&bs, 0, shift);
+	}
+	finish(&bs, &br);
+
+	for (shift = 0; shift < 32; shift++) {
+		assert(read_bits(&br, 1) == 1);
+		assert(read_bits(&br, 32) == (0xdeadbeef >> shift | 0x80000000));
+		assert(shift == 0 || read_bits(&br, shift) == 0);
+	}
+
+	free(bs.buffer);
+}
+
+TEST(buffer_grows)
+{
+	struct bitstream bs;
+	struct bit_reader br;
+	int i;
+
+	/* Several times the initial allocation */
+	bitstream_start(&bs);
+	for (i = 0; i < 20000; i++)
+		bitstream_put_ui(&bs, i * 2654435761u >> 9, 23);
+	finish(&bs, &br);
+
+	assert(br.bits == 20000 * 23);
+	for (i = 0; i < 20000; i++)
+		assert(read_bits(&br, 23) == (i * 2654435761u >> 9));
+
+	free(bs.buffer);
+}
+
+TEST(byte_aligning)
+{
+	struct bitstream bs;
+
+	bitstream_start(&bs);
+	bitstream_put_ui(&bs, 0, 3);
+	bitstream_byte_aligning(&bs, 1);
+	assert(bs.bit_offset == 8);
+	bitstream_byte_aligning(&bs, 1);
+	assert(bs.bit_offset == 8);
+	bitstream_put_ui(&bs, 1, 1);
+	bitstream_byte_aligning(&bs, 0);
+	bitstream_end(&bs);
+
+	assert(bs.bit_offset == 16);
+	assert(((uint8_t *) bs.buffer)[0] == 0x1f);
+	assert(((uint8_t *) bs.buffer)[1] == 0x80);
+
+	free(bs.buffer);
+}
+
+TEST(recorder_rbsp_matches_reference)
+{
+	struct h264_sps sps;
+	struct h264_pps pps;
+	struct bitstream bs;
+
+	recorder_parameters(&sps, &pps);
+
+	bitstream_start(&bs);
+	nal_start_code_prefix(&bs);
+	nal_header(&bs, H264_NAL_REF_IDC_HIGH, H264_NAL_SPS);
+	h264_sps_rbsp(&bs, &sps);
+	bitstream_end(&bs);
+	assert(bs.bit_offset == (int) sizeof recorder_sps * 8);
+	assert(memcmp(bs.buffer, recorder_sps, sizeof recorder_sps) == 0);
+	free(bs.buffer);
+
+	bitstream_start(&bs);
+	nal_start_code_prefix(&bs);
+	nal_header(&bs, H264_NAL_REF_IDC_HIGH, H264_NAL_PPS);
+	h264_pps_rbsp(&bs, &pps);
+	bitstream_end(&bs);
+	assert(bs.bit_offset == (int) sizeof recorder_pps * 8);
+	assert(memcmp(bs.buffer, recorder_pps, sizeof recorder_pps) == 0);
+	free(bs.buffer);
+}
+
+TEST(recorder_headers_match_reference)
+{
+	uint8_t data[H264_MAX_HEADER_BYTES];
+	struct h264_sps sps;
+	struct h264_pps pps;
+	int bits;
+
+	recorder_parameters(&sps, &pps);
+
+	bits = h264_write_sps(&sps, data, sizeof data);
+	assert(bits == (int) sizeof recorder_sps_nal * 8);
+	assert(memcmp(data, recorder_sps_nal, sizeof recorder_sps_nal) == 0);
+
+	bits = h264_write_pps(&pps, data, sizeof data);
+	assert(bits == (int) sizeof recorder_pps * 8);
+	assert(memcmp(data, recorder_pps, sizeof recorder_pps) == 0);
+
+	/* Too small a buffer is refused rather than overrun */
+	bits = h264_write_sps(&sps, data, sizeof recorder_sps_nal - 1);
+	assert(bits == -1);
+}
+
+TEST(fixed_buffer_overflows_cleanly)
+{
+	uint8_t data[8];
+	struct bitstream bs;
+	int i;
+
+	bitstream_start_fixed(&bs, data, sizeof data);
+	for (i = 0; i < 2; i++)
+		bitstream_put_ui(&bs, 0x01020304 * (i + 1), 32);
+	bitstream_end(&bs);
+	assert(bs.buffer == data);
+	assert(data[0] == 0x01 && data[7] == 0x08);
+
+	bitstream_put_ui(&bs, 1, 1);
+	bitstream_end(&bs);
+	assert(bs.buffer == NULL);
+}
+
+/* Byte at a time, straight from the definition in 7.4.1. */
+static size_t
+escape_reference(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < len; i++) {
+		if (n >= 2 && dst[n - 1] == 0 && dst[n - 2] == 0 &&
+		    src[i] <= 3)
+			dst[n++] = 3;
+		dst[n++] = src[i];
+	}
+
+	return n;
+}
+
+TEST(emulation_prevention_known_bytes)
+{
+	static const uint8_t src[] = {
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+		0x04, 0x00, 0x00, 0x03, 0x00, 0x00,
+	};
+	static const uint8_t expected[] = {
+		0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x01,
+		0x00, 0x00, 0x04, 0x00, 0x00, 0x03, 0x03, 0x00,
+		0x00,
+	};
+	uint8_t dst[sizeof src * 3 / 2];
+	size_t len;
+
+	len = h264_escape_rbsp(dst, src, sizeof src);
+	assert(len == sizeof expected);
+	assert(memcmp(dst, expected, len) == 0);
+}
+
+TEST(emulation_prevention_matches_reference)
+{
+	uint8_t src[1000], dst[1500], ref[1500];
+	uint32_t seed = 1;
+	size_t len, ref_len, i;
+	int density;
+
+	/* From no zeros, through the SIMD path, to mostly zeros, for every
+	 * length so that runs straddle the 16 byte blocks every way */
+	for (density = 0; density <= 8; density++) {
+		for (len = 0; len <= 64; len++) {
+			for (i = 0; i < sizeof src; i++) {
+				seed = seed * 1103515245 + 12345;
+				if ((int) (seed >> 28) < density * 2)
+					src[i] = (seed >> 16) & 3;
+				else
+					src[i] = 4 + (seed >> 16) % 252;
+			}
+
+			ref_len = escape_reference(ref, src, len);
+			assert(h264_escape_rbsp(dst, src, len) == ref_len);
+			assert(memcmp(dst, ref, ref_len) == 0);
+		}
+
+		ref_len = escape_reference(ref, src, sizeof src);
+		assert(h264_escape_rbsp(dst, src, sizeof src) == ref_len);
+		assert(memcmp(dst, ref, ref_len) == 0);
+	}
+}
+
+TEST(high_profile_sps_fields)
+{
+	struct h264_sps sps;
+	struct h264_pps pps;
+	struct bitstream bs;
+	struct bit_reader br;
+
+	recorder_parameters(&sps, &pps);
+	sps.profile_idc = H264_PROFILE_IDC_HIGH;
+	sps.constraint_set_flags = 0;
+	sps.pic_order_cnt_type = 2;
+	sps.direct_8x8_inference_flag = 1;
+
+	bitstream_start(&bs);
+	h264_sps_rbsp(&bs, &sps);
+	finish(&bs, &br);
+
+	assert(read_bits(&br, 8) == H264_PROFILE_IDC_HIGH);
+	assert(read_bits(&br, 8) == 0);		/* constraint flags */
+	assert(read_bits(&br, 8) == 41);
+	assert(read_ue(&br) == 0);		/* seq_parameter_set_id */
+	assert(read_ue(&br) == 1);		/* chroma_format_idc */
+	assert(read_ue(&br) == 0);		/* bit_depth_luma_minus8 */
+	assert(read_ue(&br) == 0);		/* bit_depth_chroma_minus8 */
+	assert(read_bits(&br, 2) == 0);		/* bypass, scaling matrix */
+	assert(read_ue(&br) == 0);		/* log2_max_frame_num_minus4 */
+	assert(read_ue(&br) == 2);		/* pic_order_cnt_type */
+	assert(read_ue(&br) == 4);		/* max_num_ref_frames */
+	assert(read_bits(&br, 1) == 0);		/* gaps_in_frame_num */
+	assert(read_ue(&br) == 119);
+	assert(read_ue(&br) == 67);
+	assert(read_bits(&br, 1) == 1);		/* frame_mbs_only_flag */
+	assert(read_bits(&br, 1) == 1);		/* direct_8x8_inference_flag */
+	assert(read_bits(&br, 1) == 1);		/* frame_cropping_flag */
+	assert(read_ue(&br) == 0);
+	assert(read_ue(&br) == 0);
+	assert(read_ue(&br) == 0);
+	assert(read_ue(&br) == 4);
+	assert(read_bits(&br, 6) == 0x21);	/* VUI, timing info only */
+	assert(read_bits(&br, 32) == 15);
+	assert(read_bits(&br, 32) == 1800);
+	assert(read_bits(&br, 1) == 1);		/* fixed_frame_rate_flag */
+	assert(read_bits(&br, 4) == 0);		/* no HRD, no restrictions */
+	assert(read_bits(&br, 1) == 1);		/* rbsp_stop_one_bit */
+	assert(br.bits % 8 == 0 && br.bits - br.pos < 8);
+
+	free(bs.buffer);
+}
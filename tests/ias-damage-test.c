@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <xf86drmMode.h>
+
+#include "weston-test-runner.h"
+
+#include "ias-damage.h"
+
+#define MOCK_FD		42
+#define MOCK_BLOB_ID	7
+
+/*
+ * Stand-in for libdrm: record whatever ias_damage_create_blob() would have
+ * handed to the kernel so the tests can inspect it.
+ */
+static struct {
+	int calls;
+	int fd;
+	size_t size;
+	struct ias_damage_clip clips[IAS_MAX_DAMAGE_CLIPS];
+} mock;
+
+int
+drmModeCreatePropertyBlob(int fd, const void *data, size_t size,
+			  uint32_t *id)
+{
+	mock.calls++;
+	mock.fd = fd;
+	mock.size = size;
+	assert(size <= sizeof mock.clips);
+	memcpy(mock.clips, data, size);
+	*id = MOCK_BLOB_ID;
+
+	return 0;
+}
+
+static void
+mock_reset(void)
+{
+	memset(&mock, 0, sizeof mock);
+}
+
+static void
+assert_clip(const struct ias_damage_clip *c,
+	    int32_t x1, int32_t y1, int32_t x2, int32_t y2)
+{
+	assert(c->x1 == x1);
+	assert(c->y1 == y1);
+	assert(c->x2 == x2);
+	assert(c->y2 == y2);
+}
+
+TEST(blob_matches_damage_rects)
+{
+	pixman_region32_t damage;
+	uint32_t blob_id = 0;
+
+	mock_reset();
+	pixman_region32_init_rect(&damage, 10, 20, 100, 50);
+	pixman_region32_union_rect(&damage, &damage, 500, 300, 40, 40);
+
+	assert(ias_damage_create_blob(MOCK_FD, &damage, 1920, 1080,
+				      1920, 1080, &blob_id) == 0);
+	assert(blob_id == MOCK_BLOB_ID);
+	assert(mock.calls == 1);
+	assert(mock.fd == MOCK_FD);
+	assert(mock.size == 2 * sizeof(struct ias_damage_clip));
+	assert_clip(&mock.clips[0], 10, 20, 110, 70);
+	assert_clip(&mock.clips[1], 500, 300, 540, 340);
+
+	pixman_region32_fini(&damage);
+}
+
+TEST(empty_damage_creates_no_blob)
+{
+	pixman_region32_t damage;
+	uint32_t blob_id = 123;
+
+	mock_reset();
+	pixman_region32_init(&damage);
+
+	assert(ias_damage_create_blob(MOCK_FD, &damage, 800, 480,
+				      800, 480, &blob_id) == 0);
+	assert(blob_id == 0);
+	assert(mock.calls == 0);
+
+	pixman_region32_fini(&damage);
+}
+
+TEST(damage_is_clipped_to_framebuffer)
+{
+	pixman_region32_t damage;
+	uint32_t blob_id;
+
+	mock_reset();
+	pixman_region32_init_rect(&damage, -10, -10, 30, 30);
+	pixman_region32_union_rect(&damage, &damage, 790, 470, 50, 50);
+	pixman_region32_union_rect(&damage, &damage, 100, 600, 10, 10);
+
+	assert(ias_damage_create_blob(MOCK_FD, &damage, 800, 480,
+				      800, 480, &blob_id) == 0);
+	assert(mock.size == 2 * sizeof(struct ias_damage_clip));
+	assert_clip(&mock.clips[0], 0, 0, 20, 20);
+	assert_clip(&mock.clips[1], 790, 470, 800, 480);
+
+	pixman_region32_fini(&damage);
+}
+
+TEST(damage_is_scaled_to_framebuffer)
+{
+	pixman_region32_t damage;
+	uint32_t blob_id;
+
+	mock_reset();
+	/* Odd edges must round outwards so nothing damaged is dropped */
+	pixman_region32_init_rect(&damage, 101, 51, 99, 49);
+
+	assert(ias_damage_create_blob(MOCK_FD, &damage, 960, 540,
+				      1920, 1080, &blob_id) == 0);
+	assert(mock.size == sizeof(struct ias_damage_clip));
+	assert_clip(&mock.clips[0], 202, 102, 400, 200);
+
+	mock_reset();
+	assert(ias_damage_create_blob(MOCK_FD, &damage, 1920, 1080,
+				      960, 540, &blob_id) == 0);
+	assert_clip(&mock.clips[0], 50, 25, 100, 50);
+
+	pixman_region32_fini(&damage);
+}
+
+TEST(too_many_rects_fall_back_to_extents)
+{
+	pixman_region32_t damage;
+	uint32_t blob_id;
+	int i;
+
+	mock_reset();
+	pixman_region32_init(&damage);
+	for (i = 0; i < IAS_MAX_DAMAGE_CLIPS + 1; i++)
+		pixman_region32_union_rect(&damage, &damage,
+					   i * 10, i * 5, 4, 4);
+
+	assert(ias_damage_create_blob(MOCK_FD, &damage, 1920, 1080,
+				      1920, 1080, &blob_id) == 0);
+	assert(mock.size == sizeof(struct ias_damage_clip));
+	assert_clip(&mock.clips[0], 0, 0,
+		    IAS_MAX_DAMAGE_CLIPS * 10 + 4,
+		    IAS_MAX_DAMAGE_CLIPS * 5 + 4);
+
+	pixman_region32_fini(&damage);
+}
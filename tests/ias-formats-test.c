@@ -0,0 +1,212 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <drm_fourcc.h>
+
+#include "weston-test-runner.h"
+
+#include "ias-formats.h"
+
+/*
+ * A fake IN_FORMATS blob laid out the way the kernel builds it: header,
+ * then the format array, then the modifier array.
+ */
+struct fake_blob {
+	struct ias_format_modifier_blob header;
+	uint32_t formats[4];
+	struct ias_format_modifier modifiers[5];
+};
+
+static void
+fake_blob_init(struct fake_blob *b)
+{
+	memset(b, 0, sizeof *b);
+
+	b->header.version = IAS_FORMAT_BLOB_VERSION;
+	b->header.count_formats = 4;
+	b->header.formats_offset = offsetof(struct fake_blob, formats);
+	b->header.count_modifiers = 5;
+	b->header.modifiers_offset = offsetof(struct fake_blob, modifiers);
+
+	b->formats[0] = DRM_FORMAT_XRGB8888;
+	b->formats[1] = DRM_FORMAT_ARGB8888;
+	b->formats[2] = DRM_FORMAT_NV12;
+	b->formats[3] = DRM_FORMAT_YUYV;
+
+	/* Everything is linear and X tiled; NV12/YUYV stop there */
+	b->modifiers[0].formats = 0xf;
+	b->modifiers[0].modifier = DRM_FORMAT_MOD_LINEAR;
+	b->modifiers[1].formats = 0xf;
+	b->modifiers[1].modifier = I915_FORMAT_MOD_X_TILED;
+	b->modifiers[2].formats = 0x3;
+	b->modifiers[2].modifier = I915_FORMAT_MOD_Y_TILED;
+	b->modifiers[3].formats = 0x3;
+	b->modifiers[3].modifier = I915_FORMAT_MOD_Y_TILED_CCS;
+	/* A window starting at format 1: ARGB only */
+	b->modifiers[4].formats = 0x1;
+	b->modifiers[4].offset = 1;
+	b->modifiers[4].modifier = I915_FORMAT_MOD_Yf_TILED_CCS;
+}
+
+TEST(blob_formats_and_modifiers_are_parsed)
+{
+	struct fake_blob b;
+	struct ias_plane_formats pf;
+
+	fake_blob_init(&b);
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == 0);
+
+	assert(pf.count == 4);
+	assert(pf.formats[0].format == DRM_FORMAT_XRGB8888);
+	assert(pf.formats[0].num_modifiers == 4);
+	assert(pf.formats[1].num_modifiers == 5);
+	assert(pf.formats[2].num_modifiers == 2);
+	assert(pf.formats[3].num_modifiers == 2);
+
+	assert(ias_plane_formats_has_modifier(&pf, DRM_FORMAT_ARGB8888,
+			I915_FORMAT_MOD_Yf_TILED_CCS));
+	assert(!ias_plane_formats_has_modifier(&pf, DRM_FORMAT_XRGB8888,
+			I915_FORMAT_MOD_Yf_TILED_CCS));
+	assert(ias_plane_formats_has_modifier(&pf, DRM_FORMAT_NV12,
+			I915_FORMAT_MOD_X_TILED));
+	assert(!ias_plane_formats_has_modifier(&pf, DRM_FORMAT_NV12,
+			I915_FORMAT_MOD_Y_TILED_CCS));
+	assert(!ias_plane_formats_has_modifier(&pf, DRM_FORMAT_RGB565,
+			DRM_FORMAT_MOD_LINEAR));
+
+	ias_plane_formats_release(&pf);
+	assert(pf.count == 0 && pf.formats == NULL);
+}
+
+TEST(modifiers_come_best_first)
+{
+	struct fake_blob b;
+	struct ias_plane_formats pf;
+	uint64_t mods[8];
+	int n;
+
+	fake_blob_init(&b);
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == 0);
+
+	n = ias_plane_formats_get_modifiers(&pf, DRM_FORMAT_ARGB8888,
+			IAS_MODIFIERS_CCS | IAS_MODIFIERS_YF, mods, 8);
+	assert(n == 5);
+	assert(mods[0] == I915_FORMAT_MOD_Yf_TILED_CCS);
+	assert(mods[1] == I915_FORMAT_MOD_Y_TILED_CCS);
+	assert(mods[2] == I915_FORMAT_MOD_Y_TILED);
+	assert(mods[3] == I915_FORMAT_MOD_X_TILED);
+	assert(mods[4] == DRM_FORMAT_MOD_LINEAR);
+
+	/* Only the best ones survive a short array */
+	n = ias_plane_formats_get_modifiers(&pf, DRM_FORMAT_ARGB8888,
+			IAS_MODIFIERS_CCS | IAS_MODIFIERS_YF, mods, 2);
+	assert(n == 2);
+	assert(mods[0] == I915_FORMAT_MOD_Yf_TILED_CCS);
+	assert(mods[1] == I915_FORMAT_MOD_Y_TILED_CCS);
+
+	ias_plane_formats_release(&pf);
+}
+
+TEST(compressed_modifiers_can_be_excluded)
+{
+	struct fake_blob b;
+	struct ias_plane_formats pf;
+	uint64_t mods[8];
+	int n;
+
+	fake_blob_init(&b);
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == 0);
+
+	n = ias_plane_formats_get_modifiers(&pf, DRM_FORMAT_ARGB8888,
+			IAS_MODIFIERS_YF, mods, 8);
+	assert(n == 3);
+	assert(mods[0] == I915_FORMAT_MOD_Y_TILED);
+	assert(mods[1] == I915_FORMAT_MOD_X_TILED);
+	assert(mods[2] == DRM_FORMAT_MOD_LINEAR);
+
+	assert(ias_plane_formats_get_modifiers(&pf, DRM_FORMAT_RGB565,
+			IAS_MODIFIERS_CCS | IAS_MODIFIERS_YF, mods, 8) == 0);
+
+	ias_plane_formats_release(&pf);
+}
+
+TEST(yf_modifiers_can_be_excluded)
+{
+	struct fake_blob b;
+	struct ias_plane_formats pf;
+	uint64_t mods[8];
+	int n;
+
+	fake_blob_init(&b);
+	b.modifiers[2].modifier = I915_FORMAT_MOD_Yf_TILED;
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == 0);
+
+	/* Yf tiled CCS is left out as soon as either bit is clear */
+	n = ias_plane_formats_get_modifiers(&pf, DRM_FORMAT_ARGB8888,
+			IAS_MODIFIERS_CCS, mods, 8);
+	assert(n == 3);
+	assert(mods[0] == I915_FORMAT_MOD_Y_TILED_CCS);
+	assert(mods[1] == I915_FORMAT_MOD_X_TILED);
+	assert(mods[2] == DRM_FORMAT_MOD_LINEAR);
+
+	n = ias_plane_formats_get_modifiers(&pf, DRM_FORMAT_ARGB8888, 0,
+			mods, 8);
+	assert(n == 2);
+	assert(mods[0] == I915_FORMAT_MOD_X_TILED);
+	assert(mods[1] == DRM_FORMAT_MOD_LINEAR);
+
+	ias_plane_formats_release(&pf);
+}
+
+TEST(malformed_blobs_are_rejected)
+{
+	struct fake_blob b;
+	struct ias_plane_formats pf;
+
+	fake_blob_init(&b);
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b.header - 1) == -1);
+	assert(pf.count == 0 && pf.formats == NULL);
+
+	/* Modifier array runs past the end of the blob */
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b - 1) == -1);
+
+	fake_blob_init(&b);
+	b.header.formats_offset = sizeof b + 4;
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == -1);
+
+	fake_blob_init(&b);
+	b.header.count_formats = 0x40000000;
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == -1);
+
+	fake_blob_init(&b);
+	b.header.version = 0;
+	assert(ias_plane_formats_parse(&pf, &b, sizeof b) == -1);
+	assert(pf.count == 0 && pf.formats == NULL);
+}
@@ -0,0 +1,493 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "weston-test-runner.h"
+
+#include "ias-gesture.h"
+
+#define MAX_RECORDED 64
+
+/* Gestures reported by the recognizer under test */
+static struct {
+	int count;
+	struct ias_gesture_event events[MAX_RECORDED];
+} rec_log;
+
+static void
+record(const struct ias_gesture_event *event, void *data)
+{
+	assert(data == &rec_log);
+	assert(rec_log.count < MAX_RECORDED);
+	rec_log.events[rec_log.count++] = *event;
+}
+
+static void
+start(struct ias_gesture_recognizer *rec, uint32_t mask)
+{
+	memset(&rec_log, 0, sizeof rec_log);
+	ias_gesture_recognizer_init(rec, NULL, mask, record, &rec_log);
+}
+
+static struct timespec
+ms(int msec)
+{
+	struct timespec ts;
+
+	ts.tv_sec = 1000 + msec / 1000;
+	ts.tv_nsec = (msec % 1000) * 1000000L;
+
+	return ts;
+}
+
+/*
+ * Synthetic trace steps, fed the way the framework feeds weston's touch
+ * grab: every down, motion or up is followed by a frame.
+ */
+static void
+down(struct ias_gesture_recognizer *rec, int t, int id, double x, double y)
+{
+	struct timespec ts = ms(t);
+
+	ias_gesture_touch_down(rec, &ts, id, x, y);
+	ias_gesture_touch_frame(rec);
+}
+
+static void
+move(struct ias_gesture_recognizer *rec, int t, int id, double x, double y)
+{
+	struct timespec ts = ms(t);
+
+	ias_gesture_touch_motion(rec, &ts, id, x, y);
+	ias_gesture_touch_frame(rec);
+}
+
+static void
+move2(struct ias_gesture_recognizer *rec, int t,
+		double x0, double y0, double x1, double y1)
+{
+	struct timespec ts = ms(t);
+
+	ias_gesture_touch_motion(rec, &ts, 0, x0, y0);
+	ias_gesture_touch_motion(rec, &ts, 1, x1, y1);
+	ias_gesture_touch_frame(rec);
+}
+
+static void
+up(struct ias_gesture_recognizer *rec, int t, int id)
+{
+	struct timespec ts = ms(t);
+
+	ias_gesture_touch_up(rec, &ts, id);
+	ias_gesture_touch_frame(rec);
+}
+
+static const struct ias_gesture_event *
+logged(int i, enum ias_gesture_type type, enum ias_gesture_phase phase)
+{
+	const struct ias_gesture_event *ev;
+
+	assert(i < rec_log.count);
+	ev = &rec_log.events[i];
+	assert(ev->type == type);
+	assert(ev->phase == phase);
+
+	return ev;
+}
+
+static int
+near(double a, double b)
+{
+	return fabs(a - b) < 1e-6;
+}
+
+TEST(tap_is_reported_once_at_release)
+{
+	struct ias_gesture_recognizer rec;
+	const struct ias_gesture_event *ev;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 3, 100, 200);
+	move(&rec, 40, 3, 104, 197);
+	assert(rec_log.count == 0);
+	up(&rec, 120, 3);
+
+	assert(rec_log.count == 1);
+	ev = logged(0, IAS_GESTURE_TAP, IAS_GESTURE_PHASE_END);
+	assert(ev->fingers == 1);
+	assert(near(ev->x, 100) && near(ev->y, 200));
+	assert(ev->time.tv_sec == 1000 && ev->time.tv_nsec == 120000000L);
+}
+
+TEST(two_finger_tap_reports_both_fingers)
+{
+	struct ias_gesture_recognizer rec;
+	const struct ias_gesture_event *ev;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 100, 100);
+	down(&rec, 20, 1, 200, 100);
+	up(&rec, 100, 1);
+	up(&rec, 110, 0);
+
+	assert(rec_log.count == 1);
+	ev = logged(0, IAS_GESTURE_TAP, IAS_GESTURE_PHASE_END);
+	assert(ev->fingers == 2);
+	assert(near(ev->x, 150) && near(ev->y, 100));
+}
+
+TEST(held_touch_is_not_a_tap)
+{
+	struct ias_gesture_recognizer rec;
+
+	start(&rec, IAS_GESTURE_TAP);
+
+	down(&rec, 0, 0, 100, 100);
+	up(&rec, 500, 0);
+
+	assert(rec_log.count == 0);
+}
+
+TEST(long_press_begins_on_timeout_and_ends_on_release)
+{
+	struct ias_gesture_recognizer rec;
+	struct timespec now;
+	const struct ias_gesture_event *ev;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 300, 400);
+	assert(ias_gesture_long_press_pending(&rec));
+
+	now = ms(799);
+	ias_gesture_check_timeout(&rec, &now);
+	assert(rec_log.count == 0);
+
+	now = ms(800);
+	ias_gesture_check_timeout(&rec, &now);
+	assert(rec_log.count == 1);
+	ev = logged(0, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_BEGIN);
+	assert(near(ev->x, 300) && near(ev->y, 400));
+	assert(!ias_gesture_long_press_pending(&rec));
+
+	/* Moving after the press is recognized is reported, not a failure */
+	move(&rec, 900, 0, 350, 400);
+	ev = logged(1, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_UPDATE);
+	assert(near(ev->dx, 50) && near(ev->dy, 0));
+
+	up(&rec, 1000, 0);
+	assert(rec_log.count == 3);
+	logged(2, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_END);
+}
+
+TEST(long_press_is_recognized_without_the_timer)
+{
+	struct ias_gesture_recognizer rec;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 10, 10);
+	up(&rec, 1200, 0);
+
+	assert(rec_log.count == 2);
+	logged(0, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_BEGIN);
+	logged(1, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_END);
+}
+
+TEST(movement_or_second_finger_stops_long_press)
+{
+	struct ias_gesture_recognizer rec;
+	struct timespec now;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 10, 10);
+	move(&rec, 100, 0, 60, 10);
+	assert(!ias_gesture_long_press_pending(&rec));
+	now = ms(1000);
+	ias_gesture_check_timeout(&rec, &now);
+	up(&rec, 1100, 0);
+	assert(rec_log.count == 0);
+
+	/* A finger added to a recognized long-press cancels it */
+	down(&rec, 2000, 0, 10, 10);
+	now = ms(2900);
+	ias_gesture_check_timeout(&rec, &now);
+	down(&rec, 3000, 1, 100, 10);
+	up(&rec, 3100, 1);
+	up(&rec, 3200, 0);
+
+	assert(rec_log.count == 2);
+	logged(0, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_BEGIN);
+	logged(1, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_CANCEL);
+}
+
+TEST(fast_single_finger_movement_is_a_swipe)
+{
+	struct ias_gesture_recognizer rec;
+	const struct ias_gesture_event *ev;
+	int t;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 5, 500, 300);
+	for (t = 10; t <= 200; t += 10) {
+		move(&rec, t, 5, 500 - t, 300 + t / 10);
+	}
+	assert(rec_log.count == 0);
+	up(&rec, 200, 5);
+
+	assert(rec_log.count == 1);
+	ev = logged(0, IAS_GESTURE_SWIPE, IAS_GESTURE_PHASE_END);
+	assert(ev->direction == IAS_GESTURE_DIRECTION_LEFT);
+	assert(ev->fingers == 1);
+	assert(near(ev->dx, -200) && near(ev->dy, 20));
+	assert(near(ev->velocity_x, -1.0) && near(ev->velocity_y, 0.1));
+	assert(near(ev->start_x, 500) && near(ev->x, 300));
+}
+
+TEST(slow_or_short_movement_is_not_a_swipe)
+{
+	struct ias_gesture_recognizer rec;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	/* Far enough but too slow */
+	down(&rec, 0, 0, 0, 0);
+	move(&rec, 600, 0, 0, 300);
+	up(&rec, 700, 0);
+
+	/* Quick but too short */
+	down(&rec, 1000, 0, 0, 0);
+	move(&rec, 1050, 0, 0, 60);
+	up(&rec, 1100, 0);
+
+	assert(rec_log.count == 0);
+}
+
+TEST(spreading_two_fingers_is_a_pinch)
+{
+	struct ias_gesture_recognizer rec;
+	const struct ias_gesture_event *ev;
+	int i;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 450, 300);
+	down(&rec, 10, 1, 550, 300);
+
+	/* 10% is below the threshold */
+	move2(&rec, 20, 445, 300, 555, 300);
+	assert(rec_log.count == 0);
+
+	move2(&rec, 30, 400, 300, 600, 300);
+	ev = logged(0, IAS_GESTURE_PINCH, IAS_GESTURE_PHASE_BEGIN);
+	assert(ev->fingers == 2);
+	assert(near(ev->scale, 2.0));
+	assert(near(ev->start_x, 500) && near(ev->x, 500));
+
+	move2(&rec, 40, 350, 300, 650, 300);
+	ev = logged(1, IAS_GESTURE_PINCH, IAS_GESTURE_PHASE_UPDATE);
+	assert(near(ev->scale, 3.0));
+
+	/* Nothing changed, nothing reported */
+	move2(&rec, 50, 350, 300, 650, 300);
+	assert(rec_log.count == 2);
+
+	up(&rec, 60, 1);
+	ev = logged(2, IAS_GESTURE_PINCH, IAS_GESTURE_PHASE_END);
+	assert(near(ev->scale, 3.0));
+	assert(ev->fingers == 2);
+
+	/* The rest of the sequence is ignored */
+	move(&rec, 70, 0, 0, 0);
+	up(&rec, 80, 0);
+	assert(rec_log.count == 3);
+
+	for (i = 0; i < rec_log.count; i++) {
+		assert(rec_log.events[i].type == IAS_GESTURE_PINCH);
+	}
+}
+
+TEST(moving_two_fingers_together_is_a_drag)
+{
+	struct ias_gesture_recognizer rec;
+	const struct ias_gesture_event *ev;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 100, 100);
+	down(&rec, 0, 1, 200, 100);
+	move2(&rec, 50, 100, 120, 200, 120);
+	assert(rec_log.count == 0);
+
+	move2(&rec, 100, 100, 150, 200, 150);
+	ev = logged(0, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_BEGIN);
+	assert(ev->fingers == 2);
+	assert(near(ev->dx, 0) && near(ev->dy, 50));
+	assert(near(ev->scale, 1.0));
+
+	move2(&rec, 200, 100, 250, 200, 250);
+	ev = logged(1, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_UPDATE);
+	assert(near(ev->dy, 150));
+
+	up(&rec, 200, 0);
+	ev = logged(2, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_END);
+	assert(near(ev->dy, 150));
+	assert(near(ev->velocity_y, 1.5));
+	up(&rec, 210, 1);
+	assert(rec_log.count == 3);
+}
+
+TEST(drag_continues_across_added_and_lifted_fingers)
+{
+	struct ias_gesture_recognizer rec;
+	const struct ias_gesture_event *ev;
+	struct timespec ts;
+
+	start(&rec, IAS_GESTURE_DRAG);
+
+	down(&rec, 0, 0, 0, 0);
+	down(&rec, 0, 1, 100, 0);
+	move2(&rec, 10, 50, 0, 150, 0);
+	logged(0, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_BEGIN);
+
+	/* A third finger shifts the centroid but not the translation */
+	down(&rec, 20, 2, 400, 400);
+	assert(rec_log.count == 1);
+
+	ts = ms(30);
+	ias_gesture_touch_motion(&rec, &ts, 0, 60, 0);
+	ias_gesture_touch_motion(&rec, &ts, 1, 160, 0);
+	ias_gesture_touch_motion(&rec, &ts, 2, 410, 400);
+	ias_gesture_touch_frame(&rec);
+	ev = logged(1, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_UPDATE);
+	assert(ev->fingers == 3);
+	assert(near(ev->dx, 60) && near(ev->dy, 0));
+
+	up(&rec, 40, 2);
+	assert(rec_log.count == 2);
+	move2(&rec, 50, 70, 0, 170, 0);
+	ev = logged(2, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_UPDATE);
+	assert(near(ev->dx, 70));
+}
+
+TEST(mask_limits_what_is_recognized)
+{
+	struct ias_gesture_recognizer rec;
+
+	/* Neither a two finger pan nor a tap is reported when not asked for */
+	start(&rec, IAS_GESTURE_PINCH | IAS_GESTURE_SWIPE);
+
+	down(&rec, 0, 0, 100, 100);
+	down(&rec, 0, 1, 200, 100);
+	move2(&rec, 50, 100, 200, 200, 200);
+	up(&rec, 60, 0);
+	up(&rec, 60, 1);
+
+	down(&rec, 100, 0, 100, 100);
+	up(&rec, 150, 0);
+
+	assert(rec_log.count == 0);
+
+	/* A pinch still is */
+	down(&rec, 200, 0, 100, 100);
+	down(&rec, 200, 1, 200, 100);
+	move2(&rec, 250, 120, 100, 180, 100);
+	up(&rec, 260, 0);
+	up(&rec, 260, 1);
+
+	assert(rec_log.count == 2);
+	logged(0, IAS_GESTURE_PINCH, IAS_GESTURE_PHASE_BEGIN);
+	logged(1, IAS_GESTURE_PINCH, IAS_GESTURE_PHASE_END);
+	assert(near(rec_log.events[1].scale, 0.6));
+}
+
+TEST(cancel_and_reset_abort_a_gesture)
+{
+	struct ias_gesture_recognizer rec;
+	struct timespec now;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	down(&rec, 0, 0, 0, 0);
+	down(&rec, 0, 1, 100, 0);
+	move2(&rec, 10, 0, 50, 100, 50);
+	ias_gesture_touch_cancel(&rec);
+
+	assert(rec_log.count == 2);
+	logged(0, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_BEGIN);
+	logged(1, IAS_GESTURE_DRAG, IAS_GESTURE_PHASE_CANCEL);
+
+	/* Ups for cancelled touches are ignored */
+	up(&rec, 20, 0);
+	up(&rec, 20, 1);
+	assert(rec_log.count == 2);
+
+	down(&rec, 100, 0, 0, 0);
+	now = ms(1000);
+	ias_gesture_check_timeout(&rec, &now);
+	ias_gesture_recognizer_reset(&rec, IAS_GESTURE_TAP, record, &rec_log);
+	assert(rec_log.count == 4);
+	logged(2, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_BEGIN);
+	logged(3, IAS_GESTURE_LONG_PRESS, IAS_GESTURE_PHASE_CANCEL);
+
+	down(&rec, 2000, 0, 0, 0);
+	up(&rec, 2010, 0);
+	assert(rec_log.count == 5);
+	logged(4, IAS_GESTURE_TAP, IAS_GESTURE_PHASE_END);
+}
+
+TEST(touches_beyond_capacity_are_ignored)
+{
+	struct ias_gesture_recognizer rec;
+	int i;
+
+	start(&rec, IAS_GESTURE_ALL);
+
+	for (i = 0; i < IAS_GESTURE_MAX_TOUCHES + 2; i++) {
+		down(&rec, 0, i, i * 10, 0);
+	}
+	/* A repeated down for an active id is ignored too */
+	down(&rec, 0, 0, 999, 999);
+	assert(rec.num_touches == IAS_GESTURE_MAX_TOUCHES);
+
+	for (i = IAS_GESTURE_MAX_TOUCHES + 1; i >= 0; i--) {
+		up(&rec, 100, i);
+	}
+
+	assert(rec_log.count == 1);
+	assert(logged(0, IAS_GESTURE_TAP,
+		      IAS_GESTURE_PHASE_END)->fingers == IAS_GESTURE_MAX_TOUCHES);
+}
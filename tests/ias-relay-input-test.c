@@ -0,0 +1,725 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/tcp.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+
+#include <wayland-client.h>
+
+#include "weston-test-runner.h"
+
+#include "ias-relay-input-batch.h"
+#include "ias-shell-server-protocol.h"
+#include "ias-shell-client-protocol.h"
+#include "clients/RemoteDisplay/input_batch.h"
+#include "clients/RemoteDisplay/input_ring.h"
+
+static struct ias_relay_input_event
+touch(uint32_t type, uint32_t id, uint32_t x)
+{
+	struct ias_relay_input_event ev;
+
+	memset(&ev, 0, sizeof ev);
+	ev.kind = IAS_RELAY_INPUT_EVENT_KIND_TOUCH;
+	ev.type = type;
+	ev.touch.id = id;
+	ev.touch.x = x;
+
+	return ev;
+}
+
+#define DOWN	IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_DOWN
+#define UP	IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_UP
+#define MOTION	IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_MOTION
+#define FRAME	IAS_RELAY_INPUT_TOUCH_EVENT_TYPE_FRAME
+
+TEST(coalesce_keeps_last_motion_per_point)
+{
+	struct ias_relay_input_event ev[] = {
+		touch(DOWN, 0, 0),
+		touch(MOTION, 0, 1),
+		touch(MOTION, 0, 2),
+		touch(MOTION, 1, 10),
+		touch(MOTION, 0, 3),
+		touch(FRAME, 0, 0),
+		touch(MOTION, 0, 4),
+		touch(MOTION, 0, 5),
+		touch(FRAME, 0, 0),
+	};
+	uint32_t n;
+
+	n = ias_relay_input_coalesce(ev, ARRAY_LENGTH(ev));
+
+	assert(n == 6);
+	assert(ev[0].type == DOWN);
+	assert(ev[1].type == MOTION && ev[1].touch.id == 1);
+	assert(ev[2].type == MOTION && ev[2].touch.x == 3);
+	assert(ev[3].type == FRAME);
+	assert(ev[4].type == MOTION && ev[4].touch.x == 5);
+	assert(ev[5].type == FRAME);
+}
+
+TEST(coalesce_stops_at_down_up_and_keys)
+{
+	struct ias_relay_input_event ev[] = {
+		touch(MOTION, 0, 1),
+		touch(UP, 0, 0),
+		touch(DOWN, 0, 0),
+		touch(MOTION, 0, 2),
+		touch(MOTION, 0, 3),
+		touch(FRAME, 0, 0),
+	};
+	uint32_t n;
+
+	n = ias_relay_input_coalesce(ev, ARRAY_LENGTH(ev));
+
+	assert(n == 5);
+	assert(ev[0].type == MOTION && ev[0].touch.x == 1);
+	assert(ev[1].type == UP);
+	assert(ev[2].type == DOWN);
+	assert(ev[3].type == MOTION && ev[3].touch.x == 3);
+
+	ev[0] = touch(MOTION, 0, 1);
+	memset(&ev[1], 0, sizeof ev[1]);
+	ev[1].kind = IAS_RELAY_INPUT_EVENT_KIND_KEY;
+	ev[2] = touch(MOTION, 0, 2);
+
+	n = ias_relay_input_coalesce(ev, 3);
+	assert(n == 3);
+}
+
+static void
+write_event(uint8_t *buf, size_t *len, uint32_t type, const void *event,
+		uint32_t size)
+{
+	struct remote_display_input_event_header header = { type, size };
+
+	memcpy(buf + *len, &header, sizeof header);
+	memcpy(buf + *len + sizeof header, event, size);
+	*len += sizeof header + size;
+}
+
+/* What the receiver would do with each parsed event in surface mode */
+struct receiver {
+	struct wl_array batch;
+	uint32_t parsed;
+};
+
+static void
+collect_event(void *data, uint32_t type, const void *payload, uint32_t size)
+{
+	struct receiver *r = data;
+	struct remote_display_touch_event te;
+	struct remote_display_key_event ke;
+
+	r->parsed++;
+	switch (type) {
+	case REMOTE_DISPLAY_TOUCH_EVENT:
+		assert(size == sizeof te);
+		memcpy(&te, payload, sizeof te);
+		assert(input_batch_add_touch(&r->batch, &te) == 0);
+		break;
+	case REMOTE_DISPLAY_KEY_EVENT:
+		assert(size == sizeof ke);
+		memcpy(&ke, payload, sizeof ke);
+		assert(input_batch_add_key(&r->batch, &ke) == 0);
+		break;
+	}
+}
+
+/* Wait for 'fd' to become readable, then read into the ring. */
+static ssize_t
+ring_recv_wait(struct input_ring *ring, int fd)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	assert(poll(&pfd, 1, -1) == 1);
+	return input_ring_recv(ring, fd);
+}
+
+TEST(ring_parse_handles_partial_and_corrupt_input)
+{
+	struct remote_display_touch_event te = { REMOTE_DISPLAY_TOUCH_MOTION, 2,
+		100, 200, 1234 };
+	struct remote_display_key_event ke = { REMOTE_DISPLAY_KEY_KEY, 1235,
+		30, 1 };
+	struct remote_display_input_event_header bad = {
+		REMOTE_DISPLAY_TOUCH_EVENT, INPUT_STREAM_MAX_PAYLOAD + 1 };
+	struct ias_relay_input_event *ev;
+	struct receiver r = { .parsed = 0 };
+	struct input_ring ring;
+	uint8_t buf[256];
+	size_t len = 0;
+	int fds[2];
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	input_ring_reset(&ring);
+	wl_array_init(&r.batch);
+	write_event(buf, &len, REMOTE_DISPLAY_TOUCH_EVENT, &te, sizeof te);
+	write_event(buf, &len, REMOTE_DISPLAY_KEY_EVENT, &ke, sizeof ke);
+
+	/* Nothing to read yet */
+	assert(input_ring_recv(&ring, fds[0]) == -1 && errno == EAGAIN);
+
+	/* Only the first message is complete */
+	assert(write(fds[1], buf, len - 1) == (ssize_t) len - 1);
+	assert(ring_recv_wait(&ring, fds[0]) == (ssize_t) len - 1);
+	assert(input_ring_parse(&ring, collect_event, &r) == 1);
+	assert(r.parsed == 1);
+	assert(input_ring_used(&ring) == sizeof(struct remote_display_input_event_header) +
+	       sizeof ke - 1);
+
+	assert(write(fds[1], buf + len - 1, 1) == 1);
+	assert(ring_recv_wait(&ring, fds[0]) == 1);
+	assert(input_ring_parse(&ring, collect_event, &r) == 1);
+	assert(r.parsed == 2);
+	assert(input_ring_used(&ring) == 0);
+	assert(r.batch.size == 2 * sizeof *ev);
+
+	ev = r.batch.data;
+	assert(ev[0].kind == IAS_RELAY_INPUT_EVENT_KIND_TOUCH);
+	assert(ev[0].type == MOTION);
+	assert(ev[0].time == 1234);
+	assert(ev[0].touch.id == 2);
+	assert(ev[0].touch.x == 100 && ev[0].touch.y == 200);
+	assert(ev[1].kind == IAS_RELAY_INPUT_EVENT_KIND_KEY);
+	assert(ev[1].type == IAS_RELAY_INPUT_KEY_EVENT_TYPE_KEY);
+	assert(ev[1].key.key == 30 && ev[1].key.state == 1);
+
+	assert(write(fds[1], &bad, sizeof bad) == sizeof bad);
+	assert(ring_recv_wait(&ring, fds[0]) == sizeof bad);
+	assert(input_ring_parse(&ring, collect_event, &r) == -1);
+
+	/* End of stream */
+	close(fds[1]);
+	assert(ring_recv_wait(&ring, fds[0]) == 0);
+
+	close(fds[0]);
+	wl_array_release(&r.batch);
+}
+
+#define THROUGHPUT_POINTS		2
+#define THROUGHPUT_FRAMES		20000
+#define THROUGHPUT_MOTIONS_PER_FRAME	4
+
+static void
+send_touch(uint8_t *buf, size_t *len, uint32_t type, uint32_t id,
+		uint32_t x, uint32_t time)
+{
+	struct remote_display_touch_event te = { type, id, x, x, time };
+
+	write_event(buf, len, REMOTE_DISPLAY_TOUCH_EVENT, &te, sizeof te);
+}
+
+/*
+ * Stand-in for the remote input sender: a couple of fingers moving across
+ * the screen, several motion samples per frame, one write() per frame.
+ */
+static void
+run_sender(uint16_t port)
+{
+	struct sockaddr_in addr;
+	uint8_t buf[1024];
+	size_t len;
+	uint32_t time = 0;
+	uint32_t f, m, p;
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(fd >= 0);
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = port;
+	assert(connect(fd, (struct sockaddr *) &addr, sizeof addr) == 0);
+
+	len = 0;
+	for (p = 0; p < THROUGHPUT_POINTS; p++) {
+		send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_DOWN, p, 0, time);
+	}
+	send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_FRAME, 0, 0, time);
+	assert(write(fd, buf, len) == (ssize_t) len);
+
+	for (f = 0; f < THROUGHPUT_FRAMES; f++) {
+		len = 0;
+		for (m = 0; m < THROUGHPUT_MOTIONS_PER_FRAME; m++) {
+			time++;
+			for (p = 0; p < THROUGHPUT_POINTS; p++) {
+				send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_MOTION, p,
+						f * THROUGHPUT_MOTIONS_PER_FRAME + m,
+						time);
+			}
+		}
+		send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_FRAME, 0, 0, time);
+		assert(write(fd, buf, len) == (ssize_t) len);
+	}
+
+	len = 0;
+	for (p = 0; p < THROUGHPUT_POINTS; p++) {
+		send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_UP, p, 0, time);
+	}
+	send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_FRAME, 0, 0, time);
+	assert(write(fd, buf, len) == (ssize_t) len);
+
+	close(fd);
+	exit(0);
+}
+
+/* Bytes one touch message takes on the sender's stream */
+#define TOUCH_MESSAGE_SIZE \
+	(sizeof(struct remote_display_input_event_header) + \
+	 sizeof(struct remote_display_touch_event))
+
+/*
+ * Fill the receiver's empty batch from a single recv() of 'count' touch
+ * messages, the way read_transport() does.
+ */
+static void
+receive_burst(struct receiver *r, uint32_t count)
+{
+	struct input_ring ring;
+	uint8_t *buf;
+	size_t len = 0;
+	uint32_t i;
+	int fds[2];
+
+	buf = malloc(count * TOUCH_MESSAGE_SIZE);
+	assert(buf);
+	for (i = 0; i < count; i++) {
+		send_touch(buf, &len, REMOTE_DISPLAY_TOUCH_MOTION, i % 10, i, i);
+	}
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	assert(write(fds[1], buf, len) == (ssize_t) len);
+
+	input_ring_reset(&ring);
+	assert(r->batch.size == 0);
+	r->parsed = 0;
+	assert(ring_recv_wait(&ring, fds[0]) == (ssize_t) len);
+	assert(input_ring_parse(&ring, collect_event, r) == (int) count);
+	assert(r->batch.size == count * sizeof(struct ias_relay_input_event));
+
+	close(fds[0]);
+	close(fds[1]);
+	free(buf);
+}
+
+/*
+ * Marshal the batch through libwayland-client onto a socket pair, as the
+ * receiver does, and check the requests that come out of the other end.
+ * Nothing needs to answer: binding and send_events have no replies.
+ */
+static void
+marshal_batch(struct wl_array *batch)
+{
+	const size_t record = sizeof(struct ias_relay_input_event);
+	uint32_t count = batch->size / record;
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct ias_relay_input *ias_in;
+	uint8_t *expected, *buf;
+	uint32_t *msg, id, size, requests = 0, received = 0;
+	size_t len = 0, cap, off;
+	ssize_t ret;
+	int fds[2];
+
+	expected = malloc(batch->size);
+	assert(expected);
+	memcpy(expected, batch->data, batch->size);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	display = wl_display_connect_to_fd(fds[0]);
+	assert(display);
+	registry = wl_display_get_registry(display);
+	ias_in = wl_registry_bind(registry, 1, &ias_relay_input_interface, 2);
+	id = wl_proxy_get_id((struct wl_proxy *) ias_in);
+
+	input_batch_send(ias_in, 7, batch);
+	assert(batch->size == 0);
+	assert(wl_display_flush(display) >= 0);
+	assert(wl_display_get_error(display) == 0);
+
+	cap = count * record + 4096;
+	buf = malloc(cap);
+	assert(buf);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	while ((ret = read(fds[1], buf + len, cap - len)) > 0) {
+		len += ret;
+	}
+	assert(ret < 0 && errno == EAGAIN);
+
+	for (off = 0; off < len; off += size) {
+		msg = (uint32_t *) (buf + off);
+		size = msg[1] >> 16;
+		assert(size >= 8 && size <= 4096 && off + size <= len);
+
+		if (msg[0] != id) {
+			continue;
+		}
+		assert((msg[1] & 0xffff) == IAS_RELAY_INPUT_SEND_EVENTS);
+		assert(msg[2] == 7);
+		assert(msg[3] % record == 0 && size == 16 + msg[3]);
+		assert(memcmp(&msg[4], expected + received * record,
+				msg[3]) == 0);
+		received += msg[3] / record;
+		requests++;
+	}
+
+	assert(received == count);
+	assert(requests == (count + INPUT_BATCH_MAX_RECORDS - 1) /
+			INPUT_BATCH_MAX_RECORDS);
+
+	wl_proxy_destroy((struct wl_proxy *) ias_in);
+	wl_registry_destroy(registry);
+	wl_display_disconnect(display);
+	close(fds[1]);
+	free(buf);
+	free(expected);
+}
+
+TEST(send_events_fits_message_limit)
+{
+	struct receiver r;
+
+	wl_array_init(&r.batch);
+
+	/* Right at the limit and one past it */
+	receive_burst(&r, INPUT_BATCH_MAX_RECORDS);
+	marshal_batch(&r.batch);
+	receive_burst(&r, INPUT_BATCH_MAX_RECORDS + 1);
+	marshal_batch(&r.batch);
+
+	/* Everything one 4096 byte recv() can hold */
+	receive_burst(&r, 4096 / TOUCH_MESSAGE_SIZE);
+	marshal_batch(&r.batch);
+
+	/* A whole ring, drained in one go */
+	receive_burst(&r, INPUT_RING_SIZE / TOUCH_MESSAGE_SIZE);
+	marshal_batch(&r.batch);
+
+	wl_array_release(&r.batch);
+}
+
+TEST(tcp_stream_batches_and_coalesces)
+{
+	const uint32_t sent = THROUGHPUT_POINTS * 2 + 2 +
+		THROUGHPUT_FRAMES *
+		(THROUGHPUT_POINTS * THROUGHPUT_MOTIONS_PER_FRAME + 1);
+	const uint32_t last_x = THROUGHPUT_FRAMES * THROUGHPUT_MOTIONS_PER_FRAME - 1;
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof addr;
+	struct receiver r = { .parsed = 0 };
+	struct ias_relay_input_event *ev;
+	struct timespec start, end;
+	struct input_ring ring;
+	uint32_t requests = 0, relayed = 0, last_motion[THROUGHPUT_POINTS];
+	uint32_t i, n;
+	ssize_t ret;
+	double secs;
+	int listen_fd, fd, status;
+	pid_t pid;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(listen_fd >= 0);
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(listen_fd, (struct sockaddr *) &addr, sizeof addr) == 0);
+	assert(listen(listen_fd, 1) == 0);
+	assert(getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len) == 0);
+
+	pid = fork();
+	assert(pid >= 0);
+	if (pid == 0) {
+		close(listen_fd);
+		run_sender(addr.sin_port);
+	}
+
+	fd = accept(listen_fd, NULL, NULL);
+	assert(fd >= 0);
+	close(listen_fd);
+
+	memset(last_motion, 0, sizeof last_motion);
+	input_ring_reset(&ring);
+	wl_array_init(&r.batch);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* Same loop as the RemoteDisplay receiver: one request per recv() */
+	while ((ret = ring_recv_wait(&ring, fd)) > 0) {
+		assert(input_ring_parse(&ring, collect_event, &r) >= 0);
+
+		if (r.batch.size == 0) {
+			continue;
+		}
+
+		ev = r.batch.data;
+		n = ias_relay_input_coalesce(ev,
+				r.batch.size / sizeof *ev);
+		for (i = 0; i < n; i++) {
+			if (ev[i].type == MOTION) {
+				assert(ev[i].touch.x >= last_motion[ev[i].touch.id]);
+				last_motion[ev[i].touch.id] = ev[i].touch.x;
+			}
+		}
+		relayed += n;
+		requests++;
+		r.batch.size = 0;
+	}
+	assert(ret == 0);
+	assert(input_ring_used(&ring) == 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	close(fd);
+	assert(waitpid(pid, &status, 0) == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	assert(r.parsed == sent);
+	assert(requests <= sent);
+	assert(relayed <= sent);
+	/* Every down, up and frame survives, and so does the final position */
+	assert(relayed >= THROUGHPUT_POINTS * 2 + 2 + THROUGHPUT_FRAMES);
+	for (i = 0; i < THROUGHPUT_POINTS; i++) {
+		assert(last_motion[i] == last_x);
+	}
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "%u events in %u requests (%u after coalescing), "
+		"%.0f events/s\n", sent, requests, relayed,
+		secs > 0 ? sent / secs : 0.0);
+
+	wl_array_release(&r.batch);
+}
+
+#define FUZZ_SENDERS	2
+#define FUZZ_EVENTS	3000
+
+static uint32_t
+xorshift(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+
+	return x;
+}
+
+/*
+ * The n'th message of a fuzz stream: a type and payload derived from the
+ * generator, so the receiver can work out what it should have got.
+ */
+static uint32_t
+fuzz_message(uint32_t *state, uint8_t *payload)
+{
+	uint32_t size = xorshift(state) % (INPUT_STREAM_MAX_PAYLOAD + 1);
+	uint32_t i;
+
+	for (i = 0; i < size; i++) {
+		payload[i] = xorshift(state);
+	}
+
+	return size;
+}
+
+/*
+ * Send a stream of random sized messages in random sized fragments, pausing
+ * now and then so that the receiver really does see partial messages.
+ */
+static void
+run_fuzz_sender(uint16_t port, uint32_t seed)
+{
+	struct remote_display_input_event_header header;
+	uint8_t payload[INPUT_STREAM_MAX_PAYLOAD];
+	struct sockaddr_in addr;
+	uint32_t state = seed;
+	uint32_t frag_state = seed * 7919;
+	uint8_t *stream;
+	size_t len = 0, off, n;
+	int one = 1;
+	int fd, i;
+
+	stream = malloc(FUZZ_EVENTS * (sizeof header + INPUT_STREAM_MAX_PAYLOAD));
+	assert(stream);
+	/* Types number the messages, and tell the receiver our seed. */
+	for (i = 0; i < FUZZ_EVENTS; i++) {
+		header.type = seed * FUZZ_EVENTS + i;
+		header.size = fuzz_message(&state, payload);
+		memcpy(stream + len, &header, sizeof header);
+		memcpy(stream + len + sizeof header, payload, header.size);
+		len += sizeof header + header.size;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = port;
+	assert(connect(fd, (struct sockaddr *) &addr, sizeof addr) == 0);
+
+	for (off = 0; off < len; off += n) {
+		n = 1 + xorshift(&frag_state) % 300;
+		n = MIN(n, len - off);
+		assert(write(fd, stream + off, n) == (ssize_t) n);
+		if (xorshift(&frag_state) % 16 == 0) {
+			usleep(100);
+		}
+	}
+
+	close(fd);
+	free(stream);
+	exit(0);
+}
+
+struct fuzz_receiver {
+	int fd;
+	struct input_ring ring;
+	uint32_t seed;
+	uint32_t state;
+	uint32_t received;
+	int done;
+};
+
+static void
+check_fuzz_message(void *data, uint32_t type, const void *payload,
+		uint32_t size)
+{
+	struct fuzz_receiver *fr = data;
+	uint8_t expected[INPUT_STREAM_MAX_PAYLOAD];
+
+	if (fr->received == 0) {
+		fr->state = type / FUZZ_EVENTS;
+		fr->seed = fr->state;
+	}
+
+	assert(type == fr->seed * FUZZ_EVENTS + fr->received);
+	assert(size == fuzz_message(&fr->state, expected));
+	assert(memcmp(payload, expected, size) == 0);
+	fr->received++;
+}
+
+TEST(ring_survives_fragmented_concurrent_senders)
+{
+	struct fuzz_receiver fr[FUZZ_SENDERS];
+	struct epoll_event ev, events[FUZZ_SENDERS];
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof addr;
+	pid_t pid[FUZZ_SENDERS];
+	int listen_fd, epoll_fd, done = 0;
+	int i, n, status;
+	ssize_t ret;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(listen_fd >= 0);
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(listen_fd, (struct sockaddr *) &addr, sizeof addr) == 0);
+	assert(listen(listen_fd, FUZZ_SENDERS) == 0);
+	assert(getsockname(listen_fd, (struct sockaddr *) &addr, &addr_len) == 0);
+
+	for (i = 0; i < FUZZ_SENDERS; i++) {
+		pid[i] = fork();
+		assert(pid[i] >= 0);
+		if (pid[i] == 0) {
+			close(listen_fd);
+			run_fuzz_sender(addr.sin_port, i + 1);
+		}
+	}
+
+	epoll_fd = epoll_create1(0);
+	assert(epoll_fd >= 0);
+
+	/* Accept order needn't match fork order; see check_fuzz_message(). */
+	for (i = 0; i < FUZZ_SENDERS; i++) {
+		fr[i].fd = accept(listen_fd, NULL, NULL);
+		assert(fr[i].fd >= 0);
+		input_ring_reset(&fr[i].ring);
+		fr[i].state = 0;
+		fr[i].received = 0;
+		fr[i].done = 0;
+
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN;
+		ev.data.ptr = &fr[i];
+		assert(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fr[i].fd, &ev) == 0);
+	}
+	close(listen_fd);
+
+	while (done < FUZZ_SENDERS) {
+		n = epoll_wait(epoll_fd, events, FUZZ_SENDERS, 10000);
+		assert(n > 0);
+
+		for (i = 0; i < n; i++) {
+			struct fuzz_receiver *r = events[i].data.ptr;
+
+			ret = input_ring_recv(&r->ring, r->fd);
+			if (ret < 0 && errno == EAGAIN) {
+				continue;
+			}
+			assert(ret >= 0);
+
+			if (ret == 0) {
+				assert(input_ring_used(&r->ring) == 0);
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, r->fd, NULL);
+				close(r->fd);
+				r->done = 1;
+				done++;
+				continue;
+			}
+
+			assert(input_ring_parse(&r->ring, check_fuzz_message, r) >= 0);
+		}
+	}
+
+	for (i = 0; i < FUZZ_SENDERS; i++) {
+		assert(fr[i].received == FUZZ_EVENTS);
+		assert(fr[0].seed != fr[i].seed || i == 0);
+		assert(waitpid(pid[i], &status, 0) == pid[i]);
+		assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	}
+	close(epoll_fd);
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <linux/input.h>
+
+#include "compositor.h"
+#include "input-replay.h"
+
+/*
+ * Mouse motion and a click, a key left pressed, and two multitouch contacts
+ * on a 4096x2560 touchscreen mapped onto the 1024x640 headless output, the
+ * second starting in the frame the first lifts in.
+ */
+static const char trace[] =
+	"# EVEMU 1.3\n"
+	"N: replay test device\n"
+	"A: 35 0 4095 0 0 0\n"
+	"A: 36 0 2559 0 0 0\n"
+	"E: 0.000000 0002 0000 5\n"
+	"E: 0.000000 0000 0000 0\n"
+	"E: 0.008000 0002 0000 10\n"
+	"E: 0.008000 0002 0001 -4\n"
+	"E: 0.008000 0001 0110 1\n"
+	"E: 0.008000 0000 0000 0\n"
+	"E: 0.016000 0001 0110 0\n"
+	"E: 0.016000 0001 001e 1\n"
+	"E: 0.016000 0000 0000 0\n"
+	"E: 0.024000 0003 002f 0\n"
+	"E: 0.024000 0003 0039 7\n"
+	"E: 0.024000 0003 0035 2048\n"
+	"E: 0.024000 0003 0036 1280\n"
+	"E: 0.024000 0000 0000 0\n"
+	"E: 0.032000 0003 0035 3072\n"
+	"E: 0.032000 0000 0000 0\n"
+	"E: 0.040000 0003 0039 -1\n"
+	"E: 0.040000 0003 0039 8\n"
+	"E: 0.040000 0003 0035 2048\n"
+	"E: 0.040000 0000 0000 0\n"
+	"E: 0.048000 0003 0035 3072\n"
+	"E: 0.048000 0000 0000 0\n"
+	"E: 0.056000 0003 0039 -1\n"
+	"E: 0.056000 0000 0000 0\n";
+
+/* Timestamps must not go backwards */
+static const char bad_trace[] =
+	"E: 0.008000 0002 0000 5\n"
+	"E: 0.008000 0000 0000 0\n"
+	"E: 0.004000 0002 0000 5\n"
+	"E: 0.004000 0000 0000 0\n";
+
+struct replay_test {
+	struct weston_compositor *compositor;
+	struct weston_input_replay *replay;
+	struct weston_keyboard_grab keyboard_grab;
+	struct weston_touch_grab touch_grab;
+	int keys_pressed;
+	int keys_released;
+	int touch_downs;
+	int touch_ups;
+	wl_fixed_t down_x, down_y;
+};
+
+static struct replay_test test;
+
+static void
+test_key(struct weston_keyboard_grab *grab, const struct timespec *time,
+	 uint32_t key, uint32_t state)
+{
+	assert(key == KEY_A);
+	if (state == WL_KEYBOARD_KEY_STATE_PRESSED)
+		test.keys_pressed++;
+	else
+		test.keys_released++;
+}
+
+static void
+test_modifiers(struct weston_keyboard_grab *grab, uint32_t serial,
+	       uint32_t mods_depressed, uint32_t mods_latched,
+	       uint32_t mods_locked, uint32_t group)
+{
+}
+
+static void
+test_keyboard_cancel(struct weston_keyboard_grab *grab)
+{
+}
+
+static const struct weston_keyboard_grab_interface keyboard_grab_interface = {
+	test_key,
+	test_modifiers,
+	test_keyboard_cancel,
+};
+
+static void
+test_touch_down(struct weston_touch_grab *grab, const struct timespec *time,
+		int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+	assert(touch_id == 0);
+	/* the previous contact has been lifted */
+	assert(test.touch_downs == test.touch_ups);
+	test.touch_downs++;
+	test.down_x = x;
+	test.down_y = y;
+}
+
+static void
+test_touch_up(struct weston_touch_grab *grab, const struct timespec *time,
+	      int touch_id)
+{
+	assert(touch_id == 0);
+	test.touch_ups++;
+}
+
+static void
+test_touch_motion(struct weston_touch_grab *grab, const struct timespec *time,
+		  int touch_id, wl_fixed_t x, wl_fixed_t y)
+{
+}
+
+static void
+test_touch_frame(struct weston_touch_grab *grab)
+{
+}
+
+static void
+test_touch_cancel(struct weston_touch_grab *grab)
+{
+}
+
+static const struct weston_touch_grab_interface touch_grab_interface = {
+	test_touch_down,
+	test_touch_up,
+	test_touch_motion,
+	test_touch_frame,
+	test_touch_cancel,
+};
+
+static void
+replay_done(struct weston_input_replay *replay, void *data)
+{
+	struct weston_seat *seat = weston_input_replay_get_seat(replay);
+	struct weston_pointer *pointer = weston_seat_get_pointer(seat);
+	struct weston_keyboard *keyboard = weston_seat_get_keyboard(seat);
+	struct weston_touch *touch = weston_seat_get_touch(seat);
+	struct weston_input_replay_stats stats;
+
+	weston_input_replay_get_stats(replay, &stats);
+	fprintf(stderr, "%u events, %u frames\n", stats.events, stats.frames);
+
+	/* two passes of 8 frames: 2 motions, 2 buttons, 1 key, 6 touch
+	 * events, plus releasing the key the trace leaves pressed */
+	assert(stats.frames == 16);
+	assert(stats.events == 24);
+
+	/* relative motion from the initial 100,100 */
+	assert(pointer->x == wl_fixed_from_int(130));
+	assert(pointer->y == wl_fixed_from_int(92));
+	assert(pointer->button_count == 0);
+
+	assert(test.keys_pressed == 2);
+	assert(test.keys_released == 2);
+	assert(keyboard->keys.size == 0);
+
+	assert(test.touch_downs == 4);
+	assert(test.touch_ups == 4);
+	assert(test.down_x == wl_fixed_from_int(512));
+	assert(test.down_y == wl_fixed_from_int(320));
+	assert(touch->grab_x == wl_fixed_from_int(768));
+	assert(touch->num_tp == 0);
+
+	weston_input_replay_destroy(replay);
+	wl_display_terminate(test.compositor->wl_display);
+}
+
+WL_EXPORT int
+wet_module_init(struct weston_compositor *compositor,
+		int *argc, char *argv[])
+{
+	struct weston_input_replay *bad;
+	struct weston_seat *seat;
+	FILE *fp;
+
+	test.compositor = compositor;
+
+	bad = weston_input_replay_create(compositor, "replay-test-bad");
+	assert(bad);
+	fp = fmemopen((void *)bad_trace, strlen(bad_trace), "r");
+	assert(fp);
+	assert(weston_input_replay_load(bad, fp) < 0);
+	fclose(fp);
+	weston_input_replay_destroy(bad);
+	test.replay = weston_input_replay_create(compositor, "replay-test");
+	assert(test.replay);
+
+	fp = fmemopen((void *)trace, strlen(trace), "r");
+	assert(fp);
+	assert(weston_input_replay_load(test.replay, fp) == 0);
+	fclose(fp);
+
+	seat = weston_input_replay_get_seat(test.replay);
+	assert(seat);
+
+	test.keyboard_grab.interface = &keyboard_grab_interface;
+	weston_keyboard_start_grab(weston_seat_get_keyboard(seat),
+				   &test.keyboard_grab);
+	test.touch_grab.interface = &touch_grab_interface;
+	weston_touch_start_grab(weston_seat_get_touch(seat), &test.touch_grab);
+
+	assert(weston_input_replay_start(test.replay, 0, 2,
+					 replay_done, NULL) == 0);
+
+	return 0;
+}
@@ -26,6 +26,10 @@
 #include "config.h"
 
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include "input-timestamps-helper.h"
 #include "shared/timespec-util.h"
@@ -155,3 +159,109 @@ TEST(keyboard_timestamps_stop_after_client_releases_wl_keyboard)
 
 	input_timestamps_destroy(input_ts);
 }
+
+struct keymap_info {
+	uint32_t format;
+	int fd;
+	uint32_t size;
+};
+
+static void
+keymap_handle_keymap(void *data, struct wl_keyboard *wl_keyboard,
+		     uint32_t format, int fd, uint32_t size)
+{
+	struct keymap_info *info = data;
+
+	info->format = format;
+	info->fd = fd;
+	info->size = size;
+}
+
+static void
+keymap_handle_enter(void *data, struct wl_keyboard *wl_keyboard,
+		    uint32_t serial, struct wl_surface *wl_surface,
+		    struct wl_array *keys)
+{
+}
+
+static void
+keymap_handle_leave(void *data, struct wl_keyboard *wl_keyboard,
+		    uint32_t serial, struct wl_surface *wl_surface)
+{
+}
+
+static void
+keymap_handle_key(void *data, struct wl_keyboard *wl_keyboard,
+		  uint32_t serial, uint32_t time, uint32_t key,
+		  uint32_t state)
+{
+}
+
+static void
+keymap_handle_modifiers(void *data, struct wl_keyboard *wl_keyboard,
+			uint32_t serial, uint32_t mods_depressed,
+			uint32_t mods_latched, uint32_t mods_locked,
+			uint32_t group)
+{
+}
+
+static void
+keymap_handle_repeat_info(void *data, struct wl_keyboard *wl_keyboard,
+			  int32_t rate, int32_t delay)
+{
+}
+
+static const struct wl_keyboard_listener keymap_listener = {
+	keymap_handle_keymap,
+	keymap_handle_enter,
+	keymap_handle_leave,
+	keymap_handle_key,
+	keymap_handle_modifiers,
+	keymap_handle_repeat_info,
+};
+
+static void
+get_keymap(struct client *client, struct keymap_info *info)
+{
+	struct wl_keyboard *wl_keyboard;
+
+	info->fd = -1;
+	wl_keyboard = wl_seat_get_keyboard(client->input->wl_seat);
+	wl_keyboard_add_listener(wl_keyboard, &keymap_listener, info);
+	client_roundtrip(client);
+	wl_keyboard_release(wl_keyboard);
+
+	assert(info->format == WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1);
+	assert(info->fd >= 0);
+	assert(info->size > 0);
+}
+
+TEST(keyboard_keymap_is_shared_and_read_only)
+{
+	struct client *client = create_client_with_keyboard_focus();
+	struct keymap_info a, b;
+	char *map_a, *map_b;
+
+	get_keymap(client, &a);
+	get_keymap(client, &b);
+	assert(a.size == b.size);
+
+	map_a = mmap(NULL, a.size, PROT_READ, MAP_PRIVATE, a.fd, 0);
+	map_b = mmap(NULL, b.size, PROT_READ, MAP_PRIVATE, b.fd, 0);
+	assert(map_a != MAP_FAILED && map_b != MAP_FAILED);
+	assert(strncmp(map_a, "xkb_keymap", strlen("xkb_keymap")) == 0);
+	assert(map_a[a.size - 1] == '\0');
+	assert(memcmp(map_a, map_b, a.size) == 0);
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_GET_SEALS)
+	/* A client must not be able to change the keymap the others get */
+	assert(fcntl(a.fd, F_GET_SEALS) & F_SEAL_WRITE);
+	assert(mmap(NULL, a.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    a.fd, 0) == MAP_FAILED);
+#endif
+
+	munmap(map_a, a.size);
+	munmap(map_b, b.size);
+	close(a.fd);
+	close(b.fd);
+}
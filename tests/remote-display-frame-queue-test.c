@@ -0,0 +1,350 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/frame_queue.h"
+
+struct frame {
+	uint32_t number;
+	uint32_t pad[3];
+};
+
+struct drops {
+	uint32_t count;
+	uint32_t numbers[64];
+};
+
+static void
+record_drop(void *data, void *elem)
+{
+	struct drops *drops = data;
+	struct frame *frame = elem;
+
+	if (drops->count < 64) {
+		drops->numbers[drops->count] = frame->number;
+	}
+	drops->count++;
+}
+
+static void
+push(struct frame_queue *queue, uint32_t number, uint32_t flags)
+{
+	struct frame frame = { .number = number };
+
+	frame_queue_push(queue, &frame, flags);
+}
+
+static uint32_t
+pop(struct frame_queue *queue)
+{
+	struct frame frame;
+
+	assert(frame_queue_pop(queue, &frame, NULL) == 0);
+	return frame.number;
+}
+
+TEST(depth_is_clamped)
+{
+	struct frame_queue queue;
+
+	assert(frame_queue_init(&queue, 0, sizeof(struct frame),
+				FRAME_QUEUE_DROP_OLDEST, NULL, NULL) == 0);
+	assert(queue.depth == 1);
+	frame_queue_fini(&queue);
+
+	assert(frame_queue_init(&queue, 100, sizeof(struct frame),
+				FRAME_QUEUE_DROP_OLDEST, NULL, NULL) == 0);
+	assert(queue.depth == FRAME_QUEUE_MAX_DEPTH);
+	frame_queue_fini(&queue);
+
+	assert(frame_queue_init(&queue, 2, FRAME_QUEUE_MAX_ELEM + 1,
+				FRAME_QUEUE_DROP_OLDEST, NULL, NULL) == -1);
+}
+
+TEST(fifo_order_without_drops)
+{
+	struct frame_queue queue;
+	struct drops drops = { 0 };
+	struct frame frame;
+	uint32_t i;
+
+	frame_queue_init(&queue, 3, sizeof(frame), FRAME_QUEUE_DROP_OLDEST,
+			record_drop, &drops);
+
+	for (i = 0; i < 10; i++) {
+		push(&queue, i, 0);
+		push(&queue, i + 100, 0);
+		assert(frame_queue_occupancy(&queue) == 2);
+		assert(pop(&queue) == i);
+		assert(pop(&queue) == i + 100);
+	}
+
+	assert(frame_queue_pop(&queue, &frame, NULL) == -1);
+	assert(drops.count == 0);
+	frame_queue_fini(&queue);
+}
+
+TEST(drop_oldest_keeps_latest)
+{
+	struct frame_queue queue;
+	struct drops drops = { 0 };
+	uint32_t i;
+
+	frame_queue_init(&queue, 2, sizeof(struct frame),
+			FRAME_QUEUE_DROP_OLDEST, record_drop, &drops);
+
+	for (i = 0; i < 5; i++) {
+		push(&queue, i, 0);
+	}
+
+	assert(drops.count == 3);
+	assert(drops.numbers[0] == 0);
+	assert(drops.numbers[1] == 1);
+	assert(drops.numbers[2] == 2);
+	assert(pop(&queue) == 3);
+	assert(pop(&queue) == 4);
+	frame_queue_fini(&queue);
+}
+
+TEST(depth_one_behaves_like_a_single_slot)
+{
+	struct frame_queue queue;
+	struct drops drops = { 0 };
+
+	frame_queue_init(&queue, 1, sizeof(struct frame),
+			FRAME_QUEUE_DROP_OLDEST, record_drop, &drops);
+
+	push(&queue, 1, 0);
+	push(&queue, 2, 0);
+	assert(drops.count == 1 && drops.numbers[0] == 1);
+	assert(pop(&queue) == 2);
+	push(&queue, 3, 0);
+	assert(pop(&queue) == 3);
+	frame_queue_fini(&queue);
+}
+
+TEST(drop_newest_keeps_queued)
+{
+	struct frame_queue queue;
+	struct drops drops = { 0 };
+	uint32_t i;
+
+	frame_queue_init(&queue, 2, sizeof(struct frame),
+			FRAME_QUEUE_DROP_NEWEST, record_drop, &drops);
+
+	for (i = 0; i < 5; i++) {
+		push(&queue, i, FRAME_QUEUE_IDR);
+	}
+
+	assert(drops.count == 3);
+	assert(drops.numbers[0] == 2);
+	assert(drops.numbers[2] == 4);
+	assert(pop(&queue) == 0);
+	assert(pop(&queue) == 1);
+	frame_queue_fini(&queue);
+}
+
+TEST(keep_idr_only_drops_for_idr)
+{
+	struct frame_queue queue;
+	struct drops drops = { 0 };
+	uint32_t flags;
+	struct frame frame;
+
+	frame_queue_init(&queue, 2, sizeof(struct frame),
+			FRAME_QUEUE_KEEP_IDR, record_drop, &drops);
+
+	push(&queue, 0, FRAME_QUEUE_IDR);
+	push(&queue, 1, 0);
+
+	/* A predicted frame can't push out what's queued */
+	push(&queue, 2, 0);
+	assert(drops.count == 1 && drops.numbers[0] == 2);
+
+	/* An IDR frame replaces the oldest */
+	push(&queue, 3, FRAME_QUEUE_IDR);
+	assert(drops.count == 2 && drops.numbers[1] == 0);
+
+	assert(frame_queue_pop(&queue, &frame, &flags) == 0);
+	assert(frame.number == 1 && flags == 0);
+	assert(frame_queue_pop(&queue, &frame, &flags) == 0);
+	assert(frame.number == 3 && flags == FRAME_QUEUE_IDR);
+	frame_queue_fini(&queue);
+}
+
+TEST(fini_drops_remaining)
+{
+	struct frame_queue queue;
+	struct drops drops = { 0 };
+
+	frame_queue_init(&queue, 4, sizeof(struct frame),
+			FRAME_QUEUE_DROP_OLDEST, record_drop, &drops);
+
+	push(&queue, 7, 0);
+	push(&queue, 8, 0);
+	frame_queue_fini(&queue);
+
+	assert(drops.count == 2);
+	assert(drops.numbers[0] == 7 && drops.numbers[1] == 8);
+}
+
+TEST(stats_count_every_frame)
+{
+	struct frame_queue queue;
+	struct frame_queue_stats stats;
+	uint32_t i;
+
+	frame_queue_init(&queue, 3, sizeof(struct frame),
+			FRAME_QUEUE_DROP_OLDEST, NULL, NULL);
+
+	for (i = 0; i < 5; i++) {
+		push(&queue, i, 0);
+	}
+	pop(&queue);
+
+	frame_queue_get_stats(&queue, &stats);
+	assert(stats.pushed == 5);
+	assert(stats.dropped == 2);
+	assert(stats.popped == 1);
+	assert(stats.occupancy_max == 3);
+	assert(stats.occupancy_total == 1 + 2 + 3 + 3 + 3);
+	assert(stats.latency_max_us >= stats.latency_total_us);
+	frame_queue_fini(&queue);
+}
+
+TEST(policy_names_round_trip)
+{
+	enum frame_queue_policy policy;
+
+	assert(frame_queue_policy_from_string("drop-oldest", &policy) == 0);
+	assert(policy == FRAME_QUEUE_DROP_OLDEST);
+	assert(frame_queue_policy_from_string("drop-newest", &policy) == 0);
+	assert(policy == FRAME_QUEUE_DROP_NEWEST);
+	assert(frame_queue_policy_from_string("keep-idr", &policy) == 0);
+	assert(policy == FRAME_QUEUE_KEEP_IDR);
+	assert(frame_queue_policy_from_string("oldest", &policy) == -1);
+
+	assert(strcmp(frame_queue_policy_name(FRAME_QUEUE_KEEP_IDR),
+		      "keep-idr") == 0);
+}
+
+#define STRESS_FRAMES 200000
+
+struct stress {
+	struct frame_queue queue;
+	struct drops drops;
+	uint32_t received;
+	int done;
+};
+
+static void *
+stress_consumer(void *data)
+{
+	struct stress *stress = data;
+	struct frame frame;
+	uint32_t last = 0;
+	int first = 1;
+
+	for (;;) {
+		if (frame_queue_wait_pop(&stress->queue, &frame, NULL) < 0) {
+			if (__atomic_load_n(&stress->done, __ATOMIC_ACQUIRE) &&
+			    frame_queue_occupancy(&stress->queue) == 0) {
+				break;
+			}
+			continue;
+		}
+
+		/* Frames may be dropped but never reordered or repeated */
+		assert(first || frame.number > last);
+		assert(frame.pad[0] == frame.number * 3);
+		first = 0;
+		last = frame.number;
+		stress->received++;
+	}
+
+	return NULL;
+}
+
+static void
+count_drop(void *data, void *elem)
+{
+	struct stress *stress = data;
+
+	stress->drops.count++;
+}
+
+static void
+run_stress(enum frame_queue_policy policy, int depth)
+{
+	struct stress stress;
+	struct frame frame;
+	pthread_t thread;
+	uint32_t i;
+
+	memset(&stress, 0, sizeof(stress));
+	frame_queue_init(&stress.queue, depth, sizeof(frame), policy,
+			count_drop, &stress);
+	assert(pthread_create(&thread, NULL, stress_consumer, &stress) == 0);
+
+	for (i = 0; i < STRESS_FRAMES; i++) {
+		memset(&frame, 0, sizeof(frame));
+		frame.number = i;
+		frame.pad[0] = i * 3;
+		frame_queue_push(&stress.queue, &frame,
+				(i % 4) ? 0 : FRAME_QUEUE_IDR);
+	}
+
+	__atomic_store_n(&stress.done, 1, __ATOMIC_RELEASE);
+	frame_queue_wake(&stress.queue);
+	pthread_join(thread, NULL);
+
+	/* Every frame was either delivered or dropped exactly once */
+	assert(stress.received + stress.drops.count == STRESS_FRAMES);
+	frame_queue_fini(&stress.queue);
+}
+
+TEST(stress_drop_oldest)
+{
+	run_stress(FRAME_QUEUE_DROP_OLDEST, 1);
+	run_stress(FRAME_QUEUE_DROP_OLDEST, 3);
+}
+
+TEST(stress_drop_newest)
+{
+	run_stress(FRAME_QUEUE_DROP_NEWEST, 2);
+}
+
+TEST(stress_keep_idr)
+{
+	run_stress(FRAME_QUEUE_KEEP_IDR, 4);
+}
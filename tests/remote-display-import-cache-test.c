@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/import_cache.h"
+
+struct evictions {
+	uint32_t values[64];
+	int count;
+};
+
+static void
+record_eviction(void *data, uint32_t value)
+{
+	struct evictions *ev = data;
+
+	assert(ev->count < 64);
+	ev->values[ev->count++] = value;
+}
+
+static void
+make_key(struct import_key *key, uint64_t ino)
+{
+	memset(key, 0, sizeof(*key));
+	key->dev = 1;
+	key->ino = ino;
+	key->stride = 4096;
+	key->width = 1024;
+	key->height = 768;
+}
+
+TEST(lookup_finds_inserted_buffers)
+{
+	struct evictions ev = { .count = 0 };
+	struct import_cache cache;
+	struct import_key key;
+	uint32_t value;
+	int i;
+
+	import_cache_init(&cache, record_eviction, &ev);
+
+	/* Triple buffering: three imports, then hits every frame */
+	for (i = 0; i < 3; i++) {
+		make_key(&key, 100 + i);
+		assert(!import_cache_lookup(&cache, &key, &value));
+		import_cache_insert(&cache, &key, 10 + i);
+	}
+	for (i = 0; i < 60; i++) {
+		make_key(&key, 100 + i % 3);
+		assert(import_cache_lookup(&cache, &key, &value));
+		assert(value == 10u + i % 3);
+	}
+	assert(cache.hits == 60);
+	assert(cache.misses == 3);
+	assert(ev.count == 0);
+
+	/* Same buffer with a different layout is a different import */
+	make_key(&key, 100);
+	key.stride = 8192;
+	assert(!import_cache_lookup(&cache, &key, &value));
+
+	import_cache_fini(&cache);
+	assert(ev.count == 3);
+}
+
+TEST(full_cache_evicts_least_recently_used)
+{
+	struct evictions ev = { .count = 0 };
+	struct import_cache cache;
+	struct import_key key;
+	uint32_t value;
+	int i;
+
+	import_cache_init(&cache, record_eviction, &ev);
+
+	for (i = 0; i < IMPORT_CACHE_SIZE; i++) {
+		make_key(&key, i);
+		import_cache_insert(&cache, &key, i);
+	}
+
+	/* Touch everything except buffer 2 */
+	for (i = 0; i < IMPORT_CACHE_SIZE; i++) {
+		if (i != 2) {
+			make_key(&key, i);
+			assert(import_cache_lookup(&cache, &key, &value));
+		}
+	}
+
+	make_key(&key, 1000);
+	import_cache_insert(&cache, &key, 1000);
+	assert(ev.count == 1);
+	assert(ev.values[0] == 2);
+
+	make_key(&key, 2);
+	assert(!import_cache_lookup(&cache, &key, &value));
+	make_key(&key, 1000);
+	assert(import_cache_lookup(&cache, &key, &value));
+	assert(value == 1000);
+
+	import_cache_fini(&cache);
+	assert(ev.count == IMPORT_CACHE_SIZE + 1);
+
+	/* Nothing left after fini */
+	import_cache_fini(&cache);
+	assert(ev.count == IMPORT_CACHE_SIZE + 1);
+}
+
+TEST(key_follows_file_not_descriptor)
+{
+	struct import_key a, b, c;
+	FILE *f1, *f2;
+	int fd;
+
+	f1 = tmpfile();
+	f2 = tmpfile();
+	assert(f1 && f2);
+
+	/* Every fd for one file has the same identity, as every prime fd
+	 * exported from one buffer does */
+	fd = dup(fileno(f1));
+	assert(import_key_from_fd(&a, fileno(f1), 256, 0, 64, 64) == 0);
+	assert(import_key_from_fd(&b, fd, 256, 0, 64, 64) == 0);
+	assert(a.dev == b.dev && a.ino == b.ino);
+
+	assert(import_key_from_fd(&c, fileno(f2), 256, 0, 64, 64) == 0);
+	assert(a.ino != c.ino || a.dev != c.dev);
+
+	assert(import_key_from_fd(&c, -1, 256, 0, 64, 64) < 0);
+
+	close(fd);
+	fclose(f1);
+	fclose(f2);
+}
@@ -0,0 +1,707 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/rate_control.h"
+#include "clients/RemoteDisplay/rtcp_report.h"
+
+#define FRAME_US	16667
+#define SSRC		0x4120db95
+
+static void
+make_controller(struct rate_controller *rc)
+{
+	struct rate_control_config config;
+
+	assert(rate_control_config_init(&config, 2000, 200, 4000, 10, 60) == 0);
+	rate_control_init(rc, &config);
+	assert(rc->target_bps == 2000000);
+	assert(rc->target_fps == 60);
+}
+
+static struct rate_feedback
+receiver_feedback(uint8_t fraction_lost, uint32_t jitter_us)
+{
+	struct rate_feedback feedback;
+
+	memset(&feedback, 0, sizeof(feedback));
+	feedback.flags = RATE_FEEDBACK_RECEIVER;
+	feedback.fraction_lost = fraction_lost;
+	feedback.jitter_us = jitter_us;
+
+	return feedback;
+}
+
+TEST(config_defaults_and_limits)
+{
+	struct rate_control_config config;
+
+	assert(rate_control_config_init(&config, 0, 0, 0, 0, 60) == 0);
+	assert(config.min_bps < config.start_bps);
+	assert(config.start_bps < config.max_bps);
+	assert(config.min_fps > 0 && config.min_fps < 60);
+	assert(config.max_fps == 60);
+
+	/* A start above the default ceiling raises the ceiling */
+	assert(rate_control_config_init(&config, 50000, 0, 0, 0, 30) == 0);
+	assert(config.max_bps == 50000000);
+
+	assert(rate_control_config_init(&config, 1000, 2000, 0, 0, 60) != 0);
+	assert(rate_control_config_init(&config, 5000, 0, 4000, 0, 60) != 0);
+	assert(rate_control_config_init(&config, 0, 0, 0, 30, 20) != 0);
+}
+
+TEST(clear_link_probes_upwards)
+{
+	struct rate_controller rc;
+	struct rate_feedback feedback = receiver_feedback(0, 1000);
+	uint64_t now = 1;
+	uint32_t last;
+	int i;
+
+	make_controller(&rc);
+
+	/* About 8% a second, and never past the ceiling */
+	for (i = 0; i < 60; i++) {
+		rate_control_update(&rc, &feedback, now += FRAME_US);
+	}
+	assert(rc.target_bps > 2100000 && rc.target_bps < 2300000);
+
+	last = rc.target_bps;
+	for (i = 0; i < 60 * 30; i++) {
+		rate_control_update(&rc, &feedback, now += FRAME_US);
+		assert(rc.target_bps >= last);
+		last = rc.target_bps;
+	}
+	assert(rc.target_bps == 4000000);
+	assert(rc.target_fps == 60);
+}
+
+TEST(loss_backs_off_and_holds)
+{
+	struct rate_controller rc;
+	struct rate_feedback lossy = receiver_feedback(64, 1000);
+	struct rate_feedback middling = receiver_feedback(15, 1000);
+	struct rate_feedback clear = receiver_feedback(0, 1000);
+	uint64_t now = 1;
+	uint32_t backed_off;
+
+	make_controller(&rc);
+
+	/* 25% loss cuts by an eighth */
+	assert(rate_control_update(&rc, &lossy, now += FRAME_US));
+	assert(rc.target_bps == 1750000);
+	backed_off = rc.target_bps;
+
+	/* Some loss, but not much: stay put */
+	assert(!rate_control_update(&rc, &middling, now += FRAME_US));
+
+	/* No increase for a second after backing off... */
+	while (now < FRAME_US + 900000) {
+		rate_control_update(&rc, &clear, now += FRAME_US);
+	}
+	assert(rc.target_bps == backed_off);
+
+	/* ...and then it starts to grow again */
+	now += 200000;
+	rate_control_update(&rc, &clear, now);
+	rate_control_update(&rc, &clear, now += FRAME_US);
+	assert(rc.target_bps > backed_off);
+}
+
+TEST(send_queue_and_errors_count_as_congestion)
+{
+	struct rate_controller rc;
+	struct rate_feedback feedback;
+	uint64_t now = 1;
+
+	make_controller(&rc);
+	memset(&feedback, 0, sizeof(feedback));
+
+	/* Less than 100ms of data queued is fine */
+	feedback.flags = RATE_FEEDBACK_QUEUE;
+	feedback.queue_bytes = 2000000 / 8 / 20;
+	rate_control_update(&rc, &feedback, now += FRAME_US);
+	assert(rc.target_bps >= 2000000);
+
+	feedback.queue_bytes = 2000000 / 8 / 5;
+	assert(rate_control_update(&rc, &feedback, now += FRAME_US));
+	assert(rc.target_bps == 1700000);
+
+	/* Half of the sends since the last report failing is 50% loss */
+	make_controller(&rc);
+	feedback.flags = RATE_FEEDBACK_ERRORS;
+	feedback.packets_sent = 100;
+	feedback.send_errors = 0;
+	rate_control_update(&rc, &feedback, now += FRAME_US);
+	assert(rc.target_bps >= 2000000);
+
+	feedback.packets_sent = 200;
+	feedback.send_errors = 50;
+	rate_control_update(&rc, &feedback, now += FRAME_US);
+	assert(rc.target_bps == 1500000);
+
+	/* Jitter past 30ms too */
+	make_controller(&rc);
+	feedback = receiver_feedback(0, 50000);
+	rate_control_update(&rc, &feedback, now += FRAME_US);
+	assert(rc.target_bps == 1700000);
+}
+
+TEST(one_cut_per_hold)
+{
+	struct rate_controller rc;
+	struct rate_feedback lossy = receiver_feedback(64, 1000);
+	struct rate_feedback worse = receiver_feedback(128, 1000);
+	struct rate_feedback queued;
+	uint64_t now = 1;
+	int i;
+
+	make_controller(&rc);
+	memset(&queued, 0, sizeof(queued));
+	queued.flags = RATE_FEEDBACK_QUEUE;
+	queued.queue_bytes = 2000000 / 8 / 5;
+
+	assert(rate_control_update(&rc, &lossy, now += FRAME_US));
+	assert(rc.target_bps == 1750000);
+
+	/* The same loss and a backed up queue until the cut can have shown:
+	 * no more cuts */
+	for (i = 0; i < 50; i++) {
+		assert(!rate_control_update(&rc, &lossy, now += FRAME_US));
+		assert(!rate_control_update(&rc, &queued, now += 1));
+	}
+	assert(rc.target_bps == 1750000);
+
+	/* A receiver report of worse loss cuts again straight away... */
+	assert(rate_control_update(&rc, &worse, now += FRAME_US));
+	assert(rc.target_bps == 1312500);
+	assert(!rate_control_update(&rc, &worse, now += FRAME_US));
+
+	/* ...and once the hold is over, loss that persists cuts once more */
+	now += 1000000;
+	assert(rate_control_update(&rc, &lossy, now));
+	assert(rc.target_bps == 1148437);
+	assert(!rate_control_update(&rc, &lossy, now += FRAME_US));
+}
+
+TEST(frame_rate_drops_only_at_the_floor)
+{
+	struct rate_controller rc;
+	struct rate_feedback lossy = receiver_feedback(128, 1000);
+	struct rate_feedback clear = receiver_feedback(0, 1000);
+	uint64_t now = 1;
+	int i;
+
+	make_controller(&rc);
+
+	while (rc.target_bps > 200000) {
+		rate_control_update(&rc, &lossy, now += FRAME_US);
+		assert(rc.target_fps == 60);
+	}
+
+	/* One cut a second, so give it a few */
+	for (i = 0; i < 60 * 10; i++) {
+		rate_control_update(&rc, &lossy, now += FRAME_US);
+	}
+	assert(rc.target_bps == 200000);
+	assert(rc.target_fps == 10);
+
+	/* The frame rate comes back before the bitrate moves */
+	now += 1000000;
+	while (rc.target_fps < 60) {
+		rate_control_update(&rc, &clear, now += FRAME_US);
+		assert(rc.target_bps == 200000);
+	}
+	for (i = 0; i < 60; i++) {
+		rate_control_update(&rc, &clear, now += FRAME_US);
+	}
+	assert(rc.target_bps > 200000);
+}
+
+TEST(receiver_report_round_trip)
+{
+	struct rtcp_receiver_stats stats;
+	struct rtcp_report_block block, parsed;
+	uint8_t packet[RTCP_RR_SIZE + 8];
+	uint16_t seq;
+	int i;
+
+	rtcp_receiver_init(&stats);
+
+	/* 100 packets with every fourth lost, crossing the sequence number
+	 * wrap, arriving with alternating 0 and 180 ticks of extra delay */
+	seq = 65500;
+	for (i = 0; i < 100; i++, seq++) {
+		if (i % 4 == 3) {
+			continue;
+		}
+		rtcp_receiver_packet(&stats, seq, i * 1500,
+				i * 1500 + 1000 + (i & 1) * 180);
+	}
+
+	rtcp_receiver_report(&stats, SSRC, &block);
+	assert(block.ssrc == SSRC);
+	/* 99 expected up to the last one received, 24 of them lost */
+	assert(block.cumulative_lost == 24);
+	assert(block.fraction_lost == 24 * 256 / 99);
+	assert(block.highest_seq == 65536 + (uint16_t) (65500 + 98));
+	assert(block.jitter > 60 && block.jitter < 180);
+
+	/* Nothing new: nothing lost in this interval */
+	rtcp_receiver_report(&stats, SSRC, &block);
+	assert(block.fraction_lost == 0);
+	assert(block.cumulative_lost == 24);
+
+	/* Found after another packet in a compound packet, and not for
+	 * another source */
+	memset(packet, 0, sizeof(packet));
+	packet[0] = 0x80;
+	packet[1] = 202;
+	packet[3] = 1;
+	assert(rtcp_build_rr(packet + 8, 0x1234, &block) == RTCP_RR_SIZE);
+	assert(rtcp_parse_report(packet, sizeof(packet), SSRC, &parsed));
+	assert(parsed.ssrc == block.ssrc);
+	assert(parsed.fraction_lost == block.fraction_lost);
+	assert(parsed.cumulative_lost == block.cumulative_lost);
+	assert(parsed.highest_seq == block.highest_seq);
+	assert(parsed.jitter == block.jitter);
+	assert(!rtcp_parse_report(packet, sizeof(packet), SSRC + 1, &parsed));
+	assert(!rtcp_parse_report(packet, sizeof(packet) - 4, SSRC, &parsed));
+
+	/* Negative cumulative loss from duplicates survives */
+	block.cumulative_lost = -3;
+	rtcp_build_rr(packet, 0x1234, &block);
+	assert(rtcp_parse_report(packet, RTCP_RR_SIZE, SSRC, &parsed));
+	assert(parsed.cumulative_lost == -3);
+}
+
+/*
+ * Lossy link stand-in: a UDP proxy between the sender and the receiver that
+ * drops a share of the packets and delays the rest. After each batch of
+ * frames the sender sends a marker that the proxy never drops, and the
+ * receiver answers it with an RTCP receiver report sent straight back.
+ *
+ * So that the results don't depend on how busy the machine is, RTP
+ * timestamps count display refreshes rather than wall clock time, and the
+ * proxy stamps each packet with the time it would have arrived, which the
+ * receiver uses in place of its own clock.
+ */
+
+#define BATCH_FRAMES	10
+#define PACKET_SIZE	1400
+#define HEADER_SIZE	20
+#define MAX_HELD	256
+#define PT_VIDEO	96
+#define PT_MARKER	127
+#define TICKS_PER_FRAME	(RTCP_CLOCK_RATE / 60)
+
+struct held_packet {
+	uint64_t due_us;
+	size_t size;
+	uint8_t data[PACKET_SIZE];
+};
+
+struct lossy_link {
+	int in_fd, out_fd;
+	struct sockaddr_in receiver;
+
+	/* Drop drop_percent of the packets, and delay the rest by
+	 * delay_us plus up to jitter_us */
+	int drop_percent;
+	uint32_t delay_us;
+	uint32_t jitter_us;
+	uint32_t random;
+
+	struct held_packet held[MAX_HELD];
+	int head, count;
+	uint32_t dropped, forwarded;
+
+	int stop;
+};
+
+struct receiver {
+	int fd;
+	struct sockaddr_in sender;
+	struct rtcp_receiver_stats stats;
+	int stop;
+};
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static uint32_t
+next_random(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 16;
+}
+
+static void
+put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static uint32_t
+get_be32(const uint8_t *p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+			(uint32_t) p[2] << 8 | p[3];
+}
+
+static int
+bind_socket(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(fd >= 0);
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(fd, (struct sockaddr *) addr, sizeof(*addr)) == 0);
+	assert(getsockname(fd, (struct sockaddr *) addr, &len) == 0);
+
+	return fd;
+}
+
+static void *
+link_thread(void *data)
+{
+	struct lossy_link *link = data;
+	struct held_packet *packet;
+	struct pollfd pfd;
+	uint64_t now, due, last_due = 0;
+	uint32_t delay;
+	int timeout;
+	ssize_t n;
+
+	pfd.fd = link->in_fd;
+	pfd.events = POLLIN;
+
+	while (!__atomic_load_n(&link->stop, __ATOMIC_ACQUIRE)) {
+		now = now_us();
+		while (link->count && link->held[link->head].due_us <= now) {
+			packet = &link->held[link->head];
+			sendto(link->out_fd, packet->data, packet->size, 0,
+				(struct sockaddr *) &link->receiver,
+				sizeof(link->receiver));
+			link->forwarded++;
+			link->head = (link->head + 1) % MAX_HELD;
+			link->count--;
+		}
+
+		timeout = 10;
+		if (link->count) {
+			timeout = (link->held[link->head].due_us - now) / 1000;
+		}
+		if (poll(&pfd, 1, timeout) <= 0) {
+			continue;
+		}
+
+		packet = &link->held[(link->head + link->count) % MAX_HELD];
+		n = recv(link->in_fd, packet->data, sizeof(packet->data), 0);
+		if (n < HEADER_SIZE) {
+			continue;
+		}
+
+		if ((packet->data[1] & 0x7f) != PT_MARKER &&
+		    (int) (next_random(&link->random) % 100) <
+		    __atomic_load_n(&link->drop_percent, __ATOMIC_RELAXED)) {
+			link->dropped++;
+			continue;
+		}
+
+		/* When the packet would have arrived: its timestamp, which
+		 * is when it was sent, plus the delay */
+		delay = link->delay_us;
+		if (link->jitter_us) {
+			delay += next_random(&link->random) % link->jitter_us;
+		}
+		put_be32(packet->data + 16, get_be32(packet->data + 4) +
+				(uint64_t) delay * RTCP_CLOCK_RATE / 1000000);
+
+		/* Keep packets in order, as a single link would */
+		due = now_us() + link->delay_us;
+		if (due < last_due) {
+			due = last_due;
+		}
+		last_due = due;
+
+		assert(link->count < MAX_HELD);
+		packet->size = n;
+		packet->due_us = due;
+		link->count++;
+	}
+
+	return NULL;
+}
+
+static void *
+receiver_thread(void *data)
+{
+	struct receiver *rx = data;
+	struct rtcp_report_block block;
+	uint8_t packet[PACKET_SIZE];
+	uint8_t report[RTCP_RR_SIZE];
+	struct pollfd pfd;
+	ssize_t n;
+
+	pfd.fd = rx->fd;
+	pfd.events = POLLIN;
+
+	while (!__atomic_load_n(&rx->stop, __ATOMIC_ACQUIRE)) {
+		if (poll(&pfd, 1, 10) <= 0) {
+			continue;
+		}
+		n = recv(rx->fd, packet, sizeof(packet), 0);
+		if (n < HEADER_SIZE) {
+			continue;
+		}
+
+		if ((packet[1] & 0x7f) == PT_MARKER) {
+			rtcp_receiver_report(&rx->stats, SSRC, &block);
+			rtcp_build_rr(report, 0x5678, &block);
+			sendto(rx->fd, report, sizeof(report), 0,
+				(struct sockaddr *) &rx->sender,
+				sizeof(rx->sender));
+			continue;
+		}
+
+		rtcp_receiver_packet(&rx->stats, packet[2] << 8 | packet[3],
+				get_be32(packet + 4), get_be32(packet + 16));
+	}
+
+	return NULL;
+}
+
+struct sender {
+	int fd, rtcp_fd;
+	struct sockaddr_in link;
+	struct rate_controller rc;
+	uint16_t seq;
+	uint32_t frame;
+	int credit;
+	uint32_t reports;
+	uint32_t lost_total;
+	uint32_t max_jitter_us;
+};
+
+static void
+send_packet(struct sender *tx, int payload_type, int marker, size_t size)
+{
+	uint8_t packet[PACKET_SIZE];
+
+	memset(packet, 0, sizeof(packet));
+	packet[0] = 0x80;
+	packet[1] = payload_type | (marker ? 0x80 : 0);
+	packet[2] = tx->seq >> 8;
+	packet[3] = tx->seq;
+	put_be32(packet + 4, tx->frame * TICKS_PER_FRAME);
+	put_be32(packet + 8, SSRC);
+	put_be32(packet + 12, tx->frame);
+
+	assert(sendto(tx->fd, packet, size, 0, (struct sockaddr *) &tx->link,
+			sizeof(tx->link)) == (ssize_t) size);
+}
+
+static void
+send_frame(struct sender *tx)
+{
+	int32_t left;
+
+	left = tx->rc.target_bps / tx->rc.target_fps / 8;
+	for (; left > 0; left -= PACKET_SIZE - HEADER_SIZE) {
+		send_packet(tx, PT_VIDEO, left <= PACKET_SIZE - HEADER_SIZE,
+				PACKET_SIZE);
+		tx->seq++;
+	}
+}
+
+/* Wait for the report on the batch just sent, and give it to the
+ * controller */
+static void
+take_report(struct sender *tx)
+{
+	struct rtcp_report_block block;
+	struct rate_feedback feedback;
+	uint8_t report[256];
+	struct pollfd pfd;
+	ssize_t n;
+
+	send_packet(tx, PT_MARKER, 0, HEADER_SIZE);
+
+	pfd.fd = tx->rtcp_fd;
+	pfd.events = POLLIN;
+	assert(poll(&pfd, 1, 5000) == 1);
+	n = recv(tx->rtcp_fd, report, sizeof(report), 0);
+	assert(n > 0);
+	assert(rtcp_parse_report(report, n, SSRC, &block));
+
+	memset(&feedback, 0, sizeof(feedback));
+	feedback.flags = RATE_FEEDBACK_RECEIVER;
+	feedback.fraction_lost = block.fraction_lost;
+	feedback.jitter_us = (uint64_t) block.jitter * 1000000 /
+			RTCP_CLOCK_RATE;
+	rate_control_update(&tx->rc, &feedback,
+			(uint64_t) tx->frame * FRAME_US);
+
+	tx->reports++;
+	tx->lost_total += block.fraction_lost;
+	if (feedback.jitter_us > tx->max_jitter_us) {
+		tx->max_jitter_us = feedback.jitter_us;
+	}
+}
+
+/* Run 'ticks' display refreshes, sending the frames the controller's frame
+ * rate allows and taking a receiver report after each batch. Controller
+ * time runs at the display rate rather than the wall clock. */
+static void
+run_sender(struct sender *tx, int ticks)
+{
+	int i;
+
+	for (i = 0; i < ticks; i++) {
+		tx->credit += tx->rc.target_fps;
+		if (tx->credit >= 60) {
+			tx->credit -= 60;
+			send_frame(tx);
+		}
+
+		tx->frame++;
+		if (tx->frame % BATCH_FRAMES == 0) {
+			take_report(tx);
+		}
+	}
+}
+
+TEST(lossy_link_end_to_end)
+{
+	struct lossy_link *link;
+	struct receiver rx;
+	struct sender tx;
+	struct sockaddr_in addr;
+	struct rate_control_config config;
+	pthread_t link_tid, rx_tid;
+	uint32_t floor_bps;
+	int floor_fps;
+
+	link = calloc(1, sizeof(*link));
+	assert(link);
+	memset(&rx, 0, sizeof(rx));
+	memset(&tx, 0, sizeof(tx));
+
+	link->in_fd = bind_socket(&tx.link);
+	link->out_fd = bind_socket(&addr);
+	rx.fd = bind_socket(&link->receiver);
+	tx.fd = bind_socket(&addr);
+	tx.rtcp_fd = bind_socket(&rx.sender);
+	link->delay_us = 2000;
+	link->jitter_us = 4000;
+	link->random = 1;
+	rtcp_receiver_init(&rx.stats);
+
+	assert(rate_control_config_init(&config, 1000, 100, 2000, 10, 60) == 0);
+	rate_control_init(&tx.rc, &config);
+
+	assert(pthread_create(&link_tid, NULL, link_thread, link) == 0);
+	assert(pthread_create(&rx_tid, NULL, receiver_thread, &rx) == 0);
+
+	/* A clear link: probe upwards */
+	run_sender(&tx, 300);
+	printf("clear: %u bps, %d fps after %u reports, jitter up to %u us\n",
+		tx.rc.target_bps, tx.rc.target_fps, tx.reports,
+		tx.max_jitter_us);
+	assert(tx.reports == 30);
+	assert(tx.lost_total == 0);
+	assert(tx.max_jitter_us > 0 && tx.max_jitter_us < 4000);
+	assert(tx.rc.target_bps > 1000000);
+	assert(tx.rc.target_fps == 60);
+
+	/* A quarter of the packets lost: down to the bitrate floor, and
+	 * then fewer frames */
+	__atomic_store_n(&link->drop_percent, 25, __ATOMIC_RELAXED);
+	tx.reports = 0;
+	tx.lost_total = 0;
+	run_sender(&tx, 600);
+	printf("lossy: %u bps, %d fps, average loss %u/256\n",
+		tx.rc.target_bps, tx.rc.target_fps,
+		tx.lost_total / tx.reports);
+	assert(tx.lost_total / tx.reports > 30);
+	assert(tx.lost_total / tx.reports < 100);
+	assert(tx.rc.target_bps == 100000);
+	assert(tx.rc.target_fps < 30);
+	floor_bps = tx.rc.target_bps;
+	floor_fps = tx.rc.target_fps;
+
+	/* Clear again: the frame rate recovers, then the bitrate */
+	__atomic_store_n(&link->drop_percent, 0, __ATOMIC_RELAXED);
+	run_sender(&tx, 600);
+	printf("recovered: %u bps, %d fps\n",
+		tx.rc.target_bps, tx.rc.target_fps);
+	assert(tx.rc.target_fps == 60 && floor_fps < 60);
+	assert(tx.rc.target_bps > floor_bps);
+
+	__atomic_store_n(&rx.stop, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&link->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(rx_tid, NULL);
+	pthread_join(link_tid, NULL);
+	assert(link->dropped > 0 && link->forwarded > link->dropped);
+
+	close(link->in_fd);
+	close(link->out_fd);
+	close(rx.fd);
+	close(tx.fd);
+	close(tx.rtcp_fd);
+	free(link);
+}
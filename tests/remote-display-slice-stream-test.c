@@ -0,0 +1,310 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/h264_nal.h"
+#include "clients/RemoteDisplay/latency_probe.h"
+
+struct stream {
+	uint8_t data[4096];
+	size_t size;
+};
+
+static void
+add_nal(struct stream *s, int long_start_code, uint8_t header,
+		size_t payload, uint8_t fill)
+{
+	size_t i;
+
+	if (long_start_code) {
+		s->data[s->size++] = 0;
+	}
+	s->data[s->size++] = 0;
+	s->data[s->size++] = 0;
+	s->data[s->size++] = 1;
+	s->data[s->size++] = header;
+	for (i = 0; i < payload; i++) {
+		s->data[s->size++] = fill;
+	}
+	/* Something that looks like a start code but is escaped */
+	s->data[s->size++] = 0;
+	s->data[s->size++] = 0;
+	s->data[s->size++] = 3;
+	s->data[s->size++] = 1;
+	s->data[s->size++] = 0x80;
+	assert(s->size < sizeof(s->data));
+}
+
+/* SPS, PPS, then 'slices' IDR slices, as a VA encoder writes a frame */
+static void
+make_access_unit(struct stream *s, int slices, size_t *slice_starts)
+{
+	int i;
+
+	s->size = 0;
+	add_nal(s, 1, 0x67, 10, 0x42);
+	add_nal(s, 1, 0x68, 4, 0xce);
+	for (i = 0; i < slices; i++) {
+		slice_starts[i] = s->size;
+		add_nal(s, i % 2, 0x65, 100 + i, 0x88);
+	}
+}
+
+TEST(nal_units_are_found)
+{
+	struct stream s;
+	struct h264_nal nal;
+	size_t starts[3];
+	size_t pos = 0;
+	int types[8];
+	int n = 0;
+
+	make_access_unit(&s, 3, starts);
+	while (h264_nal_next(s.data, s.size, &pos, &nal)) {
+		assert(n < 8);
+		types[n++] = nal.type;
+		assert(s.data[nal.offset] & H264_NAL_TYPE_MASK);
+		assert(s.data[nal.offset + nal.size - 1] == 0x80);
+	}
+
+	assert(n == 5);
+	assert(types[0] == 7 && types[1] == 8);
+	assert(types[2] == H264_NAL_IDR && types[4] == H264_NAL_IDR);
+}
+
+TEST(access_unit_splits_at_slices)
+{
+	struct stream s;
+	size_t starts[4];
+	int32_t ends[16];
+	int n;
+
+	make_access_unit(&s, 4, starts);
+	n = h264_split_slices(s.data, s.size, ends, 16);
+	assert(n == 4);
+
+	/* Each run ends where the next slice's start code begins; the
+	 * first one carries the SPS and PPS */
+	assert(ends[0] == (int32_t) starts[1]);
+	assert(ends[1] == (int32_t) starts[2]);
+	assert(ends[2] == (int32_t) starts[3]);
+	assert(ends[3] == (int32_t) s.size);
+
+	/* Extra slices go in the last run */
+	n = h264_split_slices(s.data, s.size, ends, 2);
+	assert(n == 2);
+	assert(ends[0] == (int32_t) starts[1]);
+	assert(ends[1] == (int32_t) s.size);
+
+	/* Parameter sets alone have no slices */
+	assert(h264_split_slices(s.data, starts[0], ends, 16) == 0);
+}
+
+TEST(probe_survives_emulation_prevention)
+{
+	static const uint64_t times[] = {
+		0, 1, 0x0000000300000001ull, 0x0001000002000003ull,
+		0xffffffffffffffffull,
+	};
+	struct latency_probe in, out;
+	uint8_t buf[LATENCY_PROBE_MAX_SIZE];
+	struct h264_nal nal;
+	size_t size, pos, i, j;
+
+	for (i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+		in.capture_us = times[i];
+		in.frame_number = i == 0 ? 0 : 0x00000100 * i;
+		size = latency_probe_write(buf, &in);
+		assert(size <= LATENCY_PROBE_MAX_SIZE);
+
+		/* No start code inside the NAL unit */
+		for (j = 4; j + 2 < size; j++) {
+			assert(!(buf[j] == 0 && buf[j + 1] == 0 &&
+				 buf[j + 2] <= 3 && buf[j + 2] != 3));
+		}
+		pos = 0;
+		assert(h264_nal_next(buf, size, &pos, &nal));
+		assert(nal.type == H264_NAL_SEI);
+		assert(nal.offset + nal.size == size);
+
+		memset(&out, 0, sizeof(out));
+		assert(latency_probe_find(buf, size, &out));
+		assert(out.capture_us == in.capture_us);
+		assert(out.frame_number == in.frame_number);
+	}
+
+	/* A stream without one */
+	pos = 0;
+	memset(buf, 0, sizeof(buf));
+	assert(!latency_probe_find(buf, sizeof(buf), &out));
+}
+
+struct sender {
+	int fd;
+	struct stream au;
+	int32_t ends[16];
+	int slices;
+	int frames;
+};
+
+static void
+write_all(int fd, const uint8_t *data, size_t size)
+{
+	ssize_t n;
+
+	while (size > 0) {
+		n = write(fd, data, size);
+		assert(n > 0);
+		data += n;
+		size -= n;
+	}
+}
+
+/* Sends each frame as the transport thread does with send_slice(): the
+ * probe, then one slice at a time */
+static void *
+sender_thread(void *data)
+{
+	struct sender *sender = data;
+	struct latency_probe probe;
+	uint8_t sei[LATENCY_PROBE_MAX_SIZE];
+	int32_t start;
+	int frame, i;
+
+	for (frame = 0; frame < sender->frames; frame++) {
+		probe.capture_us = latency_probe_now_us();
+		probe.frame_number = frame;
+		write_all(sender->fd, sei, latency_probe_write(sei, &probe));
+
+		start = 0;
+		for (i = 0; i < sender->slices; i++) {
+			write_all(sender->fd, sender->au.data + start,
+					sender->ends[i] - start);
+			start = sender->ends[i];
+		}
+	}
+
+	close(sender->fd);
+	return NULL;
+}
+
+/* Offset of the first probe SEI after the one at 'from', or 0 if none has
+ * arrived yet */
+static size_t
+next_probe(const uint8_t *data, size_t size, size_t from)
+{
+	struct h264_nal nal;
+	size_t pos = from + 4;
+
+	while (h264_nal_next(data, size, &pos, &nal)) {
+		if (nal.type == H264_NAL_SEI) {
+			return nal.start;
+		}
+	}
+
+	return 0;
+}
+
+/* Loopback stand-in for a receiver: reads the stream, and as each frame
+ * completes finds its probe and checks the slices came through intact. */
+TEST(loopback_receiver_measures_latency)
+{
+	struct sender sender;
+	struct latency_probe probe;
+	size_t starts[4];
+	pthread_t thread;
+	int fds[2];
+	uint8_t *rx;
+	size_t rx_size = 0, rx_max, frame_start = 0, end;
+	uint64_t now;
+	int32_t ends[16];
+	ssize_t n;
+	int frame = 0;
+	int eof = 0;
+
+	make_access_unit(&sender.au, 4, starts);
+	sender.slices = h264_split_slices(sender.au.data, sender.au.size,
+			sender.ends, 16);
+	assert(sender.slices == 4);
+	sender.frames = 20;
+
+	rx_max = (LATENCY_PROBE_MAX_SIZE + sender.au.size) * sender.frames;
+	rx = malloc(rx_max);
+	assert(rx);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	sender.fd = fds[0];
+	assert(pthread_create(&thread, NULL, sender_thread, &sender) == 0);
+
+	while (!eof) {
+		n = read(fds[1], rx + rx_size, rx_max - rx_size);
+		assert(n >= 0);
+		eof = n == 0;
+		rx_size += n;
+		now = latency_probe_now_us();
+
+		/* A frame is complete once the next one's probe arrives */
+		for (;;) {
+			end = next_probe(rx, rx_size, frame_start);
+			if (end == 0) {
+				if (!eof || frame_start == rx_size) {
+					break;
+				}
+				end = rx_size;
+			}
+
+			assert(latency_probe_find(rx + frame_start,
+					end - frame_start, &probe));
+			assert(probe.frame_number == (uint32_t) frame);
+			assert(now >= probe.capture_us);
+			assert(now - probe.capture_us < 10 * 1000000);
+
+			assert(end - frame_start > sender.au.size);
+			assert(memcmp(rx + end - sender.au.size,
+					sender.au.data, sender.au.size) == 0);
+			assert(h264_split_slices(rx + end - sender.au.size,
+					sender.au.size, ends, 16) == 4);
+
+			frame_start = end;
+			frame++;
+		}
+	}
+	assert(frame == sender.frames);
+
+	pthread_join(thread, NULL);
+	close(fds[1]);
+	free(rx);
+}
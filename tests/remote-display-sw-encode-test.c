@@ -0,0 +1,461 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/h264_nal.h"
+#include "clients/RemoteDisplay/sw_encode.h"
+
+struct image {
+	struct sw_nv12 nv12;
+	uint8_t *y;
+	uint8_t *uv;
+};
+
+static void
+image_init(struct image *img, int width, int height)
+{
+	int h = (height + 1) & ~1;
+
+	img->nv12.width = width;
+	img->nv12.height = height;
+	img->nv12.y_stride = (width + 1) & ~1;
+	img->nv12.uv_stride = img->nv12.y_stride;
+	img->y = calloc(img->nv12.y_stride, h);
+	img->uv = calloc(img->nv12.uv_stride, h / 2);
+	assert(img->y && img->uv);
+	img->nv12.y = img->y;
+	img->nv12.uv = img->uv;
+}
+
+static void
+image_fini(struct image *img)
+{
+	free(img->y);
+	free(img->uv);
+}
+
+static uint8_t *
+solid_bgrx(int width, int height, uint8_t r, uint8_t g, uint8_t b)
+{
+	uint8_t *px = malloc(width * height * 4);
+	int i;
+
+	assert(px);
+	for (i = 0; i < width * height; i++) {
+		px[i * 4] = b;
+		px[i * 4 + 1] = g;
+		px[i * 4 + 2] = r;
+		px[i * 4 + 3] = 0xff;
+	}
+
+	return px;
+}
+
+TEST(simd_matches_c)
+{
+	/* Odd sizes exercise the scalar tail and the unpaired last row */
+	const int width = 61, height = 37, stride = 64 * 4;
+	struct image a, b;
+	uint8_t *src = malloc(stride * height);
+	int i;
+
+	assert(src);
+	srand(42);
+	for (i = 0; i < stride * height; i++) {
+		src[i] = rand();
+	}
+
+	image_init(&a, width, height);
+	image_init(&b, width, height);
+	sw_encode_bgrx_to_nv12(src, stride, width, height, &a.nv12);
+	sw_encode_bgrx_to_nv12_c(src, stride, width, height, &b.nv12);
+
+	assert(memcmp(a.y, b.y, a.nv12.y_stride * height) == 0);
+	assert(memcmp(a.uv, b.uv, a.nv12.uv_stride * ((height + 1) / 2)) == 0);
+
+	image_fini(&a);
+	image_fini(&b);
+	free(src);
+}
+
+static void
+check_colour(uint8_t r, uint8_t g, uint8_t b,
+		uint8_t y, uint8_t u, uint8_t v)
+{
+	const int width = 32, height = 4;
+	uint8_t *src = solid_bgrx(width, height, r, g, b);
+	struct image img;
+	int i;
+
+	image_init(&img, width, height);
+	sw_encode_bgrx_to_nv12(src, width * 4, width, height, &img.nv12);
+
+	for (i = 0; i < width * height; i++) {
+		assert(img.y[i] == y);
+	}
+	for (i = 0; i < width * height / 2; i += 2) {
+		assert(img.uv[i] == u);
+		assert(img.uv[i + 1] == v);
+	}
+
+	image_fini(&img);
+	free(src);
+}
+
+TEST(bt601_limited_range)
+{
+	check_colour(0, 0, 0, 16, 128, 128);
+	check_colour(255, 255, 255, 235, 128, 128);
+	check_colour(255, 0, 0, 82, 90, 240);
+	check_colour(0, 255, 0, 144, 54, 34);
+	check_colour(0, 0, 255, 41, 240, 110);
+}
+
+TEST(pad_repeats_last_row_and_column)
+{
+	struct image img;
+	int x, y;
+
+	image_init(&img, 32, 32);
+	for (y = 0; y < 30; y++) {
+		for (x = 0; x < 26; x++) {
+			img.y[y * 32 + x] = x + y;
+		}
+	}
+	for (y = 0; y < 15; y++) {
+		for (x = 0; x < 26; x += 2) {
+			img.uv[y * 32 + x] = 100 + y;
+			img.uv[y * 32 + x + 1] = 200 + x;
+		}
+	}
+
+	sw_encode_nv12_pad(&img.nv12, 26, 30);
+
+	for (y = 0; y < 32; y++) {
+		for (x = 26; x < 32; x++) {
+			assert(img.y[y * 32 + x] == 25 + (y < 30 ? y : 29));
+		}
+	}
+	for (x = 0; x < 32; x++) {
+		assert(img.y[31 * 32 + x] == img.y[29 * 32 + x]);
+	}
+	for (y = 0; y < 16; y++) {
+		assert(img.uv[y * 32 + 30] == 100 + (y < 15 ? y : 14));
+		assert(img.uv[y * 32 + 31] == 200 + 24);
+	}
+
+	image_fini(&img);
+}
+
+/* Minimal Annex B reader, enough to walk what the writer produces */
+struct reader {
+	uint8_t *buf;
+	size_t size;
+	size_t bit;
+};
+
+static size_t
+next_nal(const uint8_t *stream, size_t size, size_t pos)
+{
+	for (; pos + 3 < size; pos++) {
+		if (stream[pos] == 0 && stream[pos + 1] == 0 &&
+		    stream[pos + 2] == 0 && stream[pos + 3] == 1) {
+			return pos;
+		}
+	}
+
+	return size;
+}
+
+/* Strip emulation prevention from stream[start, end), checking that no
+ * start code could be mistaken for one inside the payload */
+static void
+unescape(struct reader *r, const uint8_t *stream, size_t start, size_t end)
+{
+	size_t i;
+	int zeros = 0;
+
+	r->buf = malloc(end - start);
+	assert(r->buf);
+	r->size = 0;
+	r->bit = 0;
+
+	for (i = start; i < end; i++) {
+		if (zeros >= 2) {
+			assert(stream[i] >= 3);
+			if (stream[i] == 3) {
+				assert(i + 1 == end || stream[i + 1] <= 3);
+				zeros = 0;
+				continue;
+			}
+		}
+		r->buf[r->size++] = stream[i];
+		zeros = stream[i] ? 0 : zeros + 1;
+	}
+}
+
+static uint32_t
+read_bits(struct reader *r, int n)
+{
+	uint32_t val = 0;
+
+	while (n--) {
+		assert(r->bit < r->size * 8);
+		val = (val << 1) |
+			((r->buf[r->bit / 8] >> (7 - r->bit % 8)) & 1);
+		r->bit++;
+	}
+
+	return val;
+}
+
+static uint32_t
+read_ue(struct reader *r)
+{
+	int zeros = 0;
+
+	while (read_bits(r, 1) == 0) {
+		zeros++;
+	}
+
+	return (1U << zeros) - 1 + read_bits(r, zeros);
+}
+
+static void
+check_trailing(struct reader *r)
+{
+	assert(read_bits(r, 1) == 1);
+	while (r->bit % 8) {
+		assert(read_bits(r, 1) == 0);
+	}
+	assert(r->bit == r->size * 8);
+}
+
+TEST(h264_pcm_stream_parses)
+{
+	const int width = 40, height = 24;
+	struct sw_h264 h264;
+	struct image img;
+	struct reader r;
+	uint8_t *stream;
+	size_t size, sps, pps, idr;
+	int x, y, mb;
+
+	sw_encode_h264_init(&h264, width, height);
+	assert(sw_encode_h264_coded_width(&h264) == 48);
+	assert(sw_encode_h264_coded_height(&h264) == 32);
+
+	/* Plenty of zeros, to need emulation prevention */
+	image_init(&img, 48, 32);
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			img.y[y * 48 + x] = (x * 7 + y) % 5;
+		}
+	}
+	sw_encode_nv12_pad(&img.nv12, width, height);
+
+	stream = malloc(sw_encode_h264_max_size(&h264));
+	size = sw_encode_h264_frame(&h264, &img.nv12, stream);
+	assert(size <= sw_encode_h264_max_size(&h264));
+
+	sps = next_nal(stream, size, 0);
+	pps = next_nal(stream, size, sps + 4);
+	idr = next_nal(stream, size, pps + 4);
+	assert(sps == 0);
+	assert(next_nal(stream, size, idr + 4) == size);
+	assert(stream[sps + 4] == 0x67);
+	assert(stream[pps + 4] == 0x68);
+	assert(stream[idr + 4] == 0x65);
+
+	/* SPS: size in macroblocks and cropping back to 40x24 */
+	unescape(&r, stream, sps + 5, pps);
+	assert(read_bits(&r, 8) == 66);
+	read_bits(&r, 16);
+	assert(read_ue(&r) == 0);
+	assert(read_ue(&r) == 0);
+	assert(read_ue(&r) == 2);
+	assert(read_ue(&r) == 0);
+	assert(read_bits(&r, 1) == 0);
+	assert(read_ue(&r) == 2);
+	assert(read_ue(&r) == 1);
+	assert(read_bits(&r, 2) == 3);
+	assert(read_bits(&r, 1) == 1);
+	assert(read_ue(&r) == 0);
+	assert(read_ue(&r) == 4);
+	assert(read_ue(&r) == 0);
+	assert(read_ue(&r) == 4);
+	assert(read_bits(&r, 1) == 0);
+	check_trailing(&r);
+	free(r.buf);
+
+	/* Slice: header, then every macroblock as I_PCM */
+	unescape(&r, stream, idr + 5, size);
+	assert(read_ue(&r) == 0);
+	assert(read_ue(&r) == 7);
+	assert(read_ue(&r) == 0);
+	assert(read_bits(&r, 4) == 0);
+	assert(read_ue(&r) == 0);
+	assert(read_bits(&r, 2) == 0);
+	assert(read_ue(&r) == 0);
+	assert(read_ue(&r) == 1);
+	for (mb = 0; mb < 6; mb++) {
+		assert(read_ue(&r) == 25);
+		while (r.bit % 8) {
+			assert(read_bits(&r, 1) == 0);
+		}
+		for (y = 0; y < 16; y++) {
+			for (x = 0; x < 16; x++) {
+				int px = (mb % 3) * 16 + x;
+				int py = (mb / 3) * 16 + y;
+
+				assert(read_bits(&r, 8) == img.y[py * 48 + px]);
+			}
+		}
+		r.bit += 128 * 8;
+	}
+	check_trailing(&r);
+	free(r.buf);
+
+	/* The next picture gets a different idr_pic_id */
+	size = sw_encode_h264_frame(&h264, &img.nv12, stream);
+	idr = next_nal(stream, size, next_nal(stream, size, 4) + 4);
+	unescape(&r, stream, idr + 5, size);
+	read_ue(&r);
+	read_ue(&r);
+	read_ue(&r);
+	read_bits(&r, 4);
+	assert(read_ue(&r) == 1);
+	free(r.buf);
+
+	free(stream);
+	image_fini(&img);
+}
+
+/* Same payload size as the UDP transport plugin */
+#define RTP_PAYLOAD_SIZE 1388
+
+/* Reassembles what h264_packetize() sends, the way a receiver would */
+struct depacketizer {
+	uint8_t *out;
+	size_t size;
+	int packets;
+	int markers;
+	int in_fu;
+};
+
+static void
+depacketize(uint8_t *payload, size_t size, int marker, void *data)
+{
+	static const uint8_t start_code[] = { 0, 0, 0, 1 };
+	struct depacketizer *d = data;
+	uint8_t type = payload[0] & H264_NAL_TYPE_MASK;
+
+	assert(size > 0 && size <= RTP_PAYLOAD_SIZE);
+	assert(d->markers == 0);
+	d->packets++;
+	d->markers += marker;
+
+	if (type != H264_NAL_FU_A) {
+		assert(!d->in_fu);
+		memcpy(d->out + d->size, start_code, 4);
+		memcpy(d->out + d->size + 4, payload, size);
+		d->size += 4 + size;
+		return;
+	}
+
+	assert(size > 2);
+	if (payload[1] & 0x80) {
+		assert(!d->in_fu);
+		memcpy(d->out + d->size, start_code, 4);
+		d->out[d->size + 4] = (payload[0] & 0xe0) | (payload[1] & 0x1f);
+		d->size += 5;
+		d->in_fu = 1;
+	}
+	assert(d->in_fu);
+	memcpy(d->out + d->size, payload + 2, size - 2);
+	d->size += size - 2;
+	if (payload[1] & 0x40) {
+		d->in_fu = 0;
+	}
+}
+
+TEST(h264_stream_packetizes)
+{
+	const int width = 64, height = 48;
+	static const int types[] = { 7, 8, H264_NAL_IDR };
+	struct sw_h264 h264;
+	struct image img;
+	struct depacketizer d = { 0 };
+	struct h264_nal nal, sent;
+	uint8_t payload[RTP_PAYLOAD_SIZE];
+	uint8_t *stream;
+	size_t size, pos = 0, sent_pos = 0;
+	int i, n = 0;
+
+	sw_encode_h264_init(&h264, width, height);
+	image_init(&img, width, height);
+	srand(7);
+	for (i = 0; i < width * height; i++) {
+		img.y[i] = rand() % 3;
+	}
+
+	stream = malloc(sw_encode_h264_max_size(&h264));
+	size = sw_encode_h264_frame(&h264, &img.nv12, stream);
+	assert(size > 2 * RTP_PAYLOAD_SIZE);
+
+	/* Every NAL unit comes out whole, and only the last packet is
+	 * marked */
+	d.out = malloc(size + 4 * 64);
+	i = h264_packetize(stream, size, payload, sizeof(payload), 1,
+			depacketize, &d);
+	assert(i == d.packets);
+	assert(d.markers == 1);
+	assert(!d.in_fu);
+
+	while (h264_nal_next(stream, size, &pos, &nal)) {
+		assert(n < 3);
+		assert(nal.type == types[n]);
+		assert(h264_nal_next(d.out, d.size, &sent_pos, &sent));
+		assert(sent.type == nal.type);
+		assert(sent.size == nal.size);
+		assert(memcmp(d.out + sent.offset, stream + nal.offset,
+			      nal.size) == 0);
+		n++;
+	}
+	assert(n == 3);
+	assert(!h264_nal_next(d.out, d.size, &sent_pos, &sent));
+
+	free(d.out);
+	free(stream);
+	image_fini(&img);
+}
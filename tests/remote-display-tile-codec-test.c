@@ -0,0 +1,353 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/tile_codec.h"
+
+struct frame {
+	uint8_t *px;
+	int width, height, stride;
+};
+
+static void
+frame_init(struct frame *f, int width, int height)
+{
+	int x, y;
+
+	f->width = width;
+	f->height = height;
+	/* Padded rows, as captured buffers have */
+	f->stride = width * 4 + 64;
+	f->px = malloc(f->stride * height);
+	assert(f->px);
+
+	/* HMI-like content: flat bands with a gradient strip */
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			uint8_t *p = f->px + y * f->stride + x * 4;
+
+			p[0] = y < height / 2 ? 0x20 : x & 0xff;
+			p[1] = y < height / 4 ? 0x40 : 0x80;
+			p[2] = 0x10;
+			p[3] = 0xff;
+		}
+	}
+}
+
+static void
+fill_rect(struct frame *f, int x0, int y0, int w, int h, uint32_t value)
+{
+	int x, y;
+
+	for (y = y0; y < y0 + h; y++) {
+		for (x = x0; x < x0 + w; x++) {
+			memcpy(f->px + y * f->stride + x * 4, &value, 4);
+		}
+	}
+}
+
+static int
+frame_matches(const struct frame *f, const struct tile_decoder *dec)
+{
+	int y;
+
+	if (dec->width != f->width || dec->height != f->height) {
+		return 0;
+	}
+	for (y = 0; y < f->height; y++) {
+		if (memcmp(f->px + y * f->stride, dec->frame + y * dec->stride,
+				f->width * 4) != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static uint32_t
+tile_count(const uint8_t *out)
+{
+	return out[16] | out[17] << 8 | out[18] << 16 | (uint32_t) out[19] << 24;
+}
+
+TEST(crc32c_matches_reference)
+{
+	static const char check[] = "123456789";
+	uint8_t buf[1000];
+	size_t i, len;
+
+	assert(tile_crc32c_c(0, check, 9) == 0xe3069283);
+	assert(tile_crc32c(0, check, 9) == 0xe3069283);
+
+	/* Chained calls give the same result as one */
+	assert(tile_crc32c(tile_crc32c(0, check, 4), check + 4, 5) ==
+	       0xe3069283);
+
+	srand(43);
+	for (i = 0; i < sizeof(buf); i++) {
+		buf[i] = rand();
+	}
+	for (len = 0; len < 200; len++) {
+		assert(tile_crc32c(0, buf + len % 7, len) ==
+		       tile_crc32c_c(0, buf + len % 7, len));
+	}
+}
+
+TEST(unchanged_frame_sends_no_tiles)
+{
+	struct tile_encoder enc;
+	struct tile_decoder dec;
+	struct frame f;
+	uint8_t *out;
+	size_t size;
+	int key;
+
+	frame_init(&f, 256, 128);
+	assert(tile_encoder_init(&enc, 256, 128, 64, 0) == 0);
+	tile_decoder_init(&dec);
+	out = malloc(tile_encoder_max_size(&enc));
+	assert(out);
+
+	size = tile_encoder_frame(&enc, f.px, f.stride, 1, out, &key);
+	assert(key);
+	assert(tile_count(out) == 4 * 2);
+	assert(tile_decoder_apply(&dec, out, size) == 8);
+	assert(frame_matches(&f, &dec));
+
+	size = tile_encoder_frame(&enc, f.px, f.stride, 2, out, &key);
+	assert(!key);
+	assert(size == TILE_FRAME_HEADER_SIZE);
+	assert(tile_count(out) == 0);
+	assert(tile_decoder_apply(&dec, out, size) == 0);
+	assert(dec.frame_number == 2);
+	assert(frame_matches(&f, &dec));
+
+	free(out);
+	free(f.px);
+	tile_encoder_fini(&enc);
+	tile_decoder_fini(&dec);
+}
+
+/* A clock ticking in one corner of an otherwise static screen */
+TEST(clock_update_sends_only_its_tiles)
+{
+	struct tile_encoder enc;
+	struct tile_decoder dec;
+	struct frame f;
+	uint8_t *out;
+	size_t size, key_size;
+	uint32_t second;
+	int key;
+
+	frame_init(&f, 800, 480);
+	assert(tile_encoder_init(&enc, 800, 480, 64, 0) == 0);
+	tile_decoder_init(&dec);
+	out = malloc(tile_encoder_max_size(&enc));
+	assert(out);
+
+	key_size = tile_encoder_frame(&enc, f.px, f.stride, 0, out, &key);
+	assert(tile_decoder_apply(&dec, out, key_size) == 13 * 8);
+
+	for (second = 1; second < 10; second++) {
+		/* Digits inside tiles (11, 0) and (12, 0), and a seconds
+		 * hand straddling the boundary of (12, 0) and (12, 1) */
+		fill_rect(&f, 710, 8, 20, 24, 0xff000000 | second * 0x111111);
+		fill_rect(&f, 770, 40 + second, 8, 40, 0xffffffff - second);
+
+		size = tile_encoder_frame(&enc, f.px, f.stride, second, out,
+				&key);
+		assert(!key);
+		assert(tile_count(out) == 3);
+		assert(size < key_size / 10);
+		assert(tile_decoder_apply(&dec, out, size) == 3);
+		assert(frame_matches(&f, &dec));
+	}
+
+	free(out);
+	free(f.px);
+	tile_encoder_fini(&enc);
+	tile_decoder_fini(&dec);
+}
+
+TEST(noisy_tiles_are_sent_raw)
+{
+	struct tile_encoder enc;
+	struct tile_decoder dec;
+	struct frame f;
+	uint8_t *out;
+	size_t size;
+	int key, x, y;
+
+	frame_init(&f, 64, 32);
+	srand(7);
+	for (y = 0; y < 32; y++) {
+		for (x = 0; x < 32; x++) {
+			uint32_t v = rand();
+
+			memcpy(f.px + y * f.stride + x * 4, &v, 4);
+		}
+	}
+
+	assert(tile_encoder_init(&enc, 64, 32, 32, 0) == 0);
+	tile_decoder_init(&dec);
+	out = malloc(tile_encoder_max_size(&enc));
+	assert(out);
+
+	size = tile_encoder_frame(&enc, f.px, f.stride, 0, out, &key);
+	assert(tile_count(out) == 2);
+
+	/* First tile is noise and goes raw; the second is one band plus a
+	 * gradient and run-length codes */
+	assert(out[TILE_FRAME_HEADER_SIZE + 4] == TILE_ENCODING_RAW);
+	assert(out[TILE_FRAME_HEADER_SIZE + TILE_HEADER_SIZE + 32 * 32 * 4 + 4] ==
+	       TILE_ENCODING_RLE);
+	assert(size < TILE_FRAME_HEADER_SIZE + 2 * TILE_HEADER_SIZE +
+	       32 * 32 * 4 + 32 * 32 * 4 * 3 / 4);
+
+	assert(tile_decoder_apply(&dec, out, size) == 2);
+	assert(frame_matches(&f, &dec));
+
+	free(out);
+	free(f.px);
+	tile_encoder_fini(&enc);
+	tile_decoder_fini(&dec);
+}
+
+TEST(edge_tiles_are_cut_to_the_frame)
+{
+	struct tile_encoder enc;
+	struct tile_decoder dec;
+	struct frame f;
+	uint8_t *out;
+	size_t size;
+	int key;
+
+	frame_init(&f, 100, 70);
+	assert(tile_encoder_init(&enc, 100, 70, 32, 0) == 0);
+	tile_decoder_init(&dec);
+	out = malloc(tile_encoder_max_size(&enc));
+	assert(out);
+
+	size = tile_encoder_frame(&enc, f.px, f.stride, 0, out, &key);
+	assert(tile_count(out) == 4 * 3);
+	assert(tile_decoder_apply(&dec, out, size) == 12);
+	assert(frame_matches(&f, &dec));
+
+	/* Only the bottom right corner tile, 4x6 pixels */
+	fill_rect(&f, 97, 66, 3, 4, 0xff123456);
+	size = tile_encoder_frame(&enc, f.px, f.stride, 1, out, &key);
+	assert(tile_count(out) == 1);
+	assert(tile_decoder_apply(&dec, out, size) == 1);
+	assert(frame_matches(&f, &dec));
+
+	free(out);
+	free(f.px);
+	tile_encoder_fini(&enc);
+	tile_decoder_fini(&dec);
+}
+
+TEST(key_frames_follow_interval_and_requests)
+{
+	struct tile_encoder enc;
+	struct frame f;
+	uint8_t *out;
+	int key, i;
+
+	frame_init(&f, 128, 64);
+	assert(tile_encoder_init(&enc, 128, 64, 64, 3) == 0);
+	out = malloc(tile_encoder_max_size(&enc));
+	assert(out);
+
+	for (i = 0; i < 7; i++) {
+		tile_encoder_frame(&enc, f.px, f.stride, i, out, &key);
+		assert(key == (i % 3 == 0));
+		assert(tile_count(out) == (key ? 2u : 0u));
+	}
+
+	tile_encoder_force_key(&enc);
+	tile_encoder_frame(&enc, f.px, f.stride, i, out, &key);
+	assert(key);
+	assert(tile_count(out) == 2);
+
+	free(out);
+	free(f.px);
+	tile_encoder_fini(&enc);
+}
+
+TEST(decoder_rejects_bad_streams)
+{
+	struct tile_encoder enc;
+	struct tile_decoder dec;
+	struct frame f;
+	uint8_t *out;
+	size_t size;
+	int key;
+
+	frame_init(&f, 128, 64);
+	assert(tile_encoder_init(&enc, 128, 64, 64, 0) == 0);
+	tile_decoder_init(&dec);
+	out = malloc(tile_encoder_max_size(&enc));
+	assert(out);
+
+	size = tile_encoder_frame(&enc, f.px, f.stride, 0, out, &key);
+
+	/* Truncated, and trailing junk */
+	assert(tile_decoder_apply(&dec, out, size - 1) < 0);
+	assert(tile_decoder_apply(&dec, out, TILE_FRAME_HEADER_SIZE - 1) < 0);
+
+	/* A failed frame leaves the decoder waiting for a key frame */
+	assert(!dec.have_key);
+	fill_rect(&f, 0, 0, 4, 4, 0);
+	size = tile_encoder_frame(&enc, f.px, f.stride, 1, out, &key);
+	assert(!key);
+	assert(tile_decoder_apply(&dec, out, size) < 0);
+
+	tile_encoder_force_key(&enc);
+	size = tile_encoder_frame(&enc, f.px, f.stride, 2, out, &key);
+	assert(tile_decoder_apply(&dec, out, size) == 2);
+	assert(frame_matches(&f, &dec));
+
+	/* Tile index out of range */
+	fill_rect(&f, 0, 0, 4, 4, 1);
+	size = tile_encoder_frame(&enc, f.px, f.stride, 3, out, &key);
+	out[TILE_FRAME_HEADER_SIZE] = 2;
+	assert(tile_decoder_apply(&dec, out, size) < 0);
+
+	out[0] = 'X';
+	assert(tile_decoder_apply(&dec, out, size) < 0);
+
+	free(out);
+	free(f.px);
+	tile_encoder_fini(&enc);
+	tile_decoder_fini(&dec);
+}
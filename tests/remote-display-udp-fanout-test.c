@@ -0,0 +1,321 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/udp_fanout.h"
+
+#define NOW_US		1000000
+#define MAX_PACKET	1400
+
+/*
+ * Bytes the socket can still take, or -1 for no limit, and the error to
+ * fail with once it can't. Loopback frees each packet as soon as it is
+ * sent, so a real send buffer never fills in a test; this sendmmsg() takes
+ * the place of the C library's to stand in for one.
+ */
+static ssize_t send_space = -1;
+static int send_errno = EAGAIN;
+
+int
+sendmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen, int flags)
+{
+	unsigned int n = 0;
+
+	if (send_space >= 0) {
+		while (n < vlen && msgs[n].msg_hdr.msg_iov[0].iov_len <=
+				(size_t) send_space) {
+			send_space -= msgs[n].msg_hdr.msg_iov[0].iov_len;
+			n++;
+		}
+		if (n == 0) {
+			errno = send_errno;
+			return -1;
+		}
+		vlen = n;
+	}
+
+	return syscall(SYS_sendmmsg, fd, msgs, vlen, flags);
+}
+
+static int
+open_receiver(int *port)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	assert(fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	assert(getsockname(fd, (struct sockaddr *) &addr, &len) == 0);
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+/* Returns the size of the next packet, or -1 if none comes */
+static int
+receive(int fd, uint8_t *packet)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	if (poll(&pfd, 1, 1000) != 1) {
+		return -1;
+	}
+
+	return recv(fd, packet, MAX_PACKET, 0);
+}
+
+static void
+make_packet(uint8_t *packet, size_t size, int seq)
+{
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		packet[i] = seq + i;
+	}
+}
+
+TEST(client_lists_are_checked)
+{
+	struct udp_fanout fanout;
+
+	assert(udp_fanout_init(&fanout, "127.0.0.1:5000,10.0.0.2:6000", 0,
+				NULL, 0) == 0);
+	assert(fanout.num_dests == 2);
+	assert(fanout.dests[1].addr.sin_addr.s_addr == inet_addr("10.0.0.2"));
+	assert(ntohs(fanout.dests[1].addr.sin_port) == 6000);
+	assert(udp_fanout_dest_up(&fanout, 0));
+	udp_fanout_fini(&fanout);
+
+	assert(udp_fanout_init(&fanout, "", 0, NULL, 0) < 0);
+	assert(udp_fanout_init(&fanout, "127.0.0.1", 0, NULL, 0) < 0);
+	assert(udp_fanout_init(&fanout, "127.0.0.1:0", 0, NULL, 0) < 0);
+	assert(udp_fanout_init(&fanout, "localhost:5000", 0, NULL, 0) < 0);
+	assert(udp_fanout_init(&fanout, "1.1.1.1:1,1.1.1.1:2,1.1.1.1:3,"
+				"1.1.1.1:4,1.1.1.1:5,1.1.1.1:6,1.1.1.1:7,"
+				"1.1.1.1:8,1.1.1.1:9,1.1.1.1:10,1.1.1.1:11",
+				0, NULL, 0) < 0);
+}
+
+TEST(every_client_gets_each_packet)
+{
+	struct udp_fanout fanout;
+	uint8_t packet[MAX_PACKET], received[MAX_PACKET];
+	char clients[128];
+	int fd[3], port[3];
+	int i, seq;
+
+	for (i = 0; i < 3; i++) {
+		fd[i] = open_receiver(&port[i]);
+	}
+	snprintf(clients, sizeof(clients), "127.0.0.1:%d,127.0.0.1:%d,"
+			"127.0.0.1:%d", port[0], port[1], port[2]);
+	assert(udp_fanout_init(&fanout, clients, 0, NULL, 0) == 0);
+
+	for (seq = 0; seq < 50; seq++) {
+		make_packet(packet, 100 + seq * 20, seq);
+		assert(udp_fanout_send(&fanout, packet, 100 + seq * 20,
+					NOW_US) == 0);
+		for (i = 0; i < 3; i++) {
+			assert(receive(fd[i], received) == 100 + seq * 20);
+			assert(memcmp(received, packet, 100 + seq * 20) == 0);
+		}
+	}
+
+	for (i = 0; i < 3; i++) {
+		assert(fanout.dests[i].packets_sent == 50);
+		assert(fanout.dests[i].send_errors == 0);
+		close(fd[i]);
+	}
+	udp_fanout_fini(&fanout);
+}
+
+TEST(failed_client_backs_off_and_recovers)
+{
+	struct udp_fanout fanout;
+	uint8_t packet[MAX_PACKET], received[MAX_PACKET];
+	char clients[128];
+	uint64_t now = NOW_US;
+	int fd[3], port[3];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		fd[i] = open_receiver(&port[i]);
+	}
+
+	/* Broadcast without SO_BROADCAST fails every time */
+	snprintf(clients, sizeof(clients), "127.0.0.1:%d,255.255.255.255:%d,"
+			"127.0.0.1:%d", port[0], port[1], port[2]);
+	assert(udp_fanout_init(&fanout, clients, 0, NULL, 0) == 0);
+	make_packet(packet, 64, 0);
+
+	/* The failure doesn't keep the packet from the others */
+	assert(udp_fanout_send(&fanout, packet, 64, now) == 1);
+	assert(!udp_fanout_dest_up(&fanout, 1));
+	assert(fanout.dests[1].retry_us == now + UDP_FANOUT_RETRY_MIN_US);
+	assert(receive(fd[0], received) == 64);
+	assert(receive(fd[2], received) == 64);
+
+	/* Left alone until it's time to try again, then backs off further */
+	assert(udp_fanout_send(&fanout, packet, 64,
+				now + UDP_FANOUT_RETRY_MIN_US - 1) == 0);
+	assert(fanout.dests[1].send_errors == 1);
+	now += UDP_FANOUT_RETRY_MIN_US;
+	assert(udp_fanout_send(&fanout, packet, 64, now) == 1);
+	assert(fanout.dests[1].retry_us == now + 2 * UDP_FANOUT_RETRY_MIN_US);
+
+	/* Up to a limit */
+	for (i = 0; i < 20; i++) {
+		now = fanout.dests[1].retry_us;
+		assert(udp_fanout_send(&fanout, packet, 64, now) == 1);
+	}
+	assert(fanout.dests[1].retry_us == now + UDP_FANOUT_RETRY_MAX_US);
+	assert(fanout.dests[0].packets_sent == 23);
+
+	/* The next successful send brings it straight back */
+	fanout.dests[1].addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(udp_fanout_send(&fanout, packet, 64, now + 1) == 0);
+	assert(udp_fanout_send(&fanout, packet, 64,
+				now + UDP_FANOUT_RETRY_MAX_US) == 0);
+	assert(udp_fanout_dest_up(&fanout, 1));
+	assert(fanout.dests[1].packets_sent == 1);
+	assert(receive(fd[1], received) == 64);
+
+	for (i = 0; i < 3; i++) {
+		close(fd[i]);
+	}
+	udp_fanout_fini(&fanout);
+}
+
+TEST(full_socket_only_loses_the_packet)
+{
+	static const int errors[] = { EAGAIN, ENOBUFS, EINTR };
+	struct udp_fanout fanout;
+	uint8_t packet[MAX_PACKET], received[MAX_PACKET];
+	char clients[128];
+	int fd[3], port[3];
+	int i, seq;
+
+	for (i = 0; i < 3; i++) {
+		fd[i] = open_receiver(&port[i]);
+	}
+	snprintf(clients, sizeof(clients), "127.0.0.1:%d,127.0.0.1:%d,"
+			"127.0.0.1:%d", port[0], port[1], port[2]);
+	assert(udp_fanout_init(&fanout, clients, 0, NULL, 0) == 0);
+
+	/* Room for two packets to everyone, and the third to the first */
+	send_space = 7 * 100;
+	for (seq = 0; seq < 2; seq++) {
+		make_packet(packet, 100, seq);
+		assert(udp_fanout_send(&fanout, packet, 100, NOW_US) == 0);
+	}
+	make_packet(packet, 100, 2);
+	assert(udp_fanout_send(&fanout, packet, 100, NOW_US) == 2);
+	assert(fanout.dests[0].packets_sent == 3);
+
+	/* The rest aren't tried on a full socket, and nobody backs off */
+	for (i = 0; i < 3; i++) {
+		assert(udp_fanout_dest_up(&fanout, i));
+	}
+	assert(fanout.dests[1].send_errors == 1);
+	assert(fanout.dests[2].send_errors == 1);
+
+	/* Nor while it stays full, for whatever reason */
+	for (i = 0; i < 3; i++) {
+		send_errno = errors[i];
+		assert(udp_fanout_send(&fanout, packet, 100, NOW_US) == 3);
+	}
+	for (i = 0; i < 3; i++) {
+		assert(udp_fanout_dest_up(&fanout, i));
+	}
+
+	/* So the next packet reaches everyone as soon as there is room */
+	send_space = -1;
+	send_errno = EAGAIN;
+	make_packet(packet, 100, 3);
+	assert(udp_fanout_send(&fanout, packet, 100, NOW_US) == 0);
+	for (i = 0; i < 3; i++) {
+		for (seq = 0; seq < (i == 0 ? 3 : 2); seq++) {
+			assert(receive(fd[i], received) == 100);
+		}
+		assert(receive(fd[i], received) == 100);
+		assert(memcmp(received, packet, 100) == 0);
+		assert(fanout.dests[i].packets_sent == (i == 0 ? 4u : 3u));
+		close(fd[i]);
+	}
+	udp_fanout_fini(&fanout);
+}
+
+TEST(multicast_options_are_applied)
+{
+	struct udp_fanout fanout;
+	struct in_addr addr;
+	socklen_t len;
+	int ttl;
+
+	assert(udp_fanout_init(&fanout, "239.255.0.1:5000", 4, "127.0.0.1",
+				0) == 0);
+	len = sizeof(ttl);
+	assert(getsockopt(fanout.fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl,
+				&len) == 0);
+	assert(ttl == 4);
+	len = sizeof(addr);
+	assert(getsockopt(fanout.fd, IPPROTO_IP, IP_MULTICAST_IF, &addr,
+				&len) == 0);
+	assert(addr.s_addr == htonl(INADDR_LOOPBACK));
+	udp_fanout_fini(&fanout);
+
+	/* One hop by default */
+	assert(udp_fanout_init(&fanout, "127.0.0.1:5000,239.255.0.1:5000", 0,
+				NULL, 0) == 0);
+	len = sizeof(ttl);
+	assert(getsockopt(fanout.fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl,
+				&len) == 0);
+	assert(ttl == 1);
+	udp_fanout_fini(&fanout);
+
+	assert(udp_fanout_init(&fanout, "239.255.0.1:5000", 0, "eth0",
+				0) < 0);
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "weston-test-runner.h"
+
+#include "clients/RemoteDisplay/uring_writer.h"
+
+#define SKIP 77
+
+#define SLOT_SIZE	4096
+#define STREAM_SIZE	(2 * 1024 * 1024)
+
+/* Kernels without io_uring, or sandboxes that block it, skip these */
+static void
+require_uring(void)
+{
+	struct rd_uring ring;
+	int ret = rd_uring_init(&ring, 4);
+
+	if (ret == -ENOSYS || ret == -EPERM) {
+		fprintf(stderr, "io_uring not available\n");
+		exit(SKIP);
+	}
+	assert(ret == 0);
+	rd_uring_fini(&ring);
+}
+
+static uint8_t
+pattern(size_t i)
+{
+	return (uint8_t)(i * 7 + (i >> 11));
+}
+
+static uint8_t *
+make_stream(size_t size)
+{
+	uint8_t *stream = malloc(size);
+	size_t i;
+
+	assert(stream);
+	for (i = 0; i < size; i++) {
+		stream[i] = pattern(i);
+	}
+
+	return stream;
+}
+
+/* Frame sizes that straddle the buffers in every way */
+static size_t
+frame_size(int frame)
+{
+	static const size_t sizes[] = { 1, 4095, 4096, 4097, 100, 12000, 37 };
+
+	return sizes[frame % ARRAY_LENGTH(sizes)];
+}
+
+static int
+temp_file(void)
+{
+	char name[] = "/tmp/remote-display-uring-XXXXXX";
+	int fd = mkstemp(name);
+
+	assert(fd >= 0);
+	unlink(name);
+
+	return fd;
+}
+
+static void
+check_file(int fd, const uint8_t *expected, size_t offset, size_t size)
+{
+	uint8_t *contents = malloc(size);
+	struct stat st;
+
+	assert(contents);
+	assert(fstat(fd, &st) == 0);
+	assert((size_t) st.st_size == offset + size);
+	assert(pread(fd, contents, size, offset) == (ssize_t) size);
+	assert(memcmp(contents, expected, size) == 0);
+	free(contents);
+}
+
+static size_t
+write_frames(struct rd_uring_writer *writer, const uint8_t *stream,
+		size_t limit)
+{
+	size_t done = 0, size;
+	int frame;
+
+	for (frame = 0; done < limit; frame++) {
+		size = frame_size(frame);
+		if (size > limit - done) {
+			size = limit - done;
+		}
+		assert(rd_uring_writer_queue(writer, stream + done, size) == 0);
+		assert(rd_uring_writer_submit(writer) == 0);
+		done += size;
+	}
+
+	return done;
+}
+
+TEST(file_writes_land_in_order)
+{
+	struct rd_uring_writer writer;
+	uint8_t *stream;
+	size_t size;
+	int fd;
+
+	require_uring();
+	stream = make_stream(STREAM_SIZE / 8);
+
+	/* Carries on from what was already in the file */
+	fd = temp_file();
+	assert(write(fd, "hdr", 3) == 3);
+	assert(rd_uring_writer_init(&writer, fd, RD_URING_WRITE, 4, SLOT_SIZE,
+				0, 3) == 0);
+
+	size = write_frames(&writer, stream, STREAM_SIZE / 8);
+	assert(rd_uring_writer_flush(&writer) == 0);
+	assert(writer.bytes_pending == 0);
+	assert(writer.op_errors == 0);
+	rd_uring_writer_fini(&writer);
+
+	check_file(fd, stream, 3, size);
+	close(fd);
+	free(stream);
+}
+
+TEST(aligned_writes_pad_and_truncate)
+{
+	struct rd_uring_writer writer;
+	uint8_t *stream;
+	size_t size = 3 * SLOT_SIZE + 123;
+	int fd;
+
+	require_uring();
+	stream = make_stream(size);
+	fd = temp_file();
+
+	/* Only whole slots go out until the end, when the last block is
+	 * padded and cut back */
+	assert(rd_uring_writer_init(&writer, fd, RD_URING_WRITE, 2, SLOT_SIZE,
+				SLOT_SIZE, 1) == -EINVAL);
+	assert(rd_uring_writer_init(&writer, fd, RD_URING_WRITE, 2, SLOT_SIZE,
+				SLOT_SIZE, 0) == 0);
+	assert(rd_uring_writer_queue(&writer, stream, size) == 0);
+	assert(rd_uring_writer_submit(&writer) == 0);
+	assert(writer.filling >= 0);
+	assert(writer.slots[writer.filling].used == 123);
+	assert(rd_uring_writer_flush(&writer) == 0);
+	assert(writer.offset == 4 * SLOT_SIZE);
+	rd_uring_writer_fini(&writer);
+
+	check_file(fd, stream, 0, size);
+	close(fd);
+	free(stream);
+}
+
+struct receiver {
+	int listen_fd;
+	int fd;
+	uint8_t *data;
+	size_t size;
+	size_t received;
+	size_t stop_after;
+	pthread_t thread;
+};
+
+static void *
+receive_thread(void *data)
+{
+	struct receiver *receiver = data;
+	ssize_t n;
+
+	receiver->fd = accept(receiver->listen_fd, NULL, NULL);
+	assert(receiver->fd >= 0);
+
+	while (receiver->received < receiver->size) {
+		/* Read slowly in small pieces, so sends back up */
+		n = read(receiver->fd, receiver->data + receiver->received,
+				receiver->received < receiver->stop_after ?
+				1500 : 0);
+		if (n <= 0) {
+			break;
+		}
+		receiver->received += n;
+		if (receiver->received % 64 < 8) {
+			usleep(100);
+		}
+	}
+
+	close(receiver->fd);
+	return NULL;
+}
+
+static int
+connect_receiver(struct receiver *receiver, size_t size, size_t stop_after)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int sndbuf = 8192;
+	int fd;
+
+	memset(receiver, 0, sizeof(*receiver));
+	receiver->size = size;
+	receiver->stop_after = stop_after;
+	receiver->data = malloc(size);
+	assert(receiver->data);
+
+	receiver->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(receiver->listen_fd >= 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(receiver->listen_fd, (struct sockaddr *) &addr,
+				sizeof(addr)) == 0);
+	assert(getsockname(receiver->listen_fd, (struct sockaddr *) &addr,
+				&len) == 0);
+	assert(listen(receiver->listen_fd, 1) == 0);
+	assert(pthread_create(&receiver->thread, NULL, receive_thread,
+				receiver) == 0);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	assert(fd >= 0);
+	assert(setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf,
+				sizeof(sndbuf)) == 0);
+	assert(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+
+	return fd;
+}
+
+static void
+finish_receiver(struct receiver *receiver)
+{
+	pthread_join(receiver->thread, NULL);
+	close(receiver->listen_fd);
+}
+
+static void
+check_send(enum rd_uring_op op)
+{
+	struct rd_uring_writer writer;
+	struct receiver receiver;
+	uint8_t *stream;
+	size_t size;
+	int fd, ret;
+
+	require_uring();
+	stream = make_stream(STREAM_SIZE);
+	fd = connect_receiver(&receiver, STREAM_SIZE, STREAM_SIZE);
+
+	ret = rd_uring_writer_init(&writer, fd, op, 4, SLOT_SIZE, 0, 0);
+	if (ret == -EOPNOTSUPP) {
+		fprintf(stderr, "no zero-copy send\n");
+		exit(SKIP);
+	}
+	assert(ret == 0);
+
+	/* A chain has to wait for the one before, or a send that found the
+	 * socket full could be overtaken, and a buffer can't be reused until
+	 * the kernel is done with it. Either would garble the stream. */
+	size = write_frames(&writer, stream, STREAM_SIZE);
+	assert(size == STREAM_SIZE);
+	assert(rd_uring_writer_flush(&writer) == 0);
+	assert(writer.bytes_pending == 0);
+	assert(writer.sends_in_flight == 0);
+	assert(writer.op_errors == 0);
+	rd_uring_writer_fini(&writer);
+	close(fd);
+
+	finish_receiver(&receiver);
+	assert(receiver.received == STREAM_SIZE);
+	assert(memcmp(receiver.data, stream, STREAM_SIZE) == 0);
+	free(receiver.data);
+	free(stream);
+}
+
+TEST(sends_keep_stream_order)
+{
+	check_send(RD_URING_SEND);
+}
+
+TEST(zero_copy_sends_keep_stream_order)
+{
+	check_send(RD_URING_SEND_ZC);
+}
+
+TEST(send_errors_are_reported)
+{
+	struct rd_uring_writer writer;
+	struct receiver receiver;
+	uint8_t *stream;
+	int fd, ret = 0, i;
+
+	require_uring();
+	stream = make_stream(SLOT_SIZE * 4);
+
+	/* The receiver hangs up after the first few frames */
+	fd = connect_receiver(&receiver, STREAM_SIZE, 20000);
+	assert(rd_uring_writer_init(&writer, fd, RD_URING_SEND, 4, SLOT_SIZE,
+				0, 0) == 0);
+
+	for (i = 0; i < 10000 && ret == 0; i++) {
+		ret = rd_uring_writer_queue(&writer, stream, SLOT_SIZE * 4);
+		if (ret == 0) {
+			ret = rd_uring_writer_submit(&writer);
+		}
+	}
+	assert(ret < 0);
+	assert(writer.op_errors > 0);
+
+	/* And the error sticks */
+	assert(rd_uring_writer_queue(&writer, stream, 1) == ret);
+
+	rd_uring_writer_fini(&writer);
+	close(fd);
+	finish_receiver(&receiver);
+	free(receiver.data);
+	free(stream);
+}
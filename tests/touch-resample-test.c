@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2018 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial
+ * portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <time.h>
+
+#include "shared/timespec-util.h"
+#include "weston-test-client-helper.h"
+#include "wayland-server-protocol.h"
+
+/* tests/touch-resample.ini enables resampling with a 5 ms horizon */
+
+static const struct timespec t_down = { .tv_sec = 1, .tv_nsec = 0 };
+static const struct timespec t_move1 = { .tv_sec = 1, .tv_nsec = 10000000 };
+static const struct timespec t_move2 = { .tv_sec = 1, .tv_nsec = 20000000 };
+static const struct timespec t_up = { .tv_sec = 1, .tv_nsec = 30000000 };
+
+static void
+queue_touch(struct client *client, const struct timespec *time,
+	    int x, int y, uint32_t touch_type)
+{
+	uint32_t tv_sec_hi, tv_sec_lo, tv_nsec;
+
+	timespec_to_proto(time, &tv_sec_hi, &tv_sec_lo, &tv_nsec);
+	weston_test_send_touch(client->test->weston_test, tv_sec_hi, tv_sec_lo,
+			       tv_nsec, 0, wl_fixed_from_int(x),
+			       wl_fixed_from_int(y), touch_type);
+}
+
+static void
+wait_for_touch_frame(struct client *client, int frame_no)
+{
+	while (client->input->touch->frame_no < frame_no)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+TEST(touch_motion_is_predicted_at_frame)
+{
+	struct client *client = create_client_and_test_surface(0, 0, 100, 100);
+	struct touch *touch = client->input->touch;
+
+	/* Queued back to back so the server reads them in one dispatch */
+	queue_touch(client, &t_down, 10, 10, WL_TOUCH_DOWN);
+	queue_touch(client, &t_move1, 20, 10, WL_TOUCH_MOTION);
+	queue_touch(client, &t_move2, 30, 10, WL_TOUCH_MOTION);
+	wait_for_touch_frame(client, 1);
+
+	/* One motion for the frame, extrapolated 5 ms past the newest
+	 * sample at 1 px/ms */
+	assert(touch->down_x == 10 && touch->down_y == 10);
+	assert(touch->x == 35 && touch->y == 10);
+	assert(touch->motion_time_msec == 1025);
+	assert(touch->frame_no == 1);
+
+	queue_touch(client, &t_up, 0, 0, WL_TOUCH_UP);
+	client_roundtrip(client);
+	assert(touch->up_time_msec == 1030);
+}
+
+TEST(touch_up_flushes_pending_motion_unmodified)
+{
+	struct client *client = create_client_and_test_surface(0, 0, 100, 100);
+	struct touch *touch = client->input->touch;
+
+	queue_touch(client, &t_down, 10, 10, WL_TOUCH_DOWN);
+	queue_touch(client, &t_move1, 40, 50, WL_TOUCH_MOTION);
+	queue_touch(client, &t_up, 0, 0, WL_TOUCH_UP);
+	client_roundtrip(client);
+
+	/* The raw sample went out ahead of the up, with no prediction */
+	assert(touch->x == 40 && touch->y == 50);
+	assert(touch->motion_time_msec == 1010);
+	assert(touch->up_time_msec == 1030);
+}
@@ -25,12 +25,20 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <time.h>
 
 #include "input-timestamps-helper.h"
 #include "shared/timespec-util.h"
 #include "weston-test-client-helper.h"
 #include "wayland-server-protocol.h"
+#include "trace-reporter-client-protocol.h"
+
+#ifdef ENABLE_TRACING
+char *server_parameters = "--modules=weston-test.so,trace-reporter.so";
+#endif
+
+#define LATENCY_STAGES (TRACE_REPORTER_LATENCY_STAGE_CLIENT_COMMIT + 1)
 
 static const struct timespec t1 = { .tv_sec = 1, .tv_nsec = 1000001 };
 static const struct timespec t2 = { .tv_sec = 2, .tv_nsec = 2000001 };
@@ -121,3 +129,125 @@ TEST(touch_timestamps_stop_after_client_releases_wl_touch)
 
 	input_timestamps_destroy(input_ts);
 }
+
+struct latency_report {
+	uint32_t count[LATENCY_STAGES];
+	uint32_t bucket_total[LATENCY_STAGES];
+	bool done;
+};
+
+static void
+latency_handle_tracepoint(void *data, struct trace_reporter *reporter,
+			  const char *message, uint32_t time_sec,
+			  uint32_t time_usec)
+{
+}
+
+static void
+latency_handle_trace_end(void *data, struct trace_reporter *reporter)
+{
+	struct latency_report *report = data;
+
+	report->done = true;
+}
+
+static void
+latency_handle_histogram(void *data, struct trace_reporter *reporter,
+			 uint32_t stage, const char *name, uint32_t count,
+			 uint32_t mean_usec, uint32_t max_usec,
+			 struct wl_array *buckets)
+{
+	struct latency_report *report = data;
+	uint32_t *bucket;
+
+	assert(stage < LATENCY_STAGES);
+	assert(mean_usec <= max_usec);
+
+	report->count[stage] = count;
+	report->bucket_total[stage] = 0;
+	wl_array_for_each(bucket, buckets)
+		report->bucket_total[stage] += *bucket;
+}
+
+static const struct trace_reporter_listener latency_listener = {
+	latency_handle_tracepoint,
+	latency_handle_trace_end,
+	latency_handle_histogram,
+};
+
+static struct trace_reporter *
+bind_trace_reporter(struct client *client, struct latency_report *report)
+{
+	struct trace_reporter *reporter;
+	struct global *g;
+
+	wl_list_for_each(g, &client->global_list, link) {
+		if (strcmp(g->interface, "trace_reporter") == 0 &&
+		    g->version >= 2)
+			break;
+	}
+
+	if (&g->link == &client->global_list)
+		skip("trace_reporter v2 not available\n");
+
+	reporter = wl_registry_bind(client->wl_registry, g->name,
+				    &trace_reporter_interface, 2);
+	trace_reporter_add_listener(reporter, &latency_listener, report);
+
+	return reporter;
+}
+
+static void
+query_latency(struct client *client, struct trace_reporter *reporter,
+	      struct latency_report *report, uint32_t clear)
+{
+	memset(report, 0, sizeof *report);
+	trace_reporter_latency_report(reporter, clear);
+	while (!report->done)
+		assert(wl_display_dispatch(client->wl_display) >= 0);
+}
+
+TEST(touch_latency_is_reported_per_stage)
+{
+	struct client *client = create_touch_test_client();
+	struct latency_report report;
+	struct trace_reporter *reporter;
+	int i;
+
+	reporter = bind_trace_reporter(client, &report);
+
+	/* Drop whatever setting up the client produced */
+	query_latency(client, reporter, &report,
+		      TRACE_REPORTER_LOG_REPORT_CLEAR);
+
+	send_touch(client, &t1, WL_TOUCH_DOWN);
+	send_touch(client, &t2, WL_TOUCH_MOTION);
+	send_touch(client, &t3, WL_TOUCH_UP);
+
+	/* The client answers the three events with a single commit */
+	wl_surface_commit(client->surface->wl_surface);
+	client_roundtrip(client);
+
+	query_latency(client, reporter, &report,
+		      TRACE_REPORTER_LOG_REPORT_PRESERVE);
+
+	/* weston-test injects events, so nothing is read from a device */
+	assert(report.count[TRACE_REPORTER_LATENCY_STAGE_DEVICE_READ] == 0);
+	assert(report.count[TRACE_REPORTER_LATENCY_STAGE_SEAT_DISPATCH] == 3);
+	assert(report.count[TRACE_REPORTER_LATENCY_STAGE_PLUGIN_GRAB] == 3);
+	assert(report.count[TRACE_REPORTER_LATENCY_STAGE_CLIENT_SEND] == 3);
+	assert(report.count[TRACE_REPORTER_LATENCY_STAGE_CLIENT_COMMIT] == 1);
+
+	for (i = 0; i < LATENCY_STAGES; i++)
+		assert(report.bucket_total[i] == report.count[i]);
+
+	/* Clearing resets every stage */
+	query_latency(client, reporter, &report,
+		      TRACE_REPORTER_LOG_REPORT_CLEAR);
+	query_latency(client, reporter, &report,
+		      TRACE_REPORTER_LOG_REPORT_PRESERVE);
+	for (i = 0; i < LATENCY_STAGES; i++)
+		assert(report.count[i] == 0);
+
+	trace_reporter_destroy(reporter);
+}